@@ -342,6 +342,58 @@ infinoted_config_reload(InfinotedRun* run,
     }
   }
 
+  /* Compression and handshake settings apply to new connections */
+  if(run->xmpp6 != NULL)
+  {
+    g_object_set(
+      G_OBJECT(run->xmpp6),
+      "compression-level", startup->options->compression_level,
+      "compression-threshold", startup->options->compression_threshold,
+      "flush-latency", startup->options->flush_latency * 1000,
+      "tls-handshake-async", TRUE,
+      NULL
+    );
+  }
+
+  if(run->xmpp4 != NULL)
+  {
+    g_object_set(
+      G_OBJECT(run->xmpp4),
+      "compression-level", startup->options->compression_level,
+      "compression-threshold", startup->options->compression_threshold,
+      "flush-latency", startup->options->flush_latency * 1000,
+      "tls-handshake-async", TRUE,
+      NULL
+    );
+  }
+
+  /* Admission control applies to the TCP servers */
+  if(run->xmpp6 != NULL)
+  {
+    g_object_get(G_OBJECT(run->xmpp6), "tcp-server", &tcp6, NULL);
+    g_object_set(
+      G_OBJECT(tcp6),
+      "max-pending-handshakes", startup->options->max_pending_handshakes,
+      "handshake-timeout", startup->options->handshake_timeout,
+      "address-rate-limit", startup->options->address_rate_limit,
+      NULL
+    );
+    g_object_unref(tcp6);
+  }
+
+  if(run->xmpp4 != NULL)
+  {
+    g_object_get(G_OBJECT(run->xmpp4), "tcp-server", &tcp4, NULL);
+    g_object_set(
+      G_OBJECT(tcp4),
+      "max-pending-handshakes", startup->options->max_pending_handshakes,
+      "handshake-timeout", startup->options->handshake_timeout,
+      "address-rate-limit", startup->options->address_rate_limit,
+      NULL
+    );
+    g_object_unref(tcp4);
+  }
+
   /* Now, re-initialize plugins. This is a bit tricky, because it can fail,
    * and because we need to unload the previous plugins first.
    *
@@ -372,6 +424,24 @@ infinoted_config_reload(InfinotedRun* run,
     g_object_unref(filesystem_account_storage);
   }
 
+  /* Setting the IO again is a no-op for the old storage, and lets a new
+   * storage batch its writes in the same way. */
+  g_object_get(G_OBJECT(run->directory), "storage", &storage, NULL);
+  g_object_set(
+    G_OBJECT(storage),
+    "io", run->io,
+    "sync-writes", startup->options->sync_writes,
+    NULL
+  );
+  g_object_unref(storage);
+
+  g_object_set(
+    G_OBJECT(run->directory),
+    "memory-budget", (guint64)startup->options->memory_budget << 20,
+    "evict-sessions-in-use", startup->options->evict_in_use,
+    NULL
+  );
+
 #ifdef G_OS_WIN32
   module_path = g_win32_get_package_installation_directory_of_module(NULL);
   plugin_path = g_build_filename(module_path, "lib", PLUGIN_PATH, NULL);
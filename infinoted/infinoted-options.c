@@ -117,6 +117,109 @@ const InfinotedParameterInfo INFINOTED_OPTIONS[] = {
        "TLS. It is strongly encouraged to always require TLS. "
        "[Default=require-tls]"),
     N_("no-tls|allow-tls|require-tls")
+  }, {
+    "compression-level",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, compression_level),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The zlib compression level from 1 (fastest) to 9 (best) with which "
+       "connections to clients supporting stream compression are "
+       "compressed, or 0 to not compress connections. [Default=0]"),
+    N_("LEVEL")
+  }, {
+    "compression-threshold",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, compression_threshold),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("Messages to compressed connections smaller than this number of "
+       "bytes are sent without compressing them, so that small messages "
+       "are not delayed by compression. [Default=0]"),
+    N_("BYTES")
+  }, {
+    "flush-latency",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, flush_latency),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The number of milliseconds for which messages to a client are held "
+       "back so that they can be sent together with the following ones, "
+       "or 0 to send every message right away. [Default=0]"),
+    N_("MILLISECONDS")
+  }, {
+    "max-pending-handshakes",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, max_pending_handshakes),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The maximum number of connections that are still in their initial "
+       "handshake. When this many are pending, further clients wait in the "
+       "listen queue until one of them finishes, or 0 for no limit. "
+       "[Default=0]"),
+    N_("NUMBER")
+  }, {
+    "handshake-timeout",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, handshake_timeout),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The number of seconds after which connections are closed if their "
+       "initial handshake has not finished, or 0 for no timeout. Only "
+       "applies if max-pending-handshakes is set. [Default=30]"),
+    N_("SECONDS")
+  }, {
+    "address-rate-limit",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, address_rate_limit),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The maximum number of connections per minute accepted from the same "
+       "IP address, or from the same /64 network for IPv6. Connections "
+       "exceeding this rate are closed right away. 0 means no limit. "
+       "[Default=0]"),
+    N_("NUMBER")
+  }, {
+    "sync-writes",
+    INFINOTED_PARAMETER_BOOLEAN,
+    0,
+    offsetof(InfinotedOptions, sync_writes),
+    infinoted_parameter_convert_boolean,
+    0,
+    N_("Whether saved documents are flushed to disk before they replace the "
+       "previous version, so that they survive a power failure. Documents "
+       "written in the background at the same time are flushed together. "
+       "[Default=false]"),
+    N_("true|false")
+  }, {
+    "memory-budget",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, memory_budget),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The estimated number of megabytes that open documents may occupy. "
+       "When it is exceeded, the least recently used documents without "
+       "users are saved and unloaded early, or 0 for no limit. "
+       "[Default=0]"),
+    N_("MEGABYTES")
+  }, {
+    "evict-documents-in-use",
+    INFINOTED_PARAMETER_BOOLEAN,
+    0,
+    offsetof(InfinotedOptions, evict_in_use),
+    infinoted_parameter_convert_boolean,
+    0,
+    N_("Whether documents that users are editing are unloaded as well when "
+       "the memory budget is exceeded and no other document is left, which "
+       "unsubscribes these users. [Default=false]"),
+    N_("true|false")
   }, {
     "root-directory",
     INFINOTED_PARAMETER_STRING,
@@ -275,6 +378,30 @@ infinoted_options_validate(InfinotedOptions* options,
 
     return FALSE;
   }
+  else if(options->compression_level > 9)
+  {
+    g_set_error(
+      error,
+      infinoted_options_error_quark(),
+      INFINOTED_OPTIONS_ERROR_INVALID_NUMBER,
+      _("Compression level %u is not between 0 and 9"),
+      options->compression_level
+    );
+
+    return FALSE;
+  }
+  else if(options->flush_latency > G_MAXUINT / 1000)
+  {
+    g_set_error(
+      error,
+      infinoted_options_error_quark(),
+      INFINOTED_OPTIONS_ERROR_INVALID_NUMBER,
+      _("Flush latency %u is too large"),
+      options->flush_latency
+    );
+
+    return FALSE;
+  }
   else if(security_policy != INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED &&
           options->certificate_file == NULL)
   {
@@ -973,6 +1100,15 @@ infinoted_options_new(const gchar* const* config_files,
   options->port = inf_protocol_get_default_port();
   options->listen_address = NULL;
   options->security_policy = INF_XMPP_CONNECTION_SECURITY_ONLY_TLS;
+  options->compression_level = 0;
+  options->compression_threshold = 0;
+  options->flush_latency = 0;
+  options->max_pending_handshakes = 0;
+  options->handshake_timeout = 30;
+  options->address_rate_limit = 0;
+  options->sync_writes = FALSE;
+  options->memory_budget = 0;
+  options->evict_in_use = FALSE;
   options->root_directory =
     g_build_filename(g_get_home_dir(), ".infinote", NULL);
   options->plugins = g_malloc(2 * sizeof(gchar*));
@@ -41,6 +41,15 @@ struct _InfinotedOptions {
   guint port;
   InfIpAddress *listen_address;
   InfXmppConnectionSecurityPolicy security_policy;
+  guint compression_level;
+  guint compression_threshold;
+  guint flush_latency;
+  guint max_pending_handshakes;
+  guint handshake_timeout;
+  guint address_rate_limit;
+  gboolean sync_writes;
+  guint memory_budget;
+  gboolean evict_in_use;
   gchar* root_directory;
 
   gchar** plugins;
@@ -184,38 +184,35 @@ infinoted_pam_user_is_in_group(const gchar* username,
 }
 
 gboolean
-infinoted_pam_user_is_allowed(InfinotedStartup* startup,
+infinoted_pam_user_is_allowed(InfinotedLog* log,
+                              gchar* const* allowed_users,
+                              gchar* const* allowed_groups,
                               const gchar* username,
                               GError** error)
 {
-  InfinotedOptions* options;
-
   char* buf;
   long buf_size_gr, buf_size_pw, buf_size;
   gboolean status;
   GError* local_error;
 
-  gchar** iter;
-
-  options = startup->options;
+  gchar* const* iter;
 
-  if(options->pam_allowed_users == NULL
-     && options->pam_allowed_groups == NULL)
+  if(allowed_users == NULL && allowed_groups == NULL)
   {
     return TRUE;
   }
   else
   {
-    if(options->pam_allowed_users != NULL)
+    if(allowed_users != NULL)
     {
-      for(iter = options->pam_allowed_users; *iter; ++iter)
+      for(iter = allowed_users; *iter; ++iter)
       {
         if(strcmp(*iter, username) == 0)
           return TRUE;
       }
     }
 
-    if(options->pam_allowed_groups != NULL)
+    if(allowed_groups != NULL)
     {
       /* avoid reallocating this buffer over and over */
       buf_size_pw = sysconf(_SC_GETPW_R_SIZE_MAX);
@@ -225,10 +222,10 @@ infinoted_pam_user_is_allowed(InfinotedStartup* startup,
 
       status = FALSE;
       local_error = NULL;
-      for(iter = options->pam_allowed_groups; *iter; ++iter)
+      for(iter = allowed_groups; *iter; ++iter)
       {
         if(infinoted_pam_user_is_in_group(
-             username, *iter, buf, buf_size, startup->log, &local_error))
+             username, *iter, buf, buf_size, log, &local_error))
         {
           status = TRUE;
           break;
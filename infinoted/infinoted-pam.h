@@ -34,7 +34,9 @@
 G_BEGIN_DECLS
 
 gboolean
-infinoted_pam_user_is_allowed(InfinotedStartup* startup,
+infinoted_pam_user_is_allowed(InfinotedLog* log,
+                              gchar* const* allowed_users,
+                              gchar* const* allowed_groups,
                               const gchar* username,
                               GError** error);
 
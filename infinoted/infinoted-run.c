@@ -55,12 +55,32 @@ infinoted_run_load_directory(InfinotedRun* run,
 
   run->io = inf_standalone_io_new();
 
+  g_object_set(
+    G_OBJECT(communication_manager),
+    "io", run->io,
+    NULL
+  );
+
+  g_object_set(
+    G_OBJECT(storage),
+    "io", run->io,
+    "sync-writes", startup->options->sync_writes,
+    NULL
+  );
+
   run->directory = infd_directory_new(
     INF_IO(run->io),
     INFD_STORAGE(storage),
     communication_manager
   );
 
+  g_object_set(
+    G_OBJECT(run->directory),
+    "memory-budget", (guint64)startup->options->memory_budget << 20,
+    "evict-sessions-in-use", startup->options->evict_in_use,
+    NULL
+  );
+
   infd_directory_enable_chat(run->directory, TRUE);
 
   g_object_unref(communication_manager);
@@ -163,6 +183,9 @@ infinoted_run_create_server(InfinotedRun* run,
       "io", INF_IO(run->io),
       "local-address", address,
       "local-port", startup->options->port,
+      "max-pending-handshakes", startup->options->max_pending_handshakes,
+      "handshake-timeout", startup->options->handshake_timeout,
+      "address-rate-limit", startup->options->address_rate_limit,
       NULL
     )
   );
@@ -183,6 +206,15 @@ infinoted_run_create_server(InfinotedRun* run,
     startup->sasl_context ? "PLAIN" : NULL
   );
 
+  g_object_set(
+    G_OBJECT(xmpp),
+    "compression-level", startup->options->compression_level,
+    "compression-threshold", startup->options->compression_threshold,
+    "flush-latency", startup->options->flush_latency * 1000,
+    "tls-handshake-async", TRUE,
+    NULL
+  );
+
   infd_server_pool_add_server(run->pool, INFD_XML_SERVER(xmpp));
 
 #ifdef LIBINFINITY_HAVE_AVAHI
@@ -280,6 +280,132 @@ infinoted_startup_sasl_callback_set_error(InfXmppConnection* connection,
   }
 }
 
+#ifdef LIBINFINITY_HAVE_PAM
+/* A PAM authentication running in a worker thread. Everything it needs is
+ * copied, since the options can change with a config reload while it
+ * runs. */
+typedef struct _InfinotedStartupPamCheck InfinotedStartupPamCheck;
+struct _InfinotedStartupPamCheck {
+  InfXmppConnection* xmpp;
+  InfinotedLog* log;
+  gchar* service;
+  gchar* username;
+  gchar* password;
+  gchar** allowed_users;
+  gchar** allowed_groups;
+  gchar* remote_id;
+
+  /* Result, written by the worker thread */
+  gboolean authenticated;
+  gboolean allowed;
+  GError* error;
+};
+
+static void
+infinoted_startup_pam_check_free(gpointer data)
+{
+  InfinotedStartupPamCheck* check;
+  check = (InfinotedStartupPamCheck*)data;
+
+  g_object_unref(check->log);
+  g_free(check->service);
+  g_free(check->username);
+
+  if(check->password != NULL)
+  {
+    memset(check->password, 0, strlen(check->password));
+    g_free(check->password);
+  }
+
+  g_strfreev(check->allowed_users);
+  g_strfreev(check->allowed_groups);
+  g_free(check->remote_id);
+
+  if(check->error != NULL)
+    g_error_free(check->error);
+
+  g_slice_free(InfinotedStartupPamCheck, check);
+}
+
+static void
+infinoted_startup_pam_check_func(gpointer user_data)
+{
+  InfinotedStartupPamCheck* check;
+  check = (InfinotedStartupPamCheck*)user_data;
+
+  check->authenticated = infinoted_pam_authenticate(
+    check->service,
+    check->username,
+    check->password
+  );
+
+  if(check->authenticated)
+  {
+    check->allowed = infinoted_pam_user_is_allowed(
+      check->log,
+      check->allowed_users,
+      check->allowed_groups,
+      check->username,
+      &check->error
+    );
+  }
+}
+
+static void
+infinoted_startup_pam_check_done(InfSaslContextSession* session,
+                                 gpointer user_data)
+{
+  InfinotedStartupPamCheck* check;
+  check = (InfinotedStartupPamCheck*)user_data;
+
+  if(!check->authenticated)
+  {
+    infinoted_log_warning(
+      check->log,
+      _("User %s failed to log in from %s: PAM authentication failed"),
+      check->username,
+      check->remote_id
+    );
+
+    infinoted_startup_sasl_callback_set_error(
+      check->xmpp,
+      INF_AUTHENTICATION_DETAIL_ERROR_AUTHENTICATION_FAILED,
+      NULL
+    );
+
+    inf_sasl_context_session_continue(session, GSASL_AUTHENTICATION_ERROR);
+  }
+  else if(!check->allowed)
+  {
+    infinoted_log_warning(
+      check->log,
+      _("User %s failed to log in from %s: PAM user not allowed"),
+      check->username,
+      check->remote_id
+    );
+
+    infinoted_startup_sasl_callback_set_error(
+      check->xmpp,
+      INF_AUTHENTICATION_DETAIL_ERROR_USER_NOT_AUTHORIZED,
+      check->error
+    );
+
+    inf_sasl_context_session_continue(session, GSASL_AUTHENTICATION_ERROR);
+  }
+  else
+  {
+    infinoted_log_info(
+      check->log,
+      _("User %s logged in from %s via PAM"),
+      check->username,
+      check->remote_id
+    );
+
+    inf_sasl_context_session_continue(session, GSASL_OK);
+  }
+}
+#endif /* LIBINFINITY_HAVE_PAM */
+
 static void
 infinoted_startup_sasl_callback(InfSaslContextSession* session,
                                 Gsasl_property prop,
@@ -296,6 +422,7 @@ infinoted_startup_sasl_callback(InfSaslContextSession* session,
 
 #ifdef LIBINFINITY_HAVE_PAM
   const gchar* pam_service;
+  InfinotedStartupPamCheck* check;
   GError* error;
 #endif
   gchar* remote_id;
@@ -313,57 +440,42 @@ infinoted_startup_sasl_callback(InfSaslContextSession* session,
     pam_service = startup->options->pam_service;
     if(pam_service != NULL)
     {
+      check = g_slice_new(InfinotedStartupPamCheck);
+      check->xmpp = xmpp;
+      check->log = startup->log;
+      g_object_ref(check->log);
+      check->service = g_strdup(pam_service);
+      check->username = g_strdup(username);
+      check->password = g_strdup(password);
+      check->allowed_users = g_strdupv(startup->options->pam_allowed_users);
+      check->allowed_groups = g_strdupv(startup->options->pam_allowed_groups);
+      check->remote_id = g_strdup(remote_id);
+      check->authenticated = FALSE;
+      check->allowed = FALSE;
+      check->error = NULL;
+
+      /* PAM can take a long time, for example because of a delay after a
+       * failed attempt, so do not block the server while it runs. */
       error = NULL;
-      if(!infinoted_pam_authenticate(pam_service, username, password))
-      {
-        infinoted_log_warning(
-          startup->log,
-          _("User %s failed to log in from %s: PAM authentication failed"),
-          username,
-          remote_id
-        );
-
-        infinoted_startup_sasl_callback_set_error(
-          xmpp,
-          INF_AUTHENTICATION_DETAIL_ERROR_AUTHENTICATION_FAILED,
-          NULL
-        );
-
-        inf_sasl_context_session_continue(
-          session,
-          GSASL_AUTHENTICATION_ERROR
-        );
-      }
-      else if(!infinoted_pam_user_is_allowed(startup, username, &error))
+      if(!inf_sasl_context_session_run_in_worker(
+           session,
+           infinoted_startup_pam_check_func,
+           infinoted_startup_pam_check_done,
+           check,
+           infinoted_startup_pam_check_free,
+           &error))
       {
         infinoted_log_warning(
           startup->log,
-          _("User %s failed to log in from %s: PAM user not allowed"),
-          username,
-          remote_id
+          _("Failed to start PAM authentication in a worker thread: %s"),
+          error->message
         );
 
-        infinoted_startup_sasl_callback_set_error(
-          xmpp,
-          INF_AUTHENTICATION_DETAIL_ERROR_USER_NOT_AUTHORIZED,
-          error
-        );
-
-        inf_sasl_context_session_continue(
-          session,
-          GSASL_AUTHENTICATION_ERROR
-        );
-      }
-      else
-      {
-        infinoted_log_info(
-          startup->log,
-          _("User %s logged in from %s via PAM"),
-          username,
-          remote_id
-        );
+        g_error_free(error);
 
-        inf_sasl_context_session_continue(session, GSASL_OK);
+        infinoted_startup_pam_check_func(check);
+        infinoted_startup_pam_check_done(session, check);
+        infinoted_startup_pam_check_free(check);
       }
     }
     else
@@ -163,10 +163,6 @@ infinoted_plugin_autosave_save(InfinotedPluginAutosaveSessionInfo* info)
   }
   else
   {
-    /* TODO: Remove this as soon as directory itself unsets modified flag
-     * on session_write */
-    inf_buffer_set_modified(INF_BUFFER(buffer), FALSE);
-
     if(info->plugin->hook != NULL)
     {
       path = inf_browser_get_path(INF_BROWSER(directory), iter);
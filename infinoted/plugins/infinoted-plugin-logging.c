@@ -41,6 +41,8 @@ struct _InfinotedPluginLogging {
   gboolean log_connection_errors;
   gboolean log_session_errors;
   gboolean log_session_request_extra;
+  gboolean log_session_saves;
+  gboolean log_session_evictions;
 
   /* TODO: Make this a hash table, and use the thread ID as a key */
   gchar* extra_message;
@@ -373,6 +375,66 @@ infinoted_plugin_logging_notify_status_cb(InfSession* session,
   }
 }
 
+static void
+infinoted_plugin_logging_session_saved_cb(InfdDirectory* directory,
+                                          const InfBrowserIter* iter,
+                                          InfdSessionProxy* proxy,
+                                          guint64 bytes,
+                                          guint64 duration,
+                                          gpointer user_data)
+{
+  InfinotedPluginLogging* plugin;
+  gchar* path;
+
+  plugin = (InfinotedPluginLogging*)user_data;
+  path = inf_browser_get_path(INF_BROWSER(directory), iter);
+
+  infinoted_log_info(
+    infinoted_plugin_manager_get_log(plugin->manager),
+    _("Saved document \"%s\": %" G_GUINT64_FORMAT " bytes in %.3f ms"),
+    path,
+    bytes,
+    duration / 1000.0
+  );
+
+  g_free(path);
+}
+
+static void
+infinoted_plugin_logging_session_evicted_cb(InfdDirectory* directory,
+                                            const InfBrowserIter* iter,
+                                            InfdSessionProxy* proxy,
+                                            guint64 size,
+                                            gpointer user_data)
+{
+  InfinotedPluginLogging* plugin;
+  guint64 usage;
+  guint64 budget;
+  gchar* path;
+
+  plugin = (InfinotedPluginLogging*)user_data;
+  path = inf_browser_get_path(INF_BROWSER(directory), iter);
+
+  g_object_get(
+    G_OBJECT(directory),
+    "memory-usage", &usage,
+    "memory-budget", &budget,
+    NULL
+  );
+
+  infinoted_log_info(
+    infinoted_plugin_manager_get_log(plugin->manager),
+    _("Unloaded document \"%s\" of %" G_GUINT64_FORMAT " bytes; sessions "
+      "use %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " bytes"),
+    path,
+    size,
+    usage,
+    budget
+  );
+
+  g_free(path);
+}
+
 static void
 infinoted_plugin_logging_info_initialize(gpointer plugin_info)
 {
@@ -384,6 +446,8 @@ infinoted_plugin_logging_info_initialize(gpointer plugin_info)
   plugin->log_connection_errors = TRUE;
   plugin->log_session_errors = TRUE;
   plugin->log_session_request_extra = TRUE;
+  plugin->log_session_saves = TRUE;
+  plugin->log_session_evictions = TRUE;
 }
 
 static gboolean
@@ -403,6 +467,26 @@ infinoted_plugin_logging_initialize(InfinotedPluginManager* manager,
     plugin
   );
 
+  if(plugin->log_session_saves)
+  {
+    g_signal_connect(
+      G_OBJECT(infinoted_plugin_manager_get_directory(manager)),
+      "session-saved",
+      G_CALLBACK(infinoted_plugin_logging_session_saved_cb),
+      plugin
+    );
+  }
+
+  if(plugin->log_session_evictions)
+  {
+    g_signal_connect(
+      G_OBJECT(infinoted_plugin_manager_get_directory(manager)),
+      "session-evicted",
+      G_CALLBACK(infinoted_plugin_logging_session_evicted_cb),
+      plugin
+    );
+  }
+
   plugin->extra_message = NULL;
   plugin->current_session = NULL;
 
@@ -420,6 +504,24 @@ infinoted_plugin_logging_deinitialize(gpointer plugin_info)
     G_CALLBACK(infinoted_plugin_logging_log_message_cb),
     plugin
   );
+
+  if(plugin->log_session_saves)
+  {
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(infinoted_plugin_manager_get_directory(plugin->manager)),
+      G_CALLBACK(infinoted_plugin_logging_session_saved_cb),
+      plugin
+    );
+  }
+
+  if(plugin->log_session_evictions)
+  {
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(infinoted_plugin_manager_get_directory(plugin->manager)),
+      G_CALLBACK(infinoted_plugin_logging_session_evicted_cb),
+      plugin
+    );
+  }
 }
 
 static void
@@ -743,6 +845,26 @@ static const InfinotedParameterInfo INFINOTED_PLUGIN_LOGGING_OPTIONS[] = {
        "used for debugging purposes to find problems in the server "
        "implementation itself."),
     NULL
+  }, {
+    "log-session-saves",
+    INFINOTED_PARAMETER_BOOLEAN,
+    0,
+    offsetof(InfinotedPluginLogging, log_session_saves),
+    infinoted_parameter_convert_boolean,
+    0,
+    N_("Whether to write a log message with the number of bytes written "
+       "and the time it took when a document is saved to disk."),
+    NULL
+  }, {
+    "log-session-evictions",
+    INFINOTED_PARAMETER_BOOLEAN,
+    0,
+    offsetof(InfinotedPluginLogging, log_session_evictions),
+    infinoted_parameter_convert_boolean,
+    0,
+    N_("Whether to write a log message when a document is unloaded from "
+       "memory early to stay within the memory budget."),
+    NULL
   }, {
     NULL,
     0,
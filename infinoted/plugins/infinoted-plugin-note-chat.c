@@ -126,7 +126,8 @@ const InfdNotePlugin INFINOTED_PLUGIN_NOTE_CHAT_PLUGIN = {
   "InfChat",
   infinoted_plugin_note_chat_session_new,
   infinoted_plugin_note_chat_session_read,
-  infinoted_plugin_note_chat_session_write
+  infinoted_plugin_note_chat_session_write,
+  NULL
 };
 
 /* Infinoted plugin glue */
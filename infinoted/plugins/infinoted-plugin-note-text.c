@@ -24,14 +24,38 @@
 #include <libinftext/inf-text-default-buffer.h>
 #include <libinftext/inf-text-filesystem-format.h>
 
+#include <libinfinity/adopted/inf-adopted-user.h>
 #include <libinfinity/inf-i18n.h>
 
+#include <stddef.h>
+
 typedef struct _InfinotedPluginNoteText InfinotedPluginNoteText;
 struct _InfinotedPluginNoteText {
   InfinotedPluginManager* manager;
+  gboolean journal;
+  gboolean async_write;
+
+  InfdNotePlugin note_plugin;
   const InfdNotePlugin* plugin;
 };
 
+/* Key under which the InfTextFilesystemJournal of a session is stored */
+#define INFINOTED_PLUGIN_NOTE_TEXT_JOURNAL_KEY "inf-text-filesystem-journal"
+
+/* Key under which the estimated size of the text of a buffer is stored */
+#define INFINOTED_PLUGIN_NOTE_TEXT_SIZE_KEY "infinoted-plugin-note-text-size"
+
+/* Approximate memory overhead of a text segment in the buffer, and of a
+ * request in a user's request log, in bytes */
+#define INFINOTED_PLUGIN_NOTE_TEXT_SEGMENT_SIZE 64
+#define INFINOTED_PLUGIN_NOTE_TEXT_REQUEST_SIZE 256
+
+typedef struct _InfinotedPluginNoteTextWrite InfinotedPluginNoteTextWrite;
+struct _InfinotedPluginNoteTextWrite {
+  InfdNotePluginWriteFunc func;
+  gpointer user_data;
+};
+
 /* Note plugin implementation */
 static InfSession*
 infinoted_plugin_note_text_session_new(InfIo* io,
@@ -69,23 +93,45 @@ infinoted_plugin_note_text_session_read(InfdStorage* storage,
                                         gpointer user_data,
                                         GError** error)
 {
+  InfinotedPluginNoteText* plugin;
   InfUserTable* user_table;
   InfTextBuffer* buffer;
+  InfTextFilesystemJournal* journal;
   gboolean result;
   InfTextSession* session;
 
   g_assert(INFD_IS_FILESYSTEM_STORAGE(storage));
 
+  plugin = (InfinotedPluginNoteText*)user_data;
   user_table = inf_user_table_new();
   buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+  journal = NULL;
 
-  result = inf_text_filesystem_format_read(
-    INFD_FILESYSTEM_STORAGE(storage),
-    path,
-    user_table,
-    buffer,
-    error
-  );
+  if(plugin->journal == TRUE)
+  {
+    journal = inf_text_filesystem_journal_read(
+      INFD_FILESYSTEM_STORAGE(storage),
+      path,
+      user_table,
+      buffer,
+      error
+    );
+
+    result = (journal != NULL);
+  }
+  else
+  {
+    /* This also applies the journal of a document that has been saved
+     * while the journal was enabled, so no changes are lost when it is
+     * disabled again. */
+    result = inf_text_filesystem_format_read(
+      INFD_FILESYSTEM_STORAGE(storage),
+      path,
+      user_table,
+      buffer,
+      error
+    );
+  }
 
   if(result == FALSE)
   {
@@ -107,9 +153,156 @@ infinoted_plugin_note_text_session_read(InfdStorage* storage,
   g_object_unref(user_table);
   g_object_unref(buffer);
 
+  if(journal != NULL)
+  {
+    g_object_set_data_full(
+      G_OBJECT(session),
+      INFINOTED_PLUGIN_NOTE_TEXT_JOURNAL_KEY,
+      journal,
+      (GDestroyNotify)inf_text_filesystem_journal_free
+    );
+  }
+
   return INF_SESSION(session);
 }
 
+/* Returns the estimated size of the text of buffer, walking all of its
+ * segments */
+static gsize
+infinoted_plugin_note_text_get_text_size(InfTextBuffer* buffer)
+{
+  InfTextBufferIter* iter;
+  gsize size;
+
+  size = 0;
+  iter = inf_text_buffer_create_begin_iter(buffer);
+  if(iter != NULL)
+  {
+    do
+    {
+      size += INFINOTED_PLUGIN_NOTE_TEXT_SEGMENT_SIZE;
+      size += inf_text_buffer_iter_get_bytes(buffer, iter);
+    } while(inf_text_buffer_iter_next(buffer, iter));
+
+    inf_text_buffer_destroy_iter(buffer, iter);
+  }
+
+  return size;
+}
+
+static gsize
+infinoted_plugin_note_text_get_chunk_bytes(InfTextChunk* chunk)
+{
+  InfTextChunkIter iter;
+  gsize bytes;
+
+  bytes = 0;
+  if(inf_text_chunk_iter_init_begin(chunk, &iter))
+  {
+    do
+    {
+      bytes += inf_text_chunk_iter_get_bytes(&iter);
+    } while(inf_text_chunk_iter_next(&iter));
+  }
+
+  return bytes;
+}
+
+static void
+infinoted_plugin_note_text_text_inserted_cb(InfTextBuffer* buffer,
+                                            guint pos,
+                                            InfTextChunk* chunk,
+                                            InfUser* user,
+                                            gpointer user_data)
+{
+  gsize* size;
+  size = (gsize*)user_data;
+
+  *size += infinoted_plugin_note_text_get_chunk_bytes(chunk);
+}
+
+static void
+infinoted_plugin_note_text_text_erased_cb(InfTextBuffer* buffer,
+                                          guint pos,
+                                          InfTextChunk* chunk,
+                                          InfUser* user,
+                                          gpointer user_data)
+{
+  gsize* size;
+  gsize bytes;
+
+  size = (gsize*)user_data;
+  bytes = infinoted_plugin_note_text_get_chunk_bytes(chunk);
+
+  if(*size > bytes)
+    *size -= bytes;
+  else
+    *size = 0;
+}
+
+/* Returns where the estimated size of the text of buffer is stored. The
+ * estimate is made once by walking all segments, and then kept up to date
+ * with the number of bytes inserted and erased, so that it is cheap to
+ * query. Since a change can merge or split segments, the segment overhead
+ * is only updated when the estimate is made again, such as when the buffer
+ * is written. */
+static gsize*
+infinoted_plugin_note_text_lookup_text_size(InfTextBuffer* buffer)
+{
+  gsize* size;
+
+  size = g_object_get_data(
+    G_OBJECT(buffer),
+    INFINOTED_PLUGIN_NOTE_TEXT_SIZE_KEY
+  );
+
+  if(size == NULL)
+  {
+    size = g_new(gsize, 1);
+    *size = infinoted_plugin_note_text_get_text_size(buffer);
+
+    g_object_set_data_full(
+      G_OBJECT(buffer),
+      INFINOTED_PLUGIN_NOTE_TEXT_SIZE_KEY,
+      size,
+      g_free
+    );
+
+    g_signal_connect(
+      G_OBJECT(buffer),
+      "text-inserted",
+      G_CALLBACK(infinoted_plugin_note_text_text_inserted_cb),
+      size
+    );
+
+    g_signal_connect(
+      G_OBJECT(buffer),
+      "text-erased",
+      G_CALLBACK(infinoted_plugin_note_text_text_erased_cb),
+      size
+    );
+  }
+
+  return size;
+}
+
+/* Makes the size estimate of the text of buffer exact again, if there is
+ * one. This is done when the buffer is written, which walks all of its
+ * segments anyway. */
+static void
+infinoted_plugin_note_text_update_text_size(InfTextBuffer* buffer)
+{
+  gsize* size;
+
+  size = g_object_get_data(
+    G_OBJECT(buffer),
+    INFINOTED_PLUGIN_NOTE_TEXT_SIZE_KEY
+  );
+
+  if(size != NULL)
+    *size = infinoted_plugin_note_text_get_text_size(buffer);
+}
+
 static gboolean
 infinoted_plugin_note_text_session_write(InfdStorage* storage,
                                          InfSession* session,
@@ -117,13 +310,141 @@ infinoted_plugin_note_text_session_write(InfdStorage* storage,
                                          gpointer user_data,
                                          GError** error)
 {
-  return inf_text_filesystem_format_write(
+  InfinotedPluginNoteText* plugin;
+  InfTextFilesystemJournal* journal;
+
+  plugin = (InfinotedPluginNoteText*)user_data;
+  if(plugin->journal == FALSE)
+  {
+    infinoted_plugin_note_text_update_text_size(
+      INF_TEXT_BUFFER(inf_session_get_buffer(session))
+    );
+
+    return inf_text_filesystem_format_write(
+      INFD_FILESYSTEM_STORAGE(storage),
+      path,
+      inf_session_get_user_table(session),
+      INF_TEXT_BUFFER(inf_session_get_buffer(session)),
+      error
+    );
+  }
+
+  journal = g_object_get_data(
+    G_OBJECT(session),
+    INFINOTED_PLUGIN_NOTE_TEXT_JOURNAL_KEY
+  );
+
+  /* Sessions that were not read from the storage, such as new documents,
+   * start recording with their first write. */
+  if(journal == NULL)
+  {
+    journal = inf_text_filesystem_journal_new(
+      inf_session_get_user_table(session),
+      INF_TEXT_BUFFER(inf_session_get_buffer(session))
+    );
+
+    g_object_set_data_full(
+      G_OBJECT(session),
+      INFINOTED_PLUGIN_NOTE_TEXT_JOURNAL_KEY,
+      journal,
+      (GDestroyNotify)inf_text_filesystem_journal_free
+    );
+  }
+
+  return inf_text_filesystem_journal_write(
+    journal,
+    INFD_FILESYSTEM_STORAGE(storage),
+    path,
+    error
+  );
+}
+
+static void
+infinoted_plugin_note_text_write_func(InfdFilesystemStorage* storage,
+                                      const GError* error,
+                                      gpointer user_data)
+{
+  InfinotedPluginNoteTextWrite* write;
+  write = (InfinotedPluginNoteTextWrite*)user_data;
+
+  write->func(error, write->user_data);
+  g_slice_free(InfinotedPluginNoteTextWrite, write);
+}
+
+/* Only used if the async-write option is set and the journal is not */
+static gboolean
+infinoted_plugin_note_text_session_write_async(
+  InfdStorage* storage,
+  InfSession* session,
+  const gchar* path,
+  gpointer user_data,
+  InfdNotePluginWriteFunc func,
+  gpointer func_data,
+  GError** error)
+{
+  InfinotedPluginNoteText* plugin;
+  InfinotedPluginNoteTextWrite* write;
+  gboolean result;
+
+  plugin = (InfinotedPluginNoteText*)user_data;
+
+  write = g_slice_new(InfinotedPluginNoteTextWrite);
+  write->func = func;
+  write->user_data = func_data;
+
+  infinoted_plugin_note_text_update_text_size(
+    INF_TEXT_BUFFER(inf_session_get_buffer(session))
+  );
+
+  result = inf_text_filesystem_format_write_async(
     INFD_FILESYSTEM_STORAGE(storage),
+    infinoted_plugin_manager_get_io(plugin->manager),
     path,
     inf_session_get_user_table(session),
     INF_TEXT_BUFFER(inf_session_get_buffer(session)),
+    infinoted_plugin_note_text_write_func,
+    write,
     error
   );
+
+  if(result == FALSE)
+    g_slice_free(InfinotedPluginNoteTextWrite, write);
+
+  return result;
+}
+
+static void
+infinoted_plugin_note_text_session_size_foreach_user_func(InfUser* user,
+                                                          gpointer user_data)
+{
+  InfAdoptedRequestLog* log;
+  gsize* size;
+
+  size = (gsize*)user_data;
+  log = inf_adopted_user_get_request_log(INF_ADOPTED_USER(user));
+
+  *size += INFINOTED_PLUGIN_NOTE_TEXT_REQUEST_SIZE *
+    (inf_adopted_request_log_get_end(log) -
+     inf_adopted_request_log_get_begin(log));
+}
+
+static gsize
+infinoted_plugin_note_text_session_size(InfSession* session,
+                                        gpointer user_data)
+{
+  gsize size;
+
+  size = *infinoted_plugin_note_text_lookup_text_size(
+    INF_TEXT_BUFFER(inf_session_get_buffer(session))
+  );
+
+  inf_user_table_foreach_user(
+    inf_session_get_user_table(session),
+    infinoted_plugin_note_text_session_size_foreach_user_func,
+    &size
+  );
+
+  return size;
 }
 
 const InfdNotePlugin INFINOTED_PLUGIN_NOTE_TEXT_PLUGIN = {
@@ -132,7 +453,8 @@ const InfdNotePlugin INFINOTED_PLUGIN_NOTE_TEXT_PLUGIN = {
   "InfText",
   infinoted_plugin_note_text_session_new,
   infinoted_plugin_note_text_session_read,
-  infinoted_plugin_note_text_session_write
+  infinoted_plugin_note_text_session_write,
+  infinoted_plugin_note_text_session_size
 };
 
 /* Infinoted plugin glue */
@@ -143,6 +465,8 @@ infinoted_plugin_note_text_info_initialize(gpointer plugin_info)
   plugin = (InfinotedPluginNoteText*)plugin_info;
 
   plugin->manager = NULL;
+  plugin->journal = FALSE;
+  plugin->async_write = FALSE;
   plugin->plugin = NULL;
 }
 
@@ -158,9 +482,20 @@ infinoted_plugin_note_text_initialize(InfinotedPluginManager* manager,
 
   plugin->manager = manager;
 
+  plugin->note_plugin = INFINOTED_PLUGIN_NOTE_TEXT_PLUGIN;
+  plugin->note_plugin.user_data = plugin;
+
+  /* The journal is appended to synchronously, since it only ever writes
+   * the changes made since the previous save */
+  if(plugin->async_write == TRUE && plugin->journal == FALSE)
+  {
+    plugin->note_plugin.session_write_async =
+      infinoted_plugin_note_text_session_write_async;
+  }
+
   result = infd_directory_add_plugin(
     infinoted_plugin_manager_get_directory(manager),
-    &INFINOTED_PLUGIN_NOTE_TEXT_PLUGIN
+    &plugin->note_plugin
   );
 
   if(result != TRUE)
@@ -176,7 +511,7 @@ infinoted_plugin_note_text_initialize(InfinotedPluginManager* manager,
     return FALSE;
   }
 
-  plugin->plugin = &INFINOTED_PLUGIN_NOTE_TEXT_PLUGIN;
+  plugin->plugin = &plugin->note_plugin;
   return TRUE;
 }
 
@@ -184,6 +519,8 @@ static void
 infinoted_plugin_note_text_deinitialize(gpointer plugin_info)
 {
   InfinotedPluginNoteText* plugin;
+  InfdStorage* storage;
+
   plugin = (InfinotedPluginNoteText*)plugin_info;
 
   /* Note that this kills all sessions with that particular type. This is
@@ -198,12 +535,41 @@ infinoted_plugin_note_text_deinitialize(gpointer plugin_info)
       plugin->plugin
     );
 
+    /* Pending writes call back into the plugin */
+    storage = infd_directory_get_storage(
+      infinoted_plugin_manager_get_directory(plugin->manager)
+    );
+
+    if(INFD_IS_FILESYSTEM_STORAGE(storage))
+      infd_filesystem_storage_flush(INFD_FILESYSTEM_STORAGE(storage));
+
     plugin->plugin = NULL;
   }
 }
 
 static const InfinotedParameterInfo INFINOTED_PLUGIN_NOTE_TEXT_OPTIONS[] = {
   {
+    "journal",
+    INFINOTED_PARAMETER_BOOLEAN,
+    0,
+    offsetof(InfinotedPluginNoteText, journal),
+    infinoted_parameter_convert_boolean,
+    0,
+    N_("Whether to append the changes to a document to a journal when "
+       "saving it, instead of writing the whole document each time."),
+    NULL
+  }, {
+    "async-write",
+    INFINOTED_PARAMETER_BOOLEAN,
+    0,
+    offsetof(InfinotedPluginNoteText, async_write),
+    infinoted_parameter_convert_boolean,
+    0,
+    N_("Whether to write documents that are unloaded from memory to disk "
+       "in a background thread, so that a slow disk does not delay editing. "
+       "Not used together with the journal."),
+    NULL
+  }, {
     NULL,
     0,
     0,
@@ -0,0 +1,1047 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#include <infinoted/infinoted-plugin-manager.h>
+#include <infinoted/infinoted-parameter.h>
+#include <infinoted/infinoted-log.h>
+#include <infinoted/plugins/util/infinoted-plugin-util-navigate-browser.h>
+
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/server/infd-session-proxy.h>
+#include <libinfinity/common/inf-async-operation.h>
+#include <libinfinity/common/inf-xml-util.h>
+
+#include <libinfinity/inf-signals.h>
+#include <libinfinity/inf-i18n.h>
+
+#include <glib/gstdio.h>
+
+#include <string.h>
+
+/* Time after which modified usage counts are written to disk, in seconds */
+#define INFINOTED_PLUGIN_WARMUP_SAVE_INTERVAL 300
+
+/* Time in which usage counts drop to half, in seconds, so that documents
+ * that are not used anymore make room for others eventually */
+#define INFINOTED_PLUGIN_WARMUP_HALF_LIFE (7 * 24 * 60 * 60)
+
+typedef struct _InfinotedPluginWarmup InfinotedPluginWarmup;
+struct _InfinotedPluginWarmup {
+  InfinotedPluginManager* manager;
+  gchar** notes;
+  guint max_notes;
+  guint hold_time;
+
+  /* Number of subscriptions by path, across server restarts */
+  GHashTable* usage;
+  /* Time up to which the usage counts have decayed, in seconds since the
+   * epoch */
+  gint64 decay_time;
+  InfIoTimeout* save_timeout;
+
+  InfIoTimeout* start_timeout;
+  GSList* prefetches;
+  guint n_loaded;
+  gint64 start_time;
+
+  /* Warmed-up sessions which nobody has subscribed to yet, by proxy */
+  GHashTable* holds;
+};
+
+typedef struct _InfinotedPluginWarmupSessionInfo
+  InfinotedPluginWarmupSessionInfo;
+struct _InfinotedPluginWarmupSessionInfo {
+  InfinotedPluginWarmup* plugin;
+  InfSessionProxy* proxy;
+  gchar* path;
+};
+
+/* A note whose file is read by a worker thread before it is loaded, so
+ * that loading it in the main thread does not wait for the disk. */
+typedef struct _InfinotedPluginWarmupPrefetch InfinotedPluginWarmupPrefetch;
+struct _InfinotedPluginWarmupPrefetch {
+  InfinotedPluginWarmup* plugin;
+  InfAsyncOperation* operation;
+  gchar* path;
+  gchar* filename;
+};
+
+typedef struct _InfinotedPluginWarmupHold InfinotedPluginWarmupHold;
+struct _InfinotedPluginWarmupHold {
+  InfinotedPluginWarmup* plugin;
+  InfSessionProxy* proxy;
+  InfIoTimeout* timeout;
+};
+
+typedef struct _InfinotedPluginWarmupUsage InfinotedPluginWarmupUsage;
+struct _InfinotedPluginWarmupUsage {
+  const gchar* path;
+  guint count;
+};
+
+/*
+ * Usage counts
+ */
+
+/* Halves the usage counts once for every half-life that has passed since
+ * they have last decayed, and drops the ones that reach zero. Returns
+ * whether any count has changed. */
+static gboolean
+infinoted_plugin_warmup_decay_usage(InfinotedPluginWarmup* plugin)
+{
+  GHashTableIter iter;
+  gpointer value;
+  gint64 now;
+  gint64 n_halvings;
+  guint count;
+
+  now = g_get_real_time() / G_USEC_PER_SEC;
+
+  /* The clock has been set back */
+  if(now < plugin->decay_time)
+    plugin->decay_time = now;
+
+  n_halvings = (now - plugin->decay_time) / INFINOTED_PLUGIN_WARMUP_HALF_LIFE;
+  if(n_halvings == 0)
+    return FALSE;
+
+  plugin->decay_time += n_halvings * INFINOTED_PLUGIN_WARMUP_HALF_LIFE;
+
+  g_hash_table_iter_init(&iter, plugin->usage);
+  while(g_hash_table_iter_next(&iter, NULL, &value))
+  {
+    count = 0;
+    if(n_halvings < 32)
+      count = GPOINTER_TO_UINT(value) >> n_halvings;
+
+    if(count == 0)
+      g_hash_table_iter_remove(&iter);
+    else
+      g_hash_table_iter_replace(&iter, GUINT_TO_POINTER(count));
+  }
+
+  return TRUE;
+}
+
+static gboolean
+infinoted_plugin_warmup_read_usage(InfinotedPluginWarmup* plugin,
+                                   GError** error)
+{
+  InfdStorage* storage;
+  xmlDocPtr doc;
+  xmlNodePtr root;
+  xmlNodePtr child;
+  xmlChar* path;
+  guint count;
+  guint decay_time;
+  gboolean result;
+  GError* local_error;
+
+  storage = infd_directory_get_storage(
+    infinoted_plugin_manager_get_directory(plugin->manager)
+  );
+
+  local_error = NULL;
+
+  doc = infd_filesystem_storage_read_xml_file(
+    INFD_FILESYSTEM_STORAGE(storage),
+    "xml",
+    "/warmup-usage",
+    "infinoted-warmup-usage",
+    &local_error
+  );
+
+  if(local_error != NULL)
+  {
+    if(local_error->domain == G_FILE_ERROR &&
+       local_error->code == G_FILE_ERROR_NOENT)
+    {
+      /* No note has been used yet */
+      g_error_free(local_error);
+      return TRUE;
+    }
+
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  /* Without a decay time the counts start to decay now */
+  root = xmlDocGetRootElement(doc);
+  result = inf_xml_util_get_attribute_uint(
+    root,
+    "decay-time",
+    &decay_time,
+    &local_error
+  );
+
+  if(local_error != NULL)
+  {
+    g_propagate_error(error, local_error);
+    xmlFreeDoc(doc);
+    return FALSE;
+  }
+
+  if(result == TRUE)
+    plugin->decay_time = decay_time;
+
+  for(child = root->children;
+      child != NULL;
+      child = child->next)
+  {
+    if(child->type != XML_ELEMENT_NODE) continue;
+    if(strcmp((const char*)child->name, "note") != 0) continue;
+
+    path = inf_xml_util_get_attribute_required(child, "path", error);
+    if(path == NULL)
+    {
+      xmlFreeDoc(doc);
+      return FALSE;
+    }
+
+    if(!inf_xml_util_get_attribute_uint_required(child, "count", &count,
+                                                 error))
+    {
+      xmlFree(path);
+      xmlFreeDoc(doc);
+      return FALSE;
+    }
+
+    g_hash_table_insert(
+      plugin->usage,
+      g_strdup((const gchar*)path),
+      GUINT_TO_POINTER(count)
+    );
+
+    xmlFree(path);
+  }
+
+  xmlFreeDoc(doc);
+  return TRUE;
+}
+
+static void
+infinoted_plugin_warmup_write_usage(InfinotedPluginWarmup* plugin)
+{
+  InfdStorage* storage;
+  xmlDocPtr doc;
+  xmlNodePtr root;
+  xmlNodePtr child;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+  GError* error;
+
+  storage = infd_directory_get_storage(
+    infinoted_plugin_manager_get_directory(plugin->manager)
+  );
+
+  doc = xmlNewDoc((const xmlChar*)"1.0");
+  root = xmlNewDocNode(
+    doc,
+    NULL,
+    (const xmlChar*)"infinoted-warmup-usage",
+    NULL
+  );
+
+  xmlDocSetRootElement(doc, root);
+
+  infinoted_plugin_warmup_decay_usage(plugin);
+  inf_xml_util_set_attribute_uint(root, "decay-time", plugin->decay_time);
+
+  g_hash_table_iter_init(&iter, plugin->usage);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+  {
+    child = xmlNewChild(root, NULL, (const xmlChar*)"note", NULL);
+    inf_xml_util_set_attribute(child, "path", (const gchar*)key);
+    inf_xml_util_set_attribute_uint(child, "count", GPOINTER_TO_UINT(value));
+  }
+
+  error = NULL;
+  if(!infd_filesystem_storage_write_xml_file(
+       INFD_FILESYSTEM_STORAGE(storage),
+       "xml",
+       "/warmup-usage",
+       doc,
+       &error))
+  {
+    infinoted_log_warning(
+      infinoted_plugin_manager_get_log(plugin->manager),
+      _("Failed to write document usage counts: %s"),
+      error->message
+    );
+
+    g_error_free(error);
+  }
+
+  xmlFreeDoc(doc);
+}
+
+static void
+infinoted_plugin_warmup_save_timeout_cb(gpointer user_data)
+{
+  InfinotedPluginWarmup* plugin;
+  plugin = (InfinotedPluginWarmup*)user_data;
+
+  plugin->save_timeout = NULL;
+  infinoted_plugin_warmup_write_usage(plugin);
+}
+
+/* Writes the usage counts to disk after a while */
+static void
+infinoted_plugin_warmup_usage_changed(InfinotedPluginWarmup* plugin)
+{
+  if(plugin->save_timeout == NULL)
+  {
+    plugin->save_timeout = inf_io_add_timeout(
+      infinoted_plugin_manager_get_io(plugin->manager),
+      INFINOTED_PLUGIN_WARMUP_SAVE_INTERVAL * 1000,
+      infinoted_plugin_warmup_save_timeout_cb,
+      plugin,
+      NULL
+    );
+  }
+}
+
+/* Drops the usage counts of the note at path, or of all notes below it if
+ * it is a subdirectory */
+static void
+infinoted_plugin_warmup_remove_usage(InfinotedPluginWarmup* plugin,
+                                     const gchar* path)
+{
+  GHashTableIter iter;
+  gpointer key;
+  gsize len;
+  gboolean changed;
+
+  len = strlen(path);
+  changed = FALSE;
+
+  g_hash_table_iter_init(&iter, plugin->usage);
+  while(g_hash_table_iter_next(&iter, &key, NULL))
+  {
+    /* The root directory is "/", and all other paths do not end with a
+     * slash */
+    if(strncmp((const gchar*)key, path, len) == 0 &&
+       (((const gchar*)key)[len] == '\0' || ((const gchar*)key)[len] == '/' ||
+        path[len - 1] == '/'))
+    {
+      g_hash_table_iter_remove(&iter);
+      changed = TRUE;
+    }
+  }
+
+  if(changed == TRUE)
+    infinoted_plugin_warmup_usage_changed(plugin);
+}
+
+static gint
+infinoted_plugin_warmup_usage_compare_func(gconstpointer first,
+                                           gconstpointer second)
+{
+  const InfinotedPluginWarmupUsage* first_usage;
+  const InfinotedPluginWarmupUsage* second_usage;
+
+  first_usage = (const InfinotedPluginWarmupUsage*)first;
+  second_usage = (const InfinotedPluginWarmupUsage*)second;
+
+  /* Most used first */
+  if(first_usage->count > second_usage->count) return -1;
+  if(first_usage->count < second_usage->count) return 1;
+  return strcmp(first_usage->path, second_usage->path);
+}
+
+/*
+ * Holding warmed-up sessions
+ */
+
+static void
+infinoted_plugin_warmup_hold_free(gpointer data)
+{
+  InfinotedPluginWarmupHold* hold;
+  hold = (InfinotedPluginWarmupHold*)data;
+
+  if(hold->timeout != NULL)
+  {
+    inf_io_remove_timeout(
+      infinoted_plugin_manager_get_io(hold->plugin->manager),
+      hold->timeout
+    );
+  }
+
+  g_object_unref(hold->proxy);
+  g_slice_free(InfinotedPluginWarmupHold, hold);
+}
+
+static void
+infinoted_plugin_warmup_hold_timeout_cb(gpointer user_data)
+{
+  InfinotedPluginWarmupHold* hold;
+  hold = (InfinotedPluginWarmupHold*)user_data;
+
+  /* Nobody wanted the session. Let the directory unload it. */
+  hold->timeout = NULL;
+  g_hash_table_remove(hold->plugin->holds, hold->proxy);
+}
+
+/* Keeps a reference on proxy for the hold time, so that the directory can
+ * re-use the session if somebody subscribes to it, even after it has been
+ * unloaded for being idle. */
+static void
+infinoted_plugin_warmup_hold(InfinotedPluginWarmup* plugin,
+                             InfSessionProxy* proxy)
+{
+  InfinotedPluginWarmupHold* hold;
+
+  hold = g_slice_new(InfinotedPluginWarmupHold);
+  hold->plugin = plugin;
+  hold->proxy = proxy;
+  g_object_ref(proxy);
+
+  hold->timeout = inf_io_add_timeout(
+    infinoted_plugin_manager_get_io(plugin->manager),
+    plugin->hold_time * 1000,
+    infinoted_plugin_warmup_hold_timeout_cb,
+    hold,
+    NULL
+  );
+
+  g_hash_table_insert(plugin->holds, proxy, hold);
+}
+
+static void
+infinoted_plugin_warmup_session_evicted_cb(InfdDirectory* directory,
+                                           const InfBrowserIter* iter,
+                                           InfdSessionProxy* proxy,
+                                           guint64 size,
+                                           gpointer user_data)
+{
+  InfinotedPluginWarmup* plugin;
+  plugin = (InfinotedPluginWarmup*)user_data;
+
+  /* Memory is scarce, so do not keep the session around */
+  g_hash_table_remove(plugin->holds, proxy);
+}
+
+/*
+ * Loading notes
+ */
+
+typedef struct _InfinotedPluginWarmupFind InfinotedPluginWarmupFind;
+struct _InfinotedPluginWarmupFind {
+  gboolean found;
+  InfBrowserIter iter;
+};
+
+static void
+infinoted_plugin_warmup_find_cb(InfBrowser* browser,
+                                const InfBrowserIter* iter,
+                                const GError* error,
+                                gpointer user_data)
+{
+  InfinotedPluginWarmupFind* find;
+  find = (InfinotedPluginWarmupFind*)user_data;
+
+  if(error == NULL && !inf_browser_is_subdirectory(browser, iter))
+  {
+    find->found = TRUE;
+    find->iter = *iter;
+  }
+}
+
+/* Looks up the note at path. Since InfdDirectory explores folders
+ * synchronously, this does not need to wait for anything. */
+static gboolean
+infinoted_plugin_warmup_find_note(InfBrowser* browser,
+                                  const gchar* path,
+                                  InfBrowserIter* iter)
+{
+  InfinotedPluginWarmupFind find;
+  InfinotedPluginUtilNavigateData* data;
+
+  find.found = FALSE;
+
+  data = infinoted_plugin_util_navigate_to(
+    browser,
+    path,
+    strlen(path),
+    FALSE,
+    infinoted_plugin_warmup_find_cb,
+    &find
+  );
+
+  g_assert(data == NULL);
+
+  if(find.found == FALSE)
+    return FALSE;
+
+  *iter = find.iter;
+  return TRUE;
+}
+
+static void
+infinoted_plugin_warmup_subscribe_func(InfRequest* request,
+                                       const InfRequestResult* result,
+                                       const GError* error,
+                                       gpointer user_data)
+{
+  InfinotedPluginWarmupPrefetch* prefetch;
+  InfinotedPluginWarmup* plugin;
+  const InfBrowserIter* iter;
+  InfSessionProxy* proxy;
+
+  prefetch = (InfinotedPluginWarmupPrefetch*)user_data;
+  plugin = prefetch->plugin;
+
+  if(error != NULL)
+  {
+    infinoted_log_warning(
+      infinoted_plugin_manager_get_log(plugin->manager),
+      _("Failed to load document \"%s\" for warm-up: %s"),
+      prefetch->path,
+      error->message
+    );
+  }
+  else
+  {
+    inf_request_result_get_subscribe_session(result, NULL, &iter, &proxy);
+    infinoted_plugin_warmup_hold(plugin, proxy);
+    ++plugin->n_loaded;
+  }
+}
+
+static void
+infinoted_plugin_warmup_load(InfinotedPluginWarmupPrefetch* prefetch)
+{
+  InfBrowser* browser;
+  InfBrowserIter iter;
+
+  browser = INF_BROWSER(
+    infinoted_plugin_manager_get_directory(prefetch->plugin->manager)
+  );
+
+  /* The note might have been removed in the meanwhile, or somebody else
+   * has loaded it already. */
+  if(!infinoted_plugin_warmup_find_note(browser, prefetch->path, &iter))
+    return;
+  if(inf_browser_get_session(browser, &iter) != NULL)
+    return;
+  if(inf_browser_get_pending_request(browser, &iter, "subscribe-session"))
+    return;
+
+  /* InfdDirectory finishes the request before returning */
+  inf_browser_subscribe(
+    browser,
+    &iter,
+    infinoted_plugin_warmup_subscribe_func,
+    prefetch
+  );
+}
+
+static void
+infinoted_plugin_warmup_prefetch_free(InfinotedPluginWarmupPrefetch* prefetch)
+{
+  g_free(prefetch->path);
+  g_free(prefetch->filename);
+  g_slice_free(InfinotedPluginWarmupPrefetch, prefetch);
+}
+
+static void
+infinoted_plugin_warmup_prefetch_run_func(gpointer* run_data,
+                                          GDestroyNotify* run_notify,
+                                          gpointer user_data)
+{
+  InfinotedPluginWarmupPrefetch* prefetch;
+  FILE* file;
+  gchar buffer[65536];
+
+  prefetch = (InfinotedPluginWarmupPrefetch*)user_data;
+
+  /* Reading the file brings it into the page cache. Errors do not matter
+   * here; they are reported when the note is loaded. */
+  file = g_fopen(prefetch->filename, "rb");
+  if(file != NULL)
+  {
+    while(fread(buffer, 1, sizeof(buffer), file) == sizeof(buffer))
+      ;
+
+    fclose(file);
+  }
+
+  *run_data = NULL;
+  *run_notify = NULL;
+}
+
+static void
+infinoted_plugin_warmup_prefetch_done_func(gpointer run_data,
+                                           gpointer user_data)
+{
+  InfinotedPluginWarmupPrefetch* prefetch;
+  InfinotedPluginWarmup* plugin;
+
+  prefetch = (InfinotedPluginWarmupPrefetch*)user_data;
+  plugin = prefetch->plugin;
+
+  plugin->prefetches = g_slist_remove(plugin->prefetches, prefetch);
+  infinoted_plugin_warmup_load(prefetch);
+  infinoted_plugin_warmup_prefetch_free(prefetch);
+
+  if(plugin->prefetches == NULL)
+  {
+    infinoted_log_info(
+      infinoted_plugin_manager_get_log(plugin->manager),
+      _("Warmed up %u documents in %.3f s"),
+      plugin->n_loaded,
+      (g_get_monotonic_time() - plugin->start_time) / 1e6
+    );
+  }
+}
+
+static void
+infinoted_plugin_warmup_prefetch(InfinotedPluginWarmup* plugin,
+                                 const gchar* path)
+{
+  InfdDirectory* directory;
+  InfBrowserIter iter;
+  InfinotedPluginWarmupPrefetch* prefetch;
+  GError* error;
+
+  directory = infinoted_plugin_manager_get_directory(plugin->manager);
+  if(!infinoted_plugin_warmup_find_note(INF_BROWSER(directory), path, &iter))
+    return;
+
+  prefetch = g_slice_new(InfinotedPluginWarmupPrefetch);
+  prefetch->plugin = plugin;
+  prefetch->path = g_strdup(path);
+
+  prefetch->filename = infd_filesystem_storage_get_path(
+    INFD_FILESYSTEM_STORAGE(infd_directory_get_storage(directory)),
+    inf_browser_get_node_type(INF_BROWSER(directory), &iter),
+    path,
+    NULL
+  );
+
+  if(prefetch->filename == NULL)
+  {
+    infinoted_plugin_warmup_prefetch_free(prefetch);
+    return;
+  }
+
+  prefetch->operation = inf_async_operation_new(
+    infinoted_plugin_manager_get_io(plugin->manager),
+    infinoted_plugin_warmup_prefetch_run_func,
+    infinoted_plugin_warmup_prefetch_done_func,
+    prefetch
+  );
+
+  plugin->prefetches = g_slist_prepend(plugin->prefetches, prefetch);
+
+  error = NULL;
+  if(!inf_async_operation_start(prefetch->operation, &error))
+  {
+    /* Load the note without prefetching it then */
+    plugin->prefetches = g_slist_remove(plugin->prefetches, prefetch);
+    g_error_free(error);
+
+    infinoted_plugin_warmup_load(prefetch);
+    infinoted_plugin_warmup_prefetch_free(prefetch);
+  }
+}
+
+/* Starts to load the configured notes and the most used ones. This runs
+ * once the server is running, when all note plugins have been loaded.
+ * Usage counts of notes which do not exist anymore, because they have been
+ * removed while the server was not running, are dropped, and the next most
+ * used notes are loaded instead. */
+static void
+infinoted_plugin_warmup_start_timeout_cb(gpointer user_data)
+{
+  InfinotedPluginWarmup* plugin;
+  InfBrowser* browser;
+  InfBrowserIter note_iter;
+  GArray* usages;
+  InfinotedPluginWarmupUsage usage;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+  GHashTable* paths;
+  gchar** note;
+  const gchar* path;
+  guint n_found;
+  guint i;
+
+  plugin = (InfinotedPluginWarmup*)user_data;
+  plugin->start_timeout = NULL;
+  plugin->start_time = g_get_monotonic_time();
+
+  paths = g_hash_table_new(g_str_hash, g_str_equal);
+
+  if(plugin->notes != NULL)
+    for(note = plugin->notes; *note != NULL; ++note)
+      g_hash_table_add(paths, *note);
+
+  usages = g_array_sized_new(
+    FALSE,
+    FALSE,
+    sizeof(InfinotedPluginWarmupUsage),
+    g_hash_table_size(plugin->usage)
+  );
+
+  g_hash_table_iter_init(&iter, plugin->usage);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+  {
+    usage.path = (const gchar*)key;
+    usage.count = GPOINTER_TO_UINT(value);
+    g_array_append_val(usages, usage);
+  }
+
+  g_array_sort(usages, infinoted_plugin_warmup_usage_compare_func);
+
+  browser = INF_BROWSER(
+    infinoted_plugin_manager_get_directory(plugin->manager)
+  );
+
+  n_found = 0;
+  for(i = 0; i < usages->len && n_found < plugin->max_notes; ++i)
+  {
+    path = g_array_index(usages, InfinotedPluginWarmupUsage, i).path;
+    if(infinoted_plugin_warmup_find_note(browser, path, &note_iter))
+    {
+      g_hash_table_add(paths, (gpointer)path);
+      ++n_found;
+    }
+    else
+    {
+      /* This frees path */
+      g_hash_table_remove(plugin->usage, path);
+      infinoted_plugin_warmup_usage_changed(plugin);
+    }
+  }
+
+  g_hash_table_iter_init(&iter, paths);
+  while(g_hash_table_iter_next(&iter, &key, NULL))
+    infinoted_plugin_warmup_prefetch(plugin, (const gchar*)key);
+
+  g_array_free(usages, TRUE);
+  g_hash_table_destroy(paths);
+}
+
+static void
+infinoted_plugin_warmup_node_removed_cb(InfBrowser* browser,
+                                        const InfBrowserIter* iter,
+                                        InfRequest* request,
+                                        gpointer user_data)
+{
+  InfinotedPluginWarmup* plugin;
+  gchar* path;
+
+  plugin = (InfinotedPluginWarmup*)user_data;
+
+  path = inf_browser_get_path(browser, iter);
+  infinoted_plugin_warmup_remove_usage(plugin, path);
+  g_free(path);
+}
+
+/*
+ * Plugin interface
+ */
+
+static void
+infinoted_plugin_warmup_info_initialize(gpointer plugin_info)
+{
+  InfinotedPluginWarmup* plugin;
+  plugin = (InfinotedPluginWarmup*)plugin_info;
+
+  plugin->manager = NULL;
+  plugin->notes = NULL;
+  plugin->max_notes = 20;
+  plugin->hold_time = 600;
+
+  plugin->usage = NULL;
+  plugin->decay_time = 0;
+  plugin->save_timeout = NULL;
+  plugin->start_timeout = NULL;
+  plugin->prefetches = NULL;
+  plugin->n_loaded = 0;
+  plugin->start_time = 0;
+  plugin->holds = NULL;
+}
+
+static gboolean
+infinoted_plugin_warmup_initialize(InfinotedPluginManager* manager,
+                                   gpointer plugin_info,
+                                   GError** error)
+{
+  InfinotedPluginWarmup* plugin;
+  InfdStorage* storage;
+
+  plugin = (InfinotedPluginWarmup*)plugin_info;
+  plugin->manager = manager;
+
+  plugin->usage = g_hash_table_new_full(
+    g_str_hash,
+    g_str_equal,
+    g_free,
+    NULL
+  );
+
+  plugin->holds = g_hash_table_new_full(
+    NULL,
+    NULL,
+    NULL,
+    infinoted_plugin_warmup_hold_free
+  );
+
+  storage = infd_directory_get_storage(
+    infinoted_plugin_manager_get_directory(manager)
+  );
+
+  if(!INFD_IS_FILESYSTEM_STORAGE(storage))
+  {
+    g_set_error(
+      error,
+      g_quark_from_static_string("INFINOTED_PLUGIN_WARMUP_ERROR"),
+      0,
+      "%s",
+      _("The warmup plugin can only be used with a filesystem storage")
+    );
+
+    return FALSE;
+  }
+
+  plugin->decay_time = g_get_real_time() / G_USEC_PER_SEC;
+  if(!infinoted_plugin_warmup_read_usage(plugin, error))
+    return FALSE;
+
+  if(infinoted_plugin_warmup_decay_usage(plugin))
+    infinoted_plugin_warmup_usage_changed(plugin);
+
+  g_signal_connect(
+    G_OBJECT(infinoted_plugin_manager_get_directory(manager)),
+    "session-evicted",
+    G_CALLBACK(infinoted_plugin_warmup_session_evicted_cb),
+    plugin
+  );
+
+  g_signal_connect(
+    G_OBJECT(infinoted_plugin_manager_get_directory(manager)),
+    "node-removed",
+    G_CALLBACK(infinoted_plugin_warmup_node_removed_cb),
+    plugin
+  );
+
+  plugin->start_timeout = inf_io_add_timeout(
+    infinoted_plugin_manager_get_io(manager),
+    0,
+    infinoted_plugin_warmup_start_timeout_cb,
+    plugin,
+    NULL
+  );
+
+  return TRUE;
+}
+
+static void
+infinoted_plugin_warmup_deinitialize(gpointer plugin_info)
+{
+  InfinotedPluginWarmup* plugin;
+  InfinotedPluginWarmupPrefetch* prefetch;
+  InfIo* io;
+
+  plugin = (InfinotedPluginWarmup*)plugin_info;
+
+  if(plugin->manager != NULL)
+  {
+    io = infinoted_plugin_manager_get_io(plugin->manager);
+
+    if(plugin->start_timeout != NULL)
+      inf_io_remove_timeout(io, plugin->start_timeout);
+
+    while(plugin->prefetches != NULL)
+    {
+      prefetch = (InfinotedPluginWarmupPrefetch*)plugin->prefetches->data;
+      inf_async_operation_free(prefetch->operation);
+      infinoted_plugin_warmup_prefetch_free(prefetch);
+
+      plugin->prefetches = g_slist_delete_link(
+        plugin->prefetches,
+        plugin->prefetches
+      );
+    }
+
+    if(plugin->save_timeout != NULL)
+    {
+      inf_io_remove_timeout(io, plugin->save_timeout);
+      infinoted_plugin_warmup_write_usage(plugin);
+    }
+
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(infinoted_plugin_manager_get_directory(plugin->manager)),
+      G_CALLBACK(infinoted_plugin_warmup_session_evicted_cb),
+      plugin
+    );
+
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(infinoted_plugin_manager_get_directory(plugin->manager)),
+      G_CALLBACK(infinoted_plugin_warmup_node_removed_cb),
+      plugin
+    );
+  }
+
+  if(plugin->holds != NULL)
+    g_hash_table_destroy(plugin->holds);
+  if(plugin->usage != NULL)
+    g_hash_table_destroy(plugin->usage);
+
+  g_strfreev(plugin->notes);
+}
+
+static void
+infinoted_plugin_warmup_add_subscription_cb(InfdSessionProxy* proxy,
+                                            InfXmlConnection* connection,
+                                            guint seq_id,
+                                            gpointer user_data)
+{
+  InfinotedPluginWarmupSessionInfo* info;
+  InfinotedPluginWarmup* plugin;
+  guint count;
+
+  info = (InfinotedPluginWarmupSessionInfo*)user_data;
+  plugin = info->plugin;
+
+  count = GPOINTER_TO_UINT(g_hash_table_lookup(plugin->usage, info->path));
+  if(count < G_MAXUINT)
+    ++count;
+
+  g_hash_table_insert(
+    plugin->usage,
+    g_strdup(info->path),
+    GUINT_TO_POINTER(count)
+  );
+
+  infinoted_plugin_warmup_usage_changed(plugin);
+
+  /* The directory keeps the session now as long as it is in use */
+  g_hash_table_remove(plugin->holds, proxy);
+}
+
+static void
+infinoted_plugin_warmup_session_added(const InfBrowserIter* iter,
+                                      InfSessionProxy* proxy,
+                                      gpointer plugin_info,
+                                      gpointer session_info)
+{
+  InfinotedPluginWarmupSessionInfo* info;
+
+  info = (InfinotedPluginWarmupSessionInfo*)session_info;
+  info->plugin = (InfinotedPluginWarmup*)plugin_info;
+  info->proxy = proxy;
+
+  info->path = inf_browser_get_path(
+    INF_BROWSER(infinoted_plugin_manager_get_directory(info->plugin->manager)),
+    iter
+  );
+
+  g_signal_connect(
+    G_OBJECT(proxy),
+    "add-subscription",
+    G_CALLBACK(infinoted_plugin_warmup_add_subscription_cb),
+    info
+  );
+}
+
+static void
+infinoted_plugin_warmup_session_removed(const InfBrowserIter* iter,
+                                        InfSessionProxy* proxy,
+                                        gpointer plugin_info,
+                                        gpointer session_info)
+{
+  InfinotedPluginWarmupSessionInfo* info;
+  info = (InfinotedPluginWarmupSessionInfo*)session_info;
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(proxy),
+    G_CALLBACK(infinoted_plugin_warmup_add_subscription_cb),
+    info
+  );
+
+  g_free(info->path);
+}
+
+static const InfinotedParameterInfo INFINOTED_PLUGIN_WARMUP_OPTIONS[] = {
+  {
+    "notes",
+    INFINOTED_PARAMETER_STRING_LIST,
+    0,
+    offsetof(InfinotedPluginWarmup, notes),
+    infinoted_parameter_convert_string_list,
+    0,
+    N_("Paths of documents that are always loaded when the server starts, "
+       "in addition to the most used ones."),
+    N_("PATH1;PATH2;[...]")
+  }, {
+    "max-notes",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginWarmup, max_notes),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The number of most used documents to load when the server starts. "
+       "[Default=20]"),
+    N_("NUMBER")
+  }, {
+    "hold-time",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginWarmup, hold_time),
+    infinoted_parameter_convert_positive,
+    0,
+    N_("The time, in seconds, for which a loaded document is kept in memory "
+       "if nobody opens it. [Default=600]"),
+    N_("SECONDS")
+  }, {
+    NULL,
+    0,
+    0,
+    0,
+    NULL
+  }
+};
+
+const InfinotedPlugin INFINOTED_PLUGIN = {
+  "warmup",
+  N_("Loads documents into memory in the background when the server starts, "
+     "so that the first users opening them do not have to wait for them to "
+     "be read from disk. The documents are the most used ones, according to "
+     "usage counts which the plugin keeps in the root directory, and any "
+     "explicitly configured ones."),
+  INFINOTED_PLUGIN_WARMUP_OPTIONS,
+  sizeof(InfinotedPluginWarmup),
+  0,
+  sizeof(InfinotedPluginWarmupSessionInfo),
+  NULL,
+  infinoted_plugin_warmup_info_initialize,
+  infinoted_plugin_warmup_initialize,
+  infinoted_plugin_warmup_deinitialize,
+  NULL,
+  NULL,
+  infinoted_plugin_warmup_session_added,
+  infinoted_plugin_warmup_session_removed
+};
+
+/* vim:set et sw=2 ts=2: */
@@ -40,6 +40,7 @@
 #include <libinfinity/adopted/inf-adopted-session.h>
 #include <libinfinity/adopted/inf-adopted-no-operation.h>
 #include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-protocol.h>
 #include <libinfinity/common/inf-error.h>
 #include <libinfinity/inf-i18n.h>
 #include <libinfinity/inf-signals.h>
@@ -54,6 +55,18 @@ struct _InfAdoptedSessionToXmlSyncForeachData {
   xmlNodePtr parent_xml;
 };
 
+typedef struct _InfAdoptedSessionSyncStream InfAdoptedSessionSyncStream;
+struct _InfAdoptedSessionSyncStream {
+  gpointer parent;
+  GPtrArray* requests;
+  guint index;
+
+  /* If set, request vectors are sent as a diff to the previous request of
+   * the same user. */
+  gboolean diff;
+  InfAdoptedRequest* previous;
+};
+
 typedef struct _InfAdoptedSessionLocalUser InfAdoptedSessionLocalUser;
 struct _InfAdoptedSessionLocalUser {
   InfAdoptedUser* user;
@@ -75,6 +88,10 @@ struct _InfAdoptedSessionPrivate {
   InfAdoptedSessionLocalUser* next_noop_user;
   /* Buffer for requests that are not ready to be executed yet */
   GPtrArray* request_buffer;
+
+  /* Whether the synchronization we receive has diff-encoded request
+   * vectors */
+  gboolean sync_diff;
 };
 
 enum {
@@ -800,6 +817,7 @@ inf_adopted_session_init(InfAdoptedSession* session)
   priv->io = NULL;
   priv->max_total_log_size = 2048;
   priv->algorithm = NULL;
+  priv->sync_diff = FALSE;
   priv->local_users = NULL;
   priv->noop_timeout = NULL;
   priv->next_noop_user = NULL;
@@ -1038,7 +1056,8 @@ inf_adopted_session_to_xml_sync_foreach_user_func(InfUser* user,
       NULL
     );
 
-    /* TODO: Diff to previous request? */
+    /* Diff encoding is only used with sync streams, see
+     * inf_adopted_session_sync_stream_next(). */
     session_class->request_to_xml(data->session, xml, request, NULL, TRUE);
     xmlAddChild(data->parent_xml, xml);
   }
@@ -1069,27 +1088,236 @@ inf_adopted_session_to_xml_sync(InfSession* session,
   );
 }
 
+static void
+inf_adopted_session_sync_stream_new_foreach_user_func(InfUser* user,
+                                                      gpointer user_data)
+{
+  InfAdoptedRequestLog* log;
+  GPtrArray* requests;
+  guint i;
+  guint end;
+
+  g_assert(INF_ADOPTED_IS_USER(user));
+
+  requests = (GPtrArray*)user_data;
+  log = inf_adopted_user_get_request_log(INF_ADOPTED_USER(user));
+  end = inf_adopted_request_log_get_end(log);
+
+  /* Requests are immutable, so keeping a reference is enough for the
+   * snapshot, even if the request log is cleaned up in the meanwhile. */
+  for(i = inf_adopted_request_log_get_begin(log); i < end; ++ i)
+  {
+    g_ptr_array_add(
+      requests,
+      g_object_ref(inf_adopted_request_log_get_request(log, i))
+    );
+  }
+}
+
+static gpointer
+inf_adopted_session_sync_stream_new(InfSession* session,
+                                    InfXmlConnection* connection,
+                                    guint* n_messages)
+{
+  InfAdoptedSessionPrivate* priv;
+  InfAdoptedSessionSyncStream* stream;
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  g_assert(priv->algorithm != NULL);
+
+  stream = g_slice_new(InfAdoptedSessionSyncStream);
+
+  stream->parent =
+    INF_SESSION_CLASS(inf_adopted_session_parent_class)->sync_stream_new(
+      session,
+      connection,
+      n_messages
+    );
+
+  stream->requests = g_ptr_array_new();
+  stream->index = 0;
+
+  /* Protocol version 1.2 allows to encode request vectors as a diff */
+  stream->diff = inf_protocol_get_remote_supports(connection, 1, 2);
+  stream->previous = NULL;
+
+  inf_user_table_foreach_user(
+    inf_session_get_user_table(session),
+    inf_adopted_session_sync_stream_new_foreach_user_func,
+    stream->requests
+  );
+
+  *n_messages += stream->requests->len;
+  return stream;
+}
+
+static xmlNodePtr
+inf_adopted_session_sync_stream_next(InfSession* session,
+                                     gpointer stream)
+{
+  InfAdoptedSessionSyncStream* adopted_stream;
+  InfAdoptedSessionClass* session_class;
+  InfAdoptedRequest* request;
+  InfAdoptedStateVector* diff_vec;
+  xmlNodePtr xml;
+
+  adopted_stream = (InfAdoptedSessionSyncStream*)stream;
+
+  if(adopted_stream->parent != NULL)
+  {
+    xml = INF_SESSION_CLASS(inf_adopted_session_parent_class)->
+      sync_stream_next(session, adopted_stream->parent);
+    if(xml != NULL) return xml;
+
+    INF_SESSION_CLASS(inf_adopted_session_parent_class)->sync_stream_free(
+      session,
+      adopted_stream->parent
+    );
+
+    adopted_stream->parent = NULL;
+  }
+
+  if(adopted_stream->index == adopted_stream->requests->len)
+    return NULL;
+
+  session_class = INF_ADOPTED_SESSION_GET_CLASS(session);
+  g_assert(session_class->request_to_xml != NULL);
+
+  request = INF_ADOPTED_REQUEST(
+    g_ptr_array_index(adopted_stream->requests, adopted_stream->index)
+  );
+
+  xml = xmlNewNode(NULL, (const xmlChar*)"sync-request");
+  diff_vec = NULL;
+
+  if(adopted_stream->diff)
+  {
+    /* Let the receiving side know that this and all following requests
+     * are diff-encoded. */
+    if(adopted_stream->index == 0)
+      inf_xml_util_set_attribute(xml, "time-diff", "true");
+
+    /* The requests of a user are ordered in the snapshot, and the vector of
+     * a request is always causally before the vector of the next request of
+     * the same user, since the vector time of a site never decreases. */
+    if(adopted_stream->previous != NULL &&
+       inf_adopted_request_get_user_id(adopted_stream->previous) ==
+       inf_adopted_request_get_user_id(request))
+    {
+      diff_vec = inf_adopted_request_get_vector(adopted_stream->previous);
+    }
+  }
+
+  session_class->request_to_xml(
+    INF_ADOPTED_SESSION(session),
+    xml,
+    request,
+    diff_vec,
+    TRUE
+  );
+
+  /* Keep only the request the next one might be diffed to */
+  if(adopted_stream->previous != NULL)
+    g_object_unref(adopted_stream->previous);
+  adopted_stream->previous = request;
+  ++ adopted_stream->index;
+
+  return xml;
+}
+
+static void
+inf_adopted_session_sync_stream_free(InfSession* session,
+                                     gpointer stream)
+{
+  InfAdoptedSessionSyncStream* adopted_stream;
+  adopted_stream = (InfAdoptedSessionSyncStream*)stream;
+
+  if(adopted_stream->parent != NULL)
+  {
+    INF_SESSION_CLASS(inf_adopted_session_parent_class)->sync_stream_free(
+      session,
+      adopted_stream->parent
+    );
+  }
+
+  if(adopted_stream->previous != NULL)
+    g_object_unref(adopted_stream->previous);
+
+  /* Requests that have already been sent were released in
+   * inf_adopted_session_sync_stream_next(). */
+  for(; adopted_stream->index < adopted_stream->requests->len;
+      ++ adopted_stream->index)
+  {
+    g_object_unref(
+      g_ptr_array_index(adopted_stream->requests, adopted_stream->index)
+    );
+  }
+
+  g_ptr_array_free(adopted_stream->requests, TRUE);
+  g_slice_free(InfAdoptedSessionSyncStream, adopted_stream);
+}
+
 static gboolean
 inf_adopted_session_process_xml_sync(InfSession* session,
                                      InfXmlConnection* connection,
                                      const xmlNodePtr xml,
                                      GError** error)
 {
+  InfAdoptedSessionPrivate* priv;
   InfAdoptedSessionClass* session_class;
   InfAdoptedRequest* request;
   InfAdoptedUser* user;
   InfAdoptedRequestLog* log;
+  InfAdoptedStateVector* diff_vec;
   InfSessionClass* parent_class;
+  xmlChar* attr;
+  guint user_id;
+  guint end;
 
   if(strcmp((const char*)xml->name, "sync-request") == 0)
   {
+    priv = INF_ADOPTED_SESSION_PRIVATE(session);
     session_class = INF_ADOPTED_SESSION_GET_CLASS(session);
     g_assert(session_class->xml_to_request != NULL);
 
+    attr = inf_xml_util_get_attribute(xml, "time-diff");
+    if(attr != NULL)
+    {
+      priv->sync_diff = (strcmp((const char*)attr, "true") == 0);
+      xmlFree(attr);
+    }
+
+    /* With diff encoding, the vector is relative to the previous request
+     * of the same user, which is the last one in the user's request log.
+     * Errors in the user attribute are reported by xml_to_request. */
+    diff_vec = NULL;
+    if(priv->sync_diff &&
+       inf_xml_util_get_attribute_uint(xml, "user", &user_id, NULL))
+    {
+      user = INF_ADOPTED_USER(
+        inf_user_table_lookup_user_by_id(
+          inf_session_get_user_table(session),
+          user_id
+        )
+      );
+
+      if(user != NULL)
+      {
+        log = inf_adopted_user_get_request_log(user);
+        end = inf_adopted_request_log_get_end(log);
+        if(inf_adopted_request_log_get_begin(log) != end)
+        {
+          diff_vec = inf_adopted_request_get_vector(
+            inf_adopted_request_log_get_request(log, end - 1)
+          );
+        }
+      }
+    }
+
     request = session_class->xml_to_request(
       INF_ADOPTED_SESSION(session),
       xml,
-      NULL, /* TODO: Diff to previous request, if any. */
+      diff_vec,
       TRUE,
       error
     );
@@ -1548,6 +1776,9 @@ inf_adopted_session_class_init(InfAdoptedSessionClass* adopted_session_class)
   object_class->get_property = inf_adopted_session_get_property;
 
   session_class->to_xml_sync = inf_adopted_session_to_xml_sync;
+  session_class->sync_stream_new = inf_adopted_session_sync_stream_new;
+  session_class->sync_stream_next = inf_adopted_session_sync_stream_next;
+  session_class->sync_stream_free = inf_adopted_session_sync_stream_free;
   session_class->process_xml_sync = inf_adopted_session_process_xml_sync;
   session_class->process_xml_run = inf_adopted_session_process_xml_run;
   session_class->get_xml_user_props = inf_adopted_session_get_xml_user_props;
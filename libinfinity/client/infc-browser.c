@@ -34,6 +34,7 @@
 #include <libinfinity/client/infc-request-manager.h>
 
 #include <libinfinity/common/inf-request-result.h>
+#include <libinfinity/common/inf-browser-private.h>
 #include <libinfinity/common/inf-chat-session.h>
 #include <libinfinity/common/inf-cert-util.h>
 #include <libinfinity/common/inf-xml-util.h>
@@ -211,6 +212,7 @@ struct _InfcBrowserPrivate {
   InfBrowserStatus status;
   GHashTable* nodes; /* Mapping from id to node */
   InfcBrowserNode* root;
+  InfBrowserAclCache* acl_cache; /* effective permissions per account */
 
   GHashTable* accounts; /* known accounts, id -> InfAclAccount* */
   const InfAclAccount* local_account;
@@ -220,6 +222,9 @@ struct _InfcBrowserPrivate {
   GSList* subscription_requests;
 
   InfcSessionProxy* chat_session;
+
+  /* Maximum number of nodes per page when exploring, or 0 */
+  guint explore_page_size;
 };
 
 #define INFC_BROWSER_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INFC_TYPE_BROWSER, InfcBrowserPrivate))
@@ -230,6 +235,7 @@ enum {
   PROP_IO,
   PROP_COMMUNICATION_MANAGER,
   PROP_CONNECTION,
+  PROP_EXPLORE_PAGE_SIZE,
 
   /* read only */
   PROP_STATUS,
@@ -891,12 +897,15 @@ infc_browser_remove_account_from_sheets(InfcBrowser* browser,
                                         InfcBrowserNode* node,
                                         InfAclAccountId account)
 {
+  InfcBrowserPrivate* priv;
   InfcBrowserNode* child;
   InfAclSheet* sheet;
   InfAclSheet announce_sheet;
   InfAclSheetSet sheet_set;
   InfBrowserIter iter;
 
+  priv = INFC_BROWSER_PRIVATE(browser);
+
   if(node->type == INFC_BROWSER_NODE_SUBDIRECTORY &&
      node->shared.subdir.explored)
   {
@@ -913,6 +922,7 @@ infc_browser_remove_account_from_sheets(InfcBrowser* browser,
     {
       announce_sheet = *sheet;
       inf_acl_sheet_set_remove_sheet(node->acl, sheet);
+      _inf_browser_acl_cache_invalidate(priv->acl_cache);
 
       /* Clear the mask, to announce that all permissions
        * have been reset to default */
@@ -1097,7 +1107,11 @@ infc_browser_enforce_single_acl(InfcBrowser* browser,
   {
     inf_acl_mask_set1(&mask, INF_ACL_CAN_QUERY_ACL);
     if(inf_browser_check_acl(ibrowser, &iter, account, &mask, NULL) == FALSE)
+    {
+      /* Permissions of other accounts are no longer available */
       node->acl_queried = FALSE;
+      _inf_browser_acl_cache_invalidate(priv->acl_cache);
+    }
   }
 
   /* If query-acl was revoked, then update the sheet set by removing all
@@ -1135,6 +1149,7 @@ infc_browser_enforce_single_acl(InfcBrowser* browser,
     if(sheet_set != NULL && sheet_set->n_sheets > 0)
     {
       node->acl = inf_acl_sheet_set_merge_sheets(node->acl, sheet_set);
+      _inf_browser_acl_cache_invalidate(priv->acl_cache);
 
       /* Check subscription requests for this node, and adapt the sheet set,
        * so that the sheet set is correct when the node is
@@ -1481,6 +1496,9 @@ infc_browser_disconnected(InfcBrowser* browser)
     priv->root = NULL;
   }
 
+  /* Node IDs are only unique for one connection to the server */
+  _inf_browser_acl_cache_invalidate(priv->acl_cache);
+
   priv->account_list_status = INFC_BROWSER_ACCOUNT_LIST_NOT_QUERIED;
   priv->local_account = NULL;
 
@@ -1664,6 +1682,7 @@ infc_browser_init(InfcBrowser* browser)
   priv->status = INF_BROWSER_CLOSED;
   priv->nodes = g_hash_table_new(NULL, NULL);
   priv->root = NULL;
+  priv->acl_cache = _inf_browser_acl_cache_new();
 
   priv->accounts = NULL;
   priv->local_account = NULL;
@@ -1672,6 +1691,7 @@ infc_browser_init(InfcBrowser* browser)
   priv->sync_ins = NULL;
   priv->subscription_requests = NULL;
   priv->chat_session = NULL;
+  priv->explore_page_size = 1000;
 }
 
 static void
@@ -1763,6 +1783,9 @@ infc_browser_finalize(GObject* object)
   g_hash_table_destroy(priv->nodes);
   priv->nodes = NULL;
 
+  _inf_browser_acl_cache_free(priv->acl_cache);
+  priv->acl_cache = NULL;
+
   G_OBJECT_CLASS(infc_browser_parent_class)->finalize(object);
 }
 
@@ -1866,6 +1889,9 @@ infc_browser_set_property(GObject* object,
       }
     }
 
+    break;
+  case PROP_EXPLORE_PAGE_SIZE:
+    priv->explore_page_size = g_value_get_uint(value);
     break;
   case PROP_STATUS:
   case PROP_CHAT_SESSION:
@@ -1899,6 +1925,9 @@ infc_browser_get_property(GObject* object,
   case PROP_CONNECTION:
     g_value_set_object(value, G_OBJECT(priv->connection));
     break;
+  case PROP_EXPLORE_PAGE_SIZE:
+    g_value_set_uint(value, priv->explore_page_size);
+    break;
   case PROP_STATUS:
     g_value_set_enum(value, priv->status);
     break;
@@ -2811,6 +2840,11 @@ infc_browser_handle_welcome(InfcBrowser* browser,
     error
   );
 
+  /* Remember the server version so that sessions synchronized to the
+   * server can make use of newer protocol features. */
+  if(result)
+    inf_protocol_set_remote_version(connection, (const gchar*)version, NULL);
+
   xmlFree(version);
   if(!result) return FALSE;
 
@@ -3097,6 +3131,85 @@ infc_browser_handle_explore_end(InfcBrowser* browser,
   }
 }
 
+static gboolean
+infc_browser_handle_explore_continue(InfcBrowser* browser,
+                                     InfXmlConnection* connection,
+                                     xmlNodePtr xml,
+                                     GError** error)
+{
+  InfcBrowserPrivate* priv;
+  InfcRequest* request;
+  xmlNodePtr reply_xml;
+  guint offset;
+  guint current;
+  guint node_id;
+
+  priv = INFC_BROWSER_PRIVATE(browser);
+
+  request = infc_request_manager_get_request_by_xml_required(
+    priv->request_manager,
+    "explore-node",
+    xml,
+    error
+  );
+
+  if(request == NULL) return FALSE;
+  g_assert(INFC_IS_PROGRESS_REQUEST(request));
+
+  /* The server only continues if not all children have been sent yet */
+  if(!infc_browser_validate_progress_request(
+       browser,
+       INFC_PROGRESS_REQUEST(request),
+       error))
+  {
+    return FALSE;
+  }
+
+  if(!inf_xml_util_get_attribute_uint_required(xml, "offset", &offset, error))
+    return FALSE;
+
+  g_object_get(
+    G_OBJECT(request),
+    "current", &current,
+    "node-id", &node_id,
+    NULL
+  );
+
+  if(offset != current)
+  {
+    g_set_error_literal(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_TOO_FEW_CHILDREN,
+      _("Not all nodes of the previous page were received before "
+        "explore-continue was received")
+    );
+
+    return FALSE;
+  }
+
+  /* Ask for the next page */
+  reply_xml = infc_browser_request_to_xml(request);
+  inf_xml_util_set_attribute_uint(reply_xml, "id", node_id);
+  inf_xml_util_set_attribute_uint(reply_xml, "offset", offset);
+  if(priv->explore_page_size > 0)
+  {
+    inf_xml_util_set_attribute_uint(
+      reply_xml,
+      "limit",
+      priv->explore_page_size
+    );
+  }
+
+  inf_communication_group_send_message(
+    INF_COMMUNICATION_GROUP(priv->group),
+    priv->connection,
+    reply_xml
+  );
+
+  return TRUE;
+}
+
 static gboolean
 infc_browser_handle_add_node(InfcBrowser* browser,
                              InfXmlConnection* connection,
@@ -4855,6 +4968,7 @@ infc_browser_handle_set_acl(InfcBrowser* browser,
       }
 
       node->acl = inf_acl_sheet_set_merge_sheets(node->acl, sheet_set);
+      _inf_browser_acl_cache_invalidate(priv->acl_cache);
       infc_browser_enforce_acl(browser, node, request, NULL);
 
       inf_browser_acl_changed(
@@ -5049,6 +5163,15 @@ infc_browser_communication_object_received(InfCommunicationObject* object,
       &local_error
     );
   }
+  else if(strcmp((const gchar*)node->name, "explore-continue") == 0)
+  {
+    infc_browser_handle_explore_continue(
+      browser,
+      connection,
+      node,
+      &local_error
+    );
+  }
   else if(strcmp((const gchar*)node->name, "add-node") == 0)
   {
     infc_browser_handle_add_node(
@@ -5766,6 +5889,11 @@ infc_browser_browser_explore(InfBrowser* browser,
   xml = infc_browser_request_to_xml(request);
   inf_xml_util_set_attribute_uint(xml, "id", node->id);
 
+  /* Servers not supporting paged exploration ignore the limit and send all
+   * children at once. */
+  if(priv->explore_page_size > 0)
+    inf_xml_util_set_attribute_uint(xml, "limit", priv->explore_page_size);
+
   inf_communication_group_send_message(
     INF_COMMUNICATION_GROUP(priv->group),
     priv->connection,
@@ -5882,7 +6010,18 @@ infc_browser_browser_add_note(InfBrowser* infbrowser,
     inf_acl_sheet_set_to_xml(sheet_set, xml);
 
   if(initial_subscribe != FALSE)
+  {
     xmlNewChild(xml, NULL, (const xmlChar*)"subscribe", NULL);
+
+    /* Let the server know which protocol features it can use to
+     * synchronize the session to us. */
+    inf_xml_util_set_attribute(
+      xml,
+      "protocol-version",
+      inf_protocol_get_version()
+    );
+  }
+
   if(session != NULL)
     xmlNewChild(xml, NULL, (const xmlChar*)"sync-in", NULL);
 
@@ -6091,6 +6230,14 @@ infc_browser_browser_subscribe(InfBrowser* browser,
   xml = infc_browser_request_to_xml(request);
   inf_xml_util_set_attribute_uint(xml, "id", node->id);
 
+  /* Let the server know which protocol features it can use to
+   * synchronize the session to us. */
+  inf_xml_util_set_attribute(
+    xml,
+    "protocol-version",
+    inf_protocol_get_version()
+  );
+
   inf_communication_group_send_message(
     INF_COMMUNICATION_GROUP(priv->group),
     priv->connection,
@@ -6719,6 +6866,30 @@ infc_browser_browser_has_acl(InfBrowser* browser,
   return FALSE;
 }
 
+static gboolean
+infc_browser_browser_check_acl(InfBrowser* browser,
+                               const InfBrowserIter* iter,
+                               InfAclAccountId account,
+                               const InfAclMask* check_mask,
+                               InfAclMask* out_mask)
+{
+  InfcBrowserPrivate* priv;
+
+  g_return_val_if_fail(INFC_IS_BROWSER(browser), FALSE);
+  infc_browser_return_val_if_iter_fail(INFC_BROWSER(browser), iter, FALSE);
+
+  priv = INFC_BROWSER_PRIVATE(browser);
+
+  return _inf_browser_acl_cache_check(
+    priv->acl_cache,
+    browser,
+    iter,
+    account,
+    check_mask,
+    out_mask
+  );
+}
+
 static const InfAclSheetSet*
 infc_browser_browser_get_acl(InfBrowser* browser,
                              const InfBrowserIter* iter)
@@ -6860,6 +7031,21 @@ infc_browser_class_init(InfcBrowserClass* browser_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_EXPLORE_PAGE_SIZE,
+    g_param_spec_uint(
+      "explore-page-size",
+      "Explore page size",
+      "The maximum number of nodes the server sends at once when exploring "
+      "a subdirectory, or 0 to receive all of them at once",
+      0,
+      G_MAXUINT,
+      1000,
+      G_PARAM_READWRITE
+    )
+  );
+
   g_object_class_install_property(
     object_class,
     PROP_CHAT_SESSION,
@@ -6927,6 +7113,7 @@ infc_browser_browser_iface_init(InfBrowserInterface* iface)
   iface->has_acl = infc_browser_browser_has_acl;
   iface->get_acl = infc_browser_browser_get_acl;
   iface->set_acl = infc_browser_browser_set_acl;
+  iface->check_acl = infc_browser_browser_check_acl;
 }
 
 /*
@@ -27,6 +27,16 @@
  * #InfAsyncOperation is a simple mechanism to run some code in a separate
  * worker thread and then, once the result is computed, notify the main thread
  * about the result.
+ *
+ * The operations run on shared pools of worker threads whose size is
+ * bounded, see inf_async_operation_set_max_threads(). If more operations are
+ * started than there are threads, the remaining ones are queued and run as
+ * soon as a thread becomes available. This makes sure that a large number of
+ * simultaneous operations, such as authentication requests from many clients
+ * connecting at the same time, does not spawn an unbounded number of
+ * threads. Operations that are part of establishing a connection run on a
+ * pool of their own, see inf_async_operation_set_pool(), so that they are
+ * not queued behind file I/O.
  **/
 
 #include <libinfinity/common/inf-async-operation.h>
@@ -35,8 +45,9 @@
 struct _InfAsyncOperation {
   InfIo* io;
   InfIoDispatch* dispatch;
-  GThread* thread;
+  gboolean started;
   GMutex mutex;
+  InfAsyncOperationPool pool;
 
   InfAsyncOperationRunFunc run_func;
   InfAsyncOperationDoneFunc done_func;
@@ -46,6 +57,23 @@ struct _InfAsyncOperation {
   GDestroyNotify run_notify;
 };
 
+/* Default maximum number of worker threads if the number of processors is
+ * lower than this. Operations typically block on I/O rather than use the
+ * CPU, so we allow a few more threads than there are processors. */
+#define INF_ASYNC_OPERATION_MIN_THREADS 4
+
+#define INF_ASYNC_OPERATION_N_POOLS (INF_ASYNC_OPERATION_POOL_HANDSHAKE + 1)
+
+G_LOCK_DEFINE_STATIC(inf_async_operation_pools);
+static GThreadPool* inf_async_operation_pools[INF_ASYNC_OPERATION_N_POOLS];
+static guint inf_async_operation_max_threads[INF_ASYNC_OPERATION_N_POOLS];
+
+static guint
+inf_async_operation_default_max_threads(void)
+{
+  return MAX(g_get_num_processors(), INF_ASYNC_OPERATION_MIN_THREADS);
+}
+
 static void
 inf_async_operation_dispatch(gpointer data)
 {
@@ -64,14 +92,15 @@ inf_async_operation_dispatch(gpointer data)
 
   op->run_data = NULL;
   op->run_notify = NULL;
-  op->thread = NULL;
+  op->started = FALSE;
   g_mutex_clear(&op->mutex);
 
   inf_async_operation_free(op);
 }
 
-static gpointer
-inf_async_operation_thread_start(gpointer data)
+static void
+inf_async_operation_thread_start(gpointer data,
+                                 gpointer user_data)
 {
   InfAsyncOperation* op;
   op = (InfAsyncOperation*)data;
@@ -99,11 +128,39 @@ inf_async_operation_thread_start(gpointer data)
 
     g_mutex_unlock(&op->mutex);
     g_mutex_clear(&op->mutex);
-    g_thread_unref(op->thread);
     g_slice_free(InfAsyncOperation, op);
   }
+}
 
-  return NULL;
+static GThreadPool*
+inf_async_operation_get_pool(InfAsyncOperationPool index,
+                             GError** error)
+{
+  GThreadPool* pool;
+
+  G_LOCK(inf_async_operation_pools);
+
+  if(inf_async_operation_pools[index] == NULL)
+  {
+    if(inf_async_operation_max_threads[index] == 0)
+    {
+      inf_async_operation_max_threads[index] =
+        inf_async_operation_default_max_threads();
+    }
+
+    inf_async_operation_pools[index] = g_thread_pool_new(
+      inf_async_operation_thread_start,
+      NULL,
+      inf_async_operation_max_threads[index],
+      FALSE,
+      error
+    );
+  }
+
+  pool = inf_async_operation_pools[index];
+  G_UNLOCK(inf_async_operation_pools);
+
+  return pool;
 }
 
 static void
@@ -169,7 +226,8 @@ inf_async_operation_new(InfIo* io,
 
   op->io = io;
   op->dispatch = NULL;
-  op->thread = NULL;
+  op->started = FALSE;
+  op->pool = INF_ASYNC_OPERATION_POOL_DEFAULT;
 
   op->run_func = run_func;
   op->done_func = done_func;
@@ -197,37 +255,71 @@ inf_async_operation_new(InfIo* io,
  * @error is set and %FALSE is returned. In that case, the operation must not
  * be used anymore since it will be automatically freed.
  *
+ * If all worker threads are busy, the operation is queued and runs once a
+ * thread becomes available. This is also the case if a new worker thread
+ * cannot be spawned, in which case a warning is printed, but the operation
+ * is started nevertheless.
+ *
  * Returns: %TRUE on success or %FALSE if the operation could not be started.
  */
 gboolean
 inf_async_operation_start(InfAsyncOperation* op,
                           GError** error)
 {
+  GThreadPool* pool;
+  GError* local_error;
+
   g_return_val_if_fail(op != NULL, FALSE);
-  g_return_val_if_fail(op->thread == NULL, FALSE);
+  g_return_val_if_fail(op->started == FALSE, FALSE);
+
+  pool = inf_async_operation_get_pool(op->pool, error);
+  if(pool == NULL)
+  {
+    inf_async_operation_free(op);
+    return FALSE;
+  }
 
   g_mutex_init(&op->mutex);
   g_mutex_lock(&op->mutex);
 
-  op->thread = g_thread_try_new(
-    "InfAsyncOperation",
-    inf_async_operation_thread_start,
-    op,
-    error
-  );
-
-  if(op->thread == NULL)
+  /* If no new thread can be spawned, the operation has been queued
+   * nevertheless, and an existing thread can pick it up at any time, so it
+   * must not be freed here. */
+  op->started = TRUE;
+  local_error = NULL;
+  if(!g_thread_pool_push(pool, op, &local_error))
   {
-    g_mutex_unlock(&op->mutex);
-    g_mutex_clear(&op->mutex);
-    inf_async_operation_free(op);
-    return FALSE;
+    g_warning(
+      "Failed to spawn a worker thread, the operation is queued: %s",
+      local_error->message
+    );
+
+    g_error_free(local_error);
   }
 
   g_mutex_unlock(&op->mutex);
   return TRUE;
 }
 
+/**
+ * inf_async_operation_set_pool:
+ * @op: A #InfAsyncOperation that has not been started yet.
+ * @pool: The pool of worker threads on which to run @op.
+ *
+ * Sets the pool of worker threads on which @op runs once it is started.
+ * By default, operations run on %INF_ASYNC_OPERATION_POOL_DEFAULT.
+ */
+void
+inf_async_operation_set_pool(InfAsyncOperation* op,
+                             InfAsyncOperationPool pool)
+{
+  g_return_if_fail(op != NULL);
+  g_return_if_fail(op->started == FALSE);
+  g_return_if_fail(pool < INF_ASYNC_OPERATION_N_POOLS);
+
+  op->pool = pool;
+}
+
 /**
  * inf_async_operation_free:
  * @op: A #InfAsyncOperation.
@@ -242,7 +334,7 @@ inf_async_operation_free(InfAsyncOperation* op)
 {
   g_return_if_fail(op != NULL);
 
-  if(op->thread == NULL)
+  if(op->started == FALSE)
   {
     /* The async operation has not started yet,
      * or it has finished (dispatched) already. */
@@ -287,10 +379,70 @@ inf_async_operation_free(InfAsyncOperation* op)
 
       g_mutex_unlock(&op->mutex);
       g_mutex_clear(&op->mutex);
-      g_thread_unref(op->thread);
       g_slice_free(InfAsyncOperation, op);
     }
   }
 }
 
+/**
+ * inf_async_operation_set_max_threads:
+ * @pool: The pool whose size to set.
+ * @max_threads: The maximum number of worker threads, or 0 for the default.
+ *
+ * Sets the maximum number of worker threads in @pool that run asynchronous
+ * operations at the same time. The default is the number of processors, but
+ * at least 4. Operations started when all threads of their pool are busy are
+ * queued until a thread of that pool becomes available.
+ */
+void
+inf_async_operation_set_max_threads(InfAsyncOperationPool pool,
+                                    guint max_threads)
+{
+  g_return_if_fail(pool < INF_ASYNC_OPERATION_N_POOLS);
+
+  G_LOCK(inf_async_operation_pools);
+
+  if(max_threads == 0)
+    max_threads = inf_async_operation_default_max_threads();
+
+  inf_async_operation_max_threads[pool] = max_threads;
+  if(inf_async_operation_pools[pool] != NULL)
+  {
+    g_thread_pool_set_max_threads(
+      inf_async_operation_pools[pool],
+      max_threads,
+      NULL
+    );
+  }
+
+  G_UNLOCK(inf_async_operation_pools);
+}
+
+/**
+ * inf_async_operation_get_max_threads:
+ * @pool: The pool whose size to return.
+ *
+ * Returns the maximum number of worker threads in @pool that run
+ * asynchronous operations at the same time, see
+ * inf_async_operation_set_max_threads().
+ *
+ * Returns: The maximum number of worker threads.
+ */
+guint
+inf_async_operation_get_max_threads(InfAsyncOperationPool pool)
+{
+  guint max_threads;
+
+  g_return_val_if_fail(pool < INF_ASYNC_OPERATION_N_POOLS, 0);
+
+  G_LOCK(inf_async_operation_pools);
+
+  max_threads = inf_async_operation_max_threads[pool];
+  if(max_threads == 0)
+    max_threads = inf_async_operation_default_max_threads();
+
+  G_UNLOCK(inf_async_operation_pools);
+  return max_threads;
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -26,6 +26,23 @@
 
 G_BEGIN_DECLS
 
+/**
+ * InfAsyncOperationPool:
+ * @INF_ASYNC_OPERATION_POOL_DEFAULT: The pool for most operations, such as
+ * reading and writing files.
+ * @INF_ASYNC_OPERATION_POOL_HANDSHAKE: The pool for work done while a
+ * connection is being established, such as TLS handshakes and
+ * authentication. New connections can then not be held up by slow storage.
+ *
+ * The pools of worker threads on which asynchronous operations run. Each
+ * pool has its own maximum number of threads, see
+ * inf_async_operation_set_max_threads().
+ */
+typedef enum _InfAsyncOperationPool {
+  INF_ASYNC_OPERATION_POOL_DEFAULT,
+  INF_ASYNC_OPERATION_POOL_HANDSHAKE
+} InfAsyncOperationPool;
+
 /**
  * InfAsyncOperationRunFunc:
  * @run_data: Location where to write the result of the asynchronous
@@ -70,9 +87,20 @@ gboolean
 inf_async_operation_start(InfAsyncOperation* op,
                           GError** error);
 
+void
+inf_async_operation_set_pool(InfAsyncOperation* op,
+                             InfAsyncOperationPool pool);
+
 void
 inf_async_operation_free(InfAsyncOperation* op);
 
+void
+inf_async_operation_set_max_threads(InfAsyncOperationPool pool,
+                                    guint max_threads);
+
+guint
+inf_async_operation_get_max_threads(InfAsyncOperationPool pool);
+
 G_END_DECLS
 
 #endif /* __INF_ASYNC_OPERATION_H__ */
@@ -0,0 +1,50 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#ifndef __INF_BROWSER_PRIVATE_H__
+#define __INF_BROWSER_PRIVATE_H__
+
+#include <libinfinity/common/inf-browser.h>
+
+G_BEGIN_DECLS
+
+typedef struct _InfBrowserAclCache InfBrowserAclCache;
+
+InfBrowserAclCache*
+_inf_browser_acl_cache_new(void);
+
+void
+_inf_browser_acl_cache_free(InfBrowserAclCache* cache);
+
+void
+_inf_browser_acl_cache_invalidate(InfBrowserAclCache* cache);
+
+gboolean
+_inf_browser_acl_cache_check(InfBrowserAclCache* cache,
+                             InfBrowser* browser,
+                             const InfBrowserIter* iter,
+                             InfAclAccountId account,
+                             const InfAclMask* check_mask,
+                             InfAclMask* out_mask);
+
+G_END_DECLS
+
+#endif /* __INF_BROWSER_PRIVATE_H__ */
+
+/* vim:set et sw=2 ts=2: */
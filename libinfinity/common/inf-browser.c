@@ -35,6 +35,7 @@
  */
 
 #include <libinfinity/common/inf-browser.h>
+#include <libinfinity/common/inf-browser-private.h>
 #include <libinfinity/inf-define-enum.h>
 
 #include <string.h>
@@ -55,6 +56,25 @@ static const GEnumValue inf_browser_status_values[] = {
   }
 };
 
+/* Effective permissions of one account at one node, valid as long as the
+ * cache generation has not changed since they were computed. */
+typedef struct _InfBrowserAclCacheEntry InfBrowserAclCacheEntry;
+struct _InfBrowserAclCacheEntry {
+  guint node_id;
+  InfAclAccountId account;
+  guint generation;
+  InfAclMask perms;
+};
+
+struct _InfBrowserAclCache {
+  GHashTable* entries;
+  guint generation;
+};
+
+/* The cache is cleared when it grows beyond this number of entries, so that
+ * stale entries of removed nodes do not accumulate. */
+#define INF_BROWSER_ACL_CACHE_MAX_ENTRIES 65536
+
 INF_DEFINE_ENUM_TYPE(InfBrowserStatus, inf_browser_status, inf_browser_status_values)
 G_DEFINE_INTERFACE(InfBrowser, inf_browser, G_TYPE_OBJECT)
 
@@ -1510,42 +1530,14 @@ inf_browser_set_acl(InfBrowser* browser,
   return iface->set_acl(browser, iter, sheet_set, func, user_data);
 }
 
-/**
- * inf_browser_check_acl:
- * @browser: A #InfBrowser.
- * @iter: A #InfBrowserIter pointing to a node in a browser.
- * @account: The ID of the account whose permission to check, or %NULL.
- * @check_mask: A bitmask of #InfAclSetting<!-- -->s with permissions to
- * check.
- * @out_mask: (out): Output parameter with the granted permissions, or %NULL.
- *
- * Checks whether the given account has permissions to perform the operations
- * specified by @mask on the node @iter points to. The @mask parameter
- * should have all permissions enabled that are to be checked. The function
- * will then write those permissions that are actually granted to the
- * mask specified by the @out_mask parameter.
- *
- * The function returns %TRUE if all permissions asked for are granted, i.e.
- * when *@out_mask equals *@mask after the function call. The @out_mask
- * parameter is allowed to be %NULL which is useful if only the return value
- * is of interest.
- *
- * In order for this function to work, the ACL sheet for @account has to be
- * available for the node @iter points to and all of its parent nodes. If
- * @account is not the default or the local account, these need to be queried
- * before using inf_browser_query_acl().
- *
- * If account is 0, it is assumed that local access to the directory is
- * available and the function always returns %TRUE.
- *
- * Returns: %TRUE if all checked permissions are granted, or %FALSE otherwise.
- */
-gboolean
-inf_browser_check_acl(InfBrowser* browser,
-                      const InfBrowserIter* iter,
-                      InfAclAccountId account,
-                      const InfAclMask* check_mask,
-                      InfAclMask* out_mask)
+/* Checks the permissions of account at iter by walking up the tree until
+ * the sheets of the nodes on the way define all of check_mask. */
+static gboolean
+inf_browser_check_acl_walk(InfBrowser* browser,
+                           const InfBrowserIter* iter,
+                           InfAclAccountId account,
+                           const InfAclMask* check_mask,
+                           InfAclMask* out_mask)
 {
   const InfAclAccount* default_account;
   InfBrowserIter check_iter;
@@ -1555,17 +1547,6 @@ inf_browser_check_acl(InfBrowser* browser,
   const InfAclSheet* sheet;
   InfAclMask temp_mask;
 
-  g_return_val_if_fail(INF_IS_BROWSER(browser), FALSE);
-  g_return_val_if_fail(iter != NULL, FALSE);
-  g_return_val_if_fail(check_mask != NULL, FALSE);
-
-  if(account == 0)
-  {
-    if(out_mask != NULL)
-      *out_mask = *check_mask;
-    return TRUE;
-  }
-
   default_account = inf_browser_get_acl_default_account(browser);
   if(default_account->id == account)
     default_account = NULL;
@@ -1628,6 +1609,73 @@ inf_browser_check_acl(InfBrowser* browser,
   return FALSE;
 }
 
+/**
+ * inf_browser_check_acl:
+ * @browser: A #InfBrowser.
+ * @iter: A #InfBrowserIter pointing to a node in a browser.
+ * @account: The ID of the account whose permission to check, or %NULL.
+ * @check_mask: A bitmask of #InfAclSetting<!-- -->s with permissions to
+ * check.
+ * @out_mask: (out): Output parameter with the granted permissions, or %NULL.
+ *
+ * Checks whether the given account has permissions to perform the operations
+ * specified by @mask on the node @iter points to. The @mask parameter
+ * should have all permissions enabled that are to be checked. The function
+ * will then write those permissions that are actually granted to the
+ * mask specified by the @out_mask parameter.
+ *
+ * The function returns %TRUE if all permissions asked for are granted, i.e.
+ * when *@out_mask equals *@mask after the function call. The @out_mask
+ * parameter is allowed to be %NULL which is useful if only the return value
+ * is of interest.
+ *
+ * In order for this function to work, the ACL sheet for @account has to be
+ * available for the node @iter points to and all of its parent nodes. If
+ * @account is not the default or the local account, these need to be queried
+ * before using inf_browser_query_acl().
+ *
+ * If account is 0, it is assumed that local access to the directory is
+ * available and the function always returns %TRUE.
+ *
+ * If the browser implements the check_acl virtual function, for example to
+ * cache the effective permissions of an account, then the check is
+ * delegated to it.
+ *
+ * Returns: %TRUE if all checked permissions are granted, or %FALSE otherwise.
+ */
+gboolean
+inf_browser_check_acl(InfBrowser* browser,
+                      const InfBrowserIter* iter,
+                      InfAclAccountId account,
+                      const InfAclMask* check_mask,
+                      InfAclMask* out_mask)
+{
+  InfBrowserInterface* iface;
+
+  g_return_val_if_fail(INF_IS_BROWSER(browser), FALSE);
+  g_return_val_if_fail(iter != NULL, FALSE);
+  g_return_val_if_fail(check_mask != NULL, FALSE);
+
+  if(account == 0)
+  {
+    if(out_mask != NULL)
+      *out_mask = *check_mask;
+    return TRUE;
+  }
+
+  iface = INF_BROWSER_GET_IFACE(browser);
+  if(iface->check_acl != NULL)
+    return iface->check_acl(browser, iter, account, check_mask, out_mask);
+
+  return inf_browser_check_acl_walk(
+    browser,
+    iter,
+    account,
+    check_mask,
+    out_mask
+  );
+}
+
 /**
  * inf_browser_error:
  * @browser: A #InfBrowser.
@@ -1916,4 +1964,220 @@ inf_browser_acl_changed(InfBrowser* browser,
   );
 }
 
+static guint
+inf_browser_acl_cache_entry_hash(gconstpointer key)
+{
+  const InfBrowserAclCacheEntry* entry;
+  entry = (const InfBrowserAclCacheEntry*)key;
+
+  return entry->node_id * 31 + entry->account;
+}
+
+static gboolean
+inf_browser_acl_cache_entry_equal(gconstpointer a,
+                                  gconstpointer b)
+{
+  const InfBrowserAclCacheEntry* entry_a;
+  const InfBrowserAclCacheEntry* entry_b;
+
+  entry_a = (const InfBrowserAclCacheEntry*)a;
+  entry_b = (const InfBrowserAclCacheEntry*)b;
+
+  return entry_a->node_id == entry_b->node_id &&
+    entry_a->account == entry_b->account;
+}
+
+static void
+inf_browser_acl_cache_entry_free(gpointer entry)
+{
+  g_slice_free(InfBrowserAclCacheEntry, entry);
+}
+
+static void
+inf_browser_acl_cache_apply_sheet(const InfAclSheet* sheet,
+                                  InfAclMask* perms)
+{
+  InfAclMask defined;
+  InfAclMask inherited;
+
+  /* Permissions in the sheet's mask are taken from the sheet, all others
+   * are inherited. */
+  inf_acl_mask_and(&sheet->perms, &sheet->mask, &defined);
+  inf_acl_mask_neg(&sheet->mask, &inherited);
+  inf_acl_mask_and(perms, &inherited, perms);
+  inf_acl_mask_or(perms, &defined, perms);
+}
+
+/* Computes the full set of permissions that account has at the node iter
+ * points to. The result for the parent node is computed first, and then
+ * overridden by the sheets of this node, so that a miss only walks up to
+ * the closest cached ancestor. Returns FALSE without caching anything if
+ * the sheets of account are not available at iter or one of its
+ * ancestors, for example because the ACL of that node has not been
+ * queried. The full set of permissions is not known then, even though
+ * the permissions that are being checked might be. */
+static gboolean
+inf_browser_acl_cache_get_perms(InfBrowserAclCache* cache,
+                                InfBrowser* browser,
+                                const InfBrowserIter* iter,
+                                InfAclAccountId account,
+                                InfAclAccountId default_id,
+                                InfAclMask* perms)
+{
+  InfBrowserAclCacheEntry key;
+  InfBrowserAclCacheEntry* entry;
+  InfBrowserIter parent_iter;
+  const InfAclSheetSet* sheet_set;
+  const InfAclSheet* sheet;
+  gboolean result;
+
+  key.node_id = iter->node_id;
+  key.account = account;
+
+  entry = g_hash_table_lookup(cache->entries, &key);
+  if(entry != NULL && entry->generation == cache->generation)
+  {
+    *perms = entry->perms;
+    return TRUE;
+  }
+
+  if(!inf_browser_has_acl(browser, iter, account))
+    return FALSE;
+
+  parent_iter = *iter;
+  if(inf_browser_get_parent(browser, &parent_iter))
+  {
+    result = inf_browser_acl_cache_get_perms(
+      cache,
+      browser,
+      &parent_iter,
+      account,
+      default_id,
+      perms
+    );
+
+    if(result == FALSE)
+      return FALSE;
+  }
+  else
+  {
+    /* The default sheet of the root node defines all permissions */
+    inf_acl_mask_clear(perms);
+  }
+
+  sheet_set = inf_browser_get_acl(browser, iter);
+  if(sheet_set != NULL)
+  {
+    /* At the same node, the account's own sheet has precedence over the
+     * sheet of the default account. */
+    if(default_id != account)
+    {
+      sheet = inf_acl_sheet_set_find_const_sheet(sheet_set, default_id);
+      if(sheet != NULL)
+        inf_browser_acl_cache_apply_sheet(sheet, perms);
+    }
+
+    sheet = inf_acl_sheet_set_find_const_sheet(sheet_set, account);
+    if(sheet != NULL)
+      inf_browser_acl_cache_apply_sheet(sheet, perms);
+  }
+
+  if(entry == NULL)
+  {
+    if(g_hash_table_size(cache->entries) >= INF_BROWSER_ACL_CACHE_MAX_ENTRIES)
+      g_hash_table_remove_all(cache->entries);
+
+    entry = g_slice_new(InfBrowserAclCacheEntry);
+    entry->node_id = iter->node_id;
+    entry->account = account;
+    g_hash_table_add(cache->entries, entry);
+  }
+
+  entry->generation = cache->generation;
+  entry->perms = *perms;
+  return TRUE;
+}
+
+/* Creates a cache for the effective permissions of accounts at the nodes of
+ * a browser. It can be used by browser implementations to implement the
+ * check_acl virtual function. This is not public API. */
+InfBrowserAclCache*
+_inf_browser_acl_cache_new(void)
+{
+  InfBrowserAclCache* cache;
+  cache = g_slice_new(InfBrowserAclCache);
+
+  cache->entries = g_hash_table_new_full(
+    inf_browser_acl_cache_entry_hash,
+    inf_browser_acl_cache_entry_equal,
+    inf_browser_acl_cache_entry_free,
+    NULL
+  );
+
+  cache->generation = 0;
+  return cache;
+}
+
+void
+_inf_browser_acl_cache_free(InfBrowserAclCache* cache)
+{
+  g_hash_table_destroy(cache->entries);
+  g_slice_free(InfBrowserAclCache, cache);
+}
+
+/* Must be called whenever the ACL of any node changes, or when node IDs
+ * might be reused. All cached permissions become invalid. */
+void
+_inf_browser_acl_cache_invalidate(InfBrowserAclCache* cache)
+{
+  ++cache->generation;
+}
+
+/* Same as inf_browser_check_acl(), but looks up the effective permissions
+ * in cache, and stores them there if they are not cached yet. */
+gboolean
+_inf_browser_acl_cache_check(InfBrowserAclCache* cache,
+                             InfBrowser* browser,
+                             const InfBrowserIter* iter,
+                             InfAclAccountId account,
+                             const InfAclMask* check_mask,
+                             InfAclMask* out_mask)
+{
+  const InfAclAccount* default_account;
+  InfAclMask perms;
+  gboolean result;
+
+  default_account = inf_browser_get_acl_default_account(browser);
+
+  result = inf_browser_acl_cache_get_perms(
+    cache,
+    browser,
+    iter,
+    account,
+    default_account->id,
+    &perms
+  );
+
+  /* Fall back to only look at the nodes that are needed for check_mask */
+  if(result == FALSE)
+  {
+    return inf_browser_check_acl_walk(
+      browser,
+      iter,
+      account,
+      check_mask,
+      out_mask
+    );
+  }
+
+  inf_acl_mask_and(&perms, check_mask, &perms);
+
+  if(out_mask != NULL)
+    *out_mask = perms;
+
+  if(inf_acl_mask_equal(&perms, check_mask))
+    return TRUE;
+  return FALSE;
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -125,6 +125,9 @@ typedef enum _InfBrowserStatus {
  * or is otherwise available.
  * @get_acl: Virtual function for obtaining the full ACL for a node.
  * @set_acl: Virtual function for changing the ACL for one node.
+ * @check_acl: Virtual function for checking the permissions of an account
+ * at a node, or %NULL to walk the ACLs of the node and its parents with
+ * @has_acl and @get_acl on every check.
  *
  * Signals and virtual functions for the #InfBrowser interface.
  */
@@ -282,6 +285,12 @@ struct _InfBrowserInterface {
                          const InfAclSheetSet* sheet_set,
                          InfRequestFunc func,
                          gpointer user_data);
+
+  gboolean (*check_acl)(InfBrowser* browser,
+                        const InfBrowserIter* iter,
+                        InfAclAccountId account,
+                        const InfAclMask* check_mask,
+                        InfAclMask* out_mask);
 };
 
 GType
@@ -34,7 +34,7 @@
 G_DEFINE_BOXED_TYPE(InfCertificateCredentials, inf_certificate_credentials, inf_certificate_credentials_ref, inf_certificate_credentials_unref)
 
 struct _InfCertificateCredentials {
-  guint ref_count;
+  gint ref_count;
   gnutls_certificate_credentials_t creds;
 };
 
@@ -72,7 +72,7 @@ InfCertificateCredentials*
 inf_certificate_credentials_ref(InfCertificateCredentials* creds)
 {
   g_return_val_if_fail(creds != NULL, NULL);
-  ++creds->ref_count;
+  g_atomic_int_inc(&creds->ref_count);
   return creds;
 }
 
@@ -81,13 +81,15 @@ inf_certificate_credentials_ref(InfCertificateCredentials* creds)
  * @creds: A #InfCertificateCredentials.
  *
  * Decreases the reference count of @creds by 1. If its reference count
- * reaches 0, then the #InfCertificateCredentials will be freed.
+ * reaches 0, then the #InfCertificateCredentials will be freed. The
+ * reference count is changed atomically, so that a TLS handshake running in
+ * a worker thread can hold a reference.
  */
 void
 inf_certificate_credentials_unref(InfCertificateCredentials* creds)
 {
   g_return_if_fail(creds != NULL);
-  if(!--creds->ref_count)
+  if(g_atomic_int_dec_and_test(&creds->ref_count))
   {
     gnutls_certificate_free_credentials(creds->creds);
     g_slice_free(InfCertificateCredentials, creds);
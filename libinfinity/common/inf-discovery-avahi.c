@@ -114,6 +114,7 @@ struct _InfDiscoveryAvahiPrivate {
   InfXmppManager* xmpp_manager;
   InfXmppConnectionSecurityPolicy security_policy;
   InfKeepalive keepalive;
+  guint compression_level;
 
   InfCertificateCredentials* creds;
   InfSaslContext* sasl_context;
@@ -137,7 +138,8 @@ enum {
   PROP_SASL_CONTEXT,
   PROP_SASL_MECHANISMS,
   PROP_SECURITY_POLICY,
-  PROP_KEEPALIVE
+  PROP_KEEPALIVE,
+  PROP_COMPRESSION_LEVEL
 };
 
 #define INF_DISCOVERY_AVAHI_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_TYPE_DISCOVERY_AVAHI, InfDiscoveryAvahiPrivate))
@@ -382,6 +384,15 @@ inf_discovery_avahi_service_resolver_callback(AvahiServiceResolver* resolver,
           priv->sasl_context == NULL ? NULL : priv->sasl_mechanisms
         );
 
+        if(priv->compression_level > 0)
+        {
+          g_object_set(
+            G_OBJECT(xmpp),
+            "compression-level", priv->compression_level,
+            NULL
+          );
+        }
+
         g_object_unref(tcp);
 
         inf_xmpp_manager_add_connection(priv->xmpp_manager, xmpp);
@@ -1116,6 +1127,7 @@ inf_discovery_avahi_init(InfDiscoveryAvahi* avahi)
   priv->xmpp_manager = NULL;
   priv->security_policy = INF_XMPP_CONNECTION_SECURITY_BOTH_PREFER_TLS;
   priv->keepalive.mask = 0;
+  priv->compression_level = 0;
   priv->creds = NULL;
   priv->sasl_context = NULL;
   priv->sasl_mechanisms = NULL;
@@ -1251,6 +1263,9 @@ inf_discovery_avahi_set_property(GObject* object,
     g_assert(g_value_get_boxed(value) != NULL);
     priv->keepalive = *(const InfKeepalive*)g_value_get_boxed(value);
     break;
+  case PROP_COMPRESSION_LEVEL:
+    priv->compression_level = g_value_get_uint(value);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -1292,6 +1307,9 @@ inf_discovery_avahi_get_property(GObject* object,
   case PROP_KEEPALIVE:
     g_value_set_boxed(value, &priv->keepalive);
     break;
+  case PROP_COMPRESSION_LEVEL:
+    g_value_set_uint(value, priv->compression_level);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -1623,6 +1641,21 @@ inf_discovery_avahi_class_init(InfDiscoveryAvahiClass* avahi_class)
       G_PARAM_READWRITE
     )
   );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSION_LEVEL,
+    g_param_spec_uint(
+      "compression-level",
+      "Compression level",
+      "The stream compression level for new connections, see "
+      "InfXmppConnection:compression-level",
+      0,
+      9,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
 }
 
 static void
@@ -25,6 +25,13 @@
  * @stability: Unstable
  *
  * This section defines common protocol parameters used by libinfinity.
+ *
+ * Newer minor versions of the protocol are backwards compatible with older
+ * ones. Features that an older peer would not understand are only used once
+ * the remote side has announced a version that supports them, see
+ * inf_protocol_set_remote_version() and
+ * inf_protocol_get_remote_supports(). Version 1.2 adds diff-encoded state
+ * vectors for the requests sent during session synchronization.
  **/
 
 #include <libinfinity/common/inf-protocol.h>
@@ -34,6 +41,8 @@
 #include <stdlib.h>
 #include <errno.h>
 
+static GQuark inf_protocol_remote_version_quark;
+
 /**
  * inf_protocol_get_version:
  *
@@ -45,7 +54,7 @@
 const gchar*
 inf_protocol_get_version(void)
 {
-  return "1.1";
+  return "1.2";
 }
 
 /**
@@ -131,6 +140,134 @@ inf_protocol_parse_version(const gchar* version,
   return TRUE;
 }
 
+/**
+ * inf_protocol_set_remote_version:
+ * @connection: A #InfXmlConnection.
+ * @version: The protocol version announced by the remote side of
+ * @connection.
+ * @error: Location to store error information, if any.
+ *
+ * Remembers which protocol version the remote side of @connection
+ * implements, so that protocol features which the remote side supports can
+ * be used when sending data to it. If @version is badly formatted, the
+ * function returns %FALSE, @error is set and the previously remembered
+ * version, if any, is kept.
+ *
+ * Returns: %TRUE on success, or %FALSE on error.
+ */
+gboolean
+inf_protocol_set_remote_version(InfXmlConnection* connection,
+                                const gchar* version,
+                                GError** error)
+{
+  guint* remote_version;
+  guint major;
+  guint minor;
+
+  g_return_val_if_fail(INF_IS_XML_CONNECTION(connection), FALSE);
+  g_return_val_if_fail(version != NULL, FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  if(!inf_protocol_parse_version(version, &major, &minor, error))
+    return FALSE;
+
+  if(inf_protocol_remote_version_quark == 0)
+  {
+    inf_protocol_remote_version_quark =
+      g_quark_from_static_string("inf-protocol-remote-version");
+  }
+
+  remote_version = g_new(guint, 2);
+  remote_version[0] = major;
+  remote_version[1] = minor;
+
+  g_object_set_qdata_full(
+    G_OBJECT(connection),
+    inf_protocol_remote_version_quark,
+    remote_version,
+    g_free
+  );
+
+  return TRUE;
+}
+
+/**
+ * inf_protocol_get_remote_version:
+ * @connection: A #InfXmlConnection.
+ * @major: (out) (allow-none): A location to store the major version number
+ * to, or %NULL.
+ * @minor: (out) (allow-none): A location to store the minor version number
+ * to, or %NULL.
+ *
+ * Returns the protocol version the remote side of @connection has announced
+ * and which was set with inf_protocol_set_remote_version(). If it is not
+ * known, the function returns %FALSE and @major and @minor are left
+ * untouched.
+ *
+ * Returns: %TRUE if the remote protocol version is known, or %FALSE
+ * otherwise.
+ */
+gboolean
+inf_protocol_get_remote_version(InfXmlConnection* connection,
+                                guint* major,
+                                guint* minor)
+{
+  guint* remote_version;
+
+  g_return_val_if_fail(INF_IS_XML_CONNECTION(connection), FALSE);
+
+  if(inf_protocol_remote_version_quark == 0)
+    return FALSE;
+
+  remote_version = g_object_get_qdata(
+    G_OBJECT(connection),
+    inf_protocol_remote_version_quark
+  );
+
+  if(remote_version == NULL)
+    return FALSE;
+
+  if(major) *major = remote_version[0];
+  if(minor) *minor = remote_version[1];
+  return TRUE;
+}
+
+/**
+ * inf_protocol_get_remote_supports:
+ * @connection: A #InfXmlConnection.
+ * @major: The major protocol version to check for.
+ * @minor: The minor protocol version to check for.
+ *
+ * Returns whether the remote side of @connection is known to implement
+ * protocol version @major.@minor or a later, compatible version. If the
+ * remote side has not announced its version with
+ * inf_protocol_set_remote_version(), the function returns %FALSE.
+ *
+ * Returns: Whether the remote side supports the given protocol version.
+ */
+gboolean
+inf_protocol_get_remote_supports(InfXmlConnection* connection,
+                                 guint major,
+                                 guint minor)
+{
+  guint remote_major;
+  guint remote_minor;
+  gboolean known;
+
+  g_return_val_if_fail(INF_IS_XML_CONNECTION(connection), FALSE);
+
+  known = inf_protocol_get_remote_version(
+    connection,
+    &remote_major,
+    &remote_minor
+  );
+
+  if(!known)
+    return FALSE;
+
+  return remote_major == major && remote_minor >= minor;
+}
+
 /**
  * inf_protocol_get_default_port:
  *
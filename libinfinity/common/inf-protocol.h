@@ -20,6 +20,8 @@
 #ifndef __INF_PROTOCOL_H__
 #define __INF_PROTOCOL_H__
 
+#include <libinfinity/common/inf-xml-connection.h>
+
 #include <glib-object.h>
 
 G_BEGIN_DECLS
@@ -33,6 +35,21 @@ inf_protocol_parse_version(const gchar* version,
                            guint* minor,
                            GError** error);
 
+gboolean
+inf_protocol_set_remote_version(InfXmlConnection* connection,
+                                const gchar* version,
+                                GError** error);
+
+gboolean
+inf_protocol_get_remote_version(InfXmlConnection* connection,
+                                guint* major,
+                                guint* minor);
+
+gboolean
+inf_protocol_get_remote_supports(InfXmlConnection* connection,
+                                 guint major,
+                                 guint minor);
+
 guint
 inf_protocol_get_default_port(void);
 
@@ -41,11 +41,16 @@
  * issued in the user thread. However, it requires an #InfIo object to
  * dispatch messages to it. Also, all #InfSaslContext functions are fully
  * thread-safe.
+ *
+ * If answering a property query blocks, such as checking a password with
+ * PAM, the callback can use inf_sasl_context_session_run_in_worker() to do
+ * the blocking part in a worker thread.
  **/
 
 #include <libinfinity/common/inf-sasl-context.h>
 #include <libinfinity/common/inf-standalone-io.h>
 #include <libinfinity/common/inf-error.h>
+#include <libinfinity/common/inf-async-operation.h>
 
 #include <string.h>
 
@@ -86,6 +91,10 @@ struct _InfSaslContextSession {
    * whether more data can be given to the context or not. */
   gboolean stepping;
 
+  /* Blocking work for a property query running in a worker thread, see
+   * inf_sasl_context_session_run_in_worker(). Main thread only. */
+  InfAsyncOperation* work;
+
   /* used in session thread only */
   gchar* step64;
   InfSaslContextSessionFeedFunc feed_func;
@@ -95,6 +104,15 @@ struct _InfSaslContextSession {
   InfSaslContextSessionStatus status;
 };
 
+typedef struct _InfSaslContextWork InfSaslContextWork;
+struct _InfSaslContextWork {
+  InfSaslContextSession* session;
+  InfSaslContextSessionWorkFunc func;
+  InfSaslContextSessionWorkDoneFunc done;
+  gpointer user_data;
+  GDestroyNotify notify;
+};
+
 typedef struct _InfSaslContextMessage InfSaslContextMessage;
 struct _InfSaslContextMessage {
   InfSaslContextSession* session;
@@ -478,6 +496,51 @@ inf_sasl_context_thread_func(gpointer data)
   return NULL;
 }
 
+/*
+ * Work in worker threads
+ */
+
+static void
+inf_sasl_context_work_free(gpointer data)
+{
+  InfSaslContextWork* work;
+  work = (InfSaslContextWork*)data;
+
+  if(work->notify != NULL)
+    work->notify(work->user_data);
+
+  g_slice_free(InfSaslContextWork, work);
+}
+
+static void
+inf_sasl_context_work_run_func(gpointer* run_data,
+                               GDestroyNotify* run_notify,
+                               gpointer user_data)
+{
+  InfSaslContextWork* work;
+  work = (InfSaslContextWork*)user_data;
+
+  /* worker thread */
+  work->func(work->user_data);
+
+  *run_data = work;
+  *run_notify = inf_sasl_context_work_free;
+}
+
+static void
+inf_sasl_context_work_done_func(gpointer run_data,
+                                gpointer user_data)
+{
+  InfSaslContextWork* work;
+  work = (InfSaslContextWork*)run_data;
+
+  /* main thread */
+  g_assert(work->session->work != NULL);
+  work->session->work = NULL;
+
+  work->done(work->session, work->user_data);
+}
+
 /*
  * Helper functions
  */
@@ -502,6 +565,7 @@ inf_sasl_context_start_session(InfSaslContext* context,
   session->dispatch = NULL;
   session->thread = NULL;
   session->stepping = FALSE;
+  session->work = NULL;
 
   session->status = INF_SASL_CONTEXT_SESSION_OUTER;
   session->step64 = NULL;
@@ -975,6 +1039,14 @@ inf_sasl_context_stop_session(InfSaslContext* context,
   g_return_if_fail(session->context == context);
   g_mutex_unlock(&context->mutex);
 
+  /* Cancel work for a property query. Its result would be for a session
+   * that does not exist anymore. */
+  if(session->work != NULL)
+  {
+    inf_async_operation_free(session->work);
+    session->work = NULL;
+  }
+
   /* Tell client thread to terminate */
   g_async_queue_push(
     session->session_queue,
@@ -1076,6 +1148,78 @@ inf_sasl_context_session_continue(InfSaslContextSession* session,
   );
 }
 
+/**
+ * inf_sasl_context_session_run_in_worker:
+ * @session: A #InfSaslContextSession.
+ * @func: (scope async): The function to run in a worker thread.
+ * @done: (scope async): The function to call once @func has finished.
+ * @user_data: Additional user data to pass to @func and @done.
+ * @notify: Function to free @user_data, or %NULL.
+ * @error: Location to store error information, if any.
+ *
+ * This function can be used by the #InfSaslContextCallbackFunc if
+ * answering a property query blocks, for example because a password needs
+ * to be checked against an external authentication system. It runs @func in
+ * the %INF_ASYNC_OPERATION_POOL_HANDSHAKE pool of worker threads of
+ * #InfAsyncOperation, so that many authentications at the same time do not
+ * block the thread of the session, and do not spawn an unbounded number of
+ * threads. Once @func has finished,
+ * @done is called in the thread of the session's #InfIo, and it should call
+ * inf_sasl_context_session_continue().
+ *
+ * If @session is stopped before @done was called, then @done is not called
+ * anymore. In that case @notify might be called from the worker thread.
+ *
+ * Only one such function can run for a session at a time. If the worker
+ * could not be started, %FALSE is returned and @error is set. In that case
+ * @notify is not called, and the caller should answer the query directly.
+ *
+ * Returns: %TRUE if @func was started, or %FALSE on error.
+ */
+gboolean
+inf_sasl_context_session_run_in_worker(InfSaslContextSession* session,
+                                       InfSaslContextSessionWorkFunc func,
+                                       InfSaslContextSessionWorkDoneFunc done,
+                                       gpointer user_data,
+                                       GDestroyNotify notify,
+                                       GError** error)
+{
+  InfSaslContextWork* work;
+
+  g_return_val_if_fail(session != NULL, FALSE);
+  g_return_val_if_fail(func != NULL, FALSE);
+  g_return_val_if_fail(done != NULL, FALSE);
+  g_return_val_if_fail(session->work == NULL, FALSE);
+
+  work = g_slice_new(InfSaslContextWork);
+  work->session = session;
+  work->func = func;
+  work->done = done;
+  work->user_data = user_data;
+  work->notify = notify;
+
+  session->work = inf_async_operation_new(
+    session->main_io,
+    inf_sasl_context_work_run_func,
+    inf_sasl_context_work_done_func,
+    work
+  );
+
+  inf_async_operation_set_pool(
+    session->work,
+    INF_ASYNC_OPERATION_POOL_HANDSHAKE
+  );
+
+  if(!inf_async_operation_start(session->work, error))
+  {
+    session->work = NULL;
+    g_slice_free(InfSaslContextWork, work);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
 /**
  * inf_sasl_context_session_feed:
  * @session: A #InfSaslContextSession.
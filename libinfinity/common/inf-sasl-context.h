@@ -96,6 +96,31 @@ typedef void(*InfSaslContextSessionFeedFunc)(InfSaslContextSession* session,
                                              const GError* error,
                                              gpointer user_data);
 
+/**
+ * InfSaslContextSessionWorkFunc:
+ * @user_data: The user data specified in
+ * inf_sasl_context_session_run_in_worker().
+ *
+ * This function performs a blocking part of answering a property query, such
+ * as checking a password against an external authentication system. It runs
+ * in a worker thread and must therefore not access the
+ * #InfSaslContextSession or any other object that is not thread-safe.
+ */
+typedef void(*InfSaslContextSessionWorkFunc)(gpointer user_data);
+
+/**
+ * InfSaslContextSessionWorkDoneFunc:
+ * @session: A #InfSaslContextSession.
+ * @user_data: The user data specified in
+ * inf_sasl_context_session_run_in_worker().
+ *
+ * This function is called in the thread of the session's #InfIo once the
+ * #InfSaslContextSessionWorkFunc has finished. It is expected to call
+ * inf_sasl_context_session_continue() for @session.
+ */
+typedef void(*InfSaslContextSessionWorkDoneFunc)(InfSaslContextSession* session,
+                                                 gpointer user_data);
+
 GType
 inf_sasl_context_get_type(void) G_GNUC_CONST;
 
@@ -165,6 +190,14 @@ void
 inf_sasl_context_session_continue(InfSaslContextSession* session,
                                   int retval);
 
+gboolean
+inf_sasl_context_session_run_in_worker(InfSaslContextSession* session,
+                                       InfSaslContextSessionWorkFunc func,
+                                       InfSaslContextSessionWorkDoneFunc done,
+                                       gpointer user_data,
+                                       GDestroyNotify notify,
+                                       GError** error);
+
 void
 inf_sasl_context_session_feed(InfSaslContextSession* session,
                               const char* data,
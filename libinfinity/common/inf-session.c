@@ -59,6 +59,7 @@
 #include <libinfinity/common/inf-session.h>
 #include <libinfinity/common/inf-buffer.h>
 #include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-protocol.h>
 #include <libinfinity/common/inf-error.h>
 #include <libinfinity/communication/inf-communication-object.h>
 #include <libinfinity/inf-i18n.h>
@@ -105,6 +106,39 @@ struct _InfSessionSync {
   InfSessionSyncStatus status;
 };
 
+/* A snapshot of the session for synchronization. It is shared between all
+ * connections that start synchronizing while the session does not change,
+ * so that the messages are produced only once even if many connections
+ * join at the same time. Only the messages between the slowest and the
+ * fastest of these connections are kept. Once the slowest one has taken a
+ * message, the snapshot is no longer offered to new connections, since
+ * they would need to start from the beginning. */
+typedef struct _InfSessionSyncCache InfSessionSyncCache;
+struct _InfSessionSyncCache {
+  InfSession* session;
+  GSList* streams;
+
+  /* The stream from sync_stream_new, or NULL once it has ended */
+  gpointer stream;
+  GPtrArray* messages;
+  guint offset; /* index of the first message in messages */
+  guint n_messages;
+
+  /* The protocol version of the remote side the messages were made for */
+  gboolean has_version;
+  guint major;
+  guint minor;
+};
+
+/* Synchronization messages that are produced only when they are about to
+ * be sent, see inf_communication_group_send_stream(). */
+typedef struct _InfSessionSyncStream InfSessionSyncStream;
+struct _InfSessionSyncStream {
+  InfSession* session;
+  InfSessionSyncCache* cache;
+  guint index;
+};
+
 typedef struct _InfSessionPrivate InfSessionPrivate;
 struct _InfSessionPrivate {
   InfCommunicationManager* manager;
@@ -115,6 +149,11 @@ struct _InfSessionPrivate {
   /* Group of subscribed connections */
   InfCommunicationGroup* subscription_group;
 
+  /* Snapshot of the current state for synchronization, if any. This does
+   * not hold a reference; the cache is removed when it is freed or when
+   * the session changes. */
+  InfSessionSyncCache* sync_cache;
+
   union {
     /* INF_SESSION_PRESYNC */
     struct {
@@ -189,6 +228,19 @@ G_DEFINE_TYPE_WITH_CODE(InfSession, inf_session, G_TYPE_OBJECT,
  * Utility functions.
  */
 
+/* Called whenever something happens in the session that connections
+ * synchronizing from now on need to know about, but which connections that
+ * are already being synchronized get told separately. */
+static void
+inf_session_invalidate_sync_cache(InfSession* session)
+{
+  InfSessionPrivate* priv;
+  priv = INF_SESSION_PRIVATE(session);
+
+  /* Synchronizations in progress keep using the cache */
+  priv->sync_cache = NULL;
+}
+
 static const gchar*
 inf_session_sync_strerror(InfSessionSyncError errcode)
 {
@@ -457,6 +509,7 @@ inf_session_init(InfSession* session)
   priv->buffer = NULL;
   priv->user_table = NULL;
   priv->status = INF_SESSION_RUNNING;
+  priv->sync_cache = NULL;
 
   priv->shared.run.syncs = NULL;
 }
@@ -834,6 +887,49 @@ inf_session_to_xml_sync_impl(InfSession* session,
   );
 }
 
+static gpointer
+inf_session_sync_stream_new_impl(InfSession* session,
+                                 InfXmlConnection* connection,
+                                 guint* n_messages)
+{
+  xmlNodePtr container;
+  xmlNodePtr child;
+
+  /* There are usually only few users, so produce their messages right
+   * away. */
+  container = xmlNewNode(NULL, (const xmlChar*)"sync-container");
+  inf_session_to_xml_sync_impl(session, container);
+
+  *n_messages = 0;
+  for(child = container->children; child != NULL; child = child->next)
+    ++ *n_messages;
+
+  return container;
+}
+
+static xmlNodePtr
+inf_session_sync_stream_next_impl(InfSession* session,
+                                  gpointer stream)
+{
+  xmlNodePtr container;
+  xmlNodePtr xml;
+
+  container = (xmlNodePtr)stream;
+  xml = container->children;
+
+  if(xml != NULL)
+    xmlUnlinkNode(xml);
+
+  return xml;
+}
+
+static void
+inf_session_sync_stream_free_impl(InfSession* session,
+                                  gpointer stream)
+{
+  xmlFreeNode((xmlNodePtr)stream);
+}
+
 static gboolean
 inf_session_process_xml_sync_impl(InfSession* session,
                                   InfXmlConnection* connection,
@@ -1592,6 +1688,10 @@ inf_session_communication_object_received(InfCommunicationObject* comm_object,
       session_class = INF_SESSION_GET_CLASS(session);
       g_assert(session_class->process_xml_run != NULL);
 
+      /* The message is likely to change the session state, and it is
+       * forwarded to connections that are currently synchronizing. */
+      inf_session_invalidate_sync_cache(session);
+
       local_error = NULL;
       scope = session_class->process_xml_run(
         session,
@@ -1700,6 +1800,237 @@ inf_session_close_handler(InfSession* session)
   g_object_thaw_notify(G_OBJECT(session));
 }
 
+/* Returns the most derived class of session that does not override the
+ * virtual function at the given offset in InfSessionClass. */
+static GType
+inf_session_get_vfunc_owner(InfSession* session,
+                            gsize offset)
+{
+  GType type;
+  GType parent;
+  gpointer func;
+  gpointer parent_func;
+
+  type = G_OBJECT_TYPE(session);
+  func = G_STRUCT_MEMBER(gpointer, G_OBJECT_GET_CLASS(session), offset);
+
+  while(type != INF_TYPE_SESSION)
+  {
+    parent = g_type_parent(type);
+    parent_func = G_STRUCT_MEMBER(gpointer, g_type_class_peek(parent), offset);
+    if(parent_func != func)
+      break;
+
+    type = parent;
+  }
+
+  return type;
+}
+
+/* Streaming synchronization can only be used if the class that produces
+ * the synchronization messages via to_xml_sync also implements the sync
+ * stream functions, otherwise the stream would miss messages. */
+static gboolean
+inf_session_can_stream_sync(InfSession* session)
+{
+  InfSessionClass* session_class;
+  session_class = INF_SESSION_GET_CLASS(session);
+
+  if(session_class->sync_stream_new == NULL ||
+     session_class->sync_stream_next == NULL ||
+     session_class->sync_stream_free == NULL)
+  {
+    return FALSE;
+  }
+
+  return inf_session_get_vfunc_owner(
+    session,
+    G_STRUCT_OFFSET(InfSessionClass, to_xml_sync)
+  ) == inf_session_get_vfunc_owner(
+    session,
+    G_STRUCT_OFFSET(InfSessionClass, sync_stream_new)
+  );
+}
+
+static InfSessionSyncCache*
+inf_session_sync_cache_get(InfSession* session,
+                           InfXmlConnection* connection)
+{
+  InfSessionPrivate* priv;
+  InfSessionSyncCache* cache;
+  gboolean has_version;
+  guint major;
+  guint minor;
+
+  priv = INF_SESSION_PRIVATE(session);
+  cache = priv->sync_cache;
+
+  major = minor = 0;
+  has_version = inf_protocol_get_remote_version(connection, &major, &minor);
+
+  if(cache != NULL && cache->has_version == has_version &&
+     cache->major == major && cache->minor == minor)
+  {
+    return cache;
+  }
+
+  cache = g_slice_new(InfSessionSyncCache);
+  cache->session = session;
+  cache->streams = NULL;
+  cache->messages = g_ptr_array_new_with_free_func(
+    (GDestroyNotify)xmlFreeNode
+  );
+  cache->offset = 0;
+  cache->n_messages = 0;
+
+  cache->has_version = has_version;
+  cache->major = major;
+  cache->minor = minor;
+
+  cache->stream = INF_SESSION_GET_CLASS(session)->sync_stream_new(
+    session,
+    connection,
+    &cache->n_messages
+  );
+
+  priv->sync_cache = cache;
+  return cache;
+}
+
+/* Returns the index of the next message for the slowest stream of cache,
+ * or the index after the last produced message if there is no stream. */
+static guint
+inf_session_sync_cache_get_min_index(InfSessionSyncCache* cache)
+{
+  InfSessionSyncStream* stream;
+  GSList* item;
+  guint index;
+
+  index = cache->offset + cache->messages->len;
+  for(item = cache->streams; item != NULL; item = item->next)
+  {
+    stream = (InfSessionSyncStream*)item->data;
+    if(stream->index < index)
+      index = stream->index;
+  }
+
+  return index;
+}
+
+/* Frees the messages that all streams of cache have taken. */
+static void
+inf_session_sync_cache_trim(InfSessionSyncCache* cache)
+{
+  InfSessionPrivate* priv;
+  guint index;
+
+  index = inf_session_sync_cache_get_min_index(cache);
+  if(index > cache->offset)
+  {
+    /* New connections would need the messages from the beginning */
+    priv = INF_SESSION_PRIVATE(cache->session);
+    if(priv->sync_cache == cache)
+      priv->sync_cache = NULL;
+
+    g_ptr_array_remove_range(cache->messages, 0, index - cache->offset);
+    cache->offset = index;
+  }
+}
+
+static void
+inf_session_sync_cache_remove_stream(InfSessionSyncCache* cache,
+                                     InfSessionSyncStream* stream)
+{
+  InfSessionPrivate* priv;
+
+  cache->streams = g_slist_remove(cache->streams, stream);
+
+  if(cache->streams == NULL)
+  {
+    priv = INF_SESSION_PRIVATE(cache->session);
+    if(priv->sync_cache == cache)
+      priv->sync_cache = NULL;
+
+    if(cache->stream != NULL)
+    {
+      INF_SESSION_GET_CLASS(cache->session)->sync_stream_free(
+        cache->session,
+        cache->stream
+      );
+    }
+
+    g_ptr_array_free(cache->messages, TRUE);
+    g_slice_free(InfSessionSyncCache, cache);
+  }
+  else
+  {
+    inf_session_sync_cache_trim(cache);
+  }
+}
+
+static xmlNodePtr
+inf_session_sync_stream_func(gpointer user_data)
+{
+  InfSessionSyncStream* stream;
+  InfSessionSyncCache* cache;
+  xmlNodePtr xml;
+  guint index;
+
+  stream = (InfSessionSyncStream*)user_data;
+  cache = stream->cache;
+
+  if(stream->index == cache->offset + cache->messages->len)
+  {
+    if(cache->stream == NULL)
+      return NULL;
+
+    xml = INF_SESSION_GET_CLASS(stream->session)->sync_stream_next(
+      stream->session,
+      cache->stream
+    );
+
+    if(xml == NULL)
+    {
+      INF_SESSION_GET_CLASS(stream->session)->sync_stream_free(
+        stream->session,
+        cache->stream
+      );
+
+      cache->stream = NULL;
+      return NULL;
+    }
+
+    g_ptr_array_add(cache->messages, xml);
+  }
+
+  index = stream->index - cache->offset;
+  xml = g_ptr_array_index(cache->messages, index);
+  ++ stream->index;
+
+  /* If no other stream needs the message anymore, then hand it out
+   * directly instead of copying it. */
+  if(inf_session_sync_cache_get_min_index(cache) > index + cache->offset)
+  {
+    g_ptr_array_index(cache->messages, index) = NULL;
+    inf_session_sync_cache_trim(cache);
+    return xml;
+  }
+
+  return xmlCopyNode(xml, 1);
+}
+
+static void
+inf_session_sync_stream_free(gpointer user_data)
+{
+  InfSessionSyncStream* stream;
+  stream = (InfSessionSyncStream*)user_data;
+
+  inf_session_sync_cache_remove_stream(stream->cache, stream);
+
+  g_object_unref(stream->session);
+  g_slice_free(InfSessionSyncStream, stream);
+}
+
 static void
 inf_session_synchronization_begin_handler(InfSession* session,
                                           InfCommunicationGroup* group,
@@ -1708,6 +2039,8 @@ inf_session_synchronization_begin_handler(InfSession* session,
   InfSessionPrivate* priv;
   InfSessionClass* session_class;
   InfSessionSync* sync;
+  InfSessionSyncStream* stream;
+  guint n_messages;
   xmlNodePtr messages;
   xmlNodePtr next;
   xmlNodePtr xml;
@@ -1743,14 +2076,37 @@ inf_session_synchronization_begin_handler(InfSession* session,
   /* The group needs to contain that connection, of course. */
   g_assert(inf_communication_group_is_member(sync->group, connection));
 
-  /* Name is irrelevant because the node is only used to collect the child
-   * nodes via the to_xml_sync vfunc. */
-  messages = xmlNewNode(NULL, (const xmlChar*)"sync-container");
-  session_class->to_xml_sync(session, messages);
+  if(inf_session_can_stream_sync(session))
+  {
+    /* Only take a snapshot of the session now, and produce the actual
+     * messages when the connection is ready to send them. This way, the
+     * whole synchronization does not need to be kept in memory. */
+    stream = g_slice_new(InfSessionSyncStream);
+    stream->session = session;
+    stream->cache = inf_session_sync_cache_get(session, connection);
+    stream->index = stream->cache->offset;
+    stream->cache->streams = g_slist_prepend(stream->cache->streams, stream);
+    g_object_ref(session);
+
+    n_messages = stream->cache->n_messages;
+
+    messages = NULL;
+  }
+  else
+  {
+    /* Name is irrelevant because the node is only used to collect the child
+     * nodes via the to_xml_sync vfunc. */
+    messages = xmlNewNode(NULL, (const xmlChar*)"sync-container");
+    session_class->to_xml_sync(session, messages);
+
+    n_messages = 0;
+    for(xml = messages->children; xml != NULL; xml = xml->next)
+      ++ n_messages;
 
-  for(xml = messages->children; xml != NULL; xml = xml->next)
-    ++ sync->messages_total;
+    stream = NULL;
+  }
 
+  sync->messages_total += n_messages;
   sprintf(num_messages_buf, "%u", sync->messages_total - 2);
 
   xml = xmlNewNode(NULL, (const xmlChar*)"sync-begin");
@@ -1763,16 +2119,29 @@ inf_session_synchronization_begin_handler(InfSession* session,
 
   inf_communication_group_send_message(sync->group, connection, xml);
 
-  /* TODO: Add a function that can send multiple messages */
-  for(xml = messages->children; xml != NULL; xml = next)
+  if(stream != NULL)
   {
-    next = xml->next;
-    xmlUnlinkNode(xml);
+    inf_communication_group_send_stream(
+      sync->group,
+      connection,
+      inf_session_sync_stream_func,
+      stream,
+      inf_session_sync_stream_free
+    );
+  }
+  else
+  {
+    for(xml = messages->children; xml != NULL; xml = next)
+    {
+      next = xml->next;
+      xmlUnlinkNode(xml);
+
+      inf_communication_group_send_message(sync->group, connection, xml);
+    }
 
-    inf_communication_group_send_message(sync->group, connection, xml);
+    xmlFreeNode(messages);
   }
 
-  xmlFreeNode(messages);
   xml = xmlNewNode(NULL, (const xmlChar*)"sync-end");
   inf_communication_group_send_message(sync->group, connection, xml);
 }
@@ -1880,6 +2249,9 @@ inf_session_class_init(InfSessionClass* session_class)
   object_class->get_property = inf_session_get_property;
 
   session_class->to_xml_sync = inf_session_to_xml_sync_impl;
+  session_class->sync_stream_new = inf_session_sync_stream_new_impl;
+  session_class->sync_stream_next = inf_session_sync_stream_next_impl;
+  session_class->sync_stream_free = inf_session_sync_stream_free_impl;
   session_class->process_xml_sync = inf_session_process_xml_sync_impl;
   session_class->process_xml_run = inf_session_process_xml_run_impl;
 
@@ -2874,6 +3246,10 @@ inf_session_send_to_subscriptions(InfSession* session,
   priv = INF_SESSION_PRIVATE(session);
   g_return_if_fail(priv->subscription_group != NULL);
 
+  /* Connections that start synchronizing from now on will not receive
+   * this message, so their snapshot needs to include its effect. */
+  inf_session_invalidate_sync_cache(session);
+
   inf_communication_group_send_group_message(priv->subscription_group, xml);
 }
 
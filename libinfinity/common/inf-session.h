@@ -188,6 +188,21 @@ typedef enum _InfSessionSyncError {
  * #InfSession::synchronization-failed signal. If the session itself got
  * synchronized (and did not synchronize another session), then the default
  * handler changes status to %INF_SESSION_CLOSED.
+ * @sync_stream_new: Virtual function that takes a snapshot of the session
+ * for synchronization to @connection. It returns a stream from which
+ * @sync_stream_next produces the same messages as @to_xml_sync would, one
+ * by one, and sets @n_messages to the number of these messages. The
+ * messages may make use of protocol features that the remote side of
+ * @connection supports, see inf_protocol_get_remote_supports(). Subclasses
+ * overriding @to_xml_sync need to override the three stream functions as
+ * well, otherwise the session is synchronized via @to_xml_sync. The
+ * snapshot should be cheap, since the messages themselves are only
+ * produced when they are about to be sent.
+ * @sync_stream_next: Virtual function that returns the next message of
+ * a stream created by @sync_stream_new, or %NULL if there are no more
+ * messages.
+ * @sync_stream_free: Virtual function that frees a stream created by
+ * @sync_stream_new, which might not have produced all of its messages.
  *
  * This structure contains the virtual functions and default signal handlers
  * of #InfSession.
@@ -252,6 +267,17 @@ struct _InfSessionClass {
   void(*synchronization_failed)(InfSession* session,
                                 InfXmlConnection* connection,
                                 const GError* error);
+
+  /* Virtual table, continued */
+  gpointer(*sync_stream_new)(InfSession* session,
+                             InfXmlConnection* connection,
+                             guint* n_messages);
+
+  xmlNodePtr(*sync_stream_next)(InfSession* session,
+                                gpointer stream);
+
+  void(*sync_stream_free)(InfSession* session,
+                          gpointer stream);
 };
 
 /**
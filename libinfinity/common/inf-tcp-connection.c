@@ -110,6 +110,10 @@ struct _InfTcpConnectionPrivate {
   gsize front_pos;
   gsize back_pos;
   gsize alloc;
+
+  /* Receive buffer, grows with the amount of data available per wakeup */
+  guint8* recv_buf;
+  gsize recv_alloc;
 };
 
 enum {
@@ -140,6 +144,13 @@ enum {
 
 #define INF_TCP_CONNECTION_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_TYPE_TCP_CONNECTION, InfTcpConnectionPrivate))
 
+/* Initial and maximum size of the receive buffer. The buffer is doubled
+ * whenever a single wakeup fills it completely, and halved again when a
+ * wakeup uses less than a quarter of it, so that idle connections do not
+ * keep a large buffer allocated. */
+#define INF_TCP_CONNECTION_RECV_MIN 2048
+#define INF_TCP_CONNECTION_RECV_MAX 65536
+
 static guint tcp_connection_signals[LAST_SIGNAL];
 
 INF_DEFINE_ENUM_TYPE(InfTcpConnectionStatus, inf_tcp_connection_status, inf_tcp_connection_status_values)
@@ -638,7 +649,8 @@ static void
 inf_tcp_connection_io_incoming(InfTcpConnection* connection)
 {
   InfTcpConnectionPrivate* priv;
-  gchar buf[2048];
+  gsize filled;
+  gsize total;
   int errcode;
   ssize_t result;
 
@@ -646,11 +658,68 @@ inf_tcp_connection_io_incoming(InfTcpConnection* connection)
 
   g_assert(priv->status == INF_TCP_CONNECTION_CONNECTED);
 
+  filled = 0;
+  total = 0;
+
+  /* Read until the kernel has no more data for us, and only emit the
+   * received signal when the buffer is full or all available data has been
+   * read, instead of once per recv() call. */
   do
   {
-    result = recv(priv->socket, buf, 2048, INF_NATIVE_SOCKET_SENDRECV_FLAGS);
+    result = recv(
+      priv->socket,
+      priv->recv_buf + filled,
+      priv->recv_alloc - filled,
+      INF_NATIVE_SOCKET_SENDRECV_FLAGS
+    );
+
     errcode = INF_NATIVE_SOCKET_LAST_ERROR;
 
+    if(result > 0)
+    {
+      filled += result;
+      total += result;
+
+      if(filled == priv->recv_alloc)
+      {
+        if(priv->recv_alloc < INF_TCP_CONNECTION_RECV_MAX)
+        {
+          priv->recv_alloc *= 2;
+          priv->recv_buf = g_realloc(priv->recv_buf, priv->recv_alloc);
+        }
+        else
+        {
+          g_signal_emit(
+            G_OBJECT(connection),
+            tcp_connection_signals[RECEIVED],
+            0,
+            priv->recv_buf,
+            (guint)filled
+          );
+
+          filled = 0;
+        }
+      }
+    }
+  } while( ((result > 0) ||
+            (result < 0 && errcode == INF_NATIVE_SOCKET_EINTR)) &&
+           (priv->status != INF_TCP_CONNECTION_CLOSED));
+
+  /* Deliver what we have read so far before reporting an error or the
+   * connection closure, to keep the order of events. */
+  if(filled > 0 && priv->status != INF_TCP_CONNECTION_CLOSED)
+  {
+    g_signal_emit(
+      G_OBJECT(connection),
+      tcp_connection_signals[RECEIVED],
+      0,
+      priv->recv_buf,
+      (guint)filled
+    );
+  }
+
+  if(priv->status != INF_TCP_CONNECTION_CLOSED)
+  {
     if(result < 0 &&
        errcode != INF_NATIVE_SOCKET_EINTR &&
        errcode != INF_NATIVE_SOCKET_EAGAIN)
@@ -661,19 +730,15 @@ inf_tcp_connection_io_incoming(InfTcpConnection* connection)
     {
       inf_tcp_connection_close(connection);
     }
-    else if(result > 0)
-    {
-      g_signal_emit(
-        G_OBJECT(connection),
-        tcp_connection_signals[RECEIVED],
-        0,
-        buf,
-        (guint)result
-      );
-    }
-  } while( ((result > 0) ||
-            (result < 0 && errcode == INF_NATIVE_SOCKET_EINTR)) &&
-           (priv->status != INF_TCP_CONNECTION_CLOSED));
+  }
+
+  /* Shrink the buffer again if the connection became less busy */
+  if(priv->recv_alloc > INF_TCP_CONNECTION_RECV_MIN &&
+     total < priv->recv_alloc / 4)
+  {
+    priv->recv_alloc /= 2;
+    priv->recv_buf = g_realloc(priv->recv_buf, priv->recv_alloc);
+  }
 }
 
 static void
@@ -914,6 +979,9 @@ inf_tcp_connection_init(InfTcpConnection* connection)
   priv->front_pos = 0;
   priv->back_pos = 0;
   priv->alloc = 1024;
+
+  priv->recv_buf = g_malloc(INF_TCP_CONNECTION_RECV_MIN);
+  priv->recv_alloc = INF_TCP_CONNECTION_RECV_MIN;
 }
 
 static void
@@ -955,6 +1023,7 @@ inf_tcp_connection_finalize(GObject* object)
     closesocket(priv->socket);
 
   g_free(priv->queue);
+  g_free(priv->recv_buf);
 
   G_OBJECT_CLASS(inf_tcp_connection_parent_class)->finalize(object);
 }
@@ -294,6 +294,49 @@ void inf_xml_connection_send(InfXmlConnection* connection,
   iface->send(connection, xml);
 }
 
+/**
+ * inf_xml_connection_send_serialized:
+ * @connection: A #InfXmlConnection.
+ * @xml: (transfer none): A XML message to send.
+ * @serialized: The serialized form of @xml, as returned by
+ * inf_xml_util_node_to_bytes().
+ *
+ * Sends the given XML message to the remote host, like
+ * inf_xml_connection_send(). If @connection supports it, @serialized is
+ * transmitted as-is instead of serializing @xml again. This allows a
+ * message that is sent to many connections to be serialized only once.
+ *
+ * Unlike inf_xml_connection_send(), this function does not take ownership
+ * of @xml, so that the same message can be passed to several connections.
+ * Instead, @connection keeps a reference on @serialized until the
+ * #InfXmlConnection::sent signal has been emitted for @xml. This means @xml
+ * must stay alive as long as @serialized does, for example by freeing it
+ * in the #GDestroyNotify of @serialized. Neither @xml nor @serialized must
+ * be modified after this call.
+ **/
+void inf_xml_connection_send_serialized(InfXmlConnection* connection,
+                                        xmlNodePtr xml,
+                                        GBytes* serialized)
+{
+  InfXmlConnectionInterface* iface;
+
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+  g_return_if_fail(xml != NULL);
+  g_return_if_fail(serialized != NULL);
+
+  iface = INF_XML_CONNECTION_GET_IFACE(connection);
+
+  if(iface->send_serialized != NULL)
+  {
+    iface->send_serialized(connection, xml, serialized);
+  }
+  else
+  {
+    g_return_if_fail(iface->send != NULL);
+    iface->send(connection, xmlCopyNode(xml, 1));
+  }
+}
+
 /**
  * inf_xml_connection_sent:
  * @connection: A #InfXmlConnection.
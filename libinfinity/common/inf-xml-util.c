@@ -28,12 +28,20 @@
  * numbers. These function provide some convenience to set and retrieve them.
  * They are mostly used in libinfinity itself but can also be useful when
  * implementing new session types so they are public API.
+ *
+ * inf_xml_util_node_to_compact() and inf_xml_util_node_from_compact()
+ * convert the most frequent messages of a text session, such as insertions,
+ * deletions, undo and redo requests, caret movements and no-ops, into a
+ * compact binary form and back. #InfXmppConnection uses this form on the
+ * wire if both sides support it, to save parsing and serialization time.
  **/
 
 #include <libinfinity/common/inf-xml-util.h>
 #include <libinfinity/common/inf-error.h>
 #include <libinfinity/inf-i18n.h>
 
+#include <libxml/xmlsave.h>
+
 #include <string.h>
 #include <stdlib.h>
 #include <math.h> /* HUGE_VAL */
@@ -290,6 +298,41 @@ inf_xml_util_valid_xml_char(gunichar codepoint)
  */
 #define inf_utf8_next_char(p) ((p) + g_utf8_skip[*(const guchar *)(p)])
 
+/* Names of elements and attributes that can appear in compact XML. The
+ * token of a name is its index in this array plus one. The order must not
+ * change, since the tokens are transmitted over the network. */
+static const gchar* const inf_xml_util_compact_names[] = {
+  "group",
+  "name",
+  "publisher",
+  "request",
+  "user",
+  "time",
+  "num",
+  "insert-caret",
+  "delete-caret",
+  "undo-caret",
+  "redo-caret",
+  "move",
+  "no-op",
+  "pos",
+  "len",
+  "caret",
+  "selection",
+  "uchar",
+  "codepoint"
+};
+
+#define INF_XML_UTIL_COMPACT_N_NAMES \
+  (sizeof(inf_xml_util_compact_names) / sizeof(inf_xml_util_compact_names[0]))
+
+/* Token which introduces a text node instead of an element */
+#define INF_XML_UTIL_COMPACT_TEXT 0x80
+
+/* Maximum nesting depth of compact XML. The hot messages do not nest deeper
+ * than <group><request><insert-caret><uchar/>. */
+#define INF_XML_UTIL_COMPACT_MAX_DEPTH 4
+
 /**
  * inf_xml_util_add_child_text:
  * @xml: A #xmlNodePtr.
@@ -956,4 +999,430 @@ inf_xml_util_new_error_from_node(xmlNodePtr xml)
   return result;
 }
 
+/**
+ * inf_xml_util_node_to_bytes:
+ * @xml: The XML node to serialize.
+ *
+ * Serializes @xml, including all its children, into a byte buffer, in the
+ * form in which it is transmitted over the network. The node does not need
+ * to be part of a document. The returned buffer is immutable and can be
+ * passed to inf_xml_connection_send_serialized() for any number of
+ * connections.
+ *
+ * Returns: (transfer full): A new #GBytes holding the serialized node. Free
+ * with g_bytes_unref() when no longer needed.
+ */
+GBytes*
+inf_xml_util_node_to_bytes(xmlNodePtr xml)
+{
+  xmlBufferPtr buffer;
+  xmlSaveCtxtPtr ctxt;
+
+  g_return_val_if_fail(xml != NULL, NULL);
+
+  buffer = xmlBufferCreate();
+  ctxt = xmlSaveToBuffer(buffer, NULL, XML_SAVE_NO_DECL);
+  xmlSaveTree(ctxt, xml);
+  xmlSaveClose(ctxt);
+
+  return g_bytes_new_with_free_func(
+    xmlBufferContent(buffer),
+    xmlBufferLength(buffer),
+    (GDestroyNotify)xmlBufferFree,
+    buffer
+  );
+}
+
+static guint8
+inf_xml_util_compact_lookup(const xmlChar* name)
+{
+  guint8 i;
+
+  for(i = 0; i < INF_XML_UTIL_COMPACT_N_NAMES; ++i)
+    if(strcmp((const char*)name, inf_xml_util_compact_names[i]) == 0)
+      return i + 1;
+
+  return 0;
+}
+
+static void
+inf_xml_util_compact_write_size(GByteArray* array,
+                                gsize size)
+{
+  guint8 byte;
+
+  while(size >= 0x80)
+  {
+    byte = (size & 0x7f) | 0x80;
+    g_byte_array_append(array, &byte, 1);
+    size >>= 7;
+  }
+
+  byte = size;
+  g_byte_array_append(array, &byte, 1);
+}
+
+static void
+inf_xml_util_compact_write_string(GByteArray* array,
+                                  const xmlChar* str)
+{
+  gsize len;
+
+  len = strlen((const char*)str);
+  inf_xml_util_compact_write_size(array, len);
+  g_byte_array_append(array, str, len);
+}
+
+static gboolean
+inf_xml_util_compact_write_node(GByteArray* array,
+                                xmlNodePtr xml,
+                                guint depth)
+{
+  xmlAttrPtr attr;
+  xmlNodePtr child;
+  guint8 token;
+  guint n_attrs;
+  guint n_children;
+
+  if(xml->type == XML_TEXT_NODE)
+  {
+    token = INF_XML_UTIL_COMPACT_TEXT;
+    g_byte_array_append(array, &token, 1);
+    inf_xml_util_compact_write_string(array, xml->content);
+    return TRUE;
+  }
+
+  if(xml->type != XML_ELEMENT_NODE || xml->ns != NULL ||
+     depth >= INF_XML_UTIL_COMPACT_MAX_DEPTH)
+  {
+    return FALSE;
+  }
+
+  token = inf_xml_util_compact_lookup(xml->name);
+  if(token == 0) return FALSE;
+  g_byte_array_append(array, &token, 1);
+
+  n_attrs = 0;
+  for(attr = xml->properties; attr != NULL; attr = attr->next)
+    ++n_attrs;
+  inf_xml_util_compact_write_size(array, n_attrs);
+
+  for(attr = xml->properties; attr != NULL; attr = attr->next)
+  {
+    /* Only plain attributes with a single text value */
+    if(attr->ns != NULL || attr->children == NULL ||
+       attr->children->type != XML_TEXT_NODE || attr->children->next != NULL)
+    {
+      return FALSE;
+    }
+
+    token = inf_xml_util_compact_lookup(attr->name);
+    if(token == 0) return FALSE;
+
+    g_byte_array_append(array, &token, 1);
+    inf_xml_util_compact_write_string(array, attr->children->content);
+  }
+
+  n_children = 0;
+  for(child = xml->children; child != NULL; child = child->next)
+    ++n_children;
+  inf_xml_util_compact_write_size(array, n_children);
+
+  for(child = xml->children; child != NULL; child = child->next)
+    if(!inf_xml_util_compact_write_node(array, child, depth + 1))
+      return FALSE;
+
+  return TRUE;
+}
+
+static void
+inf_xml_util_compact_set_truncated_error(GError** error)
+{
+  g_set_error_literal(
+    error,
+    inf_request_error_quark(),
+    INF_REQUEST_ERROR_FAILED,
+    _("Compact XML data is truncated")
+  );
+}
+
+static gboolean
+inf_xml_util_compact_read_size(const guint8** data,
+                               const guint8* end,
+                               gsize* size,
+                               GError** error)
+{
+  guint shift;
+
+  *size = 0;
+  for(shift = 0; shift < 32; shift += 7)
+  {
+    if(*data == end)
+    {
+      inf_xml_util_compact_set_truncated_error(error);
+      return FALSE;
+    }
+
+    *size |= (gsize)(**data & 0x7f) << shift;
+    if((*(*data)++ & 0x80) == 0)
+      return TRUE;
+  }
+
+  g_set_error_literal(
+    error,
+    inf_request_error_quark(),
+    INF_REQUEST_ERROR_INVALID_NUMBER,
+    _("Length in compact XML data is too large")
+  );
+
+  return FALSE;
+}
+
+/* Allows only what could also have been transmitted as XML text */
+static gboolean
+inf_xml_util_compact_valid_text(const gchar* text,
+                                gsize len)
+{
+  const gchar* p;
+
+  if(!g_utf8_validate(text, len, NULL))
+    return FALSE;
+
+  for(p = text; p != text + len; p = inf_utf8_next_char(p))
+    if(!inf_xml_util_valid_xml_char(g_utf8_get_char(p)))
+      return FALSE;
+
+  return TRUE;
+}
+
+static const xmlChar*
+inf_xml_util_compact_read_string(const guint8** data,
+                                 const guint8* end,
+                                 gsize* len,
+                                 GError** error)
+{
+  const guint8* str;
+
+  if(!inf_xml_util_compact_read_size(data, end, len, error))
+    return NULL;
+
+  if((gsize)(end - *data) < *len)
+  {
+    inf_xml_util_compact_set_truncated_error(error);
+    return NULL;
+  }
+
+  str = *data;
+  *data += *len;
+
+  if(!inf_xml_util_compact_valid_text((const gchar*)str, *len))
+  {
+    g_set_error_literal(
+      error,
+      inf_request_error_quark(),
+      INF_REQUEST_ERROR_FAILED,
+      _("Compact XML data contains invalid text")
+    );
+
+    return NULL;
+  }
+
+  return str;
+}
+
+static xmlNodePtr
+inf_xml_util_compact_read_node(const guint8** data,
+                               const guint8* end,
+                               guint depth,
+                               GError** error)
+{
+  xmlNodePtr xml;
+  xmlNodePtr child;
+  const xmlChar* str;
+  xmlChar* value;
+  gsize len;
+  gsize n_attrs;
+  gsize n_children;
+  guint8 token;
+
+  if(*data == end)
+  {
+    inf_xml_util_compact_set_truncated_error(error);
+    return NULL;
+  }
+
+  token = *(*data)++;
+  if(token == INF_XML_UTIL_COMPACT_TEXT)
+  {
+    str = inf_xml_util_compact_read_string(data, end, &len, error);
+    if(str == NULL) return NULL;
+
+    return xmlNewTextLen(str, len);
+  }
+
+  if(token == 0 || token > INF_XML_UTIL_COMPACT_N_NAMES ||
+     depth >= INF_XML_UTIL_COMPACT_MAX_DEPTH)
+  {
+    g_set_error_literal(
+      error,
+      inf_request_error_quark(),
+      INF_REQUEST_ERROR_FAILED,
+      _("Compact XML data contains an unexpected element")
+    );
+
+    return NULL;
+  }
+
+  xml = xmlNewNode(
+    NULL,
+    (const xmlChar*)inf_xml_util_compact_names[token - 1]
+  );
+
+  if(!inf_xml_util_compact_read_size(data, end, &n_attrs, error))
+  {
+    xmlFreeNode(xml);
+    return NULL;
+  }
+
+  for(; n_attrs > 0; --n_attrs)
+  {
+    if(*data == end)
+    {
+      inf_xml_util_compact_set_truncated_error(error);
+      xmlFreeNode(xml);
+      return NULL;
+    }
+
+    token = *(*data)++;
+    if(token == 0 || token > INF_XML_UTIL_COMPACT_N_NAMES)
+    {
+      g_set_error_literal(
+        error,
+        inf_request_error_quark(),
+        INF_REQUEST_ERROR_INVALID_ATTRIBUTE,
+        _("Compact XML data contains an unexpected attribute")
+      );
+
+      xmlFreeNode(xml);
+      return NULL;
+    }
+
+    str = inf_xml_util_compact_read_string(data, end, &len, error);
+    if(str == NULL)
+    {
+      xmlFreeNode(xml);
+      return NULL;
+    }
+
+    value = xmlStrndup(str, len);
+    xmlNewProp(
+      xml,
+      (const xmlChar*)inf_xml_util_compact_names[token - 1],
+      value
+    );
+    xmlFree(value);
+  }
+
+  if(!inf_xml_util_compact_read_size(data, end, &n_children, error))
+  {
+    xmlFreeNode(xml);
+    return NULL;
+  }
+
+  for(; n_children > 0; --n_children)
+  {
+    child = inf_xml_util_compact_read_node(data, end, depth + 1, error);
+    if(child == NULL)
+    {
+      xmlFreeNode(xml);
+      return NULL;
+    }
+
+    /* Adjacent text nodes are merged by xmlAddChild(), in which case
+     * child is freed. */
+    xmlAddChild(xml, child);
+  }
+
+  return xml;
+}
+
+/**
+ * inf_xml_util_node_to_compact:
+ * @xml: The XML node to encode.
+ * @array: A #GByteArray to which to append the compact form of @xml.
+ *
+ * Appends a compact binary form of @xml to @array, which can be decoded
+ * again with inf_xml_util_node_from_compact(). Only elements and attributes
+ * that occur in the frequent messages of text sessions, such as
+ * &lt;request&gt;, &lt;insert-caret&gt; or &lt;undo-caret&gt; within a
+ * &lt;group&gt;, can be encoded this way. If @xml contains anything else,
+ * the function returns %FALSE and leaves @array unmodified. Such messages
+ * need to be transmitted as XML text.
+ *
+ * Returns: %TRUE if @xml was encoded, or %FALSE otherwise.
+ */
+gboolean
+inf_xml_util_node_to_compact(xmlNodePtr xml,
+                             GByteArray* array)
+{
+  guint len;
+
+  g_return_val_if_fail(xml != NULL, FALSE);
+  g_return_val_if_fail(array != NULL, FALSE);
+
+  len = array->len;
+  if(!inf_xml_util_compact_write_node(array, xml, 0))
+  {
+    g_byte_array_set_size(array, len);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/**
+ * inf_xml_util_node_from_compact:
+ * @data: (array length=len): Data produced by inf_xml_util_node_to_compact().
+ * @len: The number of bytes of @data.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Decodes the compact binary form of an XML node, as produced by
+ * inf_xml_util_node_to_compact(). @data must contain exactly one node. The
+ * text in @data is validated in the same way an XML parser would, so the
+ * result can be processed like a node received as XML text.
+ *
+ * Returns: (transfer full): A new XML node, or %NULL on error. Free with
+ * xmlFreeNode() when no longer needed.
+ */
+xmlNodePtr
+inf_xml_util_node_from_compact(const guint8* data,
+                               gsize len,
+                               GError** error)
+{
+  const guint8* end;
+  xmlNodePtr xml;
+
+  g_return_val_if_fail(data != NULL || len == 0, NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  end = data + len;
+  xml = inf_xml_util_compact_read_node(&data, end, 0, error);
+  if(xml == NULL) return NULL;
+
+  if(xml->type != XML_ELEMENT_NODE || data != end)
+  {
+    g_set_error_literal(
+      error,
+      inf_request_error_quark(),
+      INF_REQUEST_ERROR_FAILED,
+      _("Compact XML data does not contain a single element")
+    );
+
+    xmlFreeNode(xml);
+    return NULL;
+  }
+
+  return xml;
+}
+
 /* vim:set et sw=2 ts=2: */
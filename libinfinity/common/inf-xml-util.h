@@ -143,6 +143,18 @@ inf_xml_util_new_node_from_error(GError* error,
 GError*
 inf_xml_util_new_error_from_node(xmlNodePtr xml);
 
+GBytes*
+inf_xml_util_node_to_bytes(xmlNodePtr xml);
+
+gboolean
+inf_xml_util_node_to_compact(xmlNodePtr xml,
+                             GByteArray* array);
+
+xmlNodePtr
+inf_xml_util_node_from_compact(const guint8* data,
+                               gsize len,
+                               GError** error);
+
 G_END_DECLS
 
 #endif /* __INF_XML_UTIL_H__ */
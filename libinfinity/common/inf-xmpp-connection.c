@@ -33,6 +33,31 @@
  * not need to adhere to the XMPP standard. It is in the responsibility of the
  * user of this class to send only XML message that the remote counterpart can
  * understand.
+ *
+ * If both sides of the connection have the #InfXmppConnection:binary-frames
+ * property set, then frequent messages such as text insertions and
+ * deletions are transmitted in a compact binary form, see
+ * inf_xml_util_node_to_compact(), instead of as XML text. This is
+ * transparent to the user of this class: sent and received messages are
+ * XML nodes either way. Sites which do not support binary frames keep
+ * exchanging XML text only.
+ *
+ * If the #InfXmppConnection:compression-level property is non-zero on both
+ * sides, then the stream is compressed with zlib as specified in XEP-0138.
+ * Compression is negotiated after authentication, in the order that
+ * XEP-0170 recommends, so that credentials are never sent within a
+ * compressed stream and unauthenticated sites cannot make the server set up
+ * compression. Writes smaller than
+ * #InfXmppConnection:compression-threshold are passed through the
+ * compressor without actually being compressed, so that small messages do
+ * not pay for compression in latency and CPU time.
+ *
+ * If #InfXmppConnection:tls-handshake-async is set, the TLS handshake is
+ * performed in a worker thread with #InfAsyncOperation, so that the key
+ * exchange of many connections being established at the same time does not
+ * block the thread the connection lives in. It runs in the
+ * %INF_ASYNC_OPERATION_POOL_HANDSHAKE pool, so that it does not wait for
+ * file I/O.
  **/
 
 #include <libinfinity/common/inf-xmpp-connection.h>
@@ -40,12 +65,15 @@
 #include <libinfinity/common/inf-xml-util.h>
 #include <libinfinity/common/inf-ip-address.h>
 #include <libinfinity/common/inf-error.h>
+#include <libinfinity/common/inf-async-operation.h>
 
 #include <libinfinity/inf-i18n.h>
 #include <libinfinity/inf-signals.h>
 #include <libinfinity/inf-define-enum.h>
 
 #include <gnutls/x509.h>
+#include <libxml/xmlsave.h>
+#include <zlib.h>
 
 #include <errno.h>
 #include <string.h>
@@ -118,6 +146,8 @@ typedef enum _InfXmppConnectionStatus {
   INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES,
   /* <starttls> request has been sent (client only) */
   INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED,
+  /* <compress> request has been sent after authentication (client only) */
+  INF_XMPP_CONNECTION_COMPRESSION_REQUESTED,
   /* TLS handshake is being performed */
   INF_XMPP_CONNECTION_HANDSHAKING,
   /* SASL authentication is in progress */
@@ -152,6 +182,31 @@ struct _InfXmppConnectionMessage {
   gpointer user_data;
 };
 
+/* One step of a TLS handshake running in a worker thread, see
+ * inf_xmpp_connection_tls_handshake_start(). While the step runs, the
+ * GnuTLS session belongs to the worker thread and reads from input and
+ * writes to output. */
+typedef struct _InfXmppConnectionHandshake InfXmppConnectionHandshake;
+struct _InfXmppConnectionHandshake {
+  InfXmppConnection* xmpp; /* only accessed in the main thread */
+  gnutls_session_t session;
+  InfCertificateCredentials* creds;
+  GBytes* ticket_key;
+
+  GByteArray* input;
+  guint input_pos;
+  GByteArray* output;
+  int ret;
+};
+
+/* A message sent with inf_xml_connection_send_serialized(). The bytes keep
+ * the XML alive until the message has been sent. */
+typedef struct _InfXmppConnectionSerialized InfXmppConnectionSerialized;
+struct _InfXmppConnectionSerialized {
+  xmlNodePtr xml;
+  GBytes* bytes;
+};
+
 typedef struct _InfXmppConnectionPrivate InfXmppConnectionPrivate;
 struct _InfXmppConnectionPrivate {
   InfTcpConnection* tcp;
@@ -171,14 +226,45 @@ struct _InfXmppConnectionPrivate {
   guint position;
 
   /* Message queue */
-  xmlDocPtr doc;
   xmlBufferPtr buf;
   InfXmppConnectionMessage* messages;
   InfXmppConnectionMessage* last_message;
 
+  /* Messages held back to be written together with the next ones */
+  guint flush_latency;
+  GByteArray* cork;
+  InfXmppConnectionMessage* corked_messages;
+  InfXmppConnectionMessage* last_corked_message;
+  InfIo* cork_io;
+  InfIoTimeout* cork_timeout;
+  guint flushing;
+
+  /* Binary frames, see inf_xmpp_connection_parse_received() */
+  gboolean binary_frames;
+  gboolean remote_binary_frames;
+  GByteArray* frame_out;
+  GByteArray* frame_in;
+  gboolean frame_pending;
+  gboolean frame_sized;
+  gsize frame_size;
+  guint frame_shift;
+
+  /* Stream compression (XEP-0138) */
+  guint compression_level;
+  guint compression_threshold;
+  z_stream* deflate;
+  z_stream* inflate;
+  gint deflate_level;
+  GByteArray* deflate_buf;
+  guint8* inflate_buf;
+  /* Whether the remote site announced to request compression after
+   * authentication (server only) */
+  gboolean remote_compression;
+
   /* XML parsing */
   guint parsing; /* Whether we are currently in an XML parser or GnuTLS callback */
   xmlParserCtxtPtr parser;
+  xmlDocPtr doc; /* Owner of received nodes, shares the parser's dictionary */
   xmlNodePtr root;
   xmlNodePtr cur;
 
@@ -189,6 +275,23 @@ struct _InfXmppConnectionPrivate {
   InfCertificateChain* peer_cert;
   const gchar* pull_data;
   gsize pull_len;
+  gchar* recv_buf;
+  gsize recv_alloc;
+
+  /* TLS session resumption. The ticket key is used by the server to issue
+   * session tickets, the session data by the client to resume a previous
+   * session with the same server. */
+  GBytes* tls_ticket_key;
+  GBytes* tls_session_data;
+  gboolean tls_established;
+  gboolean tls_resumed;
+
+  /* Asynchronous TLS handshake */
+  gboolean tls_handshake_async;
+  InfAsyncOperation* tls_handshake_op;
+  GByteArray* tls_handshake_pending;
+  gboolean tls_handshake_finished;
+  int tls_handshake_ret;
 
   /* SASL */
   InfSaslContext* sasl_context;
@@ -210,11 +313,22 @@ enum {
   PROP_SECURITY_POLICY,
 
   PROP_TLS_ENABLED,
+  PROP_TLS_RESUMED,
+  PROP_TLS_SESSION_DATA,
+  PROP_TLS_SESSION_TICKET_KEY,
+  PROP_TLS_HANDSHAKE_ASYNC,
   PROP_CREDENTIALS,
 
   PROP_SASL_CONTEXT,
   PROP_SASL_MECHANISMS,
 
+  PROP_FLUSH_LATENCY,
+  PROP_BINARY_FRAMES,
+
+  PROP_COMPRESSION_LEVEL,
+  PROP_COMPRESSION_THRESHOLD,
+  PROP_COMPRESSION_ENABLED,
+
   /* From InfXmlConnection */
   PROP_STATUS,
   PROP_NETWORK,
@@ -224,6 +338,37 @@ enum {
   PROP_REMOTE_CERTIFICATE
 };
 
+/* Initial and maximum size of the buffer into which decrypted data is
+ * collected before it is handed to the XML parser. */
+#define INF_XMPP_CONNECTION_RECV_MIN 2048
+#define INF_XMPP_CONNECTION_RECV_MAX 65536
+
+/* Amount of held back data at which it is written without waiting for the
+ * flush latency to expire, matching the maximum size of a TLS record. */
+#define INF_XMPP_CONNECTION_CORK_MAX 16384
+
+/* A binary frame starts with a zero byte, followed by the length of the
+ * frame in at most five bytes. Larger messages are sent as XML text. */
+#define INF_XMPP_CONNECTION_FRAME_HEADER 6
+#define INF_XMPP_CONNECTION_FRAME_MAX (1 << 20)
+
+/* Added to <stream:stream> by sites that accept binary frames. Sites that
+ * do not know about binary frames ignore it. */
+#define INF_XMPP_CONNECTION_FRAMES_ATTRIBUTE " frames=\"binary\""
+
+/* Added to <stream:stream> by clients that request compression if the
+ * server offers it after authentication. The server only offers it to such
+ * clients, since it waits for the request before the stream is ready. */
+#define INF_XMPP_CONNECTION_COMPRESS_ATTRIBUTE " compress=\"zlib\""
+
+/* Namespaces of the XEP-0138 stream feature and protocol */
+#define INF_XMPP_CONNECTION_COMPRESS_FEATURE_NS \
+  "http://jabber.org/features/compress"
+#define INF_XMPP_CONNECTION_COMPRESS_NS "http://jabber.org/protocol/compress"
+
+/* Size of the buffer into which received compressed data is inflated */
+#define INF_XMPP_CONNECTION_INFLATE_CHUNK 16384
+
 #define INF_XMPP_CONNECTION_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_TYPE_XMPP_CONNECTION, InfXmppConnectionPrivate))
 
 static GQuark inf_xmpp_connection_stream_error_quark;
@@ -564,7 +709,28 @@ inf_xmpp_connection_push_message(InfXmppConnection* xmpp,
 
   priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
 
-  if(priv->position == 0)
+  if(priv->cork->len > 0)
+  {
+    /* The message is held back in the cork buffer. We only know its
+     * position once the buffer has been written, so queue it separately
+     * until then. */
+    message = g_slice_new(InfXmppConnectionMessage);
+
+    message->next = NULL;
+    message->position = 0;
+    message->sent = FALSE;
+    message->sent_func = sent_func;
+    message->free_func = free_func;
+    message->user_data = user_data;
+
+    if(priv->last_corked_message == NULL)
+      priv->corked_messages = message;
+    else
+      priv->last_corked_message->next = message;
+
+    priv->last_corked_message = message;
+  }
+  else if(priv->position == 0)
   {
     if(sent_func != NULL)
       sent_func(xmpp, user_data);
@@ -610,6 +776,233 @@ inf_xmpp_connection_pop_message(InfXmppConnection* connection)
   g_slice_free(InfXmppConnectionMessage, message);
 }
 
+static void
+inf_xmpp_connection_discard_cork(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  InfXmppConnectionMessage* message;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  if(priv->cork_timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->cork_io, priv->cork_timeout);
+    priv->cork_timeout = NULL;
+
+    g_object_unref(priv->cork_io);
+    priv->cork_io = NULL;
+  }
+
+  g_byte_array_set_size(priv->cork, 0);
+
+  while(priv->corked_messages != NULL)
+  {
+    message = priv->corked_messages;
+    priv->corked_messages = message->next;
+
+    if(message->free_func != NULL)
+      message->free_func(xmpp, message->user_data);
+
+    g_slice_free(InfXmppConnectionMessage, message);
+  }
+
+  priv->last_corked_message = NULL;
+}
+
+/*
+ * Stream compression
+ */
+
+/* Starts compressing outgoing and decompressing incoming data. Called after
+ * the server has sent, or the client has received, <compressed/>. */
+static gboolean
+inf_xmpp_connection_compression_start(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  g_assert(priv->deflate == NULL && priv->inflate == NULL);
+
+  priv->deflate = g_slice_new0(z_stream);
+  priv->inflate = g_slice_new0(z_stream);
+
+  if(deflateInit(priv->deflate, priv->compression_level) != Z_OK)
+  {
+    g_slice_free(z_stream, priv->deflate);
+    g_slice_free(z_stream, priv->inflate);
+    priv->deflate = NULL;
+    priv->inflate = NULL;
+    return FALSE;
+  }
+
+  if(inflateInit(priv->inflate) != Z_OK)
+  {
+    deflateEnd(priv->deflate);
+    g_slice_free(z_stream, priv->deflate);
+    g_slice_free(z_stream, priv->inflate);
+    priv->deflate = NULL;
+    priv->inflate = NULL;
+    return FALSE;
+  }
+
+  priv->deflate_level = priv->compression_level;
+  if(priv->deflate_buf == NULL)
+    priv->deflate_buf = g_byte_array_new();
+  if(priv->inflate_buf == NULL)
+    priv->inflate_buf = g_malloc(INF_XMPP_CONNECTION_INFLATE_CHUNK);
+
+  g_object_notify(G_OBJECT(xmpp), "compression-enabled");
+  return TRUE;
+}
+
+static void
+inf_xmpp_connection_compression_stop(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  if(priv->deflate != NULL)
+  {
+    deflateEnd(priv->deflate);
+    inflateEnd(priv->inflate);
+    g_slice_free(z_stream, priv->deflate);
+    g_slice_free(z_stream, priv->inflate);
+    priv->deflate = NULL;
+    priv->inflate = NULL;
+
+    g_object_notify(G_OBJECT(xmpp), "compression-enabled");
+  }
+
+  priv->remote_compression = FALSE;
+}
+
+/* Compresses len bytes at data into out, and flushes the compressor so that
+ * the remote site can decompress everything written so far. Writes below
+ * the compression threshold are stored without compressing them. */
+static void
+inf_xmpp_connection_compress(InfXmppConnection* xmpp,
+                             gconstpointer data,
+                             guint len,
+                             GByteArray* out)
+{
+  InfXmppConnectionPrivate* priv;
+  z_stream* stream;
+  gint level;
+  gsize offset;
+  guint chunk;
+  int ret;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  stream = priv->deflate;
+
+  g_byte_array_set_size(out, 0);
+
+  level = priv->compression_level;
+  if(len < priv->compression_threshold)
+    level = Z_NO_COMPRESSION;
+
+  if(level != priv->deflate_level)
+  {
+    /* Every write ends with a flush, so there is no pending input that
+     * would need to be compressed with the previous level. */
+    g_byte_array_set_size(out, 64);
+    stream->next_in = NULL;
+    stream->avail_in = 0;
+    stream->next_out = out->data;
+    stream->avail_out = out->len;
+
+    if(deflateParams(stream, level, Z_DEFAULT_STRATEGY) == Z_OK)
+      priv->deflate_level = level;
+    g_byte_array_set_size(out, out->len - stream->avail_out);
+  }
+
+  stream->next_in = (Bytef*)data;
+  stream->avail_in = len;
+  chunk = len / 2 + 64;
+
+  do
+  {
+    offset = out->len;
+    g_byte_array_set_size(out, offset + chunk);
+
+    stream->next_out = out->data + offset;
+    stream->avail_out = chunk;
+
+    ret = deflate(stream, Z_SYNC_FLUSH);
+    g_assert(ret == Z_OK || ret == Z_BUF_ERROR);
+
+    g_byte_array_set_size(out, out->len - stream->avail_out);
+  } while(stream->avail_out == 0);
+
+  g_assert(stream->avail_in == 0);
+}
+
+static void
+inf_xmpp_connection_tls_handshake_free(gpointer data)
+{
+  InfXmppConnectionHandshake* handshake;
+  handshake = (InfXmppConnectionHandshake*)data;
+
+  /* The session is still set if the handshake was cancelled */
+  if(handshake->session != NULL)
+    gnutls_deinit(handshake->session);
+
+  inf_certificate_credentials_unref(handshake->creds);
+  if(handshake->ticket_key != NULL)
+    g_bytes_unref(handshake->ticket_key);
+
+  g_byte_array_unref(handshake->input);
+  g_byte_array_unref(handshake->output);
+  g_slice_free(InfXmppConnectionHandshake, handshake);
+}
+
+/* Cancels a TLS handshake step running in a worker thread. The session
+ * is freed by the worker thread once it has finished. */
+static void
+inf_xmpp_connection_tls_handshake_cancel(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  if(priv->tls_handshake_op != NULL)
+  {
+    inf_async_operation_free(priv->tls_handshake_op);
+    priv->tls_handshake_op = NULL;
+    priv->session = NULL;
+  }
+
+  if(priv->tls_handshake_pending != NULL)
+  {
+    g_byte_array_unref(priv->tls_handshake_pending);
+    priv->tls_handshake_pending = NULL;
+  }
+
+  priv->tls_handshake_finished = FALSE;
+}
+
+static void
+inf_xmpp_connection_tls_store_session_data(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  gnutls_datum_t data;
+  int ret;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  g_assert(priv->session != NULL);
+
+  ret = gnutls_session_get_data2(priv->session, &data);
+  if(ret == GNUTLS_E_SUCCESS)
+  {
+    if(priv->tls_session_data != NULL)
+      g_bytes_unref(priv->tls_session_data);
+
+    priv->tls_session_data = g_bytes_new(data.data, data.size);
+    gnutls_free(data.data);
+
+    g_object_notify(G_OBJECT(xmpp), "tls-session-data");
+  }
+}
+
 /* Note that this function does not change the state of xmpp, so it might
  * rest in a state where it expects to actually have the resources available
  * that are cleared here. Be sure to adjust state after having called
@@ -655,10 +1048,22 @@ inf_xmpp_connection_clear(InfXmppConnection* xmpp)
   }
 #endif
 
+  inf_xmpp_connection_tls_handshake_cancel(xmpp);
+
   if(priv->session != NULL)
   {
+    /* Remember the session for resuming it with the next connection. This
+     * is done only now and not right after the handshake, since with
+     * TLS 1.3 the server sends the session ticket after the handshake. */
+    if(priv->site == INF_XMPP_CONNECTION_CLIENT &&
+       priv->tls_established == TRUE)
+    {
+      inf_xmpp_connection_tls_store_session_data(xmpp);
+    }
+
     gnutls_deinit(priv->session);
     priv->session = NULL;
+    priv->tls_established = FALSE;
 
     g_object_notify(G_OBJECT(xmpp), "tls-enabled");
   }
@@ -668,40 +1073,52 @@ inf_xmpp_connection_clear(InfXmppConnection* xmpp)
     xmlFreeParserCtxt(priv->parser);
     priv->parser = NULL;
 
+    /* The document keeps the dictionary alive that the names of the
+     * received nodes point into. */
     if(priv->root != NULL)
     {
       xmlFreeNode(priv->root);
       priv->root = NULL;
       priv->cur = NULL;
     }
+
+    xmlFreeDoc(priv->doc);
+    priv->doc = NULL;
   }
 
   while(priv->messages != NULL)
     inf_xmpp_connection_pop_message(xmpp);
 
+  inf_xmpp_connection_discard_cork(xmpp);
+
   if(priv->buf != NULL)
   {
-    g_assert(priv->doc != NULL);
-
     xmlBufferFree(priv->buf);
-    xmlFreeDoc(priv->doc);
-
     priv->buf = NULL;
-    priv->doc = NULL;
   }
 
+  priv->remote_binary_frames = FALSE;
+  priv->frame_pending = FALSE;
+
+  inf_xmpp_connection_compression_stop(xmpp);
+
   priv->pull_data = NULL;
   priv->pull_len = 0;
 
   g_object_thaw_notify(G_OBJECT(xmpp));
 }
 
+/* Required by inf_xmpp_connection_send_chars() */
+static void
+inf_xmpp_connection_flush(InfXmppConnection* xmpp);
+
 static void
 inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
                                gconstpointer data,
                                guint len)
 {
   InfXmppConnectionPrivate* priv;
+  GByteArray* compressed;
   ssize_t cur_bytes;
   GError* error;
 
@@ -710,9 +1127,32 @@ inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
   g_assert(priv->status != INF_XMPP_CONNECTION_HANDSHAKING &&
            priv->status != INF_XMPP_CONNECTION_CLOSED);
 
+  /* Write out held back data first, to keep the order of the stream */
+  if(priv->cork->len > 0)
+  {
+    inf_xmpp_connection_flush(xmpp);
+    if(priv->status == INF_XMPP_CONNECTION_CLOSED)
+      return;
+  }
+
   if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
     printf("\033[00;34m%.*s\033[00;00m\n", (int)len, (const char*)data);
 
+  /* Take the compression buffer, in case we are called again from within a
+   * callback while the compressed data is being written. */
+  compressed = NULL;
+  if(priv->deflate != NULL)
+  {
+    compressed = priv->deflate_buf;
+    priv->deflate_buf = NULL;
+    if(compressed == NULL)
+      compressed = g_byte_array_new();
+
+    inf_xmpp_connection_compress(xmpp, data, len, compressed);
+    data = compressed->data;
+    len = compressed->len;
+  }
+
   /* From here on we go into a GnuTLS callback. Set this flag to prevent
    * premature cleanup -- make sure that if the connection is being brought
    * down from a GnuTLS callback then we keep the GnuTLS context around
@@ -758,6 +1198,14 @@ inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
     inf_tcp_connection_send(priv->tcp, data, len);
   }
 
+  if(compressed != NULL)
+  {
+    if(priv->deflate_buf == NULL)
+      priv->deflate_buf = compressed;
+    else
+      g_byte_array_unref(compressed);
+  }
+
   g_assert(priv->parsing > 0);
   if(--priv->parsing == 0)
   {
@@ -774,29 +1222,243 @@ inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
 }
 
 static void
-inf_xmpp_connection_send_xml(InfXmppConnection* xmpp,
-                             xmlNodePtr xml)
+inf_xmpp_connection_flush(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  InfXmppConnectionMessage* messages;
+  InfXmppConnectionMessage* message;
+  GByteArray* cork;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  if(priv->cork_timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->cork_io, priv->cork_timeout);
+    priv->cork_timeout = NULL;
+
+    g_object_unref(priv->cork_io);
+    priv->cork_io = NULL;
+  }
+
+  if(priv->cork->len == 0)
+    return;
+
+  /* Take the held back data and messages, so that anything which is sent
+   * from within a callback is held back anew. */
+  cork = priv->cork;
+  priv->cork = g_byte_array_sized_new(cork->len);
+
+  messages = priv->corked_messages;
+  priv->corked_messages = NULL;
+  priv->last_corked_message = NULL;
+
+  g_object_ref(xmpp);
+  inf_xmpp_connection_send_chars(xmpp, cork->data, cork->len);
+  g_byte_array_unref(cork);
+
+  /* All messages end with the data just written. Don't use
+   * inf_xmpp_connection_push_message() for them, since data held back from
+   * within a sent callback must not make later messages wait for it. */
+  ++ priv->flushing;
+  while(messages != NULL)
+  {
+    message = messages;
+    messages = message->next;
+
+    /* Messages are only held back in READY state. If the connection went
+     * down while writing them, then they have not been sent. */
+    if(priv->status != INF_XMPP_CONNECTION_READY)
+    {
+      if(message->free_func != NULL)
+        message->free_func(xmpp, message->user_data);
+      g_slice_free(InfXmppConnectionMessage, message);
+    }
+    else if(priv->position == 0)
+    {
+      if(message->sent_func != NULL)
+        message->sent_func(xmpp, message->user_data);
+      if(message->free_func != NULL)
+        message->free_func(xmpp, message->user_data);
+      g_slice_free(InfXmppConnectionMessage, message);
+    }
+    else
+    {
+      message->next = NULL;
+      message->position = priv->position;
+
+      if(priv->last_message == NULL)
+        priv->messages = message;
+      else
+        priv->last_message->next = message;
+
+      priv->last_message = message;
+    }
+  }
+  -- priv->flushing;
+
+  g_object_unref(xmpp);
+}
+
+static void
+inf_xmpp_connection_cork_timeout_func(gpointer user_data)
+{
+  InfXmppConnection* xmpp;
+  InfXmppConnectionPrivate* priv;
+
+  xmpp = INF_XMPP_CONNECTION(user_data);
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  priv->cork_timeout = NULL;
+  g_object_unref(priv->cork_io);
+  priv->cork_io = NULL;
+
+  inf_xmpp_connection_flush(xmpp);
+}
+
+/* Holds back application data for at most flush_latency microseconds, so
+ * that messages sent in quick succession are written together. */
+static void
+inf_xmpp_connection_cork_chars(InfXmppConnection* xmpp,
+                               gconstpointer data,
+                               guint len)
 {
   InfXmppConnectionPrivate* priv;
   priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
 
-  g_return_if_fail(priv->doc != NULL);
+  g_assert(priv->status == INF_XMPP_CONNECTION_READY);
+
+  if(priv->flush_latency == 0)
+  {
+    inf_xmpp_connection_send_chars(xmpp, data, len);
+  }
+  else
+  {
+    g_byte_array_append(priv->cork, data, len);
+
+    if(priv->cork->len >= INF_XMPP_CONNECTION_CORK_MAX &&
+       priv->flushing == 0)
+    {
+      inf_xmpp_connection_flush(xmpp);
+    }
+    else if(priv->cork_timeout == NULL)
+    {
+      g_object_get(G_OBJECT(priv->tcp), "io", &priv->cork_io, NULL);
+      g_assert(priv->cork_io != NULL);
+
+      priv->cork_timeout = inf_io_add_timeout(
+        priv->cork_io,
+        (priv->flush_latency + 999) / 1000,
+        inf_xmpp_connection_cork_timeout_func,
+        xmpp,
+        NULL
+      );
+    }
+  }
+}
+
+/* Encodes xml as a binary frame into array. The frame starts at *offset
+ * within array. Returns FALSE if xml has no compact form or if it is too
+ * large for a binary frame. */
+static gboolean
+inf_xmpp_connection_encode_frame(xmlNodePtr xml,
+                                 GByteArray* array,
+                                 guint* offset)
+{
+  guint8 size_bytes[INF_XMPP_CONNECTION_FRAME_HEADER - 1];
+  gsize size;
+  guint n_size_bytes;
+
+  /* Leave room for the frame header in front of the compact XML */
+  g_byte_array_set_size(array, INF_XMPP_CONNECTION_FRAME_HEADER);
+  if(!inf_xml_util_node_to_compact(xml, array))
+    return FALSE;
+
+  size = array->len - INF_XMPP_CONNECTION_FRAME_HEADER;
+  if(size > INF_XMPP_CONNECTION_FRAME_MAX)
+    return FALSE;
+
+  n_size_bytes = 0;
+  do
+  {
+    size_bytes[n_size_bytes] = size & 0x7f;
+    size >>= 7;
+    if(size > 0) size_bytes[n_size_bytes] |= 0x80;
+    ++n_size_bytes;
+  } while(size > 0);
+
+  *offset = INF_XMPP_CONNECTION_FRAME_HEADER - n_size_bytes - 1;
+  array->data[*offset] = '\0';
+  memcpy(array->data + *offset + 1, size_bytes, n_size_bytes);
+  return TRUE;
+}
+
+/* Writes xml as a binary frame, if the remote site accepts binary frames and
+ * xml has a compact form. Returns FALSE if xml needs to be written as XML
+ * text instead. */
+static gboolean
+inf_xmpp_connection_write_frame(InfXmppConnection* xmpp,
+                                xmlNodePtr xml)
+{
+  InfXmppConnectionPrivate* priv;
+  guint offset;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  if(priv->remote_binary_frames == FALSE)
+    return FALSE;
+
+  if(!inf_xmpp_connection_encode_frame(xml, priv->frame_out, &offset))
+    return FALSE;
+
+  inf_xmpp_connection_cork_chars(
+    xmpp,
+    priv->frame_out->data + offset,
+    priv->frame_out->len - offset
+  );
+
+  return TRUE;
+}
+
+static void
+inf_xmpp_connection_write_xml(InfXmppConnection* xmpp,
+                              xmlNodePtr xml,
+                              gboolean cork)
+{
+  InfXmppConnectionPrivate* priv;
+  xmlSaveCtxtPtr ctxt;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
   g_return_if_fail(priv->buf != NULL);
 
-  xmlDocSetRootElement(priv->doc, xml);
-  xmlNodeDump(priv->buf, priv->doc, xml, 0, 0);
-  xmlUnlinkNode(xml);
-  xmlSetListDoc(xml, NULL);
+  /* Application data can be written as a binary frame */
+  if(cork && inf_xmpp_connection_write_frame(xmpp, xml))
+    return;
+
+  /* Serialize the node directly, without attaching it to a document
+   * first. */
+  ctxt = xmlSaveToBuffer(priv->buf, NULL, XML_SAVE_NO_DECL);
+  xmlSaveTree(ctxt, xml);
+  xmlSaveClose(ctxt);
 
   /* Keep the object alive during the send_chars call, so that we can check
    * the buffer variable afterwards. */
   g_object_ref(xmpp);
 
-  inf_xmpp_connection_send_chars(
-    xmpp,
-    xmlBufferContent(priv->buf),
-    xmlBufferLength(priv->buf)
-  );
+  if(cork)
+  {
+    inf_xmpp_connection_cork_chars(
+      xmpp,
+      xmlBufferContent(priv->buf),
+      xmlBufferLength(priv->buf)
+    );
+  }
+  else
+  {
+    inf_xmpp_connection_send_chars(
+      xmpp,
+      xmlBufferContent(priv->buf),
+      xmlBufferLength(priv->buf)
+    );
+  }
 
   /* The connection might be closed & cleared as a result from
    * inf_xmpp_connection_send_chars(), so make sure the buffer still
@@ -807,6 +1469,13 @@ inf_xmpp_connection_send_xml(InfXmppConnection* xmpp,
   g_object_unref(xmpp);
 }
 
+static void
+inf_xmpp_connection_send_xml(InfXmppConnection* xmpp,
+                             xmlNodePtr xml)
+{
+  inf_xmpp_connection_write_xml(xmpp, xml, FALSE);
+}
+
 /*
  * Helper functions
  */
@@ -1261,6 +1930,227 @@ inf_xmpp_connection_tls_import_peer_certificate(InfXmppConnection* xmpp,
   return inf_certificate_chain_new(certs, list_size);
 }
 
+static ssize_t
+inf_xmpp_connection_tls_handshake_push(gnutls_transport_ptr_t ptr,
+                                       const void* data,
+                                       size_t len)
+{
+  InfXmppConnectionHandshake* handshake;
+  handshake = (InfXmppConnectionHandshake*)ptr;
+
+  /* Worker thread: keep the data until the step has finished */
+  g_byte_array_append(handshake->output, data, len);
+  return len;
+}
+
+static ssize_t
+inf_xmpp_connection_tls_handshake_pull(gnutls_transport_ptr_t ptr,
+                                       void* data,
+                                       size_t len)
+{
+  InfXmppConnectionHandshake* handshake;
+  size_t pull_len;
+
+  handshake = (InfXmppConnectionHandshake*)ptr;
+
+  /* Worker thread: no more data available, so the step is finished */
+  if(handshake->input_pos == handshake->input->len)
+  {
+    gnutls_transport_set_errno(handshake->session, EAGAIN);
+    return -1;
+  }
+
+  pull_len = handshake->input->len - handshake->input_pos;
+  if(len < pull_len) pull_len = len;
+
+  memcpy(data, handshake->input->data + handshake->input_pos, pull_len);
+  handshake->input_pos += pull_len;
+  return pull_len;
+}
+
+static void
+inf_xmpp_connection_tls_handshake_run_func(gpointer* run_data,
+                                           GDestroyNotify* run_notify,
+                                           gpointer user_data)
+{
+  InfXmppConnectionHandshake* handshake;
+  handshake = (InfXmppConnectionHandshake*)user_data;
+
+  handshake->ret = gnutls_handshake(handshake->session);
+
+  *run_data = handshake;
+  *run_notify = inf_xmpp_connection_tls_handshake_free;
+}
+
+static void
+inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
+                                gconstpointer data,
+                                guint len,
+                                gpointer user_data);
+
+static void
+inf_xmpp_connection_tls_handshake_done_func(gpointer run_data,
+                                            gpointer user_data)
+{
+  InfXmppConnection* xmpp;
+  InfXmppConnectionPrivate* priv;
+  InfXmppConnectionHandshake* handshake;
+  GByteArray* input;
+
+  handshake = (InfXmppConnectionHandshake*)run_data;
+  xmpp = handshake->xmpp;
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  g_assert(priv->status == INF_XMPP_CONNECTION_HANDSHAKING);
+  g_assert(priv->tls_handshake_op != NULL);
+  priv->tls_handshake_op = NULL;
+
+  /* Take back the session */
+  priv->session = handshake->session;
+  handshake->session = NULL;
+
+  gnutls_transport_set_ptr(priv->session, xmpp);
+  gnutls_transport_set_push_function(
+    priv->session,
+    inf_xmpp_connection_tls_push
+  );
+  gnutls_transport_set_pull_function(
+    priv->session,
+    inf_xmpp_connection_tls_pull
+  );
+
+  if(handshake->output->len > 0)
+  {
+    inf_xmpp_connection_tls_push(
+      xmpp,
+      handshake->output->data,
+      handshake->output->len
+    );
+  }
+
+  /* Data which the handshake did not consume, followed by the data that
+   * has been received while the step was running */
+  input = priv->tls_handshake_pending;
+  priv->tls_handshake_pending = NULL;
+
+  if(handshake->input_pos < handshake->input->len)
+  {
+    g_byte_array_prepend(
+      input,
+      handshake->input->data + handshake->input_pos,
+      handshake->input->len - handshake->input_pos
+    );
+  }
+
+  /* Process the result of the step in the same way as received data, so
+   * that data following the handshake is processed right away. If the
+   * handshake needs more data and there is none, then wait for it. */
+  if(handshake->ret != GNUTLS_E_AGAIN)
+  {
+    priv->tls_handshake_finished = TRUE;
+    priv->tls_handshake_ret = handshake->ret;
+  }
+
+  if(priv->tls_handshake_finished == TRUE || input->len > 0)
+    inf_xmpp_connection_received_cb(priv->tcp, input->data, input->len, xmpp);
+
+  g_byte_array_unref(input);
+}
+
+/* Runs the next step of the TLS handshake in a worker thread, with the
+ * data that is currently available for pulling. Returns FALSE if the
+ * worker could not be started, in which case the step needs to be
+ * performed synchronously. */
+static gboolean
+inf_xmpp_connection_tls_handshake_start(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  InfXmppConnectionHandshake* handshake;
+  InfIo* io;
+  GError* error;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  g_assert(priv->tls_handshake_op == NULL);
+
+  g_object_get(G_OBJECT(priv->tcp), "io", &io, NULL);
+  g_assert(io != NULL);
+
+  handshake = g_slice_new(InfXmppConnectionHandshake);
+  handshake->xmpp = xmpp;
+  handshake->session = priv->session;
+  handshake->creds = inf_certificate_credentials_ref(priv->creds);
+  handshake->ticket_key = NULL;
+  if(priv->tls_ticket_key != NULL)
+    handshake->ticket_key = g_bytes_ref(priv->tls_ticket_key);
+
+  handshake->input = g_byte_array_sized_new(priv->pull_len);
+  handshake->input_pos = 0;
+  handshake->output = g_byte_array_new();
+  handshake->ret = GNUTLS_E_AGAIN;
+
+  g_byte_array_append(
+    handshake->input,
+    (const guint8*)priv->pull_data,
+    priv->pull_len
+  );
+
+  gnutls_transport_set_ptr(priv->session, handshake);
+  gnutls_transport_set_push_function(
+    priv->session,
+    inf_xmpp_connection_tls_handshake_push
+  );
+  gnutls_transport_set_pull_function(
+    priv->session,
+    inf_xmpp_connection_tls_handshake_pull
+  );
+
+  priv->tls_handshake_op = inf_async_operation_new(
+    io,
+    inf_xmpp_connection_tls_handshake_run_func,
+    inf_xmpp_connection_tls_handshake_done_func,
+    handshake
+  );
+
+  inf_async_operation_set_pool(
+    priv->tls_handshake_op,
+    INF_ASYNC_OPERATION_POOL_HANDSHAKE
+  );
+
+  g_object_unref(io);
+
+  error = NULL;
+  if(!inf_async_operation_start(priv->tls_handshake_op, &error))
+  {
+    g_warning(
+      "Failed to start TLS handshake in worker thread: %s",
+      error->message
+    );
+
+    g_error_free(error);
+    priv->tls_handshake_op = NULL;
+
+    gnutls_transport_set_ptr(priv->session, xmpp);
+    gnutls_transport_set_push_function(
+      priv->session,
+      inf_xmpp_connection_tls_push
+    );
+    gnutls_transport_set_pull_function(
+      priv->session,
+      inf_xmpp_connection_tls_pull
+    );
+
+    handshake->session = NULL;
+    inf_xmpp_connection_tls_handshake_free(handshake);
+    return FALSE;
+  }
+
+  /* The session belongs to the worker thread until the step has finished,
+   * and it has taken all the data there was to pull. */
+  priv->pull_len = 0;
+  priv->tls_handshake_pending = g_byte_array_new();
+  return TRUE;
+}
+
 static void
 inf_xmpp_connection_tls_handshake(InfXmppConnection* xmpp)
 {
@@ -1274,7 +2164,23 @@ inf_xmpp_connection_tls_handshake(InfXmppConnection* xmpp)
   g_assert(priv->status == INF_XMPP_CONNECTION_HANDSHAKING);
   g_assert(priv->session != NULL);
 
-  ret = gnutls_handshake(priv->session);
+  if(priv->tls_handshake_finished == TRUE)
+  {
+    /* A step in a worker thread has finished the handshake */
+    priv->tls_handshake_finished = FALSE;
+    ret = priv->tls_handshake_ret;
+  }
+  else if(priv->tls_handshake_async == TRUE &&
+          inf_xmpp_connection_tls_handshake_start(xmpp) == TRUE)
+  {
+    /* Wait for the worker thread */
+    return;
+  }
+  else
+  {
+    ret = gnutls_handshake(priv->session);
+  }
+
   switch(ret)
   {
   case GNUTLS_E_AGAIN:
@@ -1283,6 +2189,10 @@ inf_xmpp_connection_tls_handshake(InfXmppConnection* xmpp)
   case 0:
     /* Handshake finished successfully */
     priv->status = INF_XMPP_CONNECTION_CONNECTED;
+    priv->tls_established = TRUE;
+    priv->tls_resumed = gnutls_session_is_resumed(priv->session) != 0;
+
+    g_object_notify(G_OBJECT(xmpp), "tls-resumed");
     g_object_notify(G_OBJECT(xmpp), "tls-enabled");
 
     error = NULL;
@@ -1389,6 +2299,7 @@ static void
 inf_xmpp_connection_tls_init(InfXmppConnection* xmpp)
 {
   InfXmppConnectionPrivate* priv;
+  gnutls_datum_t key;
 
   priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
   g_assert(priv->session == NULL);
@@ -1406,14 +2317,40 @@ inf_xmpp_connection_tls_init(InfXmppConnection* xmpp)
     g_object_notify(G_OBJECT(xmpp), "credentials");
   }
 
+  if(priv->tls_resumed == TRUE)
+  {
+    priv->tls_resumed = FALSE;
+    g_object_notify(G_OBJECT(xmpp), "tls-resumed");
+  }
+
   switch(priv->site)
   {
   case INF_XMPP_CONNECTION_CLIENT:
     gnutls_init(&priv->session, GNUTLS_CLIENT);
+
+    /* Try to resume a previous session, to avoid a full handshake. If the
+     * server does not accept it anymore, a full handshake is done. */
+    if(priv->tls_session_data != NULL)
+    {
+      gnutls_session_set_data(
+        priv->session,
+        g_bytes_get_data(priv->tls_session_data, NULL),
+        g_bytes_get_size(priv->tls_session_data)
+      );
+    }
+
     break;
   case INF_XMPP_CONNECTION_SERVER:
     gnutls_init(&priv->session, GNUTLS_SERVER);
 
+    /* Issue session tickets so that clients can resume the session */
+    if(priv->tls_ticket_key != NULL)
+    {
+      key.data = (unsigned char*)g_bytes_get_data(priv->tls_ticket_key, NULL);
+      key.size = g_bytes_get_size(priv->tls_ticket_key);
+      gnutls_session_ticket_enable_server(priv->session, &key);
+    }
+
     /* If the user wants to check the client's certificate, then require
      * that the client sends one. */
     if(priv->certificate_callback != NULL)
@@ -1866,6 +2803,38 @@ inf_xmpp_connection_sasl_init(InfXmppConnection* xmpp,
  * XMPP messaging
  */
 
+/* Checks whether the remote site accepts binary frames, from the attributes
+ * of its <stream:stream>. */
+static void
+inf_xmpp_connection_process_stream_attrs(InfXmppConnection* xmpp,
+                                         const xmlChar** attrs)
+{
+  InfXmppConnectionPrivate* priv;
+  const xmlChar** attr;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  priv->remote_binary_frames = FALSE;
+  priv->remote_compression = FALSE;
+
+  if(attrs != NULL)
+  {
+    for(attr = attrs; *attr != NULL; attr += 2)
+    {
+      /* Only use binary frames if we accept them ourselves */
+      if(strcmp((const char*)attr[0], "frames") == 0 &&
+         strcmp((const char*)attr[1], "binary") == 0)
+      {
+        priv->remote_binary_frames = priv->binary_frames;
+      }
+      else if(strcmp((const char*)attr[0], "compress") == 0 &&
+              strcmp((const char*)attr[1], "zlib") == 0)
+      {
+        priv->remote_compression = TRUE;
+      }
+    }
+  }
+}
+
 /* This does actually process the start_element event after several
  * special cases have been handled in sax_start_element(). */
 static void
@@ -1881,7 +2850,11 @@ inf_xmpp_connection_process_start_element(InfXmppConnection* xmpp,
   const xmlChar* attr_value;
 
   priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
-  node = xmlNewNode(NULL, name);
+
+  /* Since the document uses the parser's dictionary, the element and
+   * attribute names, which the parser has already put into the dictionary,
+   * are not copied for every node. */
+  node = xmlNewDocNode(priv->doc, NULL, name, NULL);
 
   if(attrs != NULL)
   {
@@ -1919,7 +2892,7 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
   /* TODO: xml:lang and id field are missing here */
   static const gchar xmpp_connection_initial_request[] = 
     "<stream:stream xmlns:stream=\"http://etherx.jabber.org/streams\" "
-    "xmlns=\"jabber:client\" version=\"1.0\" from=\"%s\">";
+    "xmlns=\"jabber:client\" version=\"1.0\" from=\"%s\"%s>";
 
   InfXmppConnectionPrivate* priv;
   char* mech_list;
@@ -1930,6 +2903,7 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
 
   xmlNodePtr features;
   xmlNodePtr starttls;
+  xmlNodePtr compression;
   xmlNodePtr mechanisms;
   xmlNodePtr mechanism;
   gchar* mechanism_dup;
@@ -1942,9 +2916,12 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
   g_assert(priv->status == INF_XMPP_CONNECTION_CONNECTED ||
            priv->status == INF_XMPP_CONNECTION_AUTH_CONNECTED);
 
+  inf_xmpp_connection_process_stream_attrs(xmpp, attrs);
+
   reply = g_strdup_printf(
     xmpp_connection_initial_request,
-    priv->local_hostname
+    priv->local_hostname,
+    priv->binary_frames ? INF_XMPP_CONNECTION_FRAMES_ATTRIBUTE : ""
   );
 
   inf_xmpp_connection_send_chars(xmpp, reply, strlen(reply));
@@ -1966,8 +2943,10 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
 
   features = xmlNewNode(NULL, (const xmlChar*)"stream:features");
 
-  /* Don't offer TLS if we have already authenticated. It's pointless now. */
-  if(priv->session == NULL &&
+  /* Don't offer TLS if we have already authenticated. It's pointless now.
+   * Also don't offer it on a compressed stream, since TLS would then run on
+   * top of compression. */
+  if(priv->session == NULL && priv->deflate == NULL &&
      priv->status != INF_XMPP_CONNECTION_AUTH_INITIATED)
   {
     if(priv->security_policy != INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED)
@@ -1979,6 +2958,29 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
     }
   }
 
+  /* Offer compression only after authentication, and only to clients which
+   * announced to request it, since the stream is not ready before the
+   * client did so. */
+  compression = NULL;
+  if(priv->status == INF_XMPP_CONNECTION_AUTH_INITIATED &&
+     priv->compression_level > 0 && priv->deflate == NULL &&
+     priv->remote_compression == TRUE)
+  {
+    compression = inf_xmpp_connection_node_new(
+      "compression",
+      INF_XMPP_CONNECTION_COMPRESS_FEATURE_NS
+    );
+
+    xmlNewTextChild(
+      compression,
+      NULL,
+      (const xmlChar*)"method",
+      (const xmlChar*)"zlib"
+    );
+
+    xmlAddChild(features, compression);
+  }
+
   if(priv->status == INF_XMPP_CONNECTION_INITIATED)
   {
     /* Not yet authenticated, so give the client a list of authentication
@@ -2061,11 +3063,126 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
   inf_xmpp_connection_send_xml(xmpp, features);
   xmlFreeNode(features);
 
-  if(priv->status == INF_XMPP_CONNECTION_AUTH_INITIATED)
+  /* If we offered compression, then the session is ready once the client
+   * requested it, see inf_xmpp_connection_process_auth_initiated(). */
+  if(priv->status == INF_XMPP_CONNECTION_AUTH_INITIATED && compression == NULL)
+  {
+    /* Authentication done, <stream:features> sent. Session is ready. */
+    priv->status = INF_XMPP_CONNECTION_READY;
+    g_object_notify(G_OBJECT(xmpp), "status");
+  }
+}
+
+/* Handles a <compress> request from the client */
+static void
+inf_xmpp_connection_process_compress(InfXmppConnection* xmpp,
+                                     xmlNodePtr xml)
+{
+  InfXmppConnectionPrivate* priv;
+  xmlNodePtr child;
+  xmlNodePtr reply;
+  xmlChar* method;
+  gboolean has_zlib;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  g_assert(priv->site == INF_XMPP_CONNECTION_SERVER);
+  g_assert(priv->status == INF_XMPP_CONNECTION_AUTH_INITIATED);
+
+  has_zlib = FALSE;
+  for(child = xml->children; child != NULL; child = child->next)
+  {
+    if(strcmp((const gchar*)child->name, "method") == 0)
+    {
+      method = xmlNodeGetContent(child);
+      if(method != NULL && strcmp((const gchar*)method, "zlib") == 0)
+        has_zlib = TRUE;
+      if(method != NULL)
+        xmlFree(method);
+    }
+  }
+
+  /* We did not offer compression in these cases */
+  if(priv->compression_level == 0 || priv->deflate != NULL)
+    has_zlib = FALSE;
+
+  if(has_zlib)
+  {
+    /* <compressed/> itself is sent uncompressed. Everything afterwards,
+     * starting with the new stream, is compressed. */
+    reply = inf_xmpp_connection_node_new(
+      "compressed",
+      INF_XMPP_CONNECTION_COMPRESS_NS
+    );
+
+    inf_xmpp_connection_send_xml(xmpp, reply);
+    xmlFreeNode(reply);
+
+    if(priv->status != INF_XMPP_CONNECTION_AUTH_INITIATED)
+      return;
+
+    if(inf_xmpp_connection_compression_start(xmpp))
+    {
+      /* The stream is restarted in received_cb(), since we are in an XML
+       * callback here and cannot replace the XML parser. */
+      priv->status = INF_XMPP_CONNECTION_AUTH_CONNECTED;
+      return;
+    }
+
+    /* We already told the client that compression is in effect, so there
+     * is no way to recover. */
+    inf_xmpp_connection_terminate(xmpp);
+    return;
+  }
+
+  /* The client goes on without compression */
+  reply = inf_xmpp_connection_node_new(
+    "failure",
+    INF_XMPP_CONNECTION_COMPRESS_NS
+  );
+
+  xmlNewChild(
+    reply,
+    NULL,
+    (const xmlChar*)(priv->compression_level > 0 && priv->deflate == NULL ?
+                     "unsupported-method" : "setup-failed"),
+    NULL
+  );
+
+  inf_xmpp_connection_send_xml(xmpp, reply);
+  xmlFreeNode(reply);
+
+  if(priv->status == INF_XMPP_CONNECTION_AUTH_INITIATED)
+  {
+    priv->status = INF_XMPP_CONNECTION_READY;
+    g_object_notify(G_OBJECT(xmpp), "status");
+  }
+}
+
+/* Handles the first message of the client after the server offered
+ * compression following authentication */
+static void
+inf_xmpp_connection_process_auth_initiated(InfXmppConnection* xmpp,
+                                           xmlNodePtr xml)
+{
+  InfXmppConnectionPrivate* priv;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  g_assert(priv->site == INF_XMPP_CONNECTION_SERVER);
+  g_assert(priv->status == INF_XMPP_CONNECTION_AUTH_INITIATED);
+
+  if(strcmp((const gchar*)xml->name, "compress") == 0)
   {
-    /* Authentication done, <stream:features> sent. Session is ready. */
+    inf_xmpp_connection_process_compress(xmpp, xml);
+  }
+  else
+  {
+    /* The client chose not to compress the stream after all, and went on
+     * with the session right away. */
     priv->status = INF_XMPP_CONNECTION_READY;
     g_object_notify(G_OBJECT(xmpp), "status");
+
+    if(priv->status == INF_XMPP_CONNECTION_READY)
+      inf_xml_connection_received(INF_XML_CONNECTION(xmpp), xml);
   }
 }
 
@@ -2308,6 +3425,37 @@ inf_xmpp_connection_sasl_suggest_mechanism(InfXmppConnection* xmpp,
   return suggestion;
 }
 
+/* Returns whether the given <stream:features> offer zlib compression */
+static gboolean
+inf_xmpp_connection_features_have_zlib(xmlNodePtr xml)
+{
+  xmlNodePtr child;
+  xmlNodePtr method;
+  xmlChar* content;
+  gboolean result;
+
+  result = FALSE;
+  for(child = xml->children; child != NULL; child = child->next)
+  {
+    if(strcmp((const gchar*)child->name, "compression") != 0)
+      continue;
+
+    for(method = child->children; method != NULL; method = method->next)
+    {
+      if(strcmp((const gchar*)method->name, "method") == 0)
+      {
+        content = xmlNodeGetContent(method);
+        if(content != NULL && strcmp((const gchar*)content, "zlib") == 0)
+          result = TRUE;
+        if(content != NULL)
+          xmlFree(content);
+      }
+    }
+  }
+
+  return result;
+}
+
 static void
 inf_xmpp_connection_process_features(InfXmppConnection* xmpp,
                                      xmlNodePtr xml)
@@ -2316,6 +3464,7 @@ inf_xmpp_connection_process_features(InfXmppConnection* xmpp,
   xmlNodePtr child;
   xmlNodePtr req;
   xmlNodePtr starttls;
+  xmlNodePtr request;
   const char* suggestion;
   GError* error;
 
@@ -2390,6 +3539,31 @@ inf_xmpp_connection_process_features(InfXmppConnection* xmpp,
     }
   }
 
+  /* Request compression once authenticated if the server offers it. We
+   * announced in <stream:stream> that we would do so. */
+  if(priv->status == INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES &&
+     priv->compression_level > 0 && priv->deflate == NULL &&
+     inf_xmpp_connection_features_have_zlib(xml))
+  {
+    request = inf_xmpp_connection_node_new(
+      "compress",
+      INF_XMPP_CONNECTION_COMPRESS_NS
+    );
+
+    xmlNewTextChild(
+      request,
+      NULL,
+      (const xmlChar*)"method",
+      (const xmlChar*)"zlib"
+    );
+
+    inf_xmpp_connection_send_xml(xmpp, request);
+    xmlFreeNode(request);
+
+    if(priv->status == INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES)
+      priv->status = INF_XMPP_CONNECTION_COMPRESSION_REQUESTED;
+  }
+
   /* If we did not request TLS above, then go on with authentication */
   if(priv->status == INF_XMPP_CONNECTION_AWAITING_FEATURES)
   {
@@ -2479,6 +3653,45 @@ inf_xmpp_connection_process_encryption(InfXmppConnection* xmpp,
   }
 }
 
+static void
+inf_xmpp_connection_process_compression(InfXmppConnection* xmpp,
+                                        xmlNodePtr xml)
+{
+  InfXmppConnectionPrivate* priv;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  g_assert(priv->site == INF_XMPP_CONNECTION_CLIENT);
+  g_assert(priv->status == INF_XMPP_CONNECTION_COMPRESSION_REQUESTED);
+
+  if(strcmp((const gchar*)xml->name, "compressed") == 0)
+  {
+    if(inf_xmpp_connection_compression_start(xmpp))
+    {
+      /* We might be in a XML callback here, so do not initiate the stream
+       * right now because it replaces the XML parser. The stream is
+       * reinitiated in received_cb(), as after authentication. */
+      priv->status = INF_XMPP_CONNECTION_AUTH_CONNECTED;
+    }
+    else
+    {
+      /* The server compresses everything from now on, so we cannot go on
+       * without compression either. */
+      inf_xmpp_connection_terminate(xmpp);
+    }
+  }
+  else if(strcmp((const gchar*)xml->name, "failure") == 0)
+  {
+    /* Go on with the session on the uncompressed stream */
+    priv->status = INF_XMPP_CONNECTION_READY;
+    g_object_notify(G_OBJECT(xmpp), "status");
+  }
+  else
+  {
+    /* We got neither 'compressed' nor 'failure'. Ignore and wait for either
+     * of them. */
+  }
+}
+
 static void
 inf_xmpp_connection_process_authentication_error(
   InfXmppConnection* xmpp,
@@ -2699,6 +3912,11 @@ inf_xmpp_connection_process_end_element(InfXmppConnection* xmpp,
         g_assert(priv->site == INF_XMPP_CONNECTION_CLIENT);
         inf_xmpp_connection_process_encryption(xmpp, priv->root);
         break;
+      case INF_XMPP_CONNECTION_COMPRESSION_REQUESTED:
+        /* This is a client-only state */
+        g_assert(priv->site == INF_XMPP_CONNECTION_CLIENT);
+        inf_xmpp_connection_process_compression(xmpp, priv->root);
+        break;
       case INF_XMPP_CONNECTION_AUTHENTICATING:
         inf_xmpp_connection_process_authentication(xmpp, priv->root);
         break;
@@ -2712,9 +3930,12 @@ inf_xmpp_connection_process_end_element(InfXmppConnection* xmpp,
         break;
       case INF_XMPP_CONNECTION_AUTH_INITIATED:
         /* The client should be waiting for <stream:stream> from the server
-         * in this state, and sax_end_element should not have called this
-         * function. Also, this is a client-only state (the server goes
-         * directly to READY after having received <stream:stream>). */
+         * in this state, and sax_end_element() should not have called this
+         * function. The server only stays in this state if it offered
+         * compression. */
+        g_assert(priv->site == INF_XMPP_CONNECTION_SERVER);
+        inf_xmpp_connection_process_auth_initiated(xmpp, priv->root);
+        break;
       case INF_XMPP_CONNECTION_CONNECTING:
       case INF_XMPP_CONNECTION_CONNECTED:
       case INF_XMPP_CONNECTION_AUTH_CONNECTED:
@@ -2786,6 +4007,7 @@ inf_xmpp_connection_sax_start_element(void* context,
          * we can start TLS or authentication if the server supports it. */
         /* TODO: Read server's JID, if a from field is given? However, the RFC
          * suggests we SHOULD silently ignore it. */
+        inf_xmpp_connection_process_stream_attrs(xmpp, attrs);
         if(priv->status == INF_XMPP_CONNECTION_INITIATED)
           priv->status = INF_XMPP_CONNECTION_AWAITING_FEATURES;
         else
@@ -2804,6 +4026,7 @@ inf_xmpp_connection_sax_start_element(void* context,
   case INF_XMPP_CONNECTION_AWAITING_FEATURES:
   case INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES:
   case INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED:
+  case INF_XMPP_CONNECTION_COMPRESSION_REQUESTED:
   case INF_XMPP_CONNECTION_AUTHENTICATING:
   case INF_XMPP_CONNECTION_READY:
     inf_xmpp_connection_process_start_element(xmpp, name, attrs);
@@ -2869,6 +4092,7 @@ inf_xmpp_connection_sax_end_element(void* context,
     case INF_XMPP_CONNECTION_AWAITING_FEATURES:
     case INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES:
     case INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED:
+    case INF_XMPP_CONNECTION_COMPRESSION_REQUESTED:
     case INF_XMPP_CONNECTION_READY:
       /* Also terminate stream in these states */
       inf_xmpp_connection_terminate(xmpp);
@@ -3045,7 +4269,7 @@ inf_xmpp_connection_initiate(InfXmppConnection* xmpp)
 {
   static const gchar xmpp_connection_initial_request[] =
     "<stream:stream version=\"1.0\" xmlns=\"jabber:client\" "
-    "xmlns:stream=\"http://etherx.jabber.org/streams\" to=\"%s\">";
+    "xmlns:stream=\"http://etherx.jabber.org/streams\" to=\"%s\"%s%s>";
 
   InfXmppConnectionPrivate* priv;
   gchar* request;
@@ -3055,121 +4279,389 @@ inf_xmpp_connection_initiate(InfXmppConnection* xmpp)
   g_assert(priv->status == INF_XMPP_CONNECTION_CONNECTED ||
            priv->status == INF_XMPP_CONNECTION_AUTH_CONNECTED);
 
-  /* Create XML parser for incoming data */
-  if(priv->parser != NULL) xmlFreeParserCtxt(priv->parser);
-  priv->parser = xmlCreatePushParserCtxt(
-    &inf_xmpp_connection_handler,
-    xmpp,
-    NULL,
-    0,
-    NULL
+  /* Create XML parser for incoming data. When the stream is restarted,
+   * reset the existing parser instead, which keeps its buffers and its
+   * dictionary of element and attribute names. */
+  if(priv->parser != NULL)
+  {
+    if(priv->root != NULL)
+    {
+      xmlFreeNode(priv->root);
+      priv->root = NULL;
+      priv->cur = NULL;
+    }
+
+    xmlCtxtResetPush(priv->parser, NULL, 0, NULL, NULL);
+    priv->parser->userData = xmpp;
+  }
+  else
+  {
+    priv->parser = xmlCreatePushParserCtxt(
+      &inf_xmpp_connection_handler,
+      xmpp,
+      NULL,
+      0,
+      NULL
+    );
+
+    g_assert(priv->doc == NULL);
+    priv->doc = xmlNewDoc(NULL);
+    priv->doc->dict = priv->parser->dict;
+    xmlDictReference(priv->doc->dict);
+  }
+
+  /* Create XML buffer for outgoing data */
+  if(priv->buf == NULL)
+    priv->buf = xmlBufferCreate();
+
+  if(priv->site == INF_XMPP_CONNECTION_CLIENT)
+  {
+    /* Announce that we request compression once authenticated */
+    request = g_strdup_printf(
+      xmpp_connection_initial_request,
+      priv->remote_hostname,
+      priv->binary_frames ? INF_XMPP_CONNECTION_FRAMES_ATTRIBUTE : "",
+      priv->status == INF_XMPP_CONNECTION_AUTH_CONNECTED &&
+      priv->compression_level > 0 && priv->deflate == NULL ?
+        INF_XMPP_CONNECTION_COMPRESS_ATTRIBUTE : ""
+    );
+
+    inf_xmpp_connection_send_chars(xmpp, request, strlen(request));
+    g_free(request);
+
+    switch(priv->status)
+    {
+    case INF_XMPP_CONNECTION_CONNECTED:
+      priv->status = INF_XMPP_CONNECTION_INITIATED;
+      break;
+    case INF_XMPP_CONNECTION_AUTH_CONNECTED:
+      priv->status = INF_XMPP_CONNECTION_AUTH_INITIATED;
+      break;
+    default:
+      g_assert_not_reached();
+      break;
+    }
+  }
+}
+
+/*
+ * Signal handlers.
+ */
+
+static void
+inf_xmpp_connection_received_cb_sent_func(InfXmppConnection* xmpp,
+                                          gpointer user_data)
+{
+  InfXmppConnectionPrivate* priv;
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  /* Terminating </stream:stream> and GnuTLS bye have been sent, so
+   * close underlaying TCP connection. This will trigger a TCP status
+   * notify. */
+  inf_tcp_connection_close(priv->tcp);
+}
+
+static void
+inf_xmpp_connection_sent_cb(InfTcpConnection* tcp,
+                            gconstpointer data,
+                            guint len,
+                            gpointer user_data)
+{
+  InfXmppConnection* xmpp;
+  InfXmppConnectionPrivate* priv;
+  InfXmppConnectionMessage* message;
+  gboolean have_sent;
+
+  xmpp = INF_XMPP_CONNECTION(user_data);
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  g_assert(priv->position >= len);
+  g_object_ref(G_OBJECT(xmpp));
+
+  priv->position -= len;
+  if(priv->messages != NULL)
+  {
+    have_sent = priv->messages->sent;
+
+    /* Flag all messages that have been sent by this call */
+    for(message = priv->messages; message != NULL; message = message->next)
+    {
+      if(!message->sent)
+      {
+        if(message->position <= len)
+          message->sent = TRUE;
+        else
+          message->position -= len;
+      }
+    }
+
+    /* Note that a complete execution of this function doesn't keep messages
+     * with sent flag set to TRUE in the queue. So if the sent flag was FALSE,
+     * the method has been called recursively by a sent callback. In that
+     * case, don't do anything here but let the parent call do all other sent
+     * callbacks. */
+    if(have_sent == FALSE)
+    {
+      /* Now call sent func on all flagged messages */
+      while(priv->messages != NULL && priv->messages->sent)
+      {
+        if(priv->messages->sent_func != NULL)
+          priv->messages->sent_func(xmpp, priv->messages->user_data);
+
+        /* Note that the sent func might have called _clear() in which case all
+         * messages have already been removed. */
+        if(priv->messages != NULL)
+          inf_xmpp_connection_pop_message(xmpp);
+      }
+    }
+  }
+
+  /* All data has been written out, so the socket is writable again. There
+   * is no point in holding back data any longer. Don't do this from within
+   * a GnuTLS or parser callback, though, the timeout takes care of it. */
+  if(priv->position == 0 && priv->cork->len > 0 && priv->parsing == 0 &&
+     priv->flushing == 0 && priv->status == INF_XMPP_CONNECTION_READY)
+  {
+    inf_xmpp_connection_flush(xmpp);
+  }
+
+  g_object_unref(G_OBJECT(xmpp));
+}
+
+/* Terminates the connection because of an invalid binary frame or invalid
+ * compressed data. As with XML errors, no <stream:error> can be sent before
+ * the stream has started or while TLS is being set up. */
+static void
+inf_xmpp_connection_input_error(InfXmppConnection* xmpp,
+                                InfXmppConnectionStreamError code,
+                                const gchar* message)
+{
+  InfXmppConnectionPrivate* priv;
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  if(priv->status != INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED &&
+     priv->status != INF_XMPP_CONNECTION_HANDSHAKING &&
+     priv->status != INF_XMPP_CONNECTION_CONNECTED &&
+     priv->status != INF_XMPP_CONNECTION_AUTH_CONNECTED)
+  {
+    inf_xmpp_connection_terminate_error(xmpp, code, message);
+  }
+  else
+  {
+    inf_xmpp_connection_terminate(xmpp);
+  }
+}
+
+/* Processes a completely received binary frame */
+static void
+inf_xmpp_connection_process_frame(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  xmlNodePtr xml;
+  GError* error;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  /* Binary frames can only occur between two top-level messages */
+  if(priv->root != NULL ||
+     (priv->status != INF_XMPP_CONNECTION_READY &&
+      priv->status != INF_XMPP_CONNECTION_CLOSING_STREAM))
+  {
+    inf_xmpp_connection_input_error(
+      xmpp,
+      INF_XMPP_CONNECTION_STREAM_ERROR_BAD_FORMAT,
+      _("Received a binary frame at an unexpected position")
+    );
+
+    return;
+  }
+
+  error = NULL;
+  xml = inf_xml_util_node_from_compact(
+    priv->frame_in->data,
+    priv->frame_in->len,
+    &error
   );
 
-  /* Create XML buffer for outgoing data */
-  if(priv->buf == NULL)
-  {
-    priv->buf = xmlBufferCreate();
-    priv->doc = xmlNewDoc((const xmlChar*)"1.0");
-  }
+  if(xml == NULL)
+  {
+    inf_xmpp_connection_input_error(
+      xmpp,
+      INF_XMPP_CONNECTION_STREAM_ERROR_BAD_FORMAT,
+      error->message
+    );
+
+    g_error_free(error);
+    return;
+  }
+
+  /* As for XML text, messages received while waiting for </stream:stream>
+   * are ignored. */
+  if(priv->status == INF_XMPP_CONNECTION_READY)
+    inf_xml_connection_received(INF_XML_CONNECTION(xmpp), xml);
+
+  xmlFreeNode(xml);
+}
+
+/* Feeds received data into the XML parser. If we accept binary frames, then
+ * the data is split into XML text, which goes into the parser, and binary
+ * frames, which are decoded directly. A binary frame starts with a zero
+ * byte, which cannot occur in XML text, followed by the frame length and
+ * the compact form of a message as produced by
+ * inf_xml_util_node_to_compact(). Returns FALSE if the connection is being
+ * closed as a result, in which case no more data should be parsed. */
+static gboolean
+inf_xmpp_connection_parse_received(InfXmppConnection* xmpp,
+                                   const gchar* data,
+                                   gsize len)
+{
+  InfXmppConnectionPrivate* priv;
+  const gchar* marker;
+  gsize bytes;
+  guint8 byte;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  while(len > 0)
+  {
+    if(priv->frame_pending == FALSE)
+    {
+      marker = NULL;
+      if(priv->binary_frames == TRUE)
+        marker = memchr(data, '\0', len);
+
+      bytes = (marker != NULL) ? (gsize)(marker - data) : len;
+      if(bytes > 0)
+      {
+        if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
+          printf("\033[00;32m%.*s\033[00;00m\n", (int)bytes, data);
+        xmlParseChunk(priv->parser, data, bytes, 0);
+
+        /* If the callback changed made us disconnect then don't try
+         * to read more data. */
+        if(priv->status == INF_XMPP_CONNECTION_CLOSING_GNUTLS ||
+           priv->status == INF_XMPP_CONNECTION_CLOSED)
+        {
+          return FALSE;
+        }
+      }
+
+      if(marker == NULL)
+        break;
+
+      priv->frame_pending = TRUE;
+      priv->frame_sized = FALSE;
+      priv->frame_size = 0;
+      priv->frame_shift = 0;
+      g_byte_array_set_size(priv->frame_in, 0);
+
+      data += bytes + 1;
+      len -= bytes + 1;
+    }
+    else if(priv->frame_sized == FALSE)
+    {
+      byte = *data;
+      ++data;
+      --len;
 
-  if(priv->site == INF_XMPP_CONNECTION_CLIENT)
-  {
-    request = g_strdup_printf(
-      xmpp_connection_initial_request,
-      priv->remote_hostname
-    );
+      priv->frame_size |= (gsize)(byte & 0x7f) << priv->frame_shift;
+      priv->frame_shift += 7;
 
-    inf_xmpp_connection_send_chars(xmpp, request, strlen(request));
-    g_free(request);
+      if((byte & 0x80) == 0)
+        priv->frame_sized = TRUE;
 
-    switch(priv->status)
+      if(priv->frame_size > INF_XMPP_CONNECTION_FRAME_MAX ||
+         (priv->frame_sized == FALSE &&
+          priv->frame_shift >= 7 * (INF_XMPP_CONNECTION_FRAME_HEADER - 1)))
+      {
+        inf_xmpp_connection_input_error(
+          xmpp,
+          INF_XMPP_CONNECTION_STREAM_ERROR_POLICY_VIOLATION,
+          _("Received binary frame is too large")
+        );
+
+        return FALSE;
+      }
+    }
+    else
     {
-    case INF_XMPP_CONNECTION_CONNECTED:
-      priv->status = INF_XMPP_CONNECTION_INITIATED;
-      break;
-    case INF_XMPP_CONNECTION_AUTH_CONNECTED:
-      priv->status = INF_XMPP_CONNECTION_AUTH_INITIATED;
-      break;
-    default:
-      g_assert_not_reached();
-      break;
+      bytes = MIN(len, priv->frame_size - priv->frame_in->len);
+      g_byte_array_append(priv->frame_in, (const guint8*)data, bytes);
+      data += bytes;
+      len -= bytes;
     }
-  }
-}
 
-/*
- * Signal handlers.
- */
+    if(priv->frame_pending == TRUE && priv->frame_sized == TRUE &&
+       priv->frame_in->len == priv->frame_size)
+    {
+      priv->frame_pending = FALSE;
+      inf_xmpp_connection_process_frame(xmpp);
 
-static void
-inf_xmpp_connection_received_cb_sent_func(InfXmppConnection* xmpp,
-                                          gpointer user_data)
-{
-  InfXmppConnectionPrivate* priv;
-  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+      if(priv->status == INF_XMPP_CONNECTION_CLOSING_GNUTLS ||
+         priv->status == INF_XMPP_CONNECTION_CLOSED)
+      {
+        return FALSE;
+      }
+    }
+  }
 
-  /* Terminating </stream:stream> and GnuTLS bye have been sent, so
-   * close underlaying TCP connection. This will trigger a TCP status
-   * notify. */
-  inf_tcp_connection_close(priv->tcp);
+  return TRUE;
 }
 
-static void
-inf_xmpp_connection_sent_cb(InfTcpConnection* tcp,
-                            gconstpointer data,
-                            guint len,
-                            gpointer user_data)
+/* Decompresses received data if the stream is compressed, and passes it on
+ * to inf_xmpp_connection_parse_received(). Returns FALSE if the connection
+ * is being closed, in which case no more data should be processed. */
+static gboolean
+inf_xmpp_connection_process_received(InfXmppConnection* xmpp,
+                                     const gchar* data,
+                                     gsize len)
 {
-  InfXmppConnection* xmpp;
   InfXmppConnectionPrivate* priv;
-  InfXmppConnectionMessage* message;
-  gboolean have_sent;
+  z_stream* stream;
+  gsize produced;
+  int ret;
 
-  xmpp = INF_XMPP_CONNECTION(user_data);
   priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  if(priv->inflate == NULL)
+    return inf_xmpp_connection_parse_received(xmpp, data, len);
 
-  g_assert(priv->position >= len);
-  g_object_ref(G_OBJECT(xmpp));
+  /* The stream is only freed in inf_xmpp_connection_clear(), which is not
+   * called while we are parsing. */
+  stream = priv->inflate;
+  stream->next_in = (Bytef*)data;
+  stream->avail_in = len;
 
-  priv->position -= len;
-  if(priv->messages != NULL)
+  do
   {
-    have_sent = priv->messages->sent;
+    stream->next_out = priv->inflate_buf;
+    stream->avail_out = INF_XMPP_CONNECTION_INFLATE_CHUNK;
 
-    /* Flag all messages that have been sent by this call */
-    for(message = priv->messages; message != NULL; message = message->next)
+    ret = inflate(stream, Z_SYNC_FLUSH);
+    if(ret != Z_OK && ret != Z_BUF_ERROR)
     {
-      if(!message->sent)
-      {
-        if(message->position <= len)
-          message->sent = TRUE;
-        else
-          message->position -= len;
-      }
+      inf_xmpp_connection_input_error(
+        xmpp,
+        INF_XMPP_CONNECTION_STREAM_ERROR_BAD_FORMAT,
+        _("Received invalid compressed data")
+      );
+
+      return FALSE;
     }
 
-    /* Note that a complete execution of this function doesn't keep messages
-     * with sent flag set to TRUE in the queue. So if the sent flag was FALSE,
-     * the method has been called recursively by a sent callback. In that
-     * case, don't do anything here but let the parent call do all other sent
-     * callbacks. */
-    if(have_sent == FALSE)
+    produced = INF_XMPP_CONNECTION_INFLATE_CHUNK - stream->avail_out;
+    if(produced > 0)
     {
-      /* Now call sent func on all flagged messages */
-      while(priv->messages != NULL && priv->messages->sent)
+      if(!inf_xmpp_connection_parse_received(
+           xmpp,
+           (const gchar*)priv->inflate_buf,
+           produced))
       {
-        if(priv->messages->sent_func != NULL)
-          priv->messages->sent_func(xmpp, priv->messages->user_data);
-
-        /* Note that the sent func might have called _clear() in which case all
-         * messages have already been removed. */
-        if(priv->messages != NULL)
-          inf_xmpp_connection_pop_message(xmpp);
+        return FALSE;
       }
     }
-  }
+  } while(stream->avail_in > 0 || stream->avail_out == 0);
 
-  g_object_unref(G_OBJECT(xmpp));
+  return TRUE;
 }
 
 static void
@@ -3180,7 +4672,8 @@ inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
 {
   InfXmppConnection* xmpp;
   InfXmppConnectionPrivate* priv;
-  gchar buffer[2048];
+  gsize filled;
+  gsize total;
   ssize_t res;
   GError* error;
   gboolean receiving;
@@ -3193,6 +4686,14 @@ inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
   if(priv->status == INF_XMPP_CONNECTION_CLOSING_GNUTLS)
     return;
 
+  /* The GnuTLS session is in use by a worker thread performing a handshake
+   * step. Keep the data until the step has finished. */
+  if(priv->tls_handshake_op != NULL)
+  {
+    g_byte_array_append(priv->tls_handshake_pending, data, len);
+    return;
+  }
+
   g_object_ref(xmpp);
 
   g_assert(priv->parsing == 0);
@@ -3227,57 +4728,113 @@ inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
     if(priv->session != NULL)
     {
       receiving = TRUE;
+      filled = 0;
+      total = 0;
+
+      /* Decrypt all records that are available and feed them to the XML
+       * parser in one go, instead of parsing each record on its own. */
       while(receiving && (priv->pull_len > 0 ||
                           gnutls_record_check_pending(priv->session) > 0))
       {
-        res = gnutls_record_recv(priv->session, buffer, 2048);
+        if(filled == priv->recv_alloc)
+        {
+          if(priv->recv_alloc < INF_XMPP_CONNECTION_RECV_MAX)
+          {
+            priv->recv_alloc *= 2;
+            priv->recv_buf = g_realloc(priv->recv_buf, priv->recv_alloc);
+          }
+          else
+          {
+            receiving = inf_xmpp_connection_process_received(
+              xmpp,
+              priv->recv_buf,
+              filled
+            );
+
+            filled = 0;
+            if(!receiving) break;
+          }
+        }
+
+        res = gnutls_record_recv(
+          priv->session,
+          priv->recv_buf + filled,
+          priv->recv_alloc - filled
+        );
+
         if(res < 0)
         {
           /* Just try again if we were interrupted */
           if(res != GNUTLS_E_INTERRUPTED && res != GNUTLS_E_AGAIN)
           {
+            /* Process what we got before the error occured */
+            if(filled > 0)
+            {
+              inf_xmpp_connection_process_received(
+                xmpp,
+                priv->recv_buf,
+                filled
+              );
+
+              filled = 0;
+            }
+
             /* A TLS error occured. */
-            error = NULL;
-            inf_gnutls_set_error(&error, res);
-            inf_xml_connection_error(INF_XML_CONNECTION(xmpp), error);
-            g_error_free(error);
-
-            /* We cannot assume that GnuTLS is working enough to send a
-             * final </stream:stream> or something, so just close the
-             * underlaying TCP connection. */
-            inf_tcp_connection_close(priv->tcp);
+            if(priv->status != INF_XMPP_CONNECTION_CLOSED)
+            {
+              error = NULL;
+              inf_gnutls_set_error(&error, res);
+              inf_xml_connection_error(INF_XML_CONNECTION(xmpp), error);
+              g_error_free(error);
+
+              /* We cannot assume that GnuTLS is working enough to send a
+               * final </stream:stream> or something, so just close the
+               * underlaying TCP connection. */
+              inf_tcp_connection_close(priv->tcp);
+            }
+
             receiving = FALSE;
           }
         }
         else if(res == 0)
         {
+          if(filled > 0)
+          {
+            inf_xmpp_connection_process_received(
+              xmpp,
+              priv->recv_buf,
+              filled
+            );
+            filled = 0;
+          }
+
           /* Remote site sent gnutls_bye. This involves session closure. */
-          inf_tcp_connection_close(priv->tcp);
+          if(priv->status != INF_XMPP_CONNECTION_CLOSED)
+            inf_tcp_connection_close(priv->tcp);
           receiving = FALSE;
         }
         else
         {
-          /* Feed decoded data into XML parser */
-          if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
-            printf("\033[00;32m%.*s\033[00;00m\n", (int)res, buffer);
-          xmlParseChunk(priv->parser, buffer, res, 0);
-
-          /* If the callback changed made us disconnect then don't try
-           * to read more data. */
-          if(priv->status == INF_XMPP_CONNECTION_CLOSING_GNUTLS ||
-             priv->status == INF_XMPP_CONNECTION_CLOSED)
-          {
-            receiving = FALSE;
-          }
+          filled += res;
+          total += res;
         }
       }
+
+      if(filled > 0)
+        inf_xmpp_connection_process_received(xmpp, priv->recv_buf, filled);
+
+      /* Shrink the buffer again if the connection became less busy */
+      if(priv->recv_alloc > INF_XMPP_CONNECTION_RECV_MIN &&
+         total < priv->recv_alloc / 4)
+      {
+        priv->recv_alloc /= 2;
+        priv->recv_buf = g_realloc(priv->recv_buf, priv->recv_alloc);
+      }
     }
     else
     {
       /* Feed input directly into XML parser */
-      if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
-        printf("\033[00;31m%.*s\033[00;00m\n", (int)len, (const char*)data);
-      xmlParseChunk(priv->parser, data, len, 0);
+      inf_xmpp_connection_process_received(xmpp, data, len);
     }
   }
 
@@ -3367,7 +4924,7 @@ inf_xmpp_connection_notify_status_cb(InfTcpConnection* tcp,
       g_assert(priv->session == NULL);
       g_assert(priv->messages == NULL);
       g_assert(priv->parser == NULL);
-      g_assert(priv->doc == NULL);
+      g_assert(priv->buf == NULL);
       g_assert(priv->position == 0);
       g_assert(priv->sasl_session == NULL);
     }
@@ -3543,6 +5100,7 @@ inf_xmpp_connection_get_xml_status(InfXmppConnection* xmpp)
   case INF_XMPP_CONNECTION_AWAITING_FEATURES:
   case INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES:
   case INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED:
+  case INF_XMPP_CONNECTION_COMPRESSION_REQUESTED:
   case INF_XMPP_CONNECTION_HANDSHAKING:
   case INF_XMPP_CONNECTION_AUTHENTICATING:
     return INF_XML_CONNECTION_OPENING;
@@ -3610,12 +5168,38 @@ inf_xmpp_connection_init(InfXmppConnection* connection)
   priv->messages = NULL;
   priv->last_message = NULL;
 
+  priv->flush_latency = 0;
+  priv->cork = g_byte_array_new();
+  priv->corked_messages = NULL;
+  priv->last_corked_message = NULL;
+  priv->cork_io = NULL;
+  priv->cork_timeout = NULL;
+  priv->flushing = 0;
+
+  priv->binary_frames = TRUE;
+  priv->remote_binary_frames = FALSE;
+  priv->frame_out = g_byte_array_new();
+  priv->frame_in = g_byte_array_new();
+  priv->frame_pending = FALSE;
+  priv->frame_sized = FALSE;
+  priv->frame_size = 0;
+  priv->frame_shift = 0;
+
+  priv->compression_level = 0;
+  priv->compression_threshold = 0;
+  priv->deflate = NULL;
+  priv->inflate = NULL;
+  priv->deflate_level = 0;
+  priv->deflate_buf = NULL;
+  priv->inflate_buf = NULL;
+  priv->remote_compression = FALSE;
+
   priv->parsing = 0;
   priv->parser = NULL;
+  priv->doc = NULL;
   priv->root = NULL;
   priv->cur = NULL;
 
-  priv->doc = NULL;
   priv->buf = NULL;
 
   priv->session = NULL;
@@ -3624,6 +5208,17 @@ inf_xmpp_connection_init(InfXmppConnection* connection)
   priv->peer_cert = NULL;
   priv->pull_data = NULL;
   priv->pull_len = 0;
+  priv->recv_buf = g_malloc(INF_XMPP_CONNECTION_RECV_MIN);
+  priv->recv_alloc = INF_XMPP_CONNECTION_RECV_MIN;
+  priv->tls_ticket_key = NULL;
+  priv->tls_session_data = NULL;
+  priv->tls_established = FALSE;
+  priv->tls_resumed = FALSE;
+  priv->tls_handshake_async = FALSE;
+  priv->tls_handshake_op = NULL;
+  priv->tls_handshake_pending = NULL;
+  priv->tls_handshake_finished = FALSE;
+  priv->tls_handshake_ret = 0;
 
   priv->sasl_context = NULL;
   priv->sasl_own_context = NULL;
@@ -3735,6 +5330,28 @@ inf_xmpp_connection_finalize(GObject* object)
   if(priv->sasl_error)
     g_error_free(priv->sasl_error);
 
+  g_free(priv->recv_buf);
+  g_byte_array_unref(priv->cork);
+  g_byte_array_unref(priv->frame_out);
+  g_byte_array_unref(priv->frame_in);
+
+  if(priv->deflate != NULL)
+  {
+    deflateEnd(priv->deflate);
+    inflateEnd(priv->inflate);
+    g_slice_free(z_stream, priv->deflate);
+    g_slice_free(z_stream, priv->inflate);
+  }
+
+  if(priv->deflate_buf != NULL)
+    g_byte_array_unref(priv->deflate_buf);
+  g_free(priv->inflate_buf);
+
+  if(priv->tls_ticket_key != NULL)
+    g_bytes_unref(priv->tls_ticket_key);
+  if(priv->tls_session_data != NULL)
+    g_bytes_unref(priv->tls_session_data);
+
   G_OBJECT_CLASS(inf_xmpp_connection_parent_class)->finalize(object);
 }
 
@@ -3826,6 +5443,31 @@ inf_xmpp_connection_set_property(GObject* object,
     g_free(priv->sasl_local_mechanisms);
     priv->sasl_local_mechanisms = g_value_dup_string(value);
     break;
+  case PROP_FLUSH_LATENCY:
+    priv->flush_latency = g_value_get_uint(value);
+    break;
+  case PROP_BINARY_FRAMES:
+    priv->binary_frames = g_value_get_boolean(value);
+    break;
+  case PROP_COMPRESSION_LEVEL:
+    priv->compression_level = g_value_get_uint(value);
+    break;
+  case PROP_COMPRESSION_THRESHOLD:
+    priv->compression_threshold = g_value_get_uint(value);
+    break;
+  case PROP_TLS_SESSION_DATA:
+    if(priv->tls_session_data != NULL)
+      g_bytes_unref(priv->tls_session_data);
+    priv->tls_session_data = g_value_dup_boxed(value);
+    break;
+  case PROP_TLS_SESSION_TICKET_KEY:
+    if(priv->tls_ticket_key != NULL)
+      g_bytes_unref(priv->tls_ticket_key);
+    priv->tls_ticket_key = g_value_dup_boxed(value);
+    break;
+  case PROP_TLS_HANDSHAKE_ASYNC:
+    priv->tls_handshake_async = g_value_get_boolean(value);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -3867,6 +5509,18 @@ inf_xmpp_connection_get_property(GObject* object,
   case PROP_TLS_ENABLED:
     g_value_set_boolean(value, inf_xmpp_connection_get_tls_enabled(xmpp));
     break;
+  case PROP_TLS_RESUMED:
+    g_value_set_boolean(value, priv->tls_resumed);
+    break;
+  case PROP_TLS_SESSION_DATA:
+    g_value_set_boxed(value, priv->tls_session_data);
+    break;
+  case PROP_TLS_SESSION_TICKET_KEY:
+    g_value_set_boxed(value, priv->tls_ticket_key);
+    break;
+  case PROP_TLS_HANDSHAKE_ASYNC:
+    g_value_set_boolean(value, priv->tls_handshake_async);
+    break;
   case PROP_CREDENTIALS:
     g_value_set_boxed(value, priv->creds);
     break;
@@ -3876,6 +5530,21 @@ inf_xmpp_connection_get_property(GObject* object,
   case PROP_SASL_MECHANISMS:
     g_value_set_string(value, priv->sasl_local_mechanisms);
     break;
+  case PROP_FLUSH_LATENCY:
+    g_value_set_uint(value, priv->flush_latency);
+    break;
+  case PROP_BINARY_FRAMES:
+    g_value_set_boolean(value, priv->binary_frames);
+    break;
+  case PROP_COMPRESSION_LEVEL:
+    g_value_set_uint(value, priv->compression_level);
+    break;
+  case PROP_COMPRESSION_THRESHOLD:
+    g_value_set_uint(value, priv->compression_threshold);
+    break;
+  case PROP_COMPRESSION_ENABLED:
+    g_value_set_boolean(value, priv->deflate != NULL);
+    break;
   case PROP_STATUS:
     g_value_set_enum(value, inf_xmpp_connection_get_xml_status(xmpp));
     break;
@@ -3985,9 +5654,12 @@ inf_xmpp_connection_xml_connection_close(InfXmlConnection* connection)
      * and then close the connection regularly. */
     /* I don't think we can do more here to make the closure more
      * explicit */
-    g_assert(priv->session != NULL);
-    gnutls_deinit(priv->session);
-    priv->session = NULL;
+    inf_xmpp_connection_tls_handshake_cancel(INF_XMPP_CONNECTION(connection));
+    if(priv->session != NULL)
+    {
+      gnutls_deinit(priv->session);
+      priv->session = NULL;
+    }
     /* This will cause a status property notify which will actually set
      * the xmpp status */
     inf_tcp_connection_close(priv->tcp);
@@ -4006,6 +5678,7 @@ inf_xmpp_connection_xml_connection_close(InfXmlConnection* connection)
   case INF_XMPP_CONNECTION_AUTH_INITIATED:
   case INF_XMPP_CONNECTION_AWAITING_FEATURES:
   case INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES:
+  case INF_XMPP_CONNECTION_COMPRESSION_REQUESTED:
   case INF_XMPP_CONNECTION_READY:
     inf_xmpp_connection_deinitiate(INF_XMPP_CONNECTION(connection));
     break;
@@ -4024,7 +5697,7 @@ inf_xmpp_connection_xml_connection_send(InfXmlConnection* connection,
 
   g_assert(priv->status == INF_XMPP_CONNECTION_READY);
 
-  inf_xmpp_connection_send_xml(INF_XMPP_CONNECTION(connection), xml);
+  inf_xmpp_connection_write_xml(INF_XMPP_CONNECTION(connection), xml, TRUE);
 
   /* It can happen that while calling inf_xmpp_connection_send_xml we
    * notice that the connection is down. Only proceed with sent notification
@@ -4044,6 +5717,75 @@ inf_xmpp_connection_xml_connection_send(InfXmlConnection* connection,
   }
 }
 
+static void
+inf_xmpp_connection_xml_connection_send_serialized_sent(
+  InfXmppConnection* xmpp,
+  gpointer user_data)
+{
+  InfXmppConnectionSerialized* serialized;
+  serialized = (InfXmppConnectionSerialized*)user_data;
+
+  inf_xml_connection_sent(INF_XML_CONNECTION(xmpp), serialized->xml);
+}
+
+static void
+inf_xmpp_connection_xml_connection_send_serialized_free(
+  InfXmppConnection* xmpp,
+  gpointer user_data)
+{
+  InfXmppConnectionSerialized* serialized;
+  serialized = (InfXmppConnectionSerialized*)user_data;
+
+  g_bytes_unref(serialized->bytes);
+  g_slice_free(InfXmppConnectionSerialized, serialized);
+}
+
+static void
+inf_xmpp_connection_xml_connection_send_serialized(InfXmlConnection* conn,
+                                                   xmlNodePtr xml,
+                                                   GBytes* bytes)
+{
+  InfXmppConnection* xmpp;
+  InfXmppConnectionPrivate* priv;
+  InfXmppConnectionSerialized* serialized;
+  gconstpointer data;
+  gsize len;
+
+  xmpp = INF_XMPP_CONNECTION(conn);
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  g_assert(priv->status == INF_XMPP_CONNECTION_READY);
+
+  g_object_ref(xmpp);
+
+  /* The serialized message is shared with other connections. It is handed
+   * to GnuTLS or the TCP connection directly, without copying it into our
+   * own buffer first. If we can send a binary frame instead, it is encoded
+   * into our own frame buffer, as for inf_xml_connection_send(), since the
+   * connections sending the message do not share any state. */
+  if(!inf_xmpp_connection_write_frame(xmpp, xml))
+  {
+    data = g_bytes_get_data(bytes, &len);
+    inf_xmpp_connection_cork_chars(xmpp, data, len);
+  }
+
+  if(priv->status == INF_XMPP_CONNECTION_READY)
+  {
+    serialized = g_slice_new(InfXmppConnectionSerialized);
+    serialized->xml = xml;
+    serialized->bytes = g_bytes_ref(bytes);
+
+    inf_xmpp_connection_push_message(
+      xmpp,
+      inf_xmpp_connection_xml_connection_send_serialized_sent,
+      inf_xmpp_connection_xml_connection_send_serialized_free,
+      serialized
+    );
+  }
+
+  g_object_unref(xmpp);
+}
+
 /*
  * GObject type registration
  */
@@ -4142,6 +5884,58 @@ inf_xmpp_connection_class_init(InfXmppConnectionClass* xmpp_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_TLS_RESUMED,
+    g_param_spec_boolean(
+      "tls-resumed",
+      "TLS resumed",
+      "Whether the TLS session was resumed from a previous session instead "
+      "of performing a full handshake",
+      FALSE,
+      G_PARAM_READABLE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_TLS_SESSION_DATA,
+    g_param_spec_boxed(
+      "tls-session-data",
+      "TLS session data",
+      "Data of a previous TLS session with the server that the client tries "
+      "to resume. Updated when the TLS session of the connection ends",
+      G_TYPE_BYTES,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_TLS_SESSION_TICKET_KEY,
+    g_param_spec_boxed(
+      "tls-session-ticket-key",
+      "TLS session ticket key",
+      "Key with which the server encrypts TLS session tickets. If not set, "
+      "no session tickets are issued",
+      G_TYPE_BYTES,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_TLS_HANDSHAKE_ASYNC,
+    g_param_spec_boolean(
+      "tls-handshake-async",
+      "TLS handshake asynchronous",
+      "Whether to perform the TLS handshake in a worker thread instead of "
+      "blocking the thread of the connection",
+      FALSE,
+      G_PARAM_READWRITE
+    )
+  );
+
   g_object_class_install_property(
     object_class,
     PROP_CREDENTIALS,
@@ -4178,6 +5972,78 @@ inf_xmpp_connection_class_init(InfXmppConnectionClass* xmpp_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_FLUSH_LATENCY,
+    g_param_spec_uint(
+      "flush-latency",
+      "Flush latency",
+      "Time in microseconds for which outgoing messages are held back to "
+      "be written together with subsequent ones, or 0 to write them "
+      "immediately",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_BINARY_FRAMES,
+    g_param_spec_boolean(
+      "binary-frames",
+      "Binary frames",
+      "Whether to accept frequent messages in a compact binary form, and "
+      "to send them that way if the remote site accepts them as well",
+      TRUE,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSION_LEVEL,
+    g_param_spec_uint(
+      "compression-level",
+      "Compression level",
+      "The zlib compression level from 1 to 9 with which to compress the "
+      "stream if the remote site supports it, or 0 to not compress it. "
+      "Changes take effect when the stream is established the next time",
+      0,
+      9,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSION_THRESHOLD,
+    g_param_spec_uint(
+      "compression-threshold",
+      "Compression threshold",
+      "Writes to a compressed stream smaller than this number of bytes are "
+      "sent without actually compressing them",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSION_ENABLED,
+    g_param_spec_boolean(
+      "compression-enabled",
+      "Compression enabled",
+      "Whether the stream is compressed or not",
+      FALSE,
+      G_PARAM_READABLE
+    )
+  );
+
   g_object_class_override_property(object_class, PROP_STATUS, "status");
   g_object_class_override_property(object_class, PROP_NETWORK, "network");
   g_object_class_override_property(object_class, PROP_LOCAL_ID, "local-id");
@@ -4203,6 +6069,7 @@ inf_xmpp_connection_xml_connection_iface_init(
   iface->open = inf_xmpp_connection_xml_connection_open;
   iface->close = inf_xmpp_connection_xml_connection_close;
   iface->send = inf_xmpp_connection_xml_connection_send;
+  iface->send_serialized = inf_xmpp_connection_xml_connection_send_serialized;
 }
 
 /*
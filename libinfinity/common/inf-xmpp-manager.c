@@ -51,6 +51,12 @@
  * name resolver. Once the hostname has been looked up, and if another
  * connection with the same address and port number exists already, the new
  * connection is removed in favor of the already existing one.
+ *
+ * In addition, the XMPP manager remembers the TLS sessions of the client
+ * connections it contains, by the hostname and port of the remote host.
+ * When a new connection to the same host and port is added, it is given the
+ * session to resume, so that it can skip the full TLS handshake if the
+ * server still accepts the session.
  */
 
 typedef enum _InfXmppManagerKeyKind {
@@ -89,6 +95,18 @@ struct _InfXmppManagerConnectionInfo {
 typedef struct _InfXmppManagerPrivate InfXmppManagerPrivate;
 struct _InfXmppManagerPrivate {
   GTree* connections;
+
+  /* TLS session data by remote hostname and port */
+  GHashTable* tls_sessions;
+  guint tls_full_handshakes;
+  guint tls_resumed_handshakes;
+};
+
+enum {
+  PROP_0,
+
+  PROP_TLS_FULL_HANDSHAKES,
+  PROP_TLS_RESUMED_HANDSHAKES
 };
 
 enum {
@@ -616,6 +634,151 @@ inf_xmpp_manager_notify_resolver_cb(GObject* object,
   inf_xmpp_manager_update_keys(info->manager, info, TRUE);
 }
 
+/* Returns the key under which the TLS session of xmpp is cached, or NULL if
+ * the remote host or port is not known (yet). Several servers can run on
+ * the same host, and a session can only be resumed with the server which
+ * issued it, so the port is part of the key. */
+static gchar*
+inf_xmpp_manager_tls_session_key(InfXmppConnection* xmpp)
+{
+  InfTcpConnection* tcp;
+  gchar* hostname;
+  guint port;
+  gchar* key;
+
+  g_object_get(
+    G_OBJECT(xmpp),
+    "tcp-connection", &tcp,
+    "remote-hostname", &hostname,
+    NULL
+  );
+
+  port = inf_tcp_connection_get_remote_port(tcp);
+  g_object_unref(tcp);
+
+  key = NULL;
+  if(hostname != NULL && port != 0)
+    key = g_strdup_printf("%s:%u", hostname, port);
+
+  g_free(hostname);
+  return key;
+}
+
+/* Lets a client connection resume an earlier session with the same server,
+ * if it does not have a session to resume already. */
+static void
+inf_xmpp_manager_resume_tls_session(InfXmppManager* manager,
+                                    InfXmppConnection* xmpp)
+{
+  InfXmppManagerPrivate* priv;
+  InfXmppConnectionSite site;
+  GBytes* data;
+  gchar* key;
+
+  priv = INF_XMPP_MANAGER_PRIVATE(manager);
+
+  g_object_get(
+    G_OBJECT(xmpp),
+    "site", &site,
+    "tls-session-data", &data,
+    NULL
+  );
+
+  if(data != NULL)
+  {
+    g_bytes_unref(data);
+    return;
+  }
+
+  if(site != INF_XMPP_CONNECTION_CLIENT)
+    return;
+
+  key = inf_xmpp_manager_tls_session_key(xmpp);
+  if(key != NULL)
+  {
+    data = g_hash_table_lookup(priv->tls_sessions, key);
+    if(data != NULL)
+      g_object_set(G_OBJECT(xmpp), "tls-session-data", data, NULL);
+    g_free(key);
+  }
+}
+
+static void
+inf_xmpp_manager_notify_remote_port_cb(GObject* object,
+                                       GParamSpec* pspec,
+                                       gpointer user_data)
+{
+  InfXmppManagerConnectionInfo* info;
+  info = (InfXmppManagerConnectionInfo*)user_data;
+
+  /* With a name resolver, the port is only known once the hostname has
+   * been resolved, which is still before the TLS handshake. */
+  inf_xmpp_manager_resume_tls_session(info->manager, info->xmpp);
+}
+
+static void
+inf_xmpp_manager_notify_tls_session_data_cb(GObject* object,
+                                            GParamSpec* pspec,
+                                            gpointer user_data)
+{
+  InfXmppManagerConnectionInfo* info;
+  InfXmppManagerPrivate* priv;
+  gchar* key;
+  GBytes* data;
+
+  info = (InfXmppManagerConnectionInfo*)user_data;
+  priv = INF_XMPP_MANAGER_PRIVATE(info->manager);
+
+  g_object_get(object, "tls-session-data", &data, NULL);
+  key = inf_xmpp_manager_tls_session_key(info->xmpp);
+
+  if(key != NULL && data != NULL)
+  {
+    /* Takes ownership of both */
+    g_hash_table_insert(priv->tls_sessions, key, data);
+  }
+  else
+  {
+    g_free(key);
+    if(data != NULL) g_bytes_unref(data);
+  }
+}
+
+static void
+inf_xmpp_manager_notify_tls_enabled_cb(GObject* object,
+                                       GParamSpec* pspec,
+                                       gpointer user_data)
+{
+  InfXmppManagerConnectionInfo* info;
+  InfXmppManagerPrivate* priv;
+  gboolean tls_enabled;
+  gboolean tls_resumed;
+
+  info = (InfXmppManagerConnectionInfo*)user_data;
+  priv = INF_XMPP_MANAGER_PRIVATE(info->manager);
+
+  g_object_get(
+    object,
+    "tls-enabled", &tls_enabled,
+    "tls-resumed", &tls_resumed,
+    NULL
+  );
+
+  if(tls_enabled == TRUE)
+  {
+    if(tls_resumed == TRUE)
+    {
+      ++priv->tls_resumed_handshakes;
+      g_object_notify(G_OBJECT(info->manager), "tls-resumed-handshakes");
+    }
+    else
+    {
+      ++priv->tls_full_handshakes;
+      g_object_notify(G_OBJECT(info->manager), "tls-full-handshakes");
+    }
+  }
+}
+
 static InfXmppManagerConnectionInfo*
 inf_xmpp_manager_connection_info_new(InfXmppManager* manager,
                                      InfXmppConnection* xmpp)
@@ -627,6 +790,8 @@ inf_xmpp_manager_connection_info_new(InfXmppManager* manager,
   g_object_get(G_OBJECT(xmpp), "tcp-connection", &tcp, NULL);
   g_assert(tcp != NULL);
 
+  inf_xmpp_manager_resume_tls_session(manager, xmpp);
+
   info = g_slice_new(InfXmppManagerConnectionInfo);
   info->manager = manager;
   info->xmpp = xmpp;
@@ -656,6 +821,27 @@ inf_xmpp_manager_connection_info_new(InfXmppManager* manager,
     info
   );
 
+  g_signal_connect(
+    G_OBJECT(tcp),
+    "notify::remote-port",
+    G_CALLBACK(inf_xmpp_manager_notify_remote_port_cb),
+    info
+  );
+
+  g_signal_connect(
+    G_OBJECT(xmpp),
+    "notify::tls-session-data",
+    G_CALLBACK(inf_xmpp_manager_notify_tls_session_data_cb),
+    info
+  );
+
+  g_signal_connect(
+    G_OBJECT(xmpp),
+    "notify::tls-enabled",
+    G_CALLBACK(inf_xmpp_manager_notify_tls_enabled_cb),
+    info
+  );
+
   g_object_get(G_OBJECT(tcp), "resolver", &resolver, NULL);
 
   if(resolver != NULL)
@@ -690,6 +876,24 @@ inf_xmpp_manager_connection_info_free(InfXmppManagerConnectionInfo* info)
     info
   );
 
+  inf_signal_handlers_disconnect_by_func(
+    tcp,
+    G_CALLBACK(inf_xmpp_manager_notify_remote_port_cb),
+    info
+  );
+
+  inf_signal_handlers_disconnect_by_func(
+    info->xmpp,
+    G_CALLBACK(inf_xmpp_manager_notify_tls_session_data_cb),
+    info
+  );
+
+  inf_signal_handlers_disconnect_by_func(
+    info->xmpp,
+    G_CALLBACK(inf_xmpp_manager_notify_tls_enabled_cb),
+    info
+  );
+
   g_object_unref(tcp);
   g_object_unref(info->xmpp);
   g_free(info->keys);
@@ -722,6 +926,16 @@ inf_xmpp_manager_init(InfXmppManager* manager)
     inf_xmpp_manager_key_free,
     NULL
   );
+
+  priv->tls_sessions = g_hash_table_new_full(
+    g_str_hash,
+    g_str_equal,
+    g_free,
+    (GDestroyNotify)g_bytes_unref
+  );
+
+  priv->tls_full_handshakes = 0;
+  priv->tls_resumed_handshakes = 0;
 }
 
 static void
@@ -745,6 +959,40 @@ inf_xmpp_manager_dispose(GObject* object)
   G_OBJECT_CLASS(inf_xmpp_manager_parent_class)->dispose(object);
 }
 
+static void
+inf_xmpp_manager_finalize(GObject* object)
+{
+  InfXmppManagerPrivate* priv;
+  priv = INF_XMPP_MANAGER_PRIVATE(object);
+
+  g_hash_table_destroy(priv->tls_sessions);
+
+  G_OBJECT_CLASS(inf_xmpp_manager_parent_class)->finalize(object);
+}
+
+static void
+inf_xmpp_manager_get_property(GObject* object,
+                              guint prop_id,
+                              GValue* value,
+                              GParamSpec* pspec)
+{
+  InfXmppManagerPrivate* priv;
+  priv = INF_XMPP_MANAGER_PRIVATE(object);
+
+  switch(prop_id)
+  {
+  case PROP_TLS_FULL_HANDSHAKES:
+    g_value_set_uint(value, priv->tls_full_handshakes);
+    break;
+  case PROP_TLS_RESUMED_HANDSHAKES:
+    g_value_set_uint(value, priv->tls_resumed_handshakes);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
 static void
 inf_xmpp_manager_class_init(InfXmppManagerClass* xmpp_manager_class)
 {
@@ -752,9 +1000,41 @@ inf_xmpp_manager_class_init(InfXmppManagerClass* xmpp_manager_class)
   object_class = G_OBJECT_CLASS(xmpp_manager_class);
 
   object_class->dispose = inf_xmpp_manager_dispose;
+  object_class->finalize = inf_xmpp_manager_finalize;
+  object_class->get_property = inf_xmpp_manager_get_property;
   xmpp_manager_class->connection_added = NULL;
   xmpp_manager_class->connection_removed = NULL;
 
+  g_object_class_install_property(
+    object_class,
+    PROP_TLS_FULL_HANDSHAKES,
+    g_param_spec_uint(
+      "tls-full-handshakes",
+      "TLS full handshakes",
+      "The number of TLS handshakes of the contained connections that "
+      "established a new session",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_TLS_RESUMED_HANDSHAKES,
+    g_param_spec_uint(
+      "tls-resumed-handshakes",
+      "TLS resumed handshakes",
+      "The number of TLS handshakes of the contained connections that "
+      "resumed a previous session",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
   /**
    * InfXmppManager::connection-added:
    * @xmpp_manager: The #InfXmppManager emitting the signal.
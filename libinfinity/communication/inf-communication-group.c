@@ -706,6 +706,56 @@ inf_communication_group_send_message(InfCommunicationGroup* group,
   inf_communication_method_send_single(method, connection, xml);
 }
 
+/**
+ * inf_communication_group_send_stream:
+ * @group: A #InfCommunicationGroup.
+ * @connection: The #InfXmlConnection to which to send the messages.
+ * @func: (scope notified): Function producing the messages to send.
+ * @user_data: Additional data to pass to @func.
+ * @notify: (allow-none): Function called to free @user_data, or %NULL.
+ *
+ * Sends all messages returned by @func, until it returns %NULL, to
+ * @connection which must be a member of @group. This behaves as if
+ * inf_communication_group_send_message() was called for every message in
+ * turn, but the messages are produced only when they are about to be sent.
+ * This allows sending a large amount of data without having all of it in
+ * memory at the same time. Messages sent to @connection afterwards are
+ * sent after all of the messages produced by @func.
+ *
+ * @func must not send messages on @group itself. @notify is called when
+ * no more messages are going to be produced, either because @func returned
+ * %NULL or because the messages were cancelled with
+ * inf_communication_group_cancel_messages().
+ */
+void
+inf_communication_group_send_stream(InfCommunicationGroup* group,
+                                    InfXmlConnection* connection,
+                                    InfCommunicationStreamFunc func,
+                                    gpointer user_data,
+                                    GDestroyNotify notify)
+{
+  InfCommunicationMethod* method;
+
+  g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+  g_return_if_fail(func != NULL);
+
+  method = inf_communication_group_lookup_method_for_connection(
+    group,
+    connection
+  );
+
+  g_return_if_fail(method != NULL);
+
+  inf_communication_method_send_stream(
+    method,
+    connection,
+    func,
+    user_data,
+    notify
+  );
+}
+
 /**
  * inf_communication_group_send_group_message:
  * @group: A #InfCommunicationGroup.
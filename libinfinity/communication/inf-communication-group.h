@@ -22,6 +22,7 @@
 
 #include <libinfinity/common/inf-xml-connection.h>
 #include <libinfinity/communication/inf-communication-object.h>
+#include <libinfinity/communication/inf-communication-method.h>
 
 #include <glib-object.h>
 
@@ -104,6 +105,13 @@ inf_communication_group_send_message(InfCommunicationGroup* group,
                                      InfXmlConnection* connection,
                                      xmlNodePtr xml);
 
+void
+inf_communication_group_send_stream(InfCommunicationGroup* group,
+                                    InfXmlConnection* connection,
+                                    InfCommunicationStreamFunc func,
+                                    gpointer user_data,
+                                    GDestroyNotify notify);
+
 void
 inf_communication_group_send_group_message(InfCommunicationGroup* group,
                                            xmlNodePtr xml);
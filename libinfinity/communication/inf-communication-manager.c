@@ -32,6 +32,7 @@
 
 #include <libinfinity/communication/inf-communication-manager.h>
 #include <libinfinity/communication/inf-communication-central-factory.h>
+#include <libinfinity/common/inf-io.h>
 
 #include <string.h>
 
@@ -55,6 +56,12 @@ struct _InfCommunicationManagerPrivate {
   GHashTable* joined_groups;
 };
 
+enum {
+  PROP_0,
+
+  PROP_IO
+};
+
 #define INF_COMMUNICATION_MANAGER_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_COMMUNICATION_TYPE_MANAGER, InfCommunicationManagerPrivate))
 
 G_DEFINE_TYPE_WITH_CODE(InfCommunicationManager, inf_communication_manager, G_TYPE_OBJECT,
@@ -235,6 +242,52 @@ inf_communication_manager_dispose(GObject* object)
   G_OBJECT_CLASS(inf_communication_manager_parent_class)->dispose(object);
 }
 
+static void
+inf_communication_manager_set_property(GObject* object,
+                                       guint prop_id,
+                                       const GValue* value,
+                                       GParamSpec* pspec)
+{
+  InfCommunicationManager* manager;
+  InfCommunicationManagerPrivate* priv;
+
+  manager = INF_COMMUNICATION_MANAGER(object);
+  priv = INF_COMMUNICATION_MANAGER_PRIVATE(manager);
+
+  switch(prop_id)
+  {
+  case PROP_IO:
+    g_object_set_property(G_OBJECT(priv->registry), "io", value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+inf_communication_manager_get_property(GObject* object,
+                                       guint prop_id,
+                                       GValue* value,
+                                       GParamSpec* pspec)
+{
+  InfCommunicationManager* manager;
+  InfCommunicationManagerPrivate* priv;
+
+  manager = INF_COMMUNICATION_MANAGER(object);
+  priv = INF_COMMUNICATION_MANAGER_PRIVATE(manager);
+
+  switch(prop_id)
+  {
+  case PROP_IO:
+    g_object_get_property(G_OBJECT(priv->registry), "io", value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
 static void
 inf_communication_manager_class_init(
   InfCommunicationManagerClass* manager_class)
@@ -243,6 +296,21 @@ inf_communication_manager_class_init(
   object_class = G_OBJECT_CLASS(manager_class);
 
   object_class->dispose = inf_communication_manager_dispose;
+  object_class->set_property = inf_communication_manager_set_property;
+  object_class->get_property = inf_communication_manager_get_property;
+
+  g_object_class_install_property(
+    object_class,
+    PROP_IO,
+    g_param_spec_object(
+      "io",
+      "IO",
+      "The main loop from which to close connections which do not receive "
+      "the messages sent to them fast enough",
+      INF_TYPE_IO,
+      G_PARAM_READWRITE
+    )
+  );
 }
 
 /**
@@ -210,6 +210,53 @@ inf_communication_method_send_all(InfCommunicationMethod* method,
   iface->send_all(method, xml);
 }
 
+/**
+ * inf_communication_method_send_stream:
+ * @method: A #InfCommunicationMethod.
+ * @connection: A #InfXmlConnection that is a group member.
+ * @func: (scope notified): Function producing the messages to send.
+ * @user_data: Additional data to pass to @func.
+ * @notify: (allow-none): Function called to free @user_data, or %NULL.
+ *
+ * Sends all messages returned by @func, until it returns %NULL, to
+ * @connection. If the method supports it, @func is only called when the
+ * messages are about to be sent, so that not all of them need to be kept in
+ * memory at the same time. @notify is called when no more messages are
+ * going to be produced.
+ */
+void
+inf_communication_method_send_stream(InfCommunicationMethod* method,
+                                     InfXmlConnection* connection,
+                                     InfCommunicationStreamFunc func,
+                                     gpointer user_data,
+                                     GDestroyNotify notify)
+{
+  InfCommunicationMethodInterface* iface;
+  xmlNodePtr xml;
+
+  g_return_if_fail(INF_COMMUNICATION_IS_METHOD(method));
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+  g_return_if_fail(inf_communication_method_is_member(method, connection));
+  g_return_if_fail(func != NULL);
+
+  iface = INF_COMMUNICATION_METHOD_GET_IFACE(method);
+
+  if(iface->send_stream != NULL)
+  {
+    iface->send_stream(method, connection, func, user_data, notify);
+  }
+  else
+  {
+    g_return_if_fail(iface->send_single != NULL);
+
+    while( (xml = func(user_data)) != NULL)
+      iface->send_single(method, connection, xml);
+
+    if(notify != NULL)
+      notify(user_data);
+  }
+}
+
 /**
  * inf_communication_method_cancel_messages:
  * @method: A #InfCommunicationMethod.
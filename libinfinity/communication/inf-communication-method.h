@@ -43,6 +43,18 @@ G_BEGIN_DECLS
 typedef struct _InfCommunicationMethod InfCommunicationMethod;
 typedef struct _InfCommunicationMethodInterface InfCommunicationMethodInterface;
 
+/**
+ * InfCommunicationStreamFunc:
+ * @user_data: User data passed along with the function.
+ *
+ * Produces the next message of a sequence of messages sent with
+ * inf_communication_group_send_stream().
+ *
+ * Returns: (transfer full): The next message to send, or %NULL if there
+ * are no more messages.
+ */
+typedef xmlNodePtr(*InfCommunicationStreamFunc)(gpointer user_data);
+
 /**
  * InfCommunicationMethodInterface:
  * @add_member: Default signal handler of the
@@ -62,6 +74,10 @@ typedef struct _InfCommunicationMethodInterface InfCommunicationMethodInterface;
  * @enqueued: Handles when a message has been enqueued to be sent on a
  * registered connection.
  * @sent: Handles when a message has been sent to a registered connection.
+ * @send_stream: Sends the messages produced by @func to a single
+ * connection, calling @func only when the messages are about to be sent.
+ * If this is %NULL, then all messages are produced at once and sent with
+ * @send_single.
  *
  * The default signal handlers of virtual methods of #InfCommunicationMethod.
  * These implement communication within a #InfCommunicationGroup.
@@ -98,6 +114,12 @@ struct _InfCommunicationMethodInterface {
   void (*sent)(InfCommunicationMethod* method,
                InfXmlConnection* connection,
                xmlNodePtr xml);
+
+  void (*send_stream)(InfCommunicationMethod* method,
+                      InfXmlConnection* connection,
+                      InfCommunicationStreamFunc func,
+                      gpointer user_data,
+                      GDestroyNotify notify);
 };
 
 GType
@@ -124,6 +146,13 @@ void
 inf_communication_method_send_all(InfCommunicationMethod* method,
                                   xmlNodePtr xml);
 
+void
+inf_communication_method_send_stream(InfCommunicationMethod* method,
+                                     InfXmlConnection* connection,
+                                     InfCommunicationStreamFunc func,
+                                     gpointer user_data,
+                                     GDestroyNotify notify);
+
 void
 inf_communication_method_cancel_messages(InfCommunicationMethod* method,
                                          InfXmlConnection* connection);
@@ -34,11 +34,25 @@
  * inf_communication_method_enqueued() when sending the message cannot be
  * cancelled anymore via inf_communication_registry_cancel_messages() and
  * inf_communication_method_sent() when the message has been sent.
+ *
+ * Messages are passed to the connection in batches, each message within
+ * its own &lt;group&gt; container, which is shared with all other connections
+ * the message is sent to. The size of a batch
+ * adapts to how fast the connection sends out its data: It grows up to
+ * #InfCommunicationRegistry:max-window messages while batches are sent
+ * within #InfCommunicationRegistry:fast-ack-time, and shrinks again when
+ * the connection builds up a backlog. Messages that do not fit into the
+ * current batch remain in the registry's queue, and the
+ * #InfCommunicationRegistry::queue-overflow signal is emitted when that
+ * queue, together with the batches not yet sent by the connection, grows
+ * beyond #InfCommunicationRegistry:max-queue-bytes, which is 16 MiB by
+ * default.
  **/
 
 #include <libinfinity/communication/inf-communication-registry.h>
 #include <libinfinity/communication/inf-communication-group-private.h>
 #include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-io.h>
 #include <libinfinity/inf-signals.h>
 
 #include <string.h>
@@ -58,21 +72,97 @@ struct _InfCommunicationRegistryEntry {
   InfCommunicationRegistry* registry;
   InfCommunicationRegistryKey key;
   const gchar* publisher_string;
+  gchar* header; /* serialized opening tag of the <group> container */
 
   InfCommunicationGroup* group;
   InfCommunicationMethod* method;
 
   /* Queue of messages to send */
   guint inner_count;
-  xmlNodePtr queue_begin;
-  xmlNodePtr queue_end;
+  gsize inner_bytes;
+  GQueue queue; /* InfCommunicationRegistryMessage* */
+  gsize queue_bytes;
+
+  /* Set when the queue overflowed and the default handler of the
+   * queue-overflow signal ran. Further messages are dropped. */
+  gboolean overflowed;
+
+  /* Send window, in messages, adapted to how fast the connection
+   * acknowledges the batches passed to it. */
+  guint window;
+  GQueue inflight; /* InfCommunicationRegistryBatch* */
 
   /* Activation status */
   gboolean registered;
   guint activation_count; /* # messages to be sent until activation */
 
-  xmlNodePtr enqueued_list;
-  xmlNodePtr sent_list;
+  /* Batches waiting to be passed to the connection, and sent containers
+   * waiting to be processed, if send_real() or sent_cb() run
+   * recursively. */
+  gboolean enqueuing;
+  GQueue enqueued_list; /* InfCommunicationRegistryBatch* */
+  gboolean sending;
+  GQueue sent_list; /* xmlNodePtr */
+};
+
+/* A message scheduled to be sent to one or more connections. If the same
+ * message is sent to many connections, such as for group broadcasts, then
+ * all of them share the same message object, so that it neither needs to be
+ * copied nor serialized more than once. A message can also be a stream,
+ * in which case it stands for all messages that stream_func produces. */
+typedef struct _InfCommunicationRegistryMessage
+  InfCommunicationRegistryMessage;
+struct _InfCommunicationRegistryMessage {
+  guint ref_count;
+  xmlNodePtr xml;
+
+  InfCommunicationStreamFunc stream_func;
+  gpointer stream_data;
+  GDestroyNotify stream_notify;
+
+  /* A <group> container with xml as its only child, and its serialization,
+   * created when the message is queued for the first time. Once set,
+   * serialized owns the container, which in turn owns xml. bytes refers to
+   * the part of serialized that makes up xml itself. */
+  gchar* header;
+  GBytes* serialized;
+  GBytes* bytes;
+
+  /* Containers for connections that need a different <group> header than
+   * the one above, one per header. */
+  GSList* variants; /* InfCommunicationRegistryVariant* */
+};
+
+/* A copy of a message in a container with another header, for connections
+ * to which the group's publisher is named differently. The serialization is
+ * made from the message's bytes, without serializing it again. */
+typedef struct _InfCommunicationRegistryVariant
+  InfCommunicationRegistryVariant;
+struct _InfCommunicationRegistryVariant {
+  gchar* header;
+  xmlNodePtr container;
+  GBytes* serialized; /* owns container */
+};
+
+typedef struct _InfCommunicationRegistrySerialized
+  InfCommunicationRegistrySerialized;
+struct _InfCommunicationRegistrySerialized {
+  xmlNodePtr container;
+  GBytes* bytes;
+};
+
+/* One or more messages passed to a connection at once. Each message is
+ * passed in the container it shares with other connections. Once passed,
+ * the batch stays in the entry's inflight queue until the connection
+ * reports all of its messages as sent. */
+typedef struct _InfCommunicationRegistryBatch InfCommunicationRegistryBatch;
+struct _InfCommunicationRegistryBatch {
+  GPtrArray* messages; /* InfCommunicationRegistryMessage* */
+  guint n_sent;
+
+  gsize size;
+  gboolean limited; /* whether the window held back further messages */
+  gint64 time;
 };
 
 typedef struct _InfCommunicationRegistryForeachMethodData
@@ -82,32 +172,193 @@ struct _InfCommunicationRegistryForeachMethodData {
   xmlNodePtr xml;
 };
 
+/* A connection which overflowed and is to be closed from the main loop */
+typedef struct _InfCommunicationRegistryClose InfCommunicationRegistryClose;
+struct _InfCommunicationRegistryClose {
+  InfCommunicationRegistry* registry;
+  InfXmlConnection* connection;
+  InfIoDispatch* dispatch;
+};
+
 typedef struct _InfCommunicationRegistryPrivate
   InfCommunicationRegistryPrivate;
 struct _InfCommunicationRegistryPrivate {
+  InfIo* io;
   GHashTable* connections;
   GHashTable* entries;
+  GSList* closes; /* InfCommunicationRegistryClose* */
+
+  guint initial_window;
+  guint max_window;
+  guint max_window_bytes;
+  guint fast_ack_time;
+  guint64 max_queue_bytes;
+};
+
+enum {
+  PROP_0,
+
+  PROP_IO,
+
+  PROP_INITIAL_WINDOW,
+  PROP_MAX_WINDOW,
+  PROP_MAX_WINDOW_BYTES,
+  PROP_FAST_ACK_TIME,
+  PROP_MAX_QUEUE_BYTES
+};
+
+enum {
+  QUEUE_OVERFLOW,
+
+  LAST_SIGNAL
 };
 
 #define INF_COMMUNICATION_REGISTRY_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_COMMUNICATION_TYPE_REGISTRY, InfCommunicationRegistryPrivate))
 
+static guint registry_signals[LAST_SIGNAL];
+
 G_DEFINE_TYPE_WITH_CODE(InfCommunicationRegistry, inf_communication_registry, G_TYPE_OBJECT,
   G_ADD_PRIVATE(InfCommunicationRegistry))
 
-/* Maximum number of messages enqueued at the same time */
-static const guint INF_COMMUNICATION_REGISTRY_INNER_QUEUE_LIMIT = 5;
+static const gchar INF_COMMUNICATION_REGISTRY_FOOTER[] = "</group>";
+
+static InfCommunicationRegistryMessage*
+inf_communication_registry_message_new(xmlNodePtr xml)
+{
+  InfCommunicationRegistryMessage* message;
+  message = g_slice_new(InfCommunicationRegistryMessage);
+
+  xmlUnlinkNode(xml);
+
+  message->ref_count = 1;
+  message->xml = xml;
+  message->stream_func = NULL;
+  message->stream_data = NULL;
+  message->stream_notify = NULL;
+  message->header = NULL;
+  message->serialized = NULL;
+  message->bytes = NULL;
+  message->variants = NULL;
+
+  return message;
+}
+
+static InfCommunicationRegistryMessage*
+inf_communication_registry_message_new_stream(InfCommunicationStreamFunc func,
+                                              gpointer user_data,
+                                              GDestroyNotify notify)
+{
+  InfCommunicationRegistryMessage* message;
+  message = g_slice_new(InfCommunicationRegistryMessage);
+
+  message->ref_count = 1;
+  message->xml = NULL;
+  message->stream_func = func;
+  message->stream_data = user_data;
+  message->stream_notify = notify;
+  message->header = NULL;
+  message->serialized = NULL;
+  message->bytes = NULL;
+  message->variants = NULL;
+
+  return message;
+}
+
+static InfCommunicationRegistryMessage*
+inf_communication_registry_message_ref(InfCommunicationRegistryMessage* msg)
+{
+  ++msg->ref_count;
+  return msg;
+}
 
 static void
-inf_communication_registry_send_real(InfCommunicationRegistryEntry* entry,
-                                     guint num_messages)
+inf_communication_registry_message_unref(InfCommunicationRegistryMessage* msg)
 {
-  InfXmlConnection* connection;
-  InfXmlConnectionStatus status;
+  InfCommunicationRegistryVariant* variant;
+  GSList* item;
+
+  if(--msg->ref_count == 0)
+  {
+    for(item = msg->variants; item != NULL; item = item->next)
+    {
+      variant = (InfCommunicationRegistryVariant*)item->data;
+      g_bytes_unref(variant->serialized);
+      g_free(variant->header);
+      g_slice_free(InfCommunicationRegistryVariant, variant);
+    }
+
+    g_slist_free(msg->variants);
+
+    /* If the message has been serialized, then the serialization owns the
+     * XML, and it might still be in use by a connection. */
+    if(msg->serialized != NULL)
+    {
+      g_bytes_unref(msg->bytes);
+      g_bytes_unref(msg->serialized);
+    }
+    else if(msg->xml != NULL)
+    {
+      xmlFreeNode(msg->xml);
+    }
 
+    if(msg->stream_notify != NULL)
+      msg->stream_notify(msg->stream_data);
+
+    g_free(msg->header);
+    g_slice_free(InfCommunicationRegistryMessage, msg);
+  }
+}
+
+static gsize
+inf_communication_registry_message_get_size(
+  InfCommunicationRegistryMessage* message)
+{
+  /* Messages of a stream are accounted for once they are produced */
+  if(message->stream_func != NULL)
+    return 0;
+
+  g_assert(message->bytes != NULL);
+  return g_bytes_get_size(message->bytes);
+}
+
+static void
+inf_communication_registry_serialized_free(gpointer data)
+{
+  InfCommunicationRegistrySerialized* serialized;
+  serialized = (InfCommunicationRegistrySerialized*)data;
+
+  g_bytes_unref(serialized->bytes);
+  xmlFreeNode(serialized->container);
+  g_slice_free(InfCommunicationRegistrySerialized, serialized);
+}
+
+static GBytes*
+inf_communication_registry_serialized_new(xmlNodePtr container,
+                                          GBytes* bytes)
+{
+  InfCommunicationRegistrySerialized* serialized;
+  gconstpointer data;
+  gsize len;
+
+  serialized = g_slice_new(InfCommunicationRegistrySerialized);
+  serialized->container = container;
+  serialized->bytes = bytes;
+
+  data = g_bytes_get_data(bytes, &len);
+
+  return g_bytes_new_with_free_func(
+    data,
+    len,
+    inf_communication_registry_serialized_free,
+    serialized
+  );
+}
+
+static xmlNodePtr
+inf_communication_registry_entry_make_container(
+  InfCommunicationRegistryEntry* entry)
+{
   xmlNodePtr container;
-  xmlNodePtr child;
-  xmlNodePtr xml;
-  guint i;
 
   container = xmlNewNode(NULL, (const xmlChar*)"group");
   if(entry->publisher_string != NULL)
@@ -120,29 +371,271 @@ inf_communication_registry_send_real(InfCommunicationRegistryEntry* entry,
   }
 
   inf_xml_util_set_attribute(container, "name", entry->key.group_name);
+  return container;
+}
+
+static gchar*
+inf_communication_registry_entry_make_header(
+  InfCommunicationRegistryEntry* entry)
+{
+  GString* str;
+  gchar* escaped;
 
-  for(i = 0; i < num_messages && ((xml = entry->queue_begin) != NULL); ++ i)
+  str = g_string_new("<group");
+
+  if(entry->publisher_string != NULL)
   {
-    entry->queue_begin = entry->queue_begin->next;
-    if(entry->queue_begin == NULL) entry->queue_end = NULL;
+    escaped = g_markup_escape_text(entry->publisher_string, -1);
+    g_string_append_printf(str, " publisher=\"%s\"", escaped);
+    g_free(escaped);
+  }
+
+  escaped = g_markup_escape_text(entry->key.group_name, -1);
+  g_string_append_printf(str, " name=\"%s\">", escaped);
+  g_free(escaped);
+
+  return g_string_free(str, FALSE);
+}
+
+/* Serializes the message wrapped into entry's container, unless it has
+ * already been serialized before. */
+static void
+inf_communication_registry_message_serialize(
+  InfCommunicationRegistryMessage* message,
+  InfCommunicationRegistryEntry* entry)
+{
+  xmlNodePtr container;
+  const gchar* data;
+  const gchar* begin;
+  gsize len;
+
+  if(message->serialized == NULL)
+  {
+    g_assert(message->xml != NULL);
+
+    container = inf_communication_registry_entry_make_container(entry);
+    xmlAddChild(container, message->xml);
+
+    message->header = g_strdup(entry->header);
+    message->serialized = inf_communication_registry_serialized_new(
+      container,
+      inf_xml_util_node_to_bytes(container)
+    );
+
+    /* The opening tag ends at the first '>', since it is escaped within
+     * attribute values. */
+    data = g_bytes_get_data(message->serialized, &len);
+    begin = memchr(data, '>', len);
+    g_assert(begin != NULL);
+    ++begin;
+
+    g_assert(len >= (gsize)(begin - data) +
+                    sizeof(INF_COMMUNICATION_REGISTRY_FOOTER) - 1);
+
+    message->bytes = g_bytes_new_from_bytes(
+      message->serialized,
+      begin - data,
+      len - (begin - data) - (sizeof(INF_COMMUNICATION_REGISTRY_FOOTER) - 1)
+    );
+  }
+}
+
+/* Returns the serialization of the message in a container for entry, and
+ * sets container to the container. The message must have been serialized
+ * already. Connections for which the group's publisher is named the same
+ * share the same container. */
+static GBytes*
+inf_communication_registry_message_get_serialized(
+  InfCommunicationRegistryMessage* message,
+  InfCommunicationRegistryEntry* entry,
+  xmlNodePtr* container)
+{
+  InfCommunicationRegistryVariant* variant;
+  GSList* item;
+  GString* str;
+
+  g_assert(message->serialized != NULL);
+
+  if(strcmp(message->header, entry->header) == 0)
+  {
+    *container = message->xml->parent;
+    return message->serialized;
+  }
+
+  for(item = message->variants; item != NULL; item = item->next)
+  {
+    variant = (InfCommunicationRegistryVariant*)item->data;
+    if(strcmp(variant->header, entry->header) == 0)
+    {
+      *container = variant->container;
+      return variant->serialized;
+    }
+  }
+
+  /* The XML can only be in one container, so this needs a copy, but only
+   * one per header, not one per connection. */
+  variant = g_slice_new(InfCommunicationRegistryVariant);
+  variant->header = g_strdup(entry->header);
+  variant->container = inf_communication_registry_entry_make_container(entry);
+  xmlAddChild(variant->container, xmlCopyNode(message->xml, 1));
+
+  str = g_string_new(entry->header);
+  g_string_append_len(
+    str,
+    g_bytes_get_data(message->bytes, NULL),
+    g_bytes_get_size(message->bytes)
+  );
+  g_string_append(str, INF_COMMUNICATION_REGISTRY_FOOTER);
+
+  variant->serialized = inf_communication_registry_serialized_new(
+    variant->container,
+    g_string_free_to_bytes(str)
+  );
+
+  message->variants = g_slist_prepend(message->variants, variant);
+
+  *container = variant->container;
+  return variant->serialized;
+}
+
+static void
+inf_communication_registry_batch_free(InfCommunicationRegistryBatch* batch)
+{
+  guint i;
+
+  for(i = 0; i < batch->messages->len; ++i)
+  {
+    inf_communication_registry_message_unref(
+      g_ptr_array_index(batch->messages, i)
+    );
+  }
+
+  g_ptr_array_free(batch->messages, TRUE);
+  g_slice_free(InfCommunicationRegistryBatch, batch);
+}
+
+/* Makes sure that the messages at the front of the queue, up to
+ * max_messages messages or max_bytes bytes, are not streams, by pulling
+ * messages out of the streams among them. Streams that have ended are
+ * removed from the queue. This way, a stream only produces messages when
+ * they are about to be sent, and messages queued after the stream are
+ * still sent after all of the stream's messages. */
+static void
+inf_communication_registry_entry_expand(InfCommunicationRegistryEntry* entry,
+                                        guint max_messages,
+                                        gsize max_bytes)
+{
+  InfCommunicationRegistryMessage* message;
+  GList* item;
+  GList* next;
+  xmlNodePtr xml;
+  gsize bytes;
+  guint n;
+
+  item = entry->queue.head;
+  bytes = 0;
+  n = 0;
+
+  while(item != NULL && n < max_messages && (n == 0 || bytes < max_bytes))
+  {
+    message = (InfCommunicationRegistryMessage*)item->data;
+
+    if(message->stream_func == NULL)
+    {
+      bytes += inf_communication_registry_message_get_size(message);
+      ++ n;
+
+      item = item->next;
+    }
+    else
+    {
+      xml = message->stream_func(message->stream_data);
+      if(xml != NULL)
+      {
+        message = inf_communication_registry_message_new(xml);
+        inf_communication_registry_message_serialize(message, entry);
+        g_queue_insert_before(&entry->queue, item, message);
+
+        bytes += inf_communication_registry_message_get_size(message);
+        entry->queue_bytes +=
+          inf_communication_registry_message_get_size(message);
+        ++ n;
+      }
+      else
+      {
+        next = item->next;
+        g_queue_delete_link(&entry->queue, item);
+        inf_communication_registry_message_unref(message);
+        item = next;
+      }
+    }
+  }
+}
+
+/* Passes up to max_messages messages from the queue to the connection,
+ * but no more than max_bytes unless a single message is larger than
+ * that. */
+static void
+inf_communication_registry_send_real(InfCommunicationRegistryEntry* entry,
+                                     guint max_messages,
+                                     gsize max_bytes)
+{
+  InfCommunicationRegistryBatch* batch;
+  InfCommunicationRegistryMessage* message;
+  InfXmlConnection* connection;
+  InfXmlConnectionStatus status;
+  GBytes* serialized;
+  xmlNodePtr container;
+  gsize size;
+  guint i;
+
+  g_assert(!g_queue_is_empty(&entry->queue));
+
+  /* If there are only ended streams in the queue, then there is nothing
+   * to send. */
+  inf_communication_registry_entry_expand(entry, max_messages, max_bytes);
+  if(g_queue_is_empty(&entry->queue))
+    return;
+
+  batch = g_slice_new(InfCommunicationRegistryBatch);
+  batch->messages = g_ptr_array_new();
+  batch->n_sent = 0;
+  batch->size = 0;
+
+  /* The batch takes over the queue's references on the messages. They are
+   * passed in their shared containers, so that no message needs to be
+   * copied or serialized again for this connection. */
+  for(i = 0; i < max_messages && !g_queue_is_empty(&entry->queue); ++ i)
+  {
+    message = g_queue_peek_head(&entry->queue);
+    if(message->stream_func != NULL)
+      break;
+
+    size = inf_communication_registry_message_get_size(message);
+    if(i > 0 && batch->size + size > max_bytes)
+      break;
+
+    g_queue_pop_head(&entry->queue);
+    entry->queue_bytes -= size;
+    batch->size += size;
     ++ entry->inner_count;
 
-    xmlUnlinkNode(xml);
-    xmlAddChild(container, xml);
+    g_ptr_array_add(batch->messages, message);
   }
 
+  entry->inner_bytes += batch->size;
+  batch->limited = !g_queue_is_empty(&entry->queue);
+
   /* Keep order of enqueued() calls and inf_xml_connection_send() calls
    * intact even if this function is run recursively in one of the
    * functions mentioned above. */
-  if(entry->enqueued_list != NULL)
+  if(entry->enqueuing)
   {
-    entry->enqueued_list->next = container;
-    entry->enqueued_list = container;
+    g_queue_push_tail(&entry->enqueued_list, batch);
   }
   else
   {
-    entry->enqueued_list = container;
-    child = container;
+    entry->enqueuing = TRUE;
 
     connection = entry->key.connection;
     g_object_ref(connection);
@@ -150,7 +643,7 @@ inf_communication_registry_send_real(InfCommunicationRegistryEntry* entry,
     g_object_get(G_OBJECT(connection), "status", &status, NULL);
     g_assert(status == INF_XML_CONNECTION_OPEN);
 
-    while(child != NULL)
+    while(batch != NULL)
     {
       /* TODO: The group could be unset at this point if called from
        * inf_communication_registry_entry_free() in turn called by
@@ -159,39 +652,108 @@ inf_communication_registry_send_real(InfCommunicationRegistryEntry* entry,
        * inf_communication_registry_entry_free(). */
       if(entry->group != NULL)
       {
-        for(xml = child->children; xml != NULL; xml = xml->next)
+        for(i = 0; i < batch->messages->len; ++i)
         {
-          inf_communication_method_enqueued(entry->method, connection, xml);
+          inf_communication_registry_message_get_serialized(
+            g_ptr_array_index(batch->messages, i),
+            entry,
+            &container
+          );
+
+          inf_communication_method_enqueued(
+            entry->method,
+            connection,
+            container->children
+          );
         }
       }
 
-      if(child == entry->enqueued_list)
-        entry->enqueued_list = NULL;
-
-      xml = child;
-      child = child->next;
-
-      /* There are two possible cases at this point:
-       * 1) We reached the end of the list. In that case, entry->enqueued_list
-       * has been reset to NULL. This also means that we have sent everything
-       * successfully. We will terminate this function after this call, so
-       * a recursive call can just begin from scratch.
-       * 2) entry->enqueued_list is not NULL. In this case, a recursive call
-       * will simply append to entry->enqueued_list, and we will enqueue and
-       * send the messages within the next iteration(s).
-       */
-      inf_xml_connection_send(connection, xml);
-
-      /* Break if sending the data lead to connection closure */
-      g_object_get(G_OBJECT(connection), "status", &status, NULL);
+      /* The batch is processed by sent_cb() from now on, which might
+       * happen synchronously from within inf_xml_connection_send(). It
+       * stays alive until its last message has been sent, though. */
+      batch->time = g_get_monotonic_time();
+      g_queue_push_tail(&entry->inflight, batch);
+
+      /* A recursive call will simply append to entry->enqueued_list, and
+       * we will enqueue and send the messages within the next
+       * iteration(s). */
+      for(i = 0; i < batch->messages->len; ++i)
+      {
+        serialized = inf_communication_registry_message_get_serialized(
+          g_ptr_array_index(batch->messages, i),
+          entry,
+          &container
+        );
+
+        inf_xml_connection_send_serialized(connection, container, serialized);
+
+        /* Break if sending the data lead to connection closure */
+        g_object_get(G_OBJECT(connection), "status", &status, NULL);
+        if(status != INF_XML_CONNECTION_OPEN)
+          break;
+      }
+
       if(status != INF_XML_CONNECTION_OPEN)
         break;
+
+      batch = g_queue_pop_head(&entry->enqueued_list);
     }
 
+    while(!g_queue_is_empty(&entry->enqueued_list))
+    {
+      inf_communication_registry_batch_free(
+        g_queue_pop_head(&entry->enqueued_list)
+      );
+    }
+
+    entry->enqueuing = FALSE;
     g_object_unref(connection);
   }
 }
 
+/* Sends as many messages as the current window of the entry allows */
+static void
+inf_communication_registry_send_window(InfCommunicationRegistryEntry* entry)
+{
+  InfCommunicationRegistryPrivate* priv;
+  priv = INF_COMMUNICATION_REGISTRY_PRIVATE(entry->registry);
+
+  inf_communication_registry_send_real(
+    entry,
+    entry->window,
+    priv->max_window_bytes
+  );
+}
+
+/* Adapts the send window of the entry after batch has been sent */
+static void
+inf_communication_registry_entry_acked(InfCommunicationRegistryEntry* entry,
+                                       InfCommunicationRegistryBatch* batch)
+{
+  InfCommunicationRegistryPrivate* priv;
+  gint64 elapsed;
+
+  priv = INF_COMMUNICATION_REGISTRY_PRIVATE(entry->registry);
+  elapsed = g_get_monotonic_time() - batch->time;
+
+  g_assert(entry->inner_bytes >= batch->size);
+  entry->inner_bytes -= batch->size;
+
+  if(elapsed <= (gint64)priv->fast_ack_time)
+  {
+    /* The connection keeps up. Only grow the window if it was actually
+     * the limiting factor, though. */
+    if(batch->limited && entry->window < priv->max_window)
+      entry->window = MIN(entry->window * 2, priv->max_window);
+  }
+  else
+  {
+    /* The connection builds up a backlog, so pass fewer messages at once,
+     * to keep them cancellable in our queue for longer. */
+    entry->window = MAX(entry->window / 2, 1);
+  }
+}
+
 /* Required by inf_communication_registry_entry_free() */
 static void
 inf_communication_registry_group_unrefed(gpointer user_data,
@@ -224,10 +786,27 @@ inf_communication_registry_entry_free(gpointer data)
   if(status != INF_XML_CONNECTION_CLOSING &&
      status != INF_XML_CONNECTION_CLOSED)
   {
-    if(entry->queue_begin != NULL)
-      inf_communication_registry_send_real(entry, G_MAXUINT);
+    if(!g_queue_is_empty(&entry->queue))
+      inf_communication_registry_send_real(entry, G_MAXUINT, G_MAXSIZE);
+  }
+
+  while(!g_queue_is_empty(&entry->queue))
+  {
+    inf_communication_registry_message_unref(
+      g_queue_pop_head(&entry->queue)
+    );
+  }
+
+  while(!g_queue_is_empty(&entry->inflight))
+  {
+    inf_communication_registry_batch_free(
+      g_queue_pop_head(&entry->inflight)
+    );
   }
 
+  while(!g_queue_is_empty(&entry->sent_list))
+    xmlFreeNode(g_queue_pop_head(&entry->sent_list));
+
   if(entry->group)
   {
     g_object_weak_unref(
@@ -240,6 +819,7 @@ inf_communication_registry_entry_free(gpointer data)
   if(!entry->registered)
     g_object_unref(entry->key.connection);
 
+  g_free(entry->header);
   g_free(entry->key.publisher_id);
   g_slice_free(InfCommunicationRegistryEntry, entry);
 }
@@ -388,6 +968,7 @@ inf_communication_registry_sent_cb(InfXmlConnection* connection,
   InfCommunicationRegistry* registry;
   InfCommunicationRegistryPrivate* priv;
   InfCommunicationRegistryEntry* entry;
+  InfCommunicationRegistryBatch* batch;
   InfCommunicationRegistryKey key;
   xmlChar* publisher;
   xmlChar* group_name;
@@ -428,14 +1009,17 @@ inf_communication_registry_sent_cb(InfXmlConnection* connection,
   entry = g_hash_table_lookup(priv->entries, &key);
   if(entry != NULL)
   {
-    if(entry->sent_list != NULL)
+    /* If we are called recursively from a sent callback, then let the
+     * parent call process the container, to keep the order of
+     * inf_communication_method_sent() calls intact. The container will be
+     * gone after this function returns, so keep a copy. */
+    if(entry->sending)
     {
-      entry->sent_list->next = xmlCopyNode(xml, 1);
-      entry->sent_list = entry->sent_list->next;
+      g_queue_push_tail(&entry->sent_list, xmlCopyNode(xml, 1));
     }
     else
     {
-      entry->sent_list = xml;
+      entry->sending = TRUE;
       child = xml;
 
       while(child != NULL)
@@ -471,25 +1055,31 @@ inf_communication_registry_sent_cb(InfXmlConnection* connection,
           -- entry->inner_count;
         }
 
-        cur = child;
-        child = child->next;
+        /* Each message of a batch is sent in its own container */
+        batch = g_queue_peek_head(&entry->inflight);
+        g_assert(batch != NULL);
+
+        ++ batch->n_sent;
+        if(batch->n_sent == batch->messages->len)
+        {
+          g_queue_pop_head(&entry->inflight);
+          inf_communication_registry_entry_acked(entry, batch);
+          inf_communication_registry_batch_free(batch);
+        }
 
-        if(cur == entry->sent_list) entry->sent_list = NULL;
-        if(cur != xml) xmlFreeNode(cur);
+        if(child != xml) xmlFreeNode(child);
+        child = g_queue_pop_head(&entry->sent_list);
       }
+
+      entry->sending = FALSE;
     }
 
     /* Messages have been sent, meaning the number of queued messages has
      * decreased, so we can send more messages now. */
     /* Send next bunch of messages if inner_count reached zero, meaning no
      * more messages have been enqueued, for better packing. */
-    if(entry->inner_count == 0 && entry->queue_end != NULL)
-    {
-      inf_communication_registry_send_real(
-        entry,
-        INF_COMMUNICATION_REGISTRY_INNER_QUEUE_LIMIT - entry->inner_count
-      );
-    }
+    if(entry->inner_count == 0 && !g_queue_is_empty(&entry->queue))
+      inf_communication_registry_send_window(entry);
 
     /* Free the entry in case all scheduled messages have been sent after
      * unregistration. */
@@ -698,6 +1288,68 @@ inf_communication_registry_group_unrefed(gpointer user_data,
   }
 }
 
+static void
+inf_communication_registry_close_free(gpointer data)
+{
+  InfCommunicationRegistryClose* pending;
+  pending = (InfCommunicationRegistryClose*)data;
+
+  g_object_unref(pending->connection);
+  g_slice_free(InfCommunicationRegistryClose, pending);
+}
+
+static void
+inf_communication_registry_close_func(gpointer user_data)
+{
+  InfCommunicationRegistryClose* pending;
+  InfCommunicationRegistryPrivate* priv;
+  InfXmlConnectionStatus status;
+
+  pending = (InfCommunicationRegistryClose*)user_data;
+  priv = INF_COMMUNICATION_REGISTRY_PRIVATE(pending->registry);
+
+  priv->closes = g_slist_remove(priv->closes, pending);
+
+  g_object_get(G_OBJECT(pending->connection), "status", &status, NULL);
+  if(status == INF_XML_CONNECTION_OPEN)
+    inf_xml_connection_close(pending->connection);
+}
+
+/* Closes connection once the main loop is reached again, so that callers
+ * which are currently sending messages to it do not find it closed
+ * unexpectedly. */
+static void
+inf_communication_registry_schedule_close(InfCommunicationRegistry* registry,
+                                          InfXmlConnection* connection)
+{
+  InfCommunicationRegistryPrivate* priv;
+  InfCommunicationRegistryClose* pending;
+  GSList* item;
+
+  priv = INF_COMMUNICATION_REGISTRY_PRIVATE(registry);
+
+  for(item = priv->closes; item != NULL; item = item->next)
+  {
+    pending = (InfCommunicationRegistryClose*)item->data;
+    if(pending->connection == connection)
+      return;
+  }
+
+  pending = g_slice_new(InfCommunicationRegistryClose);
+  pending->registry = registry;
+  pending->connection = connection;
+  g_object_ref(connection);
+
+  pending->dispatch = inf_io_add_dispatch(
+    priv->io,
+    inf_communication_registry_close_func,
+    pending,
+    inf_communication_registry_close_free
+  );
+
+  priv->closes = g_slist_prepend(priv->closes, pending);
+}
+
 /*
  * GObject overrides.
  */
@@ -708,6 +1360,7 @@ inf_communication_registry_init(InfCommunicationRegistry* registry)
   InfCommunicationRegistryPrivate* priv;
   priv = INF_COMMUNICATION_REGISTRY_PRIVATE(registry);
 
+  priv->io = NULL;
   priv->connections = g_hash_table_new(NULL, NULL);
 
   priv->entries = g_hash_table_new_full(
@@ -716,6 +1369,13 @@ inf_communication_registry_init(InfCommunicationRegistry* registry)
     NULL,
     inf_communication_registry_entry_free
   );
+
+  priv->initial_window = 5;
+  priv->max_window = 128;
+  priv->max_window_bytes = 256 * 1024;
+  priv->fast_ack_time = 100000;
+  priv->max_queue_bytes = 16 * 1024 * 1024;
+  priv->closes = NULL;
 }
 
 static void
@@ -767,9 +1427,144 @@ inf_communication_registry_dispose(GObject* object)
   g_hash_table_unref(priv->connections);
   g_hash_table_unref(priv->entries);
 
+  while(priv->closes != NULL)
+  {
+    /* The dispatch's notify function frees the entry */
+    inf_io_remove_dispatch(
+      priv->io,
+      ((InfCommunicationRegistryClose*)priv->closes->data)->dispatch
+    );
+
+    priv->closes = g_slist_delete_link(priv->closes, priv->closes);
+  }
+
+  if(priv->io != NULL)
+  {
+    g_object_unref(priv->io);
+    priv->io = NULL;
+  }
+
   G_OBJECT_CLASS(inf_communication_registry_parent_class)->dispose(object);
 }
 
+static void
+inf_communication_registry_set_property(GObject* object,
+                                        guint prop_id,
+                                        const GValue* value,
+                                        GParamSpec* pspec)
+{
+  InfCommunicationRegistry* registry;
+  InfCommunicationRegistryPrivate* priv;
+
+  registry = INF_COMMUNICATION_REGISTRY(object);
+  priv = INF_COMMUNICATION_REGISTRY_PRIVATE(registry);
+
+  switch(prop_id)
+  {
+  case PROP_IO:
+    /* Connections scheduled for closing are dispatched on the old one */
+    g_return_if_fail(priv->closes == NULL);
+    if(priv->io != NULL) g_object_unref(priv->io);
+    priv->io = INF_IO(g_value_dup_object(value));
+    break;
+  case PROP_INITIAL_WINDOW:
+    priv->initial_window = g_value_get_uint(value);
+    break;
+  case PROP_MAX_WINDOW:
+    priv->max_window = g_value_get_uint(value);
+    break;
+  case PROP_MAX_WINDOW_BYTES:
+    priv->max_window_bytes = g_value_get_uint(value);
+    break;
+  case PROP_FAST_ACK_TIME:
+    priv->fast_ack_time = g_value_get_uint(value);
+    break;
+  case PROP_MAX_QUEUE_BYTES:
+    priv->max_queue_bytes = g_value_get_uint64(value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+inf_communication_registry_get_property(GObject* object,
+                                        guint prop_id,
+                                        GValue* value,
+                                        GParamSpec* pspec)
+{
+  InfCommunicationRegistry* registry;
+  InfCommunicationRegistryPrivate* priv;
+
+  registry = INF_COMMUNICATION_REGISTRY(object);
+  priv = INF_COMMUNICATION_REGISTRY_PRIVATE(registry);
+
+  switch(prop_id)
+  {
+  case PROP_IO:
+    g_value_set_object(value, G_OBJECT(priv->io));
+    break;
+  case PROP_INITIAL_WINDOW:
+    g_value_set_uint(value, priv->initial_window);
+    break;
+  case PROP_MAX_WINDOW:
+    g_value_set_uint(value, priv->max_window);
+    break;
+  case PROP_MAX_WINDOW_BYTES:
+    g_value_set_uint(value, priv->max_window_bytes);
+    break;
+  case PROP_FAST_ACK_TIME:
+    g_value_set_uint(value, priv->fast_ack_time);
+    break;
+  case PROP_MAX_QUEUE_BYTES:
+    g_value_set_uint64(value, priv->max_queue_bytes);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+/*
+ * Default signal handlers
+ */
+
+static void
+inf_communication_registry_queue_overflow(InfCommunicationRegistry* registry,
+                                          InfCommunicationGroup* group,
+                                          InfXmlConnection* connection,
+                                          guint64 queued_bytes)
+{
+  InfCommunicationRegistryPrivate* priv;
+  InfCommunicationRegistryKey key;
+  InfCommunicationRegistryEntry* entry;
+
+  priv = INF_COMMUNICATION_REGISTRY_PRIVATE(registry);
+  key.connection = connection;
+  key.publisher_id =
+    inf_communication_group_get_publisher_id(group, connection);
+  key.group_name = inf_communication_group_get_name(group);
+
+  entry = g_hash_table_lookup(priv->entries, &key);
+  g_free(key.publisher_id);
+
+  /* A previous handler might have unregistered the connection already */
+  if(entry == NULL || entry->registered == FALSE)
+    return;
+
+  /* The remote side does not read its data fast enough. Drop it instead of
+   * buffering an arbitrary amount of data for it. We are still within the
+   * send path of the caller, which might send more messages to the
+   * connection, so do not close it right away but only stop sending to it,
+   * and close it from the main loop. */
+  inf_communication_registry_cancel_messages(registry, group, connection);
+  entry->overflowed = TRUE;
+
+  if(priv->io != NULL)
+    inf_communication_registry_schedule_close(registry, connection);
+}
+
 static void
 inf_communication_registry_class_init(
   InfCommunicationRegistryClass* registry_class)
@@ -778,6 +1573,129 @@ inf_communication_registry_class_init(
   object_class = G_OBJECT_CLASS(registry_class);
 
   object_class->dispose = inf_communication_registry_dispose;
+  object_class->set_property = inf_communication_registry_set_property;
+  object_class->get_property = inf_communication_registry_get_property;
+
+  registry_class->queue_overflow = inf_communication_registry_queue_overflow;
+
+  g_object_class_install_property(
+    object_class,
+    PROP_IO,
+    g_param_spec_object(
+      "io",
+      "IO",
+      "The main loop from which to close connections whose queue overflowed",
+      INF_TYPE_IO,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_INITIAL_WINDOW,
+    g_param_spec_uint(
+      "initial-window",
+      "Initial window",
+      "Number of messages passed to a connection at once before the first "
+      "of them has been sent",
+      1,
+      G_MAXUINT,
+      5,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_MAX_WINDOW,
+    g_param_spec_uint(
+      "max-window",
+      "Maximum window",
+      "Maximum number of messages passed to a connection at once",
+      1,
+      G_MAXUINT,
+      128,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_MAX_WINDOW_BYTES,
+    g_param_spec_uint(
+      "max-window-bytes",
+      "Maximum window bytes",
+      "Maximum number of bytes passed to a connection at once",
+      1,
+      G_MAXUINT,
+      256 * 1024,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_FAST_ACK_TIME,
+    g_param_spec_uint(
+      "fast-ack-time",
+      "Fast acknowledgement time",
+      "Time in microseconds within which messages need to be sent for the "
+      "window to grow",
+      0,
+      G_MAXUINT,
+      100000,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_MAX_QUEUE_BYTES,
+    g_param_spec_uint64(
+      "max-queue-bytes",
+      "Maximum queue bytes",
+      "Number of bytes queued or passed to a connection for a group, but "
+      "not yet sent, above which the queue-overflow signal is emitted, or 0 "
+      "for no limit",
+      0,
+      G_MAXUINT64,
+      16 * 1024 * 1024,
+      G_PARAM_READWRITE
+    )
+  );
+
+  /**
+   * InfCommunicationRegistry::queue-overflow:
+   * @registry: The #InfCommunicationRegistry emitting the signal.
+   * @group: The group for which messages are queued.
+   * @connection: The connection the messages are queued for.
+   * @queued_bytes: The number of bytes queued for @connection in @group.
+   *
+   * This signal is emitted when a message is queued for @connection while
+   * more than #InfCommunicationRegistry:max-queue-bytes bytes are waiting to
+   * be sent to it in @group, either in the registry's queue or in the
+   * connection's, which happens if the remote side does not
+   * receive data as fast as it is produced. The default handler drops all
+   * messages queued for @connection in @group, and all messages sent to it
+   * in @group afterwards, without emitting this signal again. Since the
+   * caller might still be sending messages to @connection, the default
+   * handler does not close @connection directly but from a dispatch on
+   * #InfCommunicationRegistry:io, if set. Connect to this signal and stop
+   * its emission to handle slow connections differently.
+   */
+  registry_signals[QUEUE_OVERFLOW] = g_signal_new(
+    "queue-overflow",
+    G_OBJECT_CLASS_TYPE(object_class),
+    G_SIGNAL_RUN_LAST,
+    G_STRUCT_OFFSET(InfCommunicationRegistryClass, queue_overflow),
+    NULL, NULL,
+    NULL,
+    G_TYPE_NONE,
+    3,
+    INF_COMMUNICATION_TYPE_GROUP,
+    INF_TYPE_XML_CONNECTION,
+    G_TYPE_UINT64
+  );
 }
 
 /**
@@ -855,15 +1773,24 @@ inf_communication_registry_register(InfCommunicationRegistry* registry,
     entry->group = group;
     entry->method = method;
 
+    entry->header = inf_communication_registry_entry_make_header(entry);
+
     entry->inner_count = 0;
-    entry->queue_begin = NULL;
-    entry->queue_end = NULL;
+    entry->inner_bytes = 0;
+    g_queue_init(&entry->queue);
+    entry->queue_bytes = 0;
+    entry->overflowed = FALSE;
+
+    entry->window = priv->initial_window;
+    g_queue_init(&entry->inflight);
 
     entry->registered = TRUE;
     entry->activation_count = 0;
 
-    entry->enqueued_list = NULL;
-    entry->sent_list = NULL;
+    entry->enqueuing = FALSE;
+    g_queue_init(&entry->enqueued_list);
+    entry->sending = FALSE;
+    g_queue_init(&entry->sent_list);
 
     g_object_weak_ref(
       G_OBJECT(group),
@@ -894,7 +1821,6 @@ inf_communication_registry_unregister(InfCommunicationRegistry* registry,
   InfCommunicationRegistryKey key;
   InfCommunicationRegistryEntry* entry;
   InfXmlConnectionStatus status;
-  xmlNodePtr xml;
 
   g_return_if_fail(INF_COMMUNICATION_IS_REGISTRY(registry));
   g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
@@ -912,16 +1838,23 @@ inf_communication_registry_unregister(InfCommunicationRegistry* registry,
   entry = g_hash_table_lookup(priv->entries, &key);
   g_assert(entry != NULL && entry->registered == TRUE);
 
-  if( (entry->queue_end != NULL || entry->inner_count > 0) &&
+  /* Let streams produce all of their messages now, so that we know how
+   * many messages are still to be sent. */
+  if(status != INF_XML_CONNECTION_CLOSING &&
+     status != INF_XML_CONNECTION_CLOSED)
+  {
+    inf_communication_registry_entry_expand(entry, G_MAXUINT, G_MAXSIZE);
+  }
+
+  if( (!g_queue_is_empty(&entry->queue) || entry->inner_count > 0) &&
      status != INF_XML_CONNECTION_CLOSING &&
      status != INF_XML_CONNECTION_CLOSED)
   {
     /* The entry has still messages to send, so don't remove it right now
      * but wait until all scheduled messages have been sent. */
     entry->registered = FALSE;
-    entry->activation_count = entry->inner_count;
-    for(xml = entry->queue_begin; xml != NULL; xml = xml->next)
-      ++ entry->activation_count;
+    entry->activation_count =
+      entry->inner_count + g_queue_get_length(&entry->queue);
     g_assert(entry->activation_count > 0);
 
     /* Keep an additional reference on the connection as the connection will
@@ -975,6 +1908,65 @@ inf_communication_registry_is_registered(InfCommunicationRegistry* registry,
   return entry != NULL && entry->registered == TRUE;
 }
 
+static void
+inf_communication_registry_send_message(
+  InfCommunicationRegistry* registry,
+  InfCommunicationGroup* group,
+  InfXmlConnection* connection,
+  InfCommunicationRegistryMessage* message)
+{
+  InfCommunicationRegistryPrivate* priv;
+  InfCommunicationRegistryKey key;
+  InfCommunicationRegistryEntry* entry;
+  guint64 queued_bytes;
+
+  priv = INF_COMMUNICATION_REGISTRY_PRIVATE(registry);
+  key.connection = connection;
+  key.publisher_id =
+    inf_communication_group_get_publisher_id(group, connection);
+  key.group_name = inf_communication_group_get_name(group);
+
+  entry = g_hash_table_lookup(priv->entries, &key);
+  g_assert(entry != NULL && entry->registered == TRUE);
+
+  /* The connection is about to be closed, and the remote side would not
+   * receive the message anyway. */
+  if(entry->overflowed)
+  {
+    inf_communication_registry_message_unref(message);
+    g_free(key.publisher_id);
+    return;
+  }
+
+  if(message->stream_func == NULL)
+    inf_communication_registry_message_serialize(message, entry);
+
+  g_queue_push_tail(&entry->queue, message);
+  entry->queue_bytes += inf_communication_registry_message_get_size(message);
+
+  /* If there is something in the inner queue, don't send directly but wait
+   * until the message has been sent, for better packing. */
+  if(entry->inner_count == 0)
+    inf_communication_registry_send_window(entry);
+
+  /* Batches passed to the connection but not yet sent count as well, since
+   * the connection only buffers them. */
+  queued_bytes = entry->queue_bytes + entry->inner_bytes;
+  g_free(key.publisher_id);
+
+  if(priv->max_queue_bytes > 0 && queued_bytes > priv->max_queue_bytes)
+  {
+    g_signal_emit(
+      registry,
+      registry_signals[QUEUE_OVERFLOW],
+      0,
+      group,
+      connection,
+      queued_bytes
+    );
+  }
+}
+
 /**
  * inf_communication_registry_send:
  * @registry: A #InfCommunicationRegistry.
@@ -997,47 +1989,141 @@ inf_communication_registry_send(InfCommunicationRegistry* registry,
                                 InfXmlConnection* connection,
                                 xmlNodePtr xml)
 {
-  InfCommunicationRegistryPrivate* priv;
-  InfCommunicationRegistryKey key;
-  InfCommunicationRegistryEntry* entry;
+  g_return_if_fail(INF_COMMUNICATION_IS_REGISTRY(registry));
+  g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+  g_return_if_fail(xml != NULL);
 
+  inf_communication_registry_send_message(
+    registry,
+    group,
+    connection,
+    inf_communication_registry_message_new(xml)
+  );
+}
+
+/**
+ * inf_communication_registry_send_stream:
+ * @registry: A #InfCommunicationRegistry.
+ * @group: The group for which to send the messages.
+ * @connection: A registered #InfXmlConnection.
+ * @func: (scope notified): Function producing the messages to send.
+ * @user_data: Additional data to pass to @func.
+ * @notify: (allow-none): Function called to free @user_data, or %NULL.
+ *
+ * Sends a sequence of XML messages to @connection, as if
+ * inf_communication_registry_send() was called for every message returned
+ * by @func until it returns %NULL. However, @func is only called when the
+ * messages are about to be passed to the connection, so that only a few of
+ * them, limited by the current send window, exist at the same time.
+ * Messages sent to @connection after this call are sent after all messages
+ * produced by @func.
+ *
+ * @func must not send messages on @group itself. @notify is called when
+ * @func has returned %NULL, or when the messages are cancelled via
+ * inf_communication_registry_cancel_messages().
+ */
+void
+inf_communication_registry_send_stream(InfCommunicationRegistry* registry,
+                                       InfCommunicationGroup* group,
+                                       InfXmlConnection* connection,
+                                       InfCommunicationStreamFunc func,
+                                       gpointer user_data,
+                                       GDestroyNotify notify)
+{
   g_return_if_fail(INF_COMMUNICATION_IS_REGISTRY(registry));
   g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
   g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+  g_return_if_fail(func != NULL);
+
+  inf_communication_registry_send_message(
+    registry,
+    group,
+    connection,
+    inf_communication_registry_message_new_stream(func, user_data, notify)
+  );
+}
+
+/**
+ * inf_communication_registry_send_all:
+ * @registry: A #InfCommunicationRegistry.
+ * @group: The group for which to send the message #InfCommunicationGroup.
+ * @connections: (element-type InfXmlConnection): The connections to send
+ * the message to.
+ * @except: (allow-none): A connection in @connections to which not to send
+ * the message, or %NULL.
+ * @xml: (transfer full): The message to send.
+ *
+ * Sends an XML message to all connections in @connections, except @except.
+ * Connections which are not, or no longer, registered for @group, or whose
+ * status is not %INF_XML_CONNECTION_OPEN, are skipped. Otherwise, this
+ * behaves as if inf_communication_registry_send() was called for each
+ * connection with a copy of @xml. However, the message is shared between
+ * all connections and, where possible, only serialized once, which makes
+ * this much cheaper for large groups.
+ *
+ * This function takes ownership of @xml.
+ */
+void
+inf_communication_registry_send_all(InfCommunicationRegistry* registry,
+                                    InfCommunicationGroup* group,
+                                    GSList* connections,
+                                    InfXmlConnection* except,
+                                    xmlNodePtr xml)
+{
+  InfCommunicationRegistryMessage* message;
+  InfXmlConnection* connection;
+  InfXmlConnectionStatus status;
+  GSList* item;
+
+  g_return_if_fail(INF_COMMUNICATION_IS_REGISTRY(registry));
+  g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
+  g_return_if_fail(except == NULL || INF_IS_XML_CONNECTION(except));
   g_return_if_fail(xml != NULL);
 
-  priv = INF_COMMUNICATION_REGISTRY_PRIVATE(registry);
-  key.connection = connection;
-  key.publisher_id =
-    inf_communication_group_get_publisher_id(group, connection);
-  key.group_name = inf_communication_group_get_name(group);
+  message = inf_communication_registry_message_new(xml);
 
-  entry = g_hash_table_lookup(priv->entries, &key);
-  g_assert(entry != NULL && entry->registered == TRUE);
+  /* Each of the sends can do a callback which might possibly screw up the
+   * connection list completely. So be safe here by copying all relevant
+   * information on the stack. */
+  g_object_ref(registry);
+  g_object_ref(group);
 
-  xmlUnlinkNode(xml);
-  if(entry->queue_end == NULL)
-  {
-    entry->queue_begin = xml;
-    entry->queue_end = xml;
-  }
-  else
-  {
-    entry->queue_end->next = xml;
-    entry->queue_end = xml;
-  }
+  connections = g_slist_copy(connections);
+  for(item = connections; item != NULL; item = item->next)
+    g_object_ref(item->data);
 
-  /* If there is something in the inner queue, don't send directly but wait
-   * until the message has been sent, for better packing. */
-  if(entry->inner_count == 0)
+  while(connections)
   {
-    inf_communication_registry_send_real(
-      entry,
-      INF_COMMUNICATION_REGISTRY_INNER_QUEUE_LIMIT - entry->inner_count
-    );
+    connection = INF_XML_CONNECTION(connections->data);
+
+    /* in case the connection's status changed but it was not yet removed
+     * from the group, i.e. if we are called in response to a handler of the
+     * notify::status signal, we also check the status here. */
+    g_object_get(G_OBJECT(connection), "status", &status, NULL);
+
+    /* A callback from a prior iteration might have unregistered the
+     * connection. */
+    if(connection != except &&
+       status == INF_XML_CONNECTION_OPEN &&
+       inf_communication_registry_is_registered(registry, group, connection))
+    {
+      inf_communication_registry_send_message(
+        registry,
+        group,
+        connection,
+        inf_communication_registry_message_ref(message)
+      );
+    }
+
+    g_object_unref(connection);
+    connections = g_slist_delete_link(connections, connections);
   }
 
-  g_free(key.publisher_id);
+  g_object_unref(group);
+  g_object_unref(registry);
+
+  inf_communication_registry_message_unref(message);
 }
 
 /**
@@ -1072,10 +2158,14 @@ inf_communication_registry_cancel_messages(InfCommunicationRegistry* registry,
   g_assert(entry != NULL && entry->registered == TRUE);
 
   /* TODO: Don't cancel messages prior activation? */
-  xmlFreeNodeList(entry->queue_begin);
-  entry->queue_begin = NULL;
-  entry->queue_end = NULL;
+  while(!g_queue_is_empty(&entry->queue))
+  {
+    inf_communication_registry_message_unref(
+      g_queue_pop_head(&entry->queue)
+    );
+  }
 
+  entry->queue_bytes = 0;
   g_free(key.publisher_id);
 }
 
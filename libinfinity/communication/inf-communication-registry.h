@@ -39,12 +39,21 @@ typedef struct _InfCommunicationRegistryClass InfCommunicationRegistryClass;
 
 /**
  * InfCommunicationRegistryClass:
+ * @queue_overflow: Default signal handler for the
+ * #InfCommunicationRegistry::queue-overflow signal.
  *
- * This structure does not contain any public fields.
+ * This structure contains the default signal handlers of
+ * #InfCommunicationRegistry.
  */
 struct _InfCommunicationRegistryClass {
   /*< private >*/
   GObjectClass parent;
+
+  /*< public >*/
+  void (*queue_overflow)(InfCommunicationRegistry* registry,
+                         InfCommunicationGroup* group,
+                         InfXmlConnection* connection,
+                         guint64 queued_bytes);
 };
 
 /**
@@ -83,6 +92,21 @@ inf_communication_registry_send(InfCommunicationRegistry* registry,
                                 InfXmlConnection* connection,
                                 xmlNodePtr xml);
 
+void
+inf_communication_registry_send_stream(InfCommunicationRegistry* registry,
+                                       InfCommunicationGroup* group,
+                                       InfXmlConnection* connection,
+                                       InfCommunicationStreamFunc func,
+                                       gpointer user_data,
+                                       GDestroyNotify notify);
+
+void
+inf_communication_registry_send_all(InfCommunicationRegistry* registry,
+                                    InfCommunicationGroup* group,
+                                    GSList* connections,
+                                    InfXmlConnection* except,
+                                    xmlNodePtr xml);
+
 void
 inf_communication_registry_cancel_messages(InfCommunicationRegistry* registry,
                                            InfCommunicationGroup* group,
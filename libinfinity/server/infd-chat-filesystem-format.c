@@ -200,57 +200,30 @@ infd_chat_filesystem_format_write(InfdFilesystemStorage* storage,
                                   InfChatBuffer* buffer,
                                   GError** error)
 {
-  FILE* stream;
   xmlDocPtr doc;
   xmlNodePtr root;
-  xmlErrorPtr xmlerror;
+  gboolean result;
 
   g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
   g_return_val_if_fail(path != NULL, FALSE);
   g_return_val_if_fail(INF_IS_CHAT_BUFFER(buffer), FALSE);
   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 
-  /* Open stream before exporting buffer to XML so possible errors are
-   * catched earlier. */
-  stream = infd_filesystem_storage_open(
-    INFD_FILESYSTEM_STORAGE(storage),
-    "InfChat",
-    path,
-    "w",
-    NULL,
-    error
-  );
-
-  if(stream == NULL)
-    return FALSE;
-
   root = xmlNewNode(NULL, (const xmlChar*)"inf-chat-session");
 
   doc = xmlNewDoc((const xmlChar*)"1.0");
   xmlDocSetRootElement(doc, root);
 
-  /* TODO: At this point, we should tell libxml2 to use
-   * infd_filesystem_storage_stream_write() instead of fwrite(),
-   * to prevent C runtime mixups. */
-  if(xmlDocFormatDump(stream, doc, 1) == -1)
-  {
-    xmlerror = xmlGetLastError();
-    infd_filesystem_storage_stream_close(stream);
-    xmlFreeDoc(doc);
-
-    g_set_error_literal(
-      error,
-      g_quark_from_static_string("LIBXML2_OUTPUT_ERROR"),
-      xmlerror->code,
-      xmlerror->message
-    );
-
-    return FALSE;
-  }
+  result = infd_filesystem_storage_write_xml_file(
+    storage,
+    "InfChat",
+    path,
+    doc,
+    error
+  );
 
-  infd_filesystem_storage_stream_close(stream);
   xmlFreeDoc(doc);
-  return TRUE;
+  return result;
 }
 
 /* vim:set et sw=2 ts=2: */
@@ -39,6 +39,7 @@
 #include <libinfinity/server/infd-request.h>
 #include <libinfinity/server/infd-progress-request.h>
 #include <libinfinity/common/inf-session.h>
+#include <libinfinity/common/inf-browser-private.h>
 #include <libinfinity/common/inf-chat-session.h>
 #include <libinfinity/common/inf-request-result.h>
 #include <libinfinity/common/inf-error.h>
@@ -59,6 +60,8 @@ typedef enum _InfdDirectoryNodeType {
   INFD_DIRECTORY_NODE_UNKNOWN,
 } InfdDirectoryNodeType;
 
+typedef struct _InfdDirectorySessionWrite InfdDirectorySessionWrite;
+
 typedef struct _InfdDirectoryNode InfdDirectoryNode;
 struct _InfdDirectoryNode {
   InfdDirectoryNode* parent;
@@ -71,6 +74,9 @@ struct _InfdDirectoryNode {
   InfdDirectoryNodeType type;
   guint id;
   gchar* name;
+  /* Increases with the time at which the node was linked into its parent,
+   * to find out whether a paged exploration has sent it already. */
+  guint serial;
 
   union {
     struct {
@@ -82,6 +88,17 @@ struct _InfdDirectoryNode {
       InfIoTimeout* save_timeout;
       /* Whether we hold a weak reference or a strong reference on session */
       gboolean weakref;
+      /* Position in the directory's list of linked sessions, or NULL */
+      GList* lru_link;
+      /* Time at which the session was last used, in microseconds */
+      gint64 last_used;
+      /* Estimated number of bytes the session occupies in memory */
+      gsize size;
+      /* Whether the buffer has been modified since size was estimated */
+      gboolean size_changed;
+      /* Background write of the session that has not finished yet, or
+       * NULL */
+      InfdDirectorySessionWrite* write;
     } note;
 
     struct {
@@ -95,6 +112,15 @@ struct _InfdDirectoryNode {
       GSList* connections;
       /* First child node */
       InfdDirectoryNode* child;
+      /* Child nodes by collation key of their case-folded name. Of several
+       * children with equal names, only the one linked last is indexed. */
+      GHashTable* children;
+      /* Number of children which are not indexed in the children table */
+      guint n_shadowed;
+      /* Serial for the next child to be linked */
+      guint n_links;
+      /* Explorations which have not yet sent all children */
+      GSList* pages;
       /* Whether we requested the node already from the background storage.
        * This is required because the nodes field may be NULL due to an empty
        * subdirectory or due to an unexplored subdirectory. */
@@ -103,6 +129,20 @@ struct _InfdDirectoryNode {
   } shared;
 };
 
+/* A connection exploring a subdirectory in pages. The connection is already
+ * notified of changes in the subdirectory, but the children starting from
+ * next have not been sent yet. */
+typedef struct _InfdDirectoryExplorePage InfdDirectoryExplorePage;
+struct _InfdDirectoryExplorePage {
+  InfXmlConnection* connection;
+  /* Sequence of the exploration request, or NULL */
+  gchar* seq;
+  /* Next child to be sent */
+  InfdDirectoryNode* next;
+  /* Number of children sent so far */
+  guint offset;
+};
+
 typedef struct _InfdDirectorySessionSaveTimeoutData
   InfdDirectorySessionSaveTimeoutData;
 struct _InfdDirectorySessionSaveTimeoutData {
@@ -110,6 +150,22 @@ struct _InfdDirectorySessionSaveTimeoutData {
   InfdDirectoryNode* node;
 };
 
+/* A session written with the note plugin's session_write_async */
+struct _InfdDirectorySessionWrite {
+  /* NULL if the result of the write is no longer of interest */
+  InfdDirectory* directory;
+  InfdDirectoryNode* node;
+
+  guint64 bytes;
+  gint64 start;
+
+  /* Whether to unlink the session once it has been written, and whether
+   * this evicts size bytes from memory */
+  gboolean unlink;
+  gboolean evict;
+  gsize size;
+};
+
 typedef struct _InfdDirectorySyncIn InfdDirectorySyncIn;
 struct _InfdDirectorySyncIn {
   InfdDirectory* directory;
@@ -202,11 +258,23 @@ struct _InfdDirectoryPrivate {
   GHashTable* nodes; /* Mapping from id to node */
   InfdDirectoryNode* root;
   InfAclSheetSet* orig_root_acl; /* in case root->acl is altered */
+  InfBrowserAclCache* acl_cache; /* effective permissions per account */
 
   GSList* sync_ins;
   GSList* subscription_requests;
 
   InfdSessionProxy* chat_session;
+
+  /* Linked sessions, least recently used first */
+  GQueue lru_sessions;
+  guint64 memory_budget;
+  gboolean evict_sessions_in_use;
+  guint64 memory_usage;
+  guint n_evictions;
+  guint64 evicted_bytes;
+  /* Bytes of sessions which are unlinked once their write has finished */
+  guint64 evicting_bytes;
+  InfIoTimeout* memory_timeout;
 };
 
 enum {
@@ -220,14 +288,22 @@ enum {
   PROP_PRIVATE_KEY,
   PROP_CERTIFICATE,
 
+  PROP_MEMORY_BUDGET,
+  PROP_EVICT_SESSIONS_IN_USE,
+
   /* read only */
   PROP_CHAT_SESSION,
-  PROP_STATUS
+  PROP_STATUS,
+  PROP_MEMORY_USAGE,
+  PROP_EVICTIONS,
+  PROP_EVICTED_BYTES
 };
 
 enum {
   CONNECTION_ADDED,
   CONNECTION_REMOVED,
+  SESSION_SAVED,
+  SESSION_EVICTED,
 
   LAST_SIGNAL
 };
@@ -279,6 +355,10 @@ static GQuark infd_directory_node_id_quark;
 /* TODO: This should be a property: */
 static const guint INFD_DIRECTORY_SAVE_TIMEOUT = 60000;
 
+/* Interval in which the memory usage of the linked sessions is compared to
+ * the memory budget, in milliseconds */
+static const guint INFD_DIRECTORY_MEMORY_CHECK_INTERVAL = 10000;
+
 static void infd_directory_communication_object_iface_init(InfCommunicationObjectInterface* iface);
 static void infd_directory_browser_iface_init(InfBrowserInterface* iface);
 G_DEFINE_TYPE_WITH_CODE(InfdDirectory, infd_directory, G_TYPE_OBJECT,
@@ -377,56 +457,386 @@ infd_directory_node_unlink_session(InfdDirectory* directory,
                                    InfdDirectoryNode* node,
                                    InfdRequest* request);
 
+/* Required by infd_directory_node_unload_session() */
 static void
-infd_directory_session_save_timeout_data_free(gpointer data)
+infd_directory_node_evict_session(InfdDirectory* directory,
+                                  InfdDirectoryNode* node);
+
+/* Stops waiting for the background write of the session of node, if there
+ * is one. Since it is not known whether that write succeeds, the session's
+ * buffer is marked modified, so that it is written again. */
+static void
+infd_directory_node_cancel_write(InfdDirectory* directory,
+                                 InfdDirectoryNode* node)
 {
-  g_slice_free(InfdDirectorySessionSaveTimeoutData, data);
+  InfdDirectoryPrivate* priv;
+  InfdDirectorySessionWrite* write;
+  InfSession* session;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  write = node->shared.note.write;
+
+  if(write != NULL)
+  {
+    g_assert(write->directory == directory);
+    g_assert(priv->evicting_bytes >= write->size);
+
+    write->directory = NULL;
+    node->shared.note.write = NULL;
+    priv->evicting_bytes -= write->size;
+
+    if(node->shared.note.session != NULL)
+    {
+      g_object_get(
+        G_OBJECT(node->shared.note.session),
+        "session", &session,
+        NULL
+      );
+
+      inf_buffer_set_modified(inf_session_get_buffer(session), TRUE);
+      g_object_unref(session);
+    }
+  }
 }
 
+/* Unlinks the session of node after it has been saved, either because it
+ * has been idle for some time, or to free memory if evict is TRUE. */
 static void
-infd_directory_session_save_timeout_func(gpointer user_data)
+infd_directory_node_unload_session(InfdDirectory* directory,
+                                   InfdDirectoryNode* node,
+                                   gboolean evict)
+{
+  if(evict == TRUE)
+    infd_directory_node_evict_session(directory, node);
+  else
+    infd_directory_node_unlink_session(directory, node, NULL);
+}
+
+/* Writes the session of node into the storage, unless its buffer has not
+ * been modified since it was last written or read. On success, the buffer's
+ * modified flag is unset, and the session-saved signal is emitted. A
+ * background write of the session which has not finished yet is superseded
+ * by this one, so that the session is stored when the function returns. */
+static gboolean
+infd_directory_node_save_session(InfdDirectory* directory,
+                                 InfdDirectoryNode* node,
+                                 GError** error)
 {
-  InfdDirectorySessionSaveTimeoutData* timeout_data;
   InfdDirectoryPrivate* priv;
-  GError* error;
+  InfBrowserIter iter;
+  InfSession* session;
+  InfBuffer* buffer;
   gchar* path;
+  guint64 bytes;
+  gint64 start;
   gboolean result;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  g_assert(priv->storage != NULL);
+  g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
+  g_assert(node->shared.note.session != NULL);
+
+  infd_directory_node_cancel_write(directory, node);
+
+  g_object_get(
+    G_OBJECT(node->shared.note.session),
+    "session", &session,
+    NULL
+  );
+
+  buffer = inf_session_get_buffer(session);
+  if(inf_buffer_get_modified(buffer) == FALSE)
+  {
+    g_object_unref(session);
+    return TRUE;
+  }
+
+  infd_directory_node_get_path(node, &path, NULL);
+
+  bytes = infd_storage_get_bytes_written(priv->storage);
+  start = g_get_monotonic_time();
+
+  result = node->shared.note.plugin->session_write(
+    priv->storage,
+    session,
+    path,
+    node->shared.note.plugin->user_data,
+    error
+  );
+
+  if(result == TRUE)
+  {
+    inf_buffer_set_modified(buffer, FALSE);
+
+    iter.node_id = node->id;
+    iter.node = node;
+
+    g_signal_emit(
+      directory,
+      directory_signals[SESSION_SAVED],
+      0,
+      &iter,
+      node->shared.note.session,
+      infd_storage_get_bytes_written(priv->storage) - bytes,
+      (guint64)(g_get_monotonic_time() - start)
+    );
+  }
+
+  g_object_unref(session);
+  g_free(path);
+  return result;
+}
+
+static void
+infd_directory_session_write_func(const GError* error,
+                                  gpointer user_data)
+{
+  InfdDirectorySessionWrite* write;
+  InfdDirectory* directory;
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryNode* node;
+  InfdSessionProxy* proxy;
+  InfBrowserIter iter;
   InfSession* session;
+  InfBuffer* buffer;
+  guint node_id;
+  gchar* path;
 
-  timeout_data = (InfdDirectorySessionSaveTimeoutData*)user_data;
+  write = (InfdDirectorySessionWrite*)user_data;
+  directory = write->directory;
 
-  g_assert(timeout_data->node->type == INFD_DIRECTORY_NODE_NOTE);
-  g_assert(timeout_data->node->shared.note.save_timeout != NULL);
-  priv = INFD_DIRECTORY_PRIVATE(timeout_data->directory);
-  error = NULL;
+  if(directory != NULL)
+  {
+    priv = INFD_DIRECTORY_PRIVATE(directory);
+    node = write->node;
+    node_id = node->id;
+
+    /* Writes are cancelled when the session is unlinked */
+    g_assert(node->shared.note.write == write);
+    g_assert(node->shared.note.session != NULL);
+    g_assert(node->shared.note.weakref == FALSE);
+
+    node->shared.note.write = NULL;
+    priv->evicting_bytes -= write->size;
+
+    proxy = node->shared.note.session;
+    g_object_ref(proxy);
+
+    g_object_get(G_OBJECT(proxy), "session", &session, NULL);
+    buffer = inf_session_get_buffer(session);
+
+    if(error != NULL)
+    {
+      /* Write it again next time */
+      inf_buffer_set_modified(buffer, TRUE);
+
+      infd_directory_node_get_path(node, &path, NULL);
+
+      g_warning(
+        _("Failed to save note \"%s\": %s\n\nKeeping it in memory. Another "
+          "save attempt will be made when the server is shut down."),
+        path,
+        error->message
+      );
+
+      g_free(path);
+    }
+    else
+    {
+      iter.node_id = node->id;
+      iter.node = node;
+
+      g_signal_emit(
+        directory,
+        directory_signals[SESSION_SAVED],
+        0,
+        &iter,
+        proxy,
+        infd_storage_get_bytes_written(priv->storage) - write->bytes,
+        (guint64)(g_get_monotonic_time() - write->start)
+      );
+
+      /* The signal handler might have removed the node, or unlinked the
+       * session. The session is also kept if it has been used or changed
+       * again since the write was started. */
+      node = g_hash_table_lookup(priv->nodes, GUINT_TO_POINTER(node_id));
+
+      if(write->unlink == TRUE && node != NULL &&
+         node->shared.note.session == proxy &&
+         node->shared.note.weakref == FALSE &&
+         node->shared.note.write == NULL &&
+         infd_session_proxy_is_idle(proxy) &&
+         inf_buffer_get_modified(buffer) == FALSE)
+      {
+        infd_directory_node_unload_session(directory, node, write->evict);
+      }
+    }
+
+    g_object_unref(session);
+    g_object_unref(proxy);
+  }
+
+  g_slice_free(InfdDirectorySessionWrite, write);
+}
+
+/* Saves the session of node like infd_directory_node_save_session(), but
+ * writes it in the background if the note plugin supports this. If unlink
+ * is TRUE, then the session is unlinked once it has been written, or
+ * evicted if evict is TRUE, unless it has been used or modified again in
+ * the meanwhile. If the background write fails, the session stays linked
+ * and modified, and a warning is emitted. Returns FALSE if the write could
+ * not be started. */
+static gboolean
+infd_directory_node_save_session_background(InfdDirectory* directory,
+                                            InfdDirectoryNode* node,
+                                            gboolean unlink,
+                                            gboolean evict,
+                                            GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  const InfdNotePlugin* plugin;
+  InfdDirectorySessionWrite* write;
+  InfSession* session;
+  InfBuffer* buffer;
+  gchar* path;
+  gboolean result;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  plugin = node->shared.note.plugin;
+
+  g_assert(priv->storage != NULL);
+  g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
+  g_assert(node->shared.note.session != NULL);
+  g_assert(node->shared.note.weakref == FALSE);
+
+  if(plugin->session_write_async == NULL)
+  {
+    if(!infd_directory_node_save_session(directory, node, error))
+      return FALSE;
+
+    if(unlink == TRUE)
+      infd_directory_node_unload_session(directory, node, evict);
 
-  infd_directory_node_get_path(timeout_data->node, &path, NULL);
+    return TRUE;
+  }
 
   g_object_get(
-    G_OBJECT(timeout_data->node->shared.note.session),
+    G_OBJECT(node->shared.note.session),
     "session", &session,
     NULL
   );
 
-  /* TODO: Only write if the buffer modified-flag is set */
+  buffer = inf_session_get_buffer(session);
+  write = node->shared.note.write;
+
+  if(inf_buffer_get_modified(buffer) == FALSE)
+  {
+    g_object_unref(session);
+
+    /* Nothing new to write, but a previous write might still be going on,
+     * in which case the session has to stay until that one has finished. */
+    if(write == NULL)
+    {
+      if(unlink == TRUE)
+        infd_directory_node_unload_session(directory, node, evict);
+    }
+    else if(unlink == TRUE)
+    {
+      write->unlink = TRUE;
+      if(evict == TRUE && write->evict == FALSE)
+      {
+        write->evict = TRUE;
+        write->size = node->shared.note.size;
+        priv->evicting_bytes += write->size;
+      }
+    }
+
+    return TRUE;
+  }
+
+  /* The new write contains everything the previous one does */
+  infd_directory_node_cancel_write(directory, node);
+
+  write = g_slice_new(InfdDirectorySessionWrite);
+  write->directory = directory;
+  write->node = node;
+  write->bytes = infd_storage_get_bytes_written(priv->storage);
+  write->start = g_get_monotonic_time();
+  write->unlink = unlink;
+  write->evict = unlink && evict;
+  write->size = write->evict ? node->shared.note.size : 0;
+
+  node->shared.note.write = write;
+  priv->evicting_bytes += write->size;
 
-  result = timeout_data->node->shared.note.plugin->session_write(
+  /* Changes made from now on are not part of this write */
+  inf_buffer_set_modified(buffer, FALSE);
+
+  infd_directory_node_get_path(node, &path, NULL);
+
+  result = plugin->session_write_async(
     priv->storage,
     session,
     path,
-    timeout_data->node->shared.note.plugin->user_data,
-    &error
+    plugin->user_data,
+    infd_directory_session_write_func,
+    write,
+    error
   );
 
+  g_free(path);
+
+  if(result == FALSE)
+  {
+    g_assert(node->shared.note.write == write);
+
+    node->shared.note.write = NULL;
+    priv->evicting_bytes -= write->size;
+    inf_buffer_set_modified(buffer, TRUE);
+
+    g_slice_free(InfdDirectorySessionWrite, write);
+  }
+
   g_object_unref(session);
+  return result;
+}
+
+static void
+infd_directory_session_save_timeout_data_free(gpointer data)
+{
+  g_slice_free(InfdDirectorySessionSaveTimeoutData, data);
+}
+
+static void
+infd_directory_session_save_timeout_func(gpointer user_data)
+{
+  InfdDirectorySessionSaveTimeoutData* timeout_data;
+  GError* error;
+  gchar* path;
+  gboolean result;
+
+  timeout_data = (InfdDirectorySessionSaveTimeoutData*)user_data;
 
-  /* TODO: Unset modified flag of buffer if result == TRUE */
+  g_assert(timeout_data->node->type == INFD_DIRECTORY_NODE_NOTE);
+  g_assert(timeout_data->node->shared.note.save_timeout != NULL);
+  error = NULL;
 
   /* The timeout is removed automatically after it has elapsed */
   timeout_data->node->shared.note.save_timeout = NULL;
 
+  result = infd_directory_node_save_session_background(
+    timeout_data->directory,
+    timeout_data->node,
+    TRUE,
+    FALSE,
+    &error
+  );
+
   if(result == FALSE)
   {
+    infd_directory_node_get_path(timeout_data->node, &path, NULL);
+
     g_warning(
       _("Failed to save note \"%s\": %s\n\nKeeping it in memory. Another "
         "save attempt will be made when the server is shut down."),
@@ -434,18 +844,9 @@ infd_directory_session_save_timeout_func(gpointer user_data)
       error->message
     );
 
+    g_free(path);
     g_error_free(error);
   }
-  else
-  {
-    infd_directory_node_unlink_session(
-      timeout_data->directory,
-      timeout_data->node,
-      NULL
-    );
-  }
-
-  g_free(path);
 }
 
 static void
@@ -472,6 +873,413 @@ infd_directory_start_session_save_timeout(InfdDirectory* directory,
   }
 }
 
+/*
+ * Memory budget
+ */
+
+static gsize
+infd_directory_node_get_session_size(InfdDirectoryNode* node)
+{
+  const InfdNotePlugin* plugin;
+  InfSession* session;
+  gsize size;
+
+  plugin = node->shared.note.plugin;
+  if(plugin->session_size == NULL)
+    return 0;
+
+  g_object_get(
+    G_OBJECT(node->shared.note.session),
+    "session", &session,
+    NULL
+  );
+
+  size = plugin->session_size(session, plugin->user_data);
+  g_object_unref(session);
+
+  return size;
+}
+
+/* Marks the session of node as used just now, moving it to the end of the
+ * list of linked sessions, or adding it to that list if it is not in it
+ * yet. */
+static void
+infd_directory_node_touch_session(InfdDirectory* directory,
+                                  InfdDirectoryNode* node)
+{
+  InfdDirectoryPrivate* priv;
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
+  g_assert(node->shared.note.session != NULL);
+  g_assert(node->shared.note.weakref == FALSE);
+
+  if(node->shared.note.lru_link != NULL)
+  {
+    g_queue_unlink(&priv->lru_sessions, node->shared.note.lru_link);
+  }
+  else
+  {
+    node->shared.note.lru_link = g_list_alloc();
+    node->shared.note.lru_link->data = node;
+    node->shared.note.size = infd_directory_node_get_session_size(node);
+    node->shared.note.size_changed = FALSE;
+    priv->memory_usage += node->shared.note.size;
+  }
+
+  g_queue_push_tail_link(&priv->lru_sessions, node->shared.note.lru_link);
+  node->shared.note.last_used = g_get_monotonic_time();
+}
+
+/* Removes the session of node from the list of linked sessions */
+static void
+infd_directory_node_forget_session(InfdDirectory* directory,
+                                   InfdDirectoryNode* node)
+{
+  InfdDirectoryPrivate* priv;
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
+
+  if(node->shared.note.lru_link != NULL)
+  {
+    g_queue_delete_link(&priv->lru_sessions, node->shared.note.lru_link);
+    g_assert(priv->memory_usage >= node->shared.note.size);
+    priv->memory_usage -= node->shared.note.size;
+
+    node->shared.note.lru_link = NULL;
+    node->shared.note.size = 0;
+  }
+}
+
+/* Returns the number of connections subscribed to the session of node */
+static guint
+infd_directory_node_count_subscribers(InfdDirectory* directory,
+                                      InfdDirectoryNode* node)
+{
+  InfdDirectoryPrivate* priv;
+  GHashTableIter conn_iter;
+  gpointer key;
+  guint n_subscribers;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  n_subscribers = 0;
+
+  g_hash_table_iter_init(&conn_iter, priv->connections);
+  while(g_hash_table_iter_next(&conn_iter, &key, NULL))
+  {
+    if(infd_session_proxy_is_subscribed(node->shared.note.session,
+                                        INF_XML_CONNECTION(key)))
+    {
+      ++n_subscribers;
+    }
+  }
+
+  return n_subscribers;
+}
+
+/* Returns the session to be evicted next, or NULL if there is none. Only
+ * idle sessions are considered, unless the evict-sessions-in-use property
+ * is set, in which case sessions in use are considered if no idle session
+ * is left. Among the idle sessions, it is the one for which the product of
+ * its size and the time since it was last used is largest, so that of two
+ * sessions that have not been used for about the same time the bigger one
+ * goes first. For sessions in use, this product is divided by the number
+ * of subscribers, so that the fewer users a session has, the earlier it is
+ * evicted. Sessions of unknown size are never evicted, and neither are
+ * sessions that are still being synchronized. */
+static InfdDirectoryNode*
+infd_directory_find_eviction_candidate(InfdDirectory* directory)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryNode* candidate;
+  InfdDirectoryNode* node;
+  InfSession* session;
+  InfSessionStatus status;
+  GList* item;
+  gint64 now;
+  gboolean idle;
+  gboolean candidate_idle;
+  guint n_subscribers;
+  gdouble score;
+  gdouble best_score;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  candidate = NULL;
+  candidate_idle = FALSE;
+  best_score = 0.0;
+  now = g_get_monotonic_time();
+
+  for(item = priv->lru_sessions.head; item != NULL; item = item->next)
+  {
+    node = (InfdDirectoryNode*)item->data;
+    if(node->shared.note.size == 0)
+      continue;
+    /* Evicted once the write has finished, if it is about to be */
+    if(node->shared.note.write != NULL && node->shared.note.write->evict)
+      continue;
+
+    idle = infd_session_proxy_is_idle(node->shared.note.session);
+    if(idle == FALSE && priv->evict_sessions_in_use == FALSE)
+      continue;
+    if(candidate_idle == TRUE && idle == FALSE)
+      continue;
+
+    score = (gdouble)(now - node->shared.note.last_used + 1) *
+            (gdouble)node->shared.note.size;
+
+    if(idle == FALSE)
+    {
+      g_object_get(
+        G_OBJECT(node->shared.note.session),
+        "session", &session,
+        NULL
+      );
+
+      status = inf_session_get_status(session);
+      g_object_unref(session);
+
+      if(status != INF_SESSION_RUNNING)
+        continue;
+
+      n_subscribers = infd_directory_node_count_subscribers(directory, node);
+      if(n_subscribers > 1)
+        score /= (gdouble)n_subscribers;
+    }
+
+    if(candidate == NULL || (idle == TRUE && candidate_idle == FALSE) ||
+       score > best_score)
+    {
+      candidate = node;
+      candidate_idle = idle;
+      best_score = score;
+    }
+  }
+
+  return candidate;
+}
+
+/* Required by infd_directory_node_evict_session() */
+static void
+infd_directory_release_session(InfdDirectory* directory,
+                               InfdDirectoryNode* node,
+                               InfdSessionProxy* session);
+
+/* Emits the session-evicted signal for the session of node, and unlinks it
+ * to free its memory. If the session is in use, which only happens if the
+ * evict-sessions-in-use property is set, it is closed, so that its
+ * subscribers are unsubscribed, and it is loaded from the storage again
+ * when it is subscribed to the next time. */
+static void
+infd_directory_node_evict_session(InfdDirectory* directory,
+                                  InfdDirectoryNode* node)
+{
+  InfdDirectoryPrivate* priv;
+  InfBrowserIter iter;
+  InfdSessionProxy* proxy;
+  InfSession* session;
+  gsize size;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  g_object_freeze_notify(G_OBJECT(directory));
+
+  size = node->shared.note.size;
+  iter.node_id = node->id;
+  iter.node = node;
+
+  g_signal_emit(
+    directory,
+    directory_signals[SESSION_EVICTED],
+    0,
+    &iter,
+    node->shared.note.session,
+    (guint64)size
+  );
+
+  /* The signal handler might have unlinked the session already */
+  if(node->shared.note.session != NULL &&
+     node->shared.note.weakref == FALSE)
+  {
+    proxy = node->shared.note.session;
+    if(infd_session_proxy_is_idle(proxy))
+    {
+      infd_directory_node_unlink_session(directory, node, NULL);
+    }
+    else
+    {
+      g_object_ref(proxy);
+      infd_directory_node_unlink_session(directory, node, NULL);
+
+      /* Do not re-use the closed session for the next subscription */
+      infd_directory_release_session(directory, node, proxy);
+
+      g_object_get(G_OBJECT(proxy), "session", &session, NULL);
+      inf_session_close(session);
+      g_object_unref(session);
+      g_object_unref(proxy);
+    }
+  }
+
+  ++priv->n_evictions;
+  priv->evicted_bytes += size;
+
+  g_object_notify(G_OBJECT(directory), "memory-usage");
+  g_object_notify(G_OBJECT(directory), "evictions");
+  g_object_notify(G_OBJECT(directory), "evicted-bytes");
+  g_object_thaw_notify(G_OBJECT(directory));
+}
+
+/* Updates the size estimates of the linked sessions that are in use or
+ * whose buffer has been modified since their size was estimated, and then
+ * saves and unlinks sessions until the estimated memory usage is within the
+ * budget again, or there are no sessions left to evict. A session whose
+ * size has changed is considered used just now. Idle sessions are written
+ * in the background, and unlinked once their write has finished, so their
+ * size is not counted towards the budget anymore in the meanwhile. Sessions
+ * in use are saved right away, since they might change while being
+ * written. */
+static void
+infd_directory_enforce_memory_budget(InfdDirectory* directory)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryNode* node;
+  GList* item;
+  GList* next;
+  GError* error;
+  gchar* path;
+  gsize size;
+  gboolean result;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  g_object_freeze_notify(G_OBJECT(directory));
+
+  for(item = priv->lru_sessions.head; item != NULL; item = next)
+  {
+    /* Touching a session moves it to the end of the list */
+    next = item->next;
+    node = (InfdDirectoryNode*)item->data;
+
+    if(node->shared.note.size_changed == TRUE ||
+       !infd_session_proxy_is_idle(node->shared.note.session))
+    {
+      node->shared.note.size_changed = FALSE;
+      size = infd_directory_node_get_session_size(node);
+      if(size != node->shared.note.size)
+      {
+        g_assert(priv->memory_usage >= node->shared.note.size);
+        priv->memory_usage -= node->shared.note.size;
+        priv->memory_usage += size;
+        node->shared.note.size = size;
+
+        infd_directory_node_touch_session(directory, node);
+        g_object_notify(G_OBJECT(directory), "memory-usage");
+      }
+    }
+  }
+
+  while(priv->storage != NULL && priv->memory_budget > 0 &&
+        priv->memory_usage > priv->memory_budget + priv->evicting_bytes)
+  {
+    node = infd_directory_find_eviction_candidate(directory);
+    if(node == NULL)
+      break;
+
+    error = NULL;
+    if(infd_session_proxy_is_idle(node->shared.note.session))
+    {
+      result = infd_directory_node_save_session_background(
+        directory,
+        node,
+        TRUE,
+        TRUE,
+        &error
+      );
+    }
+    else
+    {
+      result = infd_directory_node_save_session(directory, node, &error);
+
+      /* A session-saved handler might have unlinked the session already */
+      if(result == TRUE && node->shared.note.session != NULL &&
+         node->shared.note.weakref == FALSE)
+      {
+        infd_directory_node_evict_session(directory, node);
+      }
+    }
+
+    if(result == FALSE)
+    {
+      infd_directory_node_get_path(node, &path, NULL);
+
+      g_warning(
+        _("Failed to save note \"%s\": %s\n\nKeeping it in memory. Another "
+          "save attempt will be made when the server is shut down."),
+        path,
+        error->message
+      );
+
+      g_free(path);
+      g_error_free(error);
+      break;
+    }
+  }
+
+  g_object_thaw_notify(G_OBJECT(directory));
+}
+
+/* Required by infd_directory_memory_timeout_func() */
+static void
+infd_directory_schedule_memory_check(InfdDirectory* directory,
+                                     guint msecs);
+
+static void
+infd_directory_memory_timeout_func(gpointer user_data)
+{
+  InfdDirectory* directory;
+  InfdDirectoryPrivate* priv;
+
+  directory = INFD_DIRECTORY(user_data);
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  /* The timeout is removed automatically after it has elapsed */
+  priv->memory_timeout = NULL;
+
+  infd_directory_enforce_memory_budget(directory);
+
+  infd_directory_schedule_memory_check(
+    directory,
+    INFD_DIRECTORY_MEMORY_CHECK_INTERVAL
+  );
+}
+
+/* Makes the directory check its memory budget in msecs milliseconds, and
+ * then regularly. This replaces a previously scheduled check. If no memory
+ * budget is set, then any scheduled check is cancelled. */
+static void
+infd_directory_schedule_memory_check(InfdDirectory* directory,
+                                     guint msecs)
+{
+  InfdDirectoryPrivate* priv;
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  if(priv->memory_timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->io, priv->memory_timeout);
+    priv->memory_timeout = NULL;
+  }
+
+  if(priv->io != NULL && priv->memory_budget > 0)
+  {
+    priv->memory_timeout = inf_io_add_timeout(
+      priv->io,
+      msecs,
+      infd_directory_memory_timeout_func,
+      directory,
+      NULL
+    );
+  }
+}
+
 static void
 infd_directory_session_weak_ref_cb(gpointer data,
                                    GObject* where_the_object_was)
@@ -533,6 +1341,10 @@ infd_directory_session_idle_notify_cb(GObject* object,
       node->shared.note.save_timeout = NULL;
     }
   }
+
+  /* A session is in use until it becomes idle */
+  if(node->shared.note.weakref == FALSE)
+    infd_directory_node_touch_session(directory, node);
 }
 
 static gboolean
@@ -803,6 +1615,11 @@ infd_directory_announce_acl_sheets_for_connection(InfdDirectory* directory,
   }
 }
 
+/* Required by infd_directory_announce_acl_sheets() */
+static gboolean
+infd_directory_node_is_sent(InfdDirectoryNode* node,
+                            InfXmlConnection* connection);
+
 static void
 infd_directory_announce_acl_sheets(InfdDirectory* directory,
                                    InfdDirectoryNode* node,
@@ -849,7 +1666,10 @@ infd_directory_announce_acl_sheets(InfdDirectory* directory,
         local_item != NULL;
         local_item = g_slist_next(local_item))
     {
-      if(local_item->data != except)
+      /* Connections which have not yet received the node in a paged
+       * exploration get the new ACL together with the node. */
+      if(local_item->data != except &&
+         infd_directory_node_is_sent(node, local_item->data))
       {
         infd_directory_announce_acl_sheets_for_connection(
           directory,
@@ -1305,6 +2125,8 @@ infd_directory_verify_acl_for_node(InfdDirectory* directory,
 
     if(removed_sheets != NULL)
     {
+      _inf_browser_acl_cache_invalidate(priv->acl_cache);
+
       iter.node = node;
       iter.node_id = node->id;
 
@@ -1635,6 +2457,7 @@ infd_directory_update_root_acl(InfdDirectory* directory)
   {
     inf_acl_sheet_set_free(priv->root->acl);
     priv->root->acl = copy_set;
+    _inf_browser_acl_cache_invalidate(priv->acl_cache);
 
     infd_directory_announce_acl_sheets(
       directory,
@@ -1714,6 +2537,8 @@ infd_directory_read_root_acl(InfdDirectory* directory)
       sheet_set
     );
 
+    _inf_browser_acl_cache_invalidate(priv->acl_cache);
+
     if(priv->root->acl != NULL)
       priv->orig_root_acl = inf_acl_sheet_set_copy(priv->root->acl);
     else
@@ -1764,6 +2589,8 @@ infd_directory_read_root_acl(InfdDirectory* directory)
       sheet_set
     );
 
+    _inf_browser_acl_cache_invalidate(priv->acl_cache);
+
     infd_directory_announce_acl_sheets(
       directory,
       priv->root,
@@ -2021,7 +2848,6 @@ infd_directory_node_unlink_child_sessions(InfdDirectory* directory,
   InfdDirectoryNode* child;
   gchar* path;
   GError* error;
-  InfSession* session;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
@@ -2049,33 +2875,15 @@ infd_directory_node_unlink_child_sessions(InfdDirectory* directory,
     {
       if(save_notes)
       {
-        infd_directory_node_get_path(node, &path, NULL);
-
         error = NULL;
 
         if(priv->storage != NULL)
-        {
-          g_object_get(
-            G_OBJECT(node->shared.note.session),
-            "session", &session,
-            NULL
-          );
-
-          node->shared.note.plugin->session_write(
-            priv->storage,
-            session,
-            path,
-            node->shared.note.plugin->user_data,
-            &error
-          );
-
-          g_object_unref(session);
-        }
-
-        /* TODO: Unset modified flag of buffer if result == TRUE */
+          infd_directory_node_save_session(directory, node, &error);
 
         if(error != NULL)
         {
+          infd_directory_node_get_path(node, &path, NULL);
+
           /* There is not really anything we could do about it here. Of
            * course, any application should save the sessions explicitely
            * before shutting the directory down, so that it has the chance to
@@ -2089,10 +2897,9 @@ infd_directory_node_unlink_child_sessions(InfdDirectory* directory,
             error->message
           );
 
+          g_free(path);
           g_error_free(error);
         }
-
-        g_free(path);
       }
 
       if(node->shared.note.weakref == FALSE)
@@ -2109,10 +2916,28 @@ infd_directory_node_unlink_child_sessions(InfdDirectory* directory,
   }
 }
 
+/* Returns the key under which a node with the given name is indexed in its
+ * parent's children table. Two names have the same key if and only if
+ * infd_directory_node_name_equal() considers them equal. */
+static gchar*
+infd_directory_node_name_key(const gchar* name)
+{
+  gchar* folded;
+  gchar* key;
+
+  folded = g_utf8_casefold(name, -1);
+  key = g_utf8_collate_key(folded, -1);
+  g_free(folded);
+
+  return key;
+}
+
 static void
 infd_directory_node_link(InfdDirectoryNode* node,
                          InfdDirectoryNode* parent)
 {
+  gchar* key;
+
   g_return_if_fail(node != NULL);
   g_return_if_fail(parent != NULL);
   infd_directory_return_if_subdir_fail(parent);
@@ -2129,28 +2954,163 @@ infd_directory_node_link(InfdDirectoryNode* node,
   }
 
   parent->shared.subdir.child = node;
+  node->serial = parent->shared.subdir.n_links++;
+
+  if(parent->shared.subdir.children == NULL)
+  {
+    parent->shared.subdir.children =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  }
+
+  /* The node linked last shadows existing ones with the same name, as it
+   * comes first in the list of children. */
+  key = infd_directory_node_name_key(node->name);
+  if(g_hash_table_lookup(parent->shared.subdir.children, key) != NULL)
+    ++parent->shared.subdir.n_shadowed;
+  g_hash_table_replace(parent->shared.subdir.children, key, node);
 }
 
 static void
 infd_directory_node_unlink(InfdDirectoryNode* node)
 {
+  InfdDirectoryNode* parent;
+  InfdDirectoryExplorePage* page;
+  InfdDirectoryNode* sibling;
+  gchar* sibling_key;
+  gchar* key;
+  GSList* item;
+
   g_return_if_fail(node != NULL);
   g_return_if_fail(node->parent != NULL);
 
+  parent = node->parent;
+  g_assert(parent->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
+
+  for(item = parent->shared.subdir.pages; item != NULL; item = item->next)
+  {
+    page = (InfdDirectoryExplorePage*)item->data;
+    if(page->next == node)
+      page->next = node->next;
+  }
+
+  key = infd_directory_node_name_key(node->name);
+  if(g_hash_table_lookup(parent->shared.subdir.children, key) != node)
+  {
+    g_assert(parent->shared.subdir.n_shadowed > 0);
+    --parent->shared.subdir.n_shadowed;
+  }
+  else if(parent->shared.subdir.n_shadowed == 0)
+  {
+    g_hash_table_remove(parent->shared.subdir.children, key);
+  }
+  else
+  {
+    /* Another child has the same name. Index the one coming next in the
+     * list instead, which is the one linked last. */
+    g_hash_table_remove(parent->shared.subdir.children, key);
+    for(sibling = parent->shared.subdir.child;
+        sibling != NULL;
+        sibling = sibling->next)
+    {
+      if(sibling == node) continue;
+
+      sibling_key = infd_directory_node_name_key(sibling->name);
+      if(strcmp(sibling_key, key) == 0)
+      {
+        g_hash_table_insert(
+          parent->shared.subdir.children,
+          sibling_key,
+          sibling
+        );
+
+        --parent->shared.subdir.n_shadowed;
+        break;
+      }
+
+      g_free(sibling_key);
+    }
+  }
+
+  g_free(key);
+
   if(node->prev != NULL)
   {
     node->prev->next = node->next;
   }
   else 
   {
-    g_assert(node->parent->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
-    node->parent->shared.subdir.child = node->next;
+    parent->shared.subdir.child = node->next;
   }
 
   if(node->next != NULL)
     node->next->prev = node->prev;
 }
 
+static void
+infd_directory_explore_page_free(gpointer data)
+{
+  InfdDirectoryExplorePage* page;
+  page = (InfdDirectoryExplorePage*)data;
+
+  g_free(page->seq);
+  g_slice_free(InfdDirectoryExplorePage, page);
+}
+
+static InfdDirectoryExplorePage*
+infd_directory_node_find_page(InfdDirectoryNode* node,
+                              InfXmlConnection* connection)
+{
+  InfdDirectoryExplorePage* page;
+  GSList* item;
+
+  g_assert(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
+
+  for(item = node->shared.subdir.pages; item != NULL; item = item->next)
+  {
+    page = (InfdDirectoryExplorePage*)item->data;
+    if(page->connection == connection)
+      return page;
+  }
+
+  return NULL;
+}
+
+static void
+infd_directory_node_remove_page(InfdDirectoryNode* node,
+                                InfXmlConnection* connection)
+{
+  InfdDirectoryExplorePage* page;
+
+  page = infd_directory_node_find_page(node, connection);
+  if(page != NULL)
+  {
+    node->shared.subdir.pages =
+      g_slist_remove(node->shared.subdir.pages, page);
+    infd_directory_explore_page_free(page);
+  }
+}
+
+/* Returns whether connection knows about node, i.e. whether it is not still
+ * waiting for it in a paged exploration of the node's parent. */
+static gboolean
+infd_directory_node_is_sent(InfdDirectoryNode* node,
+                            InfXmlConnection* connection)
+{
+  InfdDirectoryExplorePage* page;
+
+  if(node->parent == NULL)
+    return TRUE;
+
+  page = infd_directory_node_find_page(node->parent, connection);
+  if(page == NULL || page->next == NULL)
+    return TRUE;
+
+  /* Children are sent in list order, which is the reverse order in which
+   * they were linked. Children linked after the page was begun are
+   * announced to the connection right away. */
+  return node->serial > page->next->serial;
+}
+
 /* This function takes ownership of name. If write_acl the ACL is written to
  * the storage. This should be used for newly created nodes, but for nodes
  * read from storage it should be false, since it is pointless to write
@@ -2197,6 +3157,7 @@ infd_directory_node_new_common(InfdDirectory* directory,
   {
     node->prev = NULL;
     node->next = NULL;
+    node->serial = 0;
   }
 
   g_hash_table_insert(priv->nodes, GUINT_TO_POINTER(node->id), node);
@@ -2225,6 +3186,10 @@ infd_directory_node_new_subdirectory(InfdDirectory* directory,
 
   node->shared.subdir.connections = NULL;
   node->shared.subdir.child = NULL;
+  node->shared.subdir.children = NULL;
+  node->shared.subdir.n_shadowed = 0;
+  node->shared.subdir.n_links = 0;
+  node->shared.subdir.pages = NULL;
   node->shared.subdir.explored = FALSE;
 
   return node;
@@ -2255,6 +3220,11 @@ infd_directory_node_new_note(InfdDirectory* directory,
   node->shared.note.plugin = plugin;
   node->shared.note.save_timeout = NULL;
   node->shared.note.weakref = FALSE;
+  node->shared.note.lru_link = NULL;
+  node->shared.note.last_used = 0;
+  node->shared.note.size = 0;
+  node->shared.note.size_changed = FALSE;
+  node->shared.note.write = NULL;
 
   return node;
 }
@@ -2317,6 +3287,12 @@ infd_directory_node_free(InfdDirectory* directory,
   {
   case INFD_DIRECTORY_NODE_SUBDIRECTORY:
     g_slist_free(node->shared.subdir.connections);
+    g_slist_free_full(
+      node->shared.subdir.pages,
+      infd_directory_explore_page_free
+    );
+
+    node->shared.subdir.pages = NULL;
 
     /* Free child nodes */
     if(node->shared.subdir.explored == TRUE)
@@ -2327,6 +3303,9 @@ infd_directory_node_free(InfdDirectory* directory,
       }
     }
 
+    if(node->shared.subdir.children != NULL)
+      g_hash_table_destroy(node->shared.subdir.children);
+
     break;
   case INFD_DIRECTORY_NODE_NOTE:
     /* Sessions must have been explicitely unlinked before; we might still
@@ -2428,6 +3407,8 @@ infd_directory_node_remove_connection(InfdDirectoryNode* node,
       item
     );
 
+    infd_directory_node_remove_page(node, connection);
+
     if(node->shared.subdir.explored == TRUE)
     {
       for(child = node->shared.subdir.child;
@@ -2540,6 +3521,7 @@ infd_directory_enforce_single_acl(InfdDirectory* directory,
       {
         node->shared.subdir.connections =
           g_slist_remove(node->shared.subdir.connections, connection);
+        infd_directory_node_remove_page(node, connection);
         retval = FALSE;
 
         /* If there are subscription requests to create a node into this node
@@ -2656,11 +3638,16 @@ infd_directory_enforce_single_acl(InfdDirectory* directory,
 /* Enforce ACL for the given node and all its children for info. If
  * reply_xml is set, then fill it with information about ACL for all
  * nodes for info's account. This is used when a connection is
- * switching accounts. */
+ * switching accounts.
+ *
+ * If revoked is not NULL, then it contains the permissions that info's
+ * account might have lost at node. Children whose own sheets define all of
+ * them do not inherit the change, so they and their children are skipped. */
 static void
 infd_directory_enforce_acl(InfdDirectory* directory,
                            InfXmlConnection* conn,
                            InfdDirectoryNode* node,
+                           const InfAclMask* revoked,
                            xmlNodePtr reply_xml)
 {
   InfdDirectoryPrivate* priv;
@@ -2668,13 +3655,19 @@ infd_directory_enforce_acl(InfdDirectory* directory,
   InfdDirectoryNode* child;
   InfdDirectoryConnectionInfo* info;
   InfAclAccountId account;
+  InfAclAccountId default_id;
+  InfAclMask child_revoked;
+  InfAclMask defined;
   const InfAclSheet* sheet;
   xmlNodePtr child_xml;
 
+  g_assert(revoked == NULL || reply_xml == NULL);
+
   priv = INFD_DIRECTORY_PRIVATE(directory);
   info = g_hash_table_lookup(priv->connections, conn);
   g_assert(info != NULL);
   account = info->account_id;
+  default_id = inf_acl_account_id_from_string("default");
 
   if(infd_directory_enforce_single_acl(directory, conn, node, TRUE) == TRUE)
   {
@@ -2682,7 +3675,40 @@ infd_directory_enforce_acl(InfdDirectory* directory,
 
     for(child = node->shared.subdir.child; child != NULL; child = child->next)
     {
-      infd_directory_enforce_acl(directory, conn, child, reply_xml);
+      if(revoked == NULL)
+      {
+        infd_directory_enforce_acl(directory, conn, child, NULL, reply_xml);
+        continue;
+      }
+
+      child_revoked = *revoked;
+      if(child->acl != NULL)
+      {
+        sheet = inf_acl_sheet_set_find_const_sheet(child->acl, account);
+        if(sheet != NULL)
+        {
+          inf_acl_mask_neg(&sheet->mask, &defined);
+          inf_acl_mask_and(&child_revoked, &defined, &child_revoked);
+        }
+
+        sheet = inf_acl_sheet_set_find_const_sheet(child->acl, default_id);
+        if(sheet != NULL)
+        {
+          inf_acl_mask_neg(&sheet->mask, &defined);
+          inf_acl_mask_and(&child_revoked, &defined, &child_revoked);
+        }
+      }
+
+      if(!inf_acl_mask_empty(&child_revoked))
+      {
+        infd_directory_enforce_acl(
+          directory,
+          conn,
+          child,
+          &child_revoked,
+          NULL
+        );
+      }
     }
   }
 
@@ -2706,6 +3732,133 @@ infd_directory_enforce_acl(InfdDirectory* directory,
   }
 }
 
+/* The permissions that are enforced on existing explorations,
+ * subscriptions and ACL queries when an ACL changes. */
+static void
+infd_directory_get_enforced_mask(InfAclMask* mask)
+{
+  inf_acl_mask_set1(mask, INF_ACL_CAN_EXPLORE_NODE);
+  inf_acl_mask_or1(mask, INF_ACL_CAN_SUBSCRIBE_SESSION);
+  inf_acl_mask_or1(mask, INF_ACL_CAN_QUERY_ACL);
+}
+
+static void
+infd_directory_free_mask(gpointer mask)
+{
+  g_slice_free(InfAclMask, mask);
+}
+
+/* Returns the enforced permissions at node for the accounts of all
+ * connections, before an ACL change is applied to node. */
+static GHashTable*
+infd_directory_get_enforced_perms(InfdDirectory* directory,
+                                  InfdDirectoryNode* node)
+{
+  InfdDirectoryPrivate* priv;
+  GHashTable* table;
+  GHashTableIter conn_iter;
+  gpointer key;
+  gpointer value;
+  InfdDirectoryConnectionInfo* info;
+  InfBrowserIter iter;
+  InfAclMask enforced;
+  InfAclMask perms;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  table = g_hash_table_new_full(NULL, NULL, NULL, infd_directory_free_mask);
+  infd_directory_get_enforced_mask(&enforced);
+
+  iter.node_id = node->id;
+  iter.node = node;
+
+  g_hash_table_iter_init(&conn_iter, priv->connections);
+  while(g_hash_table_iter_next(&conn_iter, NULL, &value))
+  {
+    info = (InfdDirectoryConnectionInfo*)value;
+    key = INF_ACL_ACCOUNT_ID_TO_POINTER(info->account_id);
+
+    if(!g_hash_table_contains(table, key))
+    {
+      inf_browser_check_acl(
+        INF_BROWSER(directory),
+        &iter,
+        info->account_id,
+        &enforced,
+        &perms
+      );
+
+      g_hash_table_insert(table, key, g_slice_dup(InfAclMask, &perms));
+    }
+  }
+
+  return table;
+}
+
+/* Enforces an ACL change at node, given the enforced permissions from
+ * before the change as returned by infd_directory_get_enforced_perms().
+ * A permission can only change for node's children if it changed for node
+ * itself, so only connections whose account lost one of the enforced
+ * permissions at node need to be checked, and only for those. */
+static void
+infd_directory_enforce_changed_acl(InfdDirectory* directory,
+                                   InfdDirectoryNode* node,
+                                   GHashTable* old_perms)
+{
+  InfdDirectoryPrivate* priv;
+  GHashTableIter conn_iter;
+  gpointer key;
+  gpointer value;
+  InfdDirectoryConnectionInfo* info;
+  InfBrowserIter iter;
+  InfAclMask enforced;
+  InfAclMask perms;
+  InfAclMask revoked;
+  const InfAclMask* old;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  infd_directory_get_enforced_mask(&enforced);
+
+  iter.node_id = node->id;
+  iter.node = node;
+
+  g_hash_table_iter_init(&conn_iter, priv->connections);
+  while(g_hash_table_iter_next(&conn_iter, &key, &value))
+  {
+    info = (InfdDirectoryConnectionInfo*)value;
+
+    old = g_hash_table_lookup(
+      old_perms,
+      INF_ACL_ACCOUNT_ID_TO_POINTER(info->account_id)
+    );
+
+    if(old == NULL)
+      old = &enforced;
+
+    inf_browser_check_acl(
+      INF_BROWSER(directory),
+      &iter,
+      info->account_id,
+      &enforced,
+      &perms
+    );
+
+    inf_acl_mask_neg(&perms, &revoked);
+    inf_acl_mask_and(&revoked, old, &revoked);
+
+    if(!inf_acl_mask_empty(&revoked))
+    {
+      infd_directory_enforce_acl(
+        directory,
+        (InfXmlConnection*)key,
+        node,
+        &revoked,
+        NULL
+      );
+    }
+  }
+}
+
 static InfdDirectoryTransientAccount*
 infd_directory_lookup_transient_account(InfdDirectory* directory,
                                         InfAclAccountId account)
@@ -2867,6 +4020,7 @@ infd_directory_change_acl_account(InfdDirectory* directory,
     directory,
     connection,
     priv->root,
+    NULL,
     is_default_account ? NULL : xml
   );
 
@@ -3196,6 +4350,7 @@ infd_directory_cleanup_acl_account(InfdDirectory* directory,
         directory,
         (InfXmlConnection*)key,
         priv->root,
+        NULL,
         NULL
       );
 
@@ -3477,6 +4632,40 @@ infd_directory_node_unregister_to_xml(InfdDirectoryNode* node)
   return xml;
 }
 
+/* Sends node to connection as part of an exploration of its parent */
+static void
+infd_directory_node_send_explored(InfdDirectory* directory,
+                                  InfdDirectoryNode* node,
+                                  InfXmlConnection* connection,
+                                  const gchar* seq)
+{
+  InfdDirectoryPrivate* priv;
+  xmlNodePtr xml;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  xml = infd_directory_node_register_to_xml(node);
+  if(seq != NULL)
+    inf_xml_util_set_attribute(xml, "seq", seq);
+
+  if(node->acl != NULL)
+  {
+    infd_directory_acl_sheets_to_xml_for_connection(
+      directory,
+      node->acl_connections,
+      node->acl,
+      connection,
+      xml
+    );
+  }
+
+  inf_communication_group_send_message(
+    INF_COMMUNICATION_GROUP(priv->group),
+    connection,
+    xml
+  );
+}
+
 static gboolean
 infd_directory_make_seq(InfdDirectory* directory,
                         InfXmlConnection* connection,
@@ -3586,6 +4775,7 @@ infd_directory_node_unregister(InfdDirectory* directory,
 {
   InfdDirectoryPrivate* priv;
   InfBrowserIter iter;
+  InfdDirectoryExplorePage* page;
   xmlNodePtr xml;
   GSList* item;
 
@@ -3606,6 +4796,24 @@ infd_directory_node_unregister(InfdDirectory* directory,
       item != NULL;
       item = g_slist_next(item))
   {
+    /* If the connection is still waiting for the node in a paged
+     * exploration, then send it now, so that the number of explored nodes
+     * matches the announced total. */
+    if(!infd_directory_node_is_sent(node, INF_XML_CONNECTION(item->data)))
+    {
+      page = infd_directory_node_find_page(node->parent, item->data);
+      infd_directory_node_send_explored(
+        directory,
+        node,
+        INF_XML_CONNECTION(item->data),
+        page->seq
+      );
+
+      ++page->offset;
+      if(page->next == node)
+        page->next = node->next;
+    }
+
     inf_communication_group_send_message(
       INF_COMMUNICATION_GROUP(priv->group),
       INF_XML_CONNECTION(item->data),
@@ -3702,27 +4910,17 @@ infd_directory_sync_in_synchronization_complete_cb(InfSession* session,
   infd_directory_node_link_session(directory, node, request, proxy);
 
   /* Save session initially */
-  infd_directory_node_get_path(node, &path, NULL);
-
   error = NULL;
 
   if(priv->storage != NULL)
-  {
-    ret = sync_in->plugin->session_write(
-      priv->storage,
-      session,
-      path,
-      sync_in->plugin->user_data,
-      &error
-    );
-  }
+    ret = infd_directory_node_save_session(directory, node, &error);
   else
-  {
     ret = TRUE;
-  }
 
   if(ret == FALSE)
   {
+    infd_directory_node_get_path(node, &path, NULL);
+
     /* Note that while indeed this may fail in theory we have already
      * (successfully) written the session before we started the sync-in, so
      * the name of the node is accepted by the storage backend. */
@@ -3734,11 +4932,10 @@ infd_directory_sync_in_synchronization_complete_cb(InfSession* session,
       error->message
     );
 
+    g_free(path);
     g_error_free(error);
   }
 
-  g_free(path);
-
   iter.node_id = node->id;
   iter.node = node;
 
@@ -4223,13 +5420,17 @@ infd_directory_node_find_child_by_name(InfdDirectoryNode* parent,
 {
   InfdDirectoryNode* node;
 
+  gchar* key;
+
   infd_directory_return_val_if_subdir_fail(parent, NULL);
+  if(parent->shared.subdir.children == NULL)
+    return NULL;
 
-  for(node = parent->shared.subdir.child; node != NULL; node = node->next)
-    if(infd_directory_node_name_equal(node->name, name))
-      return node;
+  key = infd_directory_node_name_key(name);
+  node = g_hash_table_lookup(parent->shared.subdir.children, key);
+  g_free(key);
 
-  return NULL;
+  return node;
 }
 
 /* Checks whether a node with the given name can be created in the given
@@ -5559,7 +6760,62 @@ infd_directory_get_node_from_xml_typed(InfdDirectory* directory,
     }
   }
 
-  return node;
+  return node;
+}
+
+/* Sends the next limit children of node to the connection of page, or all
+ * of them if limit is 0. Then, either ends the exploration and frees page,
+ * or tells the connection to ask for the next page. */
+static void
+infd_directory_node_send_page(InfdDirectory* directory,
+                              InfdDirectoryNode* node,
+                              InfdDirectoryExplorePage* page,
+                              guint limit)
+{
+  InfdDirectoryPrivate* priv;
+  xmlNodePtr reply_xml;
+  guint n;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  for(n = 0; page->next != NULL && (limit == 0 || n < limit); ++n)
+  {
+    infd_directory_node_send_explored(
+      directory,
+      page->next,
+      page->connection,
+      page->seq
+    );
+
+    page->next = page->next->next;
+    ++page->offset;
+  }
+
+  if(page->next != NULL)
+  {
+    reply_xml = xmlNewNode(NULL, (const xmlChar*)"explore-continue");
+    inf_xml_util_set_attribute_uint(reply_xml, "offset", page->offset);
+  }
+  else
+  {
+    reply_xml = xmlNewNode(NULL, (const xmlChar*)"explore-end");
+  }
+
+  if(page->seq != NULL)
+    inf_xml_util_set_attribute(reply_xml, "seq", page->seq);
+
+  inf_communication_group_send_message(
+    INF_COMMUNICATION_GROUP(priv->group),
+    page->connection,
+    reply_xml
+  );
+
+  if(page->next == NULL)
+  {
+    node->shared.subdir.pages =
+      g_slist_remove(node->shared.subdir.pages, page);
+    infd_directory_explore_page_free(page);
+  }
 }
 
 static gboolean
@@ -5571,15 +6827,16 @@ infd_directory_handle_explore_node(InfdDirectory* directory,
   InfdDirectoryPrivate* priv;
   InfdDirectoryNode* node;
   InfAclMask perms;
-  GSList* item;
   InfdProgressRequest* request;
   InfBrowserIter iter;
   GError* local_error;
-  InfdDirectoryNode* child;
+  InfdDirectoryExplorePage* page;
   xmlNodePtr reply_xml;
   gchar* seq;
   guint total;
-  const InfAclSheetSet* sheet_set;
+  guint limit;
+  guint offset;
+  gboolean has_offset;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
@@ -5597,6 +6854,62 @@ infd_directory_handle_explore_node(InfdDirectory* directory,
   if(!infd_directory_check_auth(directory, node, connection, &perms, error))
     return FALSE;
 
+  /* The client can ask for the children in pages of limit nodes. With
+   * offset set, it asks for the next page of an exploration it began
+   * earlier. */
+  local_error = NULL;
+  if(!inf_xml_util_get_attribute_uint(xml, "limit", &limit, &local_error))
+  {
+    if(local_error != NULL)
+    {
+      g_propagate_error(error, local_error);
+      return FALSE;
+    }
+
+    limit = 0;
+  }
+
+  has_offset =
+    inf_xml_util_get_attribute_uint(xml, "offset", &offset, &local_error);
+  if(local_error != NULL)
+  {
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  if(has_offset == TRUE)
+  {
+    page = infd_directory_node_find_page(node, connection);
+    if(page == NULL)
+    {
+      g_set_error_literal(
+        error,
+        inf_directory_error_quark(),
+        INF_DIRECTORY_ERROR_NOT_EXPLORED,
+        _("There is no exploration of this node to be continued")
+      );
+
+      return FALSE;
+    }
+
+    if(page->offset != offset)
+    {
+      g_set_error(
+        error,
+        inf_directory_error_quark(),
+        INF_DIRECTORY_ERROR_UNEXPECTED_MESSAGE,
+        _("Exploration continues at offset %u, but %u nodes have been sent"),
+        offset,
+        page->offset
+      );
+
+      return FALSE;
+    }
+
+    infd_directory_node_send_page(directory, node, page, limit);
+    return TRUE;
+  }
+
   if(node->shared.subdir.explored == FALSE)
   {
     request = INFD_PROGRESS_REQUEST(
@@ -5617,7 +6930,6 @@ infd_directory_handle_explore_node(InfdDirectory* directory,
       INF_REQUEST(request)
     );
 
-    local_error = NULL;
     infd_directory_node_explore(directory, node, request, &local_error);
     g_object_unref(request);
 
@@ -5644,11 +6956,15 @@ infd_directory_handle_explore_node(InfdDirectory* directory,
     return FALSE;
 
   total = 0;
-  for(child = node->shared.subdir.child; child != NULL; child = child->next)
-    ++ total;
+  if(node->shared.subdir.children != NULL)
+  {
+    total = g_hash_table_size(node->shared.subdir.children) +
+      node->shared.subdir.n_shadowed;
+  }
 
   reply_xml = xmlNewNode(NULL, (const xmlChar*)"explore-begin");
   inf_xml_util_set_attribute_uint(reply_xml, "total", total);
+
   if(seq != NULL)
     inf_xml_util_set_attribute(reply_xml, "seq", seq);
 
@@ -5658,48 +6974,26 @@ infd_directory_handle_explore_node(InfdDirectory* directory,
     reply_xml
   );
 
-  for(child = node->shared.subdir.child; child != NULL; child = child->next)
-  {
-    reply_xml = infd_directory_node_register_to_xml(child);
-    if(seq != NULL)
-      inf_xml_util_set_attribute(reply_xml, "seq", seq);
-
-    if(child->acl != NULL)
-    {
-      infd_directory_acl_sheets_to_xml_for_connection(
-        directory,
-        child->acl_connections,
-        child->acl,
-        connection,
-        reply_xml
-      );
-    }
-
-    inf_communication_group_send_message(
-      INF_COMMUNICATION_GROUP(priv->group),
-      connection,
-      reply_xml
-    );
-  }
-
-  reply_xml = xmlNewNode(NULL, (const xmlChar*)"explore-end");
-
-  if(seq != NULL) inf_xml_util_set_attribute(reply_xml, "seq", seq);
-
-  inf_communication_group_send_message(
-    INF_COMMUNICATION_GROUP(priv->group),
-    connection,
-    reply_xml
-  );
-
   /* Remember that this connection explored that node so that it gets
-   * notified when changes occur. */
+   * notified when changes occur. This already happens before all children
+   * are sent, so that changes between the pages are not missed. */
   node->shared.subdir.connections = g_slist_prepend(
     node->shared.subdir.connections,
     connection
   );
 
-  g_free(seq);
+  page = g_slice_new(InfdDirectoryExplorePage);
+  page->connection = connection;
+  page->seq = seq;
+  page->next = node->shared.subdir.child;
+  page->offset = 0;
+
+  node->shared.subdir.pages = g_slist_prepend(
+    node->shared.subdir.pages,
+    page
+  );
+
+  infd_directory_node_send_page(directory, node, page, limit);
   return TRUE;
 }
 
@@ -6172,9 +7466,7 @@ infd_directory_handle_save_session(InfdDirectory* directory,
   InfdDirectoryPrivate* priv;
   InfdDirectoryNode* node;
   xmlNodePtr reply_xml;
-  gchar* path;
   gchar* seq;
-  InfSession* session;
   gboolean result;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
@@ -6190,8 +7482,6 @@ infd_directory_handle_save_session(InfdDirectory* directory,
     return FALSE;
   }
 
-  /* TODO: Don't do anything if buffer is not modified */
-
   /* TODO: Authentication, we could also allow specific connections to save
    * without being subscribed. */
   node = infd_directory_get_node_from_xml_typed(
@@ -6233,35 +7523,17 @@ infd_directory_handle_save_session(InfdDirectory* directory,
   );
 #endif
 
-  infd_directory_node_get_path(node, &path, NULL);
-
-  g_object_get(
-    G_OBJECT(node->shared.note.session),
-    "session", &session,
-    NULL
-  );
-
   /* TODO: Make a request */
 
-  result = node->shared.note.plugin->session_write(
-    priv->storage,
-    session,
-    path,
-    node->shared.note.plugin->user_data,
-    error
-  );
-
-  g_object_unref(session);
-
-  /* TODO: unset modified flag of buffer if result == TRUE */
+  /* This does not write anything if the buffer has not been modified
+   * since it was last saved. */
+  result = infd_directory_node_save_session(directory, node, error);
 
   /* The timeout should only be set when there aren't any connections
    * subscribed, however we just made sure that the connection the request
    * comes from is subscribed. */
   g_assert(node->shared.note.save_timeout == NULL);
 
-  g_free(path);
-
   if(result == FALSE)
     return FALSE;
   if(!infd_directory_make_seq(directory, connection, xml, &seq, error))
@@ -7004,14 +8276,7 @@ infd_directory_handle_set_acl(InfdDirectory* directory,
   InfAclSheetSet* sheet_set;
   InfdRequest* request;
   InfBrowserIter iter;
-  InfAclAccountId default_id;
-  const InfAclSheet* default_sheet;
-  const InfAclSheet* account_sheet;
-  GHashTableIter conn_iter;
-  gpointer key;
-  gpointer value;
-  InfXmlConnection* conn;
-  InfdDirectoryConnectionInfo* info;
+  GHashTable* old_perms;
   xmlNodePtr reply_xml;
   guint i;
   const InfAclSheet* sheet;
@@ -7108,7 +8373,11 @@ infd_directory_handle_set_acl(InfdDirectory* directory,
     INF_REQUEST(request)
   );
 
+  old_perms = infd_directory_get_enforced_perms(directory, node);
+
   node->acl = inf_acl_sheet_set_merge_sheets(node->acl, sheet_set);
+  _inf_browser_acl_cache_invalidate(priv->acl_cache);
+
   if(node == priv->root)
   {
     priv->orig_root_acl = inf_acl_sheet_set_merge_sheets(
@@ -7118,26 +8387,8 @@ infd_directory_handle_set_acl(InfdDirectory* directory,
   }
 
   /* Apply the effect of the new ACL */
-  default_id = inf_acl_account_id_from_string("default");
-  default_sheet = inf_acl_sheet_set_find_const_sheet(sheet_set, default_id);
-
-  g_hash_table_iter_init(&conn_iter, priv->connections);
-  while(g_hash_table_iter_next(&conn_iter, &key, &value))
-  {
-    conn = (InfXmlConnection*)key;
-    info = (InfdDirectoryConnectionInfo*)value;
-
-    if(default_sheet == NULL)
-    {
-      account_sheet = inf_acl_sheet_set_find_const_sheet(
-        sheet_set,
-        info->account_id
-      );
-    }
-
-    if(default_sheet != NULL || account_sheet != NULL)
-      infd_directory_enforce_acl(directory, conn, node, NULL);
-  }
+  infd_directory_enforce_changed_acl(directory, node, old_perms);
+  g_hash_table_destroy(old_perms);
 
   /* Announce to all connections but this one, since for this connection we
    * need to set the seq (done below) */
@@ -8543,6 +9794,7 @@ infd_directory_init(InfdDirectory* directory)
 
   priv->node_counter = 1;
   priv->nodes = g_hash_table_new(NULL, NULL);
+  priv->acl_cache = _inf_browser_acl_cache_new();
 
   /* The root node has no name. At this point we also create the root node
    * with no ACL. The ACL is read from storage in the constructor, or if no
@@ -8561,6 +9813,15 @@ infd_directory_init(InfdDirectory* directory)
   priv->subscription_requests = NULL;
 
   priv->chat_session = NULL;
+
+  g_queue_init(&priv->lru_sessions);
+  priv->memory_budget = 0;
+  priv->evict_sessions_in_use = FALSE;
+  priv->memory_usage = 0;
+  priv->n_evictions = 0;
+  priv->evicted_bytes = 0;
+  priv->evicting_bytes = 0;
+  priv->memory_timeout = NULL;
 }
 
 static void
@@ -8667,6 +9928,12 @@ infd_directory_dispose(GObject* object)
   if(priv->chat_session != NULL)
     infd_directory_enable_chat(directory, FALSE);
 
+  if(priv->memory_timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->io, priv->memory_timeout);
+    priv->memory_timeout = NULL;
+  }
+
   /* This frees the complete directory tree and saves sessions into the
    * storage. */
   infd_directory_node_unlink_child_sessions(
@@ -8679,6 +9946,7 @@ infd_directory_dispose(GObject* object)
   infd_directory_set_storage(directory, NULL);
   infd_directory_set_account_storage(directory, NULL);
 
+  g_assert(g_queue_is_empty(&priv->lru_sessions));
   g_assert(priv->root != NULL);
   infd_directory_node_free(directory, priv->root);
   priv->root = NULL;
@@ -8733,6 +10001,7 @@ infd_directory_finalize(GObject* object)
     g_free(priv->transient_accounts[i].dn);
   }
   g_free(priv->transient_accounts);
+  _inf_browser_acl_cache_free(priv->acl_cache);
 
   G_OBJECT_CLASS(infd_directory_parent_class)->finalize(object);
 }
@@ -8782,8 +10051,19 @@ infd_directory_set_property(GObject* object,
   case PROP_CERTIFICATE:
     priv->certificate = (InfCertificateChain*)g_value_dup_boxed(value);
     break;
+  case PROP_MEMORY_BUDGET:
+    priv->memory_budget = g_value_get_uint64(value);
+    infd_directory_schedule_memory_check(directory, 0);
+    break;
+  case PROP_EVICT_SESSIONS_IN_USE:
+    priv->evict_sessions_in_use = g_value_get_boolean(value);
+    infd_directory_schedule_memory_check(directory, 0);
+    break;
   case PROP_CHAT_SESSION:
   case PROP_STATUS:
+  case PROP_MEMORY_USAGE:
+  case PROP_EVICTIONS:
+  case PROP_EVICTED_BYTES:
     /* read only */
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
@@ -8826,9 +10106,24 @@ infd_directory_get_property(GObject* object,
   case PROP_CHAT_SESSION:
     g_value_set_object(value, G_OBJECT(priv->chat_session));
     break;
+  case PROP_MEMORY_BUDGET:
+    g_value_set_uint64(value, priv->memory_budget);
+    break;
+  case PROP_EVICT_SESSIONS_IN_USE:
+    g_value_set_boolean(value, priv->evict_sessions_in_use);
+    break;
   case PROP_STATUS:
     g_value_set_enum(value, INF_BROWSER_OPEN);
     break;
+  case PROP_MEMORY_USAGE:
+    g_value_set_uint64(value, priv->memory_usage);
+    break;
+  case PROP_EVICTIONS:
+    g_value_set_uint(value, priv->n_evictions);
+    break;
+  case PROP_EVICTED_BYTES:
+    g_value_set_uint64(value, priv->evicted_bytes);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -8848,12 +10143,23 @@ infd_directory_communication_object_received(InfCommunicationObject* object,
   InfdDirectoryPrivate* priv;
   GError* local_error;
   xmlNodePtr reply_xml;
+  xmlChar* version;
   gchar* seq;
 
   directory = INFD_DIRECTORY(object);
   priv = INFD_DIRECTORY_PRIVATE(directory);
   local_error = NULL;
 
+  /* Clients announce their protocol version with requests that lead to a
+   * session being synchronized to them, so that the synchronization can
+   * make use of newer protocol features. */
+  version = inf_xml_util_get_attribute(node, "protocol-version");
+  if(version != NULL)
+  {
+    inf_protocol_set_remote_version(connection, (const gchar*)version, NULL);
+    xmlFree(version);
+  }
+
   if(strcmp((const char*)node->name, "explore-node") == 0)
   {
     infd_directory_handle_explore_node(
@@ -9027,6 +10333,21 @@ infd_directory_communication_object_received(InfCommunicationObject* object,
  * InfBrowser implementation
  */
 
+static void
+infd_directory_buffer_modified_notify_cb(GObject* object,
+                                         GParamSpec* pspec,
+                                         gpointer user_data)
+{
+  InfdDirectoryNode* node;
+  node = (InfdDirectoryNode*)user_data;
+
+  /* Estimate the size again with the next memory check. Sessions in use
+   * are estimated with every check anyway, but idle sessions can be
+   * changed locally as well. */
+  if(inf_buffer_get_modified(INF_BUFFER(object)))
+    node->shared.note.size_changed = TRUE;
+}
+
 static void
 infd_directory_browser_subscribe_session(InfBrowser* browser,
                                          const InfBrowserIter* iter,
@@ -9034,6 +10355,7 @@ infd_directory_browser_subscribe_session(InfBrowser* browser,
                                          InfRequest* request)
 {
   InfdDirectoryNode* node;
+  InfSession* session;
 
   /* If iter is NULL then we are linking the global chat session, which is
    * already taken care of directly by infd_directory_enable_chat(), and
@@ -9086,6 +10408,17 @@ infd_directory_browser_subscribe_session(InfBrowser* browser,
       G_CALLBACK(infd_directory_session_reject_user_join_cb),
       INFD_DIRECTORY(browser)
     );
+
+    g_object_get(G_OBJECT(proxy), "session", &session, NULL);
+
+    g_signal_connect(
+      G_OBJECT(inf_session_get_buffer(session)),
+      "notify::modified",
+      G_CALLBACK(infd_directory_buffer_modified_notify_cb),
+      node
+    );
+
+    g_object_unref(session);
   
     /* TODO: Drop the session if it gets closed; don't even weak-ref
      * it in that case */
@@ -9094,6 +10427,10 @@ infd_directory_browser_subscribe_session(InfBrowser* browser,
     {
       infd_directory_start_session_save_timeout(INFD_DIRECTORY(browser), node);
     }
+
+    /* Check soon whether other sessions need to make room for this one */
+    infd_directory_node_touch_session(INFD_DIRECTORY(browser), node);
+    infd_directory_schedule_memory_check(INFD_DIRECTORY(browser), 0);
   }
 }
 
@@ -9106,6 +10443,7 @@ infd_directory_browser_unsubscribe_session(InfBrowser* browser,
   InfdDirectory* directory;
   InfdDirectoryPrivate* priv;
   InfdDirectoryNode* node;
+  InfSession* session;
 
   directory = INFD_DIRECTORY(browser);
   priv = INFD_DIRECTORY_PRIVATE(directory);
@@ -9133,6 +10471,22 @@ infd_directory_browser_unsubscribe_session(InfBrowser* browser,
       node->shared.note.save_timeout = NULL;
     }
 
+    /* If the session is unlinked while it is written in the background,
+     * such as when its node is removed, then the outcome of the write does
+     * not matter anymore. */
+    infd_directory_node_cancel_write(directory, node);
+    infd_directory_node_forget_session(directory, node);
+
+    g_object_get(G_OBJECT(proxy), "session", &session, NULL);
+
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(inf_session_get_buffer(session)),
+      G_CALLBACK(infd_directory_buffer_modified_notify_cb),
+      node
+    );
+
+    g_object_unref(session);
+
     g_object_weak_ref(
       G_OBJECT(node->shared.note.session),
       infd_directory_session_weak_ref_cb,
@@ -10371,6 +11725,31 @@ infd_directory_browser_has_acl(InfBrowser* browser,
   return TRUE;
 }
 
+static gboolean
+infd_directory_browser_check_acl(InfBrowser* browser,
+                                 const InfBrowserIter* iter,
+                                 InfAclAccountId account,
+                                 const InfAclMask* check_mask,
+                                 InfAclMask* out_mask)
+{
+  InfdDirectory* directory;
+  InfdDirectoryPrivate* priv;
+
+  directory = INFD_DIRECTORY(browser);
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  infd_directory_return_val_if_iter_fail(directory, iter, FALSE);
+
+  return _inf_browser_acl_cache_check(
+    priv->acl_cache,
+    browser,
+    iter,
+    account,
+    check_mask,
+    out_mask
+  );
+}
+
 static const InfAclSheetSet*
 infd_directory_browser_get_acl(InfBrowser* browser,
                                const InfBrowserIter* iter)
@@ -10400,6 +11779,7 @@ infd_directory_browser_set_acl(InfBrowser* browser,
   InfdDirectoryNode* node;
   InfdRequest* request;
   InfAclSheetSet* copy_set;
+  GHashTable* old_perms;
   GError* error;
 
   directory = INFD_DIRECTORY(browser);
@@ -10465,7 +11845,11 @@ infd_directory_browser_set_acl(InfBrowser* browser,
     inf_acl_sheet_set_free(copy_set);
   }
 
+  old_perms = infd_directory_get_enforced_perms(directory, node);
+
   node->acl = inf_acl_sheet_set_merge_sheets(node->acl, sheet_set);
+  _inf_browser_acl_cache_invalidate(priv->acl_cache);
+
   if(node == priv->root)
   {
     priv->orig_root_acl = inf_acl_sheet_set_merge_sheets(
@@ -10474,6 +11858,9 @@ infd_directory_browser_set_acl(InfBrowser* browser,
     );
   }
 
+  infd_directory_enforce_changed_acl(directory, node, old_perms);
+  g_hash_table_destroy(old_perms);
+
   infd_directory_announce_acl_sheets(
     directory,
     node,
@@ -10510,6 +11897,8 @@ infd_directory_class_init(InfdDirectoryClass* directory_class)
 
   directory_class->connection_added = NULL;
   directory_class->connection_removed = NULL;
+  directory_class->session_saved = NULL;
+  directory_class->session_evicted = NULL;
 
   infd_directory_node_id_quark =
     g_quark_from_static_string("INFD_DIRECTORY_NODE_ID");
@@ -10597,6 +11986,79 @@ infd_directory_class_init(InfdDirectoryClass* directory_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_MEMORY_BUDGET,
+    g_param_spec_uint64(
+      "memory-budget",
+      "Memory budget",
+      "Estimated number of bytes that linked sessions may occupy before "
+      "the least recently used ones are saved and unloaded, or 0 for no "
+      "limit",
+      0,
+      G_MAXUINT64,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_EVICT_SESSIONS_IN_USE,
+    g_param_spec_boolean(
+      "evict-sessions-in-use",
+      "Evict sessions in use",
+      "Whether sessions with subscribers are saved and closed when the "
+      "memory budget is exceeded and no idle session is left, which "
+      "unsubscribes their users",
+      FALSE,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_MEMORY_USAGE,
+    g_param_spec_uint64(
+      "memory-usage",
+      "Memory usage",
+      "Estimated number of bytes occupied by linked sessions",
+      0,
+      G_MAXUINT64,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_EVICTIONS,
+    g_param_spec_uint(
+      "evictions",
+      "Evictions",
+      "Number of sessions unloaded to stay within the memory budget",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_EVICTED_BYTES,
+    g_param_spec_uint64(
+      "evicted-bytes",
+      "Evicted bytes",
+      "Estimated number of bytes freed by unloading sessions to stay "
+      "within the memory budget",
+      0,
+      G_MAXUINT64,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
   /**
    * InfdDirectory::connection-added:
    * @directory: The #InfdDirectory emitting the signal.
@@ -10639,6 +12101,65 @@ infd_directory_class_init(InfdDirectoryClass* directory_class)
     INF_TYPE_XML_CONNECTION
   );
 
+  /**
+   * InfdDirectory::session-saved:
+   * @directory: The #InfdDirectory emitting the signal.
+   * @iter: A #InfBrowserIter pointing to the note whose session was saved.
+   * @proxy: The #InfdSessionProxy of the saved session.
+   * @bytes: The number of bytes written to the storage, or 0 if the storage
+   * does not keep track of it.
+   * @duration: The time it took to write the session, in microseconds.
+   *
+   * This signal is emitted whenever the directory has written a session into
+   * its storage, either because a client or infd_directory_iter_save_session()
+   * requested it, or before unloading an idle session. It is not emitted
+   * when a session is not written because its buffer was not modified.
+   **/
+  directory_signals[SESSION_SAVED] = g_signal_new(
+    "session-saved",
+    G_OBJECT_CLASS_TYPE(object_class),
+    G_SIGNAL_RUN_LAST,
+    G_STRUCT_OFFSET(InfdDirectoryClass, session_saved),
+    NULL, NULL,
+    NULL,
+    G_TYPE_NONE,
+    4,
+    INF_TYPE_BROWSER_ITER | G_SIGNAL_TYPE_STATIC_SCOPE,
+    INFD_TYPE_SESSION_PROXY,
+    G_TYPE_UINT64,
+    G_TYPE_UINT64
+  );
+
+  /**
+   * InfdDirectory::session-evicted:
+   * @directory: The #InfdDirectory emitting the signal.
+   * @iter: A #InfBrowserIter pointing to the note whose session is evicted.
+   * @proxy: The #InfdSessionProxy of the evicted session.
+   * @size: The estimated number of bytes the session occupies in memory.
+   *
+   * This signal is emitted when a session is unloaded before its save
+   * timeout has elapsed, because the sessions of @directory exceed the
+   * #InfdDirectory:memory-budget. The session has already been saved at
+   * this point, and is unlinked from the directory right after the signal
+   * has been emitted. Only idle sessions are evicted, unless
+   * #InfdDirectory:evict-sessions-in-use is set. In that case, if @proxy
+   * still has subscriptions, its session is closed after it has been
+   * unlinked, so that the subscribed clients are unsubscribed.
+   **/
+  directory_signals[SESSION_EVICTED] = g_signal_new(
+    "session-evicted",
+    G_OBJECT_CLASS_TYPE(object_class),
+    G_SIGNAL_RUN_LAST,
+    G_STRUCT_OFFSET(InfdDirectoryClass, session_evicted),
+    NULL, NULL,
+    NULL,
+    G_TYPE_NONE,
+    3,
+    INF_TYPE_BROWSER_ITER | G_SIGNAL_TYPE_STATIC_SCOPE,
+    INFD_TYPE_SESSION_PROXY,
+    G_TYPE_UINT64
+  );
+
   g_object_class_override_property(object_class, PROP_STATUS, "status");
 }
 
@@ -10695,6 +12216,7 @@ infd_directory_browser_iface_init(InfBrowserInterface* iface)
   iface->has_acl = infd_directory_browser_has_acl;
   iface->get_acl = infd_directory_browser_get_acl;
   iface->set_acl = infd_directory_browser_set_acl;
+  iface->check_acl = infd_directory_browser_check_acl;
 }
 
 /*
@@ -10904,6 +12426,11 @@ infd_directory_add_plugin(InfdDirectory* directory,
       node->shared.note.plugin = plugin;
       node->shared.note.save_timeout = NULL;
       node->shared.note.weakref = FALSE;
+      node->shared.note.lru_link = NULL;
+      node->shared.note.last_used = 0;
+      node->shared.note.size = 0;
+      node->shared.note.size_changed = FALSE;
+      node->shared.note.write = NULL;
     }
   }
 
@@ -11299,7 +12826,10 @@ infd_directory_foreach_connection(InfdDirectory* directory,
  * @error: Location to store error information.
  *
  * Attempts to store the session the node @iter points to represents into the
- * background storage.
+ * background storage. If the session's buffer has not been modified since it
+ * was last stored or read, then nothing is written. Otherwise, the modified
+ * flag of the buffer is unset and #InfdDirectory::session-saved is emitted
+ * once the session has been stored successfully.
  *
  * Returns: %TRUE if the operation succeeded, %FALSE otherwise.
  */
@@ -11310,9 +12840,6 @@ infd_directory_iter_save_session(InfdDirectory* directory,
 {
   InfdDirectoryPrivate* priv;
   InfdDirectoryNode* node;
-  gchar* path;
-  InfSession* session;
-  gboolean result;
 
   g_return_val_if_fail(INFD_IS_DIRECTORY(directory), FALSE);
   infd_directory_return_val_if_iter_fail(directory, iter, FALSE);
@@ -11320,6 +12847,7 @@ infd_directory_iter_save_session(InfdDirectory* directory,
   priv = INFD_DIRECTORY_PRIVATE(directory);
   node = (InfdDirectoryNode*)iter->node;
   g_return_val_if_fail(node->type == INFD_DIRECTORY_NODE_NOTE, FALSE);
+  g_return_val_if_fail(node->shared.note.session != NULL, FALSE);
 
   if(priv->storage == NULL)
   {
@@ -11333,27 +12861,7 @@ infd_directory_iter_save_session(InfdDirectory* directory,
     return FALSE;
   }
 
-  infd_directory_node_get_path(node, &path, NULL);
-
-  g_object_get(
-    G_OBJECT(node->shared.note.session),
-    "session", &session,
-    NULL
-  );
-
-  result = node->shared.note.plugin->session_write(
-    priv->storage,
-    session,
-    path,
-    node->shared.note.plugin->user_data,
-    error
-  );
-
-  /* TODO: Unset modified flag of buffer if result == TRUE */
-
-  g_object_unref(session);
-  g_free(path);
-  return result;
+  return infd_directory_node_save_session(directory, node, error);
 }
 
 /**
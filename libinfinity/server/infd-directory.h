@@ -49,6 +49,10 @@ typedef struct _InfdDirectoryClass InfdDirectoryClass;
  * #InfdDirectory::connection-added signal.
  * @connection_removed: Default signal handler for the
  * #InfdDirectory::connection-removed signal.
+ * @session_saved: Default signal handler for the
+ * #InfdDirectory::session-saved signal.
+ * @session_evicted: Default signal handler for the
+ * #InfdDirectory::session-evicted signal.
  *
  * Default signal handlers for #InfdDirectory.
  */
@@ -61,6 +65,15 @@ struct _InfdDirectoryClass {
                            InfXmlConnection* connection);
   void (*connection_removed)(InfdDirectory* directory,
                              InfXmlConnection* connection);
+  void (*session_saved)(InfdDirectory* directory,
+                        const InfBrowserIter* iter,
+                        InfdSessionProxy* proxy,
+                        guint64 bytes,
+                        guint64 duration);
+  void (*session_evicted)(InfdDirectory* directory,
+                          const InfBrowserIter* iter,
+                          InfdSessionProxy* proxy,
+                          guint64 size);
 };
 
 /**
@@ -27,12 +27,15 @@
  * This class implements the #InfdAccountStorage interface via an underlying
  * #InfdFilesystemStorage. It uses the &quot;root-directory&quot; of that
  * underlying storage to store an XML file there which contains the account
- * information.
+ * information. Changes to accounts are appended to a journal next to that
+ * file, which is merged into the file once it has grown large enough, so
+ * that the cost of a change does not depend on the number of accounts.
  *
  * This is a simple implementation of an account storage which keeps all
- * accounts read from the file in memory. When you have more than a thousand
- * accounts or so you should start thinking of using a more sophisticated
- * account storage, for example a database backend.
+ * accounts read from the file in memory, indexed by ID, name and
+ * certificate. When you have many more accounts than fit into memory you
+ * should start thinking of using a more sophisticated account storage, for
+ * example a database backend.
  **/
 
 #include <libinfinity/server/infd-filesystem-account-storage.h>
@@ -46,6 +49,13 @@
 #include <gnutls/crypto.h>
 
 #include <string.h>
+#include <errno.h>
+
+#ifdef G_OS_WIN32
+# include <io.h>
+#else
+# include <unistd.h>
+#endif
 
 typedef struct _InfdFilesystemAccountStorageAccountInfo
   InfdFilesystemAccountStorageAccountInfo;
@@ -68,6 +78,13 @@ struct _InfdFilesystemAccountStoragePrivate {
   GHashTable* accounts_by_certificate; /* by certificate DN */
   GHashTable* accounts_by_name; /* by name */
   /* Note that we require names to be unique */
+
+  /* ID of the account file the journal belongs to, or NULL if the next
+   * change needs to write the account file again */
+  gchar* checkpoint_id;
+  /* 0 if the journal file needs to be created from scratch */
+  gsize journal_size;
+  guint journal_records;
 };
 
 enum {
@@ -470,6 +487,7 @@ infd_filesystem_account_storage_hash_password(const gchar* password,
 
 static GHashTable*
 infd_filesystem_account_storage_load_file(InfdFilesystemStorage* storage,
+                                          gchar** checkpoint_id,
                                           GError** error)
 {
   GHashTable* table;
@@ -479,6 +497,7 @@ infd_filesystem_account_storage_load_file(InfdFilesystemStorage* storage,
   xmlNodePtr child;
   InfdFilesystemAccountStorageAccountInfo* info;
   gpointer id_ptr;
+  xmlChar* journal_id;
 
   table = g_hash_table_new_full(
     NULL,
@@ -505,6 +524,7 @@ infd_filesystem_account_storage_load_file(InfdFilesystemStorage* storage,
       /* The account file does not exist. This is not an error, but just means
        * the account list is empty. */
       g_error_free(local_error);
+      *checkpoint_id = NULL;
       return table;
     }
 
@@ -551,6 +571,19 @@ infd_filesystem_account_storage_load_file(InfdFilesystemStorage* storage,
     }
   }
 
+  /* Account files written before the journal was introduced do not have a
+   * journal ID, so that the first change writes the file again. */
+  journal_id = inf_xml_util_get_attribute(root, "journal-id");
+  if(journal_id != NULL)
+  {
+    *checkpoint_id = g_strdup((const gchar*)journal_id);
+    xmlFree(journal_id);
+  }
+  else
+  {
+    *checkpoint_id = NULL;
+  }
+
   xmlFreeDoc(doc);
   return table;
 }
@@ -623,6 +656,7 @@ infd_filesystem_account_storage_xref_account_table(GHashTable* accounts,
 static gboolean
 infd_filesystem_account_storage_store_file(InfdFilesystemStorage* storage,
                                            GHashTable* table,
+                                           const gchar* journal_id,
                                            GError** error)
 {
   xmlNodePtr root;
@@ -645,6 +679,8 @@ infd_filesystem_account_storage_store_file(InfdFilesystemStorage* storage,
     infd_filesystem_account_storage_account_info_to_xml(info, child);
   }
 
+  inf_xml_util_set_attribute(root, "journal-id", journal_id);
+
   doc = xmlNewDoc((const xmlChar*)"1.0");
   xmlDocSetRootElement(doc, root);
 
@@ -660,6 +696,858 @@ infd_filesystem_account_storage_store_file(InfdFilesystemStorage* storage,
   return result;
 }
 
+/*
+ * Journal
+ */
+
+/* Instead of writing the whole account file for every change, changed and
+ * removed accounts are appended to a journal next to it. The journal file
+ * starts with this magic, followed by the version and the journal ID of the
+ * account file it belongs to. After that, there is one record for each
+ * change. All numbers are stored as little endian. */
+#define INFD_FILESYSTEM_ACCOUNT_STORAGE_JOURNAL_MAGIC "INFA"
+#define INFD_FILESYSTEM_ACCOUNT_STORAGE_JOURNAL_VERSION 1
+
+/* The account file is written again as soon as the journal has more records
+ * than there are accounts, but not before the journal reaches this size. */
+#define INFD_FILESYSTEM_ACCOUNT_STORAGE_JOURNAL_MIN_CHECKPOINT_SIZE \
+  (64 * 1024)
+
+typedef enum _InfdFilesystemAccountStorageJournalRecord {
+  /* id, name, certificates, salt, hash, first seen, last seen; replaces the
+   * account with the same ID, if any */
+  INFD_FILESYSTEM_ACCOUNT_STORAGE_JOURNAL_RECORD_ACCOUNT = 'a',
+  /* id */
+  INFD_FILESYSTEM_ACCOUNT_STORAGE_JOURNAL_RECORD_REMOVE = 'r'
+} InfdFilesystemAccountStorageJournalRecord;
+
+static void
+infd_filesystem_account_storage_journal_append_uint32(GByteArray* array,
+                                                      guint32 value)
+{
+  value = GUINT32_TO_LE(value);
+  g_byte_array_append(array, (const guint8*)&value, 4);
+}
+
+static void
+infd_filesystem_account_storage_journal_append_uint64(GByteArray* array,
+                                                      guint64 value)
+{
+  value = GUINT64_TO_LE(value);
+  g_byte_array_append(array, (const guint8*)&value, 8);
+}
+
+static void
+infd_filesystem_account_storage_journal_append_string(GByteArray* array,
+                                                      gconstpointer data,
+                                                      guint32 len)
+{
+  infd_filesystem_account_storage_journal_append_uint32(array, len);
+  g_byte_array_append(array, (const guint8*)data, len);
+}
+
+static gboolean
+infd_filesystem_account_storage_journal_parse_uint32(const guint8** data,
+                                                     const guint8* end,
+                                                     guint32* value)
+{
+  if(end - *data < 4)
+    return FALSE;
+
+  memcpy(value, *data, 4);
+  *value = GUINT32_FROM_LE(*value);
+  *data += 4;
+  return TRUE;
+}
+
+static gboolean
+infd_filesystem_account_storage_journal_parse_uint64(const guint8** data,
+                                                     const guint8* end,
+                                                     guint64* value)
+{
+  if(end - *data < 8)
+    return FALSE;
+
+  memcpy(value, *data, 8);
+  *value = GUINT64_FROM_LE(*value);
+  *data += 8;
+  return TRUE;
+}
+
+/* Returns a newly allocated, nul-terminated copy of the string at *data */
+static gboolean
+infd_filesystem_account_storage_journal_parse_string(const guint8** data,
+                                                     const guint8* end,
+                                                     gchar** str,
+                                                     guint32* len)
+{
+  if(!infd_filesystem_account_storage_journal_parse_uint32(data, end, len))
+    return FALSE;
+  if((guint32)(end - *data) < *len)
+    return FALSE;
+
+  *str = g_malloc(*len + 1);
+  memcpy(*str, *data, *len);
+  (*str)[*len] = '\0';
+  *data += *len;
+  return TRUE;
+}
+
+static void
+infd_filesystem_account_storage_journal_append_account(
+  GByteArray* array,
+  const InfdFilesystemAccountStorageAccountInfo* info)
+{
+  const gchar* id;
+  guint8 type;
+  guint i;
+
+  id = inf_acl_account_id_to_string(info->id);
+
+  type = INFD_FILESYSTEM_ACCOUNT_STORAGE_JOURNAL_RECORD_ACCOUNT;
+  g_byte_array_append(array, &type, 1);
+
+  infd_filesystem_account_storage_journal_append_string(
+    array,
+    id,
+    strlen(id)
+  );
+
+  infd_filesystem_account_storage_journal_append_string(
+    array,
+    info->name,
+    strlen(info->name)
+  );
+
+  infd_filesystem_account_storage_journal_append_uint32(
+    array,
+    info->n_certificates
+  );
+
+  for(i = 0; i < info->n_certificates; ++i)
+  {
+    infd_filesystem_account_storage_journal_append_string(
+      array,
+      info->certificates[i],
+      strlen(info->certificates[i])
+    );
+  }
+
+  /* Either both or none of salt and hash are set */
+  if(info->password_salt != NULL)
+  {
+    infd_filesystem_account_storage_journal_append_string(
+      array,
+      info->password_salt,
+      32
+    );
+
+    infd_filesystem_account_storage_journal_append_string(
+      array,
+      info->password_hash,
+      gnutls_hash_get_len(GNUTLS_DIG_SHA256)
+    );
+  }
+  else
+  {
+    infd_filesystem_account_storage_journal_append_string(array, NULL, 0);
+    infd_filesystem_account_storage_journal_append_string(array, NULL, 0);
+  }
+
+  infd_filesystem_account_storage_journal_append_uint64(
+    array,
+    info->first_seen
+  );
+
+  infd_filesystem_account_storage_journal_append_uint64(
+    array,
+    info->last_seen
+  );
+}
+
+/* Parses the account record at *data, not including the record type. Returns
+ * NULL if the record is incomplete, or if it is invalid, in which case
+ * error is set. */
+static InfdFilesystemAccountStorageAccountInfo*
+infd_filesystem_account_storage_journal_parse_account(const guint8** data,
+                                                      const guint8* end,
+                                                      GError** error)
+{
+  InfdFilesystemAccountStorageAccountInfo* info;
+  gchar* str;
+  guint32 len;
+  guint32 n_certificates;
+  guint64 seen;
+  gboolean result;
+
+  if(!infd_filesystem_account_storage_journal_parse_string(data, end,
+                                                           &str, &len))
+    return NULL;
+
+  info = g_slice_new(InfdFilesystemAccountStorageAccountInfo);
+  info->id = inf_acl_account_id_from_string(str);
+  info->name = NULL;
+  info->certificates = NULL;
+  info->n_certificates = 0;
+  info->password_salt = NULL;
+  info->password_hash = NULL;
+  info->first_seen = 0;
+  info->last_seen = 0;
+  g_free(str);
+
+  result = infd_filesystem_account_storage_journal_parse_string(
+    data,
+    end,
+    &info->name,
+    &len
+  );
+
+  if(result == TRUE)
+  {
+    result = infd_filesystem_account_storage_journal_parse_uint32(
+      data,
+      end,
+      &n_certificates
+    );
+  }
+
+  /* Every certificate takes at least four bytes, which protects against
+   * allocating huge arrays for a torn record. */
+  if(result == TRUE && (guint32)(end - *data) / 4 < n_certificates)
+    result = FALSE;
+
+  if(result == TRUE)
+  {
+    info->certificates = g_malloc(sizeof(gchar*) * n_certificates);
+    while(result == TRUE && info->n_certificates < n_certificates)
+    {
+      result = infd_filesystem_account_storage_journal_parse_string(
+        data,
+        end,
+        &info->certificates[info->n_certificates],
+        &len
+      );
+
+      if(result == TRUE)
+        ++info->n_certificates;
+    }
+  }
+
+  if(result == TRUE)
+  {
+    result = infd_filesystem_account_storage_journal_parse_string(
+      data,
+      end,
+      &info->password_salt,
+      &len
+    );
+
+    if(result == TRUE && len == 0)
+    {
+      g_free(info->password_salt);
+      info->password_salt = NULL;
+    }
+    else if(result == TRUE && len != 32)
+    {
+      g_set_error_literal(
+        error,
+        infd_filesystem_account_storage_error_quark(),
+        INFD_FILESYSTEM_ACCOUNT_STORAGE_ERROR_INVALID_FORMAT,
+        _("The length of the password salt is incorrect, it should "
+          "be 32 bytes")
+      );
+
+      result = FALSE;
+    }
+  }
+
+  if(result == TRUE)
+  {
+    result = infd_filesystem_account_storage_journal_parse_string(
+      data,
+      end,
+      &info->password_hash,
+      &len
+    );
+
+    if(result == TRUE && len == 0)
+    {
+      g_free(info->password_hash);
+      info->password_hash = NULL;
+    }
+    else if(result == TRUE &&
+            len != gnutls_hash_get_len(GNUTLS_DIG_SHA256))
+    {
+      g_set_error(
+        error,
+        infd_filesystem_account_storage_error_quark(),
+        INFD_FILESYSTEM_ACCOUNT_STORAGE_ERROR_INVALID_FORMAT,
+        _("The length of the password hash is incorrect, it should be "
+          "%u bytes"),
+        (unsigned int)gnutls_hash_get_len(GNUTLS_DIG_SHA256)
+      );
+
+      result = FALSE;
+    }
+  }
+
+  if(result == TRUE &&
+     (info->password_salt == NULL) != (info->password_hash == NULL))
+  {
+    g_set_error_literal(
+      error,
+      infd_filesystem_account_storage_error_quark(),
+      INFD_FILESYSTEM_ACCOUNT_STORAGE_ERROR_INVALID_FORMAT,
+      _("If one of \"password-hash\" or \"password-salt\" is provided, the "
+        "other must be provided as well.")
+    );
+
+    result = FALSE;
+  }
+
+  if(result == TRUE)
+  {
+    result = infd_filesystem_account_storage_journal_parse_uint64(
+      data,
+      end,
+      &seen
+    );
+
+    info->first_seen = seen;
+  }
+
+  if(result == TRUE)
+  {
+    result = infd_filesystem_account_storage_journal_parse_uint64(
+      data,
+      end,
+      &seen
+    );
+
+    info->last_seen = seen;
+  }
+
+  if(result == FALSE)
+  {
+    infd_filesystem_account_storage_account_info_free(info);
+    return NULL;
+  }
+
+  return info;
+}
+
+/* Applies the records in data to accounts. Returns the number of bytes of
+ * complete records, or -1 on error. */
+static gssize
+infd_filesystem_account_storage_journal_replay(GHashTable* accounts,
+                                               const guint8* data,
+                                               gsize len,
+                                               guint* n_records,
+                                               GError** error)
+{
+  const guint8* begin;
+  const guint8* record;
+  const guint8* end;
+  InfdFilesystemAccountStorageAccountInfo* info;
+  GError* local_error;
+  gchar* str;
+  guint32 str_len;
+
+  begin = data;
+  end = data + len;
+  local_error = NULL;
+
+  while(data < end)
+  {
+    record = data++;
+    switch(*record)
+    {
+    case INFD_FILESYSTEM_ACCOUNT_STORAGE_JOURNAL_RECORD_ACCOUNT:
+      info = infd_filesystem_account_storage_journal_parse_account(
+        &data,
+        end,
+        &local_error
+      );
+
+      if(info == NULL)
+      {
+        if(local_error != NULL)
+        {
+          g_propagate_error(error, local_error);
+          return -1;
+        }
+
+        return record - begin;
+      }
+
+      g_hash_table_replace(
+        accounts,
+        INF_ACL_ACCOUNT_ID_TO_POINTER(info->id),
+        info
+      );
+
+      break;
+    case INFD_FILESYSTEM_ACCOUNT_STORAGE_JOURNAL_RECORD_REMOVE:
+      if(!infd_filesystem_account_storage_journal_parse_string(&data, end,
+                                                               &str,
+                                                               &str_len))
+        return record - begin;
+
+      g_hash_table_remove(
+        accounts,
+        INF_ACL_ACCOUNT_ID_TO_POINTER(inf_acl_account_id_from_string(str))
+      );
+
+      g_free(str);
+      break;
+    default:
+      g_set_error(
+        error,
+        infd_filesystem_account_storage_error_quark(),
+        INFD_FILESYSTEM_ACCOUNT_STORAGE_ERROR_INVALID_FORMAT,
+        _("Unknown record type '%c' in account journal"),
+        *record
+      );
+
+      return -1;
+    }
+
+    ++*n_records;
+  }
+
+  return data - begin;
+}
+
+/* Applies the journal belonging to the account file with the given
+ * checkpoint ID to accounts. If the journal cannot be appended to, then
+ * *checkpoint_id is reset to NULL. */
+static gboolean
+infd_filesystem_account_storage_journal_read(InfdFilesystemStorage* storage,
+                                             GHashTable* accounts,
+                                             gchar** checkpoint_id,
+                                             gsize* journal_size,
+                                             guint* journal_records,
+                                             GError** error)
+{
+  gchar* full_path;
+  gchar* contents;
+  gsize length;
+  GError* local_error;
+  const guint8* data;
+  const guint8* end;
+  guint32 version;
+  gchar* str;
+  guint32 str_len;
+  gboolean matches;
+  gssize replayed;
+
+  *journal_size = 0;
+  *journal_records = 0;
+
+  /* Without a journal ID in the account file, any journal is left over from
+   * before the account file was written without one, or removed. */
+  if(*checkpoint_id == NULL)
+    return TRUE;
+
+  full_path = infd_filesystem_storage_get_path(
+    storage,
+    "journal",
+    "/accounts",
+    error
+  );
+
+  if(full_path == NULL)
+    return FALSE;
+
+  local_error = NULL;
+  if(!g_file_get_contents(full_path, &contents, &length, &local_error))
+  {
+    g_free(full_path);
+
+    /* No journal means there were no changes since the account file was
+     * written. */
+    if(local_error->domain == G_FILE_ERROR &&
+       local_error->code == G_FILE_ERROR_NOENT)
+    {
+      g_error_free(local_error);
+      return TRUE;
+    }
+
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  g_free(full_path);
+
+  data = (const guint8*)contents;
+  end = data + length;
+
+  /* A journal that does not belong to the account file is left over from
+   * before the account file was written, and its changes are contained in
+   * the account file already. It is recreated with the next change. */
+  matches = FALSE;
+  if(length >= 4 &&
+     memcmp(data, INFD_FILESYSTEM_ACCOUNT_STORAGE_JOURNAL_MAGIC, 4) == 0)
+  {
+    data += 4;
+    if(infd_filesystem_account_storage_journal_parse_uint32(&data, end,
+                                                            &version) &&
+       version == INFD_FILESYSTEM_ACCOUNT_STORAGE_JOURNAL_VERSION &&
+       infd_filesystem_account_storage_journal_parse_string(&data, end,
+                                                            &str, &str_len))
+    {
+      matches = strcmp(str, *checkpoint_id) == 0;
+      g_free(str);
+    }
+  }
+
+  if(matches == FALSE)
+  {
+    g_free(contents);
+    return TRUE;
+  }
+
+  replayed = infd_filesystem_account_storage_journal_replay(
+    accounts,
+    data,
+    end - data,
+    journal_records,
+    error
+  );
+
+  if(replayed < 0)
+  {
+    g_prefix_error(error, _("Error processing account journal: "));
+    g_free(contents);
+    return FALSE;
+  }
+
+  if(data + replayed == end)
+  {
+    *journal_size = length;
+  }
+  else
+  {
+    /* The last record is incomplete. Appending to the journal would leave
+     * it in between, so write the account file instead. */
+    g_free(*checkpoint_id);
+    *checkpoint_id = NULL;
+  }
+
+  g_free(contents);
+  return TRUE;
+}
+
+/* Writes the whole account list, and starts a new, empty journal for it */
+static gboolean
+infd_filesystem_account_storage_journal_checkpoint(
+  InfdFilesystemAccountStorage* storage,
+  GError** error)
+{
+  InfdFilesystemAccountStoragePrivate* priv;
+  gchar* checkpoint_id;
+
+  priv = INFD_FILESYSTEM_ACCOUNT_STORAGE_PRIVATE(storage);
+
+  checkpoint_id = g_strdup_printf(
+    "%08x%08x",
+    (guint)g_random_int(),
+    (guint)g_random_int()
+  );
+
+  if(!infd_filesystem_account_storage_store_file(priv->filesystem,
+                                                 priv->accounts,
+                                                 checkpoint_id,
+                                                 error))
+  {
+    g_free(checkpoint_id);
+    return FALSE;
+  }
+
+  g_free(priv->checkpoint_id);
+  priv->checkpoint_id = checkpoint_id;
+  priv->journal_size = 0;
+  priv->journal_records = 0;
+  return TRUE;
+}
+
+/* Flushes the data written to stream to disk. Returns 0 on success or -1
+ * on failure, with errno set. */
+static int
+infd_filesystem_account_storage_journal_sync(FILE* stream)
+{
+  if(fflush(stream) != 0)
+    return -1;
+#ifdef G_OS_WIN32
+  if(_commit(_fileno(stream)) != 0)
+    return -1;
+#else
+  if(fsync(fileno(stream)) != 0)
+    return -1;
+#endif
+  return 0;
+}
+
+/* Cuts off everything after the last record that has been appended
+ * successfully, so that a record whose change has been given up is not
+ * replayed when the journal is read again. */
+static void
+infd_filesystem_account_storage_journal_truncate(
+  InfdFilesystemAccountStorage* storage)
+{
+  InfdFilesystemAccountStoragePrivate* priv;
+  FILE* stream;
+
+  priv = INFD_FILESYSTEM_ACCOUNT_STORAGE_PRIVATE(storage);
+
+  stream = infd_filesystem_storage_open(
+    priv->filesystem,
+    "journal",
+    "/accounts",
+    "r+",
+    NULL,
+    NULL
+  );
+
+  /* There is nothing else we could do if this fails */
+  if(stream != NULL)
+  {
+#ifdef G_OS_WIN32
+    _chsize(_fileno(stream), priv->journal_size);
+#else
+    if(ftruncate(fileno(stream), priv->journal_size) == 0)
+      infd_filesystem_account_storage_journal_sync(stream);
+#endif
+    infd_filesystem_storage_stream_close(stream);
+  }
+}
+
+/* Appends record to the journal, creating it first if necessary. If the
+ * underlying storage has sync-writes set, the record is flushed to disk
+ * before the function returns. */
+static gboolean
+infd_filesystem_account_storage_journal_append(
+  InfdFilesystemAccountStorage* storage,
+  GByteArray* record,
+  GError** error)
+{
+  InfdFilesystemAccountStoragePrivate* priv;
+  GByteArray* header;
+  FILE* stream;
+  gboolean sync_writes;
+  gsize written;
+  gsize expected;
+  int save_errno;
+
+  priv = INFD_FILESYSTEM_ACCOUNT_STORAGE_PRIVATE(storage);
+
+  g_object_get(
+    G_OBJECT(priv->filesystem),
+    "sync-writes", &sync_writes,
+    NULL
+  );
+
+  header = g_byte_array_new();
+  if(priv->journal_size == 0)
+  {
+    /* Starting the new journal replaces the previous one, so the account
+     * file it belongs to needs to be in place first. Otherwise a crash
+     * could leave the previous account file behind, together with a
+     * journal that does not belong to it. */
+    if(!infd_filesystem_storage_commit(priv->filesystem, error))
+    {
+      g_byte_array_free(header, TRUE);
+      return FALSE;
+    }
+
+    g_byte_array_append(
+      header,
+      (const guint8*)INFD_FILESYSTEM_ACCOUNT_STORAGE_JOURNAL_MAGIC,
+      4
+    );
+
+    infd_filesystem_account_storage_journal_append_uint32(
+      header,
+      INFD_FILESYSTEM_ACCOUNT_STORAGE_JOURNAL_VERSION
+    );
+
+    infd_filesystem_account_storage_journal_append_string(
+      header,
+      priv->checkpoint_id,
+      strlen(priv->checkpoint_id)
+    );
+  }
+
+  stream = infd_filesystem_storage_open(
+    priv->filesystem,
+    "journal",
+    "/accounts",
+    priv->journal_size == 0 ? "w" : "a",
+    NULL,
+    error
+  );
+
+  if(stream == NULL)
+  {
+    g_byte_array_free(header, TRUE);
+    return FALSE;
+  }
+
+  written = infd_filesystem_storage_stream_write(
+    stream,
+    header->data,
+    header->len
+  );
+
+  if(written == header->len)
+  {
+    written += infd_filesystem_storage_stream_write(
+      stream,
+      record->data,
+      record->len
+    );
+  }
+
+  expected = header->len + record->len;
+  g_byte_array_free(header, TRUE);
+
+  save_errno = errno;
+  infd_filesystem_storage_add_bytes_written(priv->filesystem, written);
+  if(written == expected && sync_writes == TRUE &&
+     infd_filesystem_account_storage_journal_sync(stream) != 0)
+  {
+    save_errno = errno;
+    written = 0;
+  }
+
+  if(written != expected)
+  {
+    infd_filesystem_storage_stream_close(stream);
+  }
+  else if(infd_filesystem_storage_stream_close(stream) != 0)
+  {
+    save_errno = errno;
+    written = 0;
+  }
+
+  if(written != expected)
+  {
+    g_set_error_literal(
+      error,
+      G_FILE_ERROR,
+      g_file_error_from_errno(save_errno),
+      g_strerror(save_errno)
+    );
+
+    return FALSE;
+  }
+
+  priv->journal_size += written;
+  ++priv->journal_records;
+  return TRUE;
+}
+
+/* Makes a change to the account list persistent, by appending record to the
+ * journal or by writing the whole account list. The change must already be
+ * made in the account table. */
+static gboolean
+infd_filesystem_account_storage_journal_write(
+  InfdFilesystemAccountStorage* storage,
+  GByteArray* record,
+  GError** error)
+{
+  InfdFilesystemAccountStoragePrivate* priv;
+  GError* local_error;
+
+  priv = INFD_FILESYSTEM_ACCOUNT_STORAGE_PRIVATE(storage);
+
+  if(priv->checkpoint_id == NULL ||
+     (priv->journal_records >= g_hash_table_size(priv->accounts) &&
+      priv->journal_size >=
+        INFD_FILESYSTEM_ACCOUNT_STORAGE_JOURNAL_MIN_CHECKPOINT_SIZE))
+  {
+    return infd_filesystem_account_storage_journal_checkpoint(storage, error);
+  }
+
+  local_error = NULL;
+  if(!infd_filesystem_account_storage_journal_append(storage, record,
+                                                     &local_error))
+  {
+    /* The record might have been written partially, so do not append to
+     * the journal anymore. Writing the account file makes the change
+     * persistent anyway, and invalidates the current journal. */
+    g_free(priv->checkpoint_id);
+    priv->checkpoint_id = NULL;
+
+    if(!infd_filesystem_account_storage_journal_checkpoint(storage, NULL))
+    {
+      /* The change is not made then, but the record might be in the
+       * journal in full, for example if only closing the file failed. */
+      infd_filesystem_account_storage_journal_truncate(storage);
+      g_propagate_error(error, local_error);
+      return FALSE;
+    }
+
+    g_error_free(local_error);
+  }
+
+  return TRUE;
+}
+
+static gboolean
+infd_filesystem_account_storage_store_account(
+  InfdFilesystemAccountStorage* storage,
+  const InfdFilesystemAccountStorageAccountInfo* info,
+  GError** error)
+{
+  GByteArray* record;
+  gboolean result;
+
+  record = g_byte_array_new();
+  infd_filesystem_account_storage_journal_append_account(record, info);
+
+  result = infd_filesystem_account_storage_journal_write(
+    storage,
+    record,
+    error
+  );
+
+  g_byte_array_free(record, TRUE);
+  return result;
+}
+
+static gboolean
+infd_filesystem_account_storage_store_removal(
+  InfdFilesystemAccountStorage* storage,
+  InfAclAccountId account,
+  GError** error)
+{
+  GByteArray* record;
+  const gchar* id;
+  guint8 type;
+  gboolean result;
+
+  id = inf_acl_account_id_to_string(account);
+  type = INFD_FILESYSTEM_ACCOUNT_STORAGE_JOURNAL_RECORD_REMOVE;
+
+  record = g_byte_array_new();
+  g_byte_array_append(record, &type, 1);
+  infd_filesystem_account_storage_journal_append_string(
+    record,
+    id,
+    strlen(id)
+  );
+
+  result = infd_filesystem_account_storage_journal_write(
+    storage,
+    record,
+    error
+  );
+
+  g_byte_array_free(record, TRUE);
+  return result;
+}
+
 static gboolean
 infd_filesystem_account_storage_set_filesystem_impl(
     InfdFilesystemAccountStorage* s,
@@ -677,6 +1565,10 @@ infd_filesystem_account_storage_set_filesystem_impl(
   GHashTable* new_accounts_by_name;
   GHashTable* new_accounts_by_certificate;
 
+  gchar* checkpoint_id;
+  gsize journal_size;
+  guint journal_records;
+
   GHashTableIter hash_iter;
   gpointer id_ptr;
   gpointer value;
@@ -687,9 +1579,30 @@ infd_filesystem_account_storage_set_filesystem_impl(
   if(priv->filesystem == fs) return TRUE;
 
   /* Load the new accounts */
-  new_accounts = infd_filesystem_account_storage_load_file(fs, error);
+  new_accounts = infd_filesystem_account_storage_load_file(
+    fs,
+    &checkpoint_id,
+    error
+  );
+
   if(new_accounts == NULL) return FALSE;
 
+  success = infd_filesystem_account_storage_journal_read(
+    fs,
+    new_accounts,
+    &checkpoint_id,
+    &journal_size,
+    &journal_records,
+    error
+  );
+
+  if(success == FALSE)
+  {
+    g_free(checkpoint_id);
+    g_hash_table_destroy(new_accounts);
+    return FALSE;
+  }
+
   new_accounts_by_certificate = g_hash_table_new(g_str_hash, g_str_equal);
   new_accounts_by_name = g_hash_table_new(g_str_hash, g_str_equal);
 
@@ -705,12 +1618,18 @@ infd_filesystem_account_storage_set_filesystem_impl(
     g_hash_table_destroy(new_accounts_by_certificate);
     g_hash_table_destroy(new_accounts_by_name);
     g_hash_table_destroy(new_accounts);
+    g_free(checkpoint_id);
     return FALSE;
   }
 
   if(priv->filesystem != NULL)
     g_object_unref(priv->filesystem);
 
+  g_free(priv->checkpoint_id);
+  priv->checkpoint_id = checkpoint_id;
+  priv->journal_size = journal_size;
+  priv->journal_records = journal_records;
+
   priv->filesystem = fs;
   if(fs != NULL)
     g_object_ref(fs);
@@ -838,6 +1757,10 @@ infd_filesystem_account_storage_init(InfdFilesystemAccountStorage* storage)
     g_str_hash,
     g_str_equal
   );
+
+  priv->checkpoint_id = NULL;
+  priv->journal_size = 0;
+  priv->journal_records = 0;
 }
 
 static void
@@ -870,6 +1793,7 @@ infd_filesystem_account_storage_finalize(GObject* object)
   g_hash_table_destroy(priv->accounts_by_name);
   g_hash_table_destroy(priv->accounts_by_certificate);
   g_hash_table_destroy(priv->accounts);
+  g_free(priv->checkpoint_id);
 
   G_OBJECT_CLASS(infd_filesystem_account_storage_parent_class)->finalize(object);
 }
@@ -1220,9 +2144,9 @@ infd_filesystem_account_storage_add_account(InfdAccountStorage* s,
 
   infd_filesystem_account_storage_add_info(storage, info);
 
-  success = infd_filesystem_account_storage_store_file(
-    priv->filesystem,
-    priv->accounts,
+  success = infd_filesystem_account_storage_store_account(
+    storage,
+    info,
     error
   );
 
@@ -1270,9 +2194,9 @@ infd_filesystem_account_storage_remove_account(InfdAccountStorage* s,
 
   infd_filesystem_account_storage_remove_info(storage, info);
 
-  success = infd_filesystem_account_storage_store_file(
-    priv->filesystem,
-    priv->accounts,
+  success = infd_filesystem_account_storage_store_removal(
+    storage,
+    account,
     error
   );
 
@@ -1348,11 +2272,7 @@ infd_filesystem_account_storage_login_by_certificate(InfdAccountStorage* s,
 
   /* Try to save the fingerprint/DN and time change to disk, but if it does
    * not work, that's okay for now, we still keep the login functional. */
-  infd_filesystem_account_storage_store_file(
-    priv->filesystem,
-    priv->accounts,
-    NULL
-  );
+  infd_filesystem_account_storage_store_account(storage, info, NULL);
 
   return info->id;
 }
@@ -1402,11 +2322,7 @@ infd_filesystem_account_storage_login_by_password(InfdAccountStorage* s,
 
   /* Try to save the fingerprint/DN and time change to disk, but if it does
    * not work, that's okay for now, we still keep the login functional. */
-  infd_filesystem_account_storage_store_file(
-    priv->filesystem,
-    priv->accounts,
-    NULL
-  );
+  infd_filesystem_account_storage_store_account(storage, info, NULL);
 
   return info->id;
 }
@@ -1493,10 +2409,10 @@ infd_filesystem_account_storage_set_certificate(InfdAccountStorage* s,
    * do so, we write the accounts file -- if that files, we need to
    * rollback */
 
-  success = infd_filesystem_account_storage_store_file(
-    priv->filesystem,
-    priv->accounts,
-    NULL
+  success = infd_filesystem_account_storage_store_account(
+    storage,
+    info,
+    error
   );
 
   if(success == FALSE)
@@ -1546,6 +2462,9 @@ infd_filesystem_account_storage_set_password(InfdAccountStorage* s,
   gchar* old_salt;
   gboolean success;
 
+  storage = INFD_FILESYSTEM_ACCOUNT_STORAGE(s);
+  priv = INFD_FILESYSTEM_ACCOUNT_STORAGE_PRIVATE(storage);
+
   info = g_hash_table_lookup(
     priv->accounts,
     INF_ACL_ACCOUNT_ID_TO_POINTER(account)
@@ -1594,10 +2513,10 @@ infd_filesystem_account_storage_set_password(InfdAccountStorage* s,
 
   /* Try to write the updated password to disk */
 
-  success = infd_filesystem_account_storage_store_file(
-    priv->filesystem,
-    priv->accounts,
-    NULL
+  success = infd_filesystem_account_storage_store_account(
+    storage,
+    info,
+    error
   );
 
   if(success == FALSE)
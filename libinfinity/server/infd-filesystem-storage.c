@@ -21,6 +21,7 @@
 
 #include <libinfinity/server/infd-filesystem-storage.h>
 #include <libinfinity/server/infd-storage.h>
+#include <libinfinity/common/inf-async-operation.h>
 #include <libinfinity/common/inf-file-util.h>
 #include <libinfinity/common/inf-xml-util.h>
 #include <libinfinity/inf-i18n.h>
@@ -32,26 +33,136 @@
 
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
 
 #ifndef G_OS_WIN32
 # include <sys/types.h>
 # include <sys/stat.h>
-# include <fcntl.h>
 # include <dirent.h>
 # include <unistd.h>
 #endif
 
+/* An asynchronous write of an XML document. Writes to the same file are
+ * queued, and only the first one in the queue is running at a time. */
+typedef struct _InfdFilesystemStorageWrite InfdFilesystemStorageWrite;
+struct _InfdFilesystemStorageWrite {
+  InfdFilesystemStorage* storage;
+  InfAsyncOperation* operation;
+  gint ref_count;
+
+  gchar* full_path;
+  xmlDocPtr doc;
+  /* Whether the file is moved into place by a group commit, after it has
+   * been flushed to disk, instead of right after it has been written */
+  gboolean commit;
+  /* Written file that waits for the group commit, or NULL */
+  gchar* temp_path;
+
+  InfdFilesystemStorageWriteFunc func;
+  gpointer user_data;
+
+  /* Set by the worker thread when it starts and once it has finished the
+   * write. If the main thread needs the result before a worker thread has
+   * picked up the write, it claims the write and performs it itself. */
+  GMutex mutex;
+  GCond cond;
+  gboolean running;
+  gboolean claimed;
+  gboolean finished;
+  gsize size;
+  GError* error;
+};
+
+/* A file written with sync-writes set that still needs to be flushed to
+ * disk and moved into place by a group commit */
+typedef struct _InfdFilesystemStorageCommit InfdFilesystemStorageCommit;
+struct _InfdFilesystemStorageCommit {
+  gchar* temp_path;
+  /* Writes whose result is reported once the file has been committed.
+   * Older versions of the file that have been replaced by a newer one
+   * before the commit share its result. */
+  GSList* writes;
+  GError* error;
+};
+
+typedef enum _InfdFilesystemStorageCommitStage {
+  /* Flush the written files to disk, in a worker thread */
+  INFD_FILESYSTEM_STORAGE_COMMIT_FLUSH_FILES,
+  /* Flush the directories of the renamed files, in a worker thread */
+  INFD_FILESYSTEM_STORAGE_COMMIT_FLUSH_DIRECTORIES
+} InfdFilesystemStorageCommitStage;
+
+/* A group commit running in the background. Its stages run in worker
+ * threads, and the renames in between in the main thread. If the main
+ * thread needs the result before a worker thread has picked up a stage,
+ * it claims the stage and performs it itself, as for
+ * InfdFilesystemStorageWrite. */
+typedef struct _InfdFilesystemStorageCommitJob InfdFilesystemStorageCommitJob;
+struct _InfdFilesystemStorageCommitJob {
+  InfdFilesystemStorage* storage;
+  InfAsyncOperation* operation;
+  gint ref_count;
+
+  gchar* root_directory;
+  GHashTable* commits; /* full path -> InfdFilesystemStorageCommit */
+  GHashTable* directories; /* directory -> errno of flushing it */
+  InfdFilesystemStorageCommitStage stage;
+
+  gboolean syncfs_done;
+  int syncfs_errno;
+#ifdef HAVE_SYNCFS
+  dev_t root_dev;
+#endif
+
+  GMutex mutex;
+  GCond cond;
+  gboolean running;
+  gboolean claimed;
+  gboolean finished;
+};
+
 typedef struct _InfdFilesystemStoragePrivate InfdFilesystemStoragePrivate;
 struct _InfdFilesystemStoragePrivate {
   gchar* root_directory;
+  gboolean sync_writes;
+
+  guint64 bytes_written;
+
+  /* Used to report back the result of asynchronous writes, and to
+   * schedule group commits */
+  InfIo* io;
+  /* full path -> GQueue of InfdFilesystemStorageWrite */
+  GHashTable* writes;
+  guint n_pending_writes;
+
+  /* Files written asynchronously with sync-writes set that still need to
+   * be flushed to disk and moved into place,
+   * full path -> InfdFilesystemStorageCommit */
+  GHashTable* commits;
+  InfIoTimeout* commit_timeout;
+  InfdFilesystemStorageCommitJob* commit_job;
+  guint n_commits;
+  guint n_committed_files;
 };
 
 enum {
   PROP_0,
 
-  PROP_ROOT_DIRECTORY
+  PROP_ROOT_DIRECTORY,
+  PROP_SYNC_WRITES,
+  PROP_IO,
+
+  /* read only */
+  PROP_COMMITS,
+  PROP_COMMITTED_FILES
 };
 
+/* Appended to the name of a file being written, followed by six random
+ * characters. It does not start with "Inf", so that a temporary file never
+ * shows up in a directory listing, and is distinctive enough not to be
+ * confused with files of the user when temporary files are removed. */
+#define INFD_FILESYSTEM_STORAGE_TEMP_SUFFIX ".infd-tmp-"
+
 #define INFD_FILESYSTEM_STORAGE_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INFD_TYPE_FILESYSTEM_STORAGE, InfdFilesystemStoragePrivate))
 
 static GQuark infd_filesystem_storage_error_quark;
@@ -101,6 +212,84 @@ infd_filesystem_storage_verify_path(const gchar* path,
   return TRUE;
 }
 
+/* Returns whether name is the name of a temporary file created by
+ * infd_filesystem_storage_write_xml_temp(), that is a non-empty name
+ * followed by INFD_FILESYSTEM_STORAGE_TEMP_SUFFIX and six random
+ * characters. */
+static gboolean
+infd_filesystem_storage_is_temp_name(const gchar* name)
+{
+  gsize suffix_len;
+  gsize len;
+  gsize i;
+
+  suffix_len = strlen(INFD_FILESYSTEM_STORAGE_TEMP_SUFFIX);
+  len = strlen(name);
+  if(len <= suffix_len + 6)
+    return FALSE;
+
+  if(strncmp(name + len - suffix_len - 6,
+             INFD_FILESYSTEM_STORAGE_TEMP_SUFFIX,
+             suffix_len) != 0)
+  {
+    return FALSE;
+  }
+
+  for(i = len - 6; i < len; ++i)
+    if(!g_ascii_isalnum(name[i]))
+      return FALSE;
+
+  return TRUE;
+}
+
+/* Required by infd_filesystem_storage_remove_temp_files_func() */
+static void
+infd_filesystem_storage_remove_temp_files(const gchar* path);
+
+static gboolean
+infd_filesystem_storage_remove_temp_files_func(const gchar* name,
+                                               const gchar* path,
+                                               InfFileType type,
+                                               gpointer user_data,
+                                               GError** error)
+{
+  if(type == INF_FILE_TYPE_DIR)
+  {
+    infd_filesystem_storage_remove_temp_files(path);
+  }
+  else if(type == INF_FILE_TYPE_REG &&
+          infd_filesystem_storage_is_temp_name(name))
+  {
+    g_unlink(path);
+  }
+
+  return TRUE;
+}
+
+/* Removes the temporary files below path that a previous process left
+ * behind when it crashed while writing, or before a group commit. */
+static void
+infd_filesystem_storage_remove_temp_files(const gchar* path)
+{
+  GError* error;
+  error = NULL;
+
+  if(!inf_file_util_list_directory(
+       path,
+       infd_filesystem_storage_remove_temp_files_func,
+       NULL,
+       &error))
+  {
+    g_warning(
+      _("Failed to remove temporary files in \"%s\": %s"),
+      path,
+      error->message
+    );
+
+    g_error_free(error);
+  }
+}
+
 static void
 infd_filesystem_storage_set_root_directory(InfdFilesystemStorage* storage,
                                            const gchar* root_directory)
@@ -145,6 +334,10 @@ infd_filesystem_storage_set_root_directory(InfdFilesystemStorage* storage,
 
       g_error_free(error);
     }
+    else
+    {
+      infd_filesystem_storage_remove_temp_files(converted);
+    }
 
     g_free(priv->root_directory);
     priv->root_directory = converted;
@@ -204,6 +397,7 @@ infd_filesystem_storage_open_impl(InfdFilesystemStorage* storage,
 #else
   if(strcmp(mode, "r") == 0) open_mode = O_RDONLY;
   else if(strcmp(mode, "w") == 0) open_mode = O_CREAT | O_WRONLY | O_TRUNC;
+  else if(strcmp(mode, "a") == 0) open_mode = O_CREAT | O_WRONLY | O_APPEND;
   else g_assert_not_reached();
   fd = open(path, O_NOFOLLOW | open_mode, 0644);
   if(fd == -1)
@@ -286,56 +480,1108 @@ infd_filesystem_storage_read_xml_file_impl(InfdFilesystemStorage* storage,
         toplevel_tag
       );
 
-      xmlFreeDoc(doc);
-      doc = NULL;
-    }
-  }
+      xmlFreeDoc(doc);
+      doc = NULL;
+    }
+  }
+
+  return doc;
+}
+
+/* Flushes the file or directory at path to disk. Returns 0 on success or
+ * an errno value on failure. */
+static int
+infd_filesystem_storage_sync_path(const gchar* path)
+{
+#ifndef G_OS_WIN32
+  int fd;
+  int save_errno;
+
+  fd = open(path, O_RDONLY);
+  if(fd == -1)
+    return errno;
+
+  save_errno = 0;
+  if(fsync(fd) != 0)
+    save_errno = errno;
+
+  close(fd);
+  return save_errno;
+#else
+  /* Windows does not allow to open directories, and renames are not atomic
+   * there anyway. */
+  return 0;
+#endif
+}
+
+/* Writes doc to a new temporary file next to path, and returns the name of
+ * the temporary file. If sync is TRUE, the data is flushed to disk before
+ * the function returns. This does not access the storage, so that it can
+ * run in a worker thread. */
+static gchar*
+infd_filesystem_storage_write_xml_temp(const gchar* path,
+                                       xmlDocPtr doc,
+                                       gboolean sync,
+                                       gsize* size,
+                                       GError** error)
+{
+  gchar* temp_path;
+  FILE* file;
+  int fd;
+  int save_errno;
+  xmlErrorPtr xmlerror;
+  long file_size;
+
+  temp_path = g_strconcat(
+    path,
+    INFD_FILESYSTEM_STORAGE_TEMP_SUFFIX "XXXXXX",
+    NULL
+  );
+  fd = g_mkstemp_full(temp_path, O_WRONLY, 0644);
+  if(fd == -1)
+  {
+    save_errno = errno;
+    infd_filesystem_storage_system_error(save_errno, error);
+    g_free(temp_path);
+    return NULL;
+  }
+
+  file = fdopen(fd, "w");
+  if(file == NULL)
+  {
+    save_errno = errno;
+    g_close(fd, NULL);
+    g_unlink(temp_path);
+    g_free(temp_path);
+
+    infd_filesystem_storage_system_error(save_errno, error);
+    return NULL;
+  }
+
+  if(xmlDocFormatDump(file, doc, 1) == -1)
+  {
+    xmlerror = xmlGetLastError();
+    fclose(file);
+    g_unlink(temp_path);
+    g_free(temp_path);
+
+    g_set_error_literal(
+      error,
+      g_quark_from_static_string("LIBXML2_OUTPUT_ERROR"),
+      xmlerror->code,
+      xmlerror->message
+    );
+
+    return NULL;
+  }
+
+  file_size = ftell(file);
+
+  save_errno = 0;
+  if(fflush(file) != 0)
+    save_errno = errno;
+#ifndef G_OS_WIN32
+  if(save_errno == 0 && sync == TRUE && fsync(fileno(file)) != 0)
+    save_errno = errno;
+#endif
+  if(fclose(file) != 0 && save_errno == 0)
+    save_errno = errno;
+
+  if(save_errno != 0)
+  {
+    g_unlink(temp_path);
+    g_free(temp_path);
+
+    infd_filesystem_storage_system_error(save_errno, error);
+    return NULL;
+  }
+
+  if(size != NULL)
+    *size = file_size > 0 ? file_size : 0;
+
+  return temp_path;
+}
+
+/* Moves temp_path to path, replacing the previous version of the file. The
+ * temporary file is removed if this fails. If sync is TRUE, the directory
+ * containing path is flushed to disk, so that the new name survives a
+ * system crash. */
+static gboolean
+infd_filesystem_storage_replace_file(const gchar* temp_path,
+                                     const gchar* path,
+                                     gboolean sync,
+                                     GError** error)
+{
+  gchar* dirname;
+  int save_errno;
+
+  save_errno = 0;
+
+#ifdef G_OS_WIN32
+  /* Windows cannot rename over an existing file */
+  if(g_unlink(path) == -1 && errno != ENOENT)
+    save_errno = errno;
+#endif
+
+  if(save_errno == 0 && g_rename(temp_path, path) == -1)
+    save_errno = errno;
+
+  if(save_errno != 0)
+  {
+    g_unlink(temp_path);
+    infd_filesystem_storage_system_error(save_errno, error);
+    return FALSE;
+  }
+
+  if(sync == TRUE)
+  {
+    dirname = g_path_get_dirname(path);
+    save_errno = infd_filesystem_storage_sync_path(dirname);
+    g_free(dirname);
+
+    if(save_errno != 0)
+    {
+      infd_filesystem_storage_system_error(save_errno, error);
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* Writes doc to a temporary file next to path, and then renames it to
+ * path, so that the file at path is replaced either completely or not at
+ * all, even if the process is interrupted in between. If sync is TRUE, the
+ * data is flushed to disk before the rename, and the rename afterwards. */
+static gboolean
+infd_filesystem_storage_write_xml_file_atomic(const gchar* path,
+                                              xmlDocPtr doc,
+                                              gboolean sync,
+                                              gsize* size,
+                                              GError** error)
+{
+  gchar* temp_path;
+  gboolean result;
+
+  temp_path = infd_filesystem_storage_write_xml_temp(
+    path,
+    doc,
+    sync,
+    size,
+    error
+  );
+
+  if(temp_path == NULL)
+    return FALSE;
+
+  result = infd_filesystem_storage_replace_file(temp_path, path, sync, error);
+  g_free(temp_path);
+
+  return result;
+}
+
+/* Required by infd_filesystem_storage_commit_job_report() */
+static void
+infd_filesystem_storage_write_report(InfdFilesystemStorage* storage,
+                                     InfdFilesystemStorageWrite* write,
+                                     const GError* error);
+
+static void
+infd_filesystem_storage_commit_free(gpointer data)
+{
+  InfdFilesystemStorageCommit* commit;
+  commit = (InfdFilesystemStorageCommit*)data;
+
+  /* The writes have been reported when the commit is freed */
+  g_assert(commit->writes == NULL);
+
+  g_free(commit->temp_path);
+  if(commit->error != NULL)
+    g_error_free(commit->error);
+
+  g_slice_free(InfdFilesystemStorageCommit, commit);
+}
+
+/* Creates a group commit of all files that have been written since the
+ * last one. The files are flushed to disk first, then renamed, and then
+ * each directory containing one of them is flushed once. The flushes may
+ * block for a long time and run in a worker thread, while the renames are
+ * done in the main thread, so that they happen in the same order as the
+ * writes. Where syncfs() is available, a single call flushes all files on
+ * the filesystem of the root directory, instead of one fsync() per file. */
+static InfdFilesystemStorageCommitJob*
+infd_filesystem_storage_commit_job_new(InfdFilesystemStorage* storage)
+{
+  InfdFilesystemStoragePrivate* priv;
+  InfdFilesystemStorageCommitJob* job;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+  job = g_slice_new(InfdFilesystemStorageCommitJob);
+
+  job->storage = storage;
+  job->operation = NULL;
+  job->ref_count = 1;
+  job->root_directory = g_strdup(priv->root_directory);
+
+  /* Take the pending commits, so that files written from now on are left
+   * to the next group commit. */
+  job->commits = priv->commits;
+  priv->commits = g_hash_table_new_full(
+    g_str_hash,
+    g_str_equal,
+    g_free,
+    infd_filesystem_storage_commit_free
+  );
+
+  /* directory -> errno of flushing it */
+  job->directories =
+    g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+  job->stage = INFD_FILESYSTEM_STORAGE_COMMIT_FLUSH_FILES;
+  job->syncfs_done = FALSE;
+  job->syncfs_errno = 0;
+
+  g_mutex_init(&job->mutex);
+  g_cond_init(&job->cond);
+  job->running = FALSE;
+  job->claimed = FALSE;
+  job->finished = FALSE;
+
+  return job;
+}
+
+static void
+infd_filesystem_storage_commit_job_unref(gpointer data)
+{
+  InfdFilesystemStorageCommitJob* job;
+  job = (InfdFilesystemStorageCommitJob*)data;
+
+  if(g_atomic_int_dec_and_test(&job->ref_count))
+  {
+    g_free(job->root_directory);
+    g_hash_table_destroy(job->commits);
+    g_hash_table_destroy(job->directories);
+
+    g_mutex_clear(&job->mutex);
+    g_cond_clear(&job->cond);
+    g_slice_free(InfdFilesystemStorageCommitJob, job);
+  }
+}
+
+/* Flushes the written files of job to disk. This does not access the
+ * storage, so that it can run in a worker thread. */
+static void
+infd_filesystem_storage_commit_job_flush_files(
+  InfdFilesystemStorageCommitJob* job)
+{
+  InfdFilesystemStorageCommit* commit;
+  GHashTableIter iter;
+  gpointer value;
+  int save_errno;
+#ifdef HAVE_SYNCFS
+  GStatBuf st;
+  int fd;
+
+  if(g_stat(job->root_directory, &st) == 0)
+  {
+    job->root_dev = st.st_dev;
+
+    fd = open(job->root_directory, O_RDONLY);
+    if(fd != -1)
+    {
+      if(syncfs(fd) == 0)
+        job->syncfs_done = TRUE;
+      close(fd);
+    }
+  }
+#endif
+
+  g_hash_table_iter_init(&iter, job->commits);
+  while(g_hash_table_iter_next(&iter, NULL, &value))
+  {
+    commit = (InfdFilesystemStorageCommit*)value;
+
+    save_errno = 0;
+#ifdef HAVE_SYNCFS
+    /* Files on a different filesystem, such as a subdirectory that is a
+     * mount point, are not covered by syncfs(). */
+    if(job->syncfs_done == FALSE || g_stat(commit->temp_path, &st) != 0 ||
+       st.st_dev != job->root_dev)
+    {
+      save_errno = infd_filesystem_storage_sync_path(commit->temp_path);
+    }
+#else
+    save_errno = infd_filesystem_storage_sync_path(commit->temp_path);
+#endif
+
+    if(save_errno != 0)
+    {
+      /* Keep the previous version rather than risking a file whose data
+       * is not on disk. */
+      g_unlink(commit->temp_path);
+      infd_filesystem_storage_system_error(save_errno, &commit->error);
+    }
+  }
+}
+
+/* Moves the flushed files of job into place. This runs in the main
+ * thread. */
+static void
+infd_filesystem_storage_commit_job_rename(InfdFilesystemStorageCommitJob* job)
+{
+  InfdFilesystemStorageCommit* commit;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+  gboolean result;
+
+  g_hash_table_iter_init(&iter, job->commits);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+  {
+    commit = (InfdFilesystemStorageCommit*)value;
+    if(commit->error != NULL)
+      continue;
+
+    result = infd_filesystem_storage_replace_file(
+      commit->temp_path,
+      key,
+      FALSE,
+      &commit->error
+    );
+
+    if(result == TRUE)
+      g_hash_table_insert(job->directories, g_path_get_dirname(key), NULL);
+  }
+}
+
+/* Flushes the renames of job to disk. This does not access the storage,
+ * so that it can run in a worker thread. */
+static void
+infd_filesystem_storage_commit_job_flush_directories(
+  InfdFilesystemStorageCommitJob* job)
+{
+  GHashTableIter iter;
+  gpointer key;
+  int save_errno;
+#ifdef HAVE_SYNCFS
+  GStatBuf st;
+  int fd;
+#endif
+
+  g_hash_table_iter_init(&iter, job->directories);
+  while(g_hash_table_iter_next(&iter, &key, NULL))
+  {
+#ifdef HAVE_SYNCFS
+    if(job->syncfs_done == TRUE && g_stat(key, &st) == 0 &&
+       st.st_dev == job->root_dev)
+    {
+      continue;
+    }
+#endif
+
+    save_errno = infd_filesystem_storage_sync_path(key);
+    g_hash_table_iter_replace(&iter, GINT_TO_POINTER(save_errno));
+  }
+
+#ifdef HAVE_SYNCFS
+  /* Flush the renames of all the files on the root filesystem */
+  if(job->syncfs_done == TRUE)
+  {
+    fd = open(job->root_directory, O_RDONLY);
+    if(fd == -1 || syncfs(fd) != 0)
+      job->syncfs_errno = errno;
+
+    if(fd != -1)
+      close(fd);
+  }
+#endif
+}
+
+/* Performs the current stage of job in the calling thread */
+static void
+infd_filesystem_storage_commit_job_perform(InfdFilesystemStorageCommitJob* job)
+{
+  switch(job->stage)
+  {
+  case INFD_FILESYSTEM_STORAGE_COMMIT_FLUSH_FILES:
+    infd_filesystem_storage_commit_job_flush_files(job);
+    break;
+  case INFD_FILESYSTEM_STORAGE_COMMIT_FLUSH_DIRECTORIES:
+    infd_filesystem_storage_commit_job_flush_directories(job);
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
+}
+
+/* Reports the result of job to the writers of its files. Returns the first
+ * error that occurred, or NULL. */
+static GError*
+infd_filesystem_storage_commit_job_report(InfdFilesystemStorageCommitJob* job)
+{
+  InfdFilesystemStoragePrivate* priv;
+  InfdFilesystemStorageCommit* commit;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+  gchar* dirname;
+  GSList* item;
+  GError* local_error;
+  int save_errno;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(job->storage);
+
+  /* A file has only been committed if the rename has reached the disk as
+   * well. */
+  local_error = NULL;
+  priv->n_commits += 1;
+
+  g_hash_table_iter_init(&iter, job->commits);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+  {
+    commit = (InfdFilesystemStorageCommit*)value;
+
+    if(commit->error == NULL)
+    {
+      dirname = g_path_get_dirname(key);
+      save_errno =
+        GPOINTER_TO_INT(g_hash_table_lookup(job->directories, dirname));
+      g_free(dirname);
+
+      if(save_errno == 0)
+        save_errno = job->syncfs_errno;
+
+      if(save_errno != 0)
+        infd_filesystem_storage_system_error(save_errno, &commit->error);
+    }
+
+    if(commit->error == NULL)
+      ++priv->n_committed_files;
+    else if(local_error == NULL)
+      local_error = g_error_copy(commit->error);
+  }
+
+  g_hash_table_iter_init(&iter, job->commits);
+  while(g_hash_table_iter_next(&iter, NULL, &value))
+  {
+    commit = (InfdFilesystemStorageCommit*)value;
+
+    for(item = commit->writes; item != NULL; item = item->next)
+    {
+      infd_filesystem_storage_write_report(
+        job->storage,
+        (InfdFilesystemStorageWrite*)item->data,
+        commit->error
+      );
+    }
+
+    g_slist_free(commit->writes);
+    commit->writes = NULL;
+  }
+
+  return local_error;
+}
+
+static void
+infd_filesystem_storage_commit_job_run_func(gpointer* run_data,
+                                            GDestroyNotify* run_notify,
+                                            gpointer user_data)
+{
+  InfdFilesystemStorageCommitJob* job;
+  gboolean claimed;
+
+  job = (InfdFilesystemStorageCommitJob*)user_data;
+
+  g_mutex_lock(&job->mutex);
+  claimed = job->claimed;
+  if(claimed == FALSE)
+    job->running = TRUE;
+  g_mutex_unlock(&job->mutex);
+
+  /* The main thread has performed the stage already */
+  if(claimed == FALSE)
+    infd_filesystem_storage_commit_job_perform(job);
+
+  *run_data = job;
+  *run_notify = infd_filesystem_storage_commit_job_unref;
+
+  g_mutex_lock(&job->mutex);
+  job->finished = TRUE;
+  g_cond_signal(&job->cond);
+  g_mutex_unlock(&job->mutex);
+}
+
+static void
+infd_filesystem_storage_commit_job_start(InfdFilesystemStorageCommitJob* job);
+
+/* Required by infd_filesystem_storage_commit_job_advance() */
+static void
+infd_filesystem_storage_commit_timeout_func(gpointer user_data);
+
+/* Called in the main thread when a stage of the group commit of the
+ * storage has finished. Starts the next one, or reports the result. */
+static void
+infd_filesystem_storage_commit_job_advance(InfdFilesystemStorageCommitJob* job)
+{
+  InfdFilesystemStorage* storage;
+  InfdFilesystemStoragePrivate* priv;
+  GError* error;
+
+  storage = job->storage;
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+  g_assert(priv->commit_job == job);
+
+  if(job->stage == INFD_FILESYSTEM_STORAGE_COMMIT_FLUSH_FILES)
+  {
+    infd_filesystem_storage_commit_job_rename(job);
+    job->stage = INFD_FILESYSTEM_STORAGE_COMMIT_FLUSH_DIRECTORIES;
+    infd_filesystem_storage_commit_job_start(job);
+  }
+  else
+  {
+    priv->commit_job = NULL;
+
+    /* Failures have been reported to the writers of the files */
+    error = infd_filesystem_storage_commit_job_report(job);
+    if(error != NULL)
+      g_error_free(error);
+
+    infd_filesystem_storage_commit_job_unref(job);
+
+    /* Files written while the commit was running */
+    if(priv->commit_job == NULL && g_hash_table_size(priv->commits) > 0 &&
+       priv->commit_timeout == NULL)
+    {
+      priv->commit_timeout = inf_io_add_timeout(
+        priv->io,
+        0,
+        infd_filesystem_storage_commit_timeout_func,
+        storage,
+        NULL
+      );
+    }
+  }
+}
+
+static void
+infd_filesystem_storage_commit_job_done_func(gpointer run_data,
+                                             gpointer user_data)
+{
+  InfdFilesystemStorageCommitJob* job;
+  job = (InfdFilesystemStorageCommitJob*)user_data;
+
+  /* The operation is freed automatically after this function returns */
+  job->operation = NULL;
+  infd_filesystem_storage_commit_job_advance(job);
+}
+
+/* Runs the current stage of job in a worker thread. If no worker thread
+ * can be started, then the stage is performed synchronously. */
+static void
+infd_filesystem_storage_commit_job_start(InfdFilesystemStorageCommitJob* job)
+{
+  InfdFilesystemStoragePrivate* priv;
+  GError* error;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(job->storage);
+  g_assert(job->operation == NULL);
+
+  job->running = FALSE;
+  job->claimed = FALSE;
+  job->finished = FALSE;
+
+  job->operation = inf_async_operation_new(
+    priv->io,
+    infd_filesystem_storage_commit_job_run_func,
+    infd_filesystem_storage_commit_job_done_func,
+    job
+  );
+
+  /* Reference for the worker thread, released by the run_notify */
+  g_atomic_int_inc(&job->ref_count);
+
+  error = NULL;
+  if(!inf_async_operation_start(job->operation, &error))
+  {
+    g_warning(
+      _("Failed to start asynchronous group commit: %s"),
+      error->message
+    );
+
+    g_error_free(error);
+    job->operation = NULL;
+    g_atomic_int_add(&job->ref_count, -1);
+
+    infd_filesystem_storage_commit_job_perform(job);
+    infd_filesystem_storage_commit_job_advance(job);
+  }
+}
+
+/* Completes the group commit that is running in the background, blocking
+ * until it has been written to disk, and reports its result. Only a stage
+ * that a worker thread is performing already is waited for, the remaining
+ * ones are performed in the calling thread. Returns the first error that
+ * occurred, or NULL. */
+static GError*
+infd_filesystem_storage_commit_job_wait(InfdFilesystemStorage* storage)
+{
+  InfdFilesystemStoragePrivate* priv;
+  InfdFilesystemStorageCommitJob* job;
+  gboolean claimed;
+  GError* error;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+  job = priv->commit_job;
+  priv->commit_job = NULL;
+
+  g_assert(job->operation != NULL);
+
+  claimed = TRUE;
+  g_mutex_lock(&job->mutex);
+  if(job->running == FALSE)
+  {
+    job->claimed = TRUE;
+  }
+  else
+  {
+    claimed = FALSE;
+    while(job->finished == FALSE)
+      g_cond_wait(&job->cond, &job->mutex);
+  }
+  g_mutex_unlock(&job->mutex);
+
+  /* This cancels the dispatch to the main thread, since we continue with
+   * the next stage right away. If the stage has been claimed, the worker
+   * thread skips it once it gets to it. */
+  inf_async_operation_free(job->operation);
+  job->operation = NULL;
+
+  if(claimed == TRUE)
+    infd_filesystem_storage_commit_job_perform(job);
+
+  if(job->stage == INFD_FILESYSTEM_STORAGE_COMMIT_FLUSH_FILES)
+  {
+    infd_filesystem_storage_commit_job_rename(job);
+    job->stage = INFD_FILESYSTEM_STORAGE_COMMIT_FLUSH_DIRECTORIES;
+    infd_filesystem_storage_commit_job_perform(job);
+  }
+
+  error = infd_filesystem_storage_commit_job_report(job);
+  infd_filesystem_storage_commit_job_unref(job);
+
+  return error;
+}
+
+/* Commits all files that have been written since the last group commit
+ * right away, after the group commit running in the background, if any,
+ * and reports the result to the writers of each file. The function fails
+ * with the first error that occurred, if any. */
+static gboolean
+infd_filesystem_storage_commit_impl(InfdFilesystemStorage* storage,
+                                    GError** error)
+{
+  InfdFilesystemStoragePrivate* priv;
+  InfdFilesystemStorageCommitJob* job;
+  GError* local_error;
+  GError* job_error;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  if(priv->commit_timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->io, priv->commit_timeout);
+    priv->commit_timeout = NULL;
+  }
+
+  local_error = NULL;
+  if(priv->commit_job != NULL)
+    local_error = infd_filesystem_storage_commit_job_wait(storage);
+
+  if(g_hash_table_size(priv->commits) > 0)
+  {
+    job = infd_filesystem_storage_commit_job_new(storage);
+
+    infd_filesystem_storage_commit_job_flush_files(job);
+    infd_filesystem_storage_commit_job_rename(job);
+    infd_filesystem_storage_commit_job_flush_directories(job);
+
+    job_error = infd_filesystem_storage_commit_job_report(job);
+    infd_filesystem_storage_commit_job_unref(job);
+
+    if(local_error == NULL)
+      local_error = job_error;
+    else if(job_error != NULL)
+      g_error_free(job_error);
+  }
+
+  if(local_error != NULL)
+  {
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+infd_filesystem_storage_commit_timeout_func(gpointer user_data)
+{
+  InfdFilesystemStorage* storage;
+  InfdFilesystemStoragePrivate* priv;
+
+  storage = INFD_FILESYSTEM_STORAGE(user_data);
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+  priv->commit_timeout = NULL;
+
+  /* Only one group commit runs at a time, so that the renames happen in
+   * the order of the writes. The next one is scheduled once the running
+   * one has finished. */
+  if(priv->commit_job == NULL && g_hash_table_size(priv->commits) > 0)
+  {
+    priv->commit_job = infd_filesystem_storage_commit_job_new(storage);
+    infd_filesystem_storage_commit_job_start(priv->commit_job);
+  }
+}
+
+/* Commits pending writes before a file is accessed in a way that needs
+ * to see them. */
+static void
+infd_filesystem_storage_commit_pending(InfdFilesystemStorage* storage)
+{
+  InfdFilesystemStoragePrivate* priv;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+  if(priv->commit_job != NULL || g_hash_table_size(priv->commits) > 0)
+    infd_filesystem_storage_commit_impl(storage, NULL);
+}
+
+gboolean
+infd_filesystem_storage_write_xml_file_impl(InfdFilesystemStorage* storage,
+                                            const gchar* path,
+                                            xmlDocPtr doc,
+                                            GError** error)
+{
+  InfdFilesystemStoragePrivate* priv;
+  gboolean result;
+  gsize size;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  /* The caller relies on the file being in place when this returns, so
+   * it is not left to a group commit. */
+  result = infd_filesystem_storage_write_xml_file_atomic(
+    path,
+    doc,
+    priv->sync_writes,
+    &size,
+    error
+  );
+
+  if(result == TRUE)
+    priv->bytes_written += size;
+
+  return result;
+}
+
+static void
+infd_filesystem_storage_write_unref(gpointer data)
+{
+  InfdFilesystemStorageWrite* write;
+  write = (InfdFilesystemStorageWrite*)data;
+
+  if(g_atomic_int_dec_and_test(&write->ref_count))
+  {
+    g_free(write->full_path);
+    if(write->doc != NULL)
+      xmlFreeDoc(write->doc);
+    if(write->temp_path != NULL)
+    {
+      g_unlink(write->temp_path);
+      g_free(write->temp_path);
+    }
+    if(write->error != NULL)
+      g_error_free(write->error);
+
+    g_mutex_clear(&write->mutex);
+    g_cond_clear(&write->cond);
+    g_slice_free(InfdFilesystemStorageWrite, write);
+  }
+}
+
+/* Writes the file of write in the calling thread. If the file is committed
+ * by a group commit, it is only written to a temporary file. */
+static void
+infd_filesystem_storage_write_perform(InfdFilesystemStorageWrite* write)
+{
+  if(write->commit == TRUE)
+  {
+    write->temp_path = infd_filesystem_storage_write_xml_temp(
+      write->full_path,
+      write->doc,
+      FALSE,
+      &write->size,
+      &write->error
+    );
+  }
+  else
+  {
+    infd_filesystem_storage_write_xml_file_atomic(
+      write->full_path,
+      write->doc,
+      FALSE,
+      &write->size,
+      &write->error
+    );
+  }
+}
+
+static void
+infd_filesystem_storage_write_run_func(gpointer* run_data,
+                                       GDestroyNotify* run_notify,
+                                       gpointer user_data)
+{
+  InfdFilesystemStorageWrite* write;
+  gboolean claimed;
+
+  write = (InfdFilesystemStorageWrite*)user_data;
+
+  g_mutex_lock(&write->mutex);
+  claimed = write->claimed;
+  if(claimed == FALSE)
+    write->running = TRUE;
+  g_mutex_unlock(&write->mutex);
+
+  /* The main thread has written the file already */
+  if(claimed == FALSE)
+    infd_filesystem_storage_write_perform(write);
+
+  *run_data = write;
+  *run_notify = infd_filesystem_storage_write_unref;
+
+  g_mutex_lock(&write->mutex);
+  write->finished = TRUE;
+  g_cond_signal(&write->cond);
+  g_mutex_unlock(&write->mutex);
+}
+
+static void
+infd_filesystem_storage_write_start(InfdFilesystemStorageWrite* write);
+
+/* Reports the result of write to its writer, and releases it */
+static void
+infd_filesystem_storage_write_report(InfdFilesystemStorage* storage,
+                                     InfdFilesystemStorageWrite* write,
+                                     const GError* error)
+{
+  InfdFilesystemStoragePrivate* priv;
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  g_assert(priv->n_pending_writes > 0);
+  --priv->n_pending_writes;
+
+  if(error == NULL)
+    priv->bytes_written += write->size;
+
+  if(write->func != NULL)
+    write->func(storage, error, write->user_data);
+
+  infd_filesystem_storage_write_unref(write);
+}
+
+/* Schedules the group commit of the file written by write. Its result is
+ * reported once the commit has happened. */
+static void
+infd_filesystem_storage_write_add_commit(InfdFilesystemStorage* storage,
+                                         InfdFilesystemStorageWrite* write)
+{
+  InfdFilesystemStoragePrivate* priv;
+  InfdFilesystemStorageCommit* commit;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+  commit = g_hash_table_lookup(priv->commits, write->full_path);
+
+  if(commit == NULL)
+  {
+    commit = g_slice_new(InfdFilesystemStorageCommit);
+    commit->temp_path = NULL;
+    commit->writes = NULL;
+    commit->error = NULL;
+
+    g_hash_table_insert(priv->commits, g_strdup(write->full_path), commit);
+  }
+  else
+  {
+    /* A newer version replaces a previous one that has not been
+     * committed */
+    g_unlink(commit->temp_path);
+    g_free(commit->temp_path);
+  }
+
+  commit->temp_path = write->temp_path;
+  commit->writes = g_slist_append(commit->writes, write);
+  write->temp_path = NULL;
+
+  if(priv->commit_timeout == NULL)
+  {
+    priv->commit_timeout = inf_io_add_timeout(
+      priv->io,
+      0,
+      infd_filesystem_storage_commit_timeout_func,
+      storage,
+      NULL
+    );
+  }
+}
+
+static void
+infd_filesystem_storage_write_start(InfdFilesystemStorageWrite* write);
+
+/* Called in the main thread when the first write in a queue has finished.
+ * Removes it from the queue, reports the result or schedules the group
+ * commit, and starts the next write in the queue if start_next is TRUE. */
+static void
+infd_filesystem_storage_write_finish(InfdFilesystemStorageWrite* write,
+                                     gboolean start_next)
+{
+  InfdFilesystemStorage* storage;
+  InfdFilesystemStoragePrivate* priv;
+  GQueue* queue;
+  InfdFilesystemStorageWrite* next;
+
+  storage = write->storage;
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  queue = g_hash_table_lookup(priv->writes, write->full_path);
+  g_assert(queue != NULL && g_queue_peek_head(queue) == write);
+
+  g_queue_pop_head(queue);
+  next = g_queue_peek_head(queue);
+  if(next == NULL)
+    g_hash_table_remove(priv->writes, write->full_path);
+
+  if(write->error == NULL && write->temp_path != NULL)
+    infd_filesystem_storage_write_add_commit(storage, write);
+  else
+    infd_filesystem_storage_write_report(storage, write, write->error);
 
-  return doc;
+  if(next != NULL && start_next == TRUE)
+    infd_filesystem_storage_write_start(next);
 }
 
-gboolean
-infd_filesystem_storage_write_xml_file_impl(InfdFilesystemStorage* storage,
-                                            const gchar* path,
-                                            xmlDocPtr doc,
-                                            GError** error)
+static void
+infd_filesystem_storage_write_done_func(gpointer run_data,
+                                        gpointer user_data)
+{
+  InfdFilesystemStorageWrite* write;
+  write = (InfdFilesystemStorageWrite*)user_data;
+
+  /* The operation is freed automatically after this function returns */
+  write->operation = NULL;
+  infd_filesystem_storage_write_finish(write, TRUE);
+}
+
+/* Runs the write in a worker thread. If no worker thread can be started,
+ * then the write is performed synchronously. */
+static void
+infd_filesystem_storage_write_start(InfdFilesystemStorageWrite* write)
 {
   InfdFilesystemStoragePrivate* priv;
-  FILE* file;
+  GError* error;
 
-  int save_errno;
-  xmlErrorPtr xmlerror;
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(write->storage);
+  g_assert(write->operation == NULL);
 
-  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+  write->operation = inf_async_operation_new(
+    priv->io,
+    infd_filesystem_storage_write_run_func,
+    infd_filesystem_storage_write_done_func,
+    write
+  );
 
-  file = infd_filesystem_storage_open_impl(storage, path, "w", error);
-  if(file == NULL)
-    return FALSE;
+  /* Reference for the worker thread, released by the run_notify */
+  g_atomic_int_inc(&write->ref_count);
 
-  if(xmlDocFormatDump(file, doc, 1) == -1)
+  error = NULL;
+  if(!inf_async_operation_start(write->operation, &error))
   {
-    xmlerror = xmlGetLastError();
-    fclose(file);
-    /* TODO: unlink? */
-
-    g_set_error_literal(
-      error,
-      g_quark_from_static_string("LIBXML2_OUTPUT_ERROR"),
-      xmlerror->code,
-      xmlerror->message
+    g_warning(
+      _("Failed to start asynchronous write: %s"),
+      error->message
     );
 
-    return FALSE;
+    g_error_free(error);
+    write->operation = NULL;
+    g_atomic_int_add(&write->ref_count, -1);
+
+    infd_filesystem_storage_write_perform(write);
+    infd_filesystem_storage_write_finish(write, TRUE);
   }
+}
+
+/* Completes all pending writes to full_path, blocking until they have
+ * been written to disk, and commits the file if it is waiting for a group
+ * commit. The callbacks of the writes are called before the function
+ * returns. Only a write that a worker thread is performing already
+ * is waited for. All others are performed in the calling thread, so that
+ * this does not depend on a thread of the pool becoming available, which
+ * might take long if the pool is busy with writes to other files. */
+static void
+infd_filesystem_storage_write_wait(InfdFilesystemStorage* storage,
+                                   const gchar* full_path)
+{
+  InfdFilesystemStoragePrivate* priv;
+  GQueue* queue;
+  InfdFilesystemStorageWrite* write;
+  gboolean claimed;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
 
-  if(fclose(file) != 0)
+  while((queue = g_hash_table_lookup(priv->writes, full_path)) != NULL)
   {
-    save_errno = errno;
-    infd_filesystem_storage_system_error(save_errno, error);
-    return FALSE;
+    write = g_queue_peek_head(queue);
+    claimed = TRUE;
+
+    if(write->operation != NULL)
+    {
+      g_mutex_lock(&write->mutex);
+      if(write->running == FALSE)
+      {
+        write->claimed = TRUE;
+      }
+      else
+      {
+        claimed = FALSE;
+        while(write->finished == FALSE)
+          g_cond_wait(&write->cond, &write->mutex);
+      }
+      g_mutex_unlock(&write->mutex);
+
+      /* This cancels the dispatch to the main thread, since we report the
+       * result right away. If the write has been claimed, the worker thread
+       * skips it once it gets to it. */
+      inf_async_operation_free(write->operation);
+      write->operation = NULL;
+    }
+
+    if(claimed == TRUE)
+    {
+      /* Writes which are queued behind the first one, or that no worker
+       * thread has picked up yet, are written in this thread. */
+      infd_filesystem_storage_write_perform(write);
+    }
+
+    infd_filesystem_storage_write_finish(write, FALSE);
   }
 
-  return TRUE;
+  /* Move the last version into place, so that it does not replace a
+   * version written later. */
+  if(g_hash_table_lookup(priv->commits, full_path) != NULL ||
+     (priv->commit_job != NULL &&
+      g_hash_table_lookup(priv->commit_job->commits, full_path) != NULL))
+  {
+    infd_filesystem_storage_commit_pending(storage);
+  }
 }
 
 static gchar*
@@ -359,6 +1605,27 @@ infd_filesystem_storage_get_acl_path(InfdFilesystemStorage* storage,
   return full_path;
 }
 
+static void
+infd_filesystem_storage_set_io(InfdFilesystemStorage* storage,
+                               InfIo* io)
+{
+  InfdFilesystemStoragePrivate* priv;
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  if(priv->io == io)
+    return;
+
+  /* Pending writes and group commits are bound to the previous IO object */
+  infd_filesystem_storage_flush(storage);
+
+  if(priv->io != NULL)
+    g_object_unref(priv->io);
+
+  priv->io = io;
+  if(io != NULL)
+    g_object_ref(io);
+}
+
 static void
 infd_filesystem_storage_init(InfdFilesystemStorage* storage)
 {
@@ -366,6 +1633,45 @@ infd_filesystem_storage_init(InfdFilesystemStorage* storage)
   priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
 
   priv->root_directory = NULL;
+  priv->sync_writes = FALSE;
+  priv->bytes_written = 0;
+
+  priv->io = NULL;
+  priv->writes = g_hash_table_new_full(
+    g_str_hash,
+    g_str_equal,
+    g_free,
+    (GDestroyNotify)g_queue_free
+  );
+
+  priv->n_pending_writes = 0;
+
+  priv->commits = g_hash_table_new_full(
+    g_str_hash,
+    g_str_equal,
+    g_free,
+    infd_filesystem_storage_commit_free
+  );
+
+  priv->commit_timeout = NULL;
+  priv->commit_job = NULL;
+  priv->n_commits = 0;
+  priv->n_committed_files = 0;
+}
+
+static void
+infd_filesystem_storage_dispose(GObject* object)
+{
+  InfdFilesystemStorage* storage;
+  InfdFilesystemStoragePrivate* priv;
+
+  storage = INFD_FILESYSTEM_STORAGE(object);
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  /* Make sure everything that has been saved ends up on disk */
+  infd_filesystem_storage_set_io(storage, NULL);
+
+  G_OBJECT_CLASS(infd_filesystem_storage_parent_class)->dispose(object);
 }
 
 static void
@@ -379,6 +1685,13 @@ infd_filesystem_storage_finalize(GObject* object)
 
   g_free(priv->root_directory);
 
+  g_assert(g_hash_table_size(priv->writes) == 0);
+  g_hash_table_destroy(priv->writes);
+
+  g_assert(g_hash_table_size(priv->commits) == 0);
+  g_assert(priv->commit_job == NULL);
+  g_hash_table_destroy(priv->commits);
+
   G_OBJECT_CLASS(infd_filesystem_storage_parent_class)->finalize(object);
 }
 
@@ -403,6 +1716,20 @@ infd_filesystem_storage_set_property(GObject* object,
     );
 
     break;
+  case PROP_SYNC_WRITES:
+    priv->sync_writes = g_value_get_boolean(value);
+    if(priv->sync_writes == FALSE)
+      infd_filesystem_storage_commit_pending(storage);
+    break;
+  case PROP_IO:
+    infd_filesystem_storage_set_io(
+      storage,
+      INF_IO(g_value_get_object(value))
+    );
+
+    break;
+  case PROP_COMMITS:
+  case PROP_COMMITTED_FILES:
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -426,6 +1753,18 @@ infd_filesystem_storage_get_property(GObject* object,
   case PROP_ROOT_DIRECTORY:
     g_value_set_string(value, priv->root_directory);
     break;
+  case PROP_SYNC_WRITES:
+    g_value_set_boolean(value, priv->sync_writes);
+    break;
+  case PROP_IO:
+    g_value_set_object(value, priv->io);
+    break;
+  case PROP_COMMITS:
+    g_value_set_uint(value, priv->n_commits);
+    break;
+  case PROP_COMMITTED_FILES:
+    g_value_set_uint(value, priv->n_committed_files);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -500,6 +1839,9 @@ infd_filesystem_storage_storage_read_subdirectory(InfdStorage* storage,
   full_name = g_build_filename(priv->root_directory, converted_name, NULL);
   g_free(converted_name);
 
+  /* Notes written in this main loop iteration are not in place yet */
+  infd_filesystem_storage_commit_pending(fs_storage);
+
   list = NULL;
 
   result = inf_file_util_list_directory(
@@ -586,6 +1928,15 @@ infd_filesystem_storage_storage_remove_node(InfdStorage* storage,
   full_name = g_build_filename(priv->root_directory, disk_name, NULL);
   if(disk_name != converted_name) g_free(disk_name);
 
+  /* Do not let a pending write recreate a removed file. Writes are rare
+   * compared to removals of subdirectories, so simply wait for all of them
+   * in that case. */
+  if(identifier != NULL)
+    infd_filesystem_storage_write_wait(fs_storage, full_name);
+  else
+    infd_filesystem_storage_flush(fs_storage);
+  infd_filesystem_storage_commit_pending(fs_storage);
+
   result = inf_file_util_delete(full_name, error);
   g_free(full_name);
 
@@ -608,6 +1959,26 @@ infd_filesystem_storage_storage_remove_node(InfdStorage* storage,
     g_free(full_name);
   }
 
+  /* Remove the journal of a note, if the note plugin keeps one */
+  if(result == TRUE && identifier != NULL)
+  {
+    disk_name = g_strconcat(converted_name, ".journal", NULL);
+    full_name = g_build_filename(priv->root_directory, disk_name, NULL);
+    g_free(disk_name);
+
+    if(g_unlink(full_name) == -1)
+    {
+      save_errno = errno;
+      if(save_errno != ENOENT)
+      {
+        infd_filesystem_storage_system_error(save_errno, error);
+        result = FALSE;
+      }
+    }
+
+    g_free(full_name);
+  }
+
   g_free(converted_name);
   return result;
 }
@@ -635,6 +2006,8 @@ infd_filesystem_storage_storage_read_acl(InfdStorage* storage,
   full_path = infd_filesystem_storage_get_acl_path(fs_storage, path, error);
   if(full_path == NULL) return NULL;
 
+  infd_filesystem_storage_commit_pending(fs_storage);
+
   local_error = NULL;
   doc = infd_filesystem_storage_read_xml_file_impl(
     fs_storage,
@@ -763,6 +2136,9 @@ infd_filesystem_storage_storage_write_acl(InfdStorage* storage,
 
   if(root == NULL)
   {
+    /* Do not let a pending commit bring the file back */
+    infd_filesystem_storage_commit_pending(INFD_FILESYSTEM_STORAGE(storage));
+
     if(g_unlink(full_path) == -1)
     {
       save_errno = errno;
@@ -799,6 +2175,15 @@ infd_filesystem_storage_storage_write_acl(InfdStorage* storage,
   return TRUE;
 }
 
+static guint64
+infd_filesystem_storage_storage_get_bytes_written(InfdStorage* storage)
+{
+  InfdFilesystemStoragePrivate* priv;
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  return priv->bytes_written;
+}
+
 static void
 infd_filesystem_storage_class_init(
   InfdFilesystemStorageClass* filesystem_storage_class)
@@ -806,6 +2191,7 @@ infd_filesystem_storage_class_init(
   GObjectClass* object_class;
   object_class = G_OBJECT_CLASS(filesystem_storage_class);
 
+  object_class->dispose = infd_filesystem_storage_dispose;
   object_class->finalize = infd_filesystem_storage_finalize;
   object_class->set_property = infd_filesystem_storage_set_property;
   object_class->get_property = infd_filesystem_storage_get_property;
@@ -825,6 +2211,60 @@ infd_filesystem_storage_class_init(
       G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
     )
   );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_SYNC_WRITES,
+    g_param_spec_boolean(
+      "sync-writes",
+      "Sync writes",
+      "Whether written files are flushed to disk before they replace the "
+      "previous version",
+      FALSE,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_IO,
+    g_param_spec_object(
+      "io",
+      "IO",
+      "The I/O object used to report asynchronous writes and to schedule "
+      "group commits",
+      INF_TYPE_IO,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMMITS,
+    g_param_spec_uint(
+      "commits",
+      "Commits",
+      "The number of group commits performed so far",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMMITTED_FILES,
+    g_param_spec_uint(
+      "committed-files",
+      "Committed files",
+      "The number of files written by group commits so far",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READABLE
+    )
+  );
 }
 
 static void
@@ -840,6 +2280,8 @@ infd_filesystem_storage_storage_iface_init(InfdStorageInterface* iface)
     infd_filesystem_storage_storage_read_acl;
   iface->write_acl =
     infd_filesystem_storage_storage_write_acl;
+  iface->get_bytes_written =
+    infd_filesystem_storage_storage_get_bytes_written;
 }
 
 /**
@@ -918,13 +2360,15 @@ infd_filesystem_storage_get_path(InfdFilesystemStorage* storage,
  * @storage: A #InfdFilesystemStorage.
  * @identifier: The type of node to open.
  * @path: The path to open, in UTF-8.
- * @mode: Either "r" for reading or "w" for writing.
+ * @mode: Either "r" for reading, "w" for writing or "a" for appending.
  * @full_path: (out) (type filename) (transfer full): Return location
  * of the full filename, or %NULL.
  * @error: Location to store error information, if any.
  *
  * Opens a file in the given path within the storage's root directory. If
  * the file exists already, and @mode is set to "w", the file is overwritten.
+ * Unlike infd_filesystem_storage_write_xml_file(), this happens in place,
+ * so prefer that function to replace a whole file.
  *
  * If @full_path is not %NULL, then it will be set to a newly allocated
  * string which contains the full name of the opened file, in the Glib file
@@ -935,6 +2379,10 @@ infd_filesystem_storage_get_path(InfdFilesystemStorage* storage,
  * identifiers can be used to store custom data in the filesystem, linked to
  * this #InfdFilesystemStorage object.
  *
+ * Data written to the stream is not counted by
+ * infd_storage_get_bytes_written() unless it is reported with
+ * infd_filesystem_storage_add_bytes_written().
+ *
  * Returns: (transfer full): A stream for the open file. Close with
  * infd_filesystem_storage_stream_close().
  **/
@@ -965,6 +2413,11 @@ infd_filesystem_storage_open(InfdFilesystemStorage* storage,
   if(full_name == NULL)
     return NULL;
 
+  /* Streams are written directly, so everything written before needs to
+   * be in place to keep the order of writes. */
+  infd_filesystem_storage_write_wait(storage, full_name);
+  infd_filesystem_storage_commit_pending(storage);
+
   res = infd_filesystem_storage_open_impl(
     storage,
     full_name,
@@ -1024,6 +2477,9 @@ infd_filesystem_storage_read_xml_file(InfdFilesystemStorage* storage,
   if(full_name == NULL)
     return NULL;
 
+  infd_filesystem_storage_write_wait(storage, full_name);
+  infd_filesystem_storage_commit_pending(storage);
+
   res = infd_filesystem_storage_read_xml_file_impl(
     storage,
     full_name,
@@ -1047,6 +2503,13 @@ infd_filesystem_storage_read_xml_file(InfdFilesystemStorage* storage,
  * by @identifier and @path. See infd_filesystem_storage_open() for how
  * @identifier and @path should be interpreted.
  *
+ * The document is written to a temporary file first, which then replaces
+ * the previous version of the file, so that an interrupted write never
+ * leaves a truncated file behind. If #InfdFilesystemStorage:sync-writes is
+ * set, the new version is flushed to disk before it replaces the previous
+ * one, and the function returns only once the replacement has been flushed
+ * as well.
+ *
  * Returns: %TRUE on success or %FALSE on error.
  **/
 gboolean
@@ -1075,6 +2538,8 @@ infd_filesystem_storage_write_xml_file(InfdFilesystemStorage* storage,
   if(full_name == NULL)
     return FALSE;
 
+  infd_filesystem_storage_write_wait(storage, full_name);
+
   result = infd_filesystem_storage_write_xml_file_impl(
     storage,
     full_name,
@@ -1086,6 +2551,237 @@ infd_filesystem_storage_write_xml_file(InfdFilesystemStorage* storage,
   return result;
 }
 
+/**
+ * infd_filesystem_storage_write_xml_async:
+ * @storage: A #InfdFilesystemStorage.
+ * @io: A #InfIo to report the result in.
+ * @identifier: The type of node to write.
+ * @path: The path to write to, in UTF-8.
+ * @doc: (transfer full): The XML document to write.
+ * @func: (scope async) (allow-none): Function to be called when the write
+ * has finished, or %NULL.
+ * @user_data: Additional data to pass to @func.
+ * @error: Location to store error information, if any.
+ *
+ * Writes the XML document in @doc into a file like
+ * infd_filesystem_storage_write_xml_file(), but without blocking the
+ * calling thread. The document is serialized and written to disk in a
+ * worker thread, and @func is called in the thread of @io when this has
+ * finished. The function takes ownership of @doc, which must not be
+ * accessed anymore by the caller.
+ *
+ * The document is written to a temporary file first, which then replaces
+ * the previous version of the file, so that the file always contains
+ * either the old or the new document. If #InfdFilesystemStorage:sync-writes
+ * is set, the file is moved into place by a group commit, see
+ * infd_filesystem_storage_commit(), and @func is called only after the
+ * commit, with an error if the commit of the file failed.
+ *
+ * Writes to the same file are performed in the order in which they have
+ * been made. Reading or writing the file with other functions of @storage
+ * waits for pending writes to finish first. Use
+ * infd_filesystem_storage_flush() to wait for all pending writes.
+ *
+ * All asynchronous writes of @storage need to use the same @io. If the
+ * function fails, %FALSE is returned, @error is set and @func is not called.
+ *
+ * Returns: %TRUE if the write has been started, or %FALSE on error.
+ **/
+gboolean
+infd_filesystem_storage_write_xml_async(InfdFilesystemStorage* storage,
+                                        InfIo* io,
+                                        const gchar* identifier,
+                                        const gchar* path,
+                                        xmlDocPtr doc,
+                                        InfdFilesystemStorageWriteFunc func,
+                                        gpointer user_data,
+                                        GError** error)
+{
+  InfdFilesystemStoragePrivate* priv;
+  InfdFilesystemStorageWrite* write;
+  gchar* full_name;
+  GQueue* queue;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(INF_IS_IO(io), FALSE);
+  g_return_val_if_fail(identifier != NULL, FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(doc != NULL, FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+  g_return_val_if_fail(
+    priv->n_pending_writes == 0 || priv->io == io,
+    FALSE
+  );
+
+  full_name = infd_filesystem_storage_get_path(
+    storage,
+    identifier,
+    path,
+    error
+  );
+
+  if(full_name == NULL)
+  {
+    xmlFreeDoc(doc);
+    return FALSE;
+  }
+
+  /* The operations require the IO object to stay alive while they are
+   * running, so keep a reference until the storage is disposed. */
+  infd_filesystem_storage_set_io(storage, io);
+
+  write = g_slice_new(InfdFilesystemStorageWrite);
+  write->storage = storage;
+  write->operation = NULL;
+  write->ref_count = 1;
+  write->full_path = full_name;
+  write->doc = doc;
+  write->commit = priv->sync_writes;
+  write->temp_path = NULL;
+  write->func = func;
+  write->user_data = user_data;
+
+  g_mutex_init(&write->mutex);
+  g_cond_init(&write->cond);
+  write->running = FALSE;
+  write->claimed = FALSE;
+  write->finished = FALSE;
+  write->size = 0;
+  write->error = NULL;
+
+  ++priv->n_pending_writes;
+
+  queue = g_hash_table_lookup(priv->writes, full_name);
+  if(queue != NULL)
+  {
+    /* Started once the previous writes to the same file have finished */
+    g_queue_push_tail(queue, write);
+  }
+  else
+  {
+    queue = g_queue_new();
+    g_queue_push_tail(queue, write);
+    g_hash_table_insert(priv->writes, g_strdup(full_name), queue);
+
+    infd_filesystem_storage_write_start(write);
+  }
+
+  return TRUE;
+}
+
+/**
+ * infd_filesystem_storage_get_pending_writes:
+ * @storage: A #InfdFilesystemStorage.
+ *
+ * Returns the number of writes started with
+ * infd_filesystem_storage_write_xml_async() that have not yet finished.
+ * This includes writes that wait for a group commit.
+ *
+ * Returns: The number of pending asynchronous writes.
+ **/
+guint
+infd_filesystem_storage_get_pending_writes(InfdFilesystemStorage* storage)
+{
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), 0);
+  return INFD_FILESYSTEM_STORAGE_PRIVATE(storage)->n_pending_writes;
+}
+
+/**
+ * infd_filesystem_storage_flush:
+ * @storage: A #InfdFilesystemStorage.
+ *
+ * Blocks until all writes started with
+ * infd_filesystem_storage_write_xml_async() have finished, and commits
+ * files that are waiting for a group commit, see
+ * infd_filesystem_storage_commit(). The callbacks of the writes are called
+ * before this function returns. This happens automatically when @storage is
+ * disposed.
+ **/
+void
+infd_filesystem_storage_flush(InfdFilesystemStorage* storage)
+{
+  InfdFilesystemStoragePrivate* priv;
+  GHashTableIter iter;
+  gpointer key;
+  gchar* full_path;
+
+  g_return_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage));
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  while(g_hash_table_size(priv->writes) > 0)
+  {
+    g_hash_table_iter_init(&iter, priv->writes);
+    g_hash_table_iter_next(&iter, &key, NULL);
+
+    /* The key is freed when the last write to the file is finished */
+    full_path = g_strdup(key);
+    infd_filesystem_storage_write_wait(storage, full_path);
+    g_free(full_path);
+  }
+
+  infd_filesystem_storage_commit_pending(storage);
+}
+
+/**
+ * infd_filesystem_storage_commit:
+ * @storage: A #InfdFilesystemStorage.
+ * @error: Location to store error information, if any.
+ *
+ * If #InfdFilesystemStorage:sync-writes is set and @storage has an
+ * #InfdFilesystemStorage:io object, then files written with
+ * infd_filesystem_storage_write_xml_async() are not flushed to disk one by
+ * one. Instead, all files whose writes finish within the same main loop
+ * iteration, such as by an autosave of many documents at once, are flushed
+ * to disk together in a worker thread after the iteration, and only then
+ * replace their previous versions. This function performs such a group
+ * commit right away, and completes the one running in the background, if
+ * any, blocking until the files are on disk.
+ *
+ * Until the commit, the previous version of a file stays in place on disk.
+ * Accessing a file through @storage commits pending writes first. The
+ * callback of each write is called once its file has been committed, with
+ * an error if that failed.
+ *
+ * If the function fails, %FALSE is returned and @error is set to the first
+ * error that occurred. Files which could not be committed keep their
+ * previous version.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ **/
+gboolean
+infd_filesystem_storage_commit(InfdFilesystemStorage* storage,
+                               GError** error)
+{
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  return infd_filesystem_storage_commit_impl(storage, error);
+}
+
+/**
+ * infd_filesystem_storage_add_bytes_written:
+ * @storage: A #InfdFilesystemStorage.
+ * @len: The number of bytes that have been written.
+ *
+ * Adds @len to the number of bytes that infd_storage_get_bytes_written()
+ * reports for @storage. Streams opened with infd_filesystem_storage_open()
+ * are written without the storage being involved, so call this after
+ * writing to such a stream to have the data accounted for.
+ */
+void
+infd_filesystem_storage_add_bytes_written(InfdFilesystemStorage* storage,
+                                          gsize len)
+{
+  InfdFilesystemStoragePrivate* priv;
+
+  g_return_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage));
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+  priv->bytes_written += len;
+}
+
 /**
  * infd_filesystem_storage_stream_close:
  * @file: A #FILE opened with infd_filesystem_storage_open().
@@ -20,6 +20,8 @@
 #ifndef __INFD_FILESYSTEM_STORAGE_H__
 #define __INFD_FILESYSTEM_STORAGE_H__
 
+#include <libinfinity/common/inf-io.h>
+
 #include <glib-object.h>
 
 #include <libxml/tree.h>
@@ -49,6 +51,21 @@ typedef enum _InfdFilesystemStorageError {
   INFD_FILESYSTEM_STORAGE_ERROR_FAILED
 } InfdFilesystemStorageError;
 
+/**
+ * InfdFilesystemStorageWriteFunc:
+ * @storage: The #InfdFilesystemStorage that has written a file.
+ * @error: Reason of the failure, or %NULL if the file was written
+ * successfully.
+ * @user_data: Additional data passed to
+ * infd_filesystem_storage_write_xml_async().
+ *
+ * This callback is called when an asynchronous write started with
+ * infd_filesystem_storage_write_xml_async() has finished.
+ */
+typedef void(*InfdFilesystemStorageWriteFunc)(InfdFilesystemStorage* storage,
+                                              const GError* error,
+                                              gpointer user_data);
+
 struct _InfdFilesystemStorageClass {
   GObjectClass parent_class;
 };
@@ -91,6 +108,30 @@ infd_filesystem_storage_write_xml_file(InfdFilesystemStorage* storage,
                                        xmlDocPtr doc,
                                        GError** error);
 
+gboolean
+infd_filesystem_storage_write_xml_async(InfdFilesystemStorage* storage,
+                                        InfIo* io,
+                                        const gchar* identifier,
+                                        const gchar* path,
+                                        xmlDocPtr doc,
+                                        InfdFilesystemStorageWriteFunc func,
+                                        gpointer user_data,
+                                        GError** error);
+
+guint
+infd_filesystem_storage_get_pending_writes(InfdFilesystemStorage* storage);
+
+void
+infd_filesystem_storage_flush(InfdFilesystemStorage* storage);
+
+gboolean
+infd_filesystem_storage_commit(InfdFilesystemStorage* storage,
+                               GError** error);
+
+void
+infd_filesystem_storage_add_bytes_written(InfdFilesystemStorage* storage,
+                                          gsize len);
+
 int
 infd_filesystem_storage_stream_close(FILE* file);
 
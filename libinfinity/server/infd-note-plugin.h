@@ -53,6 +53,20 @@ typedef gboolean(*InfdNotePluginSessionWrite)(InfdStorage*,
                                               gpointer,
                                               GError**);
 
+typedef gsize(*InfdNotePluginSessionSize)(InfSession*,
+                                          gpointer);
+
+typedef void(*InfdNotePluginWriteFunc)(const GError*,
+                                       gpointer);
+
+typedef gboolean(*InfdNotePluginSessionWriteAsync)(InfdStorage*,
+                                                   InfSession*,
+                                                   const gchar*,
+                                                   gpointer,
+                                                   InfdNotePluginWriteFunc,
+                                                   gpointer,
+                                                   GError**);
+
 typedef struct _InfdNotePlugin InfdNotePlugin;
 struct _InfdNotePlugin {
   gpointer user_data;
@@ -67,6 +81,18 @@ struct _InfdNotePlugin {
   InfdNotePluginSessionNew session_new;
   InfdNotePluginSessionRead session_read;
   InfdNotePluginSessionWrite session_write;
+
+  /* Estimates the number of bytes a session occupies in memory. This is
+   * optional, and used to keep the sessions of a directory within its
+   * memory budget. */
+  InfdNotePluginSessionSize session_size;
+
+  /* Writes a session like session_write, but without waiting for the data
+   * to reach the storage. The callback is called with the result once it
+   * has, unless the function returns FALSE. This is optional, and used for
+   * saving sessions that are unloaded because they are idle or because of
+   * the memory budget. */
+  InfdNotePluginSessionWriteAsync session_write_async;
 };
 
 G_END_DECLS
@@ -380,4 +380,29 @@ infd_storage_write_acl(InfdStorage* storage,
   return iface->write_acl(storage, path, sheet_set, error);
 }
 
+/**
+ * infd_storage_get_bytes_written:
+ * @storage: A #InfdStorage.
+ *
+ * Returns the total number of bytes that have been written into @storage
+ * since it was created. Comparing the value before and after an operation
+ * tells how many bytes the operation has written. Storage backends which do
+ * not keep track of this always return 0.
+ *
+ * Returns: The number of bytes written into @storage.
+ */
+guint64
+infd_storage_get_bytes_written(InfdStorage* storage)
+{
+  InfdStorageInterface* iface;
+
+  g_return_val_if_fail(INFD_IS_STORAGE(storage), 0);
+
+  iface = INFD_STORAGE_GET_IFACE(storage);
+  if(iface->get_bytes_written == NULL)
+    return 0;
+
+  return iface->get_bytes_written(storage);
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -91,6 +91,9 @@ struct _InfdStorageInterface {
                         const gchar* path,
                         const InfAclSheetSet* sheet_set,
                         GError** error);
+
+  /* Optional: Total number of bytes written into the storage so far */
+  guint64 (*get_bytes_written)(InfdStorage* storage);
 };
 
 GType
@@ -157,6 +160,9 @@ infd_storage_write_acl(InfdStorage* storage,
                        const InfAclSheetSet* sheet_set,
                        GError** error);
 
+guint64
+infd_storage_get_bytes_written(InfdStorage* storage);
+
 G_END_DECLS
 
 #endif /* __INFD_STORAGE_H__ */
@@ -17,13 +17,15 @@
  * MA 02110-1301, USA.
  */
 
+/* This needs to come first, since it defines _GNU_SOURCE for accept4() */
+#include <config.h>
+
 #include <libinfinity/server/infd-tcp-server.h>
 #include <libinfinity/common/inf-tcp-connection-private.h>
 #include <libinfinity/common/inf-ip-address.h>
 #include <libinfinity/common/inf-io.h>
 #include <libinfinity/common/inf-native-socket.h>
 #include <libinfinity/inf-define-enum.h>
-#include <config.h>
 
 #ifndef G_OS_WIN32
 # include <sys/types.h>
@@ -34,11 +36,12 @@
 # include <fcntl.h>
 
 # include <errno.h>
-# include <string.h>
 #else
 # include <ws2tcpip.h>
 #endif
 
+#include <string.h>
+
 static const GEnumValue infd_tcp_server_status_values[] = {
   {
     INFD_TCP_SERVER_CLOSED,
@@ -67,6 +70,39 @@ struct _InfdTcpServerPrivate {
   guint local_port;
 
   InfKeepalive keepalive;
+
+  /* Accepted connections whose handshake has not yet finished. Accepting
+   * is suspended while there are max_pending_handshakes of them. With a
+   * limit, connections are closed if their handshake does not finish
+   * within handshake_timeout seconds, so that clients which never finish
+   * it cannot keep others out. */
+  GHashTable* pending; /* InfTcpConnection* -> InfdTcpServerPending* */
+  guint max_pending_handshakes;
+  guint handshake_timeout;
+  guint timed_out_handshakes;
+  gboolean suspended;
+
+  /* Token buckets for the accepted connections of each remote address,
+   * refilled at address_rate_limit connections per minute. IPv6 addresses
+   * are limited by their /64 prefix, since that is usually what a single
+   * host is given. */
+  GHashTable* rate_buckets;
+  guint rate_buckets_prune_size;
+  guint address_rate_limit;
+  guint rejected_connections;
+};
+
+typedef struct _InfdTcpServerPending InfdTcpServerPending;
+struct _InfdTcpServerPending {
+  InfdTcpServer* server;
+  InfTcpConnection* connection;
+  InfIoTimeout* timeout;
+};
+
+typedef struct _InfdTcpServerRateBucket InfdTcpServerRateBucket;
+struct _InfdTcpServerRateBucket {
+  gdouble tokens;
+  gint64 last_update;
 };
 
 enum {
@@ -79,7 +115,14 @@ enum {
   PROP_LOCAL_ADDRESS,
   PROP_LOCAL_PORT,
 
-  PROP_KEEPALIVE
+  PROP_KEEPALIVE,
+
+  PROP_MAX_PENDING_HANDSHAKES,
+  PROP_PENDING_HANDSHAKES,
+  PROP_HANDSHAKE_TIMEOUT,
+  PROP_TIMED_OUT_HANDSHAKES,
+  PROP_ADDRESS_RATE_LIMIT,
+  PROP_REJECTED_CONNECTIONS
 };
 
 enum {
@@ -89,6 +132,13 @@ enum {
   LAST_SIGNAL
 };
 
+/* Default time in seconds within which a pending handshake needs to finish
+ * if the number of pending handshakes is limited */
+#define INFD_TCP_SERVER_DEFAULT_HANDSHAKE_TIMEOUT 30
+
+/* Minimum number of rate buckets before full ones are pruned */
+#define INFD_TCP_SERVER_RATE_BUCKETS_PRUNE_SIZE 256
+
 #define INFD_TCP_SERVER_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INFD_TYPE_TCP_SERVER, InfdTcpServerPrivate))
 
 static guint tcp_server_signals[LAST_SIGNAL];
@@ -154,6 +204,342 @@ infd_tcp_server_system_error(InfdTcpServer* server,
   g_error_free(error);
 }
 
+static void
+infd_tcp_server_update_watch(InfdTcpServer* server)
+{
+  InfdTcpServerPrivate* priv;
+  gboolean suspended;
+
+  priv = INFD_TCP_SERVER_PRIVATE(server);
+
+  suspended = priv->max_pending_handshakes > 0 &&
+    g_hash_table_size(priv->pending) >= priv->max_pending_handshakes;
+
+  /* While accepting is suspended, further clients queue up in the listen
+   * backlog of the socket until a pending handshake finishes. */
+  if(priv->watch != NULL && suspended != priv->suspended)
+  {
+    inf_io_update_watch(
+      priv->io,
+      priv->watch,
+      suspended ? INF_IO_ERROR : INF_IO_INCOMING | INF_IO_ERROR
+    );
+  }
+
+  priv->suspended = suspended;
+}
+
+static void
+infd_tcp_server_pending_status_cb(GObject* object,
+                                  GParamSpec* pspec,
+                                  gpointer user_data);
+
+static void
+infd_tcp_server_pending_timeout_func(gpointer user_data);
+
+static void
+infd_tcp_server_pending_set_timeout(InfdTcpServerPending* pending)
+{
+  InfdTcpServerPrivate* priv;
+  gboolean needs_timeout;
+
+  priv = INFD_TCP_SERVER_PRIVATE(pending->server);
+
+  needs_timeout =
+    priv->max_pending_handshakes > 0 && priv->handshake_timeout > 0;
+
+  if(needs_timeout == TRUE && pending->timeout == NULL)
+  {
+    pending->timeout = inf_io_add_timeout(
+      priv->io,
+      priv->handshake_timeout * 1000,
+      infd_tcp_server_pending_timeout_func,
+      pending,
+      NULL
+    );
+  }
+  else if(needs_timeout == FALSE && pending->timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->io, pending->timeout);
+    pending->timeout = NULL;
+  }
+}
+
+static void
+infd_tcp_server_pending_update_timeouts(InfdTcpServer* server)
+{
+  InfdTcpServerPrivate* priv;
+  GHashTableIter iter;
+  gpointer pending;
+
+  priv = INFD_TCP_SERVER_PRIVATE(server);
+
+  g_hash_table_iter_init(&iter, priv->pending);
+  while(g_hash_table_iter_next(&iter, NULL, &pending))
+    infd_tcp_server_pending_set_timeout((InfdTcpServerPending*)pending);
+}
+
+static void
+infd_tcp_server_pending_weak_notify(gpointer data,
+                                    GObject* where_the_object_was)
+{
+  InfdTcpServerPending* pending;
+  InfdTcpServer* server;
+  InfdTcpServerPrivate* priv;
+
+  pending = (InfdTcpServerPending*)data;
+  server = pending->server;
+  priv = INFD_TCP_SERVER_PRIVATE(server);
+
+  if(pending->timeout != NULL)
+    inf_io_remove_timeout(priv->io, pending->timeout);
+
+  g_hash_table_remove(priv->pending, where_the_object_was);
+  g_slice_free(InfdTcpServerPending, pending);
+
+  infd_tcp_server_update_watch(server);
+  g_object_notify(G_OBJECT(server), "pending-handshakes");
+}
+
+static void
+infd_tcp_server_pending_free(InfdTcpServerPending* pending)
+{
+  InfdTcpServerPrivate* priv;
+  priv = INFD_TCP_SERVER_PRIVATE(pending->server);
+
+  if(pending->timeout != NULL)
+    inf_io_remove_timeout(priv->io, pending->timeout);
+
+  g_object_weak_unref(
+    G_OBJECT(pending->connection),
+    infd_tcp_server_pending_weak_notify,
+    pending
+  );
+
+  g_signal_handlers_disconnect_by_func(
+    G_OBJECT(pending->connection),
+    G_CALLBACK(infd_tcp_server_pending_status_cb),
+    pending
+  );
+
+  g_slice_free(InfdTcpServerPending, pending);
+}
+
+static void
+infd_tcp_server_pending_remove(InfdTcpServer* server,
+                               InfTcpConnection* connection)
+{
+  InfdTcpServerPrivate* priv;
+  InfdTcpServerPending* pending;
+
+  priv = INFD_TCP_SERVER_PRIVATE(server);
+  pending = g_hash_table_lookup(priv->pending, connection);
+
+  if(pending != NULL)
+  {
+    g_hash_table_remove(priv->pending, connection);
+    infd_tcp_server_pending_free(pending);
+
+    infd_tcp_server_update_watch(server);
+    g_object_notify(G_OBJECT(server), "pending-handshakes");
+  }
+}
+
+static void
+infd_tcp_server_pending_status_cb(GObject* object,
+                                  GParamSpec* pspec,
+                                  gpointer user_data)
+{
+  InfdTcpServerPending* pending;
+  InfTcpConnectionStatus status;
+
+  pending = (InfdTcpServerPending*)user_data;
+  g_object_get(object, "status", &status, NULL);
+
+  if(status == INF_TCP_CONNECTION_CLOSED)
+    infd_tcp_server_pending_remove(pending->server, pending->connection);
+}
+
+static void
+infd_tcp_server_pending_timeout_func(gpointer user_data)
+{
+  InfdTcpServerPending* pending;
+  InfdTcpServer* server;
+  InfdTcpServerPrivate* priv;
+  InfTcpConnection* connection;
+
+  pending = (InfdTcpServerPending*)user_data;
+  server = pending->server;
+  priv = INFD_TCP_SERVER_PRIVATE(server);
+  connection = pending->connection;
+
+  /* The timeout is removed by the InfIo after it elapsed */
+  pending->timeout = NULL;
+
+  g_object_ref(server);
+  g_object_ref(connection);
+
+  infd_tcp_server_pending_remove(server, connection);
+
+  ++priv->timed_out_handshakes;
+  g_object_notify(G_OBJECT(server), "timed-out-handshakes");
+
+  /* Whoever handles the connection learns about this by the status
+   * change, as if the client had closed it. */
+  inf_tcp_connection_close(connection);
+
+  g_object_unref(connection);
+  g_object_unref(server);
+}
+
+static void
+infd_tcp_server_pending_add(InfdTcpServer* server,
+                            InfTcpConnection* connection)
+{
+  InfdTcpServerPrivate* priv;
+  InfdTcpServerPending* pending;
+
+  priv = INFD_TCP_SERVER_PRIVATE(server);
+
+  pending = g_slice_new(InfdTcpServerPending);
+  pending->server = server;
+  pending->connection = connection;
+  pending->timeout = NULL;
+
+  g_hash_table_insert(priv->pending, connection, pending);
+
+  g_object_weak_ref(
+    G_OBJECT(connection),
+    infd_tcp_server_pending_weak_notify,
+    pending
+  );
+
+  g_signal_connect(
+    G_OBJECT(connection),
+    "notify::status",
+    G_CALLBACK(infd_tcp_server_pending_status_cb),
+    pending
+  );
+
+  infd_tcp_server_pending_set_timeout(pending);
+  infd_tcp_server_update_watch(server);
+  g_object_notify(G_OBJECT(server), "pending-handshakes");
+}
+
+static gdouble
+infd_tcp_server_rate_bucket_refill(InfdTcpServerPrivate* priv,
+                                   InfdTcpServerRateBucket* bucket,
+                                   gint64 now)
+{
+  gdouble tokens;
+
+  tokens = bucket->tokens +
+    (now - bucket->last_update) * priv->address_rate_limit / 60e6;
+
+  return MIN(tokens, priv->address_rate_limit);
+}
+
+static gboolean
+infd_tcp_server_rate_bucket_full_func(gpointer key,
+                                      gpointer value,
+                                      gpointer user_data)
+{
+  InfdTcpServerPrivate* priv;
+  InfdTcpServerRateBucket* bucket;
+
+  priv = (InfdTcpServerPrivate*)user_data;
+  bucket = (InfdTcpServerRateBucket*)value;
+
+  /* A full bucket is the same as no bucket at all */
+  return infd_tcp_server_rate_bucket_refill(
+    priv,
+    bucket,
+    g_get_monotonic_time()
+  ) >= priv->address_rate_limit;
+}
+
+static void
+infd_tcp_server_rate_bucket_free(gpointer bucket)
+{
+  g_slice_free(InfdTcpServerRateBucket, bucket);
+}
+
+/* Returns the key of the rate bucket for connections from address. All
+ * addresses of an IPv6 /64 network share a bucket, since a single host
+ * can usually choose freely among them. */
+static gchar*
+infd_tcp_server_rate_key(const InfIpAddress* address)
+{
+  InfIpAddress* prefix;
+  guint8 raw[16];
+  gchar* key;
+
+  if(inf_ip_address_get_family(address) != INF_IP_ADDRESS_IPV6)
+    return inf_ip_address_to_string(address);
+
+  memcpy(raw, inf_ip_address_get_raw(address), 8);
+  memset(raw + 8, 0, 8);
+
+  prefix = inf_ip_address_new_raw6(raw);
+  key = inf_ip_address_to_string(prefix);
+  inf_ip_address_free(prefix);
+
+  return key;
+}
+
+/* Returns TRUE if another connection from address may be accepted, and
+ * accounts for it. */
+static gboolean
+infd_tcp_server_rate_check(InfdTcpServer* server,
+                           const InfIpAddress* address)
+{
+  InfdTcpServerPrivate* priv;
+  InfdTcpServerRateBucket* bucket;
+  gchar* key;
+  gint64 now;
+
+  priv = INFD_TCP_SERVER_PRIVATE(server);
+  if(priv->address_rate_limit == 0)
+    return TRUE;
+
+  now = g_get_monotonic_time();
+  key = infd_tcp_server_rate_key(address);
+  bucket = g_hash_table_lookup(priv->rate_buckets, key);
+
+  if(bucket == NULL)
+  {
+    if(g_hash_table_size(priv->rate_buckets) >= priv->rate_buckets_prune_size)
+    {
+      g_hash_table_foreach_remove(
+        priv->rate_buckets,
+        infd_tcp_server_rate_bucket_full_func,
+        priv
+      );
+
+      priv->rate_buckets_prune_size = MAX(
+        INFD_TCP_SERVER_RATE_BUCKETS_PRUNE_SIZE,
+        2 * g_hash_table_size(priv->rate_buckets)
+      );
+    }
+
+    bucket = g_slice_new(InfdTcpServerRateBucket);
+    bucket->tokens = priv->address_rate_limit;
+    g_hash_table_insert(priv->rate_buckets, key, bucket);
+  }
+  else
+  {
+    bucket->tokens = infd_tcp_server_rate_bucket_refill(priv, bucket, now);
+    g_free(key);
+  }
+
+  bucket->last_update = now;
+  if(bucket->tokens < 1.0)
+    return FALSE;
+
+  bucket->tokens -= 1.0;
+  return TRUE;
+}
+
 static void
 infd_tcp_server_io(InfNativeSocket* socket,
                    InfIoEvent events,
@@ -206,7 +592,16 @@ infd_tcp_server_io(InfNativeSocket* socket,
       errno = 0;
 #endif
       len = sizeof(native_addr);
+#ifdef HAVE_ACCEPT4
+      new_socket = accept4(
+        priv->socket,
+        &native_addr.in_generic,
+        &len,
+        SOCK_NONBLOCK | SOCK_CLOEXEC
+      );
+#else
       new_socket = accept(priv->socket, &native_addr.in_generic, &len);
+#endif
       errcode = INF_NATIVE_SOCKET_LAST_ERROR;
 
       if(new_socket == INVALID_SOCKET &&
@@ -232,6 +627,17 @@ infd_tcp_server_io(InfNativeSocket* socket,
           break;
         }
 
+        if(infd_tcp_server_rate_check(server, address) == FALSE)
+        {
+          /* Drop the connection before spending any more resources on it */
+          inf_ip_address_free(address);
+          closesocket(new_socket);
+
+          ++priv->rejected_connections;
+          g_object_notify(G_OBJECT(server), "rejected-connections");
+          continue;
+        }
+
         error = NULL;
         connection = _inf_tcp_connection_accepted(
           priv->io,
@@ -246,6 +652,8 @@ infd_tcp_server_io(InfNativeSocket* socket,
 
         if(connection != NULL)
         {
+          infd_tcp_server_pending_add(server, connection);
+
           g_signal_emit(
             G_OBJECT(server),
             tcp_server_signals[NEW_CONNECTION],
@@ -271,7 +679,8 @@ infd_tcp_server_io(InfNativeSocket* socket,
     } while( (new_socket != INVALID_SOCKET ||
               (new_socket == INVALID_SOCKET &&
                errcode == INF_NATIVE_SOCKET_EINTR)) &&
-             (priv->socket != INVALID_SOCKET));
+             (priv->socket != INVALID_SOCKET) &&
+             (priv->suspended == FALSE));
   }
 
   g_object_unref(G_OBJECT(server));
@@ -292,6 +701,23 @@ infd_tcp_server_init(InfdTcpServer* server)
   priv->local_port = 0;
 
   priv->keepalive.mask = 0;
+
+  priv->pending = g_hash_table_new(NULL, NULL);
+  priv->max_pending_handshakes = 0;
+  priv->handshake_timeout = INFD_TCP_SERVER_DEFAULT_HANDSHAKE_TIMEOUT;
+  priv->timed_out_handshakes = 0;
+  priv->suspended = FALSE;
+
+  priv->rate_buckets = g_hash_table_new_full(
+    g_str_hash,
+    g_str_equal,
+    g_free,
+    infd_tcp_server_rate_bucket_free
+  );
+
+  priv->rate_buckets_prune_size = INFD_TCP_SERVER_RATE_BUCKETS_PRUNE_SIZE;
+  priv->address_rate_limit = 0;
+  priv->rejected_connections = 0;
 }
 
 static void
@@ -299,6 +725,8 @@ infd_tcp_server_dispose(GObject* object)
 {
   InfdTcpServer* server;
   InfdTcpServerPrivate* priv;
+  GHashTableIter iter;
+  gpointer pending;
 
   server = INFD_TCP_SERVER(object);
   priv = INFD_TCP_SERVER_PRIVATE(server);
@@ -306,6 +734,13 @@ infd_tcp_server_dispose(GObject* object)
   if(priv->status != INFD_TCP_SERVER_CLOSED)
     infd_tcp_server_close(server);
 
+  g_hash_table_iter_init(&iter, priv->pending);
+  while(g_hash_table_iter_next(&iter, NULL, &pending))
+  {
+    infd_tcp_server_pending_free((InfdTcpServerPending*)pending);
+    g_hash_table_iter_remove(&iter);
+  }
+
   if(priv->io  != NULL)
   {
     g_object_unref(G_OBJECT(priv->io));
@@ -327,6 +762,9 @@ infd_tcp_server_finalize(GObject* object)
   if(priv->local_address != NULL)
     inf_ip_address_free(priv->local_address);
 
+  g_hash_table_destroy(priv->pending);
+  g_hash_table_destroy(priv->rate_buckets);
+
   G_OBJECT_CLASS(infd_tcp_server_parent_class)->finalize(object);
 }
 
@@ -363,6 +801,19 @@ infd_tcp_server_set_property(GObject* object,
     g_assert(g_value_get_boxed(value) != NULL);
     priv->keepalive = *(const InfKeepalive*)g_value_get_boxed(value);
     break;
+  case PROP_MAX_PENDING_HANDSHAKES:
+    priv->max_pending_handshakes = g_value_get_uint(value);
+    infd_tcp_server_pending_update_timeouts(server);
+    infd_tcp_server_update_watch(server);
+    break;
+  case PROP_HANDSHAKE_TIMEOUT:
+    priv->handshake_timeout = g_value_get_uint(value);
+    infd_tcp_server_pending_update_timeouts(server);
+    break;
+  case PROP_ADDRESS_RATE_LIMIT:
+    priv->address_rate_limit = g_value_get_uint(value);
+    g_hash_table_remove_all(priv->rate_buckets);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -398,6 +849,24 @@ infd_tcp_server_get_property(GObject* object,
   case PROP_KEEPALIVE:
     g_value_set_boxed(value, &priv->keepalive);
     break;
+  case PROP_MAX_PENDING_HANDSHAKES:
+    g_value_set_uint(value, priv->max_pending_handshakes);
+    break;
+  case PROP_PENDING_HANDSHAKES:
+    g_value_set_uint(value, g_hash_table_size(priv->pending));
+    break;
+  case PROP_HANDSHAKE_TIMEOUT:
+    g_value_set_uint(value, priv->handshake_timeout);
+    break;
+  case PROP_TIMED_OUT_HANDSHAKES:
+    g_value_set_uint(value, priv->timed_out_handshakes);
+    break;
+  case PROP_ADDRESS_RATE_LIMIT:
+    g_value_set_uint(value, priv->address_rate_limit);
+    break;
+  case PROP_REJECTED_CONNECTIONS:
+    g_value_set_uint(value, priv->rejected_connections);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -416,6 +885,7 @@ infd_tcp_server_error(InfdTcpServer* server,
     g_assert(priv->watch != NULL);
     inf_io_remove_watch(priv->io, priv->watch);
     priv->watch = NULL;
+    priv->suspended = FALSE;
   }
 
   if(priv->socket != INVALID_SOCKET)
@@ -508,6 +978,97 @@ infd_tcp_server_class_init(InfdTcpServerClass* tcp_server_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_MAX_PENDING_HANDSHAKES,
+    g_param_spec_uint(
+      "max-pending-handshakes",
+      "Maximum pending handshakes",
+      "Maximum number of accepted connections whose handshake has not yet "
+      "finished before no more connections are accepted, or 0 for no limit",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_PENDING_HANDSHAKES,
+    g_param_spec_uint(
+      "pending-handshakes",
+      "Pending handshakes",
+      "Number of accepted connections whose handshake has not yet finished",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_HANDSHAKE_TIMEOUT,
+    g_param_spec_uint(
+      "handshake-timeout",
+      "Handshake timeout",
+      "Number of seconds after which an accepted connection is closed if "
+      "its handshake has not finished, or 0 for no timeout. Only applies if "
+      "max-pending-handshakes is set",
+      0,
+      G_MAXUINT / 1000,
+      INFD_TCP_SERVER_DEFAULT_HANDSHAKE_TIMEOUT,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_TIMED_OUT_HANDSHAKES,
+    g_param_spec_uint(
+      "timed-out-handshakes",
+      "Timed out handshakes",
+      "Number of connections that were closed because their handshake did "
+      "not finish within handshake-timeout",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_ADDRESS_RATE_LIMIT,
+    g_param_spec_uint(
+      "address-rate-limit",
+      "Address rate limit",
+      "Maximum number of connections accepted per minute from the same "
+      "remote address, or 0 for no limit. IPv6 addresses are counted by "
+      "their /64 prefix",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_REJECTED_CONNECTIONS,
+    g_param_spec_uint(
+      "rejected-connections",
+      "Rejected connections",
+      "Number of connections that were closed because their remote address "
+      "exceeded the address rate limit",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
   tcp_server_signals[NEW_CONNECTION] = g_signal_new(
     "new-connection",
     G_OBJECT_CLASS_TYPE(object_class),
@@ -787,6 +1348,9 @@ infd_tcp_server_open(InfdTcpServer* server,
     NULL
   );
 
+  priv->suspended = FALSE;
+  infd_tcp_server_update_watch(server);
+
   priv->status = INFD_TCP_SERVER_OPEN;
 
   g_object_notify(G_OBJECT(server), "status");
@@ -816,6 +1380,7 @@ infd_tcp_server_close(InfdTcpServer* server)
     g_assert(priv->watch != NULL);
     inf_io_remove_watch(priv->io, priv->watch);
     priv->watch = NULL;
+    priv->suspended = FALSE;
   }
 
   closesocket(priv->socket);
@@ -858,4 +1423,25 @@ infd_tcp_server_get_keepalive(InfdTcpServer* server)
   return &INFD_TCP_SERVER_PRIVATE(server)->keepalive;
 }
 
+/**
+ * infd_tcp_server_handshake_finished:
+ * @server: A #InfdTcpServer.
+ * @connection: A #InfTcpConnection accepted by @server.
+ *
+ * Tells @server that the handshake on @connection has finished, so that it
+ * no longer counts towards the #InfdTcpServer:max-pending-handshakes limit.
+ * Connections that are closed before their handshake finishes are removed
+ * from the count automatically. If @connection is not pending, then this
+ * function does nothing.
+ */
+void
+infd_tcp_server_handshake_finished(InfdTcpServer* server,
+                                   InfTcpConnection* connection)
+{
+  g_return_if_fail(INFD_IS_TCP_SERVER(server));
+  g_return_if_fail(INF_IS_TCP_CONNECTION(connection));
+
+  infd_tcp_server_pending_remove(server, connection);
+}
+
 /* vim:set et sw=2 ts=2: */
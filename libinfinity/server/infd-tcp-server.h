@@ -83,6 +83,10 @@ infd_tcp_server_set_keepalive(InfdTcpServer* server,
 const InfKeepalive*
 infd_tcp_server_get_keepalive(InfdTcpServer* server);
 
+void
+infd_tcp_server_handshake_finished(InfdTcpServer* server,
+                                   InfTcpConnection* connection);
+
 G_END_DECLS
 
 #endif /* __INFD_TCP_SERVER_H__ */
@@ -23,6 +23,8 @@
 #include <libinfinity/common/inf-xmpp-connection.h>
 #include <libinfinity/inf-signals.h>
 
+#include <string.h>
+
 /* Some Windows header #defines ERROR for no good */
 #ifdef G_OS_WIN32
 # ifdef ERROR
@@ -41,8 +43,15 @@ struct _InfdXmppServerPrivate {
   InfdXmppServerStatus status;
   gchar* local_hostname;
   InfXmppConnectionSecurityPolicy security_policy;
+  guint flush_latency;
+  guint compression_level;
+  guint compression_threshold;
+  gboolean tls_handshake_async;
 
   InfCertificateCredentials* tls_creds;
+  GBytes* tls_ticket_key;
+  guint tls_full_handshakes;
+  guint tls_resumed_handshakes;
 
   InfSaslContext* sasl_context;
   InfSaslContext* sasl_own_context;
@@ -60,6 +69,13 @@ enum {
   PROP_SASL_MECHANISMS,
 
   PROP_SECURITY_POLICY,
+  PROP_FLUSH_LATENCY,
+  PROP_COMPRESSION_LEVEL,
+  PROP_COMPRESSION_THRESHOLD,
+  PROP_TLS_HANDSHAKE_ASYNC,
+
+  PROP_TLS_FULL_HANDSHAKES,
+  PROP_TLS_RESUMED_HANDSHAKES,
 
   /* Overridden from XML server */
   PROP_STATUS
@@ -80,6 +96,96 @@ G_DEFINE_TYPE_WITH_CODE(InfdXmppServer, infd_xmpp_server, G_TYPE_OBJECT,
   G_ADD_PRIVATE(InfdXmppServer)
   G_IMPLEMENT_INTERFACE(INFD_TYPE_XML_SERVER, infd_xmpp_server_xml_server_iface_init))
 
+static GBytes*
+infd_xmpp_server_get_tls_ticket_key(InfdXmppServer* xmpp_server)
+{
+  InfdXmppServerPrivate* priv;
+  gnutls_datum_t key;
+
+  priv = INFD_XMPP_SERVER_PRIVATE(xmpp_server);
+
+  /* The key is generated once and kept for the lifetime of the server, so
+   * that clients can resume their sessions when they reconnect. */
+  if(priv->tls_ticket_key == NULL)
+  {
+    if(gnutls_session_ticket_key_generate(&key) == GNUTLS_E_SUCCESS)
+    {
+      priv->tls_ticket_key = g_bytes_new(key.data, key.size);
+      memset(key.data, 0, key.size);
+      gnutls_free(key.data);
+    }
+  }
+
+  return priv->tls_ticket_key;
+}
+
+static void
+infd_xmpp_server_notify_tls_enabled_cb(GObject* object,
+                                       GParamSpec* pspec,
+                                       gpointer user_data)
+{
+  InfdXmppServer* xmpp_server;
+  InfdXmppServerPrivate* priv;
+  gboolean tls_enabled;
+  gboolean tls_resumed;
+
+  xmpp_server = INFD_XMPP_SERVER(user_data);
+  priv = INFD_XMPP_SERVER_PRIVATE(xmpp_server);
+
+  g_object_get(
+    object,
+    "tls-enabled", &tls_enabled,
+    "tls-resumed", &tls_resumed,
+    NULL
+  );
+
+  if(tls_enabled == TRUE)
+  {
+    if(tls_resumed == TRUE)
+    {
+      ++priv->tls_resumed_handshakes;
+      g_object_notify(G_OBJECT(xmpp_server), "tls-resumed-handshakes");
+    }
+    else
+    {
+      ++priv->tls_full_handshakes;
+      g_object_notify(G_OBJECT(xmpp_server), "tls-full-handshakes");
+    }
+  }
+}
+
+static void
+infd_xmpp_server_notify_status_cb(GObject* object,
+                                  GParamSpec* pspec,
+                                  gpointer user_data)
+{
+  InfdXmppServer* xmpp_server;
+  InfdXmppServerPrivate* priv;
+  InfXmlConnectionStatus status;
+  InfTcpConnection* tcp_connection;
+
+  xmpp_server = INFD_XMPP_SERVER(user_data);
+  priv = INFD_XMPP_SERVER_PRIVATE(xmpp_server);
+
+  g_object_get(object, "status", &status, NULL);
+
+  /* Once the XMPP handshake is done, the connection no longer counts
+   * towards the pending handshake limit of the TCP server. */
+  if(status == INF_XML_CONNECTION_OPEN)
+  {
+    g_object_get(object, "tcp-connection", &tcp_connection, NULL);
+    if(priv->tcp != NULL)
+      infd_tcp_server_handshake_finished(priv->tcp, tcp_connection);
+    g_object_unref(tcp_connection);
+
+    g_signal_handlers_disconnect_by_func(
+      object,
+      G_CALLBACK(infd_xmpp_server_notify_status_cb),
+      user_data
+    );
+  }
+}
+
 static void
 infd_xmpp_server_new_connection_cb(InfdTcpServer* tcp_server,
                                    InfTcpConnection* tcp_connection,
@@ -113,6 +219,60 @@ infd_xmpp_server_new_connection_cb(InfdTcpServer* tcp_server,
 
   g_free(addr_str);
 
+  if(priv->flush_latency > 0)
+  {
+    g_object_set(
+      G_OBJECT(xmpp_connection),
+      "flush-latency", priv->flush_latency,
+      NULL
+    );
+  }
+
+  if(priv->compression_level > 0)
+  {
+    g_object_set(
+      G_OBJECT(xmpp_connection),
+      "compression-level", priv->compression_level,
+      "compression-threshold", priv->compression_threshold,
+      NULL
+    );
+  }
+
+  if(priv->security_policy != INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED &&
+     infd_xmpp_server_get_tls_ticket_key(xmpp_server) != NULL)
+  {
+    g_object_set(
+      G_OBJECT(xmpp_connection),
+      "tls-session-ticket-key", priv->tls_ticket_key,
+      NULL
+    );
+  }
+
+  if(priv->tls_handshake_async == TRUE)
+  {
+    g_object_set(
+      G_OBJECT(xmpp_connection),
+      "tls-handshake-async", TRUE,
+      NULL
+    );
+  }
+
+  g_signal_connect_object(
+    G_OBJECT(xmpp_connection),
+    "notify::tls-enabled",
+    G_CALLBACK(infd_xmpp_server_notify_tls_enabled_cb),
+    xmpp_server,
+    0
+  );
+
+  g_signal_connect_object(
+    G_OBJECT(xmpp_connection),
+    "notify::status",
+    G_CALLBACK(infd_xmpp_server_notify_status_cb),
+    xmpp_server,
+    0
+  );
+
   /* We could, alternatively, keep the connection around until authentication
    * has completed and emit the new_connection signal after that, to guarantee
    * that the connection is open when new_connection is emitted. */
@@ -353,8 +513,15 @@ infd_xmpp_server_init(InfdXmppServer* xmpp)
   priv->status = INFD_XMPP_SERVER_CLOSED;
   priv->local_hostname = g_strdup(g_get_host_name());
   priv->security_policy = INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED;
+  priv->flush_latency = 0;
+  priv->compression_level = 0;
+  priv->compression_threshold = 0;
+  priv->tls_handshake_async = FALSE;
 
   priv->tls_creds = NULL;
+  priv->tls_ticket_key = NULL;
+  priv->tls_full_handshakes = 0;
+  priv->tls_resumed_handshakes = 0;
   priv->sasl_context = NULL;
   priv->sasl_own_context = NULL;
   priv->sasl_mechanisms = NULL;
@@ -407,6 +574,9 @@ infd_xmpp_server_finalize(GObject* object)
   g_free(priv->local_hostname);
   g_free(priv->sasl_mechanisms);
 
+  if(priv->tls_ticket_key != NULL)
+    g_bytes_unref(priv->tls_ticket_key);
+
   G_OBJECT_CLASS(infd_xmpp_server_parent_class)->finalize(object);
 }
 
@@ -462,6 +632,18 @@ infd_xmpp_server_set_property(GObject* object,
   case PROP_SECURITY_POLICY:
     infd_xmpp_server_set_security_policy(xmpp, g_value_get_enum(value));
     break;
+  case PROP_FLUSH_LATENCY:
+    priv->flush_latency = g_value_get_uint(value);
+    break;
+  case PROP_COMPRESSION_LEVEL:
+    priv->compression_level = g_value_get_uint(value);
+    break;
+  case PROP_COMPRESSION_THRESHOLD:
+    priv->compression_threshold = g_value_get_uint(value);
+    break;
+  case PROP_TLS_HANDSHAKE_ASYNC:
+    priv->tls_handshake_async = g_value_get_boolean(value);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -515,6 +697,24 @@ infd_xmpp_server_get_property(GObject* object,
   case PROP_SECURITY_POLICY:
     g_value_set_enum(value, priv->security_policy);
     break;
+  case PROP_FLUSH_LATENCY:
+    g_value_set_uint(value, priv->flush_latency);
+    break;
+  case PROP_COMPRESSION_LEVEL:
+    g_value_set_uint(value, priv->compression_level);
+    break;
+  case PROP_COMPRESSION_THRESHOLD:
+    g_value_set_uint(value, priv->compression_threshold);
+    break;
+  case PROP_TLS_HANDSHAKE_ASYNC:
+    g_value_set_boolean(value, priv->tls_handshake_async);
+    break;
+  case PROP_TLS_FULL_HANDSHAKES:
+    g_value_set_uint(value, priv->tls_full_handshakes);
+    break;
+  case PROP_TLS_RESUMED_HANDSHAKES:
+    g_value_set_uint(value, priv->tls_resumed_handshakes);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -628,6 +828,94 @@ infd_xmpp_server_class_init(InfdXmppServerClass* xmpp_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_FLUSH_LATENCY,
+    g_param_spec_uint(
+      "flush-latency",
+      "Flush latency",
+      "The flush latency in microseconds for new connections, see "
+      "InfXmppConnection:flush-latency",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSION_LEVEL,
+    g_param_spec_uint(
+      "compression-level",
+      "Compression level",
+      "The stream compression level for new connections, see "
+      "InfXmppConnection:compression-level",
+      0,
+      9,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSION_THRESHOLD,
+    g_param_spec_uint(
+      "compression-threshold",
+      "Compression threshold",
+      "The stream compression threshold in bytes for new connections, see "
+      "InfXmppConnection:compression-threshold",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_TLS_HANDSHAKE_ASYNC,
+    g_param_spec_boolean(
+      "tls-handshake-async",
+      "TLS handshake asynchronous",
+      "Whether new connections perform the TLS handshake in a worker "
+      "thread, see InfXmppConnection:tls-handshake-async",
+      FALSE,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_TLS_FULL_HANDSHAKES,
+    g_param_spec_uint(
+      "tls-full-handshakes",
+      "TLS full handshakes",
+      "The number of TLS handshakes with clients that established a new "
+      "session",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_TLS_RESUMED_HANDSHAKES,
+    g_param_spec_uint(
+      "tls-resumed-handshakes",
+      "TLS resumed handshakes",
+      "The number of TLS handshakes with clients that resumed a previous "
+      "session with a session ticket",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
   g_object_class_override_property(object_class, PROP_STATUS, "status");
 
   xmpp_server_signals[ERROR] = g_signal_new(
@@ -33,10 +33,23 @@
  */
 
 #include <libinftext/inf-text-filesystem-format.h>
+#include <libinfinity/server/infd-storage.h>
 #include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/inf-signals.h>
 #include <libinfinity/inf-i18n.h>
 
+#include <glib/gstdio.h>
+
+#include <zlib.h>
+
 #include <string.h>
+#include <errno.h>
+
+#ifdef G_OS_WIN32
+# include <io.h>
+#else
+# include <unistd.h>
+#endif
 
 typedef struct _InfTextFilesystemFormatWriteData {
   xmlNodePtr root;
@@ -281,31 +294,13 @@ inf_text_filesystem_format_write_foreach_user_func(InfUser* user,
   }
 }
 
-/**
- * inf_text_filesystem_format_read:
- * @storage: A #InfdFilesystemStorage.
- * @path: Storage path to retrieve the session from.
- * @user_table: An empty #InfUserTable to use as the new session's user table.
- * @buffer: An empty #InfTextBuffer to use as the new session's buffer.
- * @error: Location to store error information, if any, or %NULL.
- *
- * Reads a text session from @path in @storage. The file is expected to have
- * been saved with inf_text_filesystem_format_write() before. The @user_table
- * parameter should be an empty user table that will be used for the session,
- * and the @buffer parameter should be an empty #InfTextBuffer, and the
- * document will be written into this buffer. If the function succeeds, the
- * user table and buffer can be used to create an #InfTextSession with
- * inf_text_session_new_with_user_table(). If the function fails, %FALSE is
- * returned and @error is set.
- *
- * Returns: %TRUE on success or %FALSE on error.
- */
-gboolean
-inf_text_filesystem_format_read(InfdFilesystemStorage* storage,
-                                const gchar* path,
-                                InfUserTable* user_table,
-                                InfTextBuffer* buffer,
-                                GError** error)
+static gboolean
+inf_text_filesystem_format_read_impl(InfdFilesystemStorage* storage,
+                                     const gchar* path,
+                                     InfUserTable* user_table,
+                                     InfTextBuffer* buffer,
+                                     gchar** journal_id,
+                                     GError** error)
 {
   FILE* stream;
   gchar* full_path;
@@ -315,14 +310,9 @@ inf_text_filesystem_format_read(InfdFilesystemStorage* storage,
   xmlErrorPtr xmlerror;
   xmlNodePtr root;
   xmlNodePtr child;
+  xmlChar* id;
   gboolean result;
 
-  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
-  g_return_val_if_fail(path != NULL, FALSE);
-  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
-  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
-  g_return_val_if_fail(inf_text_buffer_get_length(buffer) == 0, FALSE);
-
   /* TODO: Use a SAX parser for better performance */
   full_path = NULL;
   stream = infd_filesystem_storage_open(
@@ -418,7 +408,16 @@ inf_text_filesystem_format_read(InfdFilesystemStorage* storage,
       }
 
       if(child == NULL)
+      {
         result = TRUE;
+
+        if(journal_id != NULL)
+        {
+          id = xmlGetProp(root, (const xmlChar*)"journal-id");
+          *journal_id = g_strdup((const gchar*)id);
+          if(id != NULL) xmlFree(id);
+        }
+      }
     }
 
     xmlFreeDoc(doc);
@@ -427,27 +426,77 @@ inf_text_filesystem_format_read(InfdFilesystemStorage* storage,
   return result;
 }
 
+/* Required by inf_text_filesystem_format_read() */
+static InfTextFilesystemJournal*
+inf_text_filesystem_journal_open(InfdFilesystemStorage* storage,
+                                 const gchar* path,
+                                 InfUserTable* user_table,
+                                 InfTextBuffer* buffer,
+                                 GError** error);
+
 /**
- * inf_text_filesystem_format_write:
+ * inf_text_filesystem_format_read:
  * @storage: A #InfdFilesystemStorage.
- * @path: Storage path where to write the session to.
- * @user_table: The #InfUserTable to write.
- * @buffer: The #InfTextBuffer to write.
+ * @path: Storage path to retrieve the session from.
+ * @user_table: An empty #InfUserTable to use as the new session's user table.
+ * @buffer: An empty #InfTextBuffer to use as the new session's buffer.
  * @error: Location to store error information, if any, or %NULL.
  *
- * Writes the given user table and buffer into the filesystem storage at
- * @path. If successful, the session can then be read back with
- * inf_text_filesystem_format_read(). If the function fails, %FALSE is
+ * Reads a text session from @path in @storage. The file is expected to have
+ * been saved with inf_text_filesystem_format_write() before. The @user_table
+ * parameter should be an empty user table that will be used for the session,
+ * and the @buffer parameter should be an empty #InfTextBuffer, and the
+ * document will be written into this buffer. If the function succeeds, the
+ * user table and buffer can be used to create an #InfTextSession with
+ * inf_text_session_new_with_user_table(). If the function fails, %FALSE is
  * returned and @error is set.
  *
+ * If the file has been written with inf_text_filesystem_journal_write(),
+ * the changes in its journal are applied to @buffer as well, so that the
+ * document is always read in the state in which it was last saved.
+ *
  * Returns: %TRUE on success or %FALSE on error.
  */
 gboolean
-inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
-                                 const gchar* path,
-                                 InfUserTable* user_table,
-                                 InfTextBuffer* buffer,
-                                 GError** error)
+inf_text_filesystem_format_read(InfdFilesystemStorage* storage,
+                                const gchar* path,
+                                InfUserTable* user_table,
+                                InfTextBuffer* buffer,
+                                GError** error)
+{
+  InfTextFilesystemJournal* journal;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), FALSE);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+  g_return_val_if_fail(inf_text_buffer_get_length(buffer) == 0, FALSE);
+
+  journal = inf_text_filesystem_journal_open(
+    storage,
+    path,
+    user_table,
+    buffer,
+    error
+  );
+
+  if(journal == NULL)
+    return FALSE;
+
+  inf_text_filesystem_journal_free(journal);
+  return TRUE;
+}
+
+/* Creates the XML representation of the session, and marks it with
+ * journal_id if it is non-NULL. If authors is non-NULL, it is set to a set
+ * of the IDs of the users that are part of the document. */
+static xmlDocPtr
+inf_text_filesystem_format_create_doc(InfUserTable* user_table,
+                                      InfTextBuffer* buffer,
+                                      const gchar* journal_id,
+                                      GHashTable** authors,
+                                      GError** error)
 {
   InfTextBufferIter* iter;
   xmlNodePtr buffer_node;
@@ -459,38 +508,19 @@ inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
   gchar* converted;
   gsize converted_bytes;
 
-  FILE* stream;
   xmlDocPtr doc;
-  xmlErrorPtr xmlerror;
   gboolean is_utf8;
 
   InfTextFilesystemFormatWriteData data;
 
-  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
-  g_return_val_if_fail(path != NULL, FALSE);
-  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), FALSE);
-  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
-  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
-
   is_utf8 = TRUE;
   if(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") != 0)
     is_utf8 = FALSE;
 
-  /* Open stream before exporting buffer to XML so possible errors are
-   * catched earlier. */
-  stream = infd_filesystem_storage_open(
-    INFD_FILESYSTEM_STORAGE(storage),
-    "InfText",
-    path,
-    "w",
-    NULL,
-    error
-  );
-
-  if(stream == NULL)
-    return FALSE;
-
   data.root = xmlNewNode(NULL, (const xmlChar*)"inf-text-session");
+  if(journal_id != NULL)
+    inf_xml_util_set_attribute(data.root, "journal-id", journal_id);
+
   data.encountered_authors = g_hash_table_new(NULL, NULL);
 
   buffer_node = xmlNewNode(NULL, (const xmlChar*)"buffer");
@@ -542,11 +572,11 @@ inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
 
         if(converted == NULL)
         {
+          inf_text_buffer_destroy_iter(buffer, iter);
           xmlFreeNode(buffer_node);
           xmlFreeNode(data.root);
           g_hash_table_destroy(data.encountered_authors);
-          infd_filesystem_storage_stream_close(stream);
-          return FALSE;
+          return NULL;
         }
 
         inf_xml_util_add_child_text(segment_node, converted, converted_bytes);
@@ -566,36 +596,1317 @@ inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
     &data
   );
 
-  g_hash_table_destroy(data.encountered_authors);
+  if(authors != NULL)
+    *authors = data.encountered_authors;
+  else
+    g_hash_table_destroy(data.encountered_authors);
 
   /* Write the buffer after the users */
   xmlAddChild(data.root, buffer_node);
 
   doc = xmlNewDoc((const xmlChar*)"1.0");
   xmlDocSetRootElement(doc, data.root);
+  return doc;
+}
 
-  /* TODO: At this point, we should tell libxml2 to use
-   * infd_filesystem_storage_stream_write() instead of fwrite(),
-   * to prevent C runtime mixups. */
-  if(xmlDocFormatDump(stream, doc, 1) == -1)
-  {
-    xmlerror = xmlGetLastError();
-    infd_filesystem_storage_stream_close(stream);
-    xmlFreeDoc(doc);
+/* Writes the session, and marks the file with journal_id if it is non-NULL.
+ * If authors is non-NULL, it is set to a set of the IDs of the users that
+ * were written. If size is non-NULL, it is set to the size of the file. */
+static gboolean
+inf_text_filesystem_format_write_impl(InfdFilesystemStorage* storage,
+                                      const gchar* path,
+                                      InfUserTable* user_table,
+                                      InfTextBuffer* buffer,
+                                      const gchar* journal_id,
+                                      GHashTable** authors,
+                                      gsize* size,
+                                      GError** error)
+{
+  xmlDocPtr doc;
+  guint64 bytes_before;
+  gboolean result;
 
-    g_set_error_literal(
-      error,
-      g_quark_from_static_string("LIBXML2_OUTPUT_ERROR"),
-      xmlerror->code,
-      xmlerror->message
-    );
+  doc = inf_text_filesystem_format_create_doc(
+    user_table,
+    buffer,
+    journal_id,
+    authors,
+    error
+  );
 
+  if(doc == NULL)
     return FALSE;
-  }
 
-  infd_filesystem_storage_stream_close(stream);
+  /* The storage replaces the previous version of the file only once the
+   * new one has been written completely. */
+  bytes_before = infd_storage_get_bytes_written(INFD_STORAGE(storage));
+
+  result = infd_filesystem_storage_write_xml_file(
+    storage,
+    "InfText",
+    path,
+    doc,
+    error
+  );
+
   xmlFreeDoc(doc);
+
+  if(result == FALSE)
+  {
+    if(authors != NULL)
+      g_hash_table_destroy(*authors);
+    return FALSE;
+  }
+
+  if(size != NULL)
+  {
+    *size =
+      infd_storage_get_bytes_written(INFD_STORAGE(storage)) - bytes_before;
+  }
+
+  return TRUE;
+}
+
+/**
+ * inf_text_filesystem_format_write:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path where to write the session to.
+ * @user_table: The #InfUserTable to write.
+ * @buffer: The #InfTextBuffer to write.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Writes the given user table and buffer into the filesystem storage at
+ * @path. If successful, the session can then be read back with
+ * inf_text_filesystem_format_read(). If the function fails, %FALSE is
+ * returned and @error is set.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
+                                 const gchar* path,
+                                 InfUserTable* user_table,
+                                 InfTextBuffer* buffer,
+                                 GError** error)
+{
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), FALSE);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  return inf_text_filesystem_format_write_impl(
+    storage,
+    path,
+    user_table,
+    buffer,
+    NULL,
+    NULL,
+    NULL,
+    error
+  );
+}
+
+/**
+ * inf_text_filesystem_format_write_async:
+ * @storage: A #InfdFilesystemStorage.
+ * @io: The #InfIo to report the result in.
+ * @path: Storage path where to write the session to.
+ * @user_table: The #InfUserTable to write.
+ * @buffer: The #InfTextBuffer to write.
+ * @func: (scope async) (allow-none): Function to be called when the session
+ * has been written, or %NULL.
+ * @user_data: Additional data to pass to @func.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Writes the given user table and buffer into the filesystem storage at
+ * @path like inf_text_filesystem_format_write(), but without waiting for
+ * the disk. Only a snapshot of the session is taken in the calling thread.
+ * The snapshot is then written by a worker thread with
+ * infd_filesystem_storage_write_xml_async(), and @func is called in the
+ * thread of @io once this has finished. Changes made to @buffer in the
+ * meantime are not part of the written document.
+ *
+ * If the function fails, %FALSE is returned, @error is set and @func is not
+ * called.
+ *
+ * Returns: %TRUE if the write has been started, or %FALSE on error.
+ */
+gboolean
+inf_text_filesystem_format_write_async(InfdFilesystemStorage* storage,
+                                       InfIo* io,
+                                       const gchar* path,
+                                       InfUserTable* user_table,
+                                       InfTextBuffer* buffer,
+                                       InfdFilesystemStorageWriteFunc func,
+                                       gpointer user_data,
+                                       GError** error)
+{
+  xmlDocPtr doc;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(INF_IS_IO(io), FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), FALSE);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  doc = inf_text_filesystem_format_create_doc(
+    user_table,
+    buffer,
+    NULL,
+    NULL,
+    error
+  );
+
+  if(doc == NULL)
+    return FALSE;
+
+  return infd_filesystem_storage_write_xml_async(
+    storage,
+    io,
+    "InfText",
+    path,
+    doc,
+    func,
+    user_data,
+    error
+  );
+}
+
+/*
+ * Journal
+ */
+
+/* The journal file starts with this magic, followed by the version, the ID
+ * of the checkpoint it belongs to and the encoding of the text in it. After
+ * that, there is one record for each change since the checkpoint. Each
+ * record consists of its type, the length of its payload, the payload and a
+ * CRC-32 of all of these. All numbers are stored as little endian. */
+#define INF_TEXT_FILESYSTEM_JOURNAL_MAGIC "INFJ"
+#define INF_TEXT_FILESYSTEM_JOURNAL_VERSION 1
+
+/* A new checkpoint is written as soon as the journal grows larger than the
+ * previous checkpoint, but not before it reaches this size. */
+#define INF_TEXT_FILESYSTEM_JOURNAL_MIN_CHECKPOINT_SIZE (64 * 1024)
+
+typedef enum _InfTextFilesystemJournalRecord {
+  /* id, hue, name; written before the first insertion of a user that is not
+   * part of the checkpoint */
+  INF_TEXT_FILESYSTEM_JOURNAL_RECORD_USER = 'u',
+  /* pos, length, author, bytes, text */
+  INF_TEXT_FILESYSTEM_JOURNAL_RECORD_INSERT = 'i',
+  /* pos, length */
+  INF_TEXT_FILESYSTEM_JOURNAL_RECORD_ERASE = 'e'
+} InfTextFilesystemJournalRecord;
+
+struct _InfTextFilesystemJournal {
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+
+  /* NULL if a new checkpoint needs to be written */
+  gchar* checkpoint_id;
+  gsize checkpoint_size;
+  /* 0 if the journal file needs to be created from scratch */
+  gsize journal_size;
+
+  /* IDs of the users that are stored in the checkpoint or the journal */
+  GHashTable* authors;
+  /* Records which have not yet been appended to the journal file */
+  GByteArray* pending;
+};
+
+static void
+inf_text_filesystem_journal_append_uint32(GByteArray* array,
+                                          guint32 value)
+{
+  value = GUINT32_TO_LE(value);
+  g_byte_array_append(array, (const guint8*)&value, 4);
+}
+
+static void
+inf_text_filesystem_journal_append_string(GByteArray* array,
+                                          gconstpointer data,
+                                          gsize len)
+{
+  inf_text_filesystem_journal_append_uint32(array, len);
+  g_byte_array_append(array, data, len);
+}
+
+/* Starts a new record of the given type in array, and returns its offset
+ * for inf_text_filesystem_journal_end_record(). */
+static guint
+inf_text_filesystem_journal_begin_record(GByteArray* array,
+                                         InfTextFilesystemJournalRecord type)
+{
+  guint offset;
+  guint8 type_byte;
+
+  offset = array->len;
+  type_byte = type;
+
+  g_byte_array_append(array, &type_byte, 1);
+  inf_text_filesystem_journal_append_uint32(array, 0);
+  return offset;
+}
+
+/* Fills in the payload length of the record at offset in array, and appends
+ * its checksum. */
+static void
+inf_text_filesystem_journal_end_record(GByteArray* array,
+                                       guint offset)
+{
+  guint32 length;
+  guint32 checksum;
+
+  length = GUINT32_TO_LE(array->len - offset - 5);
+  memcpy(array->data + offset + 1, &length, 4);
+
+  checksum = crc32(0, array->data + offset, array->len - offset);
+  inf_text_filesystem_journal_append_uint32(array, checksum);
+}
+
+static gboolean
+inf_text_filesystem_journal_parse_uint32(const guint8** data,
+                                         const guint8* end,
+                                         guint32* value)
+{
+  guint32 le;
+
+  if(end - *data < 4)
+    return FALSE;
+
+  memcpy(&le, *data, 4);
+  *value = GUINT32_FROM_LE(le);
+  *data += 4;
   return TRUE;
 }
 
+static gboolean
+inf_text_filesystem_journal_parse_string(const guint8** data,
+                                         const guint8* end,
+                                         const gchar** str,
+                                         guint32* len)
+{
+  if(!inf_text_filesystem_journal_parse_uint32(data, end, len))
+    return FALSE;
+  if((gsize)(end - *data) < *len)
+    return FALSE;
+
+  *str = (const gchar*)*data;
+  *data += *len;
+  return TRUE;
+}
+
+static void
+inf_text_filesystem_journal_add_author(InfTextFilesystemJournal* journal,
+                                       guint author)
+{
+  InfUser* user;
+  const gchar* name;
+  gdouble hue;
+  guint64 hue_bits;
+  guint offset;
+
+  if(author == 0)
+    return;
+  if(g_hash_table_lookup(journal->authors, GUINT_TO_POINTER(author)) != NULL)
+    return;
+
+  user = inf_user_table_lookup_user_by_id(journal->user_table, author);
+  if(user == NULL)
+    return;
+
+  name = inf_user_get_name(user);
+  hue = inf_text_user_get_hue(INF_TEXT_USER(user));
+  memcpy(&hue_bits, &hue, 8);
+
+  offset = inf_text_filesystem_journal_begin_record(
+    journal->pending,
+    INF_TEXT_FILESYSTEM_JOURNAL_RECORD_USER
+  );
+
+  inf_text_filesystem_journal_append_uint32(journal->pending, author);
+  inf_text_filesystem_journal_append_uint32(
+    journal->pending,
+    (guint32)(hue_bits & 0xffffffff)
+  );
+
+  inf_text_filesystem_journal_append_uint32(
+    journal->pending,
+    (guint32)(hue_bits >> 32)
+  );
+
+  inf_text_filesystem_journal_append_string(
+    journal->pending,
+    name,
+    strlen(name)
+  );
+
+  inf_text_filesystem_journal_end_record(journal->pending, offset);
+
+  g_hash_table_insert(
+    journal->authors,
+    GUINT_TO_POINTER(author),
+    GUINT_TO_POINTER(author)
+  );
+}
+
+static void
+inf_text_filesystem_journal_text_inserted_cb(InfTextBuffer* buffer,
+                                             guint pos,
+                                             InfTextChunk* chunk,
+                                             InfUser* user,
+                                             gpointer user_data)
+{
+  InfTextFilesystemJournal* journal;
+  InfTextChunkIter iter;
+  guint author;
+  guint offset;
+
+  journal = (InfTextFilesystemJournal*)user_data;
+
+  /* Nothing to record if the next write is a checkpoint anyway */
+  if(journal->checkpoint_id == NULL)
+    return;
+
+  if(inf_text_chunk_iter_init_begin(chunk, &iter))
+  {
+    do
+    {
+      author = inf_text_chunk_iter_get_author(&iter);
+      inf_text_filesystem_journal_add_author(journal, author);
+
+      offset = inf_text_filesystem_journal_begin_record(
+        journal->pending,
+        INF_TEXT_FILESYSTEM_JOURNAL_RECORD_INSERT
+      );
+
+      inf_text_filesystem_journal_append_uint32(journal->pending, pos);
+      inf_text_filesystem_journal_append_uint32(
+        journal->pending,
+        inf_text_chunk_iter_get_length(&iter)
+      );
+
+      inf_text_filesystem_journal_append_uint32(journal->pending, author);
+      inf_text_filesystem_journal_append_string(
+        journal->pending,
+        inf_text_chunk_iter_get_text(&iter),
+        inf_text_chunk_iter_get_bytes(&iter)
+      );
+
+      inf_text_filesystem_journal_end_record(journal->pending, offset);
+      pos += inf_text_chunk_iter_get_length(&iter);
+    } while(inf_text_chunk_iter_next(&iter));
+  }
+}
+
+static void
+inf_text_filesystem_journal_text_erased_cb(InfTextBuffer* buffer,
+                                           guint pos,
+                                           InfTextChunk* chunk,
+                                           InfUser* user,
+                                           gpointer user_data)
+{
+  InfTextFilesystemJournal* journal;
+  guint offset;
+
+  journal = (InfTextFilesystemJournal*)user_data;
+
+  if(journal->checkpoint_id == NULL)
+    return;
+
+  offset = inf_text_filesystem_journal_begin_record(
+    journal->pending,
+    INF_TEXT_FILESYSTEM_JOURNAL_RECORD_ERASE
+  );
+
+  inf_text_filesystem_journal_append_uint32(journal->pending, pos);
+  inf_text_filesystem_journal_append_uint32(
+    journal->pending,
+    inf_text_chunk_get_length(chunk)
+  );
+
+  inf_text_filesystem_journal_end_record(journal->pending, offset);
+}
+
+static void
+inf_text_filesystem_journal_foreach_user_func(InfUser* user,
+                                              gpointer user_data)
+{
+  GHashTable* authors;
+  authors = (GHashTable*)user_data;
+
+  g_hash_table_insert(
+    authors,
+    GUINT_TO_POINTER(inf_user_get_id(user)),
+    GUINT_TO_POINTER(inf_user_get_id(user))
+  );
+}
+
+static InfTextFilesystemJournal*
+inf_text_filesystem_journal_create(InfUserTable* user_table,
+                                   InfTextBuffer* buffer)
+{
+  InfTextFilesystemJournal* journal;
+
+  journal = g_slice_new(InfTextFilesystemJournal);
+  journal->user_table = user_table;
+  journal->buffer = buffer;
+  journal->checkpoint_id = NULL;
+  journal->checkpoint_size = 0;
+  journal->journal_size = 0;
+  journal->authors = g_hash_table_new(NULL, NULL);
+  journal->pending = g_byte_array_new();
+
+  g_object_ref(user_table);
+  g_object_ref(buffer);
+
+  return journal;
+}
+
+static void
+inf_text_filesystem_journal_connect(InfTextFilesystemJournal* journal)
+{
+  g_signal_connect(
+    G_OBJECT(journal->buffer),
+    "text-inserted",
+    G_CALLBACK(inf_text_filesystem_journal_text_inserted_cb),
+    journal
+  );
+
+  g_signal_connect(
+    G_OBJECT(journal->buffer),
+    "text-erased",
+    G_CALLBACK(inf_text_filesystem_journal_text_erased_cb),
+    journal
+  );
+}
+
+/* Sets error for a record of the given type whose payload cannot be
+ * parsed, and returns FALSE. */
+static gboolean
+inf_text_filesystem_journal_malformed(guint8 type,
+                                      GError** error)
+{
+  g_set_error(
+    error,
+    inf_text_filesystem_format_error_quark(),
+    INF_TEXT_FILESYSTEM_FORMAT_ERROR_INVALID_JOURNAL,
+    _("Record of type \"%u\" is malformed"),
+    (guint)type
+  );
+
+  return FALSE;
+}
+
+/* Applies the record with the given type and payload to the journal's
+ * buffer. If utf8 is TRUE, inserted text and user names are validated. */
+static gboolean
+inf_text_filesystem_journal_apply_record(InfTextFilesystemJournal* journal,
+                                         guint8 type,
+                                         const guint8* data,
+                                         const guint8* end,
+                                         gboolean utf8,
+                                         GError** error)
+{
+  guint32 pos;
+  guint32 length;
+  guint32 author;
+  guint32 hue_low;
+  guint32 hue_high;
+  guint64 hue_bits;
+  gdouble hue;
+  const gchar* text;
+  guint32 bytes;
+  gchar* name;
+  InfUser* user;
+
+  switch(type)
+  {
+  case INF_TEXT_FILESYSTEM_JOURNAL_RECORD_USER:
+    if(!inf_text_filesystem_journal_parse_uint32(&data, end, &author) ||
+       !inf_text_filesystem_journal_parse_uint32(&data, end, &hue_low) ||
+       !inf_text_filesystem_journal_parse_uint32(&data, end, &hue_high) ||
+       !inf_text_filesystem_journal_parse_string(&data, end, &text, &bytes) ||
+       data != end)
+    {
+      return inf_text_filesystem_journal_malformed(type, error);
+    }
+
+    if(author == 0 || !g_utf8_validate(text, bytes, NULL))
+    {
+      g_set_error(
+        error,
+        inf_text_filesystem_format_error_quark(),
+        INF_TEXT_FILESYSTEM_FORMAT_ERROR_INVALID_JOURNAL,
+        _("User with ID \"%u\" has an invalid ID or name"),
+        (guint)author
+      );
+
+      return FALSE;
+    }
+
+    if(inf_user_table_lookup_user_by_id(journal->user_table, author) == NULL)
+    {
+      hue_bits = ((guint64)hue_high << 32) | hue_low;
+      memcpy(&hue, &hue_bits, 8);
+      name = g_strndup(text, bytes);
+
+      user = INF_USER(
+        g_object_new(
+          INF_TEXT_TYPE_USER,
+          "id", author,
+          "name", name,
+          "hue", hue,
+          NULL
+        )
+      );
+
+      inf_user_table_add_user(journal->user_table, user);
+      g_object_unref(user);
+      g_free(name);
+    }
+
+    return TRUE;
+  case INF_TEXT_FILESYSTEM_JOURNAL_RECORD_INSERT:
+    if(!inf_text_filesystem_journal_parse_uint32(&data, end, &pos) ||
+       !inf_text_filesystem_journal_parse_uint32(&data, end, &length) ||
+       !inf_text_filesystem_journal_parse_uint32(&data, end, &author) ||
+       !inf_text_filesystem_journal_parse_string(&data, end, &text, &bytes) ||
+       data != end)
+    {
+      return inf_text_filesystem_journal_malformed(type, error);
+    }
+
+    user = NULL;
+    if(author != 0)
+    {
+      user = inf_user_table_lookup_user_by_id(journal->user_table, author);
+      if(user == NULL)
+      {
+        g_set_error(
+          error,
+          inf_text_filesystem_format_error_quark(),
+          INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_SUCH_USER,
+          _("User with ID \"%u\" does not exist"),
+          (guint)author
+        );
+
+        return FALSE;
+      }
+    }
+
+    if(utf8 == TRUE && !g_utf8_validate(text, bytes, NULL))
+    {
+      g_set_error(
+        error,
+        inf_text_filesystem_format_error_quark(),
+        INF_TEXT_FILESYSTEM_FORMAT_ERROR_INVALID_JOURNAL,
+        _("Insertion at position %u is not valid UTF-8"),
+        (guint)pos
+      );
+
+      return FALSE;
+    }
+
+    if(utf8 == TRUE && g_utf8_strlen(text, bytes) != (glong)length)
+    {
+      g_set_error(
+        error,
+        inf_text_filesystem_format_error_quark(),
+        INF_TEXT_FILESYSTEM_FORMAT_ERROR_INVALID_JOURNAL,
+        _("Insertion at position %u does not have %u characters"),
+        (guint)pos,
+        (guint)length
+      );
+
+      return FALSE;
+    }
+
+    if(pos > inf_text_buffer_get_length(journal->buffer))
+    {
+      g_set_error(
+        error,
+        inf_text_filesystem_format_error_quark(),
+        INF_TEXT_FILESYSTEM_FORMAT_ERROR_INVALID_JOURNAL,
+        _("Insertion at position %u is outside of the document"),
+        (guint)pos
+      );
+
+      return FALSE;
+    }
+
+    inf_text_buffer_insert_text(
+      journal->buffer,
+      pos,
+      text,
+      bytes,
+      length,
+      user
+    );
+
+    return TRUE;
+  case INF_TEXT_FILESYSTEM_JOURNAL_RECORD_ERASE:
+    if(!inf_text_filesystem_journal_parse_uint32(&data, end, &pos) ||
+       !inf_text_filesystem_journal_parse_uint32(&data, end, &length) ||
+       data != end)
+    {
+      return inf_text_filesystem_journal_malformed(type, error);
+    }
+
+    if(pos + length < pos ||
+       pos + length > inf_text_buffer_get_length(journal->buffer))
+    {
+      g_set_error(
+        error,
+        inf_text_filesystem_format_error_quark(),
+        INF_TEXT_FILESYSTEM_FORMAT_ERROR_INVALID_JOURNAL,
+        _("Deletion of %u characters at position %u is outside of the "
+          "document"),
+        (guint)length,
+        (guint)pos
+      );
+
+      return FALSE;
+    }
+
+    inf_text_buffer_erase_text(journal->buffer, pos, length, NULL);
+    return TRUE;
+  default:
+    g_set_error(
+      error,
+      inf_text_filesystem_format_error_quark(),
+      INF_TEXT_FILESYSTEM_FORMAT_ERROR_INVALID_JOURNAL,
+      _("Unexpected record type \"%u\""),
+      (guint)type
+    );
+
+    return FALSE;
+  }
+}
+
+/* Returns whether all bytes from data to end are zero */
+static gboolean
+inf_text_filesystem_journal_is_zero(const guint8* data,
+                                    const guint8* end)
+{
+  for(; data < end; ++data)
+    if(*data != 0)
+      return FALSE;
+  return TRUE;
+}
+
+/* Replays the records in data on the journal's buffer. Returns the number
+ * of bytes of intact records, which is less than len if the last record
+ * was not written completely, or -1 on error. */
+static gssize
+inf_text_filesystem_journal_replay(InfTextFilesystemJournal* journal,
+                                   const guint8* data,
+                                   gsize len,
+                                   GError** error)
+{
+  const guint8* begin;
+  const guint8* end;
+  const guint8* record;
+  const guint8* payload;
+  guint32 payload_len;
+  guint32 checksum;
+  gboolean utf8;
+
+  begin = data;
+  end = data + len;
+
+  utf8 = g_ascii_strcasecmp(
+    inf_text_buffer_get_encoding(journal->buffer),
+    "UTF-8"
+  ) == 0;
+
+  while(data < end)
+  {
+    record = data++;
+
+    if(!inf_text_filesystem_journal_parse_uint32(&data, end, &payload_len) ||
+       (gsize)(end - data) < (gsize)payload_len + 4)
+    {
+      /* The last record was not written completely */
+      return record - begin;
+    }
+
+    payload = data;
+    data += payload_len;
+    inf_text_filesystem_journal_parse_uint32(&data, end, &checksum);
+
+    if(crc32(0, record, payload + payload_len - record) != checksum)
+    {
+      /* A damaged record is the result of an interrupted write if nothing
+       * but zeros follows it, which the file system might have filled in
+       * when it extended the file. */
+      if(inf_text_filesystem_journal_is_zero(data, end))
+        return record - begin;
+
+      g_set_error(
+        error,
+        inf_text_filesystem_format_error_quark(),
+        INF_TEXT_FILESYSTEM_FORMAT_ERROR_INVALID_JOURNAL,
+        _("Checksum mismatch in record at offset %u"),
+        (guint)(record - begin)
+      );
+
+      return -1;
+    }
+
+    if(!inf_text_filesystem_journal_apply_record(journal, *record, payload,
+                                                 payload + payload_len,
+                                                 utf8, error))
+    {
+      return -1;
+    }
+  }
+
+  return data - begin;
+}
+
+/* Reads the journal file at path and replays it on the journal's buffer, if
+ * it belongs to the journal's checkpoint. */
+static gboolean
+inf_text_filesystem_journal_load(InfTextFilesystemJournal* journal,
+                                 InfdFilesystemStorage* storage,
+                                 const gchar* path,
+                                 GError** error)
+{
+  gchar* full_path;
+  gchar* contents;
+  gsize length;
+  GError* local_error;
+  const guint8* data;
+  const guint8* end;
+  guint32 version;
+  const gchar* str;
+  guint32 str_len;
+  gssize replayed;
+
+  full_path = infd_filesystem_storage_get_path(
+    storage,
+    "journal",
+    path,
+    error
+  );
+
+  if(full_path == NULL)
+    return FALSE;
+
+  local_error = NULL;
+  if(!g_file_get_contents(full_path, &contents, &length, &local_error))
+  {
+    g_free(full_path);
+
+    /* No journal means there were no changes since the checkpoint */
+    if(local_error->domain == G_FILE_ERROR &&
+       local_error->code == G_FILE_ERROR_NOENT)
+    {
+      g_error_free(local_error);
+      return TRUE;
+    }
+
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  g_free(full_path);
+
+  data = (const guint8*)contents;
+  end = data + length;
+
+  /* A journal that does not belong to the checkpoint is left over from
+   * before the checkpoint was written, and its changes are contained in the
+   * checkpoint already. It is recreated with the next write. */
+  if(length < 4 ||
+     memcmp(data, INF_TEXT_FILESYSTEM_JOURNAL_MAGIC, 4) != 0)
+  {
+    g_free(contents);
+    return TRUE;
+  }
+
+  data += 4;
+  if(!inf_text_filesystem_journal_parse_uint32(&data, end, &version) ||
+     version != INF_TEXT_FILESYSTEM_JOURNAL_VERSION ||
+     !inf_text_filesystem_journal_parse_string(&data, end, &str, &str_len) ||
+     strlen(journal->checkpoint_id) != str_len ||
+     strncmp(journal->checkpoint_id, str, str_len) != 0)
+  {
+    g_free(contents);
+    return TRUE;
+  }
+
+  if(!inf_text_filesystem_journal_parse_string(&data, end, &str, &str_len) ||
+     strlen(inf_text_buffer_get_encoding(journal->buffer)) != str_len ||
+     strncmp(inf_text_buffer_get_encoding(journal->buffer), str, str_len) != 0)
+  {
+    g_set_error(
+      error,
+      inf_text_filesystem_format_error_quark(),
+      INF_TEXT_FILESYSTEM_FORMAT_ERROR_INVALID_JOURNAL,
+      _("Error processing journal of \"%s\": %s"),
+      path,
+      _("The journal does not match the document's encoding")
+    );
+
+    g_free(contents);
+    return FALSE;
+  }
+
+  replayed = inf_text_filesystem_journal_replay(
+    journal,
+    data,
+    end - data,
+    error
+  );
+
+  if(replayed < 0)
+  {
+    g_prefix_error(error, _("Error processing journal of \"%s\": "), path);
+    g_free(contents);
+    return FALSE;
+  }
+
+  if(data + replayed == end)
+  {
+    journal->journal_size = length;
+  }
+  else
+  {
+    /* The last record is incomplete or damaged. Appending to the journal
+     * would leave it in between, so write a new checkpoint instead. */
+    g_free(journal->checkpoint_id);
+    journal->checkpoint_id = NULL;
+  }
+
+  g_free(contents);
+  return TRUE;
+}
+
+/* Flushes stream to disk. Returns 0 on success, or -1 with errno set. */
+static int
+inf_text_filesystem_journal_sync(FILE* stream)
+{
+  if(fflush(stream) != 0)
+    return -1;
+#ifdef G_OS_WIN32
+  if(_commit(_fileno(stream)) != 0)
+    return -1;
+#else
+  if(fsync(fileno(stream)) != 0)
+    return -1;
+#endif
+  return 0;
+}
+
+/* Appends the pending records to the journal file, creating it first if
+ * necessary. If storage has sync-writes set, the records are flushed to
+ * disk before the function returns. */
+static gboolean
+inf_text_filesystem_journal_append(InfTextFilesystemJournal* journal,
+                                   InfdFilesystemStorage* storage,
+                                   const gchar* path,
+                                   GError** error)
+{
+  GByteArray* header;
+  const gchar* encoding;
+  FILE* stream;
+  gboolean sync_writes;
+  gsize written;
+  int save_errno;
+
+  g_object_get(G_OBJECT(storage), "sync-writes", &sync_writes, NULL);
+
+  header = g_byte_array_new();
+  if(journal->journal_size == 0)
+  {
+    encoding = inf_text_buffer_get_encoding(journal->buffer);
+
+    g_byte_array_append(
+      header,
+      (const guint8*)INF_TEXT_FILESYSTEM_JOURNAL_MAGIC,
+      4
+    );
+
+    inf_text_filesystem_journal_append_uint32(
+      header,
+      INF_TEXT_FILESYSTEM_JOURNAL_VERSION
+    );
+
+    inf_text_filesystem_journal_append_string(
+      header,
+      journal->checkpoint_id,
+      strlen(journal->checkpoint_id)
+    );
+
+    inf_text_filesystem_journal_append_string(
+      header,
+      encoding,
+      strlen(encoding)
+    );
+  }
+
+  stream = infd_filesystem_storage_open(
+    storage,
+    "journal",
+    path,
+    journal->journal_size == 0 ? "w" : "a",
+    NULL,
+    error
+  );
+
+  if(stream == NULL)
+  {
+    g_byte_array_free(header, TRUE);
+    return FALSE;
+  }
+
+  written = infd_filesystem_storage_stream_write(
+    stream,
+    header->data,
+    header->len
+  );
+
+  if(written == header->len)
+  {
+    written += infd_filesystem_storage_stream_write(
+      stream,
+      journal->pending->data,
+      journal->pending->len
+    );
+  }
+
+  save_errno = errno;
+  infd_filesystem_storage_add_bytes_written(storage, written);
+
+  if(written == header->len + journal->pending->len &&
+     sync_writes == TRUE && inf_text_filesystem_journal_sync(stream) != 0)
+  {
+    save_errno = errno;
+    written = 0;
+  }
+
+  if(written != header->len + journal->pending->len)
+  {
+    infd_filesystem_storage_stream_close(stream);
+  }
+  else if(infd_filesystem_storage_stream_close(stream) != 0)
+  {
+    save_errno = errno;
+    written = 0;
+  }
+
+  if(written != header->len + journal->pending->len)
+  {
+    g_set_error_literal(
+      error,
+      G_FILE_ERROR,
+      g_file_error_from_errno(save_errno),
+      g_strerror(save_errno)
+    );
+
+    /* The journal might have been written partially, so start over with a
+     * new checkpoint next time. */
+    g_free(journal->checkpoint_id);
+    journal->checkpoint_id = NULL;
+
+    g_byte_array_free(header, TRUE);
+    return FALSE;
+  }
+
+  journal->journal_size += written;
+  g_byte_array_set_size(journal->pending, 0);
+  g_byte_array_free(header, TRUE);
+  return TRUE;
+}
+
+/* Writes the whole document as a new checkpoint, and starts a new, empty
+ * journal for it. */
+static gboolean
+inf_text_filesystem_journal_checkpoint(InfTextFilesystemJournal* journal,
+                                       InfdFilesystemStorage* storage,
+                                       const gchar* path,
+                                       GError** error)
+{
+  gchar* checkpoint_id;
+  GHashTable* authors;
+  gsize size;
+  gboolean result;
+
+  checkpoint_id = g_strdup_printf(
+    "%08x%08x",
+    (guint)g_random_int(),
+    (guint)g_random_int()
+  );
+
+  result = inf_text_filesystem_format_write_impl(
+    storage,
+    path,
+    journal->user_table,
+    journal->buffer,
+    checkpoint_id,
+    &authors,
+    &size,
+    error
+  );
+
+  if(result == FALSE)
+  {
+    g_free(checkpoint_id);
+    return FALSE;
+  }
+
+  g_free(journal->checkpoint_id);
+  journal->checkpoint_id = checkpoint_id;
+  journal->checkpoint_size = size;
+  journal->journal_size = 0;
+
+  g_hash_table_destroy(journal->authors);
+  journal->authors = authors;
+  g_byte_array_set_size(journal->pending, 0);
+
+  /* If a crash happens before the new journal is written, the old one is
+   * ignored on the next read because it belongs to another checkpoint. */
+  return inf_text_filesystem_journal_append(journal, storage, path, error);
+}
+
+/* Reads the checkpoint at path and replays its journal, if any. The
+ * returned journal does not record changes to buffer yet. */
+static InfTextFilesystemJournal*
+inf_text_filesystem_journal_open(InfdFilesystemStorage* storage,
+                                 const gchar* path,
+                                 InfUserTable* user_table,
+                                 InfTextBuffer* buffer,
+                                 GError** error)
+{
+  InfTextFilesystemJournal* journal;
+  gchar* checkpoint_id;
+  gchar* full_path;
+  GStatBuf st;
+
+  checkpoint_id = NULL;
+  if(!inf_text_filesystem_format_read_impl(storage, path, user_table,
+                                           buffer, &checkpoint_id, error))
+  {
+    return NULL;
+  }
+
+  journal = inf_text_filesystem_journal_create(user_table, buffer);
+  journal->checkpoint_id = checkpoint_id;
+
+  /* Documents without ID have been written without journal. They get a
+   * checkpoint with the first write. */
+  if(checkpoint_id != NULL)
+  {
+    full_path = infd_filesystem_storage_get_path(
+      storage,
+      "InfText",
+      path,
+      NULL
+    );
+
+    if(full_path != NULL && g_stat(full_path, &st) == 0)
+      journal->checkpoint_size = st.st_size;
+    g_free(full_path);
+
+    if(!inf_text_filesystem_journal_load(journal, storage, path, error))
+    {
+      inf_text_filesystem_journal_free(journal);
+      return NULL;
+    }
+  }
+
+  return journal;
+}
+
+/**
+ * inf_text_filesystem_journal_new: (skip)
+ * @user_table: The #InfUserTable of the session to record.
+ * @buffer: The #InfTextBuffer of the session to record.
+ *
+ * Creates a new #InfTextFilesystemJournal for a session which has not been
+ * read with inf_text_filesystem_journal_read(), such as a newly created
+ * one. The first call to inf_text_filesystem_journal_write() writes the
+ * whole document, and further calls only append the changes made to
+ * @buffer in between.
+ *
+ * Returns: (transfer full): A new #InfTextFilesystemJournal. Free with
+ * inf_text_filesystem_journal_free().
+ */
+InfTextFilesystemJournal*
+inf_text_filesystem_journal_new(InfUserTable* user_table,
+                                InfTextBuffer* buffer)
+{
+  InfTextFilesystemJournal* journal;
+
+  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), NULL);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), NULL);
+
+  journal = inf_text_filesystem_journal_create(user_table, buffer);
+  inf_text_filesystem_journal_connect(journal);
+
+  return journal;
+}
+
+/**
+ * inf_text_filesystem_journal_read: (skip)
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path to retrieve the session from.
+ * @user_table: An empty #InfUserTable to use as the new session's user table.
+ * @buffer: An empty #InfTextBuffer to use as the new session's buffer.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Reads a text session from @path in @storage like
+ * inf_text_filesystem_format_read(), and then applies the changes that have
+ * been appended to the session's journal since the document was last
+ * written completely. Documents which have been written with
+ * inf_text_filesystem_format_write() can be read as well.
+ *
+ * The returned #InfTextFilesystemJournal records further changes to
+ * @buffer, so that inf_text_filesystem_journal_write() only needs to append
+ * them to the journal. If the function fails, %NULL is returned and @error
+ * is set.
+ *
+ * Returns: (transfer full): A new #InfTextFilesystemJournal, or %NULL on
+ * error. Free with inf_text_filesystem_journal_free().
+ */
+InfTextFilesystemJournal*
+inf_text_filesystem_journal_read(InfdFilesystemStorage* storage,
+                                 const gchar* path,
+                                 InfUserTable* user_table,
+                                 InfTextBuffer* buffer,
+                                 GError** error)
+{
+  InfTextFilesystemJournal* journal;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), NULL);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+  g_return_val_if_fail(inf_text_buffer_get_length(buffer) == 0, NULL);
+
+  journal = inf_text_filesystem_journal_open(
+    storage,
+    path,
+    user_table,
+    buffer,
+    error
+  );
+
+  if(journal == NULL)
+    return NULL;
+
+  inf_user_table_foreach_user(
+    user_table,
+    inf_text_filesystem_journal_foreach_user_func,
+    journal->authors
+  );
+
+  inf_text_filesystem_journal_connect(journal);
+  return journal;
+}
+
+/**
+ * inf_text_filesystem_journal_write: (skip)
+ * @journal: A #InfTextFilesystemJournal.
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path where to write the session to.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Stores the changes that have been made to the journal's buffer since the
+ * last call into the storage at @path. Usually, this only appends the
+ * changes to the journal file, so that the cost of saving is proportional to
+ * the amount of changes, not to the size of the document. Once the journal
+ * becomes larger than the document itself, the whole document is written
+ * again as a checkpoint, and the journal is started over. The session can be
+ * read back with inf_text_filesystem_journal_read().
+ *
+ * If @storage has #InfdFilesystemStorage:sync-writes set, appended changes
+ * are flushed to disk before the function returns.
+ *
+ * If the function fails, %FALSE is returned and @error is set. In this case
+ * the next call writes the whole document.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_text_filesystem_journal_write(InfTextFilesystemJournal* journal,
+                                  InfdFilesystemStorage* storage,
+                                  const gchar* path,
+                                  GError** error)
+{
+  gsize limit;
+
+  g_return_val_if_fail(journal != NULL, FALSE);
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  limit = MAX(
+    journal->checkpoint_size,
+    INF_TEXT_FILESYSTEM_JOURNAL_MIN_CHECKPOINT_SIZE
+  );
+
+  if(journal->checkpoint_id != NULL &&
+     journal->journal_size + journal->pending->len > limit)
+  {
+    g_free(journal->checkpoint_id);
+    journal->checkpoint_id = NULL;
+  }
+
+  if(journal->checkpoint_id == NULL)
+  {
+    return inf_text_filesystem_journal_checkpoint(
+      journal,
+      storage,
+      path,
+      error
+    );
+  }
+
+  if(journal->journal_size > 0 && journal->pending->len == 0)
+    return TRUE;
+
+  return inf_text_filesystem_journal_append(journal, storage, path, error);
+}
+
+/**
+ * inf_text_filesystem_journal_free:
+ * @journal: A #InfTextFilesystemJournal.
+ *
+ * Stops recording changes to the journal's buffer and releases all
+ * resources allocated by @journal. Changes that have not been written with
+ * inf_text_filesystem_journal_write() are discarded.
+ */
+void
+inf_text_filesystem_journal_free(InfTextFilesystemJournal* journal)
+{
+  g_return_if_fail(journal != NULL);
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(journal->buffer),
+    G_CALLBACK(inf_text_filesystem_journal_text_inserted_cb),
+    journal
+  );
+
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(journal->buffer),
+    G_CALLBACK(inf_text_filesystem_journal_text_erased_cb),
+    journal
+  );
+
+  g_object_unref(journal->user_table);
+  g_object_unref(journal->buffer);
+
+  g_free(journal->checkpoint_id);
+  g_hash_table_destroy(journal->authors);
+  g_byte_array_free(journal->pending, TRUE);
+
+  g_slice_free(InfTextFilesystemJournal, journal);
+}
+
 /* vim:set et sw=2 ts=2: */
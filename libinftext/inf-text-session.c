@@ -47,6 +47,32 @@ struct _InfTextSessionLocalUser {
   InfIoTimeout* caret_timeout;
 };
 
+/* Maximum number of characters in a sync-segment message of a streamed
+ * synchronization. Since a character takes at most four bytes in UTF-8,
+ * messages are not larger than the ones of inf_text_session_to_xml_sync(),
+ * and the number of messages follows from the segment lengths alone. */
+#define INF_TEXT_SESSION_SYNC_STREAM_SEGMENT_LENGTH 256
+
+typedef struct _InfTextSessionSyncStream InfTextSessionSyncStream;
+struct _InfTextSessionSyncStream {
+  gpointer parent;
+
+  /* Copy of the buffer content at the time the synchronization started */
+  InfTextChunk* chunk;
+  InfTextChunkIter iter;
+  gboolean has_segment;
+
+  const gchar* text;
+  gsize bytes_left;
+  guint length_left;
+
+  /* Text converted to UTF-8 but not yet sent */
+  gchar utf8_text[2 * 4 * INF_TEXT_SESSION_SYNC_STREAM_SEGMENT_LENGTH];
+  gsize utf8_bytes;
+
+  GIConv cd;
+};
+
 typedef struct _InfTextSessionPrivate InfTextSessionPrivate;
 struct _InfTextSessionPrivate {
   guint caret_update_interval;
@@ -171,6 +197,13 @@ inf_text_session_segment_from_xml(GIConv* cd,
   return text;
 }
 
+static gboolean
+inf_text_session_is_utf8(const gchar* encoding)
+{
+  return g_ascii_strcasecmp(encoding, "UTF-8") == 0 ||
+         g_ascii_strcasecmp(encoding, "UTF8") == 0;
+}
+
 /*
  * Caret/Selection handling
  */
@@ -1030,6 +1063,200 @@ inf_text_session_to_xml_sync(InfSession* session,
   g_iconv_close(cd);
 }
 
+static gpointer
+inf_text_session_sync_stream_new(InfSession* session,
+                                 InfXmlConnection* connection,
+                                 guint* n_messages)
+{
+  InfTextSessionSyncStream* stream;
+  InfTextBuffer* buffer;
+  InfTextChunkIter iter;
+  gboolean result;
+
+  stream = g_slice_new(InfTextSessionSyncStream);
+
+  stream->parent =
+    INF_SESSION_CLASS(inf_text_session_parent_class)->sync_stream_new(
+      session,
+      connection,
+      n_messages
+    );
+
+  /* The chunk shares nothing with the buffer, so the buffer can be
+   * modified while the synchronization is in progress. The chunk is much
+   * more compact than the XML it is going to produce. */
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
+  stream->chunk = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+
+  stream->cd = g_iconv_open(
+    "UTF-8",
+    inf_text_chunk_get_encoding(stream->chunk)
+  );
+
+  result = inf_text_chunk_iter_init_begin(stream->chunk, &iter);
+  while(result == TRUE)
+  {
+    *n_messages +=
+      (inf_text_chunk_iter_get_length(&iter) +
+       INF_TEXT_SESSION_SYNC_STREAM_SEGMENT_LENGTH - 1) /
+      INF_TEXT_SESSION_SYNC_STREAM_SEGMENT_LENGTH;
+
+    result = inf_text_chunk_iter_next(&iter);
+  }
+
+  stream->has_segment =
+    inf_text_chunk_iter_init_begin(stream->chunk, &stream->iter);
+
+  if(stream->has_segment)
+  {
+    stream->text = inf_text_chunk_iter_get_text(&stream->iter);
+    stream->bytes_left = inf_text_chunk_iter_get_bytes(&stream->iter);
+    stream->length_left = inf_text_chunk_iter_get_length(&stream->iter);
+  }
+
+  stream->utf8_bytes = 0;
+  return stream;
+}
+
+static xmlNodePtr
+inf_text_session_sync_stream_next(InfSession* session,
+                                  gpointer stream)
+{
+  InfTextSessionSyncStream* text_stream;
+  xmlNodePtr xml;
+  guint length;
+  guint converted;
+  gchar* end;
+  gchar* inbuf;
+  gchar* outbuf;
+  gsize outbytes_left;
+  gsize result;
+
+  text_stream = (InfTextSessionSyncStream*)stream;
+
+  if(text_stream->parent != NULL)
+  {
+    xml = INF_SESSION_CLASS(inf_text_session_parent_class)->sync_stream_next(
+      session,
+      text_stream->parent
+    );
+
+    if(xml != NULL) return xml;
+
+    INF_SESSION_CLASS(inf_text_session_parent_class)->sync_stream_free(
+      session,
+      text_stream->parent
+    );
+
+    text_stream->parent = NULL;
+  }
+
+  while(text_stream->has_segment && text_stream->length_left == 0)
+  {
+    g_assert(text_stream->utf8_bytes == 0);
+
+    text_stream->has_segment = inf_text_chunk_iter_next(&text_stream->iter);
+    if(text_stream->has_segment)
+    {
+      text_stream->text = inf_text_chunk_iter_get_text(&text_stream->iter);
+      text_stream->bytes_left =
+        inf_text_chunk_iter_get_bytes(&text_stream->iter);
+      text_stream->length_left =
+        inf_text_chunk_iter_get_length(&text_stream->iter);
+    }
+  }
+
+  if(!text_stream->has_segment)
+    return NULL;
+
+  length = MIN(
+    text_stream->length_left,
+    INF_TEXT_SESSION_SYNC_STREAM_SEGMENT_LENGTH
+  );
+
+  /* Find the end of the text for this message in the already converted
+   * text, and convert more if there is not enough of it. The text left over
+   * from the previous message is shorter than a full message, so at least
+   * half of the buffer is free, which is enough for another full one. */
+  end = text_stream->utf8_text;
+  for(converted = 0; converted < length; ++converted)
+  {
+    while(end == text_stream->utf8_text + text_stream->utf8_bytes &&
+          text_stream->bytes_left > 0)
+    {
+      inbuf = *(gchar**)(gpointer)&text_stream->text; /* cast const away */
+      outbuf = text_stream->utf8_text + text_stream->utf8_bytes;
+      outbytes_left =
+        sizeof(text_stream->utf8_text) - text_stream->utf8_bytes;
+
+      result = g_iconv(
+        text_stream->cd,
+        &inbuf,
+        &text_stream->bytes_left,
+        &outbuf,
+        &outbytes_left
+      );
+
+      /* Conversion into UTF-8 should always succeed */
+      g_assert(result == 0 || errno == E2BIG);
+
+      text_stream->text = inbuf;
+      text_stream->utf8_bytes = outbuf - text_stream->utf8_text;
+    }
+
+    if(end == text_stream->utf8_text + text_stream->utf8_bytes)
+      break;
+
+    end = g_utf8_next_char(end);
+  }
+
+  g_assert(converted == length);
+
+  xml = xmlNewNode(NULL, (const xmlChar*)"sync-segment");
+
+  inf_xml_util_add_child_text(
+    xml,
+    text_stream->utf8_text,
+    end - text_stream->utf8_text
+  );
+
+  inf_xml_util_set_attribute_uint(
+    xml,
+    "author",
+    inf_text_chunk_iter_get_author(&text_stream->iter)
+  );
+
+  text_stream->utf8_bytes -= end - text_stream->utf8_text;
+  text_stream->length_left -= length;
+
+  memmove(text_stream->utf8_text, end, text_stream->utf8_bytes);
+  return xml;
+}
+
+static void
+inf_text_session_sync_stream_free(InfSession* session,
+                                  gpointer stream)
+{
+  InfTextSessionSyncStream* text_stream;
+  text_stream = (InfTextSessionSyncStream*)stream;
+
+  if(text_stream->parent != NULL)
+  {
+    INF_SESSION_CLASS(inf_text_session_parent_class)->sync_stream_free(
+      session,
+      text_stream->parent
+    );
+  }
+
+  g_iconv_close(text_stream->cd);
+  inf_text_chunk_free(text_stream->chunk);
+  g_slice_free(InfTextSessionSyncStream, text_stream);
+}
+
 static gboolean
 inf_text_session_process_xml_sync(InfSession* session,
                                   InfXmlConnection* connection,
@@ -1369,22 +1596,35 @@ inf_text_session_request_to_xml(InfAdoptedSession* session,
       result = inf_text_chunk_iter_init_begin(chunk, &iter);
       g_assert(result == TRUE);
 
-      utf8_text = g_convert(
-        inf_text_chunk_iter_get_text(&iter),
-        inf_text_chunk_iter_get_bytes(&iter),
-        "UTF-8",
-        inf_text_chunk_get_encoding(chunk),
-        &bytes_read,
-        &bytes_written,
-        NULL
-      );
+      /* Insertions are the most frequent requests, so avoid the conversion
+       * if the text is UTF-8 already. */
+      if(inf_text_session_is_utf8(inf_text_chunk_get_encoding(chunk)))
+      {
+        inf_xml_util_add_child_text(
+          op_xml,
+          inf_text_chunk_iter_get_text(&iter),
+          inf_text_chunk_iter_get_bytes(&iter)
+        );
+      }
+      else
+      {
+        utf8_text = g_convert(
+          inf_text_chunk_iter_get_text(&iter),
+          inf_text_chunk_iter_get_bytes(&iter),
+          "UTF-8",
+          inf_text_chunk_get_encoding(chunk),
+          &bytes_read,
+          &bytes_written,
+          NULL
+        );
 
-      /* Conversion to UTF-8 should always succeed */
-      g_assert(utf8_text != NULL);
-      g_assert(bytes_read == inf_text_chunk_iter_get_bytes(&iter));
+        /* Conversion to UTF-8 should always succeed */
+        g_assert(utf8_text != NULL);
+        g_assert(bytes_read == inf_text_chunk_iter_get_bytes(&iter));
 
-      inf_xml_util_add_child_text(op_xml, utf8_text, bytes_written);
-      g_free(utf8_text);
+        inf_xml_util_add_child_text(op_xml, utf8_text, bytes_written);
+        g_free(utf8_text);
+      }
 
       /* We only allow a single segment because the whole inserted text must
        * be written by a single user. */
@@ -1561,18 +1801,40 @@ inf_text_session_xml_to_request(InfAdoptedSession* session,
     if(!utf8_text)
       goto fail;
 
-    text = g_convert(
-      utf8_text,
-      in_bytes,
-      inf_text_buffer_get_encoding(buffer),
-      "UTF-8",
-      NULL,
-      &bytes,
-      error
-    );
+    if(inf_text_session_is_utf8(inf_text_buffer_get_encoding(buffer)))
+    {
+      /* Code points from <uchar> elements are not validated yet */
+      if(!g_utf8_validate(utf8_text, in_bytes, NULL))
+      {
+        g_set_error_literal(
+          error,
+          G_CONVERT_ERROR,
+          G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+          _("Inserted text is not valid UTF-8")
+        );
+
+        g_free(utf8_text);
+        goto fail;
+      }
+
+      text = utf8_text;
+      bytes = in_bytes;
+    }
+    else
+    {
+      text = g_convert(
+        utf8_text,
+        in_bytes,
+        inf_text_buffer_get_encoding(buffer),
+        "UTF-8",
+        NULL,
+        &bytes,
+        error
+      );
 
-    g_free(utf8_text);
-    if(text == NULL) goto fail;
+      g_free(utf8_text);
+      if(text == NULL) goto fail;
+    }
 
     chunk = inf_text_chunk_new(inf_text_buffer_get_encoding(buffer));
     inf_text_chunk_insert_text(chunk, 0, text, bytes, length, user_id);
@@ -1769,6 +2031,9 @@ inf_text_session_class_init(InfTextSessionClass* text_session_class)
   object_class->get_property = inf_text_session_get_property;
 
   session_class->to_xml_sync = inf_text_session_to_xml_sync;
+  session_class->sync_stream_new = inf_text_session_sync_stream_new;
+  session_class->sync_stream_next = inf_text_session_sync_stream_next;
+  session_class->sync_stream_free = inf_text_session_sync_stream_free;
   session_class->process_xml_sync = inf_text_session_process_xml_sync;
   session_class->process_xml_run = inf_text_session_process_xml_run;
   session_class->get_xml_user_props = inf_text_session_get_xml_user_props;
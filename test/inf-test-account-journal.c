@@ -0,0 +1,429 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Adds, removes and changes a number of accounts in an
+ * InfdFilesystemAccountStorage in a temporary directory and prints how long
+ * that takes. Then it loads the accounts into a new account storage and
+ * checks that all changes have been preserved. Finally, it cuts off the end
+ * of the account journal and checks that the accounts can still be loaded
+ * and changed. All of this is done once more, with fewer accounts, with
+ * sync-writes set on the underlying storage. */
+
+#include "util/inf-test-util.h"
+
+#include <libinfinity/server/infd-filesystem-account-storage.h>
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-file-util.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define INF_TEST_ACCOUNT_JOURNAL_DEFAULT_ACCOUNTS 2000
+
+/* Every this many accounts are removed again */
+#define INF_TEST_ACCOUNT_JOURNAL_REMOVE_EVERY 10
+/* Every this many accounts get a new password */
+#define INF_TEST_ACCOUNT_JOURNAL_PASSWORD_EVERY 7
+/* Every change is flushed to disk with sync-writes, so only a fraction of
+ * the accounts is used then */
+#define INF_TEST_ACCOUNT_JOURNAL_SYNC_FRACTION 10
+
+static InfdFilesystemAccountStorage*
+inf_test_account_journal_open(InfdFilesystemStorage* storage,
+                              GError** error)
+{
+  InfdFilesystemAccountStorage* account_storage;
+
+  account_storage = infd_filesystem_account_storage_new();
+  if(!infd_filesystem_account_storage_set_filesystem(account_storage,
+                                                     storage,
+                                                     error))
+  {
+    g_object_unref(account_storage);
+    return NULL;
+  }
+
+  return account_storage;
+}
+
+static gchar*
+inf_test_account_journal_password(guint i)
+{
+  if(i % INF_TEST_ACCOUNT_JOURNAL_PASSWORD_EVERY == 0)
+    return g_strdup_printf("new%u", i);
+  else
+    return g_strdup_printf("password%u", i);
+}
+
+static gboolean
+inf_test_account_journal_modify(InfdAccountStorage* storage,
+                                guint n_accounts,
+                                GError** error)
+{
+  InfAclAccountId* ids;
+  gchar* name;
+  gchar* password;
+  gint64 start;
+  gint64 end;
+  guint i;
+
+  ids = g_new(InfAclAccountId, n_accounts);
+
+  start = g_get_monotonic_time();
+  for(i = 0; i < n_accounts; ++i)
+  {
+    name = g_strdup_printf("user%u", i);
+    password = g_strdup_printf("password%u", i);
+
+    ids[i] = infd_account_storage_add_account(
+      storage,
+      name,
+      NULL,
+      0,
+      password,
+      error
+    );
+
+    g_free(name);
+    g_free(password);
+
+    if(ids[i] == 0)
+    {
+      g_free(ids);
+      return FALSE;
+    }
+  }
+  end = g_get_monotonic_time();
+
+  printf(
+    "Added %u accounts in %.3f ms\n",
+    n_accounts,
+    (end - start) / 1e3
+  );
+
+  start = g_get_monotonic_time();
+  for(i = 0; i < n_accounts; ++i)
+  {
+    if(i % INF_TEST_ACCOUNT_JOURNAL_REMOVE_EVERY == 0)
+    {
+      if(!infd_account_storage_remove_account(storage, ids[i], error))
+      {
+        g_free(ids);
+        return FALSE;
+      }
+    }
+    else if(i % INF_TEST_ACCOUNT_JOURNAL_PASSWORD_EVERY == 0)
+    {
+      password = inf_test_account_journal_password(i);
+      if(!infd_account_storage_set_password(storage, ids[i], password, error))
+      {
+        g_free(password);
+        g_free(ids);
+        return FALSE;
+      }
+
+      g_free(password);
+    }
+  }
+  end = g_get_monotonic_time();
+
+  printf("Changed accounts in %.3f ms\n", (end - start) / 1e3);
+
+  g_free(ids);
+  return TRUE;
+}
+
+static gboolean
+inf_test_account_journal_check(InfdAccountStorage* storage,
+                               guint n_accounts,
+                               GError** error)
+{
+  InfAclAccount* accounts;
+  guint n_listed;
+  guint n_expected;
+  InfAclAccountId id;
+  gchar* name;
+  gchar* password;
+  guint i;
+
+  accounts = infd_account_storage_list_accounts(storage, &n_listed, error);
+  if(accounts == NULL && n_listed > 0)
+    return FALSE;
+
+  inf_acl_account_array_free(accounts, n_listed);
+
+  n_expected = 0;
+  for(i = 0; i < n_accounts; ++i)
+    if(i % INF_TEST_ACCOUNT_JOURNAL_REMOVE_EVERY != 0)
+      ++n_expected;
+
+  if(n_listed != n_expected)
+  {
+    g_set_error(
+      error,
+      g_quark_from_static_string("INF_TEST_ACCOUNT_JOURNAL_ERROR"),
+      0,
+      "There are %u instead of %u accounts",
+      n_listed,
+      n_expected
+    );
+
+    return FALSE;
+  }
+
+  for(i = 0; i < n_accounts; ++i)
+  {
+    if(i % INF_TEST_ACCOUNT_JOURNAL_REMOVE_EVERY == 0)
+      continue;
+
+    name = g_strdup_printf("user%u", i);
+    password = inf_test_account_journal_password(i);
+
+    id = infd_account_storage_login_by_password(
+      storage,
+      name,
+      password,
+      error
+    );
+
+    g_free(password);
+
+    if(id == 0)
+    {
+      if(error == NULL || *error == NULL)
+      {
+        g_set_error(
+          error,
+          g_quark_from_static_string("INF_TEST_ACCOUNT_JOURNAL_ERROR"),
+          0,
+          "Could not log into account \"%s\"",
+          name
+        );
+      }
+
+      g_free(name);
+      return FALSE;
+    }
+
+    g_free(name);
+  }
+
+  return TRUE;
+}
+
+/* Removes the last bytes of the journal, as if the server crashed while
+ * appending to it */
+static gboolean
+inf_test_account_journal_tear(InfdFilesystemStorage* storage,
+                              GError** error)
+{
+  gchar* path;
+  gchar* contents;
+  gsize length;
+  gboolean result;
+
+  path = infd_filesystem_storage_get_path(
+    storage,
+    "journal",
+    "/accounts",
+    error
+  );
+
+  if(path == NULL)
+    return FALSE;
+
+  if(!g_file_get_contents(path, &contents, &length, error))
+  {
+    g_free(path);
+    return FALSE;
+  }
+
+  g_assert(length > 3);
+  result = g_file_set_contents(path, contents, length - 3, error);
+
+  g_free(contents);
+  g_free(path);
+  return result;
+}
+
+static gboolean
+inf_test_account_journal_run(InfdFilesystemStorage* storage,
+                             guint n_accounts,
+                             GError** error)
+{
+  InfdFilesystemAccountStorage* account_storage;
+  InfAclAccountId id;
+  gint64 start;
+  gint64 end;
+  gboolean result;
+
+  account_storage = inf_test_account_journal_open(storage, error);
+  if(account_storage == NULL)
+    return FALSE;
+
+  result = inf_test_account_journal_modify(
+    INFD_ACCOUNT_STORAGE(account_storage),
+    n_accounts,
+    error
+  );
+
+  g_object_unref(account_storage);
+  if(result == FALSE)
+    return FALSE;
+
+  start = g_get_monotonic_time();
+  account_storage = inf_test_account_journal_open(storage, error);
+  end = g_get_monotonic_time();
+
+  if(account_storage == NULL)
+    return FALSE;
+
+  printf("Loaded accounts in %.3f ms\n", (end - start) / 1e3);
+
+  /* This also logs into every account, which appends to the journal */
+  result = inf_test_account_journal_check(
+    INFD_ACCOUNT_STORAGE(account_storage),
+    n_accounts,
+    error
+  );
+
+  g_object_unref(account_storage);
+  if(result == FALSE)
+    return FALSE;
+
+  /* The last record is a login, so losing it does not lose any account */
+  if(!inf_test_account_journal_tear(storage, error))
+    return FALSE;
+
+  account_storage = inf_test_account_journal_open(storage, error);
+  if(account_storage == NULL)
+    return FALSE;
+
+  id = infd_account_storage_add_account(
+    INFD_ACCOUNT_STORAGE(account_storage),
+    "extra",
+    NULL,
+    0,
+    "extra",
+    error
+  );
+
+  g_object_unref(account_storage);
+  if(id == 0)
+    return FALSE;
+
+  account_storage = inf_test_account_journal_open(storage, error);
+  if(account_storage == NULL)
+    return FALSE;
+
+  result = inf_test_account_journal_check(
+    INFD_ACCOUNT_STORAGE(account_storage),
+    n_accounts,
+    error
+  );
+
+  if(result == TRUE)
+  {
+    id = infd_account_storage_login_by_password(
+      INFD_ACCOUNT_STORAGE(account_storage),
+      "extra",
+      "extra",
+      error
+    );
+
+    g_assert(id != 0);
+  }
+
+  g_object_unref(account_storage);
+  return result;
+}
+
+static gboolean
+inf_test_account_journal_main(const gchar* path,
+                              gpointer user_data,
+                              GError** error)
+{
+  InfdFilesystemStorage* storage;
+  InfStandaloneIo* io;
+  gchar* sync_path;
+  guint n_accounts;
+  gboolean result;
+
+  n_accounts = *(const guint*)user_data;
+
+  storage = infd_filesystem_storage_new(path);
+  result = inf_test_account_journal_run(storage, n_accounts, error);
+  g_object_unref(storage);
+
+  if(result == FALSE)
+    return FALSE;
+
+  sync_path = g_build_filename(path, "sync", NULL);
+  if(!inf_file_util_create_single_directory(sync_path, 0755, error))
+  {
+    g_free(sync_path);
+    return FALSE;
+  }
+
+  /* With an io object, writes with sync-writes set go through group
+   * commits, which the journal must not overtake. */
+  io = inf_standalone_io_new();
+  storage = infd_filesystem_storage_new(sync_path);
+  g_object_set(
+    G_OBJECT(storage),
+    "io", io,
+    "sync-writes", TRUE,
+    NULL
+  );
+
+  printf("With sync-writes:\n");
+  result = inf_test_account_journal_run(
+    storage,
+    MAX(n_accounts / INF_TEST_ACCOUNT_JOURNAL_SYNC_FRACTION, 1),
+    error
+  );
+
+  g_object_unref(storage);
+  g_object_unref(io);
+  g_free(sync_path);
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  guint n_accounts;
+
+  n_accounts = INF_TEST_ACCOUNT_JOURNAL_DEFAULT_ACCOUNTS;
+  if(argc > 1) n_accounts = strtoul(argv[1], NULL, 10);
+
+  if(n_accounts == 0)
+  {
+    fprintf(stderr, "Usage: %s [accounts]\n", argv[0]);
+    return -1;
+  }
+
+  return inf_test_util_run_in_tmpdir(
+    "inf-test-account-journal",
+    inf_test_account_journal_main,
+    &n_accounts
+  );
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,337 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Serves a directory with one subdirectory to a client via a simulated
+ * connection, and checks the permissions of another account on both sides
+ * while its sheets are queried, changed and removed. The cached effective
+ * permissions must follow every change, and checking a permission must
+ * work as long as the sheets that define it are available, even if the ACL
+ * of the parent nodes has not been queried. */
+
+#include "util/inf-test-util.h"
+
+#include <libinfinity/server/infd-directory.h>
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/client/infc-browser.h>
+#include <libinfinity/common/inf-simulated-connection.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-file-util.h>
+
+#include <stdio.h>
+
+/* Sets the sheet of account at iter so that it defines setting */
+static void
+inf_test_acl_cache_set(InfBrowser* browser,
+                       const InfBrowserIter* iter,
+                       InfAclAccountId account,
+                       InfAclSetting setting,
+                       gboolean allow)
+{
+  InfAclSheetSet* sheet_set;
+  InfAclSheet* sheet;
+
+  sheet_set = inf_acl_sheet_set_new();
+  sheet = inf_acl_sheet_set_add_sheet(sheet_set, account);
+
+  inf_acl_mask_set1(&sheet->mask, setting);
+  if(allow == TRUE)
+    inf_acl_mask_set1(&sheet->perms, setting);
+
+  inf_browser_set_acl(browser, iter, sheet_set, NULL, NULL);
+  inf_acl_sheet_set_free(sheet_set);
+}
+
+static gboolean
+inf_test_acl_cache_check(InfBrowser* browser,
+                         const InfBrowserIter* iter,
+                         InfAclAccountId account,
+                         InfAclSetting setting)
+{
+  InfAclMask mask;
+  inf_acl_mask_set1(&mask, setting);
+  return inf_browser_check_acl(browser, iter, account, &mask, NULL);
+}
+
+static void
+inf_test_acl_cache_run(InfdDirectory* directory,
+                       InfcBrowser* browser)
+{
+  InfBrowser* server;
+  InfBrowser* client;
+  InfBrowserIter server_root;
+  InfBrowserIter server_child;
+  InfBrowserIter client_root;
+  InfBrowserIter client_child;
+  InfAclAccountId default_id;
+  InfAclAccountId account;
+  GError* error;
+
+  server = INF_BROWSER(directory);
+  client = INF_BROWSER(browser);
+  default_id = inf_acl_account_id_from_string("default");
+
+  error = NULL;
+  account = infd_directory_create_acl_account(
+    directory,
+    "test",
+    TRUE,
+    NULL,
+    0,
+    &error
+  );
+
+  if(account == 0)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    g_assert_not_reached();
+  }
+
+  /* Simulated connections deliver immediately, so every request has been
+   * processed on both sides once it has been made. */
+  inf_browser_get_root(client, &client_root);
+  inf_browser_explore(client, &client_root, NULL, NULL);
+  g_assert(inf_browser_get_explored(client, &client_root));
+
+  client_child = client_root;
+  g_assert(inf_browser_get_child(client, &client_child));
+
+  inf_browser_get_root(server, &server_root);
+  server_child = server_root;
+  g_assert(inf_browser_get_child(server, &server_child));
+
+  /* Everybody may look at the sheets and the account list, but nobody may
+   * add documents, except the test account in the subdirectory. */
+  inf_test_acl_cache_set(
+    server,
+    &server_root,
+    default_id,
+    INF_ACL_CAN_QUERY_ACL,
+    TRUE
+  );
+
+  inf_test_acl_cache_set(
+    server,
+    &server_root,
+    default_id,
+    INF_ACL_CAN_QUERY_ACCOUNT_LIST,
+    TRUE
+  );
+
+  inf_test_acl_cache_set(
+    server,
+    &server_root,
+    default_id,
+    INF_ACL_CAN_ADD_DOCUMENT,
+    FALSE
+  );
+
+  inf_test_acl_cache_set(
+    server,
+    &server_child,
+    account,
+    INF_ACL_CAN_ADD_DOCUMENT,
+    TRUE
+  );
+
+  g_assert(
+    !inf_test_acl_cache_check(
+      server,
+      &server_root,
+      account,
+      INF_ACL_CAN_ADD_DOCUMENT
+    )
+  );
+
+  g_assert(
+    inf_test_acl_cache_check(
+      server,
+      &server_child,
+      account,
+      INF_ACL_CAN_ADD_DOCUMENT
+    )
+  );
+
+  /* Only the sheets of the subdirectory are known, but they are enough to
+   * tell. */
+  inf_browser_query_acl(client, &client_child, NULL, NULL);
+  g_assert(inf_browser_has_acl(client, &client_child, account));
+  g_assert(!inf_browser_has_acl(client, &client_root, account));
+
+  g_assert(
+    inf_test_acl_cache_check(
+      client,
+      &client_child,
+      account,
+      INF_ACL_CAN_ADD_DOCUMENT
+    )
+  );
+
+  inf_browser_query_acl(client, &client_root, NULL, NULL);
+  g_assert(inf_browser_has_acl(client, &client_root, account));
+
+  g_assert(
+    !inf_test_acl_cache_check(
+      client,
+      &client_root,
+      account,
+      INF_ACL_CAN_ADD_DOCUMENT
+    )
+  );
+
+  g_assert(
+    inf_test_acl_cache_check(
+      client,
+      &client_child,
+      account,
+      INF_ACL_CAN_ADD_DOCUMENT
+    )
+  );
+
+  printf("Permissions of the account are known on both sides\n");
+
+  /* Removing the account removes its sheets, so that only the ones of the
+   * default account are left. */
+  inf_browser_remove_acl_account(server, account, NULL, NULL);
+
+  g_assert(
+    !inf_test_acl_cache_check(
+      server,
+      &server_child,
+      account,
+      INF_ACL_CAN_ADD_DOCUMENT
+    )
+  );
+
+  g_assert(
+    !inf_test_acl_cache_check(
+      client,
+      &client_child,
+      account,
+      INF_ACL_CAN_ADD_DOCUMENT
+    )
+  );
+
+  printf("Removed account lost its permissions on both sides\n");
+
+  /* A change of the default sheets applies to it again */
+  inf_test_acl_cache_set(
+    server,
+    &server_root,
+    default_id,
+    INF_ACL_CAN_ADD_DOCUMENT,
+    TRUE
+  );
+
+  g_assert(
+    inf_test_acl_cache_check(
+      server,
+      &server_child,
+      account,
+      INF_ACL_CAN_ADD_DOCUMENT
+    )
+  );
+
+  g_assert(
+    inf_test_acl_cache_check(
+      client,
+      &client_child,
+      account,
+      INF_ACL_CAN_ADD_DOCUMENT
+    )
+  );
+
+  printf("Changed default sheet applies on both sides\n");
+}
+
+static gboolean
+inf_test_acl_cache_main(const gchar* path,
+                        gpointer user_data,
+                        GError** error)
+{
+  InfStandaloneIo* io;
+  InfdFilesystemStorage* storage;
+  InfCommunicationManager* server_manager;
+  InfCommunicationManager* client_manager;
+  InfSimulatedConnection* server_connection;
+  InfSimulatedConnection* client_connection;
+  InfdDirectory* directory;
+  InfcBrowser* browser;
+  gchar* child_path;
+  gboolean result;
+
+  child_path = g_build_filename(path, "d0", NULL);
+  result = inf_file_util_create_single_directory(child_path, 0755, error);
+  g_free(child_path);
+
+  if(result == FALSE)
+    return FALSE;
+
+  io = inf_standalone_io_new();
+  storage = infd_filesystem_storage_new(path);
+  server_manager = inf_communication_manager_new();
+  client_manager = inf_communication_manager_new();
+
+  directory = infd_directory_new(
+    INF_IO(io),
+    INFD_STORAGE(storage),
+    server_manager
+  );
+
+  server_connection = inf_simulated_connection_new_with_io(INF_IO(io));
+  client_connection = inf_simulated_connection_new_with_io(INF_IO(io));
+  inf_simulated_connection_connect(client_connection, server_connection);
+
+  browser = infc_browser_new(
+    INF_IO(io),
+    client_manager,
+    INF_XML_CONNECTION(client_connection)
+  );
+
+  infd_directory_add_connection(
+    directory,
+    INF_XML_CONNECTION(server_connection)
+  );
+
+  inf_test_acl_cache_run(directory, browser);
+
+  g_object_unref(browser);
+  g_object_unref(directory);
+  g_object_unref(client_connection);
+  g_object_unref(server_connection);
+  g_object_unref(client_manager);
+  g_object_unref(server_manager);
+  g_object_unref(storage);
+  g_object_unref(io);
+  return TRUE;
+}
+
+int main(int argc, char* argv[])
+{
+  /* A failed check for a node whose sheets are not available is a bug */
+  g_log_set_always_fatal(G_LOG_FATAL_MASK | G_LOG_LEVEL_CRITICAL);
+
+  return inf_test_util_run_in_tmpdir(
+    "inf-test-acl-cache",
+    inf_test_acl_cache_main,
+    NULL
+  );
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,595 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Generates a deep directory tree in a temporary directory, serves it with
+ * an InfdDirectory to a number of clients connected via simulated
+ * connections which explore the whole tree and subscribe to a note in it,
+ * and then measures how long it takes to change the ACL at different places
+ * of the tree, once with a change that does not revoke any permission that
+ * is enforced on the clients, and once with one that does. Revoked
+ * permissions must have been taken away from every client. */
+
+#include "util/inf-test-util.h"
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-filesystem-format.h>
+
+#include <libinfinity/server/infd-directory.h>
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/client/infc-browser.h>
+#include <libinfinity/common/inf-simulated-connection.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-file-util.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INF_TEST_ACL_ENFORCE_DEFAULT_DEPTH 5
+#define INF_TEST_ACL_ENFORCE_DEFAULT_FANOUT 4
+#define INF_TEST_ACL_ENFORCE_DEFAULT_CLIENTS 20
+
+/* Name of the note in the first subdirectory of the root node */
+#define INF_TEST_ACL_ENFORCE_NOTE "note"
+
+typedef struct _InfTestAclEnforce InfTestAclEnforce;
+struct _InfTestAclEnforce {
+  guint depth;
+  guint fanout;
+  guint n_clients;
+};
+
+typedef struct _InfTestAclEnforceClient InfTestAclEnforceClient;
+struct _InfTestAclEnforceClient {
+  InfSimulatedConnection* client_connection;
+  InfSimulatedConnection* server_connection;
+  InfCommunicationManager* manager;
+  InfcBrowser* browser;
+};
+
+static InfSession*
+inf_test_acl_enforce_session_new(InfIo* io,
+                                 InfCommunicationManager* manager,
+                                 InfSessionStatus status,
+                                 InfCommunicationGroup* sync_group,
+                                 InfXmlConnection* sync_connection,
+                                 const gchar* path,
+                                 gpointer user_data)
+{
+  InfTextSession* session;
+  InfTextBuffer* buffer;
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  session = inf_text_session_new(
+    manager,
+    buffer,
+    io,
+    status,
+    sync_group,
+    sync_connection
+  );
+
+  g_object_unref(buffer);
+  return INF_SESSION(session);
+}
+
+static InfSession*
+inf_test_acl_enforce_session_read(InfdStorage* storage,
+                                  InfIo* io,
+                                  InfCommunicationManager* manager,
+                                  const gchar* path,
+                                  gpointer user_data,
+                                  GError** error)
+{
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfTextSession* session;
+
+  user_table = inf_user_table_new();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  if(!inf_text_filesystem_format_read(
+       INFD_FILESYSTEM_STORAGE(storage),
+       path,
+       user_table,
+       buffer,
+       error))
+  {
+    g_object_unref(user_table);
+    g_object_unref(buffer);
+    return NULL;
+  }
+
+  session = inf_text_session_new_with_user_table(
+    manager,
+    buffer,
+    io,
+    user_table,
+    INF_SESSION_RUNNING,
+    NULL,
+    NULL
+  );
+
+  g_object_unref(user_table);
+  g_object_unref(buffer);
+  return INF_SESSION(session);
+}
+
+static gboolean
+inf_test_acl_enforce_session_write(InfdStorage* storage,
+                                   InfSession* session,
+                                   const gchar* path,
+                                   gpointer user_data,
+                                   GError** error)
+{
+  return inf_text_filesystem_format_write(
+    INFD_FILESYSTEM_STORAGE(storage),
+    path,
+    inf_session_get_user_table(session),
+    INF_TEXT_BUFFER(inf_session_get_buffer(session)),
+    error
+  );
+}
+
+static const InfdNotePlugin INF_TEST_ACL_ENFORCE_SERVER_PLUGIN = {
+  NULL,
+  "InfdFilesystemStorage",
+  "InfText",
+  inf_test_acl_enforce_session_new,
+  inf_test_acl_enforce_session_read,
+  inf_test_acl_enforce_session_write,
+  NULL
+};
+
+static const InfcNotePlugin INF_TEST_ACL_ENFORCE_CLIENT_PLUGIN = {
+  NULL,
+  "InfText",
+  inf_test_acl_enforce_session_new
+};
+
+static gboolean
+inf_test_acl_enforce_create_tree(const gchar* path,
+                                 guint depth,
+                                 guint fanout,
+                                 GError** error)
+{
+  gchar* name;
+  gchar* child_path;
+  gboolean result;
+  guint i;
+
+  result = TRUE;
+  for(i = 0; i < fanout && depth > 0 && result == TRUE; ++i)
+  {
+    name = g_strdup_printf("d%u", i);
+    child_path = g_build_filename(path, name, NULL);
+    g_free(name);
+
+    result = inf_file_util_create_single_directory(child_path, 0755, error);
+    if(result == TRUE)
+    {
+      result = inf_test_acl_enforce_create_tree(
+        child_path,
+        depth - 1,
+        fanout,
+        error
+      );
+    }
+
+    g_free(child_path);
+  }
+
+  return result;
+}
+
+/* Explores the subtree below iter completely. Returns the number of
+ * explored subdirectories. */
+static guint
+inf_test_acl_enforce_explore(InfBrowser* browser,
+                             const InfBrowserIter* iter)
+{
+  InfBrowserIter child;
+  gboolean result;
+  guint n;
+
+  if(!inf_browser_is_subdirectory(browser, iter))
+    return 0;
+
+  if(!inf_browser_get_explored(browser, iter))
+    inf_browser_explore(browser, iter, NULL, NULL);
+
+  /* Simulated connections deliver immediately, so the exploration is
+   * complete once the request has been made. */
+  g_assert(inf_browser_get_explored(browser, iter));
+
+  n = 1;
+  child = *iter;
+  for(result = inf_browser_get_child(browser, &child);
+      result == TRUE;
+      result = inf_browser_get_next(browser, &child))
+  {
+    n += inf_test_acl_enforce_explore(browser, &child);
+  }
+
+  return n;
+}
+
+/* Returns the node at the given depth, always taking the first child */
+static void
+inf_test_acl_enforce_get_deep_node(InfBrowser* browser,
+                                   guint depth,
+                                   InfBrowserIter* iter)
+{
+  guint i;
+
+  inf_browser_get_root(browser, iter);
+  for(i = 0; i < depth; ++i)
+    if(!inf_browser_get_child(browser, iter))
+      break;
+}
+
+/* Points iter to the note in the first subdirectory of the root node */
+static void
+inf_test_acl_enforce_get_note(InfBrowser* browser,
+                              InfBrowserIter* iter)
+{
+  gboolean result;
+
+  inf_test_acl_enforce_get_deep_node(browser, 1, iter);
+  g_assert(inf_browser_get_explored(browser, iter));
+
+  for(result = inf_browser_get_child(browser, iter);
+      result == TRUE;
+      result = inf_browser_get_next(browser, iter))
+  {
+    if(strcmp(inf_browser_get_node_name(browser, iter),
+              INF_TEST_ACL_ENFORCE_NOTE) == 0)
+    {
+      return;
+    }
+  }
+
+  g_assert_not_reached();
+}
+
+static void
+inf_test_acl_enforce_measure(InfBrowser* directory,
+                             const gchar* title,
+                             const InfBrowserIter* iter,
+                             InfAclSetting setting,
+                             gboolean allow)
+{
+  InfAclSheetSet* sheet_set;
+  InfAclSheet* sheet;
+  const InfAclSheetSet* result_set;
+  const InfAclSheet* result_sheet;
+  gint64 start;
+  gint64 end;
+
+  sheet_set = inf_acl_sheet_set_new();
+  sheet = inf_acl_sheet_set_add_sheet(
+    sheet_set,
+    inf_acl_account_id_from_string("default")
+  );
+
+  inf_acl_mask_set1(&sheet->mask, setting);
+  if(allow == TRUE)
+    inf_acl_mask_set1(&sheet->perms, setting);
+
+  start = g_get_monotonic_time();
+  inf_browser_set_acl(directory, iter, sheet_set, NULL, NULL);
+  end = g_get_monotonic_time();
+
+  inf_acl_sheet_set_free(sheet_set);
+
+  result_set = inf_browser_get_acl(directory, iter);
+  g_assert(result_set != NULL);
+
+  result_sheet = inf_acl_sheet_set_find_const_sheet(
+    result_set,
+    inf_acl_account_id_from_string("default")
+  );
+
+  g_assert(result_sheet != NULL);
+  g_assert(inf_acl_mask_has(&result_sheet->mask, setting));
+  g_assert(inf_acl_mask_has(&result_sheet->perms, setting) == allow);
+
+  printf("%s: %.3f ms\n", title, (end - start) / 1e3);
+}
+
+/* Checks whether each client has explored the node at the given depth
+ * below the root node, and is subscribed to the note */
+static void
+inf_test_acl_enforce_assert_clients(InfTestAclEnforceClient* clients,
+                                    guint n_clients,
+                                    guint depth,
+                                    gboolean explored,
+                                    gboolean subscribed)
+{
+  InfBrowser* browser;
+  InfBrowserIter iter;
+  guint i;
+
+  for(i = 0; i < n_clients; ++i)
+  {
+    browser = INF_BROWSER(clients[i].browser);
+
+    inf_test_acl_enforce_get_deep_node(browser, depth, &iter);
+    g_assert(inf_browser_get_explored(browser, &iter) == explored);
+
+    /* The note is known as long as the root node is explored */
+    inf_browser_get_root(browser, &iter);
+    if(inf_browser_get_explored(browser, &iter))
+    {
+      inf_test_acl_enforce_get_note(browser, &iter);
+      g_assert(
+        (inf_browser_get_session(browser, &iter) != NULL) == subscribed
+      );
+    }
+    else
+    {
+      g_assert(subscribed == FALSE);
+    }
+  }
+}
+
+static gboolean
+inf_test_acl_enforce_main(const gchar* path,
+                          gpointer user_data,
+                          GError** error)
+{
+  InfTestAclEnforce* test;
+  InfStandaloneIo* io;
+  InfdFilesystemStorage* storage;
+  InfCommunicationManager* manager;
+  InfdDirectory* directory;
+  InfTestAclEnforceClient* clients;
+  InfBrowserIter iter;
+  guint n_nodes;
+  guint i;
+
+  test = (InfTestAclEnforce*)user_data;
+
+  if(!inf_test_acl_enforce_create_tree(path, test->depth, test->fanout, error))
+    return FALSE;
+
+  io = inf_standalone_io_new();
+  storage = infd_filesystem_storage_new(path);
+  manager = inf_communication_manager_new();
+
+  directory = infd_directory_new(
+    INF_IO(io),
+    INFD_STORAGE(storage),
+    manager
+  );
+
+  infd_directory_add_plugin(directory, &INF_TEST_ACL_ENFORCE_SERVER_PLUGIN);
+
+  /* The server explores nodes on demand, so the first subdirectory needs
+   * to be explored to add the note to it */
+  inf_browser_get_root(INF_BROWSER(directory), &iter);
+  if(!inf_browser_get_explored(INF_BROWSER(directory), &iter))
+    inf_browser_explore(INF_BROWSER(directory), &iter, NULL, NULL);
+
+  inf_test_acl_enforce_get_deep_node(INF_BROWSER(directory), 1, &iter);
+  if(!inf_browser_get_explored(INF_BROWSER(directory), &iter))
+    inf_browser_explore(INF_BROWSER(directory), &iter, NULL, NULL);
+
+  inf_browser_add_note(
+    INF_BROWSER(directory),
+    &iter,
+    INF_TEST_ACL_ENFORCE_NOTE,
+    "InfText",
+    NULL,
+    NULL,
+    FALSE,
+    NULL,
+    NULL
+  );
+
+  clients = g_new(InfTestAclEnforceClient, test->n_clients);
+  n_nodes = 0;
+
+  for(i = 0; i < test->n_clients; ++i)
+  {
+    clients[i].client_connection =
+      inf_simulated_connection_new_with_io(INF_IO(io));
+    clients[i].server_connection =
+      inf_simulated_connection_new_with_io(INF_IO(io));
+
+    inf_simulated_connection_connect(
+      clients[i].client_connection,
+      clients[i].server_connection
+    );
+
+    clients[i].manager = inf_communication_manager_new();
+    clients[i].browser = infc_browser_new(
+      INF_IO(io),
+      clients[i].manager,
+      INF_XML_CONNECTION(clients[i].client_connection)
+    );
+
+    infc_browser_add_plugin(
+      clients[i].browser,
+      &INF_TEST_ACL_ENFORCE_CLIENT_PLUGIN
+    );
+
+    infd_directory_add_connection(
+      directory,
+      INF_XML_CONNECTION(clients[i].server_connection)
+    );
+
+    inf_browser_get_root(INF_BROWSER(clients[i].browser), &iter);
+    n_nodes += inf_test_acl_enforce_explore(
+      INF_BROWSER(clients[i].browser),
+      &iter
+    );
+
+    inf_test_acl_enforce_get_note(INF_BROWSER(clients[i].browser), &iter);
+    inf_browser_subscribe(
+      INF_BROWSER(clients[i].browser),
+      &iter,
+      NULL,
+      NULL
+    );
+  }
+
+  printf(
+    "%u clients, %u explored subdirectories each\n",
+    test->n_clients,
+    n_nodes / test->n_clients
+  );
+
+  inf_test_acl_enforce_assert_clients(
+    clients,
+    test->n_clients,
+    test->depth - 1,
+    TRUE,
+    TRUE
+  );
+
+  /* Changes that do not revoke any enforced permission */
+  inf_browser_get_root(INF_BROWSER(directory), &iter);
+  inf_test_acl_enforce_measure(
+    INF_BROWSER(directory),
+    "Unenforced setting at root",
+    &iter,
+    INF_ACL_CAN_ADD_DOCUMENT,
+    FALSE
+  );
+
+  inf_test_acl_enforce_measure(
+    INF_BROWSER(directory),
+    "Granted setting at root",
+    &iter,
+    INF_ACL_CAN_EXPLORE_NODE,
+    TRUE
+  );
+
+  inf_test_acl_enforce_assert_clients(
+    clients,
+    test->n_clients,
+    test->depth - 1,
+    TRUE,
+    TRUE
+  );
+
+  /* Changes that revoke an enforced permission */
+  inf_test_acl_enforce_get_deep_node(
+    INF_BROWSER(directory),
+    test->depth - 1,
+    &iter
+  );
+
+  inf_test_acl_enforce_measure(
+    INF_BROWSER(directory),
+    "Revoked exploration at deep node",
+    &iter,
+    INF_ACL_CAN_EXPLORE_NODE,
+    FALSE
+  );
+
+  inf_test_acl_enforce_assert_clients(
+    clients,
+    test->n_clients,
+    test->depth - 1,
+    FALSE,
+    TRUE
+  );
+
+  inf_test_acl_enforce_get_deep_node(INF_BROWSER(directory), 1, &iter);
+  inf_test_acl_enforce_measure(
+    INF_BROWSER(directory),
+    "Revoked subscription below root",
+    &iter,
+    INF_ACL_CAN_SUBSCRIBE_SESSION,
+    FALSE
+  );
+
+  inf_test_acl_enforce_assert_clients(
+    clients,
+    test->n_clients,
+    1,
+    TRUE,
+    FALSE
+  );
+
+  inf_browser_get_root(INF_BROWSER(directory), &iter);
+  inf_test_acl_enforce_measure(
+    INF_BROWSER(directory),
+    "Revoked exploration at root",
+    &iter,
+    INF_ACL_CAN_EXPLORE_NODE,
+    FALSE
+  );
+
+  inf_test_acl_enforce_assert_clients(
+    clients,
+    test->n_clients,
+    0,
+    FALSE,
+    FALSE
+  );
+
+  for(i = 0; i < test->n_clients; ++i)
+  {
+    g_object_unref(clients[i].browser);
+    g_object_unref(clients[i].manager);
+    g_object_unref(clients[i].client_connection);
+    g_object_unref(clients[i].server_connection);
+  }
+
+  g_free(clients);
+  g_object_unref(directory);
+  g_object_unref(manager);
+  g_object_unref(storage);
+  g_object_unref(io);
+  return TRUE;
+}
+
+int main(int argc, char* argv[])
+{
+  InfTestAclEnforce test;
+
+  test.depth = INF_TEST_ACL_ENFORCE_DEFAULT_DEPTH;
+  test.fanout = INF_TEST_ACL_ENFORCE_DEFAULT_FANOUT;
+  test.n_clients = INF_TEST_ACL_ENFORCE_DEFAULT_CLIENTS;
+
+  if(argc > 1) test.depth = strtoul(argv[1], NULL, 10);
+  if(argc > 2) test.fanout = strtoul(argv[2], NULL, 10);
+  if(argc > 3) test.n_clients = strtoul(argv[3], NULL, 10);
+
+  /* The note goes into the first subdirectory of the root node, and
+   * exploration is revoked at a node further down. */
+  if(test.depth < 3 || test.fanout == 0 || test.n_clients == 0)
+  {
+    fprintf(stderr, "Usage: %s [depth] [fanout] [clients]\n", argv[0]);
+    return -1;
+  }
+
+  return inf_test_util_run_in_tmpdir(
+    "inf-test-acl-enforce",
+    inf_test_acl_enforce_main,
+    &test
+  );
+}
+
+/* vim:set et sw=2 ts=2: */
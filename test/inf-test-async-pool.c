@@ -0,0 +1,243 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Occupies all threads of the default InfAsyncOperation pool with
+ * operations that block, like slow writes to a disk, and checks that an
+ * operation on the handshake pool still runs and finishes before any of
+ * them. */
+
+#include <libinfinity/common/inf-async-operation.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+
+/* Number of blocking operations on the default pool */
+#define INF_TEST_ASYNC_POOL_N_BLOCKED 4
+/* Time after which the test fails, in milliseconds */
+#define INF_TEST_ASYNC_POOL_TIMEOUT 10000
+
+typedef struct _InfTestAsyncPool InfTestAsyncPool;
+struct _InfTestAsyncPool {
+  InfStandaloneIo* io;
+
+  GMutex mutex;
+  GCond cond;
+  gboolean released;
+
+  guint n_blocked_done;
+  gboolean handshake_done;
+  gboolean handshake_first;
+  gboolean timed_out;
+};
+
+static void
+inf_test_async_pool_release(InfTestAsyncPool* test)
+{
+  g_mutex_lock(&test->mutex);
+  test->released = TRUE;
+  g_cond_broadcast(&test->cond);
+  g_mutex_unlock(&test->mutex);
+}
+
+static void
+inf_test_async_pool_blocked_run_func(gpointer* run_data,
+                                     GDestroyNotify* run_notify,
+                                     gpointer user_data)
+{
+  InfTestAsyncPool* test;
+  test = (InfTestAsyncPool*)user_data;
+
+  g_mutex_lock(&test->mutex);
+  while(test->released == FALSE)
+    g_cond_wait(&test->cond, &test->mutex);
+  g_mutex_unlock(&test->mutex);
+}
+
+static void
+inf_test_async_pool_blocked_done_func(gpointer run_data,
+                                      gpointer user_data)
+{
+  InfTestAsyncPool* test;
+  test = (InfTestAsyncPool*)user_data;
+
+  ++test->n_blocked_done;
+  if(test->n_blocked_done == INF_TEST_ASYNC_POOL_N_BLOCKED &&
+     test->handshake_done == TRUE)
+  {
+    inf_standalone_io_loop_quit(test->io);
+  }
+}
+
+static void
+inf_test_async_pool_handshake_run_func(gpointer* run_data,
+                                       GDestroyNotify* run_notify,
+                                       gpointer user_data)
+{
+}
+
+static void
+inf_test_async_pool_handshake_done_func(gpointer run_data,
+                                        gpointer user_data)
+{
+  InfTestAsyncPool* test;
+  test = (InfTestAsyncPool*)user_data;
+
+  test->handshake_done = TRUE;
+  test->handshake_first = (test->n_blocked_done == 0);
+
+  /* Let the blocked operations finish now */
+  inf_test_async_pool_release(test);
+}
+
+static void
+inf_test_async_pool_timeout_func(gpointer user_data)
+{
+  InfTestAsyncPool* test;
+  test = (InfTestAsyncPool*)user_data;
+
+  test->timed_out = TRUE;
+  inf_standalone_io_loop_quit(test->io);
+}
+
+static InfAsyncOperation*
+inf_test_async_pool_start(InfTestAsyncPool* test,
+                          InfAsyncOperationPool pool,
+                          InfAsyncOperationRunFunc run_func,
+                          InfAsyncOperationDoneFunc done_func)
+{
+  InfAsyncOperation* op;
+  GError* error;
+
+  op = inf_async_operation_new(INF_IO(test->io), run_func, done_func, test);
+  inf_async_operation_set_pool(op, pool);
+
+  error = NULL;
+  if(!inf_async_operation_start(op, &error))
+  {
+    fprintf(stderr, "Failed to start operation: %s\n", error->message);
+    g_error_free(error);
+    return NULL;
+  }
+
+  return op;
+}
+
+int main(int argc, char* argv[])
+{
+  InfTestAsyncPool test;
+  InfIoTimeout* timeout;
+  GError* error;
+  guint i;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  test.io = inf_standalone_io_new();
+  g_mutex_init(&test.mutex);
+  g_cond_init(&test.cond);
+  test.released = FALSE;
+  test.n_blocked_done = 0;
+  test.handshake_done = FALSE;
+  test.handshake_first = FALSE;
+  test.timed_out = FALSE;
+
+  /* The default pool is smaller than the number of blocking operations, so
+   * that some of them are queued behind the others. */
+  inf_async_operation_set_max_threads(INF_ASYNC_OPERATION_POOL_DEFAULT, 2);
+  inf_async_operation_set_max_threads(INF_ASYNC_OPERATION_POOL_HANDSHAKE, 1);
+
+  g_assert(
+    inf_async_operation_get_max_threads(INF_ASYNC_OPERATION_POOL_DEFAULT) == 2
+  );
+
+  g_assert(
+    inf_async_operation_get_max_threads(
+      INF_ASYNC_OPERATION_POOL_HANDSHAKE
+    ) == 1
+  );
+
+  for(i = 0; i < INF_TEST_ASYNC_POOL_N_BLOCKED; ++i)
+  {
+    if(inf_test_async_pool_start(
+         &test,
+         INF_ASYNC_OPERATION_POOL_DEFAULT,
+         inf_test_async_pool_blocked_run_func,
+         inf_test_async_pool_blocked_done_func) == NULL)
+    {
+      return -1;
+    }
+  }
+
+  if(inf_test_async_pool_start(
+       &test,
+       INF_ASYNC_OPERATION_POOL_HANDSHAKE,
+       inf_test_async_pool_handshake_run_func,
+       inf_test_async_pool_handshake_done_func) == NULL)
+  {
+    return -1;
+  }
+
+  timeout = inf_io_add_timeout(
+    INF_IO(test.io),
+    INF_TEST_ASYNC_POOL_TIMEOUT,
+    inf_test_async_pool_timeout_func,
+    &test,
+    NULL
+  );
+
+  inf_standalone_io_loop(test.io);
+
+  if(test.timed_out == TRUE)
+  {
+    /* The operations might still be running, so we cannot clean up */
+    fprintf(
+      stderr,
+      "Timed out: handshake operation %s, %u of %u blocked operations "
+      "finished\n",
+      test.handshake_done ? "finished" : "did not finish",
+      test.n_blocked_done,
+      INF_TEST_ASYNC_POOL_N_BLOCKED
+    );
+
+    return -1;
+  }
+
+  inf_io_remove_timeout(INF_IO(test.io), timeout);
+
+  printf(
+    "Handshake operation finished %s the blocked operations\n",
+    test.handshake_first ? "before" : "after"
+  );
+
+  g_assert(test.handshake_first == TRUE);
+  g_assert(test.n_blocked_done == INF_TEST_ASYNC_POOL_N_BLOCKED);
+
+  g_cond_clear(&test.cond);
+  g_mutex_clear(&test.mutex);
+  g_object_unref(test.io);
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -29,6 +29,9 @@
 
 #include <string.h>
 
+/* zlib level with which to compress connections to servers offering it */
+#define INF_TEST_BROWSER_COMPRESSION_LEVEL 6
+
 typedef struct _InfTestBrowser InfTestBrowser;
 struct _InfTestBrowser {
   InfStandaloneIo* io;
@@ -362,6 +365,12 @@ main(int argc, char* argv[])
       NULL
     );
 
+    g_object_set(
+      G_OBJECT(test.conn),
+      "compression-level", INF_TEST_BROWSER_COMPRESSION_LEVEL,
+      NULL
+    );
+
     g_object_unref(G_OBJECT(tcp_conn));
 
     manager = inf_communication_manager_new();
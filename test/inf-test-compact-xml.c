@@ -0,0 +1,358 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Replays a record, and then produces the messages that broadcast the
+ * requests of the resulting session, in the same way InfAdoptedSession
+ * does it. Each message is serialized and parsed again both as XML text and
+ * in its compact binary form. It checks that the compact form decodes to the
+ * same message, and prints the time and the number of bytes per request for
+ * both forms. */
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinfinity/adopted/inf-adopted-session-replay.h>
+#include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <libxml/parser.h>
+
+#include <string.h>
+
+/* Number of times each message is serialized and parsed, to get
+ * measurable times */
+#define INF_TEST_COMPACT_XML_ROUNDS 20
+
+typedef struct _InfTestCompactXmlStats InfTestCompactXmlStats;
+struct _InfTestCompactXmlStats {
+  guint n_requests;
+
+  gsize xml_bytes;
+  gint64 xml_serialize_time;
+  gint64 xml_parse_time;
+
+  gsize compact_bytes;
+  gint64 compact_serialize_time;
+  gint64 compact_parse_time;
+};
+
+typedef struct _InfTestCompactXmlForeachData InfTestCompactXmlForeachData;
+struct _InfTestCompactXmlForeachData {
+  InfAdoptedSession* session;
+  GPtrArray* messages;
+};
+
+static InfSession*
+inf_test_compact_xml_session_new(InfIo* io,
+                                 InfCommunicationManager* manager,
+                                 InfSessionStatus status,
+                                 InfCommunicationGroup* sync_group,
+                                 InfXmlConnection* sync_connection,
+                                 const gchar* path,
+                                 gpointer user_data)
+{
+  InfTextDefaultBuffer* buffer;
+  InfTextSession* session;
+
+  buffer = inf_text_default_buffer_new("UTF-8");
+  session = inf_text_session_new(
+    manager,
+    INF_TEXT_BUFFER(buffer),
+    io,
+    status,
+    sync_group,
+    sync_connection
+  );
+  g_object_unref(buffer);
+
+  return INF_SESSION(session);
+}
+
+static const InfcNotePlugin INF_TEST_COMPACT_XML_TEXT_PLUGIN = {
+  NULL, "InfText", inf_test_compact_xml_session_new
+};
+
+/* Creates the messages for all requests in the log of user, each time
+ * relative to the user's previous request, as for broadcasting them. */
+static void
+inf_test_compact_xml_foreach_user_func(InfUser* user,
+                                       gpointer user_data)
+{
+  InfTestCompactXmlForeachData* data;
+  InfAdoptedSessionClass* session_class;
+  InfAdoptedRequestLog* log;
+  InfAdoptedRequest* request;
+  InfAdoptedStateVector* previous;
+  xmlNodePtr container;
+  xmlNodePtr xml;
+  guint i;
+
+  data = (InfTestCompactXmlForeachData*)user_data;
+  session_class = INF_ADOPTED_SESSION_GET_CLASS(data->session);
+  log = inf_adopted_user_get_request_log(INF_ADOPTED_USER(user));
+  previous = NULL;
+
+  for(i = inf_adopted_request_log_get_begin(log);
+      i < inf_adopted_request_log_get_end(log);
+      ++i)
+  {
+    request = inf_adopted_request_log_get_request(log, i);
+
+    container = xmlNewNode(NULL, (const xmlChar*)"group");
+    inf_xml_util_set_attribute(container, "publisher", "me");
+    inf_xml_util_set_attribute(container, "name", "InfSession_1");
+
+    xml = xmlNewChild(container, NULL, (const xmlChar*)"request", NULL);
+    session_class->request_to_xml(
+      data->session,
+      xml,
+      request,
+      previous,
+      FALSE
+    );
+    g_ptr_array_add(data->messages, container);
+
+    previous = inf_adopted_request_get_vector(request);
+  }
+}
+
+static gboolean
+inf_test_compact_xml_run(InfAdoptedSession* session,
+                         InfTestCompactXmlStats* stats,
+                         GError** error)
+{
+  InfTestCompactXmlForeachData data;
+  GBytes* bytes;
+  GBytes* decoded_bytes;
+  GByteArray* array;
+  xmlDocPtr doc;
+  xmlNodePtr decoded;
+  gint64 start;
+  guint i;
+  guint j;
+  gboolean result;
+
+  data.session = session;
+  data.messages = g_ptr_array_new_with_free_func((GDestroyNotify)xmlFreeNode);
+
+  inf_user_table_foreach_user(
+    inf_session_get_user_table(INF_SESSION(session)),
+    inf_test_compact_xml_foreach_user_func,
+    &data
+  );
+
+  array = g_byte_array_new();
+  result = TRUE;
+
+  for(i = 0; i < data.messages->len && result == TRUE; ++i)
+  {
+    bytes = NULL;
+    start = g_get_monotonic_time();
+    for(j = 0; j < INF_TEST_COMPACT_XML_ROUNDS; ++j)
+    {
+      if(bytes != NULL) g_bytes_unref(bytes);
+      bytes = inf_xml_util_node_to_bytes(data.messages->pdata[i]);
+    }
+    stats->xml_serialize_time += g_get_monotonic_time() - start;
+    stats->xml_bytes += g_bytes_get_size(bytes);
+
+    start = g_get_monotonic_time();
+    for(j = 0; j < INF_TEST_COMPACT_XML_ROUNDS; ++j)
+    {
+      doc = xmlReadMemory(
+        g_bytes_get_data(bytes, NULL),
+        g_bytes_get_size(bytes),
+        NULL,
+        "UTF-8",
+        XML_PARSE_NONET
+      );
+
+      g_assert(doc != NULL);
+      xmlFreeDoc(doc);
+    }
+    stats->xml_parse_time += g_get_monotonic_time() - start;
+
+    start = g_get_monotonic_time();
+    for(j = 0; j < INF_TEST_COMPACT_XML_ROUNDS; ++j)
+    {
+      g_byte_array_set_size(array, 0);
+      if(!inf_xml_util_node_to_compact(data.messages->pdata[i], array))
+      {
+        g_set_error(
+          error,
+          g_quark_from_static_string("INF_TEST_COMPACT_XML_ERROR"),
+          0,
+          "Request %u has no compact form: %.*s",
+          i,
+          (int)g_bytes_get_size(bytes),
+          (const gchar*)g_bytes_get_data(bytes, NULL)
+        );
+
+        result = FALSE;
+        break;
+      }
+    }
+    stats->compact_serialize_time += g_get_monotonic_time() - start;
+    stats->compact_bytes += array->len;
+
+    decoded = NULL;
+    start = g_get_monotonic_time();
+    for(j = 0; j < INF_TEST_COMPACT_XML_ROUNDS && result == TRUE; ++j)
+    {
+      if(decoded != NULL) xmlFreeNode(decoded);
+      decoded = inf_xml_util_node_from_compact(array->data, array->len, error);
+      if(decoded == NULL) result = FALSE;
+    }
+    stats->compact_parse_time += g_get_monotonic_time() - start;
+
+    if(decoded != NULL)
+    {
+      /* The decoded message must serialize to the same XML text */
+      decoded_bytes = inf_xml_util_node_to_bytes(decoded);
+      if(!g_bytes_equal(bytes, decoded_bytes))
+      {
+        g_set_error(
+          error,
+          g_quark_from_static_string("INF_TEST_COMPACT_XML_ERROR"),
+          0,
+          "Request %u decodes to %.*s",
+          i,
+          (int)g_bytes_get_size(decoded_bytes),
+          (const gchar*)g_bytes_get_data(decoded_bytes, NULL)
+        );
+
+        result = FALSE;
+      }
+
+      g_bytes_unref(decoded_bytes);
+      xmlFreeNode(decoded);
+    }
+
+    g_bytes_unref(bytes);
+    ++stats->n_requests;
+  }
+
+  g_byte_array_free(array, TRUE);
+  g_ptr_array_free(data.messages, TRUE);
+  return result;
+}
+
+static void
+inf_test_compact_xml_print(const gchar* title,
+                           const InfTestCompactXmlStats* stats)
+{
+  guint n;
+  n = MAX(stats->n_requests, 1);
+
+  fprintf(
+    stderr,
+    "%s: %u requests\n"
+    "  XML:     %6.1f bytes, %6.3f us serialize, %6.3f us parse per request\n"
+    "  compact: %6.1f bytes, %6.3f us serialize, %6.3f us parse per request\n",
+    title,
+    stats->n_requests,
+    (double)stats->xml_bytes / n,
+    (double)stats->xml_serialize_time / n / INF_TEST_COMPACT_XML_ROUNDS,
+    (double)stats->xml_parse_time / n / INF_TEST_COMPACT_XML_ROUNDS,
+    (double)stats->compact_bytes / n,
+    (double)stats->compact_serialize_time / n / INF_TEST_COMPACT_XML_ROUNDS,
+    (double)stats->compact_parse_time / n / INF_TEST_COMPACT_XML_ROUNDS
+  );
+}
+
+int main(int argc, char* argv[])
+{
+  InfAdoptedSessionReplay* replay;
+  InfTestCompactXmlStats stats;
+  InfTestCompactXmlStats total;
+  GError* error;
+  int i;
+  int ret;
+
+  if(argc < 2)
+  {
+    fprintf(stderr, "Usage: %s <record-file1> <record-file2> ...\n", argv[0]);
+    return -1;
+  }
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  ret = 0;
+  memset(&total, 0, sizeof(total));
+
+  for(i = 1; i < argc; ++ i)
+  {
+    replay = inf_adopted_session_replay_new();
+    inf_adopted_session_replay_set_record(
+      replay,
+      argv[i],
+      &INF_TEST_COMPACT_XML_TEXT_PLUGIN,
+      &error
+    );
+
+    if(error == NULL)
+      inf_adopted_session_replay_play_to_end(replay, &error);
+
+    if(error == NULL)
+    {
+      memset(&stats, 0, sizeof(stats));
+
+      inf_test_compact_xml_run(
+        inf_adopted_session_replay_get_session(replay),
+        &stats,
+        &error
+      );
+
+      if(error == NULL)
+      {
+        inf_test_compact_xml_print(argv[i], &stats);
+
+        g_assert(stats.compact_bytes <= stats.xml_bytes);
+        total.n_requests += stats.n_requests;
+        total.xml_bytes += stats.xml_bytes;
+        total.xml_serialize_time += stats.xml_serialize_time;
+        total.xml_parse_time += stats.xml_parse_time;
+        total.compact_bytes += stats.compact_bytes;
+        total.compact_serialize_time += stats.compact_serialize_time;
+        total.compact_parse_time += stats.compact_parse_time;
+      }
+    }
+
+    if(error != NULL)
+    {
+      fprintf(stderr, "%s: %s\n", argv[i], error->message);
+      g_error_free(error);
+      error = NULL;
+
+      ret = -1;
+    }
+
+    g_object_unref(replay);
+  }
+
+  inf_test_compact_xml_print("Total", &total);
+  return ret;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,351 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Creates a folder with many subdirectories in a temporary directory and
+ * serves it with an InfdDirectory. A client explores the folder in pages
+ * via a simulated connection, while nodes are added to and removed from the
+ * folder between the pages. It checks that the client ends up with the same
+ * children as the server, and prints how long it takes to add nodes to the
+ * big folder. */
+
+#include "util/inf-test-util.h"
+
+#include <libinfinity/server/infd-directory.h>
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/client/infc-browser.h>
+#include <libinfinity/common/inf-simulated-connection.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-file-util.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define INF_TEST_EXPLORE_PAGED_DEFAULT_CHILDREN 5000
+#define INF_TEST_EXPLORE_PAGED_DEFAULT_PAGE_SIZE 500
+
+/* Number of nodes added to the big folder to measure name lookups */
+#define INF_TEST_EXPLORE_PAGED_ADDED 200
+
+typedef struct _InfTestExplorePaged InfTestExplorePaged;
+struct _InfTestExplorePaged {
+  guint n_children;
+  guint page_size;
+
+  InfSimulatedConnection* client_connection;
+  InfSimulatedConnection* server_connection;
+  InfCommunicationManager* manager;
+  InfcBrowser* browser;
+};
+
+static void
+inf_test_explore_paged_flush(InfTestExplorePaged* test)
+{
+  inf_simulated_connection_flush(test->client_connection);
+  inf_simulated_connection_flush(test->server_connection);
+}
+
+/* Returns the names of all children of the root node of browser */
+static GHashTable*
+inf_test_explore_paged_get_names(InfBrowser* browser)
+{
+  GHashTable* names;
+  InfBrowserIter iter;
+  gboolean result;
+
+  names = g_hash_table_new(g_str_hash, g_str_equal);
+
+  inf_browser_get_root(browser, &iter);
+  for(result = inf_browser_get_child(browser, &iter);
+      result == TRUE;
+      result = inf_browser_get_next(browser, &iter))
+  {
+    g_hash_table_add(
+      names,
+      (gpointer)inf_browser_get_node_name(browser, &iter)
+    );
+  }
+
+  return names;
+}
+
+static gboolean
+inf_test_explore_paged_compare(InfBrowser* directory,
+                               InfBrowser* browser,
+                               GError** error)
+{
+  GHashTable* server_names;
+  GHashTable* client_names;
+  GHashTableIter iter;
+  gpointer name;
+  gboolean result;
+
+  server_names = inf_test_explore_paged_get_names(directory);
+  client_names = inf_test_explore_paged_get_names(browser);
+
+  result = TRUE;
+  if(g_hash_table_size(server_names) != g_hash_table_size(client_names))
+  {
+    g_set_error(
+      error,
+      g_quark_from_static_string("INF_TEST_EXPLORE_PAGED_ERROR"),
+      0,
+      "Server has %u children, but client has %u",
+      g_hash_table_size(server_names),
+      g_hash_table_size(client_names)
+    );
+
+    result = FALSE;
+  }
+
+  g_hash_table_iter_init(&iter, server_names);
+  while(result == TRUE && g_hash_table_iter_next(&iter, &name, NULL))
+  {
+    if(!g_hash_table_contains(client_names, name))
+    {
+      g_set_error(
+        error,
+        g_quark_from_static_string("INF_TEST_EXPLORE_PAGED_ERROR"),
+        0,
+        "Client does not know about node \"%s\"",
+        (const gchar*)name
+      );
+
+      result = FALSE;
+    }
+  }
+
+  g_hash_table_destroy(server_names);
+  g_hash_table_destroy(client_names);
+  return result;
+}
+
+static gboolean
+inf_test_explore_paged_run(InfTestExplorePaged* test,
+                           InfBrowser* directory,
+                           GError** error)
+{
+  InfBrowserIter root;
+  InfBrowserIter iter;
+  InfBrowserIter last;
+  InfBrowserStatus status;
+  guint n_pages;
+  guint i;
+
+  /* Wait for the welcome message */
+  for(i = 0; i < 10; ++i)
+  {
+    g_object_get(G_OBJECT(test->browser), "status", &status, NULL);
+    if(status == INF_BROWSER_OPEN) break;
+    inf_test_explore_paged_flush(test);
+  }
+
+  g_assert(status == INF_BROWSER_OPEN);
+
+  inf_browser_get_root(INF_BROWSER(test->browser), &root);
+  inf_browser_explore(INF_BROWSER(test->browser), &root, NULL, NULL);
+
+  n_pages = 0;
+  while(inf_browser_get_pending_request(
+          INF_BROWSER(test->browser),
+          &root,
+          "explore-node") != NULL)
+  {
+    inf_test_explore_paged_flush(test);
+    ++n_pages;
+
+    if(n_pages == 1)
+    {
+      /* Remove the oldest child, which has not been sent yet, and add a new
+       * one while the exploration is in progress. */
+      inf_browser_get_root(directory, &iter);
+      if(inf_browser_get_child(directory, &iter))
+      {
+        last = iter;
+        while(inf_browser_get_next(directory, &iter))
+          last = iter;
+
+        inf_browser_remove_node(directory, &last, NULL, NULL);
+      }
+
+      inf_browser_get_root(directory, &iter);
+      inf_browser_add_subdirectory(directory, &iter, "new", NULL, NULL, NULL);
+    }
+  }
+
+  printf("Explored in %u pages\n", n_pages);
+  return inf_test_explore_paged_compare(
+    directory,
+    INF_BROWSER(test->browser),
+    error
+  );
+}
+
+static void
+inf_test_explore_paged_measure_add(InfBrowser* directory)
+{
+  InfBrowserIter iter;
+  gchar* name;
+  gint64 start;
+  gint64 end;
+  guint i;
+
+  inf_browser_get_root(directory, &iter);
+
+  start = g_get_monotonic_time();
+  for(i = 0; i < INF_TEST_EXPLORE_PAGED_ADDED; ++i)
+  {
+    name = g_strdup_printf("added%u", i);
+    inf_browser_add_subdirectory(directory, &iter, name, NULL, NULL, NULL);
+    g_free(name);
+  }
+  end = g_get_monotonic_time();
+
+  printf(
+    "Added %u nodes in %.3f ms\n",
+    INF_TEST_EXPLORE_PAGED_ADDED,
+    (end - start) / 1e3
+  );
+}
+
+static gboolean
+inf_test_explore_paged_main(const gchar* path,
+                            gpointer user_data,
+                            GError** error)
+{
+  InfTestExplorePaged* test;
+  InfStandaloneIo* io;
+  InfdFilesystemStorage* storage;
+  InfCommunicationManager* manager;
+  InfdDirectory* directory;
+  gchar* child_path;
+  gchar* name;
+  gboolean result;
+  guint i;
+
+  test = (InfTestExplorePaged*)user_data;
+
+  result = TRUE;
+  for(i = 0; i < test->n_children && result == TRUE; ++i)
+  {
+    name = g_strdup_printf("n%u", i);
+    child_path = g_build_filename(path, name, NULL);
+    g_free(name);
+
+    result = inf_file_util_create_single_directory(child_path, 0755, error);
+    g_free(child_path);
+  }
+
+  if(result == FALSE)
+    return FALSE;
+
+  io = inf_standalone_io_new();
+  storage = infd_filesystem_storage_new(path);
+  manager = inf_communication_manager_new();
+
+  directory = infd_directory_new(
+    INF_IO(io),
+    INFD_STORAGE(storage),
+    manager
+  );
+
+  test->client_connection = inf_simulated_connection_new_with_io(INF_IO(io));
+  test->server_connection = inf_simulated_connection_new_with_io(INF_IO(io));
+
+  inf_simulated_connection_set_mode(
+    test->client_connection,
+    INF_SIMULATED_CONNECTION_DELAYED
+  );
+
+  inf_simulated_connection_set_mode(
+    test->server_connection,
+    INF_SIMULATED_CONNECTION_DELAYED
+  );
+
+  inf_simulated_connection_connect(
+    test->client_connection,
+    test->server_connection
+  );
+
+  test->manager = inf_communication_manager_new();
+  test->browser = infc_browser_new(
+    INF_IO(io),
+    test->manager,
+    INF_XML_CONNECTION(test->client_connection)
+  );
+
+  g_object_set(
+    G_OBJECT(test->browser),
+    "explore-page-size", test->page_size,
+    NULL
+  );
+
+  infd_directory_add_connection(
+    directory,
+    INF_XML_CONNECTION(test->server_connection)
+  );
+
+  result = inf_test_explore_paged_run(test, INF_BROWSER(directory), error);
+  if(result == TRUE)
+  {
+    inf_test_explore_paged_measure_add(INF_BROWSER(directory));
+    inf_test_explore_paged_flush(test);
+
+    result = inf_test_explore_paged_compare(
+      INF_BROWSER(directory),
+      INF_BROWSER(test->browser),
+      error
+    );
+  }
+
+  g_object_unref(test->browser);
+  g_object_unref(test->manager);
+  g_object_unref(test->client_connection);
+  g_object_unref(test->server_connection);
+
+  g_object_unref(directory);
+  g_object_unref(manager);
+  g_object_unref(storage);
+  g_object_unref(io);
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  InfTestExplorePaged test;
+
+  test.n_children = INF_TEST_EXPLORE_PAGED_DEFAULT_CHILDREN;
+  test.page_size = INF_TEST_EXPLORE_PAGED_DEFAULT_PAGE_SIZE;
+
+  if(argc > 1) test.n_children = strtoul(argv[1], NULL, 10);
+  if(argc > 2) test.page_size = strtoul(argv[2], NULL, 10);
+
+  if(test.n_children == 0)
+  {
+    fprintf(stderr, "Usage: %s [children] [page-size]\n", argv[0]);
+    return -1;
+  }
+
+  return inf_test_util_run_in_tmpdir(
+    "inf-test-explore-paged",
+    inf_test_explore_paged_main,
+    &test
+  );
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -37,6 +37,9 @@
 
 #include <gtk/gtk.h>
 
+/* zlib level with which to compress connections to servers offering it */
+#define INF_TEST_GTK_BROWSER_COMPRESSION_LEVEL 6
+
 typedef struct _InfTestGtkBrowserWindow InfTestGtkBrowserWindow;
 struct _InfTestGtkBrowserWindow {
   GtkWidget* textview;
@@ -891,6 +894,12 @@ main(int argc,
   xmpp_manager = inf_xmpp_manager_new();
   avahi = inf_discovery_avahi_new(INF_IO(io), xmpp_manager, NULL, NULL, NULL);
   g_object_unref(G_OBJECT(xmpp_manager));
+
+  g_object_set(
+    G_OBJECT(avahi),
+    "compression-level", INF_TEST_GTK_BROWSER_COMPRESSION_LEVEL,
+    NULL
+  );
 #endif
 
   communication_manager = inf_communication_manager_new();
@@ -925,6 +934,12 @@ main(int argc,
       NULL
     );
 
+    g_object_set(
+      G_OBJECT(xmpp),
+      "compression-level", INF_TEST_GTK_BROWSER_COMPRESSION_LEVEL,
+      NULL
+    );
+
     inf_ip_address_free(addr);
     g_object_unref(tcp);
 
@@ -0,0 +1,593 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Creates a number of text notes in an InfdDirectory with a memory budget
+ * that only fits a few of them, and checks that the least recently used
+ * notes are saved and unloaded, so that the estimated memory usage stays
+ * within the budget. Then it subscribes to an unloaded note again, and
+ * checks that its content has been preserved. Finally, it joins a local
+ * user into every loaded note and lowers the budget, so that sessions in
+ * use need to be closed to stay within it. */
+
+#include "util/inf-test-util.h"
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-filesystem-format.h>
+
+#include <libinfinity/server/infd-directory.h>
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/common/inf-standalone-io.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INF_TEST_MEMORY_BUDGET_DEFAULT_NOTES 50
+#define INF_TEST_MEMORY_BUDGET_DEFAULT_RESIDENT 5
+
+/* Number of bytes of text in each note */
+#define INF_TEST_MEMORY_BUDGET_NOTE_SIZE 100000
+
+static InfSession*
+inf_test_memory_budget_session_new(InfIo* io,
+                                   InfCommunicationManager* manager,
+                                   InfSessionStatus status,
+                                   InfCommunicationGroup* sync_group,
+                                   InfXmlConnection* sync_connection,
+                                   const gchar* path,
+                                   gpointer user_data)
+{
+  InfTextSession* session;
+  InfTextBuffer* buffer;
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  session = inf_text_session_new(
+    manager,
+    buffer,
+    io,
+    status,
+    sync_group,
+    sync_connection
+  );
+
+  g_object_unref(buffer);
+  return INF_SESSION(session);
+}
+
+static InfSession*
+inf_test_memory_budget_session_read(InfdStorage* storage,
+                                    InfIo* io,
+                                    InfCommunicationManager* manager,
+                                    const gchar* path,
+                                    gpointer user_data,
+                                    GError** error)
+{
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfTextSession* session;
+
+  user_table = inf_user_table_new();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  if(!inf_text_filesystem_format_read(
+       INFD_FILESYSTEM_STORAGE(storage),
+       path,
+       user_table,
+       buffer,
+       error))
+  {
+    g_object_unref(user_table);
+    g_object_unref(buffer);
+    return NULL;
+  }
+
+  session = inf_text_session_new_with_user_table(
+    manager,
+    buffer,
+    io,
+    user_table,
+    INF_SESSION_RUNNING,
+    NULL,
+    NULL
+  );
+
+  g_object_unref(user_table);
+  g_object_unref(buffer);
+  return INF_SESSION(session);
+}
+
+static gboolean
+inf_test_memory_budget_session_write(InfdStorage* storage,
+                                     InfSession* session,
+                                     const gchar* path,
+                                     gpointer user_data,
+                                     GError** error)
+{
+  return inf_text_filesystem_format_write(
+    INFD_FILESYSTEM_STORAGE(storage),
+    path,
+    inf_session_get_user_table(session),
+    INF_TEXT_BUFFER(inf_session_get_buffer(session)),
+    error
+  );
+}
+
+static gsize
+inf_test_memory_budget_session_size(InfSession* session,
+                                    gpointer user_data)
+{
+  InfTextBuffer* buffer;
+  InfTextBufferIter* iter;
+  gsize size;
+
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
+  size = 0;
+
+  iter = inf_text_buffer_create_begin_iter(buffer);
+  if(iter != NULL)
+  {
+    do
+    {
+      size += inf_text_buffer_iter_get_bytes(buffer, iter);
+    } while(inf_text_buffer_iter_next(buffer, iter));
+
+    inf_text_buffer_destroy_iter(buffer, iter);
+  }
+
+  return size;
+}
+
+static const InfdNotePlugin INF_TEST_MEMORY_BUDGET_PLUGIN = {
+  NULL,
+  "InfdFilesystemStorage",
+  "InfText",
+  inf_test_memory_budget_session_new,
+  inf_test_memory_budget_session_read,
+  inf_test_memory_budget_session_write,
+  inf_test_memory_budget_session_size
+};
+
+static guint
+inf_test_memory_budget_get_length(InfBrowser* browser,
+                                  const InfBrowserIter* iter)
+{
+  InfSessionProxy* proxy;
+  InfSession* session;
+  guint length;
+
+  proxy = inf_browser_get_session(browser, iter);
+  g_assert(proxy != NULL);
+
+  g_object_get(G_OBJECT(proxy), "session", &session, NULL);
+  length = inf_text_buffer_get_length(
+    INF_TEXT_BUFFER(inf_session_get_buffer(session))
+  );
+
+  g_object_unref(session);
+  return length;
+}
+
+/* Joins a local user into the session of proxy, so that it is in use */
+static void
+inf_test_memory_budget_join(InfSessionProxy* proxy)
+{
+  InfSession* session;
+  InfAdoptedAlgorithm* algorithm;
+  GParameter params[3] = {
+    { "name", { 0 } },
+    { "vector", { 0 } },
+    { "caret-position", { 0 } }
+  };
+
+  g_object_get(G_OBJECT(proxy), "session", &session, NULL);
+  algorithm = inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session));
+
+  g_value_init(&params[0].value, G_TYPE_STRING);
+  g_value_set_static_string(&params[0].value, "test");
+
+  g_value_init(&params[1].value, INF_ADOPTED_TYPE_STATE_VECTOR);
+  g_value_take_boxed(
+    &params[1].value,
+    inf_adopted_state_vector_copy(
+      inf_adopted_algorithm_get_current(algorithm)
+    )
+  );
+
+  g_value_init(&params[2].value, G_TYPE_UINT);
+  g_value_set_uint(&params[2].value, 0);
+
+  inf_session_proxy_join_user(proxy, 3, params, NULL, NULL);
+
+  g_value_unset(&params[0].value);
+  g_value_unset(&params[1].value);
+  g_value_unset(&params[2].value);
+
+  g_object_unref(session);
+}
+
+/* Puts every loaded note in use and lowers the budget to a single note.
+ * No session is evicted until sessions in use may be evicted, and then all
+ * but one of the sessions need to be saved and closed. */
+static gboolean
+inf_test_memory_budget_run_in_use(InfStandaloneIo* io,
+                                  InfdDirectory* directory,
+                                  InfBrowserIter* iters,
+                                  guint n_notes,
+                                  GError** error)
+{
+  InfSessionProxy** proxies;
+  InfSession* session;
+  guint64 usage;
+  guint n_evictions_before;
+  guint n_evictions;
+  guint n_loaded;
+  guint n_closed;
+  guint i;
+
+  /* Runs the memory check scheduled by the last subscription */
+  inf_standalone_io_iteration_timeout(io, 0);
+
+  g_object_get(
+    G_OBJECT(directory),
+    "evictions", &n_evictions_before,
+    NULL
+  );
+
+  proxies = g_new0(InfSessionProxy*, n_notes);
+  n_loaded = 0;
+
+  for(i = 0; i < n_notes; ++i)
+  {
+    proxies[i] = inf_browser_get_session(INF_BROWSER(directory), &iters[i]);
+    if(proxies[i] != NULL)
+    {
+      g_object_ref(proxies[i]);
+      inf_test_memory_budget_join(proxies[i]);
+      g_assert(!infd_session_proxy_is_idle(INFD_SESSION_PROXY(proxies[i])));
+      ++n_loaded;
+    }
+  }
+
+  g_object_set(
+    G_OBJECT(directory),
+    "memory-budget",
+    (guint64)INF_TEST_MEMORY_BUDGET_NOTE_SIZE,
+    NULL
+  );
+
+  inf_standalone_io_iteration_timeout(io, 0);
+
+  g_object_get(G_OBJECT(directory), "evictions", &n_evictions, NULL);
+  g_assert(n_evictions == n_evictions_before);
+
+  for(i = 0; i < n_notes; ++i)
+  {
+    if(proxies[i] != NULL)
+    {
+      g_assert(
+        inf_browser_get_session(INF_BROWSER(directory), &iters[i]) ==
+        proxies[i]
+      );
+    }
+  }
+
+  g_object_set(G_OBJECT(directory), "evict-sessions-in-use", TRUE, NULL);
+  inf_standalone_io_iteration_timeout(io, 0);
+
+  g_object_get(
+    G_OBJECT(directory),
+    "memory-usage", &usage,
+    "evictions", &n_evictions,
+    NULL
+  );
+
+  n_closed = 0;
+  for(i = 0; i < n_notes; ++i)
+  {
+    if(proxies[i] != NULL)
+    {
+      g_object_get(G_OBJECT(proxies[i]), "session", &session, NULL);
+      if(inf_session_get_status(session) == INF_SESSION_CLOSED)
+      {
+        /* The closed session is not linked anymore */
+        g_assert(
+          inf_browser_get_session(INF_BROWSER(directory), &iters[i]) == NULL
+        );
+
+        ++n_closed;
+      }
+
+      g_object_unref(session);
+      g_object_unref(proxies[i]);
+    }
+  }
+
+  g_free(proxies);
+
+  printf(
+    "%u notes in use, %u closed, %" G_GUINT64_FORMAT " bytes in use\n",
+    n_loaded,
+    n_closed,
+    usage
+  );
+
+  if(usage > INF_TEST_MEMORY_BUDGET_NOTE_SIZE)
+  {
+    g_set_error(
+      error,
+      g_quark_from_static_string("INF_TEST_MEMORY_BUDGET_ERROR"),
+      0,
+      "Sessions in use take %" G_GUINT64_FORMAT " bytes, exceeding the "
+      "budget",
+      usage
+    );
+
+    return FALSE;
+  }
+
+  g_assert(n_closed == n_loaded - 1);
+  g_assert(n_evictions == n_evictions_before + n_closed);
+
+  /* The content of a closed session has been saved */
+  for(i = 0; i < n_notes; ++i)
+  {
+    if(inf_browser_get_session(INF_BROWSER(directory), &iters[i]) == NULL)
+    {
+      inf_browser_subscribe(INF_BROWSER(directory), &iters[i], NULL, NULL);
+      g_assert(
+        inf_test_memory_budget_get_length(INF_BROWSER(directory), &iters[i]) ==
+        INF_TEST_MEMORY_BUDGET_NOTE_SIZE
+      );
+
+      break;
+    }
+  }
+
+  return TRUE;
+}
+
+static gboolean
+inf_test_memory_budget_run(InfStandaloneIo* io,
+                           InfdDirectory* directory,
+                           guint n_notes,
+                           guint n_resident,
+                           GError** error)
+{
+  InfBrowserIter root;
+  InfBrowserIter* iters;
+  InfSessionProxy* proxy;
+  InfSession* session;
+  gchar* text;
+  gchar* name;
+  guint64 usage;
+  guint64 evicted_bytes;
+  guint n_evictions;
+  gint64 start;
+  gint64 end;
+  gboolean result;
+  guint i;
+
+  text = g_malloc(INF_TEST_MEMORY_BUDGET_NOTE_SIZE);
+  memset(text, 'a', INF_TEST_MEMORY_BUDGET_NOTE_SIZE);
+
+  g_object_set(
+    G_OBJECT(directory),
+    "memory-budget",
+    (guint64)n_resident * INF_TEST_MEMORY_BUDGET_NOTE_SIZE,
+    NULL
+  );
+
+  iters = g_new(InfBrowserIter, n_notes);
+  inf_browser_get_root(INF_BROWSER(directory), &root);
+  inf_browser_explore(INF_BROWSER(directory), &root, NULL, NULL);
+
+  start = g_get_monotonic_time();
+  for(i = 0; i < n_notes; ++i)
+  {
+    name = g_strdup_printf("note%u", i);
+    inf_browser_add_note(
+      INF_BROWSER(directory),
+      &root,
+      name,
+      "InfText",
+      NULL,
+      NULL,
+      TRUE,
+      NULL,
+      NULL
+    );
+
+    g_free(name);
+
+    /* New nodes are inserted at the beginning of the folder */
+    iters[i] = root;
+    result = inf_browser_get_child(INF_BROWSER(directory), &iters[i]);
+    g_assert(result == TRUE);
+
+    proxy = inf_browser_get_session(INF_BROWSER(directory), &iters[i]);
+    g_assert(proxy != NULL);
+
+    g_object_get(G_OBJECT(proxy), "session", &session, NULL);
+    inf_text_buffer_insert_text(
+      INF_TEXT_BUFFER(inf_session_get_buffer(session)),
+      0,
+      text,
+      INF_TEST_MEMORY_BUDGET_NOTE_SIZE,
+      INF_TEST_MEMORY_BUDGET_NOTE_SIZE,
+      NULL
+    );
+
+    g_object_unref(session);
+
+    /* Runs the memory check scheduled by linking the session, which now
+     * takes the text of the new note into account. */
+    inf_standalone_io_iteration_timeout(io, 0);
+  }
+
+  end = g_get_monotonic_time();
+
+  g_free(text);
+
+  g_object_get(
+    G_OBJECT(directory),
+    "memory-usage", &usage,
+    "evictions", &n_evictions,
+    "evicted-bytes", &evicted_bytes,
+    NULL
+  );
+
+  printf(
+    "%u notes in %.3f ms, %u evictions, %" G_GUINT64_FORMAT " bytes "
+    "evicted, %" G_GUINT64_FORMAT " bytes in use\n",
+    n_notes,
+    (end - start) / 1e3,
+    n_evictions,
+    evicted_bytes,
+    usage
+  );
+
+  result = TRUE;
+  if(usage > (guint64)n_resident * INF_TEST_MEMORY_BUDGET_NOTE_SIZE)
+  {
+    g_set_error(
+      error,
+      g_quark_from_static_string("INF_TEST_MEMORY_BUDGET_ERROR"),
+      0,
+      "Sessions use %" G_GUINT64_FORMAT " bytes, exceeding the budget",
+      usage
+    );
+
+    result = FALSE;
+  }
+
+  /* The most recently used notes stay in memory */
+  for(i = 0; i < n_notes && result == TRUE; ++i)
+  {
+    proxy = inf_browser_get_session(INF_BROWSER(directory), &iters[i]);
+    if((proxy != NULL) != (i + n_resident >= n_notes))
+    {
+      g_set_error(
+        error,
+        g_quark_from_static_string("INF_TEST_MEMORY_BUDGET_ERROR"),
+        0,
+        "Note %u is %s, but should not be",
+        i,
+        proxy != NULL ? "loaded" : "unloaded"
+      );
+
+      result = FALSE;
+    }
+  }
+
+  if(result == TRUE)
+  {
+    g_assert(n_evictions == n_notes - n_resident);
+
+    /* Load the least recently used note again */
+    inf_browser_subscribe(INF_BROWSER(directory), &iters[0], NULL, NULL);
+    g_assert(
+      inf_test_memory_budget_get_length(INF_BROWSER(directory), &iters[0]) ==
+      INF_TEST_MEMORY_BUDGET_NOTE_SIZE
+    );
+
+    result = inf_test_memory_budget_run_in_use(
+      io,
+      directory,
+      iters,
+      n_notes,
+      error
+    );
+  }
+
+  g_free(iters);
+  return result;
+}
+
+typedef struct _InfTestMemoryBudget InfTestMemoryBudget;
+struct _InfTestMemoryBudget {
+  guint n_notes;
+  guint n_resident;
+};
+
+static gboolean
+inf_test_memory_budget_main(const gchar* path,
+                            gpointer user_data,
+                            GError** error)
+{
+  InfTestMemoryBudget* test;
+  InfStandaloneIo* io;
+  InfdFilesystemStorage* storage;
+  InfCommunicationManager* manager;
+  InfdDirectory* directory;
+  gboolean result;
+
+  test = (InfTestMemoryBudget*)user_data;
+  io = inf_standalone_io_new();
+  storage = infd_filesystem_storage_new(path);
+  manager = inf_communication_manager_new();
+
+  directory = infd_directory_new(
+    INF_IO(io),
+    INFD_STORAGE(storage),
+    manager
+  );
+
+  infd_directory_add_plugin(directory, &INF_TEST_MEMORY_BUDGET_PLUGIN);
+
+  result = inf_test_memory_budget_run(
+    io,
+    directory,
+    test->n_notes,
+    test->n_resident,
+    error
+  );
+
+  g_object_unref(directory);
+  g_object_unref(manager);
+  g_object_unref(storage);
+  g_object_unref(io);
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  InfTestMemoryBudget test;
+
+  test.n_notes = INF_TEST_MEMORY_BUDGET_DEFAULT_NOTES;
+  test.n_resident = INF_TEST_MEMORY_BUDGET_DEFAULT_RESIDENT;
+
+  if(argc > 1) test.n_notes = strtoul(argv[1], NULL, 10);
+  if(argc > 2) test.n_resident = strtoul(argv[2], NULL, 10);
+
+  if(test.n_resident == 0 || test.n_notes < test.n_resident)
+  {
+    fprintf(stderr, "Usage: %s [notes] [resident-notes]\n", argv[0]);
+    return -1;
+  }
+
+  return inf_test_util_run_in_tmpdir(
+    "inf-test-memory-budget",
+    inf_test_memory_budget_main,
+    &test
+  );
+}
+
+/* vim:set et sw=2 ts=2: */
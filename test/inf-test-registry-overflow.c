@@ -0,0 +1,290 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Sends messages to a group member whose connection never sends anything
+ * out, and checks that InfCommunicationRegistry drops further messages to
+ * it once the unsent data exceeds the registry's queue limit, counting both
+ * the messages in the registry's queue and those already passed to the
+ * connection, and that it closes the connection from the main loop. Then it
+ * checks that a member whose connection keeps up is never closed. */
+
+#include <libinfinity/communication/inf-communication-registry.h>
+#include <libinfinity/communication/inf-communication-hosted-group.h>
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/common/inf-simulated-connection.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/* Size of the queue limit used by the test */
+#define INF_TEST_REGISTRY_OVERFLOW_LIMIT (64 * 1024)
+/* Size of the text in each message */
+#define INF_TEST_REGISTRY_OVERFLOW_MESSAGE_SIZE 1000
+
+typedef struct _InfTestRegistryOverflow InfTestRegistryOverflow;
+struct _InfTestRegistryOverflow {
+  InfStandaloneIo* io;
+  InfCommunicationRegistry* registry;
+  InfCommunicationManager* manager;
+  InfCommunicationHostedGroup* group;
+  InfSimulatedConnection* server;
+  InfSimulatedConnection* client;
+
+  guint n_sent;
+  guint n_overflows;
+  guint overflow_sent;
+  guint64 overflow_bytes;
+};
+
+static void
+inf_test_registry_overflow_cb(InfCommunicationRegistry* registry,
+                              InfCommunicationGroup* group,
+                              InfXmlConnection* connection,
+                              guint64 queued_bytes,
+                              gpointer user_data)
+{
+  InfTestRegistryOverflow* test;
+  test = (InfTestRegistryOverflow*)user_data;
+
+  ++test->n_overflows;
+  test->overflow_sent = test->n_sent;
+  test->overflow_bytes = queued_bytes;
+}
+
+static void
+inf_test_registry_overflow_setup(InfTestRegistryOverflow* test)
+{
+  test->server = inf_simulated_connection_new();
+  test->client = inf_simulated_connection_new();
+  inf_simulated_connection_connect(test->server, test->client);
+
+  inf_simulated_connection_set_mode(
+    test->server,
+    INF_SIMULATED_CONNECTION_DELAYED
+  );
+
+  test->group = g_object_new(
+    INF_COMMUNICATION_TYPE_HOSTED_GROUP,
+    "communication-manager", test->manager,
+    "communication-registry", test->registry,
+    "name", "InfTestRegistryOverflow",
+    NULL
+  );
+
+  inf_communication_hosted_group_add_method(test->group, "central");
+  inf_communication_hosted_group_add_member(
+    test->group,
+    INF_XML_CONNECTION(test->server)
+  );
+
+  test->n_sent = 0;
+  test->n_overflows = 0;
+  test->overflow_sent = 0;
+  test->overflow_bytes = 0;
+}
+
+static void
+inf_test_registry_overflow_teardown(InfTestRegistryOverflow* test)
+{
+  g_object_unref(test->group);
+  g_object_unref(test->server);
+  g_object_unref(test->client);
+}
+
+/* Sends n_messages messages with size bytes of text each to the member,
+ * flushing the connection after each one if flush is set. Returns the
+ * number of messages that could be sent before the connection was
+ * closed. */
+static guint
+inf_test_registry_overflow_send(InfTestRegistryOverflow* test,
+                                guint n_messages,
+                                gsize size,
+                                gboolean flush)
+{
+  InfXmlConnectionStatus status;
+  xmlNodePtr xml;
+  gchar* text;
+  guint i;
+
+  text = g_malloc(size + 1);
+  memset(text, 'a', size);
+  text[size] = '\0';
+
+  for(i = 0; i < n_messages; ++i)
+  {
+    g_object_get(G_OBJECT(test->server), "status", &status, NULL);
+    if(status != INF_XML_CONNECTION_OPEN)
+      break;
+
+    xml = xmlNewNode(NULL, (const xmlChar*)"message");
+    xmlNodeAddContent(xml, (const xmlChar*)text);
+
+    inf_communication_group_send_message(
+      INF_COMMUNICATION_GROUP(test->group),
+      INF_XML_CONNECTION(test->server),
+      xml
+    );
+
+    ++test->n_sent;
+    if(flush)
+      inf_simulated_connection_flush(test->server);
+  }
+
+  g_free(text);
+  return i;
+}
+
+int main(int argc, char* argv[])
+{
+  InfTestRegistryOverflow test;
+  InfXmlConnectionStatus status;
+  guint64 max_queue_bytes;
+  guint n_messages;
+  guint n_sent;
+  GError* error;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  test.io = inf_standalone_io_new();
+  test.registry = g_object_new(
+    INF_COMMUNICATION_TYPE_REGISTRY,
+    "io", test.io,
+    NULL
+  );
+
+  test.manager = inf_communication_manager_new();
+
+  /* The limit is active by default */
+  g_object_get(
+    G_OBJECT(test.registry),
+    "max-queue-bytes", &max_queue_bytes,
+    NULL
+  );
+
+  g_assert(max_queue_bytes > 0);
+
+  g_object_set(
+    G_OBJECT(test.registry),
+    "max-queue-bytes", (guint64)INF_TEST_REGISTRY_OVERFLOW_LIMIT,
+    NULL
+  );
+
+  g_signal_connect(
+    G_OBJECT(test.registry),
+    "queue-overflow",
+    G_CALLBACK(inf_test_registry_overflow_cb),
+    &test
+  );
+
+  n_messages =
+    4 * INF_TEST_REGISTRY_OVERFLOW_LIMIT /
+    INF_TEST_REGISTRY_OVERFLOW_MESSAGE_SIZE;
+
+  /* The first message is passed to the connection right away, and the
+   * following ones wait in the registry's queue until it has been sent.
+   * Both count towards the limit. */
+  inf_test_registry_overflow_setup(&test);
+  n_sent = inf_test_registry_overflow_send(
+    &test,
+    1,
+    INF_TEST_REGISTRY_OVERFLOW_LIMIT / 2,
+    FALSE
+  );
+
+  g_assert(n_sent == 1);
+
+  n_sent = inf_test_registry_overflow_send(
+    &test,
+    n_messages,
+    INF_TEST_REGISTRY_OVERFLOW_MESSAGE_SIZE,
+    FALSE
+  );
+
+  /* The connection is not closed while messages are being sent to it, but
+   * the messages after the overflow are dropped. */
+  g_object_get(G_OBJECT(test.server), "status", &status, NULL);
+  g_assert(status == INF_XML_CONNECTION_OPEN);
+  g_assert(n_sent == n_messages);
+
+  inf_standalone_io_iteration_timeout(test.io, 0);
+  g_object_get(G_OBJECT(test.server), "status", &status, NULL);
+
+  printf(
+    "Stalled connection: overflowed after %u messages, %" G_GUINT64_FORMAT
+    " bytes unsent\n",
+    test.overflow_sent,
+    test.overflow_bytes
+  );
+
+  g_assert(test.n_overflows == 1);
+  g_assert(test.overflow_bytes > INF_TEST_REGISTRY_OVERFLOW_LIMIT);
+  g_assert(
+    test.overflow_bytes <=
+      INF_TEST_REGISTRY_OVERFLOW_LIMIT +
+      2 * INF_TEST_REGISTRY_OVERFLOW_MESSAGE_SIZE
+  );
+
+  /* Overflowed once the queued messages fill the other half of the limit */
+  g_assert(
+    test.overflow_sent <=
+      INF_TEST_REGISTRY_OVERFLOW_LIMIT / 2 /
+      INF_TEST_REGISTRY_OVERFLOW_MESSAGE_SIZE + 2
+  );
+
+  g_assert(status != INF_XML_CONNECTION_OPEN);
+  inf_test_registry_overflow_teardown(&test);
+
+  /* A connection that keeps up never runs into the limit */
+  inf_test_registry_overflow_setup(&test);
+  n_sent = inf_test_registry_overflow_send(
+    &test,
+    n_messages,
+    INF_TEST_REGISTRY_OVERFLOW_MESSAGE_SIZE,
+    TRUE
+  );
+  g_object_get(G_OBJECT(test.server), "status", &status, NULL);
+
+  printf("Flushed connection: %u messages sent\n", n_sent);
+
+  g_assert(test.n_overflows == 0);
+  g_assert(n_sent == n_messages);
+  g_assert(status == INF_XML_CONNECTION_OPEN);
+
+  inf_communication_hosted_group_remove_member(
+    test.group,
+    INF_XML_CONNECTION(test.server)
+  );
+
+  inf_test_registry_overflow_teardown(&test);
+
+  g_object_unref(test.manager);
+  g_object_unref(test.registry);
+  g_object_unref(test.io);
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */
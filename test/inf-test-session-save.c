@@ -0,0 +1,414 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Saves a text note of an InfdDirectory explicitly and by unloading it, and
+ * checks each time that the storage holds the current text, that the
+ * buffer is no longer marked as modified, and that unmodified sessions are
+ * not written again. */
+
+#include "util/inf-test-util.h"
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-filesystem-format.h>
+
+#include <libinfinity/server/infd-directory.h>
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/common/inf-standalone-io.h>
+
+#include <stdio.h>
+#include <string.h>
+
+typedef struct _InfTestSessionSave InfTestSessionSave;
+struct _InfTestSessionSave {
+  guint n_saved;
+  guint64 bytes;
+};
+
+static InfSession*
+inf_test_session_save_session_new(InfIo* io,
+                                  InfCommunicationManager* manager,
+                                  InfSessionStatus status,
+                                  InfCommunicationGroup* sync_group,
+                                  InfXmlConnection* sync_connection,
+                                  const gchar* path,
+                                  gpointer user_data)
+{
+  InfTextSession* session;
+  InfTextBuffer* buffer;
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  session = inf_text_session_new(
+    manager,
+    buffer,
+    io,
+    status,
+    sync_group,
+    sync_connection
+  );
+
+  g_object_unref(buffer);
+  return INF_SESSION(session);
+}
+
+static InfSession*
+inf_test_session_save_session_read(InfdStorage* storage,
+                                   InfIo* io,
+                                   InfCommunicationManager* manager,
+                                   const gchar* path,
+                                   gpointer user_data,
+                                   GError** error)
+{
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfTextSession* session;
+
+  user_table = inf_user_table_new();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  if(!inf_text_filesystem_format_read(
+       INFD_FILESYSTEM_STORAGE(storage),
+       path,
+       user_table,
+       buffer,
+       error))
+  {
+    g_object_unref(user_table);
+    g_object_unref(buffer);
+    return NULL;
+  }
+
+  session = inf_text_session_new_with_user_table(
+    manager,
+    buffer,
+    io,
+    user_table,
+    INF_SESSION_RUNNING,
+    NULL,
+    NULL
+  );
+
+  g_object_unref(user_table);
+  g_object_unref(buffer);
+  return INF_SESSION(session);
+}
+
+static gboolean
+inf_test_session_save_session_write(InfdStorage* storage,
+                                    InfSession* session,
+                                    const gchar* path,
+                                    gpointer user_data,
+                                    GError** error)
+{
+  return inf_text_filesystem_format_write(
+    INFD_FILESYSTEM_STORAGE(storage),
+    path,
+    inf_session_get_user_table(session),
+    INF_TEXT_BUFFER(inf_session_get_buffer(session)),
+    error
+  );
+}
+
+static gsize
+inf_test_session_save_session_size(InfSession* session,
+                                   gpointer user_data)
+{
+  InfTextBuffer* buffer;
+  InfTextBufferIter* iter;
+  gsize size;
+
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
+  size = 0;
+
+  iter = inf_text_buffer_create_begin_iter(buffer);
+  if(iter != NULL)
+  {
+    do
+    {
+      size += inf_text_buffer_iter_get_bytes(buffer, iter);
+    } while(inf_text_buffer_iter_next(buffer, iter));
+
+    inf_text_buffer_destroy_iter(buffer, iter);
+  }
+
+  return size;
+}
+
+static const InfdNotePlugin INF_TEST_SESSION_SAVE_PLUGIN = {
+  NULL,
+  "InfdFilesystemStorage",
+  "InfText",
+  inf_test_session_save_session_new,
+  inf_test_session_save_session_read,
+  inf_test_session_save_session_write,
+  inf_test_session_save_session_size
+};
+
+static void
+inf_test_session_save_session_saved_cb(InfdDirectory* directory,
+                                       const InfBrowserIter* iter,
+                                       InfdSessionProxy* proxy,
+                                       guint64 bytes,
+                                       guint64 duration,
+                                       gpointer user_data)
+{
+  InfTestSessionSave* test;
+  test = (InfTestSessionSave*)user_data;
+
+  ++test->n_saved;
+  test->bytes = bytes;
+}
+
+/* Returns the buffer of the session at iter, or NULL if it is not loaded */
+static InfTextBuffer*
+inf_test_session_save_get_buffer(InfdDirectory* directory,
+                                 const InfBrowserIter* iter)
+{
+  InfSessionProxy* proxy;
+  InfSession* session;
+  InfTextBuffer* buffer;
+
+  proxy = inf_browser_get_session(INF_BROWSER(directory), iter);
+  if(proxy == NULL)
+    return NULL;
+
+  g_object_get(G_OBJECT(proxy), "session", &session, NULL);
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
+  g_object_unref(session);
+
+  return buffer;
+}
+
+/* Checks that the buffer contains exactly text */
+static void
+inf_test_session_save_assert_text(InfTextBuffer* buffer,
+                                  const gchar* text)
+{
+  InfTextChunk* chunk;
+  gchar* content;
+  gsize bytes;
+
+  chunk = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+
+  content = inf_text_chunk_get_text(chunk, &bytes);
+  inf_text_chunk_free(chunk);
+
+  g_assert(bytes == strlen(text));
+  g_assert(memcmp(content, text, bytes) == 0);
+  g_free(content);
+}
+
+/* Checks that the note at path in storage contains exactly text */
+static void
+inf_test_session_save_assert_stored(InfdFilesystemStorage* storage,
+                                    const gchar* path,
+                                    const gchar* text)
+{
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  GError* error;
+
+  user_table = inf_user_table_new();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  error = NULL;
+  if(!inf_text_filesystem_format_read(
+       storage,
+       path,
+       user_table,
+       buffer,
+       &error))
+  {
+    fprintf(stderr, "Failed to read \"%s\": %s\n", path, error->message);
+    g_error_free(error);
+    g_assert_not_reached();
+  }
+
+  inf_test_session_save_assert_text(buffer, text);
+
+  g_object_unref(user_table);
+  g_object_unref(buffer);
+}
+
+static void
+inf_test_session_save_insert(InfTextBuffer* buffer,
+                             const gchar* text)
+{
+  inf_text_buffer_insert_text(
+    buffer,
+    inf_text_buffer_get_length(buffer),
+    text,
+    strlen(text),
+    g_utf8_strlen(text, -1),
+    NULL
+  );
+}
+
+static gboolean
+inf_test_session_save_run(InfStandaloneIo* io,
+                          InfdDirectory* directory,
+                          InfdFilesystemStorage* storage,
+                          GError** error)
+{
+  InfTestSessionSave test;
+  InfBrowserIter root;
+  InfBrowserIter iter;
+  InfTextBuffer* buffer;
+  guint n_evictions;
+
+  test.n_saved = 0;
+  test.bytes = 0;
+
+  g_signal_connect(
+    G_OBJECT(directory),
+    "session-saved",
+    G_CALLBACK(inf_test_session_save_session_saved_cb),
+    &test
+  );
+
+  inf_browser_get_root(INF_BROWSER(directory), &root);
+  inf_browser_explore(INF_BROWSER(directory), &root, NULL, NULL);
+
+  inf_browser_add_note(
+    INF_BROWSER(directory),
+    &root,
+    "note",
+    "InfText",
+    NULL,
+    NULL,
+    TRUE,
+    NULL,
+    NULL
+  );
+
+  iter = root;
+  g_assert(inf_browser_get_child(INF_BROWSER(directory), &iter));
+
+  /* The empty note has been written when it was created */
+  buffer = inf_test_session_save_get_buffer(directory, &iter);
+  g_assert(buffer != NULL);
+  g_assert(inf_buffer_get_modified(INF_BUFFER(buffer)) == FALSE);
+  inf_test_session_save_assert_stored(storage, "/note", "");
+
+  /* An explicit save writes the modified buffer */
+  inf_test_session_save_insert(buffer, "Hello");
+  g_assert(inf_buffer_get_modified(INF_BUFFER(buffer)) == TRUE);
+
+  if(!infd_directory_iter_save_session(directory, &iter, error))
+    return FALSE;
+
+  g_assert(test.n_saved == 1);
+  g_assert(test.bytes > 0);
+  g_assert(inf_buffer_get_modified(INF_BUFFER(buffer)) == FALSE);
+  inf_test_session_save_assert_stored(storage, "/note", "Hello");
+
+  /* Saving an unmodified buffer does not write anything */
+  if(!infd_directory_iter_save_session(directory, &iter, error))
+    return FALSE;
+
+  g_assert(test.n_saved == 1);
+
+  printf("Saved note explicitly\n");
+
+  /* Unloading the note saves the modified buffer first */
+  inf_test_session_save_insert(buffer, ", World");
+  g_object_set(G_OBJECT(directory), "memory-budget", (guint64)1, NULL);
+  inf_standalone_io_iteration_timeout(io, 0);
+
+  g_assert(inf_test_session_save_get_buffer(directory, &iter) == NULL);
+  g_assert(test.n_saved == 2);
+  inf_test_session_save_assert_stored(storage, "/note", "Hello, World");
+
+  printf("Saved note when unloading it\n");
+
+  /* The reloaded note is not modified, and so it is unloaded again without
+   * being written. */
+  inf_browser_subscribe(INF_BROWSER(directory), &iter, NULL, NULL);
+  buffer = inf_test_session_save_get_buffer(directory, &iter);
+  g_assert(buffer != NULL);
+  g_assert(inf_buffer_get_modified(INF_BUFFER(buffer)) == FALSE);
+  inf_test_session_save_assert_text(buffer, "Hello, World");
+
+  inf_standalone_io_iteration_timeout(io, 0);
+  g_assert(inf_test_session_save_get_buffer(directory, &iter) == NULL);
+  g_assert(test.n_saved == 2);
+
+  g_object_get(G_OBJECT(directory), "evictions", &n_evictions, NULL);
+  g_assert(n_evictions == 2);
+
+  inf_test_session_save_assert_stored(storage, "/note", "Hello, World");
+
+  printf("Unloaded unmodified note without saving it\n");
+
+  g_signal_handlers_disconnect_by_func(
+    G_OBJECT(directory),
+    G_CALLBACK(inf_test_session_save_session_saved_cb),
+    &test
+  );
+
+  return TRUE;
+}
+
+static gboolean
+inf_test_session_save_main(const gchar* path,
+                           gpointer user_data,
+                           GError** error)
+{
+  InfStandaloneIo* io;
+  InfdFilesystemStorage* storage;
+  InfCommunicationManager* manager;
+  InfdDirectory* directory;
+  gboolean result;
+
+  io = inf_standalone_io_new();
+  storage = infd_filesystem_storage_new(path);
+  manager = inf_communication_manager_new();
+
+  directory = infd_directory_new(
+    INF_IO(io),
+    INFD_STORAGE(storage),
+    manager
+  );
+
+  infd_directory_add_plugin(directory, &INF_TEST_SESSION_SAVE_PLUGIN);
+
+  result = inf_test_session_save_run(io, directory, storage, error);
+
+  g_object_unref(directory);
+  g_object_unref(manager);
+  g_object_unref(storage);
+  g_object_unref(io);
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  return inf_test_util_run_in_tmpdir(
+    "inf-test-session-save",
+    inf_test_session_save_main,
+    NULL
+  );
+}
+
+/* vim:set et sw=2 ts=2: */
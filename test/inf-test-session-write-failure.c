@@ -0,0 +1,532 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Unloads a text note of an InfdDirectory whose note plugin writes in the
+ * background, while a directory in place of the note's file makes the write
+ * fail. The session must stay loaded and modified until the write has
+ * finished, and after the failure. Once the directory is gone, the note is
+ * written and unloaded. */
+
+#include "util/inf-test-util.h"
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-filesystem-format.h>
+
+#include <libinfinity/server/infd-directory.h>
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-file-util.h>
+
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+/* Maximum number of main loop iterations to wait for a write */
+#define INF_TEST_SESSION_WRITE_FAILURE_ITERATIONS 1000
+
+typedef struct _InfTestSessionWriteFailure InfTestSessionWriteFailure;
+struct _InfTestSessionWriteFailure {
+  InfStandaloneIo* io;
+  guint n_saved;
+  guint n_warnings;
+};
+
+typedef struct _InfTestSessionWriteFailureWrite
+  InfTestSessionWriteFailureWrite;
+struct _InfTestSessionWriteFailureWrite {
+  InfdNotePluginWriteFunc func;
+  gpointer user_data;
+};
+
+static InfSession*
+inf_test_session_write_failure_session_new(InfIo* io,
+                                           InfCommunicationManager* manager,
+                                           InfSessionStatus status,
+                                           InfCommunicationGroup* sync_group,
+                                           InfXmlConnection* sync_connection,
+                                           const gchar* path,
+                                           gpointer user_data)
+{
+  InfTextSession* session;
+  InfTextBuffer* buffer;
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  session = inf_text_session_new(
+    manager,
+    buffer,
+    io,
+    status,
+    sync_group,
+    sync_connection
+  );
+
+  g_object_unref(buffer);
+  return INF_SESSION(session);
+}
+
+static InfSession*
+inf_test_session_write_failure_session_read(InfdStorage* storage,
+                                            InfIo* io,
+                                            InfCommunicationManager* manager,
+                                            const gchar* path,
+                                            gpointer user_data,
+                                            GError** error)
+{
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfTextSession* session;
+
+  user_table = inf_user_table_new();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  if(!inf_text_filesystem_format_read(
+       INFD_FILESYSTEM_STORAGE(storage),
+       path,
+       user_table,
+       buffer,
+       error))
+  {
+    g_object_unref(user_table);
+    g_object_unref(buffer);
+    return NULL;
+  }
+
+  session = inf_text_session_new_with_user_table(
+    manager,
+    buffer,
+    io,
+    user_table,
+    INF_SESSION_RUNNING,
+    NULL,
+    NULL
+  );
+
+  g_object_unref(user_table);
+  g_object_unref(buffer);
+  return INF_SESSION(session);
+}
+
+static gboolean
+inf_test_session_write_failure_session_write(InfdStorage* storage,
+                                             InfSession* session,
+                                             const gchar* path,
+                                             gpointer user_data,
+                                             GError** error)
+{
+  return inf_text_filesystem_format_write(
+    INFD_FILESYSTEM_STORAGE(storage),
+    path,
+    inf_session_get_user_table(session),
+    INF_TEXT_BUFFER(inf_session_get_buffer(session)),
+    error
+  );
+}
+
+static gsize
+inf_test_session_write_failure_session_size(InfSession* session,
+                                            gpointer user_data)
+{
+  InfTextBuffer* buffer;
+  InfTextBufferIter* iter;
+  gsize size;
+
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
+  size = 0;
+
+  iter = inf_text_buffer_create_begin_iter(buffer);
+  if(iter != NULL)
+  {
+    do
+    {
+      size += inf_text_buffer_iter_get_bytes(buffer, iter);
+    } while(inf_text_buffer_iter_next(buffer, iter));
+
+    inf_text_buffer_destroy_iter(buffer, iter);
+  }
+
+  return size;
+}
+
+static void
+inf_test_session_write_failure_write_func(InfdFilesystemStorage* storage,
+                                          const GError* error,
+                                          gpointer user_data)
+{
+  InfTestSessionWriteFailureWrite* write;
+  write = (InfTestSessionWriteFailureWrite*)user_data;
+
+  write->func(error, write->user_data);
+  g_slice_free(InfTestSessionWriteFailureWrite, write);
+}
+
+static gboolean
+inf_test_session_write_failure_session_write_async(
+  InfdStorage* storage,
+  InfSession* session,
+  const gchar* path,
+  gpointer user_data,
+  InfdNotePluginWriteFunc func,
+  gpointer func_data,
+  GError** error)
+{
+  InfTestSessionWriteFailure* test;
+  InfTestSessionWriteFailureWrite* write;
+  gboolean result;
+
+  test = (InfTestSessionWriteFailure*)user_data;
+
+  write = g_slice_new(InfTestSessionWriteFailureWrite);
+  write->func = func;
+  write->user_data = func_data;
+
+  result = inf_text_filesystem_format_write_async(
+    INFD_FILESYSTEM_STORAGE(storage),
+    INF_IO(test->io),
+    path,
+    inf_session_get_user_table(session),
+    INF_TEXT_BUFFER(inf_session_get_buffer(session)),
+    inf_test_session_write_failure_write_func,
+    write,
+    error
+  );
+
+  if(result == FALSE)
+    g_slice_free(InfTestSessionWriteFailureWrite, write);
+
+  return result;
+}
+
+static const InfdNotePlugin INF_TEST_SESSION_WRITE_FAILURE_PLUGIN = {
+  NULL,
+  "InfdFilesystemStorage",
+  "InfText",
+  inf_test_session_write_failure_session_new,
+  inf_test_session_write_failure_session_read,
+  inf_test_session_write_failure_session_write,
+  inf_test_session_write_failure_session_size,
+  inf_test_session_write_failure_session_write_async
+};
+
+static void
+inf_test_session_write_failure_session_saved_cb(InfdDirectory* directory,
+                                                const InfBrowserIter* iter,
+                                                InfdSessionProxy* proxy,
+                                                guint64 bytes,
+                                                guint64 duration,
+                                                gpointer user_data)
+{
+  InfTestSessionWriteFailure* test;
+  test = (InfTestSessionWriteFailure*)user_data;
+
+  ++test->n_saved;
+}
+
+/* The directory reports failed writes as warnings */
+static void
+inf_test_session_write_failure_log_func(const gchar* log_domain,
+                                        GLogLevelFlags log_level,
+                                        const gchar* message,
+                                        gpointer user_data)
+{
+  InfTestSessionWriteFailure* test;
+  test = (InfTestSessionWriteFailure*)user_data;
+
+  if((log_level & G_LOG_LEVEL_WARNING) != 0)
+    ++test->n_warnings;
+  else
+    g_log_default_handler(log_domain, log_level, message, NULL);
+}
+
+/* Returns the buffer of the session at iter, or NULL if it is not loaded */
+static InfTextBuffer*
+inf_test_session_write_failure_get_buffer(InfdDirectory* directory,
+                                          const InfBrowserIter* iter)
+{
+  InfSessionProxy* proxy;
+  InfSession* session;
+  InfTextBuffer* buffer;
+
+  proxy = inf_browser_get_session(INF_BROWSER(directory), iter);
+  if(proxy == NULL)
+    return NULL;
+
+  g_object_get(G_OBJECT(proxy), "session", &session, NULL);
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
+  g_object_unref(session);
+
+  return buffer;
+}
+
+/* Runs the main loop until all background writes of storage have
+ * finished */
+static void
+inf_test_session_write_failure_wait(InfTestSessionWriteFailure* test,
+                                    InfdFilesystemStorage* storage)
+{
+  guint i;
+
+  for(i = 0; i < INF_TEST_SESSION_WRITE_FAILURE_ITERATIONS; ++i)
+  {
+    if(infd_filesystem_storage_get_pending_writes(storage) == 0)
+      return;
+
+    inf_standalone_io_iteration_timeout(test->io, 100);
+  }
+
+  g_assert_not_reached();
+}
+
+/* Checks that the note at path in storage contains exactly text */
+static void
+inf_test_session_write_failure_assert_stored(InfdFilesystemStorage* storage,
+                                             const gchar* path,
+                                             const gchar* text)
+{
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfTextChunk* chunk;
+  gchar* content;
+  gsize bytes;
+  GError* error;
+
+  user_table = inf_user_table_new();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  error = NULL;
+  if(!inf_text_filesystem_format_read(
+       storage,
+       path,
+       user_table,
+       buffer,
+       &error))
+  {
+    fprintf(stderr, "Failed to read \"%s\": %s\n", path, error->message);
+    g_error_free(error);
+    g_assert_not_reached();
+  }
+
+  chunk = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+
+  content = inf_text_chunk_get_text(chunk, &bytes);
+  inf_text_chunk_free(chunk);
+
+  g_assert(bytes == strlen(text));
+  g_assert(memcmp(content, text, bytes) == 0);
+
+  g_free(content);
+  g_object_unref(user_table);
+  g_object_unref(buffer);
+}
+
+static gboolean
+inf_test_session_write_failure_run(InfTestSessionWriteFailure* test,
+                                   InfdDirectory* directory,
+                                   InfdFilesystemStorage* storage,
+                                   const gchar* path,
+                                   GError** error)
+{
+  InfBrowserIter root;
+  InfBrowserIter iter;
+  InfTextBuffer* buffer;
+  gchar* note_path;
+  gchar* blocker_path;
+  guint n_evictions;
+  guint i;
+
+  g_signal_connect(
+    G_OBJECT(directory),
+    "session-saved",
+    G_CALLBACK(inf_test_session_write_failure_session_saved_cb),
+    test
+  );
+
+  inf_browser_get_root(INF_BROWSER(directory), &root);
+  inf_browser_explore(INF_BROWSER(directory), &root, NULL, NULL);
+
+  inf_browser_add_note(
+    INF_BROWSER(directory),
+    &root,
+    "note",
+    "InfText",
+    NULL,
+    NULL,
+    TRUE,
+    NULL,
+    NULL
+  );
+
+  iter = root;
+  g_assert(inf_browser_get_child(INF_BROWSER(directory), &iter));
+
+  buffer = inf_test_session_write_failure_get_buffer(directory, &iter);
+  g_assert(buffer != NULL);
+
+  inf_text_buffer_insert_text(buffer, 0, "Hello", 5, 5, NULL);
+  g_assert(inf_buffer_get_modified(INF_BUFFER(buffer)) == TRUE);
+
+  /* A non-empty directory cannot be replaced by the written file */
+  note_path = g_build_filename(path, "note.InfText", NULL);
+  blocker_path = g_build_filename(note_path, "blocker", NULL);
+
+  if(g_unlink(note_path) == -1)
+  {
+    g_set_error_literal(
+      error,
+      G_FILE_ERROR,
+      g_file_error_from_errno(errno),
+      g_strerror(errno)
+    );
+
+    g_free(blocker_path);
+    g_free(note_path);
+    return FALSE;
+  }
+
+  if(!inf_file_util_create_single_directory(note_path, 0755, error) ||
+     !g_file_set_contents(blocker_path, "", 0, error))
+  {
+    g_free(blocker_path);
+    g_free(note_path);
+    return FALSE;
+  }
+
+  /* The session stays loaded while it is being written */
+  g_object_set(G_OBJECT(directory), "memory-budget", (guint64)1, NULL);
+  inf_standalone_io_iteration_timeout(test->io, 0);
+
+  g_assert(infd_filesystem_storage_get_pending_writes(storage) <= 1);
+  g_assert(inf_test_session_write_failure_get_buffer(directory, &iter) ==
+           buffer);
+
+  inf_test_session_write_failure_wait(test, storage);
+
+  g_assert(inf_test_session_write_failure_get_buffer(directory, &iter) ==
+           buffer);
+  g_assert(inf_buffer_get_modified(INF_BUFFER(buffer)) == TRUE);
+  g_assert(test->n_saved == 0);
+  g_assert(test->n_warnings == 1);
+
+  g_object_get(G_OBJECT(directory), "evictions", &n_evictions, NULL);
+  g_assert(n_evictions == 0);
+
+  printf("Failed write kept the note in memory\n");
+
+  /* Once the file can be written, the note is unloaded after its write */
+  g_unlink(blocker_path);
+  g_rmdir(note_path);
+  g_free(blocker_path);
+  g_free(note_path);
+
+  g_object_set(G_OBJECT(directory), "memory-budget", (guint64)1, NULL);
+
+  for(i = 0; i < INF_TEST_SESSION_WRITE_FAILURE_ITERATIONS; ++i)
+  {
+    if(inf_test_session_write_failure_get_buffer(directory, &iter) == NULL)
+      break;
+
+    inf_standalone_io_iteration_timeout(test->io, 100);
+  }
+
+  g_assert(inf_test_session_write_failure_get_buffer(directory, &iter) ==
+           NULL);
+  g_assert(test->n_saved == 1);
+  g_assert(test->n_warnings == 1);
+
+  g_object_get(G_OBJECT(directory), "evictions", &n_evictions, NULL);
+  g_assert(n_evictions == 1);
+
+  inf_test_session_write_failure_assert_stored(storage, "/note", "Hello");
+
+  printf("Successful write unloaded the note\n");
+
+  g_signal_handlers_disconnect_by_func(
+    G_OBJECT(directory),
+    G_CALLBACK(inf_test_session_write_failure_session_saved_cb),
+    test
+  );
+
+  return TRUE;
+}
+
+static gboolean
+inf_test_session_write_failure_main(const gchar* path,
+                                   gpointer user_data,
+                                   GError** error)
+{
+  InfTestSessionWriteFailure test;
+  InfdNotePlugin plugin;
+  InfdFilesystemStorage* storage;
+  InfCommunicationManager* manager;
+  InfdDirectory* directory;
+  gboolean result;
+
+  test.io = inf_standalone_io_new();
+  test.n_saved = 0;
+  test.n_warnings = 0;
+
+  g_log_set_default_handler(inf_test_session_write_failure_log_func, &test);
+
+  storage = infd_filesystem_storage_new(path);
+  manager = inf_communication_manager_new();
+
+  directory = infd_directory_new(
+    INF_IO(test.io),
+    INFD_STORAGE(storage),
+    manager
+  );
+
+  plugin = INF_TEST_SESSION_WRITE_FAILURE_PLUGIN;
+  plugin.user_data = &test;
+  infd_directory_add_plugin(directory, &plugin);
+
+  result = inf_test_session_write_failure_run(
+    &test,
+    directory,
+    storage,
+    path,
+    error
+  );
+
+  g_object_unref(directory);
+  g_object_unref(manager);
+  g_object_unref(storage);
+  g_object_unref(test.io);
+
+  g_log_set_default_handler(g_log_default_handler, NULL);
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  return inf_test_util_run_in_tmpdir(
+    "inf-test-session-write-failure",
+    inf_test_session_write_failure_main,
+    NULL
+  );
+}
+
+/* vim:set et sw=2 ts=2: */
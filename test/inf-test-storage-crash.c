@@ -0,0 +1,580 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Lets a child process save new versions of a note with
+ * InfdFilesystemStorage in a loop, and kills it at random times. After each
+ * kill it checks that the note on disk is one complete version, and that a
+ * new storage removes the temporary files left behind. Then it saves a
+ * number of notes at once, once flushing every note separately and once
+ * with a group commit, and prints the time both take. A note that cannot
+ * be replaced must report the failure of the group commit to its writer. */
+
+#include "util/inf-test-util.h"
+
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-file-util.h>
+
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef G_OS_WIN32
+# include <sys/types.h>
+# include <sys/wait.h>
+# include <signal.h>
+# include <unistd.h>
+#endif
+
+#define INF_TEST_STORAGE_CRASH_DEFAULT_KILLS 50
+#define INF_TEST_STORAGE_CRASH_DEFAULT_NOTES 100
+
+/* Number of lines in each version of the crash note, to make writing it
+ * take long enough to be interrupted */
+#define INF_TEST_STORAGE_CRASH_LINES 2000
+
+static xmlDocPtr
+inf_test_storage_crash_doc_new(guint version)
+{
+  xmlDocPtr doc;
+  xmlNodePtr root;
+  xmlNodePtr line;
+  guint i;
+
+  doc = xmlNewDoc((const xmlChar*)"1.0");
+  root = xmlNewDocNode(doc, NULL, (const xmlChar*)"inf-test-storage", NULL);
+  xmlDocSetRootElement(doc, root);
+
+  inf_xml_util_set_attribute_uint(root, "version", version);
+  for(i = 0; i < INF_TEST_STORAGE_CRASH_LINES; ++i)
+  {
+    line = xmlNewChild(root, NULL, (const xmlChar*)"line", NULL);
+    inf_xml_util_set_attribute_uint(line, "version", version);
+  }
+
+  return doc;
+}
+
+/* Checks that the note at path is one complete version, and returns that
+ * version. */
+static gboolean
+inf_test_storage_crash_check(InfdFilesystemStorage* storage,
+                             const gchar* path,
+                             guint* version,
+                             GError** error)
+{
+  xmlDocPtr doc;
+  xmlNodePtr root;
+  xmlNodePtr line;
+  guint line_version;
+  guint n_lines;
+
+  doc = infd_filesystem_storage_read_xml_file(
+    storage,
+    "InfTestStorage",
+    path,
+    "inf-test-storage",
+    error
+  );
+
+  if(doc == NULL)
+    return FALSE;
+
+  root = xmlDocGetRootElement(doc);
+  if(!inf_xml_util_get_attribute_uint_required(root, "version", version, error))
+  {
+    xmlFreeDoc(doc);
+    return FALSE;
+  }
+
+  n_lines = 0;
+  for(line = root->children; line != NULL; line = line->next)
+  {
+    if(line->type != XML_ELEMENT_NODE)
+      continue;
+
+    if(!inf_xml_util_get_attribute_uint_required(
+         line,
+         "version",
+         &line_version,
+         error))
+    {
+      xmlFreeDoc(doc);
+      return FALSE;
+    }
+
+    if(line_version != *version)
+    {
+      g_set_error(
+        error,
+        g_quark_from_static_string("INF_TEST_STORAGE_CRASH_ERROR"),
+        0,
+        "Line %u of version %u is from version %u",
+        n_lines,
+        *version,
+        line_version
+      );
+
+      xmlFreeDoc(doc);
+      return FALSE;
+    }
+
+    ++n_lines;
+  }
+
+  xmlFreeDoc(doc);
+
+  if(n_lines != INF_TEST_STORAGE_CRASH_LINES)
+  {
+    g_set_error(
+      error,
+      g_quark_from_static_string("INF_TEST_STORAGE_CRASH_ERROR"),
+      0,
+      "Version %u has %u instead of %u lines",
+      *version,
+      n_lines,
+      INF_TEST_STORAGE_CRASH_LINES
+    );
+
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+#ifndef G_OS_WIN32
+static void
+inf_test_storage_crash_child(InfdFilesystemStorage* storage,
+                             guint version)
+{
+  xmlDocPtr doc;
+  GError* error;
+
+  error = NULL;
+  for(;;)
+  {
+    doc = inf_test_storage_crash_doc_new(++version);
+    if(!infd_filesystem_storage_write_xml_file(
+         storage,
+         "InfTestStorage",
+         "/crash",
+         doc,
+         &error))
+    {
+      fprintf(stderr, "Child: %s\n", error->message);
+      g_error_free(error);
+      _exit(1);
+    }
+
+    xmlFreeDoc(doc);
+  }
+}
+
+static gboolean
+inf_test_storage_crash_kill(InfdFilesystemStorage* storage,
+                            guint n_kills,
+                            GError** error)
+{
+  xmlDocPtr doc;
+  guint version;
+  guint previous;
+  pid_t pid;
+  int status;
+  guint i;
+
+  doc = inf_test_storage_crash_doc_new(0);
+  if(!infd_filesystem_storage_write_xml_file(
+       storage,
+       "InfTestStorage",
+       "/crash",
+       doc,
+       error))
+  {
+    xmlFreeDoc(doc);
+    return FALSE;
+  }
+
+  xmlFreeDoc(doc);
+  version = 0;
+
+  for(i = 0; i < n_kills; ++i)
+  {
+    pid = fork();
+    if(pid == -1)
+    {
+      g_set_error_literal(
+        error,
+        g_quark_from_static_string("INF_TEST_STORAGE_CRASH_ERROR"),
+        0,
+        "fork() failed"
+      );
+
+      return FALSE;
+    }
+
+    if(pid == 0)
+      inf_test_storage_crash_child(storage, version);
+
+    g_usleep(g_random_int_range(1000, 50000));
+    kill(pid, SIGKILL);
+    waitpid(pid, &status, 0);
+
+    if(!WIFSIGNALED(status))
+    {
+      g_set_error_literal(
+        error,
+        g_quark_from_static_string("INF_TEST_STORAGE_CRASH_ERROR"),
+        0,
+        "Child process exited before it was killed"
+      );
+
+      return FALSE;
+    }
+
+    previous = version;
+    if(!inf_test_storage_crash_check(storage, "/crash", &version, error))
+      return FALSE;
+
+    g_assert(version >= previous);
+  }
+
+  printf("%u kills, note survived at version %u\n", n_kills, version);
+  return TRUE;
+}
+#endif
+
+static gboolean
+inf_test_storage_crash_find_temp_func(const gchar* name,
+                                      const gchar* path,
+                                      InfFileType type,
+                                      gpointer user_data,
+                                      GError** error)
+{
+  if(strstr(name, ".infd-tmp-") != NULL)
+    *(gboolean*)user_data = TRUE;
+  return TRUE;
+}
+
+/* Checks that no temporary file is left in the directory at path */
+static gboolean
+inf_test_storage_crash_check_temp(const gchar* path,
+                                  GError** error)
+{
+  gboolean found;
+
+  found = FALSE;
+  if(!inf_file_util_list_directory(
+       path,
+       inf_test_storage_crash_find_temp_func,
+       &found,
+       error))
+  {
+    return FALSE;
+  }
+
+  if(found == TRUE)
+  {
+    g_set_error_literal(
+      error,
+      g_quark_from_static_string("INF_TEST_STORAGE_CRASH_ERROR"),
+      0,
+      "Temporary file left behind"
+    );
+
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+typedef struct _InfTestStorageCrashWrites InfTestStorageCrashWrites;
+struct _InfTestStorageCrashWrites {
+  guint n_succeeded;
+  guint n_failed;
+};
+
+static void
+inf_test_storage_crash_write_func(InfdFilesystemStorage* storage,
+                                  const GError* error,
+                                  gpointer user_data)
+{
+  InfTestStorageCrashWrites* writes;
+  writes = (InfTestStorageCrashWrites*)user_data;
+
+  if(error == NULL)
+    ++writes->n_succeeded;
+  else
+    ++writes->n_failed;
+}
+
+/* Writes n_notes notes, and with io one note whose previous version is a
+ * directory that cannot be replaced. Without io, every note is written and
+ * flushed to disk one after the other. With io, the notes are written
+ * asynchronously and committed together. */
+static gboolean
+inf_test_storage_crash_write_notes(InfdFilesystemStorage* storage,
+                                   InfStandaloneIo* io,
+                                   const gchar* root,
+                                   guint n_notes,
+                                   GError** error)
+{
+  InfTestStorageCrashWrites writes;
+  xmlDocPtr doc;
+  gchar* path;
+  guint commits;
+  guint committed_files;
+  guint version;
+  gint64 start;
+  gint64 end;
+  gboolean result;
+  guint i;
+
+  g_object_set(G_OBJECT(storage), "sync-writes", TRUE, NULL);
+
+  writes.n_succeeded = 0;
+  writes.n_failed = 0;
+
+  if(io != NULL)
+  {
+    path = g_build_filename(root, "blocked.InfTestStorage", "child", NULL);
+    result = inf_file_util_create_directory(path, 0755, error);
+    g_free(path);
+
+    if(result == FALSE)
+      return FALSE;
+
+    doc = inf_test_storage_crash_doc_new(0);
+    if(!infd_filesystem_storage_write_xml_async(
+         storage,
+         INF_IO(io),
+         "InfTestStorage",
+         "/blocked",
+         doc,
+         inf_test_storage_crash_write_func,
+         &writes,
+         error))
+    {
+      return FALSE;
+    }
+  }
+
+  start = g_get_monotonic_time();
+  for(i = 0; i < n_notes; ++i)
+  {
+    path = g_strdup_printf("/note%u", i);
+    doc = inf_test_storage_crash_doc_new(i);
+
+    if(io != NULL)
+    {
+      result = infd_filesystem_storage_write_xml_async(
+        storage,
+        INF_IO(io),
+        "InfTestStorage",
+        path,
+        doc,
+        inf_test_storage_crash_write_func,
+        &writes,
+        error
+      );
+    }
+    else
+    {
+      result = infd_filesystem_storage_write_xml_file(
+        storage,
+        "InfTestStorage",
+        path,
+        doc,
+        error
+      );
+
+      xmlFreeDoc(doc);
+    }
+
+    g_free(path);
+    if(result == FALSE)
+      return FALSE;
+  }
+
+  /* With io, the group commit runs in the background while the main loop
+   * keeps running. */
+  if(io != NULL)
+  {
+    while(infd_filesystem_storage_get_pending_writes(storage) > 0)
+      inf_standalone_io_iteration(io);
+  }
+
+  infd_filesystem_storage_flush(storage);
+  end = g_get_monotonic_time();
+
+  g_object_get(
+    G_OBJECT(storage),
+    "commits", &commits,
+    "committed-files", &committed_files,
+    NULL
+  );
+
+  printf(
+    "%s: %u notes in %.3f ms, %u commits\n",
+    io != NULL ? "Group commit" : "Separate flushes",
+    n_notes,
+    (end - start) / 1e3,
+    commits
+  );
+
+  if(io != NULL)
+  {
+    /* Writes finishing in different main loop iterations can end up in
+     * different group commits. */
+    g_assert(commits >= 1);
+    g_assert(committed_files == n_notes);
+    g_assert(writes.n_succeeded == n_notes);
+    g_assert(writes.n_failed == 1);
+  }
+  else
+  {
+    g_assert(commits == 0);
+  }
+
+  for(i = 0; i < n_notes; ++i)
+  {
+    path = g_strdup_printf("/note%u", i);
+    if(!inf_test_storage_crash_check(storage, path, &version, error))
+    {
+      g_free(path);
+      return FALSE;
+    }
+
+    g_assert(version == i);
+    g_free(path);
+  }
+
+  return inf_test_storage_crash_check_temp(root, error);
+}
+
+typedef struct _InfTestStorageCrash InfTestStorageCrash;
+struct _InfTestStorageCrash {
+  guint n_kills;
+  guint n_notes;
+};
+
+static gboolean
+inf_test_storage_crash_main(const gchar* path,
+                            gpointer user_data,
+                            GError** error)
+{
+  InfTestStorageCrash* test;
+  InfStandaloneIo* io;
+  InfdFilesystemStorage* storage;
+  gchar* temp_path;
+  gchar* other_path;
+  gboolean result;
+
+  test = (InfTestStorageCrash*)user_data;
+  storage = infd_filesystem_storage_new(path);
+  io = inf_standalone_io_new();
+
+#ifndef G_OS_WIN32
+  result = inf_test_storage_crash_kill(storage, test->n_kills, error);
+#else
+  result = TRUE;
+#endif
+
+  if(result == TRUE)
+  {
+    result = inf_test_storage_crash_write_notes(
+      storage,
+      NULL,
+      path,
+      test->n_notes,
+      error
+    );
+  }
+
+  if(result == TRUE)
+  {
+    g_object_unref(storage);
+
+    /* Like one that the killed child process might have left behind */
+    temp_path = g_build_filename(
+      path,
+      "crash.InfTestStorage.infd-tmp-Ab12Cd",
+      NULL
+    );
+
+    result = g_file_set_contents(temp_path, "", 0, error);
+    g_free(temp_path);
+
+    /* A file of the user which only looks similar must survive */
+    other_path = g_build_filename(path, "crash.InfTestStorage.Ab12Cd", NULL);
+    if(result == TRUE)
+      result = g_file_set_contents(other_path, "", 0, error);
+
+    storage = infd_filesystem_storage_new(path);
+    if(result == TRUE)
+      result = inf_test_storage_crash_check_temp(path, error);
+    if(result == TRUE)
+      g_assert(g_file_test(other_path, G_FILE_TEST_EXISTS));
+
+    g_unlink(other_path);
+    g_free(other_path);
+  }
+
+  if(result == TRUE)
+  {
+    result = inf_test_storage_crash_write_notes(
+      storage,
+      io,
+      path,
+      test->n_notes,
+      error
+    );
+  }
+
+  g_object_unref(storage);
+  g_object_unref(io);
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  InfTestStorageCrash test;
+
+  test.n_kills = INF_TEST_STORAGE_CRASH_DEFAULT_KILLS;
+  test.n_notes = INF_TEST_STORAGE_CRASH_DEFAULT_NOTES;
+
+  if(argc > 1) test.n_kills = strtoul(argv[1], NULL, 10);
+  if(argc > 2) test.n_notes = strtoul(argv[2], NULL, 10);
+
+  if(test.n_notes == 0)
+  {
+    fprintf(stderr, "Usage: %s [kills] [notes]\n", argv[0]);
+    return -1;
+  }
+
+  return inf_test_util_run_in_tmpdir(
+    "inf-test-storage-crash",
+    inf_test_storage_crash_main,
+    &test
+  );
+}
+
+/* vim:set et sw=2 ts=2: */
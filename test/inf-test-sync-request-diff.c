@@ -0,0 +1,498 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Replays a record, and then synchronizes the resulting session to a new
+ * session via simulated connections, once to a peer announcing protocol
+ * version 1.1, which gets full request vectors, and once to a peer
+ * announcing 1.2, which gets diff-encoded ones. It checks that the request
+ * logs and the text of the new sessions are the same as the ones of the
+ * replayed session, and prints how many bytes the diff encoding saves. */
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinfinity/adopted/inf-adopted-session-replay.h>
+#include <libinfinity/communication/inf-communication-hosted-group.h>
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/common/inf-simulated-connection.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-protocol.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <string.h>
+
+#define INF_TEST_SYNC_REQUEST_DIFF_GROUP "InfTestSyncRequestDiff"
+
+typedef struct _InfTestSyncRequestDiffCompare InfTestSyncRequestDiffCompare;
+struct _InfTestSyncRequestDiffCompare {
+  InfUserTable* user_table;
+  GError** error;
+};
+
+static InfSession*
+inf_test_sync_request_diff_session_new(InfIo* io,
+                                       InfCommunicationManager* manager,
+                                       InfSessionStatus status,
+                                       InfCommunicationGroup* sync_group,
+                                       InfXmlConnection* sync_connection,
+                                       const gchar* path,
+                                       gpointer user_data)
+{
+  InfTextDefaultBuffer* buffer;
+  InfTextSession* session;
+
+  buffer = inf_text_default_buffer_new("UTF-8");
+  session = inf_text_session_new(
+    manager,
+    INF_TEXT_BUFFER(buffer),
+    io,
+    status,
+    sync_group,
+    sync_connection
+  );
+  g_object_unref(buffer);
+
+  return INF_SESSION(session);
+}
+
+static const InfcNotePlugin INF_TEST_SYNC_REQUEST_DIFF_TEXT_PLUGIN = {
+  NULL, "InfText", inf_test_sync_request_diff_session_new
+};
+
+static GQuark
+inf_test_sync_request_diff_error_quark(void)
+{
+  return g_quark_from_static_string("INF_TEST_SYNC_REQUEST_DIFF_ERROR");
+}
+
+/* Adds the size of all sync-request messages sent to the counter in
+ * user_data. */
+static void
+inf_test_sync_request_diff_sent_cb(InfXmlConnection* connection,
+                                   xmlNodePtr xml,
+                                   gpointer user_data)
+{
+  gsize* bytes;
+  xmlBufferPtr buffer;
+  xmlNodePtr child;
+
+  bytes = (gsize*)user_data;
+
+  /* The registry sends the messages of a group in a container */
+  for(child = xml->children; child != NULL; child = child->next)
+  {
+    if(child->type != XML_ELEMENT_NODE) continue;
+    if(strcmp((const char*)child->name, "sync-request") != 0) continue;
+
+    buffer = xmlBufferCreate();
+    xmlNodeDump(buffer, child->doc, child, 0, 0);
+    *bytes += xmlBufferLength(buffer);
+    xmlBufferFree(buffer);
+  }
+}
+
+static void
+inf_test_sync_request_diff_failed_cb(InfSession* session,
+                                     InfXmlConnection* connection,
+                                     const GError* error,
+                                     gpointer user_data)
+{
+  GError** error_loc;
+  error_loc = (GError**)user_data;
+
+  if(*error_loc == NULL)
+    *error_loc = g_error_copy(error);
+}
+
+static void
+inf_test_sync_request_diff_compare_func(InfUser* user,
+                                        gpointer user_data)
+{
+  InfTestSyncRequestDiffCompare* compare;
+  InfAdoptedRequestLog* log;
+  InfAdoptedRequestLog* synced_log;
+  InfUser* synced_user;
+  InfAdoptedRequest* request;
+  gchar* vector;
+  gchar* synced_vector;
+  guint i;
+
+  compare = (InfTestSyncRequestDiffCompare*)user_data;
+  if(*compare->error != NULL) return;
+
+  synced_user = inf_user_table_lookup_user_by_id(
+    compare->user_table,
+    inf_user_get_id(user)
+  );
+
+  if(synced_user == NULL)
+  {
+    g_set_error(
+      compare->error,
+      inf_test_sync_request_diff_error_quark(),
+      0,
+      "User %u was not synchronized",
+      inf_user_get_id(user)
+    );
+
+    return;
+  }
+
+  log = inf_adopted_user_get_request_log(INF_ADOPTED_USER(user));
+  synced_log =
+    inf_adopted_user_get_request_log(INF_ADOPTED_USER(synced_user));
+
+  if(inf_adopted_request_log_get_begin(log) !=
+     inf_adopted_request_log_get_begin(synced_log) ||
+     inf_adopted_request_log_get_end(log) !=
+     inf_adopted_request_log_get_end(synced_log))
+  {
+    g_set_error(
+      compare->error,
+      inf_test_sync_request_diff_error_quark(),
+      0,
+      "The request log of user %u has a different range",
+      inf_user_get_id(user)
+    );
+
+    return;
+  }
+
+  for(i = inf_adopted_request_log_get_begin(log);
+      i < inf_adopted_request_log_get_end(log);
+      ++ i)
+  {
+    request = inf_adopted_request_log_get_request(log, i);
+    vector = inf_adopted_state_vector_to_string(
+      inf_adopted_request_get_vector(request)
+    );
+
+    request = inf_adopted_request_log_get_request(synced_log, i);
+    synced_vector = inf_adopted_state_vector_to_string(
+      inf_adopted_request_get_vector(request)
+    );
+
+    if(strcmp(vector, synced_vector) != 0)
+    {
+      g_set_error(
+        compare->error,
+        inf_test_sync_request_diff_error_quark(),
+        0,
+        "Request %u of user %u has a different vector",
+        i,
+        inf_user_get_id(user)
+      );
+    }
+
+    g_free(vector);
+    g_free(synced_vector);
+
+    if(*compare->error != NULL)
+      return;
+  }
+}
+
+/* Synchronizes session to a new session via a simulated connection whose
+ * remote side announces the given protocol version, and stores the number
+ * of bytes of all sync-request messages in bytes. Then checks that the
+ * new session has the same requests and text as session. */
+static gboolean
+inf_test_sync_request_diff_run(InfAdoptedSession* session,
+                               const gchar* version,
+                               gsize* bytes,
+                               GError** error)
+{
+  InfCommunicationManager* server_manager;
+  InfCommunicationManager* client_manager;
+  InfCommunicationHostedGroup* server_group;
+  InfCommunicationJoinedGroup* client_group;
+  InfSimulatedConnection* server_conn;
+  InfSimulatedConnection* client_conn;
+  InfTestSyncRequestDiffCompare compare;
+  InfSession* synced;
+  InfTextBuffer* buffer;
+  InfTextChunk* chunk;
+  InfTextChunk* synced_chunk;
+  InfSessionSyncStatus sync_status;
+  InfIo* io;
+  GError* local_error;
+
+  server_conn = inf_simulated_connection_new();
+  client_conn = inf_simulated_connection_new();
+  inf_simulated_connection_connect(server_conn, client_conn);
+
+  inf_simulated_connection_set_mode(
+    server_conn,
+    INF_SIMULATED_CONNECTION_DELAYED
+  );
+
+  inf_simulated_connection_set_mode(
+    client_conn,
+    INF_SIMULATED_CONNECTION_DELAYED
+  );
+
+  inf_protocol_set_remote_version(
+    INF_XML_CONNECTION(server_conn),
+    version,
+    NULL
+  );
+
+  server_manager = inf_communication_manager_new();
+  server_group = inf_communication_manager_open_group(
+    server_manager,
+    INF_TEST_SYNC_REQUEST_DIFF_GROUP,
+    NULL
+  );
+
+  inf_communication_hosted_group_add_method(server_group, "central");
+  inf_communication_hosted_group_add_member(
+    server_group,
+    INF_XML_CONNECTION(server_conn)
+  );
+
+  inf_communication_group_set_target(
+    INF_COMMUNICATION_GROUP(server_group),
+    INF_COMMUNICATION_OBJECT(session)
+  );
+
+  client_manager = inf_communication_manager_new();
+  client_group = inf_communication_manager_join_group(
+    client_manager,
+    INF_TEST_SYNC_REQUEST_DIFF_GROUP,
+    INF_XML_CONNECTION(client_conn),
+    "central"
+  );
+
+  io = INF_IO(inf_standalone_io_new());
+  synced = inf_test_sync_request_diff_session_new(
+    io,
+    client_manager,
+    INF_SESSION_SYNCHRONIZING,
+    INF_COMMUNICATION_GROUP(client_group),
+    INF_XML_CONNECTION(client_conn),
+    NULL,
+    NULL
+  );
+
+  inf_communication_group_set_target(
+    INF_COMMUNICATION_GROUP(client_group),
+    INF_COMMUNICATION_OBJECT(synced)
+  );
+
+  local_error = NULL;
+  g_signal_connect(
+    G_OBJECT(synced),
+    "synchronization-failed",
+    G_CALLBACK(inf_test_sync_request_diff_failed_cb),
+    &local_error
+  );
+
+  *bytes = 0;
+  g_signal_connect(
+    G_OBJECT(server_conn),
+    "sent",
+    G_CALLBACK(inf_test_sync_request_diff_sent_cb),
+    bytes
+  );
+
+  inf_session_synchronize_to(
+    INF_SESSION(session),
+    INF_COMMUNICATION_GROUP(server_group),
+    INF_XML_CONNECTION(server_conn)
+  );
+
+  /* Until the server has received the sync-ack */
+  sync_status = INF_SESSION_SYNC_IN_PROGRESS;
+  while(local_error == NULL && sync_status != INF_SESSION_SYNC_NONE)
+  {
+    inf_simulated_connection_flush(server_conn);
+    inf_simulated_connection_flush(client_conn);
+
+    sync_status = inf_session_get_synchronization_status(
+      INF_SESSION(session),
+      INF_XML_CONNECTION(server_conn)
+    );
+  }
+
+  if(local_error == NULL)
+  {
+    g_assert(inf_session_get_status(synced) == INF_SESSION_RUNNING);
+
+    compare.user_table = inf_session_get_user_table(synced);
+    compare.error = &local_error;
+
+    inf_user_table_foreach_user(
+      inf_session_get_user_table(INF_SESSION(session)),
+      inf_test_sync_request_diff_compare_func,
+      &compare
+    );
+  }
+
+  if(local_error == NULL)
+  {
+    buffer = INF_TEXT_BUFFER(inf_session_get_buffer(INF_SESSION(session)));
+    chunk = inf_text_buffer_get_slice(
+      buffer,
+      0,
+      inf_text_buffer_get_length(buffer)
+    );
+
+    buffer = INF_TEXT_BUFFER(inf_session_get_buffer(synced));
+    synced_chunk = inf_text_buffer_get_slice(
+      buffer,
+      0,
+      inf_text_buffer_get_length(buffer)
+    );
+
+    if(!inf_text_chunk_equal(chunk, synced_chunk))
+    {
+      g_set_error_literal(
+        &local_error,
+        inf_test_sync_request_diff_error_quark(),
+        0,
+        "The synchronized session has a different text"
+      );
+    }
+
+    inf_text_chunk_free(chunk);
+    inf_text_chunk_free(synced_chunk);
+  }
+
+  inf_communication_group_set_target(
+    INF_COMMUNICATION_GROUP(server_group),
+    NULL
+  );
+
+  inf_communication_hosted_group_remove_member(
+    server_group,
+    INF_XML_CONNECTION(server_conn)
+  );
+
+  g_object_unref(synced);
+  g_object_unref(io);
+  g_object_unref(client_group);
+  g_object_unref(client_manager);
+  g_object_unref(server_group);
+  g_object_unref(server_manager);
+  g_object_unref(server_conn);
+  g_object_unref(client_conn);
+
+  if(local_error != NULL)
+  {
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+int main(int argc, char* argv[])
+{
+  InfAdoptedSessionReplay* replay;
+  InfAdoptedSession* session;
+  GError* error;
+  gsize full_bytes;
+  gsize diff_bytes;
+  gsize total_full_bytes;
+  gsize total_diff_bytes;
+  int i;
+  int ret;
+
+  if(argc < 2)
+  {
+    fprintf(stderr, "Usage: %s <record-file1> <record-file2> ...\n", argv[0]);
+    return -1;
+  }
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  ret = 0;
+  total_full_bytes = 0;
+  total_diff_bytes = 0;
+
+  for(i = 1; i < argc; ++ i)
+  {
+    fprintf(stderr, "%s... ", argv[i]);
+    fflush(stderr);
+
+    replay = inf_adopted_session_replay_new();
+    inf_adopted_session_replay_set_record(
+      replay,
+      argv[i],
+      &INF_TEST_SYNC_REQUEST_DIFF_TEXT_PLUGIN,
+      &error
+    );
+
+    if(error == NULL)
+      inf_adopted_session_replay_play_to_end(replay, &error);
+
+    if(error == NULL)
+    {
+      session = inf_adopted_session_replay_get_session(replay);
+
+      /* Peers implementing protocol 1.1 get the full vectors */
+      inf_test_sync_request_diff_run(session, "1.1", &full_bytes, &error);
+
+      if(error == NULL)
+        inf_test_sync_request_diff_run(session, "1.2", &diff_bytes, &error);
+
+      if(error == NULL)
+      {
+        fprintf(
+          stderr,
+          "%lu bytes full, %lu bytes diff (%.1f%% saved)\n",
+          (unsigned long)full_bytes,
+          (unsigned long)diff_bytes,
+          full_bytes > 0 ? 100.0 * (full_bytes - diff_bytes) / full_bytes : 0.0
+        );
+
+        g_assert(diff_bytes <= full_bytes);
+        total_full_bytes += full_bytes;
+        total_diff_bytes += diff_bytes;
+      }
+    }
+
+    if(error != NULL)
+    {
+      fprintf(stderr, "%s\n", error->message);
+      g_error_free(error);
+      error = NULL;
+
+      ret = -1;
+    }
+
+    g_object_unref(replay);
+  }
+
+  fprintf(
+    stderr,
+    "Total: %lu bytes full, %lu bytes diff\n",
+    (unsigned long)total_full_bytes,
+    (unsigned long)total_diff_bytes
+  );
+
+  return ret;
+}
+
+/* vim:set et sw=2 ts=2: */
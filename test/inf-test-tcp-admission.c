@@ -0,0 +1,297 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Connects to an InfdTcpServer on the loopback interface without ever
+ * finishing the handshake, and checks that the server closes the connection
+ * after its handshake timeout if the number of pending handshakes is
+ * limited, and keeps it open if it is not. */
+
+#include <libinfinity/server/infd-tcp-server.h>
+#include <libinfinity/common/inf-tcp-connection.h>
+#include <libinfinity/common/inf-ip-address.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+
+/* Handshake timeout of the server, in seconds */
+#define INF_TEST_TCP_ADMISSION_HANDSHAKE_TIMEOUT 1
+/* Time after which a run ends, in milliseconds */
+#define INF_TEST_TCP_ADMISSION_TIMEOUT 10000
+/* Time for which the connection is watched if it is not expected to be
+ * closed, in milliseconds */
+#define INF_TEST_TCP_ADMISSION_WATCH \
+  (2000 * INF_TEST_TCP_ADMISSION_HANDSHAKE_TIMEOUT)
+
+typedef struct _InfTestTcpAdmission InfTestTcpAdmission;
+struct _InfTestTcpAdmission {
+  InfStandaloneIo* io;
+  InfdTcpServer* server;
+  gboolean limited;
+
+  InfTcpConnection* client;
+  InfTcpConnection* accepted;
+  gboolean client_closed;
+  gboolean timed_out;
+};
+
+static void
+inf_test_tcp_admission_timeout_func(gpointer user_data)
+{
+  InfTestTcpAdmission* test;
+  test = (InfTestTcpAdmission*)user_data;
+
+  test->timed_out = TRUE;
+  inf_standalone_io_loop_quit(test->io);
+}
+
+static void
+inf_test_tcp_admission_new_connection_cb(InfdTcpServer* server,
+                                         InfTcpConnection* connection,
+                                         gpointer user_data)
+{
+  InfTestTcpAdmission* test;
+  guint pending;
+
+  test = (InfTestTcpAdmission*)user_data;
+  g_assert(test->accepted == NULL);
+
+  /* Nobody is going to run the handshake on it */
+  test->accepted = connection;
+  g_object_ref(connection);
+
+  g_object_get(G_OBJECT(server), "pending-handshakes", &pending, NULL);
+  g_assert(pending == 1);
+
+  /* Without the limit the timeout does not apply, also not to connections
+   * that were accepted before the limit was lifted. */
+  if(test->limited == FALSE)
+    g_object_set(G_OBJECT(server), "max-pending-handshakes", 0, NULL);
+}
+
+static void
+inf_test_tcp_admission_client_status_cb(GObject* object,
+                                        GParamSpec* pspec,
+                                        gpointer user_data)
+{
+  InfTestTcpAdmission* test;
+  InfTcpConnectionStatus status;
+
+  test = (InfTestTcpAdmission*)user_data;
+  g_object_get(object, "status", &status, NULL);
+
+  if(status == INF_TCP_CONNECTION_CLOSED)
+  {
+    test->client_closed = TRUE;
+    inf_standalone_io_loop_quit(test->io);
+  }
+}
+
+static int
+inf_test_tcp_admission_run(InfStandaloneIo* io,
+                           InfdTcpServer* server,
+                           guint port,
+                           gboolean limited)
+{
+  InfTestTcpAdmission test;
+  InfIpAddress* addr;
+  InfIoTimeout* timeout;
+  InfTcpConnectionStatus status;
+  guint timed_out_before;
+  guint timed_out_after;
+  guint pending;
+  GError* error;
+
+  test.io = io;
+  test.server = server;
+  test.limited = limited;
+  test.accepted = NULL;
+  test.client_closed = FALSE;
+  test.timed_out = FALSE;
+
+  g_object_set(
+    G_OBJECT(server),
+    "max-pending-handshakes", 1,
+    "handshake-timeout", INF_TEST_TCP_ADMISSION_HANDSHAKE_TIMEOUT,
+    NULL
+  );
+
+  g_object_get(
+    G_OBJECT(server),
+    "timed-out-handshakes", &timed_out_before,
+    NULL
+  );
+
+  g_signal_connect(
+    G_OBJECT(server),
+    "new-connection",
+    G_CALLBACK(inf_test_tcp_admission_new_connection_cb),
+    &test
+  );
+
+  addr = inf_ip_address_new_loopback4();
+  error = NULL;
+  test.client = inf_tcp_connection_new_and_open(
+    INF_IO(io),
+    addr,
+    port,
+    &error
+  );
+  inf_ip_address_free(addr);
+
+  if(test.client == NULL)
+  {
+    fprintf(stderr, "Could not connect: %s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  g_signal_connect(
+    G_OBJECT(test.client),
+    "notify::status",
+    G_CALLBACK(inf_test_tcp_admission_client_status_cb),
+    &test
+  );
+
+  timeout = inf_io_add_timeout(
+    INF_IO(io),
+    limited ? INF_TEST_TCP_ADMISSION_TIMEOUT : INF_TEST_TCP_ADMISSION_WATCH,
+    inf_test_tcp_admission_timeout_func,
+    &test,
+    NULL
+  );
+
+  inf_standalone_io_loop(io);
+  if(test.timed_out == FALSE)
+    inf_io_remove_timeout(INF_IO(io), timeout);
+
+  g_signal_handlers_disconnect_by_func(
+    G_OBJECT(server),
+    G_CALLBACK(inf_test_tcp_admission_new_connection_cb),
+    &test
+  );
+
+  g_signal_handlers_disconnect_by_func(
+    G_OBJECT(test.client),
+    G_CALLBACK(inf_test_tcp_admission_client_status_cb),
+    &test
+  );
+
+  g_assert(test.accepted != NULL);
+  g_object_get(G_OBJECT(test.accepted), "status", &status, NULL);
+
+  g_object_get(
+    G_OBJECT(server),
+    "timed-out-handshakes", &timed_out_after,
+    "pending-handshakes", &pending,
+    NULL
+  );
+
+  if(limited == TRUE)
+  {
+    printf(
+      "Stalled handshake with limit: client %s, server side %s\n",
+      test.client_closed ? "closed" : "still open",
+      status == INF_TCP_CONNECTION_CLOSED ? "closed" : "still open"
+    );
+
+    g_assert(test.timed_out == FALSE);
+    g_assert(test.client_closed == TRUE);
+    g_assert(status == INF_TCP_CONNECTION_CLOSED);
+    g_assert(timed_out_after == timed_out_before + 1);
+    g_assert(pending == 0);
+  }
+  else
+  {
+    printf(
+      "Stalled handshake without limit: client %s, server side %s\n",
+      test.client_closed ? "closed" : "still open",
+      status == INF_TCP_CONNECTION_CLOSED ? "closed" : "still open"
+    );
+
+    g_assert(test.timed_out == TRUE);
+    g_assert(test.client_closed == FALSE);
+    g_assert(status == INF_TCP_CONNECTION_CONNECTED);
+    g_assert(timed_out_after == timed_out_before);
+    g_assert(pending == 1);
+
+    inf_tcp_connection_close(test.client);
+  }
+
+  g_object_unref(test.accepted);
+  g_object_unref(test.client);
+  return 0;
+}
+
+int main(int argc, char* argv[])
+{
+  InfStandaloneIo* io;
+  InfdTcpServer* tcp;
+  InfIpAddress* addr;
+  guint port;
+  GError* error;
+  int ret;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  io = inf_standalone_io_new();
+  addr = inf_ip_address_new_loopback4();
+
+  tcp = g_object_new(
+    INFD_TYPE_TCP_SERVER,
+    "io", io,
+    "local-address", addr,
+    "local-port", 0,
+    NULL
+  );
+
+  inf_ip_address_free(addr);
+
+  ret = 0;
+  if(infd_tcp_server_open(tcp, &error) == FALSE)
+  {
+    fprintf(stderr, "Could not open server: %s\n", error->message);
+    g_error_free(error);
+    ret = -1;
+  }
+  else
+  {
+    g_object_get(G_OBJECT(tcp), "local-port", &port, NULL);
+
+    if(inf_test_tcp_admission_run(io, tcp, port, TRUE) != 0 ||
+       inf_test_tcp_admission_run(io, tcp, port, FALSE) != 0)
+    {
+      ret = -1;
+    }
+
+    infd_tcp_server_close(tcp);
+  }
+
+  g_object_unref(tcp);
+  g_object_unref(io);
+  return ret;
+}
+
+/* vim:set et sw=2 ts=2: */
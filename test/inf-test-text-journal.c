@@ -0,0 +1,656 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Saves a text document with an InfTextFilesystemJournal and checks the
+ * files it writes, that reading them back yields the saved document, both
+ * with and without journal, that a journal whose end has been cut off or
+ * damaged is read up to the last intact change, that invalid changes are
+ * rejected, and that a new checkpoint is written once the journal grows
+ * large. */
+
+#include "util/inf-test-util.h"
+
+#include <libinftext/inf-text-filesystem-format.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-user.h>
+
+#include <libinfinity/server/infd-filesystem-storage.h>
+
+#include <zlib.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define INF_TEST_TEXT_JOURNAL_PATH "/note"
+
+/* Size of the header of a journal for a checkpoint ID of 16 characters and
+ * UTF-8 text: magic, version, ID and encoding */
+#define INF_TEST_TEXT_JOURNAL_HEADER_SIZE (4 + 4 + 4 + 16 + 4 + 5)
+
+/* Journal size from which on a new checkpoint is written, if the previous
+ * checkpoint is smaller */
+#define INF_TEST_TEXT_JOURNAL_MIN_CHECKPOINT_SIZE (64 * 1024)
+
+/* Number of characters inserted with each write when testing rollover */
+#define INF_TEST_TEXT_JOURNAL_CHUNK_SIZE 1000
+
+/* Returns the content of the file of the note with the given identifier */
+static gchar*
+inf_test_text_journal_get_file(InfdFilesystemStorage* storage,
+                               const gchar* identifier,
+                               gsize* length)
+{
+  gchar* full_path;
+  gchar* contents;
+  gboolean result;
+
+  full_path = infd_filesystem_storage_get_path(
+    storage,
+    identifier,
+    INF_TEST_TEXT_JOURNAL_PATH,
+    NULL
+  );
+
+  g_assert(full_path != NULL);
+
+  result = g_file_get_contents(full_path, &contents, length, NULL);
+  g_assert(result == TRUE);
+
+  g_free(full_path);
+  return contents;
+}
+
+/* Replaces the content of the note's journal */
+static void
+inf_test_text_journal_set_journal(InfdFilesystemStorage* storage,
+                                  const gchar* contents,
+                                  gsize length)
+{
+  gchar* full_path;
+  gboolean result;
+
+  full_path = infd_filesystem_storage_get_path(
+    storage,
+    "journal",
+    INF_TEST_TEXT_JOURNAL_PATH,
+    NULL
+  );
+
+  g_assert(full_path != NULL);
+
+  result = g_file_set_contents(full_path, contents, length, NULL);
+  g_assert(result == TRUE);
+
+  g_free(full_path);
+}
+
+/* Returns the journal-id attribute of the note's checkpoint */
+static gchar*
+inf_test_text_journal_get_checkpoint_id(InfdFilesystemStorage* storage)
+{
+  gchar* contents;
+  gchar* attr;
+  gchar* end;
+  gchar* id;
+
+  contents = inf_test_text_journal_get_file(storage, "InfText", NULL);
+
+  attr = strstr(contents, "journal-id=\"");
+  g_assert(attr != NULL);
+
+  attr += strlen("journal-id=\"");
+  end = strchr(attr, '"');
+  g_assert(end != NULL);
+
+  id = g_strndup(attr, end - attr);
+  g_free(contents);
+  return id;
+}
+
+static gchar*
+inf_test_text_journal_get_text(InfTextBuffer* buffer)
+{
+  InfTextChunk* chunk;
+  gchar* text;
+  gsize bytes;
+
+  chunk = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+
+  text = inf_text_chunk_get_text(chunk, &bytes);
+  inf_text_chunk_free(chunk);
+
+  text = g_realloc(text, bytes + 1);
+  text[bytes] = '\0';
+  return text;
+}
+
+static void
+inf_test_text_journal_insert(InfTextBuffer* buffer,
+                             guint pos,
+                             const gchar* text,
+                             InfUser* user)
+{
+  inf_text_buffer_insert_text(
+    buffer,
+    pos,
+    text,
+    strlen(text),
+    g_utf8_strlen(text, -1),
+    user
+  );
+}
+
+/* Reads the note, with or without journal, and returns its text, or NULL if
+ * it cannot be read. If author is not NULL, the first character must have
+ * been written by the user with that name. */
+static gchar*
+inf_test_text_journal_read(InfdFilesystemStorage* storage,
+                           gboolean with_journal,
+                           const gchar* author,
+                           GError** error)
+{
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfTextFilesystemJournal* journal;
+  InfTextBufferIter* iter;
+  InfUser* user;
+  gboolean result;
+  gchar* text;
+
+  user_table = inf_user_table_new();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  if(with_journal == TRUE)
+  {
+    journal = inf_text_filesystem_journal_read(
+      storage,
+      INF_TEST_TEXT_JOURNAL_PATH,
+      user_table,
+      buffer,
+      error
+    );
+
+    result = (journal != NULL);
+    if(journal != NULL)
+      inf_text_filesystem_journal_free(journal);
+  }
+  else
+  {
+    result = inf_text_filesystem_format_read(
+      storage,
+      INF_TEST_TEXT_JOURNAL_PATH,
+      user_table,
+      buffer,
+      error
+    );
+  }
+
+  text = NULL;
+  if(result == TRUE)
+  {
+    text = inf_test_text_journal_get_text(buffer);
+
+    iter = inf_text_buffer_create_begin_iter(buffer);
+    if(iter != NULL && author != NULL)
+    {
+      user = inf_user_table_lookup_user_by_id(
+        user_table,
+        inf_text_buffer_iter_get_author(buffer, iter)
+      );
+
+      g_assert(user != NULL);
+      g_assert(strcmp(inf_user_get_name(user), author) == 0);
+    }
+
+    if(iter != NULL)
+      inf_text_buffer_destroy_iter(buffer, iter);
+  }
+
+  g_object_unref(buffer);
+  g_object_unref(user_table);
+  return text;
+}
+
+/* Checks that the note reads as expected, with and without journal */
+static void
+inf_test_text_journal_assert_stored(InfdFilesystemStorage* storage,
+                                    const gchar* expected,
+                                    const gchar* author)
+{
+  GError* error;
+  gchar* text;
+  guint i;
+
+  for(i = 0; i < 2; ++i)
+  {
+    error = NULL;
+    text = inf_test_text_journal_read(storage, i == 1, author, &error);
+
+    if(text == NULL)
+    {
+      fprintf(stderr, "Failed to read note: %s\n", error->message);
+      g_error_free(error);
+      g_assert_not_reached();
+    }
+
+    g_assert(strcmp(text, expected) == 0);
+    g_free(text);
+  }
+}
+
+/* Checks that reading the note fails because the journal is invalid */
+static void
+inf_test_text_journal_assert_invalid(InfdFilesystemStorage* storage)
+{
+  GError* error;
+  gchar* text;
+
+  error = NULL;
+  text = inf_test_text_journal_read(storage, TRUE, NULL, &error);
+
+  g_assert(text == NULL);
+  g_assert(error != NULL);
+  g_assert(error->code == INF_TEXT_FILESYSTEM_FORMAT_ERROR_INVALID_JOURNAL);
+  g_error_free(error);
+}
+
+static void
+inf_test_text_journal_write(InfTextFilesystemJournal* journal,
+                            InfdFilesystemStorage* storage)
+{
+  GError* error;
+
+  error = NULL;
+  if(!inf_text_filesystem_journal_write(journal, storage,
+                                        INF_TEST_TEXT_JOURNAL_PATH, &error))
+  {
+    fprintf(stderr, "Failed to write note: %s\n", error->message);
+    g_error_free(error);
+    g_assert_not_reached();
+  }
+}
+
+/* Appends an insertion record of the given text to a copy of journal_data,
+ * and returns the copy. */
+static gchar*
+inf_test_text_journal_append_insert(const gchar* journal_data,
+                                    gsize journal_length,
+                                    const gchar* text,
+                                    guint32 length,
+                                    gsize* result_length)
+{
+  GByteArray* array;
+  guint32 values[4];
+  guint32 checksum;
+  guint offset;
+
+  array = g_byte_array_new();
+  g_byte_array_append(array, (const guint8*)journal_data, journal_length);
+
+  offset = array->len;
+  g_byte_array_append(array, (const guint8*)"i", 1);
+
+  values[0] = GUINT32_TO_LE(4 * 4 + strlen(text));
+  values[1] = GUINT32_TO_LE(0);
+  values[2] = GUINT32_TO_LE(length);
+  values[3] = GUINT32_TO_LE(0);
+  g_byte_array_append(array, (const guint8*)values, sizeof(values));
+
+  values[0] = GUINT32_TO_LE(strlen(text));
+  g_byte_array_append(array, (const guint8*)values, 4);
+  g_byte_array_append(array, (const guint8*)text, strlen(text));
+
+  checksum = crc32(0, array->data + offset, array->len - offset);
+  checksum = GUINT32_TO_LE(checksum);
+  g_byte_array_append(array, (const guint8*)&checksum, 4);
+
+  *result_length = array->len;
+  return (gchar*)g_byte_array_free(array, FALSE);
+}
+
+/* Replaces the journal with length bytes of data, followed by n_zeros zero
+ * bytes, in which the byte at flip is inverted unless it is -1. */
+static void
+inf_test_text_journal_set_modified(InfdFilesystemStorage* storage,
+                                   const gchar* data,
+                                   gsize length,
+                                   gsize n_zeros,
+                                   gssize flip)
+{
+  gchar* modified;
+
+  modified = g_malloc0(length + n_zeros);
+  memcpy(modified, data, length);
+  if(flip >= 0)
+    modified[flip] ^= 0xff;
+
+  inf_test_text_journal_set_journal(storage, modified, length + n_zeros);
+  g_free(modified);
+}
+
+/* Checks that the note's checkpoint has a different ID than *id, and
+ * replaces *id with the new one. */
+static void
+inf_test_text_journal_assert_new_checkpoint(InfdFilesystemStorage* storage,
+                                            gchar** id)
+{
+  gchar* new_id;
+
+  new_id = inf_test_text_journal_get_checkpoint_id(storage);
+  g_assert(strcmp(new_id, *id) != 0);
+
+  g_free(*id);
+  *id = new_id;
+}
+
+static void
+inf_test_text_journal_run(InfdFilesystemStorage* storage)
+{
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfTextUser* user;
+  InfTextFilesystemJournal* journal;
+  gchar* checkpoint_id;
+  gchar* checkpoint;
+  gchar* other;
+  gchar* before;
+  gchar* after;
+  gchar* data;
+  gsize checkpoint_length;
+  gsize other_length;
+  gsize before_length;
+  gsize after_length;
+  gsize length;
+  gchar* chunk;
+  gchar* text;
+  guint n_writes;
+
+  user_table = inf_user_table_new();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+  user = inf_text_user_new(1, "Alice", NULL, 0.5);
+  inf_user_table_add_user(user_table, INF_USER(user));
+
+  /* The first write is a checkpoint with an empty journal */
+  journal = inf_text_filesystem_journal_new(user_table, buffer);
+  inf_test_text_journal_insert(buffer, 0, "Hello", INF_USER(user));
+  inf_test_text_journal_write(journal, storage);
+
+  checkpoint_id = inf_test_text_journal_get_checkpoint_id(storage);
+  g_assert(strlen(checkpoint_id) == 16);
+
+  data = inf_test_text_journal_get_file(storage, "journal", &length);
+  g_assert(length == INF_TEST_TEXT_JOURNAL_HEADER_SIZE);
+  g_assert(memcmp(data, "INFJ", 4) == 0);
+  g_assert(memcmp(data + 12, checkpoint_id, 16) == 0);
+  g_assert(memcmp(data + 32, "UTF-8", 5) == 0);
+  g_free(data);
+
+  inf_test_text_journal_assert_stored(storage, "Hello", "Alice");
+
+  /* Further changes are only appended to the journal */
+  checkpoint = inf_test_text_journal_get_file(
+    storage,
+    "InfText",
+    &checkpoint_length
+  );
+
+  inf_test_text_journal_insert(buffer, 5, ", W\xc3\xb6rld", NULL);
+  inf_text_buffer_erase_text(buffer, 7, 1, NULL);
+  inf_test_text_journal_insert(buffer, 7, "w", NULL);
+  inf_test_text_journal_write(journal, storage);
+
+  other = inf_test_text_journal_get_file(storage, "InfText", &other_length);
+  g_assert(other_length == checkpoint_length);
+  g_assert(memcmp(checkpoint, other, other_length) == 0);
+  g_free(other);
+  g_free(checkpoint);
+
+  inf_test_text_journal_assert_stored(storage, "Hello, w\xc3\xb6rld", "Alice");
+
+  printf("Journal appends changes to checkpoint\n");
+
+  /* A journal whose last change has been written partially, or has been
+   * damaged, possibly followed by zeros, is read up to the change before */
+  before = inf_test_text_journal_get_file(storage, "journal", &before_length);
+
+  inf_test_text_journal_insert(buffer, 12, "!", INF_USER(user));
+  inf_test_text_journal_write(journal, storage);
+
+  after = inf_test_text_journal_get_file(storage, "journal", &after_length);
+  g_assert(after_length > before_length);
+
+  inf_test_text_journal_set_modified(storage, after, after_length - 1, 0, -1);
+  inf_test_text_journal_assert_stored(storage, "Hello, w\xc3\xb6rld", "Alice");
+
+  inf_test_text_journal_set_modified(
+    storage,
+    after,
+    after_length,
+    0,
+    after_length - 1
+  );
+
+  inf_test_text_journal_assert_stored(storage, "Hello, w\xc3\xb6rld", "Alice");
+
+  inf_test_text_journal_set_modified(
+    storage,
+    after,
+    after_length,
+    64,
+    after_length - 1
+  );
+
+  inf_test_text_journal_assert_stored(storage, "Hello, w\xc3\xb6rld", "Alice");
+
+  inf_test_text_journal_set_modified(storage, after, after_length, 64, -1);
+  inf_test_text_journal_assert_stored(storage, "Hello, w\xc3\xb6rld!", "Alice");
+
+  /* A damaged change that is followed by other changes cannot be skipped */
+  inf_test_text_journal_set_modified(
+    storage,
+    after,
+    after_length,
+    0,
+    before_length - 1
+  );
+
+  inf_test_text_journal_assert_invalid(storage);
+
+  g_free(before);
+
+  /* Writing after reading a cut-off journal creates a new checkpoint, since
+   * appending would leave the partial change in between */
+  inf_test_text_journal_set_modified(storage, after, after_length - 1, 0, -1);
+  g_free(after);
+
+  inf_text_filesystem_journal_free(journal);
+  g_object_unref(buffer);
+  g_object_unref(user_table);
+
+  user_table = inf_user_table_new();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+  journal = inf_text_filesystem_journal_read(
+    storage,
+    INF_TEST_TEXT_JOURNAL_PATH,
+    user_table,
+    buffer,
+    NULL
+  );
+
+  g_assert(journal != NULL);
+
+  inf_test_text_journal_insert(buffer, 12, "?", NULL);
+  inf_test_text_journal_write(journal, storage);
+  inf_test_text_journal_assert_new_checkpoint(storage, &checkpoint_id);
+
+  data = inf_test_text_journal_get_file(storage, "journal", &length);
+  g_assert(length == INF_TEST_TEXT_JOURNAL_HEADER_SIZE);
+  inf_test_text_journal_assert_stored(storage, "Hello, w\xc3\xb6rld?", "Alice");
+
+  printf("Journal is read up to the last intact change\n");
+
+  /* Insertions whose text is not valid UTF-8, or does not have as many
+   * characters as the record says, are rejected even if the record is
+   * intact */
+  other = inf_test_text_journal_append_insert(
+    data,
+    length,
+    "\xc3\x28",
+    1,
+    &other_length
+  );
+
+  inf_test_text_journal_set_journal(storage, other, other_length);
+  inf_test_text_journal_assert_invalid(storage);
+  g_free(other);
+
+  other = inf_test_text_journal_append_insert(
+    data,
+    length,
+    "w\xc3\xb6rld",
+    4,
+    &other_length
+  );
+
+  inf_test_text_journal_set_journal(storage, other, other_length);
+  inf_test_text_journal_assert_invalid(storage);
+  g_free(other);
+
+  other = inf_test_text_journal_append_insert(
+    data,
+    length,
+    "w\xc3\xb6rld",
+    5,
+    &other_length
+  );
+
+  inf_test_text_journal_set_journal(storage, other, other_length);
+  inf_test_text_journal_assert_stored(
+    storage,
+    "w\xc3\xb6rldHello, w\xc3\xb6rld?",
+    NULL
+  );
+
+  g_free(other);
+
+  inf_test_text_journal_set_journal(storage, data, length);
+  g_free(data);
+
+  printf("Invalid changes are rejected\n");
+
+  /* Once the journal would grow larger than the minimum checkpoint size,
+   * the next write is a checkpoint */
+  chunk = g_malloc(INF_TEST_TEXT_JOURNAL_CHUNK_SIZE + 1);
+  memset(chunk, 'a', INF_TEST_TEXT_JOURNAL_CHUNK_SIZE);
+  chunk[INF_TEST_TEXT_JOURNAL_CHUNK_SIZE] = '\0';
+
+  before = NULL;
+  before_length = 0;
+
+  for(n_writes = 0; ; ++n_writes)
+  {
+    g_assert(n_writes < 1000);
+
+    g_free(before);
+    before = inf_test_text_journal_get_file(
+      storage,
+      "journal",
+      &before_length
+    );
+
+    inf_test_text_journal_insert(
+      buffer,
+      inf_text_buffer_get_length(buffer),
+      chunk,
+      NULL
+    );
+
+    inf_test_text_journal_write(journal, storage);
+
+    other = inf_test_text_journal_get_checkpoint_id(storage);
+    if(strcmp(other, checkpoint_id) != 0)
+    {
+      g_free(other);
+      break;
+    }
+
+    g_free(other);
+  }
+
+  g_free(chunk);
+
+  g_assert(before_length <= INF_TEST_TEXT_JOURNAL_MIN_CHECKPOINT_SIZE);
+  g_assert(
+    before_length + 2 * INF_TEST_TEXT_JOURNAL_CHUNK_SIZE >
+    INF_TEST_TEXT_JOURNAL_MIN_CHECKPOINT_SIZE
+  );
+
+  inf_test_text_journal_assert_new_checkpoint(storage, &checkpoint_id);
+
+  data = inf_test_text_journal_get_file(storage, "journal", &length);
+  g_assert(length == INF_TEST_TEXT_JOURNAL_HEADER_SIZE);
+  g_assert(memcmp(data + 12, checkpoint_id, 16) == 0);
+  g_free(data);
+
+  text = inf_test_text_journal_get_text(buffer);
+  inf_test_text_journal_assert_stored(storage, text, "Alice");
+
+  /* The journal of the previous checkpoint is ignored */
+  inf_test_text_journal_set_journal(storage, before, before_length);
+  inf_test_text_journal_assert_stored(storage, text, "Alice");
+  g_free(before);
+  g_free(text);
+
+  printf("Checkpoint written after %u appends\n", n_writes);
+
+  g_free(checkpoint_id);
+  inf_text_filesystem_journal_free(journal);
+  g_object_unref(user);
+  g_object_unref(buffer);
+  g_object_unref(user_table);
+}
+
+static gboolean
+inf_test_text_journal_main(const gchar* path,
+                           gpointer user_data,
+                           GError** error)
+{
+  InfdFilesystemStorage* storage;
+
+  storage = infd_filesystem_storage_new(path);
+  inf_test_text_journal_run(storage);
+  g_object_unref(storage);
+
+  return TRUE;
+}
+
+int main(int argc, char* argv[])
+{
+  return inf_test_util_run_in_tmpdir(
+    "inf-test-text-journal",
+    inf_test_text_journal_main,
+    NULL
+  );
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,552 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Synchronizes a text session with text of several authors and characters
+ * of different sizes to new sessions via simulated connections, which
+ * produces the synchronization messages while sending. Several sessions
+ * start synchronizing at the same time and receive at different speeds,
+ * and the text is changed after the synchronization has started. Another
+ * session starts synchronizing when the others are already in progress.
+ * Verifies that all sessions end up with the text at the time their
+ * synchronization started, and that no sync-segment message is larger than
+ * 1024 bytes. This is done for a UTF-8 and a UTF-16 buffer. The number of
+ * sessions to synchronize to at the same time can be given on the command
+ * line. */
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-user.h>
+#include <libinfinity/communication/inf-communication-hosted-group.h>
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/common/inf-simulated-connection.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-user-table.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INF_TEST_TEXT_SYNC_STREAM_GROUP "InfTestTextSyncStream"
+#define INF_TEST_TEXT_SYNC_STREAM_DEFAULT_JOINERS 8
+
+/* Maximum number of bytes in the text of a sync-segment message */
+#define INF_TEST_TEXT_SYNC_STREAM_MAX_SEGMENT 1024
+
+typedef struct _InfTestTextSyncStreamJoiner InfTestTextSyncStreamJoiner;
+struct _InfTestTextSyncStreamJoiner {
+  InfSimulatedConnection* server_conn;
+  InfSimulatedConnection* client_conn;
+  InfCommunicationManager* manager;
+  InfCommunicationJoinedGroup* group;
+  InfTextSession* session;
+
+  /* The text at the time the synchronization started */
+  InfTextChunk* expected;
+  guint n_expected_segments;
+
+  guint n_segments;
+  gsize max_segment;
+  GError* error;
+};
+
+typedef struct _InfTestTextSyncStreamSegment InfTestTextSyncStreamSegment;
+struct _InfTestTextSyncStreamSegment {
+  guint author;
+  const gchar* text;
+  guint repeat;
+};
+
+/* Author 0 does not need a user. Each text is a single character so that
+ * the lengths are easy to tell. */
+static const InfTestTextSyncStreamSegment INF_TEST_TEXT_SYNC_STREAM_TEXT[] = {
+  { 1, "a", 700 },
+  { 0, "\xc3\xa4", 300 },                  /* a-umlaut, 2 bytes */
+  { 2, "\xe2\x82\xac", 256 },              /* euro sign, 3 bytes */
+  { 3, "\xf0\x9d\x84\x9e", 600 },          /* g-clef, 4 bytes */
+  { 1, "z", 1 }
+};
+
+static void
+inf_test_text_sync_stream_sent_cb(InfXmlConnection* connection,
+                                  xmlNodePtr xml,
+                                  gpointer user_data)
+{
+  InfTestTextSyncStreamJoiner* joiner;
+  xmlNodePtr child;
+  xmlChar* content;
+  gsize bytes;
+
+  joiner = (InfTestTextSyncStreamJoiner*)user_data;
+
+  /* The registry sends the messages of a group in a container */
+  for(child = xml->children; child != NULL; child = child->next)
+  {
+    if(child->type != XML_ELEMENT_NODE) continue;
+    if(strcmp((const char*)child->name, "sync-segment") != 0) continue;
+
+    content = xmlNodeGetContent(child);
+    bytes = strlen((const char*)content);
+    xmlFree(content);
+
+    ++ joiner->n_segments;
+    if(bytes > joiner->max_segment)
+      joiner->max_segment = bytes;
+  }
+}
+
+static void
+inf_test_text_sync_stream_failed_cb(InfSession* session,
+                                    InfXmlConnection* connection,
+                                    const GError* error,
+                                    gpointer user_data)
+{
+  InfTestTextSyncStreamJoiner* joiner;
+  joiner = (InfTestTextSyncStreamJoiner*)user_data;
+
+  if(joiner->error == NULL)
+    joiner->error = g_error_copy(error);
+}
+
+static InfTextSession*
+inf_test_text_sync_stream_create_server(InfCommunicationManager* manager,
+                                        InfIo* io,
+                                        const gchar* encoding)
+{
+  InfTextBuffer* buffer;
+  InfUserTable* user_table;
+  InfTextSession* session;
+  InfUser* user;
+  GString* utf8;
+  gchar* name;
+  gchar* text;
+  gsize bytes;
+  guint i;
+  guint j;
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new(encoding));
+  user_table = inf_user_table_new();
+
+  for(i = 1; i <= 3; ++ i)
+  {
+    name = g_strdup_printf("User_%u", i);
+
+    user = INF_USER(
+      g_object_new(
+        INF_TEXT_TYPE_USER,
+        "id", i,
+        "name", name,
+        "status", INF_USER_UNAVAILABLE,
+        "flags", 0,
+        NULL
+      )
+    );
+
+    g_free(name);
+    inf_user_table_add_user(user_table, user);
+    g_object_unref(user);
+  }
+
+  for(i = 0; i < G_N_ELEMENTS(INF_TEST_TEXT_SYNC_STREAM_TEXT); ++ i)
+  {
+    utf8 = g_string_new(NULL);
+    for(j = 0; j < INF_TEST_TEXT_SYNC_STREAM_TEXT[i].repeat; ++ j)
+      g_string_append(utf8, INF_TEST_TEXT_SYNC_STREAM_TEXT[i].text);
+
+    text = g_convert(
+      utf8->str,
+      utf8->len,
+      encoding,
+      "UTF-8",
+      NULL,
+      &bytes,
+      NULL
+    );
+
+    g_assert(text != NULL);
+    g_string_free(utf8, TRUE);
+
+    if(INF_TEST_TEXT_SYNC_STREAM_TEXT[i].author != 0)
+    {
+      user = inf_user_table_lookup_user_by_id(
+        user_table,
+        INF_TEST_TEXT_SYNC_STREAM_TEXT[i].author
+      );
+    }
+    else
+    {
+      user = NULL;
+    }
+
+    inf_text_buffer_insert_text(
+      buffer,
+      inf_text_buffer_get_length(buffer),
+      text,
+      bytes,
+      INF_TEST_TEXT_SYNC_STREAM_TEXT[i].repeat,
+      user
+    );
+
+    g_free(text);
+  }
+
+  session = INF_TEXT_SESSION(
+    g_object_new(
+      INF_TEXT_TYPE_SESSION,
+      "communication-manager", manager,
+      "buffer", buffer,
+      "io", io,
+      "user-table", user_table,
+      NULL
+    )
+  );
+
+  g_object_unref(user_table);
+  g_object_unref(buffer);
+  return session;
+}
+
+/* Returns the number of sync-segment messages for chunk, with every
+ * message containing at most 256 characters. */
+static guint
+inf_test_text_sync_stream_count_segments(InfTextChunk* chunk)
+{
+  InfTextChunkIter iter;
+  gboolean result;
+  guint count;
+
+  count = 0;
+  result = inf_text_chunk_iter_init_begin(chunk, &iter);
+  while(result == TRUE)
+  {
+    count += (inf_text_chunk_iter_get_length(&iter) + 255) / 256;
+    result = inf_text_chunk_iter_next(&iter);
+  }
+
+  return count;
+}
+
+/* Creates a new session and starts synchronizing server to it */
+static void
+inf_test_text_sync_stream_joiner_init(InfTestTextSyncStreamJoiner* joiner,
+                                      InfTextSession* server,
+                                      InfCommunicationHostedGroup* group,
+                                      InfIo* io,
+                                      const gchar* encoding)
+{
+  InfTextBuffer* buffer;
+
+  joiner->server_conn = inf_simulated_connection_new();
+  joiner->client_conn = inf_simulated_connection_new();
+  inf_simulated_connection_connect(joiner->server_conn, joiner->client_conn);
+
+  inf_simulated_connection_set_mode(
+    joiner->server_conn,
+    INF_SIMULATED_CONNECTION_DELAYED
+  );
+
+  inf_simulated_connection_set_mode(
+    joiner->client_conn,
+    INF_SIMULATED_CONNECTION_DELAYED
+  );
+
+  inf_communication_hosted_group_add_member(
+    group,
+    INF_XML_CONNECTION(joiner->server_conn)
+  );
+
+  joiner->manager = inf_communication_manager_new();
+  joiner->group = inf_communication_manager_join_group(
+    joiner->manager,
+    INF_TEST_TEXT_SYNC_STREAM_GROUP,
+    INF_XML_CONNECTION(joiner->client_conn),
+    "central"
+  );
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new(encoding));
+  joiner->session = inf_text_session_new(
+    joiner->manager,
+    buffer,
+    io,
+    INF_SESSION_SYNCHRONIZING,
+    INF_COMMUNICATION_GROUP(joiner->group),
+    INF_XML_CONNECTION(joiner->client_conn)
+  );
+  g_object_unref(buffer);
+
+  inf_communication_group_set_target(
+    INF_COMMUNICATION_GROUP(joiner->group),
+    INF_COMMUNICATION_OBJECT(joiner->session)
+  );
+
+  joiner->n_segments = 0;
+  joiner->max_segment = 0;
+  joiner->error = NULL;
+
+  g_signal_connect(
+    G_OBJECT(joiner->server_conn),
+    "sent",
+    G_CALLBACK(inf_test_text_sync_stream_sent_cb),
+    joiner
+  );
+
+  g_signal_connect(
+    G_OBJECT(joiner->session),
+    "synchronization-failed",
+    G_CALLBACK(inf_test_text_sync_stream_failed_cb),
+    joiner
+  );
+
+  inf_session_synchronize_to(
+    INF_SESSION(server),
+    INF_COMMUNICATION_GROUP(group),
+    INF_XML_CONNECTION(joiner->server_conn)
+  );
+
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(INF_SESSION(server)));
+  joiner->expected = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+
+  joiner->n_expected_segments =
+    inf_test_text_sync_stream_count_segments(joiner->expected);
+}
+
+static void
+inf_test_text_sync_stream_joiner_finalize(InfTestTextSyncStreamJoiner* joiner,
+                                          InfCommunicationHostedGroup* group)
+{
+  inf_communication_hosted_group_remove_member(
+    group,
+    INF_XML_CONNECTION(joiner->server_conn)
+  );
+
+  g_object_unref(joiner->session);
+  g_object_unref(joiner->group);
+  g_object_unref(joiner->manager);
+  g_object_unref(joiner->server_conn);
+  g_object_unref(joiner->client_conn);
+
+  inf_text_chunk_free(joiner->expected);
+
+  if(joiner->error != NULL)
+    g_error_free(joiner->error);
+}
+
+static gboolean
+inf_test_text_sync_stream_run(const gchar* encoding,
+                              guint n_joiners)
+{
+  InfIo* io;
+  InfCommunicationManager* manager;
+  InfCommunicationHostedGroup* group;
+  InfTextSession* session;
+  InfTextBuffer* buffer;
+  InfTextChunk* chunk;
+  InfTestTextSyncStreamJoiner* joiners;
+  InfSessionSyncStatus sync_status;
+  gboolean done;
+  gboolean result;
+  guint n_active;
+  guint rounds;
+  guint i;
+
+  io = INF_IO(inf_standalone_io_new());
+  manager = inf_communication_manager_new();
+  session = inf_test_text_sync_stream_create_server(manager, io, encoding);
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(INF_SESSION(session)));
+
+  group = inf_communication_manager_open_group(
+    manager,
+    INF_TEST_TEXT_SYNC_STREAM_GROUP,
+    NULL
+  );
+
+  inf_communication_hosted_group_add_method(group, "central");
+  inf_communication_group_set_target(
+    INF_COMMUNICATION_GROUP(group),
+    INF_COMMUNICATION_OBJECT(session)
+  );
+
+  /* All but the last session start synchronizing at the same time, and
+   * share the messages. The last one starts when the others have already
+   * received some of them. */
+  joiners = g_new(InfTestTextSyncStreamJoiner, n_joiners + 1);
+  for(i = 0; i < n_joiners; ++ i)
+  {
+    inf_test_text_sync_stream_joiner_init(
+      &joiners[i],
+      session,
+      group,
+      io,
+      encoding
+    );
+  }
+
+  /* Changes after the synchronization has started are not part of it */
+  inf_text_buffer_erase_text(buffer, 0, 100, NULL);
+
+  n_active = n_joiners;
+  done = FALSE;
+  for(rounds = 0; !done && rounds < 10000; ++ rounds)
+  {
+    if(rounds == 3)
+    {
+      inf_test_text_sync_stream_joiner_init(
+        &joiners[n_joiners],
+        session,
+        group,
+        io,
+        encoding
+      );
+
+      ++ n_active;
+    }
+
+    done = (n_active > n_joiners);
+    for(i = 0; i < n_active; ++ i)
+    {
+      /* Let the sessions receive at different speeds, so that the shared
+       * messages are taken at different times. */
+      if(rounds % (i % 4 + 1) == 0)
+        inf_simulated_connection_flush(joiners[i].server_conn);
+      inf_simulated_connection_flush(joiners[i].client_conn);
+
+      sync_status = inf_session_get_synchronization_status(
+        INF_SESSION(session),
+        INF_XML_CONNECTION(joiners[i].server_conn)
+      );
+
+      if(joiners[i].error == NULL &&
+         (sync_status != INF_SESSION_SYNC_NONE ||
+          inf_session_get_status(INF_SESSION(joiners[i].session)) !=
+            INF_SESSION_RUNNING))
+      {
+        done = FALSE;
+      }
+    }
+  }
+
+  result = TRUE;
+  for(i = 0; i < n_joiners + 1; ++ i)
+  {
+    if(joiners[i].error != NULL)
+    {
+      fprintf(
+        stderr,
+        "%s: Synchronization %u failed: %s\n",
+        encoding,
+        i,
+        joiners[i].error->message
+      );
+
+      result = FALSE;
+      continue;
+    }
+
+    g_assert(
+      inf_session_get_status(INF_SESSION(joiners[i].session)) ==
+      INF_SESSION_RUNNING
+    );
+
+    buffer = INF_TEXT_BUFFER(
+      inf_session_get_buffer(INF_SESSION(joiners[i].session))
+    );
+
+    chunk = inf_text_buffer_get_slice(
+      buffer,
+      0,
+      inf_text_buffer_get_length(buffer)
+    );
+
+    if(!inf_text_chunk_equal(chunk, joiners[i].expected))
+    {
+      fprintf(
+        stderr,
+        "%s: Synchronization %u has different text\n",
+        encoding,
+        i
+      );
+
+      result = FALSE;
+    }
+
+    inf_text_chunk_free(chunk);
+
+    g_assert(joiners[i].n_segments == joiners[i].n_expected_segments);
+    g_assert(joiners[i].max_segment <= INF_TEST_TEXT_SYNC_STREAM_MAX_SEGMENT);
+  }
+
+  if(result == TRUE)
+  {
+    printf(
+      "%s: %u sessions synchronized in %u rounds\n",
+      encoding,
+      n_joiners + 1,
+      rounds
+    );
+  }
+
+  for(i = 0; i < n_joiners + 1; ++ i)
+    inf_test_text_sync_stream_joiner_finalize(&joiners[i], group);
+
+  g_free(joiners);
+  g_object_unref(group);
+  g_object_unref(session);
+  g_object_unref(manager);
+  g_object_unref(io);
+
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  guint n_joiners;
+  GError* error;
+  int ret;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  n_joiners = INF_TEST_TEXT_SYNC_STREAM_DEFAULT_JOINERS;
+  if(argc > 1) n_joiners = strtoul(argv[1], NULL, 10);
+
+  if(n_joiners == 0)
+  {
+    fprintf(stderr, "Usage: %s [sessions]\n", argv[0]);
+    return -1;
+  }
+
+  ret = 0;
+  if(!inf_test_text_sync_stream_run("UTF-8", n_joiners))
+    ret = -1;
+  if(!inf_test_text_sync_stream_run("UTF-16LE", n_joiners))
+    ret = -1;
+
+  return ret;
+}
+
+/* vim:set et sw=2 ts=2: */
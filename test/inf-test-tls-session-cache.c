@@ -0,0 +1,199 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Adds client connections to an InfXmppManager and checks that the TLS
+ * session of one of them is only handed to later connections to the same
+ * host and port, including connections whose port only becomes known after
+ * they have been added. Server connections never get a session. */
+
+#include <libinfinity/common/inf-xmpp-manager.h>
+#include <libinfinity/common/inf-xmpp-connection.h>
+#include <libinfinity/common/inf-tcp-connection.h>
+#include <libinfinity/common/inf-ip-address.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define INF_TEST_TLS_SESSION_CACHE_PORT 6523
+
+/* Creates a connection to address and port, and adds it to manager. The
+ * TCP connection is not opened. */
+static InfXmppConnection*
+inf_test_tls_session_cache_add(InfXmppManager* manager,
+                               InfStandaloneIo* io,
+                               const gchar* address,
+                               guint port,
+                               InfXmppConnectionSite site)
+{
+  InfIpAddress* addr;
+  InfTcpConnection* tcp;
+  InfXmppConnection* xmpp;
+
+  addr = inf_ip_address_new_from_string(address);
+  g_assert(addr != NULL);
+
+  tcp = inf_tcp_connection_new(INF_IO(io), addr, port);
+  inf_ip_address_free(addr);
+
+  xmpp = INF_XMPP_CONNECTION(
+    g_object_new(
+      INF_TYPE_XMPP_CONNECTION,
+      "tcp-connection", tcp,
+      "site", site,
+      "local-hostname", "localhost",
+      "remote-hostname", "localhost",
+      "security-policy", INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED,
+      NULL
+    )
+  );
+
+  g_object_unref(tcp);
+
+  inf_xmpp_manager_add_connection(manager, xmpp);
+  return xmpp;
+}
+
+/* Returns whether xmpp is going to resume the session with data */
+static gboolean
+inf_test_tls_session_cache_has_session(InfXmppConnection* xmpp,
+                                       GBytes* data)
+{
+  GBytes* session;
+  gboolean result;
+
+  g_object_get(G_OBJECT(xmpp), "tls-session-data", &session, NULL);
+  if(session == NULL)
+    return FALSE;
+
+  result = g_bytes_equal(session, data);
+  g_bytes_unref(session);
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  InfStandaloneIo* io;
+  InfXmppManager* manager;
+  InfXmppConnection* first;
+  InfXmppConnection* same;
+  InfXmppConnection* other_port;
+  InfXmppConnection* late_port;
+  InfXmppConnection* server;
+  InfTcpConnection* tcp;
+  GBytes* data;
+  GError* error;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  io = inf_standalone_io_new();
+  manager = inf_xmpp_manager_new();
+
+  /* The session data is opaque to the manager */
+  data = g_bytes_new_static("session", strlen("session"));
+
+  first = inf_test_tls_session_cache_add(
+    manager,
+    io,
+    "127.0.0.1",
+    INF_TEST_TLS_SESSION_CACHE_PORT,
+    INF_XMPP_CONNECTION_CLIENT
+  );
+
+  g_assert(!inf_test_tls_session_cache_has_session(first, data));
+
+  /* This is what the connection does when its TLS session ends */
+  g_object_set(G_OBJECT(first), "tls-session-data", data, NULL);
+
+  /* A different address of the same host, with the same port */
+  same = inf_test_tls_session_cache_add(
+    manager,
+    io,
+    "127.0.0.2",
+    INF_TEST_TLS_SESSION_CACHE_PORT,
+    INF_XMPP_CONNECTION_CLIENT
+  );
+
+  g_assert(inf_test_tls_session_cache_has_session(same, data));
+
+  /* Another server on the same host */
+  other_port = inf_test_tls_session_cache_add(
+    manager,
+    io,
+    "127.0.0.1",
+    INF_TEST_TLS_SESSION_CACHE_PORT + 1,
+    INF_XMPP_CONNECTION_CLIENT
+  );
+
+  g_assert(!inf_test_tls_session_cache_has_session(other_port, data));
+
+  /* The port changes before the connection is opened, as it happens when
+   * the hostname of a connection is resolved */
+  late_port = inf_test_tls_session_cache_add(
+    manager,
+    io,
+    "127.0.0.3",
+    INF_TEST_TLS_SESSION_CACHE_PORT + 2,
+    INF_XMPP_CONNECTION_CLIENT
+  );
+
+  g_assert(!inf_test_tls_session_cache_has_session(late_port, data));
+
+  g_object_get(G_OBJECT(late_port), "tcp-connection", &tcp, NULL);
+  g_object_set(
+    G_OBJECT(tcp),
+    "remote-port", INF_TEST_TLS_SESSION_CACHE_PORT,
+    NULL
+  );
+  g_object_unref(tcp);
+
+  g_assert(inf_test_tls_session_cache_has_session(late_port, data));
+
+  /* Servers do not resume sessions */
+  server = inf_test_tls_session_cache_add(
+    manager,
+    io,
+    "127.0.0.4",
+    INF_TEST_TLS_SESSION_CACHE_PORT,
+    INF_XMPP_CONNECTION_SERVER
+  );
+
+  g_assert(!inf_test_tls_session_cache_has_session(server, data));
+
+  printf("TLS sessions are cached by host and port\n");
+
+  g_object_unref(server);
+  g_object_unref(late_port);
+  g_object_unref(other_port);
+  g_object_unref(same);
+  g_object_unref(first);
+  g_object_unref(manager);
+  g_bytes_unref(data);
+  g_object_unref(io);
+  return 0;
+}
+
+/* vim:set et sw=2 ts=2: */
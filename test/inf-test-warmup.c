@@ -0,0 +1,456 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Loads the warmup plugin into a directory with three notes and usage
+ * counts from two half-lives ago, which also contain a note that does not
+ * exist anymore. Checks that the counts have decayed, that the missing note
+ * is dropped and the next most used one is loaded in its place, and that
+ * the counts of a note are dropped when it is removed. */
+
+#include "util/inf-test-util.h"
+
+#include <infinoted/infinoted-plugin-manager.h>
+#include <infinoted/infinoted-log.h>
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-filesystem-format.h>
+
+#include <libinfinity/server/infd-directory.h>
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-xml-util.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/* Must match the half-life of the usage counts in the plugin */
+#define INF_TEST_WARMUP_HALF_LIFE (7 * 24 * 60 * 60)
+/* Time after which the test fails, in milliseconds */
+#define INF_TEST_WARMUP_TIMEOUT 10000
+
+typedef struct _InfTestWarmup InfTestWarmup;
+struct _InfTestWarmup {
+  InfStandaloneIo* io;
+  guint n_subscribed;
+  gboolean timed_out;
+};
+
+static InfSession*
+inf_test_warmup_session_new(InfIo* io,
+                            InfCommunicationManager* manager,
+                            InfSessionStatus status,
+                            InfCommunicationGroup* sync_group,
+                            InfXmlConnection* sync_connection,
+                            const gchar* path,
+                            gpointer user_data)
+{
+  InfTextSession* session;
+  InfTextBuffer* buffer;
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  session = inf_text_session_new(
+    manager,
+    buffer,
+    io,
+    status,
+    sync_group,
+    sync_connection
+  );
+
+  g_object_unref(buffer);
+  return INF_SESSION(session);
+}
+
+static InfSession*
+inf_test_warmup_session_read(InfdStorage* storage,
+                             InfIo* io,
+                             InfCommunicationManager* manager,
+                             const gchar* path,
+                             gpointer user_data,
+                             GError** error)
+{
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfTextSession* session;
+
+  user_table = inf_user_table_new();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  if(!inf_text_filesystem_format_read(
+       INFD_FILESYSTEM_STORAGE(storage),
+       path,
+       user_table,
+       buffer,
+       error))
+  {
+    g_object_unref(user_table);
+    g_object_unref(buffer);
+    return NULL;
+  }
+
+  session = inf_text_session_new_with_user_table(
+    manager,
+    buffer,
+    io,
+    user_table,
+    INF_SESSION_RUNNING,
+    NULL,
+    NULL
+  );
+
+  g_object_unref(user_table);
+  g_object_unref(buffer);
+  return INF_SESSION(session);
+}
+
+static gboolean
+inf_test_warmup_session_write(InfdStorage* storage,
+                              InfSession* session,
+                              const gchar* path,
+                              gpointer user_data,
+                              GError** error)
+{
+  return inf_text_filesystem_format_write(
+    INFD_FILESYSTEM_STORAGE(storage),
+    path,
+    inf_session_get_user_table(session),
+    INF_TEXT_BUFFER(inf_session_get_buffer(session)),
+    error
+  );
+}
+
+static const InfdNotePlugin INF_TEST_WARMUP_PLUGIN = {
+  NULL,
+  "InfdFilesystemStorage",
+  "InfText",
+  inf_test_warmup_session_new,
+  inf_test_warmup_session_read,
+  inf_test_warmup_session_write,
+  NULL
+};
+
+static gboolean
+inf_test_warmup_write_note(InfdFilesystemStorage* storage,
+                           const gchar* path,
+                           GError** error)
+{
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  gboolean result;
+
+  user_table = inf_user_table_new();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  result = inf_text_filesystem_format_write(
+    storage,
+    path,
+    user_table,
+    buffer,
+    error
+  );
+
+  g_object_unref(user_table);
+  g_object_unref(buffer);
+  return result;
+}
+
+static gboolean
+inf_test_warmup_write_usage(InfdFilesystemStorage* storage,
+                            GError** error)
+{
+  static const struct {
+    const gchar* path;
+    guint count;
+  } usages[] = {
+    { "/a", 8 },
+    { "/gone", 100 },
+    { "/b", 4 },
+    { "/c", 2 }
+  };
+
+  xmlDocPtr doc;
+  xmlNodePtr root;
+  xmlNodePtr child;
+  gboolean result;
+  guint i;
+
+  doc = xmlNewDoc((const xmlChar*)"1.0");
+  root = xmlNewDocNode(
+    doc,
+    NULL,
+    (const xmlChar*)"infinoted-warmup-usage",
+    NULL
+  );
+
+  xmlDocSetRootElement(doc, root);
+
+  /* A little more than two half-lives ago */
+  inf_xml_util_set_attribute_uint(
+    root,
+    "decay-time",
+    g_get_real_time() / G_USEC_PER_SEC - 2 * INF_TEST_WARMUP_HALF_LIFE - 60
+  );
+
+  for(i = 0; i < G_N_ELEMENTS(usages); ++i)
+  {
+    child = xmlNewChild(root, NULL, (const xmlChar*)"note", NULL);
+    inf_xml_util_set_attribute(child, "path", usages[i].path);
+    inf_xml_util_set_attribute_uint(child, "count", usages[i].count);
+  }
+
+  result = infd_filesystem_storage_write_xml_file(
+    storage,
+    "xml",
+    "/warmup-usage",
+    doc,
+    error
+  );
+
+  xmlFreeDoc(doc);
+  return result;
+}
+
+/* Returns the count for path in the usage file, or 0 if it has none */
+static guint
+inf_test_warmup_read_count(xmlDocPtr doc,
+                           const gchar* path)
+{
+  xmlNodePtr child;
+  xmlChar* child_path;
+  guint count;
+  gboolean found;
+
+  for(child = xmlDocGetRootElement(doc)->children;
+      child != NULL;
+      child = child->next)
+  {
+    if(child->type != XML_ELEMENT_NODE) continue;
+
+    child_path = xmlGetProp(child, (const xmlChar*)"path");
+    g_assert(child_path != NULL);
+
+    found = (strcmp((const char*)child_path, path) == 0);
+    xmlFree(child_path);
+
+    if(found)
+    {
+      g_assert(
+        inf_xml_util_get_attribute_uint_required(child, "count", &count, NULL)
+      );
+
+      return count;
+    }
+  }
+
+  return 0;
+}
+
+static void
+inf_test_warmup_find(InfBrowser* browser,
+                     const gchar* name,
+                     InfBrowserIter* iter)
+{
+  inf_browser_get_root(browser, iter);
+  if(!inf_browser_get_explored(browser, iter))
+    inf_browser_explore(browser, iter, NULL, NULL);
+
+  g_assert(inf_browser_get_child(browser, iter));
+  while(strcmp(inf_browser_get_node_name(browser, iter), name) != 0)
+    g_assert(inf_browser_get_next(browser, iter));
+}
+
+static gboolean
+inf_test_warmup_has_session(InfBrowser* browser,
+                            const gchar* name)
+{
+  InfBrowserIter iter;
+  inf_test_warmup_find(browser, name, &iter);
+  return inf_browser_get_session(browser, &iter) != NULL;
+}
+
+static void
+inf_test_warmup_subscribe_session_cb(InfBrowser* browser,
+                                     const InfBrowserIter* iter,
+                                     InfSessionProxy* proxy,
+                                     InfRequest* request,
+                                     gpointer user_data)
+{
+  InfTestWarmup* test;
+  test = (InfTestWarmup*)user_data;
+
+  ++test->n_subscribed;
+  if(test->n_subscribed == 2)
+    inf_standalone_io_loop_quit(test->io);
+}
+
+static void
+inf_test_warmup_timeout_func(gpointer user_data)
+{
+  InfTestWarmup* test;
+  test = (InfTestWarmup*)user_data;
+
+  test->timed_out = TRUE;
+  inf_standalone_io_loop_quit(test->io);
+}
+
+static gboolean
+inf_test_warmup_main(const gchar* path,
+                     gpointer user_data,
+                     GError** error)
+{
+  InfTestWarmup test;
+  InfdFilesystemStorage* storage;
+  InfCommunicationManager* communication_manager;
+  InfdDirectory* directory;
+  InfinotedLog* log;
+  InfinotedPluginManager* manager;
+  GKeyFile* options;
+  InfIoTimeout* timeout;
+  InfBrowserIter iter;
+  xmlDocPtr doc;
+  gboolean result;
+  const gchar* const plugins[] = { "warmup", NULL };
+
+  storage = infd_filesystem_storage_new(path);
+
+  if(!inf_test_warmup_write_note(storage, "/a", error) ||
+     !inf_test_warmup_write_note(storage, "/b", error) ||
+     !inf_test_warmup_write_note(storage, "/c", error) ||
+     !inf_test_warmup_write_usage(storage, error))
+  {
+    g_object_unref(storage);
+    return FALSE;
+  }
+
+  test.io = inf_standalone_io_new();
+  test.n_subscribed = 0;
+  test.timed_out = FALSE;
+
+  communication_manager = inf_communication_manager_new();
+  directory = infd_directory_new(
+    INF_IO(test.io),
+    INFD_STORAGE(storage),
+    communication_manager
+  );
+
+  infd_directory_add_plugin(directory, &INF_TEST_WARMUP_PLUGIN);
+
+  g_signal_connect(
+    G_OBJECT(directory),
+    "subscribe-session",
+    G_CALLBACK(inf_test_warmup_subscribe_session_cb),
+    &test
+  );
+
+  /* Only two notes fit, and the most used one does not exist */
+  options = g_key_file_new();
+  g_key_file_set_integer(options, "warmup", "max-notes", 2);
+
+  log = infinoted_log_new();
+  manager = infinoted_plugin_manager_new(directory, log, NULL);
+
+  if(!infinoted_plugin_manager_load(
+       manager,
+       PLUGIN_PATH,
+       plugins,
+       options,
+       error))
+  {
+    g_key_file_free(options);
+    g_object_unref(manager);
+    g_object_unref(log);
+    g_object_unref(directory);
+    g_object_unref(communication_manager);
+    g_object_unref(storage);
+    g_object_unref(test.io);
+    return FALSE;
+  }
+
+  g_key_file_free(options);
+
+  timeout = inf_io_add_timeout(
+    INF_IO(test.io),
+    INF_TEST_WARMUP_TIMEOUT,
+    inf_test_warmup_timeout_func,
+    &test,
+    NULL
+  );
+
+  inf_standalone_io_loop(test.io);
+  g_assert(test.timed_out == FALSE);
+  inf_io_remove_timeout(INF_IO(test.io), timeout);
+
+  g_assert(inf_test_warmup_has_session(INF_BROWSER(directory), "a"));
+  g_assert(inf_test_warmup_has_session(INF_BROWSER(directory), "b"));
+  g_assert(!inf_test_warmup_has_session(INF_BROWSER(directory), "c"));
+  printf("Loaded the next most used note in place of the missing one\n");
+
+  /* InfdDirectory finishes the request before returning */
+  inf_test_warmup_find(INF_BROWSER(directory), "b", &iter);
+  inf_browser_remove_node(INF_BROWSER(directory), &iter, NULL, NULL);
+
+  /* This writes the modified usage counts */
+  g_object_unref(manager);
+  g_object_unref(log);
+
+  doc = infd_filesystem_storage_read_xml_file(
+    storage,
+    "xml",
+    "/warmup-usage",
+    "infinoted-warmup-usage",
+    error
+  );
+
+  result = (doc != NULL);
+  if(result == TRUE)
+  {
+    g_assert(inf_test_warmup_read_count(doc, "/a") == 2);
+    g_assert(inf_test_warmup_read_count(doc, "/b") == 0);
+    g_assert(inf_test_warmup_read_count(doc, "/c") == 0);
+    g_assert(inf_test_warmup_read_count(doc, "/gone") == 0);
+    printf("Decayed, missing and removed notes lost their counts\n");
+
+    xmlFreeDoc(doc);
+  }
+
+  g_signal_handlers_disconnect_by_func(
+    G_OBJECT(directory),
+    G_CALLBACK(inf_test_warmup_subscribe_session_cb),
+    &test
+  );
+
+  g_object_unref(directory);
+  g_object_unref(communication_manager);
+  g_object_unref(storage);
+  g_object_unref(test.io);
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  return inf_test_util_run_in_tmpdir(
+    "inf-test-warmup",
+    inf_test_warmup_main,
+    NULL
+  );
+}
+
+/* vim:set et sw=2 ts=2: */
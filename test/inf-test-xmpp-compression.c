@@ -0,0 +1,532 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Connects an InfXmppConnection client to a server on the loopback
+ * interface with different compression levels on either side, and checks
+ * that stream compression is negotiated only if both sides ask for it. The
+ * client sends large and small messages which the server echoes back, and
+ * they must arrive unmodified. With compression, the client must send
+ * considerably fewer bytes than the messages take as XML text. */
+
+#include <libinfinity/server/infd-tcp-server.h>
+#include <libinfinity/common/inf-xmpp-connection.h>
+#include <libinfinity/common/inf-xml-connection.h>
+#include <libinfinity/common/inf-tcp-connection.h>
+#include <libinfinity/common/inf-ip-address.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define INF_TEST_XMPP_COMPRESSION_N_MESSAGES 32
+/* Length of the text in the large messages */
+#define INF_TEST_XMPP_COMPRESSION_TEXT_LENGTH 4096
+
+typedef struct _InfTestXmppCompression InfTestXmppCompression;
+struct _InfTestXmppCompression {
+  InfStandaloneIo* io;
+  guint server_level;
+  guint threshold;
+
+  InfTcpConnection* client_tcp;
+  InfXmppConnection* client;
+  InfXmppConnection* server;
+
+  /* Serialized form of the messages sent by the client */
+  GPtrArray* expected;
+  gsize expected_bytes;
+  /* Bytes written by the client once the stream was established */
+  gsize sent_bytes;
+  gboolean counting;
+
+  guint n_received;
+  gboolean valid;
+};
+
+typedef enum _InfTestXmppCompressionError {
+  INF_TEST_XMPP_COMPRESSION_ERROR_FAILED
+} InfTestXmppCompressionError;
+
+static GQuark
+inf_test_xmpp_compression_error_quark(void)
+{
+  return g_quark_from_static_string("INF_TEST_XMPP_COMPRESSION_ERROR");
+}
+
+/* Every other message is a large one that compresses well. The others are
+ * below the compression threshold, if any. */
+static xmlNodePtr
+inf_test_xmpp_compression_message_new(guint index)
+{
+  xmlNodePtr group;
+  xmlNodePtr request;
+  xmlNodePtr operation;
+  GString* text;
+  guint i;
+
+  group = xmlNewNode(NULL, (const xmlChar*)"group");
+  inf_xml_util_set_attribute(group, "name", "InfSession_1");
+  inf_xml_util_set_attribute(group, "publisher", "me");
+
+  request = xmlNewChild(group, NULL, (const xmlChar*)"request", NULL);
+  inf_xml_util_set_attribute_uint(request, "user", 1 + index % 3);
+  inf_xml_util_set_attribute(request, "time", "2:1");
+
+  text = g_string_sized_new(INF_TEST_XMPP_COMPRESSION_TEXT_LENGTH);
+  if(index % 2 == 0)
+  {
+    for(i = 0; text->len < INF_TEST_XMPP_COMPRESSION_TEXT_LENGTH; ++i)
+      g_string_append_printf(text, "Line %u of a <text> & more.\n", i);
+  }
+  else
+  {
+    g_string_append(text, "\xc3\xa4");
+  }
+
+  operation = xmlNewChild(request, NULL, (const xmlChar*)"insert", NULL);
+  xmlNodeAddContentLen(operation, (const xmlChar*)text->str, text->len);
+  inf_xml_util_set_attribute_uint(operation, "pos", index);
+
+  g_string_free(text, TRUE);
+  return group;
+}
+
+static void
+inf_test_xmpp_compression_sent_cb(InfTcpConnection* connection,
+                                  gconstpointer data,
+                                  guint len,
+                                  gpointer user_data)
+{
+  InfTestXmppCompression* test;
+  test = (InfTestXmppCompression*)user_data;
+
+  if(test->counting)
+    test->sent_bytes += len;
+}
+
+static void
+inf_test_xmpp_compression_client_received_cb(InfXmlConnection* connection,
+                                             xmlNodePtr xml,
+                                             gpointer user_data)
+{
+  InfTestXmppCompression* test;
+  GBytes* bytes;
+
+  test = (InfTestXmppCompression*)user_data;
+
+  if(test->n_received >= test->expected->len)
+  {
+    test->valid = FALSE;
+    return;
+  }
+
+  bytes = inf_xml_util_node_to_bytes(xml);
+  if(!g_bytes_equal(bytes, g_ptr_array_index(test->expected, test->n_received)))
+    test->valid = FALSE;
+  g_bytes_unref(bytes);
+
+  ++test->n_received;
+  if(test->n_received == INF_TEST_XMPP_COMPRESSION_N_MESSAGES)
+    inf_standalone_io_loop_quit(test->io);
+}
+
+static void
+inf_test_xmpp_compression_server_received_cb(InfXmlConnection* connection,
+                                             xmlNodePtr xml,
+                                             gpointer user_data)
+{
+  inf_xml_connection_send(connection, xmlCopyNode(xml, 1));
+}
+
+static void
+inf_test_xmpp_compression_notify_status_cb(InfXmlConnection* connection,
+                                           GParamSpec* pspec,
+                                           gpointer user_data)
+{
+  InfTestXmppCompression* test;
+  InfXmlConnectionStatus status;
+  xmlNodePtr xml;
+  GBytes* bytes;
+  guint i;
+
+  test = (InfTestXmppCompression*)user_data;
+  g_object_get(G_OBJECT(connection), "status", &status, NULL);
+
+  switch(status)
+  {
+  case INF_XML_CONNECTION_OPEN:
+    test->counting = TRUE;
+    for(i = 0; i < INF_TEST_XMPP_COMPRESSION_N_MESSAGES; ++i)
+    {
+      xml = inf_test_xmpp_compression_message_new(i);
+      bytes = inf_xml_util_node_to_bytes(xml);
+      test->expected_bytes += g_bytes_get_size(bytes);
+      g_ptr_array_add(test->expected, bytes);
+
+      inf_xml_connection_send(connection, xml);
+    }
+
+    break;
+  case INF_XML_CONNECTION_CLOSED:
+    /* The connection went down before all messages were received */
+    inf_standalone_io_loop_quit(test->io);
+    break;
+  case INF_XML_CONNECTION_OPENING:
+  case INF_XML_CONNECTION_CLOSING:
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
+}
+
+static void
+inf_test_xmpp_compression_error_cb(InfXmlConnection* connection,
+                                   GError* error,
+                                   gpointer user_data)
+{
+  fprintf(stderr, "Connection error occured: %s\n", error->message);
+}
+
+static void
+inf_test_xmpp_compression_new_connection_cb(InfdTcpServer* server,
+                                            InfTcpConnection* connection,
+                                            gpointer user_data)
+{
+  InfTestXmppCompression* test;
+  test = (InfTestXmppCompression*)user_data;
+
+  g_assert(test->server == NULL);
+
+  test->server = INF_XMPP_CONNECTION(
+    g_object_new(
+      INF_TYPE_XMPP_CONNECTION,
+      "tcp-connection", connection,
+      "site", INF_XMPP_CONNECTION_SERVER,
+      "local-hostname", "localhost",
+      "remote-hostname", "localhost",
+      "security-policy", INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED,
+      "binary-frames", FALSE,
+      "compression-level", test->server_level,
+      "compression-threshold", test->threshold,
+      NULL
+    )
+  );
+
+  g_signal_connect(
+    G_OBJECT(test->server),
+    "received",
+    G_CALLBACK(inf_test_xmpp_compression_server_received_cb),
+    test
+  );
+}
+
+static gboolean
+inf_test_xmpp_compression_run(InfdTcpServer* server,
+                              guint port,
+                              guint server_level,
+                              guint client_level,
+                              guint threshold,
+                              GError** error)
+{
+  InfTestXmppCompression test;
+  InfIpAddress* addr;
+  gboolean expect_compressed;
+  gboolean client_compressed;
+  gboolean server_compressed;
+  gboolean result;
+
+  g_object_get(G_OBJECT(server), "io", &test.io, NULL);
+  test.server_level = server_level;
+  test.threshold = threshold;
+  test.server = NULL;
+  test.expected = g_ptr_array_new_with_free_func(
+    (GDestroyNotify)g_bytes_unref
+  );
+  test.expected_bytes = 0;
+  test.sent_bytes = 0;
+  test.counting = FALSE;
+  test.n_received = 0;
+  test.valid = TRUE;
+
+  g_signal_connect(
+    G_OBJECT(server),
+    "new-connection",
+    G_CALLBACK(inf_test_xmpp_compression_new_connection_cb),
+    &test
+  );
+
+  addr = inf_ip_address_new_loopback4();
+  test.client_tcp = inf_tcp_connection_new_and_open(
+    INF_IO(test.io),
+    addr,
+    port,
+    error
+  );
+  inf_ip_address_free(addr);
+
+  if(test.client_tcp == NULL)
+  {
+    g_signal_handlers_disconnect_by_func(
+      G_OBJECT(server),
+      G_CALLBACK(inf_test_xmpp_compression_new_connection_cb),
+      &test
+    );
+
+    g_ptr_array_unref(test.expected);
+    g_object_unref(test.io);
+    return FALSE;
+  }
+
+  test.client = INF_XMPP_CONNECTION(
+    g_object_new(
+      INF_TYPE_XMPP_CONNECTION,
+      "tcp-connection", test.client_tcp,
+      "site", INF_XMPP_CONNECTION_CLIENT,
+      "remote-hostname", "localhost",
+      "security-policy", INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED,
+      "binary-frames", FALSE,
+      "compression-level", client_level,
+      "compression-threshold", threshold,
+      NULL
+    )
+  );
+
+  g_signal_connect(
+    G_OBJECT(test.client_tcp),
+    "sent",
+    G_CALLBACK(inf_test_xmpp_compression_sent_cb),
+    &test
+  );
+
+  g_signal_connect(
+    G_OBJECT(test.client),
+    "error",
+    G_CALLBACK(inf_test_xmpp_compression_error_cb),
+    &test
+  );
+
+  g_signal_connect(
+    G_OBJECT(test.client),
+    "notify::status",
+    G_CALLBACK(inf_test_xmpp_compression_notify_status_cb),
+    &test
+  );
+
+  g_signal_connect(
+    G_OBJECT(test.client),
+    "received",
+    G_CALLBACK(inf_test_xmpp_compression_client_received_cb),
+    &test
+  );
+
+  inf_standalone_io_loop(test.io);
+
+  expect_compressed = (server_level > 0 && client_level > 0);
+  g_object_get(
+    G_OBJECT(test.client),
+    "compression-enabled", &client_compressed,
+    NULL
+  );
+
+  server_compressed = FALSE;
+  if(test.server != NULL)
+  {
+    g_object_get(
+      G_OBJECT(test.server),
+      "compression-enabled", &server_compressed,
+      NULL
+    );
+  }
+
+  result = FALSE;
+  if(test.n_received != INF_TEST_XMPP_COMPRESSION_N_MESSAGES ||
+     test.valid == FALSE)
+  {
+    g_set_error(
+      error,
+      inf_test_xmpp_compression_error_quark(),
+      INF_TEST_XMPP_COMPRESSION_ERROR_FAILED,
+      "%u of %u messages received%s",
+      test.n_received,
+      INF_TEST_XMPP_COMPRESSION_N_MESSAGES,
+      test.valid ? "" : ", some of them modified"
+    );
+  }
+  else if(client_compressed != expect_compressed ||
+          server_compressed != expect_compressed)
+  {
+    g_set_error(
+      error,
+      inf_test_xmpp_compression_error_quark(),
+      INF_TEST_XMPP_COMPRESSION_ERROR_FAILED,
+      "Compression is %s on the client and %s on the server, expected %s",
+      client_compressed ? "enabled" : "disabled",
+      server_compressed ? "enabled" : "disabled",
+      expect_compressed ? "enabled" : "disabled"
+    );
+  }
+  else if(expect_compressed && test.sent_bytes * 2 > test.expected_bytes)
+  {
+    g_set_error(
+      error,
+      inf_test_xmpp_compression_error_quark(),
+      INF_TEST_XMPP_COMPRESSION_ERROR_FAILED,
+      "Sent %" G_GSIZE_FORMAT " bytes for %" G_GSIZE_FORMAT " bytes of "
+      "messages, which is hardly compressed",
+      test.sent_bytes,
+      test.expected_bytes
+    );
+  }
+  else if(!expect_compressed && test.sent_bytes < test.expected_bytes)
+  {
+    g_set_error(
+      error,
+      inf_test_xmpp_compression_error_quark(),
+      INF_TEST_XMPP_COMPRESSION_ERROR_FAILED,
+      "Sent only %" G_GSIZE_FORMAT " bytes for %" G_GSIZE_FORMAT " bytes of "
+      "messages without compression",
+      test.sent_bytes,
+      test.expected_bytes
+    );
+  }
+  else
+  {
+    result = TRUE;
+  }
+
+  printf(
+    "Levels %u/%u, threshold %u: %" G_GSIZE_FORMAT " bytes sent for %"
+    G_GSIZE_FORMAT " bytes of messages, %s\n",
+    server_level,
+    client_level,
+    threshold,
+    test.sent_bytes,
+    test.expected_bytes,
+    result ? "OK" : "FAILED"
+  );
+
+  g_signal_handlers_disconnect_by_func(
+    G_OBJECT(server),
+    G_CALLBACK(inf_test_xmpp_compression_new_connection_cb),
+    &test
+  );
+
+  g_signal_handlers_disconnect_by_func(
+    G_OBJECT(test.client_tcp),
+    G_CALLBACK(inf_test_xmpp_compression_sent_cb),
+    &test
+  );
+
+  g_signal_handlers_disconnect_by_func(
+    G_OBJECT(test.client),
+    G_CALLBACK(inf_test_xmpp_compression_notify_status_cb),
+    &test
+  );
+
+  g_signal_handlers_disconnect_by_func(
+    G_OBJECT(test.client),
+    G_CALLBACK(inf_test_xmpp_compression_client_received_cb),
+    &test
+  );
+
+  g_object_unref(test.client);
+  g_object_unref(test.client_tcp);
+
+  if(test.server != NULL)
+  {
+    g_signal_handlers_disconnect_by_func(
+      G_OBJECT(test.server),
+      G_CALLBACK(inf_test_xmpp_compression_server_received_cb),
+      &test
+    );
+
+    g_object_unref(test.server);
+  }
+
+  g_ptr_array_unref(test.expected);
+  g_object_unref(test.io);
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  InfStandaloneIo* io;
+  InfdTcpServer* tcp;
+  InfIpAddress* addr;
+  guint port;
+  GError* error;
+  int ret;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  io = inf_standalone_io_new();
+  addr = inf_ip_address_new_loopback4();
+
+  tcp = g_object_new(
+    INFD_TYPE_TCP_SERVER,
+    "io", io,
+    "local-address", addr,
+    "local-port", 0,
+    NULL
+  );
+
+  inf_ip_address_free(addr);
+
+  ret = 0;
+  if(infd_tcp_server_open(tcp, &error) == FALSE)
+  {
+    fprintf(stderr, "Could not open server: %s\n", error->message);
+    g_error_free(error);
+    ret = -1;
+  }
+  else
+  {
+    g_object_get(G_OBJECT(tcp), "local-port", &port, NULL);
+
+    /* Compression needs to be requested by both sides. With a threshold,
+     * the small messages are stored without compressing them, while the
+     * large ones are still compressed. */
+    if(!inf_test_xmpp_compression_run(tcp, port, 6, 6, 0, &error) ||
+       !inf_test_xmpp_compression_run(tcp, port, 6, 0, 0, &error) ||
+       !inf_test_xmpp_compression_run(tcp, port, 0, 6, 0, &error) ||
+       !inf_test_xmpp_compression_run(tcp, port, 1, 9, 256, &error))
+    {
+      fprintf(stderr, "%s\n", error->message);
+      g_error_free(error);
+      ret = -1;
+    }
+
+    infd_tcp_server_close(tcp);
+  }
+
+  g_object_unref(tcp);
+  g_object_unref(io);
+  return ret;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,621 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Connects InfXmppConnections on the loopback interface, with binary frames
+ * enabled or disabled on either side, and checks that binary frames are
+ * only put on the wire if both sides accept them. The first client sends
+ * messages with and without a compact form, and the server echoes each of
+ * them to all clients, either with inf_xml_connection_send() or with
+ * inf_xml_connection_send_serialized() sharing one serialization between
+ * all connections. Every client must receive the messages unmodified. */
+
+#include <libinfinity/server/infd-tcp-server.h>
+#include <libinfinity/common/inf-xmpp-connection.h>
+#include <libinfinity/common/inf-xml-connection.h>
+#include <libinfinity/common/inf-tcp-connection.h>
+#include <libinfinity/common/inf-ip-address.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define INF_TEST_XMPP_FRAMES_MAX_CLIENTS 2
+#define INF_TEST_XMPP_FRAMES_N_MESSAGES 16
+
+typedef struct _InfTestXmppFrames InfTestXmppFrames;
+
+/* One end of a connection */
+typedef struct _InfTestXmppFramesSite InfTestXmppFramesSite;
+struct _InfTestXmppFramesSite {
+  InfTestXmppFrames* test;
+  InfTcpConnection* tcp;
+  InfXmppConnection* xmpp;
+
+  gboolean binary_frames;
+  /* Whether a zero byte, which starts a binary frame and cannot occur in
+   * XML text, has been sent */
+  gboolean framed;
+  guint n_received;
+};
+
+struct _InfTestXmppFrames {
+  InfStandaloneIo* io;
+  gboolean server_binary_frames;
+
+  InfTestXmppFramesSite clients[INF_TEST_XMPP_FRAMES_MAX_CLIENTS];
+  guint n_clients;
+  guint n_open;
+
+  InfTestXmppFramesSite servers[INF_TEST_XMPP_FRAMES_MAX_CLIENTS];
+  guint n_servers;
+
+  /* Serialized form of the messages sent by the first client */
+  GPtrArray* expected;
+  /* Messages echoed with inf_xml_connection_send_serialized() */
+  GSList* serialized;
+  gboolean valid;
+};
+
+typedef enum _InfTestXmppFramesError {
+  INF_TEST_XMPP_FRAMES_ERROR_FAILED
+} InfTestXmppFramesError;
+
+static GQuark
+inf_test_xmpp_frames_error_quark(void)
+{
+  return g_quark_from_static_string("INF_TEST_XMPP_FRAMES_ERROR");
+}
+
+/* Messages with an even index have a compact form, the others do not */
+static xmlNodePtr
+inf_test_xmpp_frames_message_new(guint index)
+{
+  xmlNodePtr group;
+  xmlNodePtr request;
+  xmlNodePtr operation;
+
+  group = xmlNewNode(NULL, (const xmlChar*)"group");
+  inf_xml_util_set_attribute(group, "name", "InfSession_1");
+  inf_xml_util_set_attribute(group, "publisher", "me");
+
+  request = xmlNewChild(group, NULL, (const xmlChar*)"request", NULL);
+  inf_xml_util_set_attribute_uint(request, "user", 1 + index % 3);
+  inf_xml_util_set_attribute(request, "time", "2:1");
+
+  if(index % 2 == 0)
+  {
+    operation = xmlNewChild(
+      request,
+      NULL,
+      (const xmlChar*)"insert-caret",
+      (const xmlChar*)"\xc3\xa4"
+    );
+  }
+  else
+  {
+    operation = xmlNewChild(
+      request,
+      NULL,
+      (const xmlChar*)"insert",
+      (const xmlChar*)"<text> & more"
+    );
+  }
+
+  inf_xml_util_set_attribute_uint(operation, "pos", index);
+  return group;
+}
+
+static void
+inf_test_xmpp_frames_sent_cb(InfTcpConnection* connection,
+                             gconstpointer data,
+                             guint len,
+                             gpointer user_data)
+{
+  InfTestXmppFramesSite* site;
+  site = (InfTestXmppFramesSite*)user_data;
+
+  if(memchr(data, '\0', len) != NULL)
+    site->framed = TRUE;
+}
+
+static void
+inf_test_xmpp_frames_client_received_cb(InfXmlConnection* connection,
+                                        xmlNodePtr xml,
+                                        gpointer user_data)
+{
+  InfTestXmppFramesSite* site;
+  InfTestXmppFrames* test;
+  GBytes* bytes;
+  guint i;
+
+  site = (InfTestXmppFramesSite*)user_data;
+  test = site->test;
+
+  if(site->n_received >= test->expected->len)
+  {
+    test->valid = FALSE;
+    return;
+  }
+
+  bytes = inf_xml_util_node_to_bytes(xml);
+  if(!g_bytes_equal(bytes, g_ptr_array_index(test->expected, site->n_received)))
+    test->valid = FALSE;
+  g_bytes_unref(bytes);
+
+  ++site->n_received;
+
+  for(i = 0; i < test->n_clients; ++i)
+    if(test->clients[i].n_received < INF_TEST_XMPP_FRAMES_N_MESSAGES)
+      return;
+
+  inf_standalone_io_loop_quit(test->io);
+}
+
+static void
+inf_test_xmpp_frames_server_received_cb(InfXmlConnection* connection,
+                                        xmlNodePtr xml,
+                                        gpointer user_data)
+{
+  InfTestXmppFramesSite* site;
+  InfTestXmppFrames* test;
+  InfXmlConnectionStatus status;
+  xmlNodePtr copy;
+  GBytes* bytes;
+  guint i;
+
+  site = (InfTestXmppFramesSite*)user_data;
+  test = site->test;
+
+  /* Echo every other message with a serialization that is shared between
+   * all connections, as InfCommunicationRegistry does for group messages */
+  copy = NULL;
+  bytes = NULL;
+  if(site->n_received % 4 >= 2)
+  {
+    copy = xmlCopyNode(xml, 1);
+    bytes = inf_xml_util_node_to_bytes(copy);
+    test->serialized = g_slist_prepend(test->serialized, copy);
+  }
+
+  for(i = 0; i < test->n_servers; ++i)
+  {
+    g_object_get(G_OBJECT(test->servers[i].xmpp), "status", &status, NULL);
+    if(status != INF_XML_CONNECTION_OPEN)
+      continue;
+
+    if(bytes != NULL)
+    {
+      inf_xml_connection_send_serialized(
+        INF_XML_CONNECTION(test->servers[i].xmpp),
+        copy,
+        bytes
+      );
+    }
+    else
+    {
+      inf_xml_connection_send(
+        INF_XML_CONNECTION(test->servers[i].xmpp),
+        xmlCopyNode(xml, 1)
+      );
+    }
+  }
+
+  if(bytes != NULL)
+    g_bytes_unref(bytes);
+
+  ++site->n_received;
+}
+
+static void
+inf_test_xmpp_frames_notify_status_cb(InfXmlConnection* connection,
+                                      GParamSpec* pspec,
+                                      gpointer user_data)
+{
+  InfTestXmppFrames* test;
+  InfXmlConnectionStatus status;
+  xmlNodePtr xml;
+  guint i;
+
+  test = (InfTestXmppFrames*)user_data;
+  g_object_get(G_OBJECT(connection), "status", &status, NULL);
+
+  switch(status)
+  {
+  case INF_XML_CONNECTION_OPEN:
+    /* Start sending once all clients can receive the echoes */
+    ++test->n_open;
+    if(test->n_open < test->n_clients)
+      break;
+
+    for(i = 0; i < INF_TEST_XMPP_FRAMES_N_MESSAGES; ++i)
+    {
+      xml = inf_test_xmpp_frames_message_new(i);
+      g_ptr_array_add(test->expected, inf_xml_util_node_to_bytes(xml));
+
+      inf_xml_connection_send(
+        INF_XML_CONNECTION(test->clients[0].xmpp),
+        xml
+      );
+    }
+
+    break;
+  case INF_XML_CONNECTION_CLOSED:
+    /* The connection went down before all messages were received */
+    inf_standalone_io_loop_quit(test->io);
+    break;
+  case INF_XML_CONNECTION_OPENING:
+  case INF_XML_CONNECTION_CLOSING:
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
+}
+
+static void
+inf_test_xmpp_frames_error_cb(InfXmlConnection* connection,
+                              GError* error,
+                              gpointer user_data)
+{
+  fprintf(stderr, "Connection error occured: %s\n", error->message);
+}
+
+static void
+inf_test_xmpp_frames_new_connection_cb(InfdTcpServer* server,
+                                       InfTcpConnection* connection,
+                                       gpointer user_data)
+{
+  InfTestXmppFrames* test;
+  InfTestXmppFramesSite* site;
+
+  test = (InfTestXmppFrames*)user_data;
+  g_assert(test->n_servers < test->n_clients);
+
+  site = &test->servers[test->n_servers++];
+  site->test = test;
+  site->tcp = connection;
+  site->binary_frames = test->server_binary_frames;
+  site->framed = FALSE;
+  site->n_received = 0;
+
+  site->xmpp = INF_XMPP_CONNECTION(
+    g_object_new(
+      INF_TYPE_XMPP_CONNECTION,
+      "tcp-connection", connection,
+      "site", INF_XMPP_CONNECTION_SERVER,
+      "local-hostname", "localhost",
+      "remote-hostname", "localhost",
+      "security-policy", INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED,
+      "binary-frames", site->binary_frames,
+      NULL
+    )
+  );
+
+  g_signal_connect(
+    G_OBJECT(site->tcp),
+    "sent",
+    G_CALLBACK(inf_test_xmpp_frames_sent_cb),
+    site
+  );
+
+  g_signal_connect(
+    G_OBJECT(site->xmpp),
+    "received",
+    G_CALLBACK(inf_test_xmpp_frames_server_received_cb),
+    site
+  );
+}
+
+static gboolean
+inf_test_xmpp_frames_run(InfdTcpServer* server,
+                         guint port,
+                         gboolean server_binary_frames,
+                         guint n_clients,
+                         const gboolean* client_binary_frames,
+                         GError** error)
+{
+  InfTestXmppFrames test;
+  InfTestXmppFramesSite* site;
+  InfIpAddress* addr;
+  guint n_framed;
+  guint n_expected_framed;
+  gboolean result;
+  guint i;
+
+  g_object_get(G_OBJECT(server), "io", &test.io, NULL);
+  test.server_binary_frames = server_binary_frames;
+  test.n_clients = 0;
+  test.n_open = 0;
+  test.n_servers = 0;
+  test.expected = g_ptr_array_new_with_free_func(
+    (GDestroyNotify)g_bytes_unref
+  );
+  test.serialized = NULL;
+  test.valid = TRUE;
+
+  g_signal_connect(
+    G_OBJECT(server),
+    "new-connection",
+    G_CALLBACK(inf_test_xmpp_frames_new_connection_cb),
+    &test
+  );
+
+  addr = inf_ip_address_new_loopback4();
+  result = TRUE;
+
+  for(i = 0; i < n_clients && result == TRUE; ++i)
+  {
+    site = &test.clients[i];
+    site->test = &test;
+    site->binary_frames = client_binary_frames[i];
+    site->framed = FALSE;
+    site->n_received = 0;
+
+    site->tcp = inf_tcp_connection_new_and_open(
+      INF_IO(test.io),
+      addr,
+      port,
+      error
+    );
+
+    if(site->tcp == NULL)
+    {
+      result = FALSE;
+      break;
+    }
+
+    site->xmpp = INF_XMPP_CONNECTION(
+      g_object_new(
+        INF_TYPE_XMPP_CONNECTION,
+        "tcp-connection", site->tcp,
+        "site", INF_XMPP_CONNECTION_CLIENT,
+        "remote-hostname", "localhost",
+        "security-policy", INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED,
+        "binary-frames", site->binary_frames,
+        NULL
+      )
+    );
+
+    ++test.n_clients;
+
+    g_signal_connect(
+      G_OBJECT(site->tcp),
+      "sent",
+      G_CALLBACK(inf_test_xmpp_frames_sent_cb),
+      site
+    );
+
+    g_signal_connect(
+      G_OBJECT(site->xmpp),
+      "error",
+      G_CALLBACK(inf_test_xmpp_frames_error_cb),
+      &test
+    );
+
+    g_signal_connect(
+      G_OBJECT(site->xmpp),
+      "notify::status",
+      G_CALLBACK(inf_test_xmpp_frames_notify_status_cb),
+      &test
+    );
+
+    g_signal_connect(
+      G_OBJECT(site->xmpp),
+      "received",
+      G_CALLBACK(inf_test_xmpp_frames_client_received_cb),
+      site
+    );
+  }
+
+  inf_ip_address_free(addr);
+
+  if(result == TRUE)
+  {
+    inf_standalone_io_loop(test.io);
+
+    /* Binary frames are used towards every client which accepts them, if
+     * the server accepts them as well */
+    n_framed = 0;
+    n_expected_framed = 0;
+    for(i = 0; i < test.n_servers; ++i)
+      if(test.servers[i].framed)
+        ++n_framed;
+    for(i = 0; i < test.n_clients; ++i)
+      if(test.clients[i].binary_frames && server_binary_frames)
+        ++n_expected_framed;
+
+    for(i = 0; i < test.n_clients; ++i)
+      if(test.clients[i].n_received != INF_TEST_XMPP_FRAMES_N_MESSAGES)
+        result = FALSE;
+
+    if(result == FALSE || test.valid == FALSE)
+    {
+      g_set_error(
+        error,
+        inf_test_xmpp_frames_error_quark(),
+        INF_TEST_XMPP_FRAMES_ERROR_FAILED,
+        "Not all messages were received unmodified"
+      );
+
+      result = FALSE;
+    }
+    else if(test.clients[0].framed !=
+            (test.clients[0].binary_frames && server_binary_frames))
+    {
+      g_set_error(
+        error,
+        inf_test_xmpp_frames_error_quark(),
+        INF_TEST_XMPP_FRAMES_ERROR_FAILED,
+        "Client %s binary frames",
+        test.clients[0].framed ? "sent unexpected" : "did not send"
+      );
+
+      result = FALSE;
+    }
+    else if(test.n_servers != test.n_clients || n_framed != n_expected_framed)
+    {
+      g_set_error(
+        error,
+        inf_test_xmpp_frames_error_quark(),
+        INF_TEST_XMPP_FRAMES_ERROR_FAILED,
+        "Server sent binary frames to %u instead of %u clients",
+        n_framed,
+        n_expected_framed
+      );
+
+      result = FALSE;
+    }
+  }
+
+  g_signal_handlers_disconnect_by_func(
+    G_OBJECT(server),
+    G_CALLBACK(inf_test_xmpp_frames_new_connection_cb),
+    &test
+  );
+
+  for(i = 0; i < test.n_clients; ++i)
+  {
+    site = &test.clients[i];
+
+    g_signal_handlers_disconnect_by_func(
+      G_OBJECT(site->tcp),
+      G_CALLBACK(inf_test_xmpp_frames_sent_cb),
+      site
+    );
+
+    g_signal_handlers_disconnect_by_func(
+      G_OBJECT(site->xmpp),
+      G_CALLBACK(inf_test_xmpp_frames_notify_status_cb),
+      &test
+    );
+
+    g_signal_handlers_disconnect_by_func(
+      G_OBJECT(site->xmpp),
+      G_CALLBACK(inf_test_xmpp_frames_client_received_cb),
+      site
+    );
+
+    g_object_unref(site->xmpp);
+    g_object_unref(site->tcp);
+  }
+
+  for(i = 0; i < test.n_servers; ++i)
+  {
+    site = &test.servers[i];
+
+    g_signal_handlers_disconnect_by_func(
+      G_OBJECT(site->tcp),
+      G_CALLBACK(inf_test_xmpp_frames_sent_cb),
+      site
+    );
+
+    g_signal_handlers_disconnect_by_func(
+      G_OBJECT(site->xmpp),
+      G_CALLBACK(inf_test_xmpp_frames_server_received_cb),
+      site
+    );
+
+    g_object_unref(site->xmpp);
+  }
+
+  g_slist_free_full(test.serialized, (GDestroyNotify)xmlFreeNode);
+  g_ptr_array_unref(test.expected);
+  g_object_unref(test.io);
+
+  printf(
+    "Server %s binary frames, %u client(s): %s\n",
+    server_binary_frames ? "with" : "without",
+    n_clients,
+    result ? "OK" : "FAILED"
+  );
+
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  static const gboolean with[] = { TRUE, TRUE };
+  static const gboolean without[] = { FALSE, FALSE };
+  static const gboolean mixed[] = { TRUE, FALSE };
+
+  InfStandaloneIo* io;
+  InfdTcpServer* tcp;
+  InfIpAddress* addr;
+  guint port;
+  GError* error;
+  int ret;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  io = inf_standalone_io_new();
+  addr = inf_ip_address_new_loopback4();
+
+  tcp = g_object_new(
+    INFD_TYPE_TCP_SERVER,
+    "io", io,
+    "local-address", addr,
+    "local-port", 0,
+    NULL
+  );
+
+  inf_ip_address_free(addr);
+
+  ret = 0;
+  if(infd_tcp_server_open(tcp, &error) == FALSE)
+  {
+    fprintf(stderr, "Could not open server: %s\n", error->message);
+    g_error_free(error);
+    ret = -1;
+  }
+  else
+  {
+    g_object_get(G_OBJECT(tcp), "local-port", &port, NULL);
+
+    /* Binary frames need to be accepted by both sides. With two clients,
+     * the serialization of a message is shared between the connections,
+     * both if they use the same encoding and if they do not. */
+    if(!inf_test_xmpp_frames_run(tcp, port, TRUE, 1, with, &error) ||
+       !inf_test_xmpp_frames_run(tcp, port, TRUE, 1, without, &error) ||
+       !inf_test_xmpp_frames_run(tcp, port, FALSE, 1, with, &error) ||
+       !inf_test_xmpp_frames_run(tcp, port, FALSE, 1, without, &error) ||
+       !inf_test_xmpp_frames_run(tcp, port, TRUE, 2, with, &error) ||
+       !inf_test_xmpp_frames_run(tcp, port, TRUE, 2, mixed, &error))
+    {
+      fprintf(stderr, "%s\n", error->message);
+      g_error_free(error);
+      ret = -1;
+    }
+
+    infd_tcp_server_close(tcp);
+  }
+
+  g_object_unref(tcp);
+  g_object_unref(io);
+  return ret;
+}
+
+/* vim:set et sw=2 ts=2: */
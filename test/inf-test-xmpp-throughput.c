@@ -0,0 +1,369 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Connects an InfXmppConnection to an InfdXmppServer on the loopback
+ * interface, sends a number of request messages as they occur in a text
+ * session, and measures how many of them the server receives per second.
+ * This is done once with XML text and once with binary frames. */
+
+#include <libinfinity/server/infd-xmpp-server.h>
+#include <libinfinity/server/infd-tcp-server.h>
+#include <libinfinity/common/inf-xmpp-connection.h>
+#include <libinfinity/common/inf-xml-connection.h>
+#include <libinfinity/common/inf-tcp-connection.h>
+#include <libinfinity/common/inf-ip-address.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INF_TEST_XMPP_THROUGHPUT_DEFAULT_STANZAS 100000
+
+typedef struct _InfTestXmppThroughput InfTestXmppThroughput;
+struct _InfTestXmppThroughput {
+  InfStandaloneIo* io;
+  InfXmlConnection* server_connection;
+
+  guint n_stanzas;
+  guint n_received;
+  gboolean valid;
+
+  gint64 start_time;
+  gint64 end_time;
+};
+
+static xmlNodePtr
+inf_test_xmpp_throughput_stanza_new(guint index)
+{
+  xmlNodePtr group;
+  xmlNodePtr request;
+  xmlNodePtr operation;
+
+  group = xmlNewNode(NULL, (const xmlChar*)"group");
+  inf_xml_util_set_attribute(group, "name", "InfSession_1");
+  inf_xml_util_set_attribute(group, "publisher", "me");
+
+  request = xmlNewChild(group, NULL, (const xmlChar*)"request", NULL);
+  inf_xml_util_set_attribute_uint(request, "user", 1 + index % 3);
+  inf_xml_util_set_attribute(request, "time", "2:1");
+
+  operation = xmlNewChild(
+    request,
+    NULL,
+    (const xmlChar*)"insert-caret",
+    (const xmlChar*)"a"
+  );
+
+  inf_xml_util_set_attribute_uint(operation, "pos", index % 1000);
+  return group;
+}
+
+static void
+inf_test_xmpp_throughput_received_cb(InfXmlConnection* connection,
+                                     xmlNodePtr xml,
+                                     gpointer user_data)
+{
+  InfTestXmppThroughput* test;
+  guint pos;
+
+  test = (InfTestXmppThroughput*)user_data;
+
+  /* Check that the messages arrive as they were sent */
+  if(strcmp((const char*)xml->name, "group") != 0 ||
+     xml->children == NULL || xml->children->children == NULL ||
+     !inf_xml_util_get_attribute_uint(
+       xml->children->children,
+       "pos",
+       &pos,
+       NULL) ||
+     pos != test->n_received % 1000)
+  {
+    test->valid = FALSE;
+  }
+
+  ++ test->n_received;
+  if(test->n_received == test->n_stanzas)
+  {
+    test->end_time = g_get_monotonic_time();
+    inf_standalone_io_loop_quit(test->io);
+  }
+}
+
+static void
+inf_test_xmpp_throughput_new_connection_cb(InfdXmlServer* server,
+                                           InfXmlConnection* connection,
+                                           gpointer user_data)
+{
+  InfTestXmppThroughput* test;
+  test = (InfTestXmppThroughput*)user_data;
+
+  g_assert(test->server_connection == NULL);
+  test->server_connection = connection;
+  g_object_ref(connection);
+
+  g_signal_connect(
+    G_OBJECT(connection),
+    "received",
+    G_CALLBACK(inf_test_xmpp_throughput_received_cb),
+    test
+  );
+}
+
+static void
+inf_test_xmpp_throughput_notify_status_cb(InfXmlConnection* connection,
+                                          GParamSpec* pspec,
+                                          gpointer user_data)
+{
+  InfTestXmppThroughput* test;
+  InfXmlConnectionStatus status;
+  guint i;
+
+  test = (InfTestXmppThroughput*)user_data;
+  g_object_get(G_OBJECT(connection), "status", &status, NULL);
+
+  switch(status)
+  {
+  case INF_XML_CONNECTION_OPEN:
+    test->start_time = g_get_monotonic_time();
+    for(i = 0; i < test->n_stanzas; ++i)
+    {
+      inf_xml_connection_send(
+        connection,
+        inf_test_xmpp_throughput_stanza_new(i)
+      );
+    }
+
+    break;
+  case INF_XML_CONNECTION_CLOSED:
+    /* The connection went down before all messages were received */
+    if(test->n_received < test->n_stanzas)
+      inf_standalone_io_loop_quit(test->io);
+    break;
+  case INF_XML_CONNECTION_OPENING:
+  case INF_XML_CONNECTION_CLOSING:
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
+}
+
+static void
+inf_test_xmpp_throughput_error_cb(InfXmlConnection* connection,
+                                  GError* error,
+                                  gpointer user_data)
+{
+  fprintf(stderr, "Connection error occured: %s\n", error->message);
+}
+
+static gboolean
+inf_test_xmpp_throughput_run(InfTestXmppThroughput* test,
+                             InfdXmppServer* server,
+                             guint port,
+                             gboolean binary_frames,
+                             GError** error)
+{
+  InfIpAddress* addr;
+  InfTcpConnection* tcp;
+  InfXmppConnection* xmpp;
+  gulong handler;
+  gdouble seconds;
+  gboolean result;
+
+  test->server_connection = NULL;
+  test->n_received = 0;
+  test->valid = TRUE;
+  test->start_time = 0;
+  test->end_time = 0;
+
+  handler = g_signal_connect(
+    G_OBJECT(server),
+    "new-connection",
+    G_CALLBACK(inf_test_xmpp_throughput_new_connection_cb),
+    test
+  );
+
+  addr = inf_ip_address_new_loopback4();
+  tcp = inf_tcp_connection_new_and_open(INF_IO(test->io), addr, port, error);
+  inf_ip_address_free(addr);
+
+  if(tcp == NULL)
+  {
+    g_signal_handler_disconnect(G_OBJECT(server), handler);
+    return FALSE;
+  }
+
+  xmpp = INF_XMPP_CONNECTION(
+    g_object_new(
+      INF_TYPE_XMPP_CONNECTION,
+      "tcp-connection", tcp,
+      "site", INF_XMPP_CONNECTION_CLIENT,
+      "remote-hostname", "localhost",
+      "security-policy", INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED,
+      "binary-frames", binary_frames,
+      NULL
+    )
+  );
+
+  g_signal_connect(
+    G_OBJECT(xmpp),
+    "error",
+    G_CALLBACK(inf_test_xmpp_throughput_error_cb),
+    test
+  );
+
+  g_signal_connect(
+    G_OBJECT(xmpp),
+    "notify::status",
+    G_CALLBACK(inf_test_xmpp_throughput_notify_status_cb),
+    test
+  );
+
+  inf_standalone_io_loop(test->io);
+
+  result = (test->n_received == test->n_stanzas && test->valid == TRUE);
+  if(result == TRUE)
+  {
+    seconds = (test->end_time - test->start_time) / 1e6;
+    printf(
+      "%s: %u stanzas in %.3f s, %.0f stanzas/s\n",
+      binary_frames ? "Binary frames" : "XML text",
+      test->n_stanzas,
+      seconds,
+      seconds > 0 ? test->n_stanzas / seconds : 0.0
+    );
+  }
+  else
+  {
+    g_set_error(
+      error,
+      g_quark_from_static_string("INF_TEST_XMPP_THROUGHPUT_ERROR"),
+      0,
+      "%u of %u stanzas received%s",
+      test->n_received,
+      test->n_stanzas,
+      test->valid ? "" : ", some of them modified"
+    );
+  }
+
+  g_signal_handlers_disconnect_by_func(
+    G_OBJECT(xmpp),
+    G_CALLBACK(inf_test_xmpp_throughput_notify_status_cb),
+    test
+  );
+
+  if(test->server_connection != NULL)
+  {
+    g_signal_handlers_disconnect_by_func(
+      G_OBJECT(test->server_connection),
+      G_CALLBACK(inf_test_xmpp_throughput_received_cb),
+      test
+    );
+
+    g_object_unref(test->server_connection);
+  }
+
+  g_signal_handler_disconnect(G_OBJECT(server), handler);
+  g_object_unref(xmpp);
+  g_object_unref(tcp);
+
+  return result;
+}
+
+int main(int argc, char* argv[])
+{
+  InfTestXmppThroughput test;
+  InfdTcpServer* tcp;
+  InfdXmppServer* server;
+  InfIpAddress* addr;
+  guint port;
+  GError* error;
+  int ret;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  test.n_stanzas = INF_TEST_XMPP_THROUGHPUT_DEFAULT_STANZAS;
+  if(argc > 1)
+    test.n_stanzas = strtoul(argv[1], NULL, 10);
+
+  if(test.n_stanzas == 0)
+  {
+    fprintf(stderr, "Usage: %s [number-of-stanzas]\n", argv[0]);
+    return -1;
+  }
+
+  test.io = inf_standalone_io_new();
+  addr = inf_ip_address_new_loopback4();
+
+  tcp = g_object_new(
+    INFD_TYPE_TCP_SERVER,
+    "io", test.io,
+    "local-address", addr,
+    "local-port", 0,
+    NULL
+  );
+
+  inf_ip_address_free(addr);
+
+  ret = 0;
+  if(infd_tcp_server_open(tcp, &error) == FALSE)
+  {
+    fprintf(stderr, "Could not open server: %s\n", error->message);
+    g_error_free(error);
+    ret = -1;
+  }
+  else
+  {
+    g_object_get(G_OBJECT(tcp), "local-port", &port, NULL);
+
+    server = infd_xmpp_server_new(
+      tcp,
+      INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED,
+      NULL,
+      NULL,
+      NULL
+    );
+
+    if(!inf_test_xmpp_throughput_run(&test, server, port, FALSE, &error) ||
+       !inf_test_xmpp_throughput_run(&test, server, port, TRUE, &error))
+    {
+      fprintf(stderr, "%s\n", error->message);
+      g_error_free(error);
+      ret = -1;
+    }
+
+    infd_xml_server_close(INFD_XML_SERVER(server));
+    g_object_unref(server);
+  }
+
+  g_object_unref(tcp);
+  g_object_unref(test.io);
+  return ret;
+}
+
+/* vim:set et sw=2 ts=2: */
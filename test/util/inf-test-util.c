@@ -24,7 +24,10 @@
 #include <libinftext/inf-text-delete-operation.h>
 
 #include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-file-util.h>
+#include <libinfinity/common/inf-init.h>
 
+#include <stdio.h>
 #include <string.h>
 
 static int
@@ -277,4 +280,57 @@ inf_test_util_parse_user(xmlNodePtr xml,
   return TRUE;
 }
 
+/* Initializes libinfinity, and calls func with the path of a new, empty
+ * temporary directory whose name starts with name. The directory and
+ * everything func has put into it is removed afterwards. Errors are
+ * printed to stderr. Returns the exit status for main(). */
+int
+inf_test_util_run_in_tmpdir(const gchar* name,
+                            InfTestUtilTmpdirFunc func,
+                            gpointer user_data)
+{
+  gchar* tmpl;
+  gchar* path;
+  GError* error;
+  int ret;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  tmpl = g_strdup_printf("%s-XXXXXX", name);
+  path = g_dir_make_tmp(tmpl, &error);
+  g_free(tmpl);
+
+  if(path == NULL)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  ret = 0;
+  if(!func(path, user_data, &error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    error = NULL;
+    ret = -1;
+  }
+
+  if(!inf_file_util_delete_directory(path, &error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    ret = -1;
+  }
+
+  g_free(path);
+  return ret;
+}
+
 /* vim:set et sw=2 ts=2: */
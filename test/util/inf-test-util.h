@@ -27,6 +27,10 @@
 
 G_BEGIN_DECLS
 
+typedef gboolean(*InfTestUtilTmpdirFunc)(const gchar* path,
+                                         gpointer user_data,
+                                         GError** error);
+
 typedef enum {
   INF_TEST_UTIL_PARSE_ERROR_UNEXPECTED_NODE,
   INF_TEST_UTIL_PARSE_ERROR_USER_ALREADY_EXISTS
@@ -59,6 +63,11 @@ inf_test_util_parse_user(xmlNodePtr xml,
                          GSList** users,
                          GError** error);
 
+int
+inf_test_util_run_in_tmpdir(const gchar* name,
+                            InfTestUtilTmpdirFunc func,
+                            gpointer user_data);
+
 G_END_DECLS
 
 #endif /* __INF_TEST_UTIL_H__ */